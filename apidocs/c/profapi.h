@@ -11,6 +11,9 @@ List of all hooks which plugins may implement: {@link profhooks.h}
 /** Type representing a window, used for referencing windows created by the plugin */
 typedef char* PROF_WIN_TAG;
 
+/** Type representing a received stanza, passed read-only to the prof_on_*_stanza_receive_parsed hooks */
+typedef void* PROF_STANZA;
+
 /** Type representing a function pointer to a command callback */
 typedef void(*CMD_CB)(char **args);
 
@@ -156,6 +159,21 @@ Retrieve nicknames of all occupants in a chat room, when in a chat room window.
 */
 char** prof_get_current_occupants(void);
 
+/**
+Retrieve hook latency statistics for all plugins, slowest first.
+Each entry is a tab separated line: plugin, hook, calls, total, average, 99th percentile and maximum run time in microseconds.
+@return NULL terminated list of statistics lines, the caller must free each line and the list
+*/
+char** prof_get_plugin_stats(void);
+
+/**
+Retrieve runtime counters, the same ones shown by /stats.
+Each entry is a tab separated line of a metric, in Prometheus text format including its labels, and its value, e.g. profanity_stanzas_received_total{type="message"} followed by the count.
+Timings are in microseconds.
+@return NULL terminated list of statistics lines, the caller must free each line and the list
+*/
+char** prof_get_stats(void);
+
 /**
 Retrieve current nickname used in chat room.
 @param barejid The room's Jabber ID
@@ -235,6 +253,65 @@ Send an XMPP stanza
 */
 int prof_send_stanza(char *stanza);
 
+/**
+Get the element name of a stanza
+@param stanza the stanza or one of its children
+@return the name, or NULL, owned by the stanza
+*/
+const char* prof_stanza_get_name(PROF_STANZA stanza);
+
+/**
+Get the namespace of a stanza
+@param stanza the stanza or one of its children
+@return the namespace, or NULL, owned by the stanza
+*/
+const char* prof_stanza_get_ns(PROF_STANZA stanza);
+
+/**
+Get an attribute of a stanza
+@param stanza the stanza or one of its children
+@param name the attribute name
+@return the attribute value, or NULL, owned by the stanza
+*/
+const char* prof_stanza_get_attribute(PROF_STANZA stanza, const char *name);
+
+/**
+Get the first child of a stanza with the given name and namespace
+@param stanza the stanza or one of its children
+@param name the element name, or NULL to match any
+@param ns the namespace, or NULL to match any
+@return the child, or NULL if there is none
+*/
+PROF_STANZA prof_stanza_get_child(PROF_STANZA stanza, const char *name, const char *ns);
+
+/**
+Get the first child of a stanza
+@param stanza the stanza or one of its children
+@return the first child, or NULL if there is none
+*/
+PROF_STANZA prof_stanza_get_children(PROF_STANZA stanza);
+
+/**
+Get the next sibling of a stanza
+@param stanza one of the children of a stanza
+@return the next sibling, or NULL if there is none
+*/
+PROF_STANZA prof_stanza_get_next(PROF_STANZA stanza);
+
+/**
+Get the text content of a stanza
+@param stanza the stanza or one of its children
+@return the text, or NULL, the caller must free it
+*/
+char* prof_stanza_get_text(PROF_STANZA stanza);
+
+/**
+Serialise a stanza to XML
+@param stanza the stanza or one of its children
+@return the XML text, or NULL, the caller must free it
+*/
+char* prof_stanza_to_text(PROF_STANZA stanza);
+
 /**
 Get a boolean setting
 Settings must be specified in ~/.local/share/profanity/plugin_settings
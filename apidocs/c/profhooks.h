@@ -189,6 +189,28 @@ Called when an XMPP iq stanza is received
 */
 int prof_on_iq_stanza_receive(const char *const stanza);
 
+/**
+Called when an XMPP message stanza is received, with the parsed stanza instead of its text.
+Only serialised for plugins that implement prof_on_message_stanza_receive.
+@param stanza The stanza received, read-only and valid until the hook returns
+@return 1 if Profanity should continue to process the message stanza, 0 otherwise
+*/
+int prof_on_message_stanza_receive_parsed(PROF_STANZA stanza);
+
+/**
+Called when an XMPP presence stanza is received, with the parsed stanza instead of its text.
+@param stanza The stanza received, read-only and valid until the hook returns
+@return 1 if Profanity should continue to process the presence stanza, 0 otherwise
+*/
+int prof_on_presence_stanza_receive_parsed(PROF_STANZA stanza);
+
+/**
+Called when an XMPP iq stanza is received, with the parsed stanza instead of its text.
+@param stanza The stanza received, read-only and valid until the hook returns
+@return 1 if Profanity should continue to process the iq stanza, 0 otherwise
+*/
+int prof_on_iq_stanza_receive_parsed(PROF_STANZA stanza);
+
 /**
 Called when a contact goes offline
 @param barejid Jabber ID of the contact
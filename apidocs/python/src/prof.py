@@ -280,6 +280,28 @@ def get_current_occupants():
     pass
 
 
+def get_plugin_stats():
+    """Retrieve hook latency statistics for all plugins, slowest first.
+
+    Each entry is a tab separated line: plugin, hook, calls, total, average, 99th percentile and maximum run time in microseconds.
+
+    :return: statistics lines, or an empty list if no plugin hooks have run.
+    :rtype: list of str
+    """
+    pass
+
+
+def get_stats():
+    """Retrieve runtime counters, the same ones shown by ``/stats``.
+
+    Each entry is a tab separated line of a metric, in Prometheus text format including its labels, and its value, e.g. ``profanity_stanzas_received_total{type="message"}`` followed by the count. Timings are in microseconds.
+
+    :return: statistics lines
+    :rtype: list of str
+    """
+    pass
+
+
 def get_room_nick(barejid):
     """Retrieve current nickname used in chat room.
 
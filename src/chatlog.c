@@ -52,23 +52,43 @@
 #include "common.h"
 #include "config/files.h"
 #include "config/preferences.h"
+#include "tools/compress.h"
 #include "xmpp/xmpp.h"
 #include "xmpp/muc.h"
 
+// at most this many log files are kept open, least recently used are closed
+#define CHATLOG_MAX_OPEN           32
+// seconds between checks whether an open log file was removed
+#define CHATLOG_EXISTS_CHECK_SECS  5
+// seconds buffered log lines may wait before being written out
+#define CHATLOG_FLUSH_SECS         1
+
 static GHashTable* logs;
 static GHashTable* groupchat_logs;
+static int open_logs = 0;
+static guint flush_timer = 0;
 
 struct dated_chat_log
 {
     gchar* filename;
-    GDateTime* date;
+    gint64 roll_at; // real time of the local midnight the log is rolled at
+    FILE* fp;
+    gint64 last_used;
+    gint64 last_checked;
 };
 
 static gboolean _log_roll_needed(struct dated_chat_log* dated_log);
+static void _chat_log_rolled(const char* const filename);
+static struct dated_chat_log* _chat_log_new(const char* const filename, GDateTime* now);
 static struct dated_chat_log* _create_chatlog(const char* const other, const char* const login);
 static struct dated_chat_log* _create_groupchat_log(const char* const room, const char* const login);
 static void _free_chat_log(struct dated_chat_log* dated_log);
 static gboolean _key_equals(void* key1, void* key2);
+static FILE* _chat_log_file(struct dated_chat_log* dated_log);
+static void _chat_log_file_close(struct dated_chat_log* dated_log);
+static gboolean _chat_log_removed(struct dated_chat_log* dated_log);
+static void _chat_log_schedule_flush(void);
+static gboolean _chat_log_flush_cb(gpointer data);
 static void _chat_log_chat(const char* const login, const char* const other, const gchar* const msg,
                            chat_log_direction_t direction, GDateTime* timestamp, const char* const resourcepart);
 static void _groupchat_log_chat(const gchar* const login, const gchar* const room, const gchar* const nick,
@@ -94,7 +114,7 @@ chat_log_otr_msg_out(const char* const barejid, const char* const msg, const cha
 {
     if (prefs_get_boolean(PREF_CHLOG)) {
         const char* mybarejid = connection_get_barejid();
-        auto_gchar gchar* pref_otr_log = prefs_get_string(PREF_OTR_LOG);
+        const gchar* pref_otr_log = prefs_peek_string(PREF_OTR_LOG);
         if (strcmp(pref_otr_log, "on") == 0) {
             _chat_log_chat(mybarejid, barejid, msg, PROF_OUT_LOG, NULL, resource);
         } else if (strcmp(pref_otr_log, "redact") == 0) {
@@ -108,7 +128,7 @@ chat_log_pgp_msg_out(const char* const barejid, const char* const msg, const cha
 {
     if (prefs_get_boolean(PREF_CHLOG)) {
         const char* mybarejid = connection_get_barejid();
-        auto_gchar gchar* pref_pgp_log = prefs_get_string(PREF_PGP_LOG);
+        const gchar* pref_pgp_log = prefs_peek_string(PREF_PGP_LOG);
         if (strcmp(pref_pgp_log, "on") == 0) {
             _chat_log_chat(mybarejid, barejid, msg, PROF_OUT_LOG, NULL, resource);
         } else if (strcmp(pref_pgp_log, "redact") == 0) {
@@ -122,7 +142,7 @@ chat_log_omemo_msg_out(const char* const barejid, const char* const msg, const c
 {
     if (prefs_get_boolean(PREF_CHLOG)) {
         const char* mybarejid = connection_get_barejid();
-        auto_gchar gchar* pref_omemo_log = prefs_get_string(PREF_OMEMO_LOG);
+        const gchar* pref_omemo_log = prefs_peek_string(PREF_OMEMO_LOG);
         if (strcmp(pref_omemo_log, "on") == 0) {
             _chat_log_chat(mybarejid, barejid, msg, PROF_OUT_LOG, NULL, resource);
         } else if (strcmp(pref_omemo_log, "redact") == 0) {
@@ -136,7 +156,7 @@ chat_log_otr_msg_in(ProfMessage* message)
 {
     if (prefs_get_boolean(PREF_CHLOG)) {
         const char* mybarejid = connection_get_barejid();
-        auto_gchar gchar* pref_otr_log = prefs_get_string(PREF_OTR_LOG);
+        const gchar* pref_otr_log = prefs_peek_string(PREF_OTR_LOG);
         if (message->enc == PROF_MSG_ENC_NONE || (strcmp(pref_otr_log, "on") == 0)) {
             if (message->type == PROF_MSG_TYPE_MUCPM) {
                 _chat_log_chat(mybarejid, message->from_jid->barejid, message->plain, PROF_IN_LOG, message->timestamp, message->from_jid->resourcepart);
@@ -158,7 +178,7 @@ chat_log_pgp_msg_in(ProfMessage* message)
 {
     if (prefs_get_boolean(PREF_CHLOG)) {
         const char* mybarejid = connection_get_barejid();
-        auto_gchar gchar* pref_pgp_log = prefs_get_string(PREF_PGP_LOG);
+        const gchar* pref_pgp_log = prefs_peek_string(PREF_PGP_LOG);
         if (strcmp(pref_pgp_log, "on") == 0) {
             if (message->type == PROF_MSG_TYPE_MUCPM) {
                 _chat_log_chat(mybarejid, message->from_jid->barejid, message->plain, PROF_IN_LOG, message->timestamp, message->from_jid->resourcepart);
@@ -180,7 +200,7 @@ chat_log_omemo_msg_in(ProfMessage* message)
 {
     if (prefs_get_boolean(PREF_CHLOG)) {
         const char* mybarejid = connection_get_barejid();
-        auto_gchar gchar* pref_omemo_log = prefs_get_string(PREF_OMEMO_LOG);
+        const gchar* pref_omemo_log = prefs_peek_string(PREF_OMEMO_LOG);
         if (strcmp(pref_omemo_log, "on") == 0) {
             if (message->type == PROF_MSG_TYPE_MUCPM) {
                 _chat_log_chat(mybarejid, message->from_jid->barejid, message->plain, PROF_IN_LOG, message->timestamp, message->from_jid->resourcepart);
@@ -215,7 +235,7 @@ static void
 _chat_log_chat(const char* const login, const char* const other, const char* msg,
                chat_log_direction_t direction, GDateTime* timestamp, const char* const resourcepart)
 {
-    auto_gchar gchar* pref_dblog = prefs_get_string(PREF_DBLOG);
+    const gchar* pref_dblog = prefs_peek_string(PREF_DBLOG);
     if (g_strcmp0(pref_dblog, "redact") == 0) {
         msg = "[REDACTED]";
     }
@@ -240,14 +260,16 @@ _chat_log_chat(const char* const login, const char* const other, const char* msg
         g_hash_table_insert(logs, strdup(other_name), dated_log);
 
         // log entry exists but file removed
-    } else if (!g_file_test(dated_log->filename, G_FILE_TEST_EXISTS)) {
+    } else if (_chat_log_removed(dated_log)) {
         dated_log = _create_chatlog(other_name, login);
         g_hash_table_replace(logs, strdup(other_name), dated_log);
 
         // log file needs rolling
     } else if (_log_roll_needed(dated_log)) {
+        auto_gchar gchar* rolled = g_strdup(dated_log->filename);
         dated_log = _create_chatlog(other_name, login);
         g_hash_table_replace(logs, strdup(other_name), dated_log);
+        _chat_log_rolled(rolled);
     }
 
     if (resourcepart) {
@@ -261,8 +283,7 @@ _chat_log_chat(const char* const login, const char* const other, const char* msg
     }
 
     auto_gchar gchar* date_fmt = g_date_time_format_iso8601(timestamp);
-    FILE* chatlogp = fopen(dated_log->filename, "a");
-    g_chmod(dated_log->filename, S_IRUSR | S_IWUSR);
+    FILE* chatlogp = _chat_log_file(dated_log);
     if (chatlogp) {
         if (direction == PROF_IN_LOG) {
             if (strncmp(msg, "/me ", 4) == 0) {
@@ -285,11 +306,7 @@ _chat_log_chat(const char* const login, const char* const other, const char* msg
                 fprintf(chatlogp, "%s - me: %s\n", date_fmt, msg);
             }
         }
-        fflush(chatlogp);
-        int result = fclose(chatlogp);
-        if (result == EOF) {
-            log_error("Error closing file %s, errno = %d", dated_log->filename, errno);
-        }
+        _chat_log_schedule_flush();
     }
 
     g_date_time_unref(timestamp);
@@ -325,7 +342,7 @@ groupchat_log_omemo_msg_out(const gchar* const room, const gchar* const msg)
 {
     if (prefs_get_boolean(PREF_CHLOG)) {
         const char* mybarejid = connection_get_barejid();
-        auto_gchar gchar* pref_omemo_log = prefs_get_string(PREF_OMEMO_LOG);
+        const gchar* pref_omemo_log = prefs_peek_string(PREF_OMEMO_LOG);
         char* mynick = muc_nick(room);
 
         if (strcmp(pref_omemo_log, "on") == 0) {
@@ -341,7 +358,7 @@ groupchat_log_omemo_msg_in(const gchar* const room, const gchar* const nick, con
 {
     if (prefs_get_boolean(PREF_CHLOG)) {
         const char* mybarejid = connection_get_barejid();
-        auto_gchar gchar* pref_omemo_log = prefs_get_string(PREF_OMEMO_LOG);
+        const gchar* pref_omemo_log = prefs_peek_string(PREF_OMEMO_LOG);
 
         if (strcmp(pref_omemo_log, "on") == 0) {
             _groupchat_log_chat(mybarejid, room, nick, msg);
@@ -362,30 +379,31 @@ _groupchat_log_chat(const gchar* const login, const gchar* const room, const gch
         dated_log = _create_groupchat_log(room, login);
         g_hash_table_insert(groupchat_logs, strdup(room), dated_log);
 
+        // log entry exists but file removed
+    } else if (_chat_log_removed(dated_log)) {
+        dated_log = _create_groupchat_log(room, login);
+        g_hash_table_replace(groupchat_logs, strdup(room), dated_log);
+
         // log exists but needs rolling
     } else if (_log_roll_needed(dated_log)) {
+        auto_gchar gchar* rolled = g_strdup(dated_log->filename);
         dated_log = _create_groupchat_log(room, login);
-        g_hash_table_replace(logs, strdup(room), dated_log);
+        g_hash_table_replace(groupchat_logs, strdup(room), dated_log);
+        _chat_log_rolled(rolled);
     }
 
     GDateTime* dt_tmp = g_date_time_new_now_local();
 
     auto_gchar gchar* date_fmt = g_date_time_format_iso8601(dt_tmp);
 
-    FILE* grpchatlogp = fopen(dated_log->filename, "a");
-    g_chmod(dated_log->filename, S_IRUSR | S_IWUSR);
+    FILE* grpchatlogp = _chat_log_file(dated_log);
     if (grpchatlogp) {
         if (strncmp(msg, "/me ", 4) == 0) {
             fprintf(grpchatlogp, "%s - *%s %s\n", date_fmt, nick, msg + 4);
         } else {
             fprintf(grpchatlogp, "%s - %s: %s\n", date_fmt, nick, msg);
         }
-
-        fflush(grpchatlogp);
-        int result = fclose(grpchatlogp);
-        if (result == EOF) {
-            log_error("Error closing file %s, errno = %d", dated_log->filename, errno);
-        }
+        _chat_log_schedule_flush();
     }
 
     g_date_time_unref(dt_tmp);
@@ -394,6 +412,10 @@ _groupchat_log_chat(const gchar* const login, const gchar* const room, const gch
 void
 chat_log_close(void)
 {
+    if (flush_timer) {
+        g_source_remove(flush_timer);
+        flush_timer = 0;
+    }
     g_hash_table_destroy(logs);
     g_hash_table_destroy(groupchat_logs);
 }
@@ -419,10 +441,8 @@ _create_chatlog(const char* const other, const char* const login)
 {
     GDateTime* now = g_date_time_new_now_local();
     auto_char char* filename = _get_log_filename(other, login, now, FALSE);
-
-    struct dated_chat_log* new_log = malloc(sizeof(struct dated_chat_log));
-    new_log->filename = strdup(filename);
-    new_log->date = now;
+    struct dated_chat_log* new_log = _chat_log_new(filename, now);
+    g_date_time_unref(now);
 
     return new_log;
 }
@@ -432,10 +452,29 @@ _create_groupchat_log(const char* const room, const char* const login)
 {
     GDateTime* now = g_date_time_new_now_local();
     auto_char char* filename = _get_log_filename(room, login, now, TRUE);
+    struct dated_chat_log* new_log = _chat_log_new(filename, now);
+    g_date_time_unref(now);
+
+    return new_log;
+}
+
+static struct dated_chat_log*
+_chat_log_new(const char* const filename, GDateTime* now)
+{
+    // the day boundary is worked out once, not for every line written
+    GDateTime* today = g_date_time_new_local(g_date_time_get_year(now), g_date_time_get_month(now),
+                                             g_date_time_get_day_of_month(now), 0, 0, 0);
+    GDateTime* tomorrow = g_date_time_add_days(today, 1);
 
     struct dated_chat_log* new_log = malloc(sizeof(struct dated_chat_log));
     new_log->filename = strdup(filename);
-    new_log->date = now;
+    new_log->roll_at = g_date_time_to_unix(tomorrow) * G_USEC_PER_SEC;
+    new_log->fp = NULL;
+    new_log->last_used = 0;
+    new_log->last_checked = 0;
+
+    g_date_time_unref(tomorrow);
+    g_date_time_unref(today);
 
     return new_log;
 }
@@ -443,28 +482,27 @@ _create_groupchat_log(const char* const room, const char* const login)
 static gboolean
 _log_roll_needed(struct dated_chat_log* dated_log)
 {
-    gboolean result = FALSE;
-    GDateTime* now = g_date_time_new_now_local();
-    if (g_date_time_get_day_of_year(dated_log->date) != g_date_time_get_day_of_year(now)) {
-        result = TRUE;
-    }
-    g_date_time_unref(now);
+    return g_get_real_time() >= dated_log->roll_at;
+}
 
-    return result;
+// nothing is appended to a day's log once the next day's one is in use
+static void
+_chat_log_rolled(const char* const filename)
+{
+    if (prefs_get_boolean(PREF_LOG_COMPRESS) && g_file_test(filename, G_FILE_TEST_EXISTS)) {
+        compress_file_async(filename);
+    }
 }
 
 static void
 _free_chat_log(struct dated_chat_log* dated_log)
 {
     if (dated_log) {
+        _chat_log_file_close(dated_log);
         if (dated_log->filename) {
             g_free(dated_log->filename);
             dated_log->filename = NULL;
         }
-        if (dated_log->date) {
-            g_date_time_unref(dated_log->date);
-            dated_log->date = NULL;
-        }
         free(dated_log);
     }
 }
@@ -477,3 +515,95 @@ _key_equals(void* key1, void* key2)
 
     return (g_strcmp0(str1, str2) == 0);
 }
+
+static void
+_find_lru_log(gpointer key, gpointer value, gpointer userdata)
+{
+    struct dated_chat_log* dated_log = value;
+    struct dated_chat_log** lru = userdata;
+
+    if (dated_log->fp && (*lru == NULL || dated_log->last_used < (*lru)->last_used)) {
+        *lru = dated_log;
+    }
+}
+
+// returns the log's file opened for appending, opening it if needed
+static FILE*
+_chat_log_file(struct dated_chat_log* dated_log)
+{
+    dated_log->last_used = g_get_monotonic_time();
+    if (dated_log->fp) {
+        return dated_log->fp;
+    }
+
+    if (open_logs >= CHATLOG_MAX_OPEN) {
+        struct dated_chat_log* lru = NULL;
+        g_hash_table_foreach(logs, _find_lru_log, &lru);
+        g_hash_table_foreach(groupchat_logs, _find_lru_log, &lru);
+        _chat_log_file_close(lru);
+    }
+
+    dated_log->fp = fopen(dated_log->filename, "a");
+    if (dated_log->fp) {
+        g_chmod(dated_log->filename, S_IRUSR | S_IWUSR);
+        dated_log->last_checked = dated_log->last_used;
+        open_logs++;
+    }
+
+    return dated_log->fp;
+}
+
+static void
+_chat_log_file_close(struct dated_chat_log* dated_log)
+{
+    if (dated_log == NULL || dated_log->fp == NULL) {
+        return;
+    }
+
+    if (fclose(dated_log->fp) == EOF) {
+        log_error("Error closing file %s, errno = %d", dated_log->filename, errno);
+    }
+    dated_log->fp = NULL;
+    open_logs--;
+}
+
+// only stat the file every few seconds rather than for every line
+static gboolean
+_chat_log_removed(struct dated_chat_log* dated_log)
+{
+    gint64 now = g_get_monotonic_time();
+    if (dated_log->fp && now - dated_log->last_checked < CHATLOG_EXISTS_CHECK_SECS * G_TIME_SPAN_SECOND) {
+        return FALSE;
+    }
+    dated_log->last_checked = now;
+
+    return !g_file_test(dated_log->filename, G_FILE_TEST_EXISTS);
+}
+
+static void
+_flush_log(gpointer key, gpointer value, gpointer userdata)
+{
+    struct dated_chat_log* dated_log = value;
+
+    if (dated_log->fp && fflush(dated_log->fp) == EOF) {
+        log_error("Error writing file %s, errno = %d", dated_log->filename, errno);
+    }
+}
+
+static void
+_chat_log_schedule_flush(void)
+{
+    if (flush_timer == 0) {
+        flush_timer = g_timeout_add_seconds(CHATLOG_FLUSH_SECS, _chat_log_flush_cb, NULL);
+    }
+}
+
+static gboolean
+_chat_log_flush_cb(gpointer data)
+{
+    flush_timer = 0;
+    g_hash_table_foreach(logs, _flush_log, NULL);
+    g_hash_table_foreach(groupchat_logs, _flush_log, NULL);
+
+    return FALSE;
+}
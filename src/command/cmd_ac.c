@@ -38,11 +38,14 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <assert.h>
 #include <libgen.h>
 #include <dirent.h>
 #include <ctype.h>
 
+#include <glib/gstdio.h>
+
 #include "common.h"
 #include "config/preferences.h"
 #include "config/scripts.h"
@@ -88,7 +91,13 @@ static char* _omemo_autocomplete(ProfWin* window, const char* const input, gbool
 static char* _connect_autocomplete(ProfWin* window, const char* const input, gboolean previous);
 static char* _alias_autocomplete(ProfWin* window, const char* const input, gboolean previous);
 static char* _join_autocomplete(ProfWin* window, const char* const input, gboolean previous);
+static char* _boolean_autocomplete(ProfWin* window, const char* const input, gboolean previous);
+static char* _msg_autocomplete(ProfWin* window, const char* const input, gboolean previous);
+static char* _info_autocomplete(ProfWin* window, const char* const input, gboolean previous);
+static char* _caps_autocomplete(ProfWin* window, const char* const input, gboolean previous);
+static char* _ping_autocomplete(ProfWin* window, const char* const input, gboolean previous);
 static char* _log_autocomplete(ProfWin* window, const char* const input, gboolean previous);
+static char* _silence_autocomplete(ProfWin* window, const char* const input, gboolean previous);
 static char* _form_autocomplete(ProfWin* window, const char* const input, gboolean previous);
 static char* _form_field_autocomplete(ProfWin* window, const char* const input, gboolean previous);
 static char* _occupants_autocomplete(ProfWin* window, const char* const input, gboolean previous);
@@ -99,6 +108,7 @@ static char* _role_autocomplete(ProfWin* window, const char* const input, gboole
 static char* _resource_autocomplete(ProfWin* window, const char* const input, gboolean previous);
 static char* _wintitle_autocomplete(ProfWin* window, const char* const input, gboolean previous);
 static char* _inpblock_autocomplete(ProfWin* window, const char* const input, gboolean previous);
+static char* _scrollback_autocomplete(ProfWin* window, const char* const input, gboolean previous);
 static char* _time_autocomplete(ProfWin* window, const char* const input, gboolean previous);
 static char* _receipts_autocomplete(ProfWin* window, const char* const input, gboolean previous);
 static char* _reconnect_autocomplete(ProfWin* window, const char* const input, gboolean previous);
@@ -106,12 +116,15 @@ static char* _help_autocomplete(ProfWin* window, const char* const input, gboole
 static char* _wins_autocomplete(ProfWin* window, const char* const input, gboolean previous);
 static char* _tls_autocomplete(ProfWin* window, const char* const input, gboolean previous);
 static char* _titlebar_autocomplete(ProfWin* window, const char* const input, gboolean previous);
+static char* _mainwin_autocomplete(ProfWin* window, const char* const input, gboolean previous);
+static char* _mam_autocomplete(ProfWin* window, const char* const input, gboolean previous);
 static char* _script_autocomplete(ProfWin* window, const char* const input, gboolean previous);
 static char* _subject_autocomplete(ProfWin* window, const char* const input, gboolean previous);
 static char* _console_autocomplete(ProfWin* window, const char* const input, gboolean previous);
 static char* _win_autocomplete(ProfWin* window, const char* const input, gboolean previous);
 static char* _close_autocomplete(ProfWin* window, const char* const input, gboolean previous);
 static char* _plugins_autocomplete(ProfWin* window, const char* const input, gboolean previous);
+static char* _stats_autocomplete(ProfWin* window, const char* const input, gboolean previous);
 static char* _sendfile_autocomplete(ProfWin* window, const char* const input, gboolean previous);
 static char* _blocked_autocomplete(ProfWin* window, const char* const input, gboolean previous);
 static char* _tray_autocomplete(ProfWin* window, const char* const input, gboolean previous);
@@ -120,6 +133,7 @@ static char* _rooms_autocomplete(ProfWin* window, const char* const input, gbool
 static char* _statusbar_autocomplete(ProfWin* window, const char* const input, gboolean previous);
 static char* _clear_autocomplete(ProfWin* window, const char* const input, gboolean previous);
 static char* _invite_autocomplete(ProfWin* window, const char* const input, gboolean previous);
+static char* _history_autocomplete(ProfWin* window, const char* const input, gboolean previous);
 static char* _status_autocomplete(ProfWin* window, const char* const input, gboolean previous);
 static char* _logging_autocomplete(ProfWin* window, const char* const input, gboolean previous);
 static char* _privacy_autocomplete(ProfWin* window, const char* const input, gboolean previous);
@@ -134,6 +148,7 @@ static char* _lastactivity_autocomplete(ProfWin* window, const char* const input
 static char* _intype_autocomplete(ProfWin* window, const char* const input, gboolean previous);
 static char* _mood_autocomplete(ProfWin* window, const char* const input, gboolean previous);
 static char* _strophe_autocomplete(ProfWin* window, const char* const input, gboolean previous);
+static char* _xmlconsole_autocomplete(ProfWin* window, const char* const input, gboolean previous);
 static char* _adhoc_cmd_autocomplete(ProfWin* window, const char* const input, gboolean previous);
 static char* _vcard_autocomplete(ProfWin* window, const char* const input, gboolean previous);
 
@@ -155,6 +170,7 @@ static Autocomplete notify_trigger_ac;
 static Autocomplete prefs_ac;
 static Autocomplete sub_ac;
 static Autocomplete log_ac;
+static Autocomplete silence_ac;
 static Autocomplete log_level_ac;
 static Autocomplete autoaway_ac;
 static Autocomplete autoaway_mode_ac;
@@ -230,6 +246,7 @@ static Autocomplete time_ac;
 static Autocomplete time_format_ac;
 static Autocomplete resource_ac;
 static Autocomplete inpblock_ac;
+static Autocomplete scrollback_ac;
 static Autocomplete receipts_ac;
 static Autocomplete reconnect_ac;
 #ifdef HAVE_LIBGPGME
@@ -249,6 +266,8 @@ static Autocomplete script_show_ac;
 static Autocomplete console_ac;
 static Autocomplete console_msg_ac;
 static Autocomplete autoping_ac;
+static Autocomplete stats_ac;
+static Autocomplete stats_trace_ac;
 static Autocomplete plugins_ac;
 static Autocomplete plugins_load_ac;
 static Autocomplete plugins_unload_ac;
@@ -259,6 +278,9 @@ static Autocomplete tray_ac;
 static Autocomplete presence_ac;
 static Autocomplete presence_setting_ac;
 static Autocomplete winpos_ac;
+static Autocomplete mainwin_ac;
+static Autocomplete mam_ac;
+static Autocomplete redraw_ac;
 static Autocomplete statusbar_ac;
 static Autocomplete statusbar_self_ac;
 static Autocomplete statusbar_chat_ac;
@@ -268,6 +290,7 @@ static Autocomplete statusbar_show_ac;
 static Autocomplete statusbar_tabmode_ac;
 static Autocomplete clear_ac;
 static Autocomplete invite_ac;
+static Autocomplete history_ac;
 static Autocomplete status_ac;
 static Autocomplete status_state_ac;
 static Autocomplete logging_ac;
@@ -286,6 +309,8 @@ static Autocomplete mood_type_ac;
 static Autocomplete strophe_ac;
 static Autocomplete strophe_sm_ac;
 static Autocomplete strophe_verbosity_ac;
+static Autocomplete xmlconsole_ac;
+static Autocomplete xmlconsole_filter_ac;
 static Autocomplete adhoc_cmd_ac;
 static Autocomplete lastactivity_ac;
 static Autocomplete vcard_ac;
@@ -298,6 +323,18 @@ static Autocomplete vcard_togglable_param_ac;
 static Autocomplete vcard_address_type_ac;
 
 static GHashTable* ac_funcs = NULL;
+// commands whose parameters are completed from a single Autocomplete
+static GHashTable* ac_completers = NULL;
+
+// directory filepath_ac was last filled from, Tab on the same one reuses it
+static struct
+{
+    char* directory;
+    gboolean hidden;
+    gboolean home;
+    time_t mtime;
+    time_t listed;
+} filepath_cache;
 
 /*!
  * \brief Initialization of auto completion for commands.
@@ -372,6 +409,7 @@ cmd_ac_init(void)
     autocomplete_add(notify_room_ac, "offline");
     autocomplete_add(notify_room_ac, "current");
     autocomplete_add(notify_room_ac, "text");
+    autocomplete_add(notify_room_ac, "flood");
     autocomplete_add(notify_room_ac, "trigger");
 
     notify_typing_ac = autocomplete_new();
@@ -410,9 +448,18 @@ cmd_ac_init(void)
     autocomplete_add(log_ac, "maxsize");
     autocomplete_add(log_ac, "rotate");
     autocomplete_add(log_ac, "shared");
+    autocomplete_add(log_ac, "compress");
     autocomplete_add(log_ac, "where");
     autocomplete_add(log_ac, "level");
 
+    silence_ac = autocomplete_new();
+    autocomplete_add(silence_ac, "on");
+    autocomplete_add(silence_ac, "off");
+    autocomplete_add(silence_ac, "quarantine");
+    autocomplete_add(silence_ac, "requests");
+    autocomplete_add(silence_ac, "accept");
+    autocomplete_add(silence_ac, "clear");
+
     log_level_ac = autocomplete_new();
     autocomplete_add(log_level_ac, "WARN");
     autocomplete_add(log_level_ac, "INFO");
@@ -882,6 +929,15 @@ cmd_ac_init(void)
     autocomplete_add(inpblock_ac, "timeout");
     autocomplete_add(inpblock_ac, "dynamic");
 
+    scrollback_ac = autocomplete_new();
+    autocomplete_add(scrollback_ac, "all");
+    autocomplete_add(scrollback_ac, "console");
+    autocomplete_add(scrollback_ac, "chat");
+    autocomplete_add(scrollback_ac, "muc");
+    autocomplete_add(scrollback_ac, "config");
+    autocomplete_add(scrollback_ac, "private");
+    autocomplete_add(scrollback_ac, "xml");
+
     receipts_ac = autocomplete_new();
     autocomplete_add(receipts_ac, "send");
     autocomplete_add(receipts_ac, "request");
@@ -984,6 +1040,15 @@ cmd_ac_init(void)
     autocomplete_add(autoping_ac, "set");
     autocomplete_add(autoping_ac, "timeout");
 
+    stats_ac = autocomplete_new();
+    autocomplete_add(stats_ac, "reset");
+    autocomplete_add(stats_ac, "budget");
+    autocomplete_add(stats_ac, "trace");
+
+    stats_trace_ac = autocomplete_new();
+    autocomplete_add(stats_trace_ac, "start");
+    autocomplete_add(stats_trace_ac, "stop");
+
     plugins_ac = autocomplete_new();
     autocomplete_add(plugins_ac, "install");
     autocomplete_add(plugins_ac, "update");
@@ -992,6 +1057,7 @@ cmd_ac_init(void)
     autocomplete_add(plugins_ac, "unload");
     autocomplete_add(plugins_ac, "reload");
     autocomplete_add(plugins_ac, "python_version");
+    autocomplete_add(plugins_ac, "stats");
 
     filepath_ac = autocomplete_new();
 
@@ -1004,6 +1070,15 @@ cmd_ac_init(void)
     clear_ac = autocomplete_new();
     autocomplete_add(clear_ac, "persist_history");
 
+    history_ac = autocomplete_new();
+    autocomplete_add(history_ac, "on");
+    autocomplete_add(history_ac, "off");
+    autocomplete_add(history_ac, "search");
+    autocomplete_add(history_ac, "retention");
+    autocomplete_add(history_ac, "archive");
+    autocomplete_add(history_ac, "vacuum");
+    autocomplete_add(history_ac, "import");
+
     tray_ac = autocomplete_new();
     autocomplete_add(tray_ac, "on");
     autocomplete_add(tray_ac, "off");
@@ -1025,6 +1100,19 @@ cmd_ac_init(void)
     autocomplete_add(winpos_ac, "up");
     autocomplete_add(winpos_ac, "down");
 
+    mainwin_ac = autocomplete_new();
+    autocomplete_add(mainwin_ac, "up");
+    autocomplete_add(mainwin_ac, "down");
+    autocomplete_add(mainwin_ac, "scroll");
+
+    mam_ac = autocomplete_new();
+    autocomplete_add(mam_ac, "on");
+    autocomplete_add(mam_ac, "off");
+    autocomplete_add(mam_ac, "pagesize");
+
+    redraw_ac = autocomplete_new();
+    autocomplete_add(redraw_ac, "rate");
+
     statusbar_ac = autocomplete_new();
     autocomplete_add(statusbar_ac, "up");
     autocomplete_add(statusbar_ac, "down");
@@ -1121,6 +1209,8 @@ cmd_ac_init(void)
     url_ac = autocomplete_new();
     autocomplete_add(url_ac, "open");
     autocomplete_add(url_ac, "save");
+    autocomplete_add(url_ac, "limit");
+    autocomplete_add(url_ac, "resize");
 
     executable_ac = autocomplete_new();
     autocomplete_add(executable_ac, "avatar");
@@ -1140,6 +1230,8 @@ cmd_ac_init(void)
     strophe_ac = autocomplete_new();
     autocomplete_add(strophe_ac, "sm");
     autocomplete_add(strophe_ac, "verbosity");
+    autocomplete_add(strophe_ac, "iq-inflight");
+    autocomplete_add(strophe_ac, "capture");
     strophe_sm_ac = autocomplete_new();
     autocomplete_add(strophe_sm_ac, "on");
     autocomplete_add(strophe_sm_ac, "no-resend");
@@ -1150,6 +1242,14 @@ cmd_ac_init(void)
     autocomplete_add(strophe_verbosity_ac, "2");
     autocomplete_add(strophe_verbosity_ac, "3");
 
+    xmlconsole_ac = autocomplete_new();
+    autocomplete_add(xmlconsole_ac, "filter");
+    xmlconsole_filter_ac = autocomplete_new();
+    autocomplete_add(xmlconsole_filter_ac, "element");
+    autocomplete_add(xmlconsole_filter_ac, "ns");
+    autocomplete_add(xmlconsole_filter_ac, "jid");
+    autocomplete_add(xmlconsole_filter_ac, "clear");
+
     mood_ac = autocomplete_new();
     autocomplete_add(mood_ac, "set");
     autocomplete_add(mood_ac, "clear");
@@ -1347,6 +1447,7 @@ cmd_ac_init(void)
     g_hash_table_insert(ac_funcs, "/executable", _executable_autocomplete);
     g_hash_table_insert(ac_funcs, "/form", _form_autocomplete);
     g_hash_table_insert(ac_funcs, "/help", _help_autocomplete);
+    g_hash_table_insert(ac_funcs, "/history", _history_autocomplete);
     g_hash_table_insert(ac_funcs, "/inpblock", _inpblock_autocomplete);
     g_hash_table_insert(ac_funcs, "/intype", _intype_autocomplete);
     g_hash_table_insert(ac_funcs, "/invite", _invite_autocomplete);
@@ -1354,6 +1455,7 @@ cmd_ac_init(void)
     g_hash_table_insert(ac_funcs, "/kick", _kick_autocomplete);
     g_hash_table_insert(ac_funcs, "/lastactivity", _lastactivity_autocomplete);
     g_hash_table_insert(ac_funcs, "/log", _log_autocomplete);
+    g_hash_table_insert(ac_funcs, "/silence", _silence_autocomplete);
     g_hash_table_insert(ac_funcs, "/logging", _logging_autocomplete);
     g_hash_table_insert(ac_funcs, "/privacy", _privacy_autocomplete);
     g_hash_table_insert(ac_funcs, "/mood", _mood_autocomplete);
@@ -1378,16 +1480,21 @@ cmd_ac_init(void)
     g_hash_table_insert(ac_funcs, "/rooms", _rooms_autocomplete);
     g_hash_table_insert(ac_funcs, "/roster", _roster_autocomplete);
     g_hash_table_insert(ac_funcs, "/script", _script_autocomplete);
+    g_hash_table_insert(ac_funcs, "/scrollback", _scrollback_autocomplete);
     g_hash_table_insert(ac_funcs, "/sendfile", _sendfile_autocomplete);
     g_hash_table_insert(ac_funcs, "/software", _software_autocomplete);
+    g_hash_table_insert(ac_funcs, "/stats", _stats_autocomplete);
     g_hash_table_insert(ac_funcs, "/status", _status_autocomplete);
     g_hash_table_insert(ac_funcs, "/statusbar", _statusbar_autocomplete);
     g_hash_table_insert(ac_funcs, "/strophe", _strophe_autocomplete);
+    g_hash_table_insert(ac_funcs, "/xmlconsole", _xmlconsole_autocomplete);
     g_hash_table_insert(ac_funcs, "/sub", _sub_autocomplete);
     g_hash_table_insert(ac_funcs, "/subject", _subject_autocomplete);
     g_hash_table_insert(ac_funcs, "/theme", _theme_autocomplete);
     g_hash_table_insert(ac_funcs, "/time", _time_autocomplete);
     g_hash_table_insert(ac_funcs, "/titlebar", _titlebar_autocomplete);
+    g_hash_table_insert(ac_funcs, "/mainwin", _mainwin_autocomplete);
+    g_hash_table_insert(ac_funcs, "/mam", _mam_autocomplete);
     g_hash_table_insert(ac_funcs, "/tls", _tls_autocomplete);
     g_hash_table_insert(ac_funcs, "/tray", _tray_autocomplete);
     g_hash_table_insert(ac_funcs, "/url", _url_autocomplete);
@@ -1396,6 +1503,27 @@ cmd_ac_init(void)
     g_hash_table_insert(ac_funcs, "/win", _win_autocomplete);
     g_hash_table_insert(ac_funcs, "/wins", _wins_autocomplete);
     g_hash_table_insert(ac_funcs, "/wintitle", _wintitle_autocomplete);
+    g_hash_table_insert(ac_funcs, "/msg", _msg_autocomplete);
+    g_hash_table_insert(ac_funcs, "/info", _info_autocomplete);
+    g_hash_table_insert(ac_funcs, "/caps", _caps_autocomplete);
+    g_hash_table_insert(ac_funcs, "/ping", _ping_autocomplete);
+
+    gchar* boolean_choices[] = { "/beep", "/states", "/outtype", "/flash", "/splash",
+                                 "/vercheck", "/privileges", "/wrap",
+                                 "/carbons", "/slashguard", "/fuzzy", "/csi" };
+    for (int i = 0; i < ARRAY_SIZE(boolean_choices); i++) {
+        g_hash_table_insert(ac_funcs, boolean_choices[i], _boolean_autocomplete);
+    }
+
+    if (ac_completers != NULL)
+        g_hash_table_destroy(ac_completers);
+    ac_completers = g_hash_table_new(g_str_hash, g_str_equal);
+    g_hash_table_insert(ac_completers, "/prefs", prefs_ac);
+    g_hash_table_insert(ac_completers, "/disco", disco_ac);
+    g_hash_table_insert(ac_completers, "/room", room_ac);
+    g_hash_table_insert(ac_completers, "/autoping", autoping_ac);
+    g_hash_table_insert(ac_completers, "/inputwin", winpos_ac);
+    g_hash_table_insert(ac_completers, "/redraw", redraw_ac);
 }
 
 void
@@ -1583,6 +1711,7 @@ cmd_ac_reset(ProfWin* window)
     autocomplete_reset(who_roster_ac);
     autocomplete_reset(prefs_ac);
     autocomplete_reset(log_ac);
+    autocomplete_reset(silence_ac);
     autocomplete_reset(log_level_ac);
     autocomplete_reset(commands_ac);
     autocomplete_reset(autoaway_ac);
@@ -1674,6 +1803,7 @@ cmd_ac_reset(ProfWin* window)
     autocomplete_reset(time_format_ac);
     autocomplete_reset(resource_ac);
     autocomplete_reset(inpblock_ac);
+    autocomplete_reset(scrollback_ac);
     autocomplete_reset(receipts_ac);
     autocomplete_reset(reconnect_ac);
 #ifdef HAVE_LIBGPGME
@@ -1691,12 +1821,17 @@ cmd_ac_reset(ProfWin* window)
     autocomplete_reset(console_ac);
     autocomplete_reset(console_msg_ac);
     autocomplete_reset(autoping_ac);
+    autocomplete_reset(stats_ac);
+    autocomplete_reset(stats_trace_ac);
     autocomplete_reset(plugins_ac);
     autocomplete_reset(blocked_ac);
     autocomplete_reset(tray_ac);
     autocomplete_reset(presence_ac);
     autocomplete_reset(presence_setting_ac);
     autocomplete_reset(winpos_ac);
+    autocomplete_reset(mainwin_ac);
+    autocomplete_reset(mam_ac);
+    autocomplete_reset(redraw_ac);
     autocomplete_reset(statusbar_ac);
     autocomplete_reset(statusbar_self_ac);
     autocomplete_reset(statusbar_chat_ac);
@@ -1705,6 +1840,7 @@ cmd_ac_reset(ProfWin* window)
     autocomplete_reset(statusbar_show_ac);
     autocomplete_reset(statusbar_tabmode_ac);
     autocomplete_reset(clear_ac);
+    autocomplete_reset(history_ac);
     autocomplete_reset(invite_ac);
     autocomplete_reset(status_ac);
     autocomplete_reset(status_state_ac);
@@ -1724,6 +1860,8 @@ cmd_ac_reset(ProfWin* window)
     autocomplete_reset(strophe_verbosity_ac);
     autocomplete_reset(strophe_sm_ac);
     autocomplete_reset(strophe_ac);
+    autocomplete_reset(xmlconsole_ac);
+    autocomplete_reset(xmlconsole_filter_ac);
     autocomplete_reset(adhoc_cmd_ac);
 
     autocomplete_reset(vcard_ac);
@@ -1783,6 +1921,7 @@ cmd_ac_uninit(void)
     autocomplete_free(sub_ac);
     autocomplete_free(wintitle_ac);
     autocomplete_free(log_ac);
+    autocomplete_free(silence_ac);
     autocomplete_free(log_level_ac);
     autocomplete_free(prefs_ac);
     autocomplete_free(autoaway_ac);
@@ -1857,6 +1996,7 @@ cmd_ac_uninit(void)
     autocomplete_free(time_format_ac);
     autocomplete_free(resource_ac);
     autocomplete_free(inpblock_ac);
+    autocomplete_free(scrollback_ac);
     autocomplete_free(receipts_ac);
     autocomplete_free(reconnect_ac);
 #ifdef HAVE_LIBGPGME
@@ -1876,16 +2016,23 @@ cmd_ac_uninit(void)
     autocomplete_free(console_ac);
     autocomplete_free(console_msg_ac);
     autocomplete_free(autoping_ac);
+    autocomplete_free(stats_ac);
+    autocomplete_free(stats_trace_ac);
     autocomplete_free(plugins_ac);
     autocomplete_free(plugins_load_ac);
     autocomplete_free(plugins_unload_ac);
     autocomplete_free(plugins_reload_ac);
     autocomplete_free(filepath_ac);
+    free(filepath_cache.directory);
+    filepath_cache.directory = NULL;
     autocomplete_free(blocked_ac);
     autocomplete_free(tray_ac);
     autocomplete_free(presence_ac);
     autocomplete_free(presence_setting_ac);
     autocomplete_free(winpos_ac);
+    autocomplete_free(mainwin_ac);
+    autocomplete_free(mam_ac);
+    autocomplete_free(redraw_ac);
     autocomplete_free(statusbar_ac);
     autocomplete_free(statusbar_self_ac);
     autocomplete_free(statusbar_chat_ac);
@@ -1894,6 +2041,7 @@ cmd_ac_uninit(void)
     autocomplete_free(statusbar_show_ac);
     autocomplete_free(statusbar_tabmode_ac);
     autocomplete_free(clear_ac);
+    autocomplete_free(history_ac);
     autocomplete_free(invite_ac);
     autocomplete_free(status_ac);
     autocomplete_free(status_state_ac);
@@ -1927,6 +2075,19 @@ _filepath_item_free(char** ptr)
     free(item);
 }
 
+// whether filepath_ac still holds the listing of directory, entries added in
+// the second the listing was taken can't be told apart so that is re-read
+static gboolean
+_filepath_cache_valid(const char* const directory, gboolean hidden, gboolean home, time_t mtime)
+{
+    return filepath_cache.directory
+           && g_strcmp0(filepath_cache.directory, directory) == 0
+           && filepath_cache.hidden == hidden
+           && filepath_cache.home == home
+           && filepath_cache.mtime == mtime
+           && mtime < filepath_cache.listed;
+}
+
 char*
 cmd_ac_complete_filepath(const char* const input, char* const startstr, gboolean previous)
 {
@@ -1976,6 +2137,18 @@ cmd_ac_complete_filepath(const char* const input, char* const startstr, gboolean
     free(inpcp);
     free(inpcp2);
 
+    gboolean hidden = *foofile == '.';
+    GStatBuf st;
+    if (g_stat(directory, &st) != 0) {
+        st.st_mtime = 0;
+    }
+    if (_filepath_cache_valid(directory, hidden, output_off != 0, st.st_mtime)) {
+        free(directory);
+        free(foofile);
+        return autocomplete_param_with_ac(input, startstr, filepath_ac, TRUE, previous);
+    }
+    time_t listed = time(NULL);
+
     GArray* files = g_array_new(TRUE, FALSE, sizeof(char*));
     g_array_set_clear_func(files, (GDestroyNotify)_filepath_item_free);
 
@@ -2029,8 +2202,16 @@ cmd_ac_complete_filepath(const char* const input, char* const startstr, gboolean
             free(acstring);
         }
         closedir(d);
+    } else {
+        listed = 0;
     }
-    free(directory);
+
+    free(filepath_cache.directory);
+    filepath_cache.directory = directory;
+    filepath_cache.hidden = hidden;
+    filepath_cache.home = output_off != 0;
+    filepath_cache.mtime = st.st_mtime;
+    filepath_cache.listed = listed;
     free(foofile);
 
     autocomplete_update(filepath_ac, (char**)files->data);
@@ -2044,96 +2225,6 @@ _cmd_ac_complete_params(ProfWin* window, const char* const input, gboolean previ
 {
     char* result = NULL;
 
-    jabber_conn_status_t conn_status = connection_get_status();
-
-    // autocomplete boolean settings
-    gchar* boolean_choices[] = { "/beep", "/states", "/outtype", "/flash", "/splash",
-                                 "/history", "/vercheck", "/privileges", "/wrap",
-                                 "/carbons", "/slashguard", "/mam", "/silence" };
-
-    for (int i = 0; i < ARRAY_SIZE(boolean_choices); i++) {
-        result = autocomplete_param_with_func(input, boolean_choices[i], prefs_autocomplete_boolean_choice, previous, NULL);
-        if (result) {
-            return result;
-        }
-    }
-
-    // autocomplete nickname in chat rooms
-    if (window->type == WIN_MUC) {
-        ProfMucWin* mucwin = (ProfMucWin*)window;
-        assert(mucwin->memcheck == PROFMUCWIN_MEMCHECK);
-        Autocomplete nick_ac = muc_roster_ac(mucwin->roomjid);
-        if (nick_ac) {
-            gchar* nick_choices[] = { "/msg", "/info", "/caps" };
-
-            // Remove quote character before and after names when doing autocomplete
-            char* unquoted = strip_arg_quotes(input);
-            for (int i = 0; i < ARRAY_SIZE(nick_choices); i++) {
-                result = autocomplete_param_with_ac(unquoted, nick_choices[i], nick_ac, TRUE, previous);
-                if (result) {
-                    free(unquoted);
-                    return result;
-                }
-            }
-            free(unquoted);
-        }
-
-        // otherwise autocomplete using roster
-    } else if (conn_status == JABBER_CONNECTED) {
-        gchar* contact_choices[] = { "/msg", "/info" };
-        // Remove quote character before and after names when doing autocomplete
-        char* unquoted = strip_arg_quotes(input);
-        for (int i = 0; i < ARRAY_SIZE(contact_choices); i++) {
-            result = autocomplete_param_with_func(unquoted, contact_choices[i], roster_contact_autocomplete, previous, NULL);
-            if (result) {
-                free(unquoted);
-                return result;
-            }
-            result = autocomplete_param_with_func(unquoted, contact_choices[i], roster_barejid_autocomplete, previous, NULL);
-            if (result) {
-                free(unquoted);
-                return result;
-            }
-        }
-        free(unquoted);
-
-        gchar* resource_choices[] = { "/caps", "/ping" };
-        for (int i = 0; i < ARRAY_SIZE(resource_choices); i++) {
-            result = autocomplete_param_with_func(input, resource_choices[i], roster_fulljid_autocomplete, previous, NULL);
-            if (result) {
-                return result;
-            }
-        }
-    }
-
-    gchar* invite_choices[] = { "/join" };
-    for (int i = 0; i < ARRAY_SIZE(invite_choices); i++) {
-        result = autocomplete_param_with_func(input, invite_choices[i], muc_invites_find, previous, NULL);
-        if (result) {
-            return result;
-        }
-    }
-
-    struct
-    {
-        gchar* cmd;
-        Autocomplete completer;
-    } ac_cmds[] = {
-        { "/prefs", prefs_ac },
-        { "/disco", disco_ac },
-        { "/room", room_ac },
-        { "/autoping", autoping_ac },
-        { "/mainwin", winpos_ac },
-        { "/inputwin", winpos_ac },
-    };
-
-    for (int i = 0; i < ARRAY_SIZE(ac_cmds); i++) {
-        result = autocomplete_param_with_ac(input, ac_cmds[i].cmd, ac_cmds[i].completer, TRUE, previous);
-        if (result) {
-            return result;
-        }
-    }
-
     int len = strlen(input);
     char parsed[len + 1];
     int i = 0;
@@ -2147,6 +2238,14 @@ _cmd_ac_complete_params(ProfWin* window, const char* const input, gboolean previ
     }
     parsed[i] = '\0';
 
+    Autocomplete completer = g_hash_table_lookup(ac_completers, parsed);
+    if (completer) {
+        result = autocomplete_param_with_ac(input, parsed, completer, TRUE, previous);
+        if (result) {
+            return result;
+        }
+    }
+
     char* (*ac_func)(ProfWin*, const char* const, gboolean) = g_hash_table_lookup(ac_funcs, parsed);
     if (ac_func) {
         result = ac_func(window, input, previous);
@@ -2170,6 +2269,83 @@ _cmd_ac_complete_params(ProfWin* window, const char* const input, gboolean previ
     return NULL;
 }
 
+static char*
+_boolean_autocomplete(ProfWin* window, const char* const input, gboolean previous)
+{
+    auto_gchar gchar* command = g_strndup(input, strcspn(input, " "));
+
+    return autocomplete_param_with_func(input, command, prefs_autocomplete_boolean_choice, previous, NULL);
+}
+
+// nickname in chat rooms, otherwise contact name or bare JID
+static char*
+_nick_or_contact_autocomplete(ProfWin* window, const char* const command, const char* const input, gboolean previous)
+{
+    char* result = NULL;
+
+    if (window->type == WIN_MUC) {
+        ProfMucWin* mucwin = (ProfMucWin*)window;
+        assert(mucwin->memcheck == PROFMUCWIN_MEMCHECK);
+        Autocomplete nick_ac = muc_roster_ac(mucwin->roomjid);
+        if (nick_ac) {
+            // Remove quote character before and after names when doing autocomplete
+            auto_char char* unquoted = strip_arg_quotes(input);
+            result = autocomplete_param_with_ac(unquoted, (char*)command, nick_ac, TRUE, previous);
+        }
+    } else if (connection_get_status() == JABBER_CONNECTED) {
+        // Remove quote character before and after names when doing autocomplete
+        auto_char char* unquoted = strip_arg_quotes(input);
+        result = autocomplete_param_with_func(unquoted, (char*)command, roster_contact_autocomplete, previous, NULL);
+        if (result) {
+            return result;
+        }
+        result = autocomplete_param_with_func(unquoted, (char*)command, roster_barejid_autocomplete, previous, NULL);
+    }
+
+    return result;
+}
+
+static char*
+_msg_autocomplete(ProfWin* window, const char* const input, gboolean previous)
+{
+    return _nick_or_contact_autocomplete(window, "/msg", input, previous);
+}
+
+static char*
+_info_autocomplete(ProfWin* window, const char* const input, gboolean previous)
+{
+    return _nick_or_contact_autocomplete(window, "/info", input, previous);
+}
+
+static char*
+_caps_autocomplete(ProfWin* window, const char* const input, gboolean previous)
+{
+    if (window->type == WIN_MUC) {
+        ProfMucWin* mucwin = (ProfMucWin*)window;
+        assert(mucwin->memcheck == PROFMUCWIN_MEMCHECK);
+        Autocomplete nick_ac = muc_roster_ac(mucwin->roomjid);
+        if (nick_ac) {
+            // Remove quote character before and after names when doing autocomplete
+            auto_char char* unquoted = strip_arg_quotes(input);
+            return autocomplete_param_with_ac(unquoted, "/caps", nick_ac, TRUE, previous);
+        }
+    } else if (connection_get_status() == JABBER_CONNECTED) {
+        return autocomplete_param_with_func(input, "/caps", roster_fulljid_autocomplete, previous, NULL);
+    }
+
+    return NULL;
+}
+
+static char*
+_ping_autocomplete(ProfWin* window, const char* const input, gboolean previous)
+{
+    if (window->type != WIN_MUC && connection_get_status() == JABBER_CONNECTED) {
+        return autocomplete_param_with_func(input, "/ping", roster_fulljid_autocomplete, previous, NULL);
+    }
+
+    return NULL;
+}
+
 static char*
 _sub_autocomplete(ProfWin* window, const char* const input, gboolean previous)
 {
@@ -2631,6 +2807,10 @@ _log_autocomplete(ProfWin* window, const char* const input, gboolean previous)
     if (result) {
         return result;
     }
+    result = autocomplete_param_with_func(input, "/log compress", prefs_autocomplete_boolean_choice, previous, NULL);
+    if (result) {
+        return result;
+    }
     result = autocomplete_param_with_ac(input, "/log level", log_level_ac, TRUE, previous);
     if (result) {
         return result;
@@ -2643,6 +2823,21 @@ _log_autocomplete(ProfWin* window, const char* const input, gboolean previous)
     return NULL;
 }
 
+static char*
+_silence_autocomplete(ProfWin* window, const char* const input, gboolean previous)
+{
+    char* result = NULL;
+
+    result = autocomplete_param_with_func(input, "/silence quarantine", prefs_autocomplete_boolean_choice, previous, NULL);
+    if (result) {
+        return result;
+    }
+
+    result = autocomplete_param_with_ac(input, "/silence", silence_ac, TRUE, previous);
+
+    return result;
+}
+
 static char*
 _autoconnect_autocomplete(ProfWin* window, const char* const input, gboolean previous)
 {
@@ -2931,6 +3126,21 @@ _omemo_autocomplete(ProfWin* window, const char* const input, gboolean previous)
 }
 #endif
 
+static char*
+_stats_autocomplete(ProfWin* window, const char* const input, gboolean previous)
+{
+    if (strncmp(input, "/stats trace start ", 19) == 0) {
+        return cmd_ac_complete_filepath(input, "/stats trace start", previous);
+    }
+
+    char* result = autocomplete_param_with_ac(input, "/stats trace", stats_trace_ac, TRUE, previous);
+    if (result) {
+        return result;
+    }
+
+    return autocomplete_param_with_ac(input, "/stats", stats_ac, TRUE, previous);
+}
+
 static char*
 _plugins_autocomplete(ProfWin* window, const char* const input, gboolean previous)
 {
@@ -3161,6 +3371,12 @@ _wintitle_autocomplete(ProfWin* window, const char* const input, gboolean previo
     return NULL;
 }
 
+static char*
+_scrollback_autocomplete(ProfWin* window, const char* const input, gboolean previous)
+{
+    return autocomplete_param_with_ac(input, "/scrollback", scrollback_ac, FALSE, previous);
+}
+
 static char*
 _inpblock_autocomplete(ProfWin* window, const char* const input, gboolean previous)
 {
@@ -3583,6 +3799,25 @@ _titlebar_autocomplete(ProfWin* window, const char* const input, gboolean previo
     return result;
 }
 
+static char*
+_mainwin_autocomplete(ProfWin* window, const char* const input, gboolean previous)
+{
+    char* result = NULL;
+
+    result = autocomplete_param_with_func(input, "/mainwin scroll", prefs_autocomplete_boolean_choice, previous, NULL);
+    if (result) {
+        return result;
+    }
+
+    return autocomplete_param_with_ac(input, "/mainwin", mainwin_ac, TRUE, previous);
+}
+
+static char*
+_mam_autocomplete(ProfWin* window, const char* const input, gboolean previous)
+{
+    return autocomplete_param_with_ac(input, "/mam", mam_ac, TRUE, previous);
+}
+
 static char*
 _receipts_autocomplete(ProfWin* window, const char* const input, gboolean previous)
 {
@@ -3786,6 +4021,11 @@ _join_autocomplete(ProfWin* window, const char* const input, gboolean previous)
     char* found = NULL;
     gboolean result = FALSE;
 
+    found = autocomplete_param_with_func(input, "/join", muc_invites_find, previous, NULL);
+    if (found) {
+        return found;
+    }
+
     auto_gcharv gchar** args = parse_args(input, 1, 5, &result);
 
     if (result) {
@@ -4172,6 +4412,12 @@ _clear_autocomplete(ProfWin* window, const char* const input, gboolean previous)
     return result;
 }
 
+static char*
+_history_autocomplete(ProfWin* window, const char* const input, gboolean previous)
+{
+    return autocomplete_param_with_ac(input, "/history", history_ac, TRUE, previous);
+}
+
 static char*
 _invite_autocomplete(ProfWin* window, const char* const input, gboolean previous)
 {
@@ -4516,6 +4762,19 @@ _mood_autocomplete(ProfWin* window, const char* const input, gboolean previous)
     return result;
 }
 
+static char*
+_xmlconsole_autocomplete(ProfWin* window, const char* const input, gboolean previous)
+{
+    char* result = NULL;
+
+    result = autocomplete_param_with_ac(input, "/xmlconsole filter", xmlconsole_filter_ac, FALSE, previous);
+    if (result) {
+        return result;
+    }
+
+    return autocomplete_param_with_ac(input, "/xmlconsole", xmlconsole_ac, FALSE, previous);
+}
+
 static char*
 _strophe_autocomplete(ProfWin* window, const char* const input, gboolean previous)
 {
@@ -4531,6 +4790,11 @@ _strophe_autocomplete(ProfWin* window, const char* const input, gboolean previou
         return result;
     }
 
+    result = autocomplete_param_with_func(input, "/strophe capture", prefs_autocomplete_boolean_choice, previous, NULL);
+    if (result) {
+        return result;
+    }
+
     return autocomplete_param_with_ac(input, "/strophe", strophe_ac, FALSE, previous);
 }
 
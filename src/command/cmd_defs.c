@@ -534,7 +534,7 @@ static const struct cmd_t command_defs[] = {
               CMD_TAG_GROUPCHAT)
       CMD_SYN(
               "/join",
-              "/join <room> [nick <nick>] [password <password>]")
+              "/join <room>[,<room>...] [nick <nick>] [password <password>]")
       CMD_DESC(
               "Join a chat room at the conference server. "
               "If no room is supplied, a generated name will be used with the format private-chat-[UUID]. "
@@ -542,9 +542,10 @@ static const struct cmd_t command_defs[] = {
               "If no nickname is specified the account preference 'muc.nick' will be used which by default is the localpart of your JID. "
               "If the room doesn't exist, and the server allows it, a new one will be created. "
               "If you join to a room often, you might also want to add a bookmark (see `/help bookmark`), which also allows to set a default nickname. "
-              "In this case, you should use `/bookmark join`.")
+              "In this case, you should use `/bookmark join`. "
+              "Several rooms separated by commas are joined at once, with the same nickname and password.")
       CMD_ARGS(
-              { "<room>", "The chat room to join." },
+              { "<room>", "The chat room to join, or several separated by commas." },
               { "nick <nick>", "Nickname to use in the room." },
               { "password <password>", "Password if the room requires one." })
       CMD_EXAMPLES(
@@ -552,7 +553,8 @@ static const struct cmd_t command_defs[] = {
               "/join profanity@rooms.dismail.de",
               "/join profanity@rooms.dismail.de nick mynick",
               "/join private@conference.jabber.org nick mynick password mypassword",
-              "/join mychannel")
+              "/join mychannel",
+              "/join profanity@rooms.dismail.de,mychannel")
     },
 
     { CMD_PREAMBLE("/invite",
@@ -756,7 +758,7 @@ static const struct cmd_t command_defs[] = {
       CMD_ARGS(
               { "service <service>", "The conference service to query." },
               { "filter <text>", "The text to filter results by." },
-              { "cache on|off", "Enable or disable caching of rooms list response, enabled by default." },
+              { "cache on|off", "Enable or disable caching of rooms list response for ten minutes, enabled by default." },
               { "cache clear", "Clear the rooms response cache if enabled." })
       CMD_EXAMPLES(
               "/rooms",
@@ -839,14 +841,18 @@ static const struct cmd_t command_defs[] = {
               CMD_TAG_CHAT,
               CMD_TAG_GROUPCHAT)
       CMD_SYN(
-              "/sendfile <file>")
+              "/sendfile <file>",
+              "/sendfile <file> <file> ...")
       CMD_DESC(
-              "Send a file using XEP-0363 HTTP file transfer.")
+              "Send files using XEP-0363 HTTP file transfer. "
+              "Several files are uploaded at the same time, their links are sent in the order given.")
       CMD_ARGS(
-              { "<file>", "Path to the file." })
+              { "<file>", "Path to the file, or a pattern such as *.png. Quote paths containing spaces when sending several files." })
       CMD_EXAMPLES(
               "/sendfile /etc/hosts",
-              "/sendfile ~/images/sweet_cat.jpg")
+              "/sendfile ~/images/sweet_cat.jpg",
+              "/sendfile ~/screenshots/*.png",
+              "/sendfile \"~/my notes.txt\" ~/todo.txt")
     },
 
     { CMD_PREAMBLE("/lastactivity",
@@ -1219,6 +1225,31 @@ static const struct cmd_t command_defs[] = {
               "/time all set \"%d-%m-%y %H:%M:%S\"")
     },
 
+    { CMD_PREAMBLE("/scrollback",
+                   parse_args, 1, 2, &cons_scrollback_setting)
+      CMD_MAINFUNC(cmd_scrollback)
+      CMD_TAGS(
+              CMD_TAG_UI)
+      CMD_SYN(
+              "/scrollback all|console|chat|muc|config|private|xml <lines>",
+              "/scrollback all|console|chat|muc|config|private|xml default")
+      CMD_DESC(
+              "Set how many messages each window type keeps in its scrollback. "
+              "When the limit is reached the oldest messages are discarded from the window, they remain in the chat log.")
+      CMD_ARGS(
+              { "console <lines>", "Number of entries to keep in the console window." },
+              { "chat <lines>", "Number of messages to keep in chat windows." },
+              { "muc <lines>", "Number of messages to keep in chat room windows." },
+              { "config <lines>", "Number of entries to keep in config windows." },
+              { "private <lines>", "Number of messages to keep in private chat windows." },
+              { "xml <lines>", "Number of entries to keep in the XML console window." },
+              { "all <lines>", "Set the limit for all of the above window types." },
+              { "<type> default", "Reset the limit to the default of 200." })
+      CMD_EXAMPLES(
+              "/scrollback muc 5000",
+              "/scrollback all default")
+    },
+
     { CMD_PREAMBLE("/inpblock",
                    parse_args, 2, 2, &cons_inpblock_setting)
       CMD_MAINFUNC(cmd_inpblock)
@@ -1265,18 +1296,20 @@ static const struct cmd_t command_defs[] = {
     },
 
     { CMD_PREAMBLE("/mainwin",
-                   parse_args, 1, 1, &cons_winpos_setting)
+                   parse_args, 1, 2, &cons_winpos_setting)
       CMD_MAINFUNC(cmd_mainwin)
       CMD_TAGS(
               CMD_TAG_UI)
       CMD_SYN(
               "/mainwin up",
-              "/mainwin down")
+              "/mainwin down",
+              "/mainwin scroll on|off")
       CMD_DESC(
-              "Move the main window.")
+              "Move the main window, or change how it is drawn.")
       CMD_ARGS(
               { "up", "Move the main window up the screen." },
-              { "down", "Move the main window down the screen." })
+              { "down", "Move the main window down the screen." },
+              { "scroll on|off", "Let the terminal scroll the main window when new lines arrive, so only the new lines are sent instead of the whole window. Helps over slow connections such as SSH, some terminals show flicker with it." })
     },
 
     { CMD_PREAMBLE("/statusbar",
@@ -1353,6 +1386,7 @@ static const struct cmd_t command_defs[] = {
               "/notify room offline on|off",
               "/notify room current on|off",
               "/notify room text on|off",
+              "/notify room flood <rate>",
               "/notify room trigger add <text>",
               "/notify room trigger remove <text>",
               "/notify room trigger list",
@@ -1382,6 +1416,7 @@ static const struct cmd_t command_defs[] = {
               { "room offline on|off", "Notifications for chat room messages that were sent while you were offline." },
               { "room current on|off", "Whether to show all chat room messages notifications when the window is focused." },
               { "room text on|off", "Show message text in chat room message notifications." },
+              { "room flood <rate>", "Above <rate> messages per second in a room, hold back per message notifications and console alerts and show a summary once it calms down, use 0 to disable." },
               { "room trigger add <text>", "Notify when specified text included in all chat room messages." },
               { "room trigger remove <text>", "Remove chat room notification trigger." },
               { "room trigger list", "List all chat room highlight triggers." },
@@ -1404,6 +1439,7 @@ static const struct cmd_t command_defs[] = {
               "/notify room trigger on",
               "/notify room current off",
               "/notify room text off",
+              "/notify room flood 50",
               "/notify remind 60",
               "/notify typing on",
               "/notify invite on")
@@ -1871,18 +1907,37 @@ static const struct cmd_t command_defs[] = {
     },
 
     { CMD_PREAMBLE("/history",
-                   parse_args, 1, 1, &cons_history_setting)
+                   parse_args_with_freetext, 1, 3, &cons_history_setting)
       CMD_MAINFUNC(cmd_history)
       CMD_TAGS(
               CMD_TAG_UI,
               CMD_TAG_CHAT)
       CMD_SYN(
-              "/history on|off")
+              "/history on|off",
+              "/history search <text>",
+              "/history retention [<jid>] <policy>|off",
+              "/history archive <days>|off",
+              "/history vacuum",
+              "/history import")
       CMD_DESC(
               "Switch chat history on or off, /logging chat will automatically be enabled when this setting is on. "
-              "When history is enabled, previous messages are shown in chat windows.")
-      CMD_ARGS(
-              { "on|off", "Enable or disable showing chat history." })
+              "When history is enabled, previous messages are shown in chat windows. "
+              "History of all contacts and rooms can be searched, best matches are shown first. "
+              "The chat log database can drop old messages, move them to an archive file and give freed space back. "
+              "This is done in the background every hour.")
+      CMD_ARGS(
+              { "on|off", "Enable or disable showing chat history." },
+              { "search <text>", "Search logged messages containing all the words in text. Archived messages are not searched." },
+              { "retention <policy>|off", "Drop logged messages older than <n>d days, unless the contact or room has its own policy." },
+              { "retention <jid> <policy>|off", "Keep the last <n>d days or the newest <n> messages with a contact or room." },
+              { "archive <days>|off", "Move messages older than days to a separate archive file, history still shows them. Takes effect on next connect." },
+              { "vacuum", "Rewrite the database once to shrink it, needed for databases created before freed space was given back." },
+              { "import", "Add the messages in the account's flat-file chat logs to the database, messages already in it are skipped." })
+      CMD_EXAMPLES(
+              "/history search release notes",
+              "/history retention 365d",
+              "/history retention room@conference.example.org 5000",
+              "/history archive 90")
     },
 
     { CMD_PREAMBLE("/log",
@@ -1893,6 +1948,7 @@ static const struct cmd_t command_defs[] = {
               "/log rotate on|off",
               "/log maxsize <bytes>",
               "/log shared on|off",
+              "/log compress on|off",
               "/log level INFO|DEBUG|WARN|ERROR")
       CMD_DESC(
               "Manage profanity log settings.")
@@ -1901,6 +1957,7 @@ static const struct cmd_t command_defs[] = {
               { "rotate on|off", "Rotate log, default on. Does not take effect if you specified a filename yourself when starting Profanity." },
               { "maxsize <bytes>", "With rotate enabled, specifies the max log size, defaults to 10485760 (10MB)." },
               { "shared on|off", "Share logs between all instances, default: on. When off, the process id will be included in the log filename. Does not take effect if you specified a filename yourself when starting Profanity." },
+              { "compress on|off", "Compress rotated logs and chat logs of past days with gzip, default: off. The /history import command reads compressed chat logs too." },
               {"level INFO|DEBUG|WARN|ERROR", "Set the log level. Default is INFO. Only works with default log file, not with user provided log file during startup via -f." })
     },
 
@@ -1918,6 +1975,49 @@ static const struct cmd_t command_defs[] = {
               { "on|off", "Enable or disable message carbons." })
     },
 
+    { CMD_PREAMBLE("/csi",
+                   parse_args, 1, 1, &cons_csi_setting)
+      CMD_MAINFUNC(cmd_csi)
+      CMD_TAGS(
+              CMD_TAG_PRESENCE)
+      CMD_SYN(
+              "/csi on|off")
+      CMD_DESC(
+              "Enable or disable client state indication. "
+              "When enabled the server is told the client is inactive while the terminal is unfocused or idle for a minute, "
+              "so it can hold back presence updates and other non-urgent traffic until the user returns. "
+              "Only enable this if your server supports XEP-0352, focus tracking also needs a terminal that reports focus events.")
+      CMD_ARGS(
+              { "on|off", "Enable or disable client state indication." })
+    },
+
+    { CMD_PREAMBLE("/stats",
+                   parse_args, 0, 3, NULL)
+      CMD_MAINFUNC(cmd_stats)
+      CMD_TAGS(
+              CMD_TAG_UI)
+      CMD_SYN(
+              "/stats",
+              "/stats reset",
+              "/stats budget <ms>|off",
+              "/stats trace start <file>",
+              "/stats trace stop")
+      CMD_DESC(
+              "Show runtime statistics: stanzas received and sent per second by type, "
+              "main loop iteration and screen update times, the database write queue, time spent in plugin hooks and OMEMO, "
+              "how long key presses and received stanzas take to show on screen, "
+              "pending IQ requests, and entries and approximate memory of each window's buffer. "
+              "Main loop iterations and handlers that take longer than the frame budget are logged as warnings, naming the slowest part. "
+              "Plugins can read the same counters with prof_get_stats(). "
+              "A trace records when stanza handlers, periodic tasks, screen updates, database writes, OMEMO and plugin hooks ran, "
+              "as Chrome trace JSON that chrome://tracing or Perfetto can open. Only the latest 65536 spans are kept.")
+      CMD_ARGS(
+              { "reset", "Clear the collected counters, including the plugin hook statistics." },
+              { "budget <ms>|off", "Log main loop iterations and handlers slower than this, 50 ms by default." },
+              { "trace start <file>", "Start recording a trace, to be written to file." },
+              { "trace stop", "Stop recording and write the trace." })
+    },
+
     { CMD_PREAMBLE("/receipts",
                    parse_args, 2, 2, &cons_receipts_setting)
       CMD_MAINFUNC(cmd_receipts)
@@ -1942,9 +2042,11 @@ static const struct cmd_t command_defs[] = {
               "/reconnect <seconds>",
               "/reconnect now")
       CMD_DESC(
-              "Set the reconnect attempt interval for when the connection is lost or immediately trigger a reconnect.")
+              "Set the reconnect attempt interval for when the connection is lost or immediately trigger a reconnect. "
+              "The first attempt is made within a few seconds, after that the interval doubles with each failed attempt up to 10 minutes. "
+              "Each wait is picked at random up to the interval so clients don't reconnect in lockstep.")
       CMD_ARGS(
-              { "<seconds>", "Number of seconds before attempting to reconnect, a value of 0 disables reconnect." },
+              { "<seconds>", "Base number of seconds before attempting to reconnect, a value of 0 disables reconnect." },
               { "now", "Immediately trigger a reconnect." })
     },
 
@@ -2154,7 +2256,8 @@ static const struct cmd_t command_defs[] = {
               { "load", cmd_plugins_load },
               { "unload", cmd_plugins_unload },
               { "reload", cmd_plugins_reload },
-              { "python_version", cmd_plugins_python_version })
+              { "python_version", cmd_plugins_python_version },
+              { "stats", cmd_plugins_stats })
       CMD_MAINFUNC(cmd_plugins)
       CMD_SYN(
               "/plugins",
@@ -2164,7 +2267,8 @@ static const struct cmd_t command_defs[] = {
               "/plugins unload [<plugin>]",
               "/plugins load [<plugin>]",
               "/plugins reload [<plugin>]",
-              "/plugins python_version")
+              "/plugins python_version",
+              "/plugins stats [reset]")
       CMD_DESC(
               "Manage plugins. Passing no arguments lists installed plugins and global plugins which are available for local installation. Global directory for Python plugins is " GLOBAL_PYTHON_PLUGINS_PATH " and for C Plugins is " GLOBAL_C_PLUGINS_PATH ".")
       CMD_ARGS(
@@ -2174,7 +2278,9 @@ static const struct cmd_t command_defs[] = {
               { "load [<plugin>]", "Load a plugin that already exists in the plugin directory, passing no argument loads all found plugins. It will be loaded upon next start too unless unloaded." },
               { "unload [<plugin>]", "Unload a loaded plugin, passing no argument will unload all plugins." },
               { "reload [<plugin>]", "Reload a plugin, passing no argument will reload all plugins." },
-              { "python_version", "Show the Python interpreter version." })
+              { "python_version", "Show the Python interpreter version." },
+              { "stats", "Show call counts and total, average, 99th percentile and maximum run time of each plugin hook, slowest first." },
+              { "stats reset", "Clear the collected plugin statistics." })
       CMD_EXAMPLES(
               "/plugins install /home/steveharris/Downloads/metal.py",
               "/plugins install https://raw.githubusercontent.com/profanity-im/profanity-plugins/master/stable/sounds.py",
@@ -2231,14 +2337,29 @@ static const struct cmd_t command_defs[] = {
     },
 
     { CMD_PREAMBLE("/xmlconsole",
-                   parse_args, 0, 0, NULL)
+                   parse_args, 0, 3, NULL)
       CMD_MAINFUNC(cmd_xmlconsole)
       CMD_TAGS(
               CMD_TAG_UI)
       CMD_SYN(
-              "/xmlconsole")
+              "/xmlconsole",
+              "/xmlconsole filter",
+              "/xmlconsole filter element|ns|jid [<value>]",
+              "/xmlconsole filter clear")
       CMD_DESC(
-              "Open the XML console to view incoming and outgoing XMPP traffic.")
+              "Open the XML console to view incoming and outgoing XMPP traffic. "
+              "The console keeps the last " G_STRINGIFY(XMLWIN_RING_SIZE) " stanzas and only draws them while it is shown. "
+              "Filters are checked before a stanza is kept, when several are set a stanza must match all of them.")
+      CMD_ARGS(
+              { "filter", "Show the current filters." },
+              { "filter element [<value>]", "Only keep stanzas whose top level element has this name, e.g. iq or message. Without a value the filter is removed." },
+              { "filter ns [<value>]", "Only keep stanzas that declare this namespace anywhere, e.g. urn:xmpp:mam:2." },
+              { "filter jid [<value>]", "Only keep stanzas sent to or from this jid, a bare jid also matches its resources." },
+              { "filter clear", "Remove all filters." })
+      CMD_EXAMPLES(
+              "/xmlconsole filter element iq",
+              "/xmlconsole filter ns http://jabber.org/protocol/disco#info",
+              "/xmlconsole filter jid conference.example.org")
     },
 
     { CMD_PREAMBLE("/script",
@@ -2495,6 +2616,21 @@ static const struct cmd_t command_defs[] = {
               { "on|off", "Enable or disable slashguard." })
     },
 
+    { CMD_PREAMBLE("/fuzzy",
+                   parse_args, 1, 1, &cons_fuzzy_setting)
+      CMD_MAINFUNC(cmd_fuzzy)
+      CMD_TAGS(
+              CMD_TAG_UI)
+      CMD_SYN(
+              "/fuzzy on|off")
+      CMD_DESC(
+              "Fuzzy tab completion offers every nick, contact, room or command that contains the typed characters in order, "
+              "best matches first. Matches at the start of a word and consecutive characters rank higher. "
+              "When disabled only items starting with the typed text are completed.")
+      CMD_ARGS(
+              { "on|off", "Enable or disable fuzzy completion." })
+    },
+
     { CMD_PREAMBLE("/serversoftware",
                    parse_args, 1, 1, NULL)
       CMD_MAINFUNC(cmd_serversoftware)
@@ -2558,39 +2694,55 @@ static const struct cmd_t command_defs[] = {
     },
 
     { CMD_PREAMBLE("/url",
-                   parse_args, 2, 3, NULL)
+                   parse_args, 2, 3, &cons_url_setting)
       CMD_SUBFUNCS(
               { "open", cmd_url_open },
-              { "save", cmd_url_save })
+              { "save", cmd_url_save },
+              { "limit", cmd_url_limit },
+              { "resize", cmd_url_resize })
       CMD_TAGS(
               CMD_TAG_CHAT,
               CMD_TAG_GROUPCHAT)
       CMD_SYN(
               "/url open <url>",
-              "/url save <url> [<path>]")
+              "/url save <url> [<path>]",
+              "/url limit <kib>|off",
+              "/url resize <pixels>|off")
       CMD_DESC(
-              "Open or save URLs. This works with OMEMO encrypted files as well.")
+              "Open or save URLs. This works with OMEMO encrypted files as well. "
+              "Interrupted downloads are resumed where they stopped if the server supports it.")
       CMD_ARGS(
               { "open", "Open URL with predefined executable." },
-              { "save", "Save URL to optional path, default path is current directory." })
+              { "save", "Save URL to optional path, default path is current directory." },
+              { "limit <kib>", "Limit the bandwidth of each download to <kib> KiB per second." },
+              { "limit off", "Download without a bandwidth limit (default)." },
+              { "resize <pixels>", "Downscale JPEG and PNG images sent with /sendfile so that no side exceeds <pixels>. Image metadata is removed." },
+              { "resize off", "Send images unchanged (default)." })
       CMD_EXAMPLES(
               "/url open https://profanity-im.github.io",
-              "/url save https://profanity-im.github.io/guide/latest/userguide.html /home/user/Download/")
+              "/url save https://profanity-im.github.io/guide/latest/userguide.html /home/user/Download/",
+              "/url limit 512",
+              "/url resize 2048")
     },
 
     { CMD_PREAMBLE("/mam",
-                   parse_args, 1, 1, &cons_mam_setting)
+                   parse_args, 1, 2, &cons_mam_setting)
       CMD_MAINFUNC(cmd_mam)
       CMD_TAGS(
               CMD_TAG_CHAT)
       CMD_SYN(
-              "/mam <on>|<off>")
+              "/mam <on>|<off>",
+              "/mam pagesize <n>")
       CMD_DESC(
               "Enable/Disable Message Archive Management (XEP-0313) "
               "Currently MAM in groupchats (MUCs) is not supported."
               "Use the PG UP key to load more history.")
       CMD_ARGS(
-              { "on|off", "Enable or disable MAM" })
+              { "on|off", "Enable or disable MAM" },
+              { "pagesize <n>", "Largest number of messages fetched from the archive or the history in one go. The first page is kept small, later pages double up to this size. Default is 100." })
+      CMD_EXAMPLES(
+              "/mam on",
+              "/mam pagesize 250")
     },
 
     { CMD_PREAMBLE("/changepassword",
@@ -2631,14 +2783,29 @@ static const struct cmd_t command_defs[] = {
     },
 
     { CMD_PREAMBLE("/silence",
-                   parse_args, 1, 1, &cons_silence_setting)
+                   parse_args, 1, 2, &cons_silence_setting)
       CMD_MAINFUNC(cmd_silence)
       CMD_TAGS(
               CMD_TAG_CHAT)
       CMD_SYN(
-              "/silence on|off")
-      CMD_DESC(
-              "Let's you silence all message attempts from people who are not in your roster.")
+              "/silence on|off",
+              "/silence quarantine on|off",
+              "/silence requests",
+              "/silence accept <jid>",
+              "/silence clear")
+      CMD_DESC(
+              "Let's you silence all message attempts from people who are not in your roster. "
+              "With quarantine, messages from such senders are held back instead of opening a window each, "
+              "until you accept the sender.")
+      CMD_ARGS(
+              { "on|off", "Drop all messages from JIDs that are not in the roster." },
+              { "quarantine on|off", "Hold back messages from JIDs that are not in the roster, counting them per sender." },
+              { "requests", "List held back senders with their message count and the start of their first message." },
+              { "accept <jid>", "Let messages from the JID through for the rest of the session." },
+              { "clear", "Forget all held back messages." })
+      CMD_EXAMPLES(
+              "/silence quarantine on",
+              "/silence accept stranger@example.org")
     },
 
     { CMD_PREAMBLE("/register",
@@ -2694,15 +2861,21 @@ static const struct cmd_t command_defs[] = {
               CMD_TAG_CONNECTION)
       CMD_SYN(
               "/strophe verbosity 0-3",
-              "/strophe sm on|no-resend|off")
+              "/strophe sm on|no-resend|off",
+              "/strophe iq-inflight <n>",
+              "/strophe capture on|off")
       CMD_DESC(
-              "Modify libstrophe settings.")
+              "Modify libstrophe and stream settings.")
       CMD_ARGS(
               { "verbosity 0-3", "Set libstrophe verbosity level when log level is 'DEBUG'." },
-              { "sm on|no-resend|off", "Enable or disable Stream-Management (SM) as of XEP-0198. The 'no-resend' option enables SM, but won't re-send un-ACK'ed messages on re-connect." })
+              { "sm on|no-resend|off", "Enable or disable Stream-Management (SM) as of XEP-0198. The 'no-resend' option enables SM, but won't re-send un-ACK'ed messages on re-connect." },
+              { "iq-inflight <n>", "Maximum number of unanswered requests sent to one domain at a time, further requests wait for an answer or timeout. 0 disables the limit, default is 8." },
+              { "capture on|off", "Write all XML sent and received to a capture file in the logs directory, independent of the log level. The file is written in the background and rotated at 64MB, keeping the previous part as <file>.1." })
       CMD_EXAMPLES(
               "/strophe verbosity 3",
-              "/strophe sm no-resend")
+              "/strophe sm no-resend",
+              "/strophe iq-inflight 4",
+              "/strophe capture on")
     },
 
     { CMD_PREAMBLE("/privacy",
@@ -2731,14 +2904,22 @@ static const struct cmd_t command_defs[] = {
     },
 
     { CMD_PREAMBLE("/redraw",
-                   parse_args, 0, 0, NULL)
+                   parse_args, 0, 2, &cons_redraw_setting)
       CMD_MAINFUNC(cmd_redraw)
       CMD_TAGS(
               CMD_TAG_UI)
       CMD_SYN(
-              "/redraw")
+              "/redraw",
+              "/redraw rate <updates>|off")
       CMD_DESC(
               "Redraw user interface. Can be used when some other program interrupted profanity or wrote to the same terminal and the interface looks \"broken\"." )
+      CMD_ARGS(
+              { "rate <updates>", "Update the screen at most this many times per second, changes in between are drawn together. "
+                                  "The status bar clock then only moves along with other updates. Reduces terminal output over slow remote connections such as SSH or mosh." },
+              { "rate off", "Update the screen as soon as something changes, the default." })
+      CMD_EXAMPLES(
+              "/redraw rate 4",
+              "/redraw rate off")
     },
 
     // NEXT-COMMAND (search helper)
@@ -2746,10 +2927,24 @@ static const struct cmd_t command_defs[] = {
 
 // clang-format on
 
-static GHashTable* search_index;
-
-static char*
-_cmd_index(const Command* cmd)
+// inverted index for /help search, one entry per distinct help text token and
+// command, sorted by token so finding the commands for a term prefix is a
+// binary search, built on the first search rather than at startup
+typedef struct cmd_posting_t
+{
+    gchar* token;
+    const char* cmd;
+} CmdPosting;
+
+static GArray* search_index = NULL;
+// Command to a table of its subcommand names, the values are the sub_funcs
+// index plus one
+static GHashTable* subcommands = NULL;
+// alias name to the command it runs, kept in step with the alias preferences
+static GHashTable* alias_index = NULL;
+
+static void
+_cmd_index(const Command* cmd, GArray* index)
 {
     GString* index_source = g_string_new("");
     index_source = g_string_append(index_source, cmd->cmd);
@@ -2774,70 +2969,151 @@ _cmd_index(const Command* cmd)
         index_source = g_string_append(index_source, " ");
     }
 
-    auto_gcharv gchar** tokens = g_str_tokenize_and_fold(index_source->str, NULL, NULL);
+    gchar** tokens = g_str_tokenize_and_fold(index_source->str, NULL, NULL);
     g_string_free(index_source, TRUE);
 
-    GString* index = g_string_new("");
-    for (int i = 0; i < g_strv_length(tokens); i++) {
-        index = g_string_append(index, tokens[i]);
-        index = g_string_append(index, " ");
+    // the array takes over the token strings
+    for (int i = 0; tokens[i] != NULL; i++) {
+        CmdPosting posting = { tokens[i], cmd->cmd };
+        g_array_append_val(index, posting);
     }
+    g_free(tokens);
+}
+
+static int
+_cmd_posting_cmp(gconstpointer a, gconstpointer b)
+{
+    const CmdPosting* posting_a = a;
+    const CmdPosting* posting_b = b;
+
+    int res = strcmp(posting_a->token, posting_b->token);
+    return res != 0 ? res : strcmp(posting_a->cmd, posting_b->cmd);
+}
 
-    return g_string_free(index, FALSE);
+static void
+_cmd_posting_clear(gpointer data)
+{
+    CmdPosting* posting = data;
+    g_free(posting->token);
+}
+
+static void
+_cmd_search_index_build(void)
+{
+    if (search_index) {
+        return;
+    }
+
+    GArray* index = g_array_new(FALSE, FALSE, sizeof(CmdPosting));
+    for (unsigned int i = 0; i < ARRAY_SIZE(command_defs); i++) {
+        _cmd_index(command_defs + i, index);
+    }
+    g_array_sort(index, _cmd_posting_cmp);
+
+    // drop repeated tokens of the same command
+    guint kept = 0;
+    for (guint i = 0; i < index->len; i++) {
+        CmdPosting* posting = &g_array_index(index, CmdPosting, i);
+        if (kept > 0 && _cmd_posting_cmp(&g_array_index(index, CmdPosting, kept - 1), posting) == 0) {
+            g_free(posting->token);
+        } else {
+            g_array_index(index, CmdPosting, kept++) = *posting;
+        }
+    }
+    g_array_set_size(index, kept);
+    g_array_set_clear_func(index, _cmd_posting_clear);
+
+    search_index = index;
+}
+
+// commands with a help text token starting with term, as a set of names
+static GHashTable*
+_cmd_search_term(const char* const term)
+{
+    GHashTable* found = g_hash_table_new(g_str_hash, g_str_equal);
+
+    guint lo = 0;
+    guint hi = search_index->len;
+    while (lo < hi) {
+        guint mid = lo + (hi - lo) / 2;
+        if (strcmp(g_array_index(search_index, CmdPosting, mid).token, term) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    for (guint i = lo; i < search_index->len; i++) {
+        CmdPosting* posting = &g_array_index(search_index, CmdPosting, i);
+        if (!g_str_has_prefix(posting->token, term)) {
+            break;
+        }
+        g_hash_table_add(found, (gpointer)posting->cmd);
+    }
+
+    return found;
 }
 
 GList*
 cmd_search_index_any(char* term)
 {
-    GList* results = NULL;
+    _cmd_search_index_build();
 
     auto_gcharv gchar** processed_terms = g_str_tokenize_and_fold(term, NULL, NULL);
     int terms_len = g_strv_length(processed_terms);
 
+    GHashTable* results = g_hash_table_new(g_str_hash, g_str_equal);
     for (int i = 0; i < terms_len; i++) {
-        GList* index_keys = g_hash_table_get_keys(search_index);
-        GList* curr = index_keys;
-        while (curr) {
-            char* index_entry = g_hash_table_lookup(search_index, curr->data);
-            if (g_str_match_string(processed_terms[i], index_entry, FALSE)) {
-                results = g_list_append(results, curr->data);
-            }
-            curr = g_list_next(curr);
+        GHashTable* found = _cmd_search_term(processed_terms[i]);
+        GHashTableIter iter;
+        gpointer cmd;
+        g_hash_table_iter_init(&iter, found);
+        while (g_hash_table_iter_next(&iter, &cmd, NULL)) {
+            g_hash_table_add(results, cmd);
         }
-        g_list_free(index_keys);
+        g_hash_table_destroy(found);
     }
 
-    return results;
+    GList* result = g_hash_table_get_keys(results);
+    g_hash_table_destroy(results);
+
+    return result;
 }
 
 GList*
 cmd_search_index_all(char* term)
 {
-    GList* results = NULL;
+    _cmd_search_index_build();
 
     auto_gcharv gchar** terms = g_str_tokenize_and_fold(term, NULL, NULL);
     int terms_len = g_strv_length(terms);
 
-    GList* commands = g_hash_table_get_keys(search_index);
-    GList* curr = commands;
-    while (curr) {
-        char* command = curr->data;
-        int matches = 0;
-        for (int i = 0; i < terms_len; i++) {
-            char* command_index = g_hash_table_lookup(search_index, command);
-            if (g_str_match_string(terms[i], command_index, FALSE)) {
-                matches++;
-            }
+    if (terms_len == 0) {
+        GList* result = NULL;
+        for (unsigned int i = 0; i < ARRAY_SIZE(command_defs); i++) {
+            result = g_list_append(result, command_defs[i].cmd);
         }
-        if (matches == terms_len) {
-            results = g_list_append(results, command);
+        return result;
+    }
+
+    GHashTable* results = _cmd_search_term(terms[0]);
+    for (int i = 1; i < terms_len && g_hash_table_size(results) > 0; i++) {
+        GHashTable* found = _cmd_search_term(terms[i]);
+        GHashTableIter iter;
+        gpointer cmd;
+        g_hash_table_iter_init(&iter, results);
+        while (g_hash_table_iter_next(&iter, &cmd, NULL)) {
+            if (!g_hash_table_contains(found, cmd)) {
+                g_hash_table_iter_remove(&iter);
+            }
         }
-        curr = g_list_next(curr);
+        g_hash_table_destroy(found);
     }
 
-    g_list_free(commands);
+    GList* result = g_hash_table_get_keys(results);
+    g_hash_table_destroy(results);
 
-    return results;
+    return result;
 }
 
 /*
@@ -2850,18 +3126,22 @@ cmd_init(void)
 
     cmd_ac_init();
 
-    search_index = g_hash_table_new_full(g_str_hash, g_str_equal, free, g_free);
-
     // load command defs into hash table
     commands = g_hash_table_new(g_str_hash, g_str_equal);
+    subcommands = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)g_hash_table_destroy);
     for (unsigned int i = 0; i < ARRAY_SIZE(command_defs); i++) {
         const Command* pcmd = command_defs + i;
 
         // add to hash
         g_hash_table_insert(commands, pcmd->cmd, (gpointer)pcmd);
 
-        // add to search index
-        g_hash_table_insert(search_index, strdup(pcmd->cmd), _cmd_index(pcmd));
+        if (pcmd->sub_funcs[0].cmd) {
+            GHashTable* subs = g_hash_table_new(g_str_hash, g_str_equal);
+            for (int j = 0; pcmd->sub_funcs[j].cmd; j++) {
+                g_hash_table_insert(subs, (gpointer)pcmd->sub_funcs[j].cmd, GINT_TO_POINTER(j + 1));
+            }
+            g_hash_table_insert(subcommands, (gpointer)pcmd, subs);
+        }
 
         // add to commands and help autocompleters
         cmd_ac_add_cmd(pcmd);
@@ -2876,13 +3156,25 @@ cmd_init(void)
         curr = g_list_next(curr);
     }
     prefs_free_aliases(aliases);
+    cmd_alias_index_load();
+
+    autocomplete_set_fuzzy(prefs_get_boolean(PREF_COMPLETION_FUZZY));
 }
 
 void
 cmd_uninit(void)
 {
     cmd_ac_uninit();
-    g_hash_table_destroy(search_index);
+    if (search_index) {
+        g_array_free(search_index, TRUE);
+        search_index = NULL;
+    }
+    g_hash_table_destroy(subcommands);
+    subcommands = NULL;
+    if (alias_index) {
+        g_hash_table_destroy(alias_index);
+        alias_index = NULL;
+    }
 }
 
 gboolean
@@ -2901,6 +3193,57 @@ cmd_get(const char* const command)
     }
 }
 
+// index into sub_funcs for the first argument of a command, -1 if it isn't one
+int
+cmd_get_sub_index(Command* cmd, const char* const arg)
+{
+    GHashTable* subs = subcommands ? g_hash_table_lookup(subcommands, cmd) : NULL;
+    if (!subs) {
+        return -1;
+    }
+
+    return GPOINTER_TO_INT(g_hash_table_lookup(subs, arg)) - 1;
+}
+
+const char*
+cmd_get_alias(const char* const name)
+{
+    return alias_index ? g_hash_table_lookup(alias_index, name) : NULL;
+}
+
+// (re)reads all aliases from the preferences
+void
+cmd_alias_index_load(void)
+{
+    if (alias_index) {
+        g_hash_table_remove_all(alias_index);
+    }
+
+    GList* aliases = prefs_get_aliases();
+    for (GList* curr = aliases; curr; curr = g_list_next(curr)) {
+        ProfAlias* alias = curr->data;
+        cmd_alias_index_set(alias->name, alias->value);
+    }
+    prefs_free_aliases(aliases);
+}
+
+void
+cmd_alias_index_set(const char* const name, const char* const value)
+{
+    if (!alias_index) {
+        alias_index = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    }
+    g_hash_table_replace(alias_index, g_strdup(name), g_strdup(value));
+}
+
+void
+cmd_alias_index_remove(const char* const name)
+{
+    if (alias_index) {
+        g_hash_table_remove(alias_index, name);
+    }
+}
+
 GList*
 cmd_get_ordered(const char* const tag)
 {
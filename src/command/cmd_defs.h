@@ -45,6 +45,11 @@ void cmd_init(void);
 void cmd_uninit(void);
 
 Command* cmd_get(const char* const command);
+int cmd_get_sub_index(Command* cmd, const char* const arg);
+const char* cmd_get_alias(const char* const name);
+void cmd_alias_index_load(void);
+void cmd_alias_index_set(const char* const name, const char* const value);
+void cmd_alias_index_remove(const char* const name);
 GList* cmd_get_ordered(const char* const tag);
 
 gboolean cmd_valid_tag(const char* const str);
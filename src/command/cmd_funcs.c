@@ -48,6 +48,7 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <fcntl.h>
+#include <glob.h>
 #include <unistd.h>
 #include <langinfo.h>
 #include <ctype.h>
@@ -60,6 +61,7 @@
 
 #include "profanity.h"
 #include "log.h"
+#include "stats.h"
 #include "common.h"
 #include "command/cmd_funcs.h"
 #include "command/cmd_defs.h"
@@ -72,6 +74,7 @@
 #include "config/theme.h"
 #include "config/tlscerts.h"
 #include "config/scripts.h"
+#include "database.h"
 #include "event/client_events.h"
 #include "tools/http_upload.h"
 #include "tools/http_download.h"
@@ -85,10 +88,12 @@
 #include "ui/ui.h"
 #include "ui/window_list.h"
 #include "xmpp/avatar.h"
+#include "xmpp/capture.h"
 #include "xmpp/chat_session.h"
 #include "xmpp/connection.h"
 #include "xmpp/contact.h"
 #include "xmpp/jid.h"
+#include "xmpp/message.h"
 #include "xmpp/muc.h"
 #include "xmpp/roster_list.h"
 #include "xmpp/session.h"
@@ -1835,57 +1840,10 @@ _who_room(ProfWin* window, const char* const command, gchar** args)
     if (_string_matches_one_of(NULL, args[0], TRUE, "online", "available", "unavailable", "away", "chat", "xa", "dnd", "any", NULL)) {
 
         gchar* presence = args[0];
-        GList* occupants = muc_roster(mucwin->roomjid);
+        gboolean any = (presence == NULL) || (g_strcmp0(presence, "any") == 0);
 
-        // no arg, show all contacts
-        if ((presence == NULL) || (g_strcmp0(presence, "any") == 0)) {
-            mucwin_roster(mucwin, occupants, NULL);
-
-            // available
-        } else if (strcmp("available", presence) == 0) {
-            GList* filtered = NULL;
-
-            while (occupants) {
-                Occupant* occupant = occupants->data;
-                if (muc_occupant_available(occupant)) {
-                    filtered = g_list_append(filtered, occupant);
-                }
-                occupants = g_list_next(occupants);
-            }
-
-            mucwin_roster(mucwin, filtered, "available");
-
-            // unavailable
-        } else if (strcmp("unavailable", presence) == 0) {
-            GList* filtered = NULL;
-
-            while (occupants) {
-                Occupant* occupant = occupants->data;
-                if (!muc_occupant_available(occupant)) {
-                    filtered = g_list_append(filtered, occupant);
-                }
-                occupants = g_list_next(occupants);
-            }
-
-            mucwin_roster(mucwin, filtered, "unavailable");
-
-            // show specific status
-        } else {
-            GList* filtered = NULL;
-
-            while (occupants) {
-                Occupant* occupant = occupants->data;
-                const char* presence_str = string_from_resource_presence(occupant->presence);
-                if (strcmp(presence_str, presence) == 0) {
-                    filtered = g_list_append(filtered, occupant);
-                }
-                occupants = g_list_next(occupants);
-            }
-
-            mucwin_roster(mucwin, filtered, presence);
-        }
-
-        g_list_free(occupants);
+        // no arg shows all contacts, otherwise those with the given presence
+        mucwin_roster(mucwin, any ? NULL : presence);
 
         // role or affiliation filter
     } else {
@@ -3544,6 +3502,42 @@ cmd_serversoftware(ProfWin* window, const char* const command, gchar** args)
     return TRUE;
 }
 
+static void
+_cmd_join_room(ProfAccount* account, const char* const room_arg_str, const char* const nick, const char* passwd, gboolean switch_to)
+{
+    auto_jid Jid* room_arg = jid_create(room_arg_str);
+    auto_gchar gchar* room = NULL;
+
+    // full room jid supplied (room@server)
+    if (room_arg->localpart) {
+        room = g_strdup(room_arg_str);
+
+        // server not supplied (room), use account preference
+    } else if (account->muc_service) {
+        room = g_strdup_printf("%s@%s", room_arg_str, account->muc_service);
+
+        // no account preference
+    } else {
+        cons_show("Account MUC service property not found.");
+        return;
+    }
+
+    // When no password, check for invite with password
+    if (!passwd) {
+        passwd = muc_invite_password(room);
+    }
+
+    if (!muc_active(room)) {
+        presence_join_room(room, nick, passwd);
+        muc_join(room, nick, passwd, FALSE);
+        iq_room_affiliation_list(room, "member", false);
+        iq_room_affiliation_list(room, "admin", false);
+        iq_room_affiliation_list(room, "owner", false);
+    } else if (switch_to && muc_roster_complete(room)) {
+        ui_switch_to_room(room);
+    }
+}
+
 gboolean
 cmd_join(ProfWin* window, const char* const command, gchar** args)
 {
@@ -3571,33 +3565,22 @@ cmd_join(ProfWin* window, const char* const command, gchar** args)
         return TRUE;
     }
 
-    auto_jid Jid* room_arg = jid_create(args[0]);
-    if (room_arg == NULL) {
-        cons_show_error("Specified room has incorrect format.");
-        cons_show("");
-        return TRUE;
+    // several rooms separated by commas are joined in one go, their join
+    // presences leave in the same write and each window opens when its
+    // room answers
+    auto_gcharv gchar** rooms = g_strsplit(args[0], ",", -1);
+    for (int i = 0; rooms[i] != NULL; i++) {
+        auto_jid Jid* room_arg = jid_create(rooms[i]);
+        if (room_arg == NULL) {
+            cons_show_error("Specified room has incorrect format.");
+            cons_show("");
+            return TRUE;
+        }
     }
 
-    auto_gchar gchar* room = NULL;
-    char* nick = NULL;
-    char* passwd = NULL;
     char* account_name = session_get_account_name();
     ProfAccount* account = accounts_get_account(account_name);
 
-    // full room jid supplied (room@server)
-    if (room_arg->localpart) {
-        room = g_strdup(args[0]);
-
-        // server not supplied (room), use account preference
-    } else if (account->muc_service) {
-        room = g_strdup_printf("%s@%s", args[0], account->muc_service);
-
-        // no account preference
-    } else {
-        cons_show("Account MUC service property not found.");
-        return TRUE;
-    }
-
     // Additional args supplied
     gchar* opt_keys[] = { "nick", "password", NULL };
     gboolean parsed;
@@ -3606,34 +3589,24 @@ cmd_join(ProfWin* window, const char* const command, gchar** args)
     if (!parsed) {
         cons_bad_cmd_usage(command);
         cons_show("");
+        account_free(account);
         return TRUE;
     }
 
-    nick = g_hash_table_lookup(options, "nick");
-    passwd = g_hash_table_lookup(options, "password");
-
-    options_destroy(options);
+    char* nick = g_hash_table_lookup(options, "nick");
+    char* passwd = g_hash_table_lookup(options, "password");
 
     // In the case that a nick wasn't provided by the optional args...
     if (!nick) {
         nick = account->muc_nick;
     }
 
-    // When no password, check for invite with password
-    if (!passwd) {
-        passwd = muc_invite_password(room);
-    }
-
-    if (!muc_active(room)) {
-        presence_join_room(room, nick, passwd);
-        muc_join(room, nick, passwd, FALSE);
-        iq_room_affiliation_list(room, "member", false);
-        iq_room_affiliation_list(room, "admin", false);
-        iq_room_affiliation_list(room, "owner", false);
-    } else if (muc_roster_complete(room)) {
-        ui_switch_to_room(room);
+    gboolean single = g_strv_length(rooms) == 1;
+    for (int i = 0; rooms[i] != NULL; i++) {
+        _cmd_join_room(account, rooms[i], nick, passwd, single);
     }
 
+    options_destroy(options);
     account_free(account);
 
     return TRUE;
@@ -4835,79 +4808,154 @@ cmd_disco(ProfWin* window, const char* const command, gchar** args)
 // TODO: Move this into its own tools such as HTTPUpload or AESGCMDownload.
 #ifdef HAVE_OMEMO
 char*
-_add_omemo_stream(int* fd, FILE** fh, char** err)
-{
-    // Create temporary file for writing ciphertext.
-    int tmpfd;
-    auto_char char* tmpname = NULL;
-    if ((tmpfd = g_file_open_tmp("profanity.XXXXXX", &tmpname, NULL)) == -1) {
-        *err = "Unable to create temporary file for encrypted transfer.";
+_add_omemo_stream(off_t size, struct aes256gcm_stream_t** stream, char** err)
+{
+    // The file is encrypted while it is uploaded, see http_file_put().
+    gcry_error_t crypt_res;
+    char* fragment = NULL;
+    *stream = omemo_encrypt_file_stream(size, &fragment, &crypt_res);
+    if (*stream == NULL) {
+        *err = "Unable to set up encryption for the transfer.";
         return NULL;
     }
-    FILE* tmpfh = fdopen(tmpfd, "w+b");
-
-    // The temporary ciphertext file should be removed after it has
-    // been closed.
-    remove(tmpname);
 
-    int crypt_res;
-    char* fragment;
-    fragment = omemo_encrypt_file(*fh, tmpfh, file_size(*fd), &crypt_res);
-    if (crypt_res != 0) {
-        fclose(tmpfh);
-        return NULL;
-    }
+    return fragment;
+}
+#endif
 
-    // Force flush as the upload will read from the same stream.
-    fflush(tmpfh);
-    rewind(tmpfh);
+/*
+ * The files named by the /sendfile argument: the argument itself if it is a
+ * file, else its words, quoted as in the shell, each expanded as a glob.
+ */
+static GPtrArray*
+_sendfile_get_files(const char* const arg)
+{
+    GPtrArray* files = g_ptr_array_new_with_free_func(g_free);
 
-    fclose(*fh); // Also closes descriptor.
+    gchar* path = get_expanded_path(arg);
+    gchar** words = NULL;
+    if (access(path, F_OK) == 0 || !g_shell_parse_argv(arg, NULL, &words, NULL)) {
+        g_ptr_array_add(files, path);
+        return files;
+    }
+    g_free(path);
 
-    // Switch original stream with temporary ciphertext stream.
-    *fd = tmpfd;
-    *fh = tmpfh;
+    for (int i = 0; words[i]; i++) {
+        auto_gchar gchar* pattern = get_expanded_path(words[i]);
+        glob_t matches;
+        // patterns without matches are kept, to be reported as not found
+        if (glob(pattern, GLOB_NOCHECK, NULL, &matches) == 0) {
+            for (size_t j = 0; j < matches.gl_pathc; j++) {
+                g_ptr_array_add(files, g_strdup(matches.gl_pathv[j]));
+            }
+        } else {
+            g_ptr_array_add(files, g_strdup(pattern));
+        }
+        globfree(&matches);
+    }
+    g_strfreev(words);
 
-    return fragment;
+    return files;
 }
-#endif
 
-gboolean
-cmd_sendfile(ProfWin* window, const char* const command, gchar** args)
+static HTTPUpload*
+_sendfile_upload_new(ProfWin* window, const char* const filename, gboolean omemo_enabled)
 {
-    jabber_conn_status_t conn_status = connection_get_status();
-    // expand ~ to $HOME
-    auto_gchar gchar* filename = get_expanded_path(args[0]);
     char* alt_scheme = NULL;
     char* alt_fragment = NULL;
+    struct aes256gcm_stream_t* encrypt_stream = NULL;
 
     if (access(filename, R_OK) != 0) {
         cons_show_error("Uploading '%s' failed: File not found!", filename);
-        goto out;
+        return NULL;
     }
 
     if (!is_regular_file(filename)) {
         cons_show_error("Uploading '%s' failed: Not a file!", filename);
-        goto out;
-    }
-
-    if (conn_status != JABBER_CONNECTED) {
-        cons_show("You are not currently connected.");
-        goto out;
-    }
-
-    if (window->type != WIN_CHAT && window->type != WIN_PRIVATE && window->type != WIN_MUC) {
-        cons_show_error("Unsupported window for file transmission.");
-        goto out;
+        return NULL;
     }
 
     int fd;
     if ((fd = open(filename, O_RDONLY)) == -1) {
         cons_show_error("Unable to open file descriptor for '%s'.", filename);
-        goto out;
+        return NULL;
     }
 
     FILE* fh = fdopen(fd, "rb");
+    char* mime_type = file_mime_type(filename);
+
+#ifdef HAVE_PIXBUF
+    // the size is sent with the slot request and encrypted uploads depend on it,
+    // so images are converted up front
+    auto_gchar gchar* resize = prefs_get_string(PREF_URL_UPLOAD_RESIZE);
+    int max_pixels;
+    auto_char char* resize_err = NULL;
+    if (resize && strtoi_range(resize, &max_pixels, 16, 65536, &resize_err)) {
+        FILE* resized = http_upload_downscale_image(filename, mime_type, max_pixels);
+        if (resized) {
+            fclose(fh);
+            fh = resized;
+            fd = fileno(resized);
+        }
+    }
+#endif
+
+    if (omemo_enabled) {
+#ifdef HAVE_OMEMO
+        char* err = NULL;
+        alt_scheme = OMEMO_AESGCM_URL_SCHEME;
+        alt_fragment = _add_omemo_stream(file_size(fd), &encrypt_stream, &err);
+        if (err != NULL) {
+            cons_show_error(err);
+            win_println(window, THEME_ERROR, "-", err);
+            fclose(fh);
+            free(mime_type);
+            return NULL;
+        }
+#endif
+    }
+
+    HTTPUpload* upload = calloc(1, sizeof(HTTPUpload));
+    upload->window = window;
+
+    upload->filename = strdup(filename);
+    upload->filehandle = fh;
+    upload->filesize = file_size(fd);
+    upload->encrypt_stream = encrypt_stream;
+#ifdef HAVE_OMEMO
+    if (encrypt_stream) {
+        upload->filesize += OMEMO_AESGCM_TAG_LENGTH;
+    }
+#endif
+    upload->mime_type = mime_type;
+
+    if (alt_scheme != NULL) {
+        upload->alt_scheme = strdup(alt_scheme);
+    } else {
+        upload->alt_scheme = NULL;
+    }
+
+    if (alt_fragment != NULL) {
+        upload->alt_fragment = strdup(alt_fragment);
+#ifdef HAVE_OMEMO
+        omemo_free(alt_fragment);
+#endif
+    } else {
+        upload->alt_fragment = NULL;
+    }
+
+    return upload;
+}
+
+gboolean
+cmd_sendfile(ProfWin* window, const char* const command, gchar** args)
+{
+    jabber_conn_status_t conn_status = connection_get_status();
+
+    if (conn_status != JABBER_CONNECTED) {
+        cons_show("You are not currently connected.");
+        return TRUE;
+    }
 
     gboolean omemo_enabled = FALSE;
     gboolean sendfile_enabled = TRUE;
@@ -4933,55 +4981,26 @@ cmd_sendfile(ProfWin* window, const char* const command, gchar** args)
     case WIN_PRIVATE: // We don't support encryption in private MUC windows.
     default:
         cons_show_error("Unsupported window for file transmission.");
-        goto out;
+        return TRUE;
     }
 
     if (!sendfile_enabled) {
         cons_show_error("Uploading unencrypted files disabled. See /otr sendfile or /pgp sendfile.");
         win_println(window, THEME_ERROR, "-", "Sending encrypted files via http_upload is not possible yet.");
-        goto out;
+        return TRUE;
     }
 
-    if (omemo_enabled) {
-#ifdef HAVE_OMEMO
-        char* err = NULL;
-        alt_scheme = OMEMO_AESGCM_URL_SCHEME;
-        alt_fragment = _add_omemo_stream(&fd, &fh, &err);
-        if (err != NULL) {
-            cons_show_error(err);
-            win_println(window, THEME_ERROR, "-", err);
-            goto out;
+    GPtrArray* files = _sendfile_get_files(args[0]);
+    HTTPUploadBatch* batch = http_upload_batch_new(window);
+    for (guint i = 0; i < files->len; i++) {
+        HTTPUpload* upload = _sendfile_upload_new(window, g_ptr_array_index(files, i), omemo_enabled);
+        if (upload) {
+            http_upload_batch_add(batch, upload);
         }
-#endif
-    }
-
-    HTTPUpload* upload = malloc(sizeof(HTTPUpload));
-    upload->window = window;
-
-    upload->filename = strdup(filename);
-    upload->filehandle = fh;
-    upload->filesize = file_size(fd);
-    upload->mime_type = file_mime_type(filename);
-
-    if (alt_scheme != NULL) {
-        upload->alt_scheme = strdup(alt_scheme);
-    } else {
-        upload->alt_scheme = NULL;
-    }
-
-    if (alt_fragment != NULL) {
-        upload->alt_fragment = strdup(alt_fragment);
-    } else {
-        upload->alt_fragment = NULL;
     }
+    g_ptr_array_free(files, TRUE);
 
-    iq_http_upload_request(upload);
-
-out:
-#ifdef HAVE_OMEMO
-    if (alt_fragment != NULL)
-        omemo_free(alt_fragment);
-#endif
+    http_upload_batch_start(batch);
 
     return TRUE;
 }
@@ -5078,6 +5097,7 @@ cmd_alias(ProfWin* window, const char* const command, gchar** args)
                 cons_show("Command or alias '%s' already exists.", ac_value);
             } else {
                 prefs_add_alias(alias_p, value);
+                cmd_alias_index_set(alias_p, value);
                 cmd_ac_add(ac_value);
                 cmd_ac_add_alias_value(alias_p);
                 cons_show("Command alias added %s -> %s", ac_value, value);
@@ -5100,6 +5120,7 @@ cmd_alias(ProfWin* window, const char* const command, gchar** args)
                 auto_gchar gchar* ac_value = g_strdup_printf("/%s", alias);
                 cmd_ac_remove(ac_value);
                 cmd_ac_remove_alias_value(alias);
+                cmd_alias_index_remove(alias);
                 cons_show("Command alias removed -> /%s", alias);
             }
             return TRUE;
@@ -5725,6 +5746,18 @@ cmd_notify(ProfWin* window, const char* const command, gchar** args)
             } else {
                 cons_show("Usage: /notify room text on|off");
             }
+        } else if (g_strcmp0(args[1], "flood") == 0) {
+            if (!args[2]) {
+                cons_bad_cmd_usage(command);
+            } else {
+                gint rate = atoi(args[2]);
+                prefs_set_notify_room_flood(rate);
+                if (rate <= 0) {
+                    cons_show("Room flood summaries disabled.");
+                } else {
+                    cons_show("Room alerts summarised above %d messages per second.", rate);
+                }
+            }
         } else if (g_strcmp0(args[1], "trigger") == 0) {
             if (g_strcmp0(args[2], "add") == 0) {
                 if (!args[3]) {
@@ -5949,6 +5982,48 @@ cmd_notify(ProfWin* window, const char* const command, gchar** args)
     return TRUE;
 }
 
+gboolean
+cmd_scrollback(ProfWin* window, const char* const command, gchar** args)
+{
+    static const char* const wintypes[] = { "console", "chat", "muc", "config", "private", "xml" };
+    char* type = args[0];
+    char* value = args[1];
+
+    gboolean all = g_strcmp0(type, "all") == 0;
+    gboolean valid_type = all;
+    for (unsigned int i = 0; i < ARRAY_SIZE(wintypes) && !valid_type; i++) {
+        valid_type = g_strcmp0(type, wintypes[i]) == 0;
+    }
+
+    if (!valid_type || value == NULL) {
+        cons_bad_cmd_usage(command);
+        return TRUE;
+    }
+
+    int intval = PREFS_DEFAULT_SCROLLBACK;
+    if (g_strcmp0(value, "default") != 0) {
+        auto_char char* err_msg = NULL;
+        if (!strtoi_range(value, &intval, PREFS_MIN_SCROLLBACK, PREFS_MAX_SCROLLBACK, &err_msg)) {
+            cons_show(err_msg);
+            return TRUE;
+        }
+    }
+
+    if (all) {
+        for (unsigned int i = 0; i < ARRAY_SIZE(wintypes); i++) {
+            prefs_set_scrollback(wintypes[i], intval);
+        }
+        cons_show("Scrollback for all windows set to %d lines.", intval);
+    } else {
+        prefs_set_scrollback(type, intval);
+        cons_show("Scrollback for %s windows set to %d lines.", type, intval);
+    }
+
+    wins_apply_scrollback();
+
+    return TRUE;
+}
+
 gboolean
 cmd_inpblock(ProfWin* window, const char* const command, gchar** args)
 {
@@ -6106,6 +6181,11 @@ cmd_mainwin(ProfWin* window, const char* const command, gchar** args)
 
         return TRUE;
     }
+    if (g_strcmp0(args[0], "scroll") == 0) {
+        _cmd_set_boolean_preference(args[1], "Main window terminal scrolling", PREF_MAINWIN_SCROLL);
+        win_invalidate_virtual();
+        return TRUE;
+    }
 
     cons_bad_cmd_usage(command);
 
@@ -6403,6 +6483,11 @@ cmd_log(ProfWin* window, const char* const command, gchar** args)
         return TRUE;
     }
 
+    if (strcmp(subcmd, "compress") == 0) {
+        _cmd_set_boolean_preference(value, "Log compression", PREF_LOG_COMPRESS);
+        return TRUE;
+    }
+
     if (strcmp(subcmd, "level") == 0) {
         log_level_t prof_log_level;
         if (log_level_from_string(value, &prof_log_level) == 0) {
@@ -6665,8 +6750,25 @@ cmd_xmlconsole(ProfWin* window, const char* const command, gchar** args)
     if (xmlwin) {
         ui_focus_win((ProfWin*)xmlwin);
     } else {
-        ProfWin* window = wins_new_xmlconsole();
-        ui_focus_win(window);
+        xmlwin = (ProfXMLWin*)wins_new_xmlconsole();
+        ui_focus_win((ProfWin*)xmlwin);
+    }
+
+    if (args[0] == NULL) {
+        return TRUE;
+    }
+
+    if (g_strcmp0(args[0], "filter") != 0) {
+        cons_bad_cmd_usage(command);
+        return TRUE;
+    }
+
+    if (args[1] == NULL) {
+        xmlwin_show_filters(xmlwin);
+    } else if (!xmlwin_set_filter(xmlwin, args[1], args[2])) {
+        cons_bad_cmd_usage(command);
+    } else {
+        xmlwin_show_filters(xmlwin);
     }
 
     return TRUE;
@@ -6862,9 +6964,143 @@ cmd_history(ProfWin* window, const char* const command, gchar** args)
         return TRUE;
     }
 
-    _cmd_set_boolean_preference(args[0], "Chat history", PREF_HISTORY);
+    if (g_strcmp0(args[0], "search") == 0) {
+        if (args[1] == NULL) {
+            cons_bad_cmd_usage(command);
+            return TRUE;
+        }
+        if (connection_get_status() != JABBER_CONNECTED) {
+            cons_show("You are not currently connected.");
+            return TRUE;
+        }
 
-    // if set to on, set chlog (/logging chat on)
+        auto_gchar gchar* text = args[2] ? g_strjoin(" ", args[1], args[2], NULL) : g_strdup(args[1]);
+        GSList* results = log_database_search(text, MESSAGES_TO_SEARCH);
+        if (results == NULL) {
+            cons_show("No messages found matching \"%s\".", text);
+            return TRUE;
+        }
+
+        cons_show("Messages matching \"%s\":", text);
+        for (GSList* curr = results; curr; curr = g_slist_next(curr)) {
+            ProfMessage* msg = curr->data;
+            auto_gchar gchar* date = msg->timestamp ? g_date_time_format(msg->timestamp, "%Y-%m-%d %H:%M") : g_strdup("unknown");
+            cons_show("  %s %s -> %s: %s", date,
+                      msg->from_jid ? msg->from_jid->barejid : "?",
+                      msg->to_jid ? msg->to_jid->barejid : "?",
+                      msg->plain);
+        }
+        g_slist_free_full(results, (GDestroyNotify)message_free);
+        cons_alert(NULL);
+
+        return TRUE;
+    }
+
+    if (g_strcmp0(args[0], "retention") == 0) {
+        if (args[1] == NULL) {
+            cons_bad_cmd_usage(command);
+            return TRUE;
+        }
+
+        const char* jid = args[2] ? args[1] : NULL;
+        const char* policy = args[2] ? args[2] : args[1];
+        const char* who = jid ? jid : "all contacts";
+        if (g_strcmp0(policy, "off") == 0) {
+            prefs_set_db_retention(jid, NULL);
+            cons_show("Chat log retention for %s disabled.", who);
+            return TRUE;
+        }
+
+        // <n>d for days, <n> for a number of messages
+        int value = 0;
+        auto_char char* err_msg = NULL;
+        gboolean days = g_str_has_suffix(policy, "d");
+        auto_gchar gchar* number = days ? g_strndup(policy, strlen(policy) - 1) : g_strdup(policy);
+        if (!strtoi_range(number, &value, 1, INT_MAX, &err_msg)) {
+            cons_show(err_msg);
+            return TRUE;
+        }
+        if (!jid && !days) {
+            cons_show("The retention for all contacts must be given in days, for example 365d.");
+            return TRUE;
+        }
+
+        prefs_set_db_retention(jid, policy);
+        if (days) {
+            cons_show("Chat log retention for %s set to %d days.", who, value);
+        } else {
+            cons_show("Chat log retention for %s set to %d messages.", who, value);
+        }
+        log_database_maintenance(FALSE);
+        return TRUE;
+    }
+
+    if (g_strcmp0(args[0], "archive") == 0) {
+        if (args[1] == NULL || args[2] != NULL) {
+            cons_bad_cmd_usage(command);
+            return TRUE;
+        }
+
+        if (g_strcmp0(args[1], "off") == 0) {
+            prefs_set_db_archive(0);
+            cons_show("Chat log archiving disabled, archived messages stay in the archive.");
+            return TRUE;
+        }
+
+        int days = 0;
+        auto_char char* err_msg = NULL;
+        if (!strtoi_range(args[1], &days, 1, INT_MAX, &err_msg)) {
+            cons_show(err_msg);
+            return TRUE;
+        }
+        prefs_set_db_archive(days);
+        cons_show("Chat log messages older than %d days will be archived.", days);
+        if (log_database_archive_attached()) {
+            log_database_maintenance(FALSE);
+        } else {
+            cons_show("The archive will be opened on next connect.");
+        }
+        return TRUE;
+    }
+
+    if (g_strcmp0(args[0], "vacuum") == 0) {
+        if (args[1] != NULL) {
+            cons_bad_cmd_usage(command);
+            return TRUE;
+        }
+        if (connection_get_status() != JABBER_CONNECTED) {
+            cons_show("You are not currently connected.");
+            return TRUE;
+        }
+
+        log_database_maintenance(TRUE);
+        cons_show("Chat log database will be vacuumed in the background.");
+        return TRUE;
+    }
+
+    if (g_strcmp0(args[0], "import") == 0) {
+        if (args[1] != NULL) {
+            cons_bad_cmd_usage(command);
+            return TRUE;
+        }
+        if (connection_get_status() != JABBER_CONNECTED) {
+            cons_show("You are not currently connected.");
+            return TRUE;
+        }
+
+        log_database_import_chatlogs();
+        cons_show("Importing chat logs in the background.");
+        return TRUE;
+    }
+
+    if (args[1] != NULL) {
+        cons_bad_cmd_usage(command);
+        return TRUE;
+    }
+
+    _cmd_set_boolean_preference(args[0], "Chat history", PREF_HISTORY);
+
+    // if set to on, set chlog (/logging chat on)
     if (strcmp(args[0], "on") == 0) {
         prefs_set_boolean(PREF_CHLOG, TRUE);
     }
@@ -6896,6 +7132,22 @@ cmd_carbons(ProfWin* window, const char* const command, gchar** args)
     return TRUE;
 }
 
+gboolean
+cmd_csi(ProfWin* window, const char* const command, gchar** args)
+{
+    if (args[0] == NULL) {
+        cons_bad_cmd_usage(command);
+        return TRUE;
+    }
+
+    _cmd_set_boolean_preference(args[0], "Client state indication", PREF_CSI);
+
+    inp_set_focus_reporting(prefs_get_boolean(PREF_CSI));
+    session_check_csi();
+
+    return TRUE;
+}
+
 gboolean
 cmd_receipts(ProfWin* window, const char* const command, gchar** args)
 {
@@ -7180,6 +7432,38 @@ cmd_plugins_python_version(ProfWin* window, const char* const command, gchar** a
     return TRUE;
 }
 
+gboolean
+cmd_plugins_stats(ProfWin* window, const char* const command, gchar** args)
+{
+    if (g_strcmp0(args[1], "reset") == 0) {
+        plugins_reset_stats();
+        cons_show("Plugin statistics cleared.");
+        return TRUE;
+    } else if (args[1] != NULL) {
+        cons_bad_cmd_usage(command);
+        return TRUE;
+    }
+
+    GList* stats = plugins_get_stats();
+    if (!stats) {
+        cons_show("No plugin hooks have been run.");
+        return TRUE;
+    }
+
+    cons_show("Plugin hook statistics (microseconds):");
+    cons_show("  %-20s %-32s %8s %10s %8s %8s %8s", "Plugin", "Hook", "Calls", "Total", "Avg", "P99", "Max");
+    GList* curr = stats;
+    while (curr) {
+        PluginHookStats* entry = curr->data;
+        cons_show("  %-20s %-32s %8" G_GUINT64_FORMAT " %10" G_GINT64_FORMAT " %8" G_GINT64_FORMAT " %8" G_GINT64_FORMAT " %8" G_GINT64_FORMAT,
+                  entry->plugin_name, entry->hook, entry->calls, entry->total_us, entry->avg_us, entry->p99_us, entry->max_us);
+        curr = g_list_next(curr);
+    }
+    plugins_free_stats(stats);
+
+    return TRUE;
+}
+
 gboolean
 cmd_plugins(ProfWin* window, const char* const command, gchar** args)
 {
@@ -8418,12 +8702,9 @@ _cmd_execute(ProfWin* window, const char* const command, const char* const inp)
             return TRUE;
         }
         if (args[0] && cmd->sub_funcs[0].cmd) {
-            int i = 0;
-            while (cmd->sub_funcs[i].cmd) {
-                if (g_strcmp0(args[0], (char*)cmd->sub_funcs[i].cmd) == 0) {
-                    return cmd->sub_funcs[i].func(window, command, args);
-                }
-                i++;
+            int sub = cmd_get_sub_index(cmd, args[0]);
+            if (sub >= 0) {
+                return cmd->sub_funcs[sub].func(window, command, args);
             }
         }
         if (!cmd->func) {
@@ -8522,17 +8803,16 @@ _cmd_execute_alias(ProfWin* window, const char* const inp, gboolean* ran)
         return TRUE;
     }
 
-    auto_char char* alias = strdup(inp + 1);
-    auto_gcharv char** alias_parts = g_strsplit(alias, " ", 2);
-    auto_gchar gchar* value = prefs_get_alias(alias_parts[0]);
+    const char* params = strchr(inp, ' ');
+    auto_gchar gchar* alias = params ? g_strndup(inp + 1, params - inp - 1) : g_strdup(inp + 1);
+    const char* value = cmd_get_alias(alias);
 
     if (!value) {
         *ran = FALSE;
         return TRUE;
     }
 
-    char* params = alias_parts[1];
-    auto_gchar gchar* full_cmd = params ? g_strdup_printf("%s %s", value, params) : g_strdup(value);
+    auto_gchar gchar* full_cmd = params ? g_strdup_printf("%s %s", value, params + 1) : g_strdup(value);
 
     *ran = TRUE;
     gboolean result = cmd_process_input(window, full_cmd);
@@ -9107,6 +9387,7 @@ cmd_reload(ProfWin* window, const char* const command, gchar** args)
     log_info("Reloading preferences");
     cons_show("Reloading preferences.");
     prefs_reload();
+    cmd_alias_index_load();
     return TRUE;
 }
 
@@ -9375,6 +9656,19 @@ cmd_slashguard(ProfWin* window, const char* const command, gchar** args)
     return TRUE;
 }
 
+gboolean
+cmd_fuzzy(ProfWin* window, const char* const command, gchar** args)
+{
+    if (args[0] == NULL) {
+        return FALSE;
+    }
+
+    _cmd_set_boolean_preference(args[0], "Fuzzy completion", PREF_COMPLETION_FUZZY);
+    autocomplete_set_fuzzy(prefs_get_boolean(PREF_COMPLETION_FUZZY));
+
+    return TRUE;
+}
+
 gchar*
 _prepare_filename(gchar* url, gchar* path)
 {
@@ -9411,8 +9705,8 @@ _url_aesgcm_method(ProfWin* window, const char* cmd_template, gchar* url, gchar*
         download->cmd_template = NULL;
     }
 
-    pthread_create(&(download->worker), NULL, &aesgcm_file_get, download);
     aesgcm_download_add_download(download);
+    pthread_create(&(download->worker), NULL, &aesgcm_file_get, download);
 }
 #endif
 
@@ -9426,11 +9720,12 @@ _download_install_plugin(ProfWin* window, gchar* url, gchar* path)
     download->window = window;
     download->url = strdup(url);
     download->filename = strdup(filename);
+    download->decrypt_stream = NULL;
     download->id = get_random_string(4);
     download->cmd_template = NULL;
 
-    pthread_create(&(download->worker), NULL, &plugin_download_install, download);
     plugin_download_add_download(download);
+    pthread_create(&(download->worker), NULL, &plugin_download_install, download);
     return TRUE;
 }
 
@@ -9445,11 +9740,12 @@ _url_http_method(ProfWin* window, const char* cmd_template, gchar* url, gchar* p
     download->window = window;
     download->url = strdup(url);
     download->filename = strdup(filename);
+    download->decrypt_stream = NULL;
     download->id = strdup(id);
     download->cmd_template = cmd_template ? strdup(cmd_template) : NULL;
 
-    pthread_create(&(download->worker), NULL, &http_file_get, download);
     http_download_add_download(download);
+    pthread_create(&(download->worker), NULL, &http_file_get, download);
 }
 
 void
@@ -9551,6 +9847,64 @@ cmd_url_save(ProfWin* window, const char* const command, gchar** args)
     return TRUE;
 }
 
+gboolean
+cmd_url_limit(ProfWin* window, const char* const command, gchar** args)
+{
+    if (args[1] == NULL) {
+        cons_bad_cmd_usage(command);
+        return TRUE;
+    }
+
+    if (g_strcmp0(args[1], "off") == 0) {
+        prefs_set_string(PREF_URL_DOWNLOAD_LIMIT, NULL);
+        cons_show("Download bandwidth limit disabled.");
+        return TRUE;
+    }
+
+    int limit;
+    auto_char char* err_msg = NULL;
+    if (!strtoi_range(args[1], &limit, 1, INT_MAX / 1024, &err_msg)) {
+        cons_show(err_msg);
+        return TRUE;
+    }
+
+    prefs_set_string(PREF_URL_DOWNLOAD_LIMIT, args[1]);
+    cons_show("Download bandwidth limited to %d KiB/s.", limit);
+
+    return TRUE;
+}
+
+gboolean
+cmd_url_resize(ProfWin* window, const char* const command, gchar** args)
+{
+    if (args[1] == NULL) {
+        cons_bad_cmd_usage(command);
+        return TRUE;
+    }
+
+    if (g_strcmp0(args[1], "off") == 0) {
+        prefs_set_string(PREF_URL_UPLOAD_RESIZE, NULL);
+        cons_show("Images are sent unchanged.");
+        return TRUE;
+    }
+
+#ifdef HAVE_PIXBUF
+    int pixels;
+    auto_char char* err_msg = NULL;
+    if (!strtoi_range(args[1], &pixels, 16, 65536, &err_msg)) {
+        cons_show(err_msg);
+        return TRUE;
+    }
+
+    prefs_set_string(PREF_URL_UPLOAD_RESIZE, args[1]);
+    cons_show("Images larger than %d pixels are downscaled before sending.", pixels);
+#else
+    cons_show("Profanity has not been built with GDK Pixbuf support enabled which is needed to scale images when uploading.");
+#endif
+
+    return TRUE;
+}
+
 gboolean
 _cmd_executable_template(const preference_t setting, const char* command, gchar** args)
 {
@@ -9611,6 +9965,22 @@ cmd_executable_vcard_photo(ProfWin* window, const char* const command, gchar** a
 gboolean
 cmd_mam(ProfWin* window, const char* const command, gchar** args)
 {
+    if (g_strcmp0(args[0], "pagesize") == 0) {
+        if (!args[1]) {
+            cons_bad_cmd_usage(command);
+            return TRUE;
+        }
+        int pagesize;
+        auto_char char* err_msg = NULL;
+        if (strtoi_range(args[1], &pagesize, MESSAGES_TO_RETRIEVE, 1000, &err_msg)) {
+            prefs_set_mam_pagesize(pagesize);
+            cons_show("MAM page size set to %d.", pagesize);
+        } else {
+            cons_show(err_msg);
+        }
+        return TRUE;
+    }
+
     _cmd_set_boolean_preference(args[0], "Message Archive Management", PREF_MAM);
 
     return TRUE;
@@ -9685,15 +10055,70 @@ cmd_correct_editor(ProfWin* window, const char* const command, gchar** args)
 gboolean
 cmd_redraw(ProfWin* window, const char* const command, gchar** args)
 {
-    ui_resize();
+    if (args[0] == NULL) {
+        ui_resize();
+        return TRUE;
+    }
 
+    if (g_strcmp0(args[0], "rate") == 0 && args[1]) {
+        if (g_strcmp0(args[1], "off") == 0) {
+            prefs_set_redraw_rate(0);
+            cons_show("Screen updates are no longer limited.");
+            return TRUE;
+        }
+
+        int rate;
+        auto_char char* err_msg = NULL;
+        if (strtoi_range(args[1], &rate, 1, 60, &err_msg)) {
+            prefs_set_redraw_rate(rate);
+            cons_show("Screen updated at most %d times per second.", rate);
+        } else {
+            cons_show(err_msg);
+        }
+        return TRUE;
+    }
+
+    cons_bad_cmd_usage(command);
     return TRUE;
 }
 
 gboolean
 cmd_silence(ProfWin* window, const char* const command, gchar** args)
 {
-    _cmd_set_boolean_preference(args[0], "Block all messages from JIDs that are not in the roster", PREF_SILENCE_NON_ROSTER);
+    if (g_strcmp0(args[0], "quarantine") == 0) {
+        _cmd_set_boolean_preference(args[1], "Hold back messages from JIDs that are not in the roster", PREF_SILENCE_QUARANTINE);
+    } else if (g_strcmp0(args[0], "requests") == 0) {
+        GList* requests = message_requests_list();
+        if (!requests) {
+            cons_show("No messages held back.");
+        } else {
+            cons_show("Messages held back:");
+            for (GList* curr = requests; curr; curr = g_list_next(curr)) {
+                ProfMessageRequest* request = curr->data;
+                cons_show("  %s (%u): %s", request->barejid, request->count, request->sample);
+            }
+            g_list_free(requests);
+        }
+        guint overflow = message_requests_overflow_count();
+        if (overflow > 0) {
+            cons_show("%u more messages from further senders were dropped.", overflow);
+        }
+    } else if (g_strcmp0(args[0], "accept") == 0) {
+        if (!args[1]) {
+            cons_bad_cmd_usage(command);
+            return TRUE;
+        }
+        if (message_request_accept(args[1])) {
+            cons_show("Accepted messages from %s, messages held back so far are discarded.", args[1]);
+        } else {
+            cons_show("Accepted messages from %s.", args[1]);
+        }
+    } else if (g_strcmp0(args[0], "clear") == 0) {
+        message_requests_clear();
+        cons_show("Messages held back cleared.");
+    } else {
+        _cmd_set_boolean_preference(args[0], "Block all messages from JIDs that are not in the roster", PREF_SILENCE_NON_ROSTER);
+    }
 
     return TRUE;
 }
@@ -9815,6 +10240,37 @@ cmd_strophe(ProfWin* window, const char* const command, gchar** args)
             prefs_set_boolean(PREF_STROPHE_SM_RESEND, FALSE);
             return TRUE;
         }
+    } else if (g_strcmp0(args[0], "iq-inflight") == 0) {
+        int limit;
+        auto_char char* err_msg = NULL;
+        if (strtoi_range(args[1], &limit, 0, INT_MAX, &err_msg)) {
+            prefs_set_iq_inflight(limit);
+            if (limit == 0) {
+                cons_show("In-flight request limit disabled.");
+            } else {
+                cons_show("In-flight requests per domain set to %d.", limit);
+            }
+        } else {
+            cons_show(err_msg);
+        }
+        return TRUE;
+    } else if (g_strcmp0(args[0], "capture") == 0) {
+        if (g_strcmp0(args[1], "on") == 0) {
+            if (capture_start()) {
+                cons_show("Capturing XML traffic to %s", capture_get_path());
+            } else {
+                cons_show_error("Could not start XML capture, see the log for details.");
+            }
+            return TRUE;
+        } else if (g_strcmp0(args[1], "off") == 0) {
+            if (capture_active()) {
+                capture_stop();
+                cons_show("XML capture written to %s", capture_get_path());
+            } else {
+                cons_show("XML capture is not running.");
+            }
+            return TRUE;
+        }
     }
     cons_bad_cmd_usage(command);
     return TRUE;
@@ -10756,3 +11212,138 @@ cmd_vcard_save(ProfWin* window, const char* const command, gchar** args)
     cons_show("User vCard uploaded");
     return TRUE;
 }
+
+static void
+_cmd_stats_histogram(const char* const title, stats_timer_t timer_id)
+{
+    ProfStatsTimer timer;
+    stats_timer_get(timer_id, &timer);
+    if (timer.calls == 0) {
+        return;
+    }
+
+    cons_show("");
+    cons_show(title);
+    for (int b = 0; b < STATS_BUCKETS; b++) {
+        if (timer.buckets[b] > 0) {
+            cons_show("  < %10" G_GINT64_FORMAT "us %10" G_GUINT64_FORMAT, (gint64)1 << b, timer.buckets[b]);
+        }
+    }
+}
+
+gboolean
+cmd_stats(ProfWin* window, const char* const command, gchar** args)
+{
+    if (g_strcmp0(args[0], "reset") == 0) {
+        stats_reset();
+        plugins_reset_stats();
+        cons_show("Statistics cleared.");
+        return TRUE;
+    } else if (g_strcmp0(args[0], "trace") == 0 && g_strcmp0(args[1], "start") == 0 && args[2]) {
+        auto_gchar gchar* path = get_expanded_path(args[2]);
+        if (stats_trace_start(path)) {
+            cons_show("Tracing, /stats trace stop writes the trace to %s.", path);
+        } else {
+            cons_show("A trace is already running.");
+        }
+        return TRUE;
+    } else if (g_strcmp0(args[0], "trace") == 0 && g_strcmp0(args[1], "stop") == 0 && !args[2]) {
+        if (!stats_tracing()) {
+            cons_show("No trace is running.");
+            return TRUE;
+        }
+        GError* error = NULL;
+        gint spans = stats_trace_stop(&error);
+        if (spans < 0) {
+            cons_show_error("Could not write the trace: %s", error->message);
+            g_error_free(error);
+        } else {
+            cons_show("Trace written, %d spans.", spans);
+        }
+        return TRUE;
+    } else if (g_strcmp0(args[0], "budget") == 0 && args[1] && !args[2]) {
+        int budget = 0;
+        auto_char char* err_msg = NULL;
+        if (g_strcmp0(args[1], "off") != 0 && !strtoi_range(args[1], &budget, 1, 10000, &err_msg)) {
+            cons_show(err_msg);
+            return TRUE;
+        }
+        prefs_set_frame_budget(budget);
+        stats_set_budget(budget);
+        if (budget > 0) {
+            cons_show("Main loop iterations and handlers over %d ms are logged.", budget);
+        } else {
+            cons_show("Slow main loop iterations are no longer logged.");
+        }
+        return TRUE;
+    } else if (args[0] != NULL) {
+        cons_bad_cmd_usage(command);
+        return TRUE;
+    }
+
+    cons_show("Stanzas per second (total):");
+    for (int type = 0; type < STATS_STANZA_COUNT; type++) {
+        cons_show("  %-10s in %6" G_GUINT64_FORMAT " (%" G_GUINT64_FORMAT "), out %6" G_GUINT64_FORMAT " (%" G_GUINT64_FORMAT ")",
+                  stats_stanza_name(type),
+                  stats_stanza_rate(FALSE, type), stats_stanza_total(FALSE, type),
+                  stats_stanza_rate(TRUE, type), stats_stanza_total(TRUE, type));
+    }
+
+    cons_show("");
+    cons_show("Skipped:");
+    for (int i = 0; i < STATS_COUNTER_COUNT; i++) {
+        cons_show("  %-18s %10" G_GUINT64_FORMAT, stats_counter_name(i), stats_counter_total(i));
+    }
+
+    cons_show("");
+    cons_show("Timings (microseconds):");
+    cons_show("  %-16s %8s %10s %8s %8s %8s", "Name", "Calls", "Total", "Avg", "P99", "Max");
+    ProfStatsTimer timer;
+    for (int i = 0; i < STATS_TIMER_COUNT; i++) {
+        stats_timer_get(i, &timer);
+        cons_show("  %-16s %8" G_GUINT64_FORMAT " %10" G_GINT64_FORMAT " %8" G_GINT64_FORMAT " %8" G_GINT64_FORMAT " %8" G_GINT64_FORMAT,
+                  stats_timer_name(i), timer.calls, timer.total_us, timer.avg_us, timer.p99_us, timer.max_us);
+    }
+
+    guint64 hook_calls = 0;
+    gint64 hook_us = 0;
+    GList* plugin_stats = plugins_get_stats();
+    for (GList* curr = plugin_stats; curr; curr = g_list_next(curr)) {
+        PluginHookStats* entry = curr->data;
+        hook_calls += entry->calls;
+        hook_us += entry->total_us;
+    }
+    plugins_free_stats(plugin_stats);
+    cons_show("  %-16s %8" G_GUINT64_FORMAT " %10" G_GINT64_FORMAT, "plugin_hooks", hook_calls, hook_us);
+
+    _cmd_stats_histogram("Main loop iterations by duration:", STATS_TIMER_TICK);
+    _cmd_stats_histogram("Key press to screen update:", STATS_TIMER_KEY_TO_SCREEN);
+    _cmd_stats_histogram("Stanza received to screen update:", STATS_TIMER_STANZA_TO_SCREEN);
+
+    gint budget = stats_get_budget();
+    cons_show("");
+    if (budget > 0) {
+        cons_show("Frame budget: %d ms, slower iterations and handlers are logged.", budget);
+    } else {
+        cons_show("Frame budget: off");
+    }
+
+    cons_show("");
+    cons_show("Pending IQ requests: %u", iq_id_handlers_count());
+    cons_show("Database write queue: %d", log_database_queue_depth());
+
+    cons_show("");
+    cons_show("Window buffers:");
+    GList* nums = wins_get_nums_sorted();
+    for (GList* curr = nums; curr; curr = g_list_next(curr)) {
+        ProfWin* win = wins_get_by_num(GPOINTER_TO_INT(curr->data));
+        int entries = 0;
+        gsize bytes = 0;
+        win_buffer_stats(win, &entries, &bytes);
+        auto_gchar gchar* title = win_get_title(win);
+        cons_show("  %2d %-30s %6d entries %8" G_GSIZE_FORMAT " KiB", GPOINTER_TO_INT(curr->data), title ? title : "", entries, bytes / 1024);
+    }
+    g_list_free(nums);
+
+    return TRUE;
+}
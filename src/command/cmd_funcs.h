@@ -101,6 +101,7 @@ gboolean cmd_group(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_help(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_history(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_carbons(ProfWin* window, const char* const command, gchar** args);
+gboolean cmd_csi(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_receipts(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_info(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_intype(ProfWin* window, const char* const command, gchar** args);
@@ -154,6 +155,7 @@ gboolean cmd_wrap(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_time(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_resource(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_inpblock(ProfWin* window, const char* const command, gchar** args);
+gboolean cmd_scrollback(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_titlebar(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_titlebar_show_hide(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_mainwin(ProfWin* window, const char* const command, gchar** args);
@@ -176,6 +178,7 @@ gboolean cmd_plugins_load(ProfWin* window, const char* const command, gchar** ar
 gboolean cmd_plugins_unload(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_plugins_reload(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_plugins_python_version(ProfWin* window, const char* const command, gchar** args);
+gboolean cmd_plugins_stats(ProfWin* window, const char* const command, gchar** args);
 
 gboolean cmd_blocked(ProfWin* window, const char* const command, gchar** args);
 
@@ -244,9 +247,12 @@ gboolean cmd_os(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_correction(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_correct(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_slashguard(ProfWin* window, const char* const command, gchar** args);
+gboolean cmd_fuzzy(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_serversoftware(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_url_open(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_url_save(ProfWin* window, const char* const command, gchar** args);
+gboolean cmd_url_limit(ProfWin* window, const char* const command, gchar** args);
+gboolean cmd_url_resize(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_executable_avatar(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_executable_urlopen(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_executable_urlsave(ProfWin* window, const char* const command, gchar** args);
@@ -270,4 +276,6 @@ gboolean cmd_vcard_refresh(ProfWin* window, const char* const command, gchar** a
 gboolean cmd_vcard_set(ProfWin* window, const char* const command, gchar** args);
 gboolean cmd_vcard_save(ProfWin* window, const char* const command, gchar** args);
 
+gboolean cmd_stats(ProfWin* window, const char* const command, gchar** args);
+
 #endif
@@ -45,6 +45,8 @@
 #include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include <curl/curl.h>
 #include <curl/easy.h>
@@ -76,6 +78,13 @@ struct curl_data_t
 
 static size_t _data_callback(void* ptr, size_t size, size_t nmemb, void* data);
 static gchar* _get_file_or_linked(gchar* loc);
+static gboolean _write_keyfile(prof_keyfile_t* keyfile);
+
+// Keyfiles changed since they were last written, flushed together
+// KEYFILE_FLUSH_MS after the first change.
+#define KEYFILE_FLUSH_MS 500
+static GSList* dirty_keyfiles = NULL;
+static guint keyfile_flush_source = 0;
 
 /**
  * Frees the memory allocated for a gchar* string.
@@ -165,6 +174,12 @@ load_config_keyfile(prof_keyfile_t* keyfile, const char* filename)
 gboolean
 load_custom_keyfile(prof_keyfile_t* keyfile, gchar* filename)
 {
+    // don't lose pending changes when the keyfile gets reloaded
+    if (g_slist_find(dirty_keyfiles, keyfile)) {
+        dirty_keyfiles = g_slist_remove(dirty_keyfiles, keyfile);
+        _write_keyfile(keyfile);
+    }
+
     keyfile->filename = filename;
 
     if (g_file_test(keyfile->filename, G_FILE_TEST_EXISTS)) {
@@ -174,23 +189,102 @@ load_custom_keyfile(prof_keyfile_t* keyfile, gchar* filename)
     return _load_keyfile(keyfile);
 }
 
+static gboolean
+_write_keyfile(prof_keyfile_t* keyfile)
+{
+    gsize length = 0;
+    auto_gchar gchar* data = g_key_file_to_data(keyfile->keyfile, &length, NULL);
+    auto_gchar gchar* tmpname = g_strdup_printf("%s.XXXXXX", keyfile->filename);
+
+    // write a private temporary file and rename it over the old one, so a
+    // crash never leaves a truncated keyfile behind
+    int fd = g_mkstemp_full(tmpname, O_WRONLY, S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+        log_error("[Keyfile]: saving file %s failed! %s", keyfile->filename, strerror(errno));
+        return FALSE;
+    }
+
+    gsize written = 0;
+    while (written < length) {
+        ssize_t res = write(fd, data + written, length - written);
+        if (res < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        written += res;
+    }
+
+    if (written < length || fsync(fd) != 0) {
+        log_error("[Keyfile]: saving file %s failed! %s", keyfile->filename, strerror(errno));
+        close(fd);
+        g_unlink(tmpname);
+        return FALSE;
+    }
+    close(fd);
+
+    if (g_rename(tmpname, keyfile->filename) != 0) {
+        log_error("[Keyfile]: saving file %s failed! %s", keyfile->filename, strerror(errno));
+        g_unlink(tmpname);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static gboolean
+_flush_keyfiles_cb(gpointer userdata)
+{
+    keyfile_flush_source = 0;
+    flush_keyfiles();
+    return G_SOURCE_REMOVE;
+}
+
+/**
+ * Marks a keyfile to be written to disk.
+ *
+ * Writes are coalesced: all keyfiles changed within KEYFILE_FLUSH_MS are
+ * written once when the timer fires, on `free_keyfile()` or on `flush_keyfiles()`.
+ */
 gboolean
 save_keyfile(prof_keyfile_t* keyfile)
 {
-    GError* error = NULL;
-    if (!g_key_file_save_to_file(keyfile->keyfile, keyfile->filename, &error)) {
-        log_error("[Keyfile]: saving file %s failed! %s", keyfile->filename, error->message);
-        g_error_free(error);
+    if (!keyfile->keyfile || !keyfile->filename) {
         return FALSE;
     }
-    g_chmod(keyfile->filename, S_IRUSR | S_IWUSR);
+    if (!g_slist_find(dirty_keyfiles, keyfile)) {
+        dirty_keyfiles = g_slist_prepend(dirty_keyfiles, keyfile);
+    }
+    if (keyfile_flush_source == 0) {
+        keyfile_flush_source = g_timeout_add(KEYFILE_FLUSH_MS, _flush_keyfiles_cb, NULL);
+    }
     return TRUE;
 }
 
+/**
+ * Writes all keyfiles with pending changes to disk.
+ */
+void
+flush_keyfiles(void)
+{
+    if (keyfile_flush_source) {
+        g_source_remove(keyfile_flush_source);
+        keyfile_flush_source = 0;
+    }
+    while (dirty_keyfiles) {
+        prof_keyfile_t* keyfile = dirty_keyfiles->data;
+        dirty_keyfiles = g_slist_delete_link(dirty_keyfiles, dirty_keyfiles);
+        _write_keyfile(keyfile);
+    }
+}
+
 void
 free_keyfile(prof_keyfile_t* keyfile)
 {
     log_debug("[Keyfile]: free %s", STR_MAYBE_NULL(keyfile->filename));
+    if (g_slist_find(dirty_keyfiles, keyfile)) {
+        dirty_keyfiles = g_slist_remove(dirty_keyfiles, keyfile);
+        _write_keyfile(keyfile);
+    }
     if (keyfile->keyfile)
         g_key_file_free(keyfile->keyfile);
     keyfile->keyfile = NULL;
@@ -331,8 +425,19 @@ utf8_display_len(const char* const str)
     }
 
     int len = 0;
-    gchar* curr = g_utf8_offset_to_pointer(str, 0);
+    const gchar* curr = str;
     while (*curr != '\0') {
+        // nearly everything is plain ASCII, one column per byte, so get
+        // through runs of it without decoding
+        const gchar* run = curr;
+        while (*curr != '\0' && (guchar)*curr < 0x80) {
+            curr++;
+        }
+        len += curr - run;
+        if (*curr == '\0') {
+            break;
+        }
+
         gunichar curru = g_utf8_get_char(curr);
         if (g_unichar_iswide(curru)) {
             len += 2;
@@ -483,8 +588,12 @@ prof_occurrences(const char* const needle, const char* const haystack, int offse
         return *result;
     }
 
+    // walk the haystack once, found offsets are prepended and reversed at the end
+    GSList* found = NULL;
+    size_t needle_len = strlen(needle);
+    const gchar* haystack_curr = g_utf8_offset_to_pointer(haystack, offset);
+
     do {
-        gchar* haystack_curr = g_utf8_offset_to_pointer(haystack, offset);
         if (g_str_has_prefix(haystack_curr, needle)) {
             if (whole_word) {
                 gunichar before = 0;
@@ -494,21 +603,26 @@ prof_occurrences(const char* const needle, const char* const haystack, int offse
                 }
 
                 gunichar after = 0;
-                gchar* haystack_after_ch = haystack_curr + strlen(needle);
+                const gchar* haystack_after_ch = haystack_curr + needle_len;
                 if (haystack_after_ch[0] != '\0') {
                     after = g_utf8_get_char(haystack_after_ch);
                 }
 
                 if (!g_unichar_isalnum(before) && !g_unichar_isalnum(after)) {
-                    *result = g_slist_append(*result, GINT_TO_POINTER(offset));
+                    found = g_slist_prepend(found, GINT_TO_POINTER(offset));
                 }
             } else {
-                *result = g_slist_append(*result, GINT_TO_POINTER(offset));
+                found = g_slist_prepend(found, GINT_TO_POINTER(offset));
             }
         }
 
         offset++;
-    } while (g_strcmp0(g_utf8_offset_to_pointer(haystack, offset), "\0") != 0);
+        if (haystack_curr[0] != '\0') {
+            haystack_curr = g_utf8_next_char(haystack_curr);
+        }
+    } while (haystack_curr[0] != '\0');
+
+    *result = g_slist_concat(*result, g_slist_reverse(found));
 
     return *result;
 }
@@ -620,6 +734,17 @@ call_external(gchar** argv)
     return is_successful;
 }
 
+/*
+ * Worker threads never touch windows, preferences or the session themselves,
+ * they hand func over to the main thread instead. The main loop wakes up for
+ * it, notify frees data afterwards. From the main thread func runs right away.
+ */
+void
+run_on_main_thread(GSourceFunc func, gpointer data, GDestroyNotify notify)
+{
+    g_main_context_invoke_full(NULL, G_PRIORITY_DEFAULT, func, data, notify);
+}
+
 /**
  * @brief Formats an argument vector for calling an external command with placeholders.
  *
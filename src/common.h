@@ -125,6 +125,8 @@ load_custom_keyfile(prof_keyfile_t* keyfile, gchar* filename);
 gboolean
 save_keyfile(prof_keyfile_t* keyfile);
 void
+flush_keyfiles(void);
+void
 free_keyfile(prof_keyfile_t* keyfile);
 
 /* Our own define of MB_CUR_MAX but this time at compile time */
@@ -188,6 +190,7 @@ void get_file_paths_recursive(const char* directory, GSList** contents);
 char* get_random_string(int length);
 
 gboolean call_external(gchar** argv);
+void run_on_main_thread(GSourceFunc func, gpointer data, GDestroyNotify notify);
 gchar** format_call_external_argv(const char* template, const char* url, const char* filename);
 
 gchar* unique_filename_from_url(const char* url, const char* path);
@@ -59,7 +59,11 @@ static GKeyFile* accounts;
 static Autocomplete all_ac;
 static Autocomplete enabled_ac;
 
+// parsed accounts handed out by accounts_peek_account(), dropped on every write
+static GHashTable* peeked_accounts;
+
 static void _save_accounts(void);
+static void _accounts_peek_invalidate(void);
 
 void
 accounts_load(void)
@@ -69,6 +73,7 @@ accounts_load(void)
     enabled_ac = autocomplete_new();
     load_data_keyfile(&accounts_prof_keyfile, FILE_ACCOUNTS);
     accounts = accounts_prof_keyfile.keyfile;
+    _accounts_peek_invalidate();
 
     // create the logins searchable list for autocompletion
     gsize naccounts;
@@ -87,6 +92,10 @@ accounts_close(void)
 {
     autocomplete_free(all_ac);
     autocomplete_free(enabled_ac);
+    if (peeked_accounts) {
+        g_hash_table_destroy(peeked_accounts);
+        peeked_accounts = NULL;
+    }
     free_keyfile(&accounts_prof_keyfile);
     accounts = NULL;
 }
@@ -340,6 +349,44 @@ accounts_get_account(const char* const name)
     }
 }
 
+// Read-only account for lookups on hot paths, owned by the accounts module and
+// valid until the next change to any account. Use accounts_get_account() to
+// keep or modify a copy.
+const ProfAccount*
+accounts_peek_account(const char* const name)
+{
+    if (!name) {
+        return NULL;
+    }
+
+    if (!peeked_accounts) {
+        peeked_accounts = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, (GDestroyNotify)account_free);
+    }
+
+    ProfAccount* account = g_hash_table_lookup(peeked_accounts, name);
+    if (!account) {
+        account = accounts_get_account(name);
+        if (!account) {
+            return NULL;
+        }
+        g_hash_table_insert(peeked_accounts, account->name, account);
+    }
+
+    // without an explicit muc.service the service follows the connection
+    if (!g_key_file_has_key(accounts, name, "muc.service", NULL)) {
+        const char* conf_jid = NULL;
+        if (connection_get_status() == JABBER_CONNECTED) {
+            conf_jid = connection_jid_for_feature(XMPP_FEATURE_MUC);
+        }
+        if (g_strcmp0(account->muc_service, conf_jid) != 0) {
+            free(account->muc_service);
+            account->muc_service = conf_jid ? strdup(conf_jid) : NULL;
+        }
+    }
+
+    return account;
+}
+
 gboolean
 accounts_enable(const char* const name)
 {
@@ -951,8 +998,17 @@ accounts_get_login_status(const char* const account_name)
     return status;
 }
 
+static void
+_accounts_peek_invalidate(void)
+{
+    if (peeked_accounts) {
+        g_hash_table_remove_all(peeked_accounts);
+    }
+}
+
 static void
 _save_accounts(void)
 {
+    _accounts_peek_invalidate();
     save_keyfile(&accounts_prof_keyfile);
 }
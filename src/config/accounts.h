@@ -52,6 +52,7 @@ void accounts_add(const char* jid, const char* altdomain, const int port, const
 int accounts_remove(const char* jid);
 gchar** accounts_get_list(void);
 ProfAccount* accounts_get_account(const char* const name);
+const ProfAccount* accounts_peek_account(const char* const name);
 gboolean accounts_enable(const char* const name);
 gboolean accounts_disable(const char* const name);
 gboolean accounts_rename(const char* const account_name,
@@ -46,6 +46,19 @@
 #include "log.h"
 #include "xmpp/xmpp.h"
 
+// fingerprints known to be in the CAfile, so reconnecting to a server with a
+// trusted certificate doesn't read the whole file every time
+static GHashTable* stored_fingerprints = NULL;
+
+static void
+_cafile_mark_stored(const char* const fingerprint)
+{
+    if (!stored_fingerprints) {
+        stored_fingerprints = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    }
+    g_hash_table_add(stored_fingerprints, g_strdup(fingerprint));
+}
+
 static gchar*
 _cafile_name(void)
 {
@@ -64,6 +77,9 @@ cafile_add(const TLSCertificate* cert)
         log_error("[CAfile] can't store cert with fingerprint %s: PEM is empty", cert->fingerprint);
         return;
     }
+    if (stored_fingerprints && g_hash_table_contains(stored_fingerprints, cert->fingerprint)) {
+        return;
+    }
     auto_gchar gchar* cafile = _cafile_name();
     if (!cafile)
         return;
@@ -78,13 +94,17 @@ cafile_add(const TLSCertificate* cert)
         }
         if (strstr(contents, cert->fingerprint)) {
             log_debug("[CAfile] fingerprint %s already stored", cert->fingerprint);
+            _cafile_mark_stored(cert->fingerprint);
             return;
         }
     }
     const char* header = "# Profanity CAfile\n# DO NOT EDIT - this file is automatically generated";
     new_contents = g_strdup_printf("%s\n\n# %s\n%s", contents ? contents : header, cert->fingerprint, cert->pem);
-    if (!g_file_set_contents(cafile, new_contents, -1, &glib_error))
+    if (!g_file_set_contents(cafile, new_contents, -1, &glib_error)) {
         log_error("[CAfile] could not write to %s: %s", cafile, glib_error ? glib_error->message : "No GLib error given");
+    } else {
+        _cafile_mark_stored(cert->fingerprint);
+    }
 }
 
 gchar*
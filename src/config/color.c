@@ -60,11 +60,38 @@ static struct color_pair_cache
     struct
     {
         int16_t fg, bg;
+        // link in lru, NULL for theme pairs which are never recycled
+        GList* lru;
+        // screen update the pair was last used in
+        guint frame;
     }* pairs;
     int size;
     int capacity;
+    // (fg, bg) -> index in pairs
+    GHashTable* index;
+    // pairs of hashed strings, least recently used first
+    GQueue lru;
+    guint frame;
+    // pairs on the physical screen, per pair, found once per screen update
+    guint8* on_screen;
+    guint on_screen_frame;
+    gboolean full_logged;
+    // hashed strings -> PAIR_KEY of their colours, one table per color profile
+    GHashTable* hashed[COLOR_PROFILE_COUNT];
 } cache = { 0 };
 
+// hashed strings remembered per profile before the table is started over
+#define COLOR_HASHED_MAX 4096
+
+/*
+ * nearest color to each hue at full saturation and 50% lightness, the
+ * red/green profile folds hues into [-90, 90) so the table starts there
+ */
+#define COLOR_HUE_MIN -90
+#define COLOR_HUE_MAX 360
+static int16_t hue_cols[COLOR_HUE_MAX - COLOR_HUE_MIN];
+static gboolean hue_cols_ready = FALSE;
+
 /*
  * xterm default 256 colors
  * XXX: there are many duplicates... (eg blue3)
@@ -422,18 +449,34 @@ color_hash(const char* str, color_profile profile)
         break;
     }
 
-    rc = find_closest_col((int)h, 100, 50);
+    if (!hue_cols_ready) {
+        for (int hue = COLOR_HUE_MIN; hue < COLOR_HUE_MAX; hue++) {
+            hue_cols[hue - COLOR_HUE_MIN] = find_closest_col(hue, 100, 50);
+        }
+        hue_cols_ready = TRUE;
+    }
+    rc = hue_cols[CLAMP((int)h, COLOR_HUE_MIN, COLOR_HUE_MAX - 1) - COLOR_HUE_MIN];
 
 out:
     g_checksum_free(cs);
     return rc;
 }
 
+#define PAIR_KEY(fg, bg) GINT_TO_POINTER((((fg) + 1) << 16) | ((bg) + 1))
+#define PAIR_KEY_FG(key) ((GPOINTER_TO_INT(key) >> 16) - 1)
+#define PAIR_KEY_BG(key) ((GPOINTER_TO_INT(key) & 0xffff) - 1)
+
 void
 color_pair_cache_reset(void)
 {
     if (cache.pairs) {
         free(cache.pairs);
+        g_hash_table_destroy(cache.index);
+        g_queue_clear(&cache.lru);
+        g_free(cache.on_screen);
+        for (int i = 0; i < COLOR_PROFILE_COUNT; i++) {
+            g_hash_table_destroy(cache.hashed[i]);
+        }
         memset(&cache, 0, sizeof(cache));
     }
 
@@ -453,13 +496,102 @@ color_pair_cache_reset(void)
         cache.pairs[0].fg = -1;
         cache.pairs[0].bg = -1;
         cache.size = 1;
+        cache.index = g_hash_table_new(g_direct_hash, g_direct_equal);
+        g_hash_table_insert(cache.index, PAIR_KEY(-1, -1), GINT_TO_POINTER(0));
+        for (int i = 0; i < COLOR_PROFILE_COUNT; i++) {
+            cache.hashed[i] = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+        }
     } else {
         log_error("Color: unable to allocate memory");
     }
 }
 
+// a screen update has written out everything drawn so far
+void
+color_pair_cache_screen_updated(void)
+{
+    cache.frame++;
+}
+
+// marks which pairs some cell of the physical screen shows, scanned at most
+// once per screen update since the screen does not change in between
+static void
+_color_pair_cache_scan_screen(void)
+{
+    if (cache.on_screen && cache.on_screen_frame == cache.frame) {
+        return;
+    }
+    if (!cache.on_screen) {
+        cache.on_screen = g_malloc(cache.capacity);
+    }
+    memset(cache.on_screen, 0, cache.capacity);
+    cache.on_screen_frame = cache.frame;
+
+    if (!curscr) {
+        return;
+    }
+    for (int y = 0; y < LINES; y++) {
+        for (int x = 0; x < COLS; x++) {
+            cchar_t cell;
+            wchar_t wch[CCHARW_MAX + 1];
+            attr_t attrs;
+            short pair;
+            if (mvwin_wch(curscr, y, x, &cell) == OK && getcchar(&cell, wch, &attrs, &pair, NULL) == OK
+                && pair > 0 && pair < cache.capacity) {
+                cache.on_screen[pair] = 1;
+            }
+        }
+    }
+}
+
+// takes the least recently used pair of a hashed string that is neither on
+// screen nor drawn since the last screen update, -1 when all of them are
+static int
+_color_pair_cache_recycle(void)
+{
+    if (g_queue_is_empty(&cache.lru)) {
+        return -1;
+    }
+    _color_pair_cache_scan_screen();
+
+    for (GList* link = cache.lru.head; link; link = g_list_next(link)) {
+        int i = GPOINTER_TO_INT(link->data);
+        if (cache.on_screen[i] || cache.pairs[i].frame == cache.frame) {
+            continue;
+        }
+        g_queue_delete_link(&cache.lru, link);
+        cache.pairs[i].lru = NULL;
+        g_hash_table_remove(cache.index, PAIR_KEY(cache.pairs[i].fg, cache.pairs[i].bg));
+        return i;
+    }
+
+    return -1;
+}
+
+static void
+_color_pair_cache_touch(int i, gboolean recyclable)
+{
+    cache.pairs[i].frame = cache.frame;
+
+    GList* link = cache.pairs[i].lru;
+    if (!link) {
+        return;
+    }
+    g_queue_unlink(&cache.lru, link);
+    if (recyclable) {
+        g_queue_push_tail_link(&cache.lru, link);
+    } else {
+        g_list_free_1(link);
+        cache.pairs[i].lru = NULL;
+    }
+}
+
+// Theme pairs are kept for good. Pairs of hashed strings (nicks) can be
+// taken over by another colour once the pair table is full and they are not
+// on screen, text drawn with them in other windows or further up the
+// scrollback then shows the new colour until that window is redrawn.
 static int
-_color_pair_cache_get(int fg, int bg)
+_color_pair_cache_get(int fg, int bg, gboolean recyclable)
 {
     if (COLORS < 256) {
         if (fg > 7 || bg > 7) {
@@ -469,27 +601,40 @@ _color_pair_cache_get(int fg, int bg)
     }
 
     /* try to find pair in cache */
-    for (int i = 0; i < cache.size; i++) {
-        if (fg == cache.pairs[i].fg && bg == cache.pairs[i].bg) {
-            return i;
-        }
+    gpointer found;
+    if (cache.index && g_hash_table_lookup_extended(cache.index, PAIR_KEY(fg, bg), NULL, &found)) {
+        int i = GPOINTER_TO_INT(found);
+        _color_pair_cache_touch(i, recyclable);
+        return i;
     }
 
     /* otherwise cache new pair */
 
-    if (cache.size >= cache.capacity) {
-        log_error("Color: reached ncurses color pair cache of %d (COLOR_PAIRS=%d)",
-                  cache.capacity, COLOR_PAIRS);
-        return -1;
+    int i;
+    if (cache.size < cache.capacity) {
+        i = cache.size++;
+    } else {
+        i = _color_pair_cache_recycle();
+        if (i < 0) {
+            if (!cache.full_logged) {
+                log_error("Color: reached ncurses color pair cache of %d (COLOR_PAIRS=%d)",
+                          cache.capacity, COLOR_PAIRS);
+                cache.full_logged = TRUE;
+            }
+            return -1;
+        }
     }
 
-    int i = cache.size;
     cache.pairs[i].fg = fg;
     cache.pairs[i].bg = bg;
+    cache.pairs[i].frame = cache.frame;
+    if (recyclable) {
+        g_queue_push_tail(&cache.lru, GINT_TO_POINTER(i));
+        cache.pairs[i].lru = cache.lru.tail;
+    }
     /* (re-)define the new pair in curses */
     init_pair(i, fg, bg);
-
-    cache.size++;
+    g_hash_table_insert(cache.index, PAIR_KEY(fg, bg), GINT_TO_POINTER(i));
 
     return i;
 }
@@ -506,6 +651,12 @@ _color_pair_cache_get(int fg, int bg)
 int
 color_pair_cache_hash_str(const char* str, color_profile profile)
 {
+    GHashTable* hashed = cache.hashed[profile];
+    gpointer known;
+    if (hashed && g_hash_table_lookup_extended(hashed, str, NULL, &known)) {
+        return _color_pair_cache_get(PAIR_KEY_FG(known), PAIR_KEY_BG(known), TRUE);
+    }
+
     int fg = color_hash(str, profile);
     int bg = -1;
 
@@ -514,7 +665,14 @@ color_pair_cache_hash_str(const char* str, color_profile profile)
         bg = find_col(bkgnd, strlen(bkgnd));
     }
 
-    return _color_pair_cache_get(fg, bg);
+    if (hashed) {
+        if (g_hash_table_size(hashed) >= COLOR_HASHED_MAX) {
+            g_hash_table_remove_all(hashed);
+        }
+        g_hash_table_insert(hashed, g_strdup(str), PAIR_KEY(fg, bg));
+    }
+
+    return _color_pair_cache_get(fg, bg, TRUE);
 }
 
 /**
@@ -542,5 +700,5 @@ color_pair_cache_get(const char* pair_name)
         return -1;
     }
 
-    return _color_pair_cache_get(fg, bg);
+    return _color_pair_cache_get(fg, bg, FALSE);
 }
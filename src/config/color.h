@@ -45,6 +45,7 @@ typedef enum {
     COLOR_PROFILE_DEFAULT,
     COLOR_PROFILE_REDGREEN_BLINDNESS,
     COLOR_PROFILE_BLUE_BLINDNESS,
+    COLOR_PROFILE_COUNT,
 } color_profile;
 
 struct color_def
@@ -61,5 +62,7 @@ int color_pair_cache_hash_str(const char* str, color_profile profile);
 int color_pair_cache_get(const char* pair_name);
 /* clear cache */
 void color_pair_cache_reset(void);
+/* everything drawn so far is on screen */
+void color_pair_cache_screen_updated(void);
 
 #endif
@@ -44,9 +44,11 @@
 #define FILE_TLSCERTS                 "tlscerts"
 #define FILE_PLUGIN_SETTINGS          "plugin_settings"
 #define FILE_PLUGIN_THEMES            "plugin_themes"
+#define FILE_PLUGIN_MANIFEST          "plugin_manifest"
 #define FILE_CAPSCACHE                "capscache"
 #define FILE_PROFANITY_IDENTIFIER     "profident"
 #define FILE_BOOKMARK_AUTOJOIN_IGNORE "bookmark_ignore"
+#define FILE_INPUT_HISTORY            "inputhistory"
 
 #define DIR_THEMES    "themes"
 #define DIR_ICONS     "icons"
@@ -61,6 +63,10 @@
 #define DIR_EDITOR    "editor"
 #define DIR_CERTS     "certs"
 #define DIR_PHOTOS    "photos"
+#define DIR_ROSTER    "roster"
+#define DIR_VCARDS    "vcards"
+#define DIR_SESSION   "session"
+#define DIR_URLCACHE  "urlcache"
 
 void files_create_directories(void);
 
@@ -76,11 +76,27 @@ gint log_maxsize = 0;
 static Autocomplete boolean_choice_ac;
 static Autocomplete room_trigger_ac;
 
+// decoded values of the preferences, read from the keyfile on first use
+typedef struct prefs_cache_entry_t
+{
+    gboolean has_boolean;
+    gboolean boolean;
+    gboolean has_string;
+    gchar* string;
+} PrefsCacheEntry;
+
+static PrefsCacheEntry prefs_cache[PREF_COUNT];
+
+// changes whenever the room trigger list may have changed
+static guint room_triggers_serial = 0;
+
 static void _save_prefs(void);
 static const char* _get_group(preference_t pref);
 static const char* _get_key(preference_t pref);
 static gboolean _get_default_boolean(preference_t pref);
 static char* _get_default_string(preference_t pref);
+static void _prefs_cache_clear(preference_t pref);
+static void _prefs_cache_clear_all(void);
 
 static void
 _prefs_load(void)
@@ -284,6 +300,8 @@ prefs_load(const char* config_file)
     prefs = prefs_prof_keyfile.keyfile;
 
     _prefs_load();
+    _prefs_cache_clear_all();
+    room_triggers_serial++;
 }
 
 void
@@ -299,6 +317,23 @@ prefs_close(void)
 
     free_keyfile(&prefs_prof_keyfile);
     prefs = NULL;
+    _prefs_cache_clear_all();
+}
+
+/**
+ * @brief Fingerprint of the current preferences.
+ *
+ * @return A hash of the preferences file content, it changes whenever any preference is set or reloaded.
+ */
+guint
+prefs_fingerprint(void)
+{
+    if (prefs == NULL) {
+        return 0;
+    }
+
+    auto_gchar gchar* data = g_key_file_to_data(prefs, NULL, NULL);
+    return data ? g_str_hash(data) : 0;
 }
 
 gchar*
@@ -512,15 +547,22 @@ prefs_reset_room_notify(const char* const roomjid)
 gboolean
 prefs_get_boolean(preference_t pref)
 {
+    PrefsCacheEntry* entry = &prefs_cache[pref];
+    if (entry->has_boolean) {
+        return entry->boolean;
+    }
+
     const char* group = _get_group(pref);
     const char* key = _get_key(pref);
-    gboolean def = _get_default_boolean(pref);
 
     if (!g_key_file_has_key(prefs, group, key, NULL)) {
-        return def;
+        entry->boolean = _get_default_boolean(pref);
+    } else {
+        entry->boolean = g_key_file_get_boolean(prefs, group, key, NULL);
     }
+    entry->has_boolean = TRUE;
 
-    return g_key_file_get_boolean(prefs, group, key, NULL);
+    return entry->boolean;
 }
 
 void
@@ -529,6 +571,7 @@ prefs_set_boolean(preference_t pref, gboolean value)
     const char* group = _get_group(pref);
     const char* key = _get_key(pref);
     g_key_file_set_boolean(prefs, group, key, value);
+    _prefs_cache_clear(pref);
 }
 
 /**
@@ -542,21 +585,35 @@ prefs_set_boolean(preference_t pref, gboolean value)
 gchar*
 prefs_get_string(preference_t pref)
 {
+    return g_strdup(prefs_peek_string(pref));
+}
+
+/**
+ * @brief Retrieves a string preference value without copying it.
+ *
+ * @param pref The preference identifier.
+ * @return The string preference value or `NULL` if not found.
+ *
+ * @note The string is owned by the preferences and only valid until the preference is set or reloaded.
+ */
+const gchar*
+prefs_peek_string(preference_t pref)
+{
+    PrefsCacheEntry* entry = &prefs_cache[pref];
+    if (entry->has_string) {
+        return entry->string;
+    }
+
     const char* group = _get_group(pref);
     const char* key = _get_key(pref);
-    char* def = _get_default_string(pref);
-
-    gchar* result = g_key_file_get_string(prefs, group, key, NULL);
 
-    if (result == NULL) {
-        if (def) {
-            return g_strdup(def);
-        } else {
-            return NULL;
-        }
-    } else {
-        return result;
+    entry->string = g_key_file_get_string(prefs, group, key, NULL);
+    if (entry->string == NULL) {
+        entry->string = g_strdup(_get_default_string(pref));
     }
+    entry->has_string = TRUE;
+
+    return entry->string;
 }
 
 /**
@@ -609,6 +666,7 @@ prefs_set_string(preference_t pref, gchar* new_value)
     } else {
         g_key_file_set_string(prefs, group, key, new_value);
     }
+    _prefs_cache_clear(pref);
 }
 
 void
@@ -621,6 +679,7 @@ prefs_set_string_with_option(preference_t pref, char* option, char* value)
     } else {
         g_key_file_set_locale_string(prefs, group, key, option, value);
     }
+    _prefs_cache_clear(pref);
 }
 
 void
@@ -645,6 +704,7 @@ prefs_set_string_list_with_option(preference_t pref, char* option, const gchar*
             g_key_file_set_locale_string_list(prefs, group, key, option, values, num_values);
         }
     }
+    _prefs_cache_clear(pref);
 }
 
 char*
@@ -708,6 +768,22 @@ prefs_set_notify_remind(gint value)
     g_key_file_set_integer(prefs, PREF_GROUP_NOTIFICATIONS, "remind", value);
 }
 
+gint
+prefs_get_notify_room_flood(void)
+{
+    if (!g_key_file_has_key(prefs, PREF_GROUP_NOTIFICATIONS, "room.flood", NULL)) {
+        return 30;
+    } else {
+        return g_key_file_get_integer(prefs, PREF_GROUP_NOTIFICATIONS, "room.flood", NULL);
+    }
+}
+
+void
+prefs_set_notify_room_flood(gint value)
+{
+    g_key_file_set_integer(prefs, PREF_GROUP_NOTIFICATIONS, "room.flood", value);
+}
+
 gint
 prefs_get_max_log_size(void)
 {
@@ -724,6 +800,53 @@ prefs_set_max_log_size(gint value)
     g_key_file_set_integer(prefs, PREF_GROUP_LOGGING, "maxsize", value);
 }
 
+// Retention policy of the chat database, "<n>d" keeps n days, "<n>" keeps
+// the newest n messages. A NULL barejid is the default for everyone else.
+gchar*
+prefs_get_db_retention(const char* const barejid)
+{
+    auto_gchar gchar* key = barejid ? g_strdup_printf("db.retention.%s", barejid) : g_strdup("db.retention");
+    return g_key_file_get_string(prefs, PREF_GROUP_LOGGING, key, NULL);
+}
+
+void
+prefs_set_db_retention(const char* const barejid, const char* const policy)
+{
+    auto_gchar gchar* key = barejid ? g_strdup_printf("db.retention.%s", barejid) : g_strdup("db.retention");
+    if (policy) {
+        g_key_file_set_string(prefs, PREF_GROUP_LOGGING, key, policy);
+    } else {
+        g_key_file_remove_key(prefs, PREF_GROUP_LOGGING, key, NULL);
+    }
+}
+
+// contacts and rooms with their own retention policy
+GList*
+prefs_get_db_retention_jids(void)
+{
+    GList* result = NULL;
+    auto_gcharv gchar** keys = g_key_file_get_keys(prefs, PREF_GROUP_LOGGING, NULL, NULL);
+    for (int i = 0; keys && keys[i]; i++) {
+        if (g_str_has_prefix(keys[i], "db.retention.")) {
+            result = g_list_append(result, g_strdup(keys[i] + strlen("db.retention.")));
+        }
+    }
+
+    return result;
+}
+
+gint
+prefs_get_db_archive(void)
+{
+    return MAX(g_key_file_get_integer(prefs, PREF_GROUP_LOGGING, "db.archive", NULL), 0);
+}
+
+void
+prefs_set_db_archive(gint days)
+{
+    g_key_file_set_integer(prefs, PREF_GROUP_LOGGING, "db.archive", days);
+}
+
 gint
 prefs_get_inpblock(void)
 {
@@ -741,6 +864,29 @@ prefs_set_inpblock(gint value)
     g_key_file_set_integer(prefs, PREF_GROUP_UI, "inpblock", value);
 }
 
+gint
+prefs_get_scrollback(const char* const wintype)
+{
+    auto_gchar gchar* key = g_strdup_printf("scrollback.%s", wintype);
+    if (!g_key_file_has_key(prefs, PREF_GROUP_UI, key, NULL)) {
+        return PREFS_DEFAULT_SCROLLBACK;
+    }
+
+    gint val = g_key_file_get_integer(prefs, PREF_GROUP_UI, key, NULL);
+    if (val < PREFS_MIN_SCROLLBACK || val > PREFS_MAX_SCROLLBACK) {
+        return PREFS_DEFAULT_SCROLLBACK;
+    }
+
+    return val;
+}
+
+void
+prefs_set_scrollback(const char* const wintype, gint value)
+{
+    auto_gchar gchar* key = g_strdup_printf("scrollback.%s", wintype);
+    g_key_file_set_integer(prefs, PREF_GROUP_UI, key, value);
+}
+
 gint
 prefs_get_reconnect(void)
 {
@@ -789,6 +935,74 @@ prefs_set_autoping_timeout(gint value)
     g_key_file_set_integer(prefs, PREF_GROUP_CONNECTION, "autoping.timeout", value);
 }
 
+gint
+prefs_get_iq_inflight(void)
+{
+    if (!g_key_file_has_key(prefs, PREF_GROUP_CONNECTION, "iq.inflight", NULL)) {
+        return 8;
+    } else {
+        return g_key_file_get_integer(prefs, PREF_GROUP_CONNECTION, "iq.inflight", NULL);
+    }
+}
+
+void
+prefs_set_iq_inflight(gint value)
+{
+    g_key_file_set_integer(prefs, PREF_GROUP_CONNECTION, "iq.inflight", value);
+}
+
+// maximum screen updates per second, 0 for no limit
+gint
+prefs_get_redraw_rate(void)
+{
+    if (!g_key_file_has_key(prefs, PREF_GROUP_UI, "redraw.rate", NULL)) {
+        return 0;
+    } else {
+        return g_key_file_get_integer(prefs, PREF_GROUP_UI, "redraw.rate", NULL);
+    }
+}
+
+void
+prefs_set_redraw_rate(gint value)
+{
+    g_key_file_set_integer(prefs, PREF_GROUP_UI, "redraw.rate", value);
+}
+
+// milliseconds a main loop iteration may take before it is logged, 0 for never
+gint
+prefs_get_frame_budget(void)
+{
+    if (!g_key_file_has_key(prefs, PREF_GROUP_UI, "frame.budget", NULL)) {
+        return 50;
+    } else {
+        return g_key_file_get_integer(prefs, PREF_GROUP_UI, "frame.budget", NULL);
+    }
+}
+
+void
+prefs_set_frame_budget(gint value)
+{
+    g_key_file_set_integer(prefs, PREF_GROUP_UI, "frame.budget", value);
+}
+
+// largest page of history requested from the archive or read from the
+// database in one go, the first page is always MESSAGES_TO_RETRIEVE
+gint
+prefs_get_mam_pagesize(void)
+{
+    if (!g_key_file_has_key(prefs, PREF_GROUP_CONNECTION, "mam.pagesize", NULL)) {
+        return 100;
+    } else {
+        return g_key_file_get_integer(prefs, PREF_GROUP_CONNECTION, "mam.pagesize", NULL);
+    }
+}
+
+void
+prefs_set_mam_pagesize(gint value)
+{
+    g_key_file_set_integer(prefs, PREF_GROUP_CONNECTION, "mam.pagesize", value);
+}
+
 gint
 prefs_get_autoaway_time(void)
 {
@@ -1297,6 +1511,7 @@ prefs_add_room_notify_trigger(const char* const text)
 
     if (res) {
         autocomplete_add(room_trigger_ac, text);
+        room_triggers_serial++;
     }
 
     return res;
@@ -1310,11 +1525,22 @@ prefs_remove_room_notify_trigger(const char* const text)
 
     if (res) {
         autocomplete_remove(room_trigger_ac, text);
+        room_triggers_serial++;
     }
 
     return res;
 }
 
+/*
+ * Returns a number that changes whenever the room notify triggers are added,
+ * removed or reloaded, to tell when something built from them is stale
+ */
+guint
+prefs_get_room_notify_triggers_serial(void)
+{
+    return room_triggers_serial;
+}
+
 GList*
 prefs_get_room_notify_triggers(void)
 {
@@ -1709,6 +1935,22 @@ _save_prefs(void)
 // get the preference group for a specific preference
 // for example the PREF_BEEP setting ("beep" in .profrc, see _get_key) belongs
 // to the [ui] section.
+static void
+_prefs_cache_clear(preference_t pref)
+{
+    PrefsCacheEntry* entry = &prefs_cache[pref];
+    g_free(entry->string);
+    memset(entry, 0, sizeof(*entry));
+}
+
+static void
+_prefs_cache_clear_all(void)
+{
+    for (int i = 0; i < PREF_COUNT; i++) {
+        _prefs_cache_clear(i);
+    }
+}
+
 static const char*
 _get_group(preference_t pref)
 {
@@ -1735,6 +1977,7 @@ _get_group(preference_t pref)
     case PREF_MUC_PRIVILEGES:
     case PREF_PRESENCE:
     case PREF_WRAP:
+    case PREF_MAINWIN_SCROLL:
     case PREF_TIME_CONSOLE:
     case PREF_TIME_CHAT:
     case PREF_TIME_MUC:
@@ -1788,6 +2031,7 @@ _get_group(preference_t pref)
     case PREF_STATUSBAR_TABMODE:
     case PREF_TITLEBAR_MUC_TITLE:
     case PREF_SLASH_GUARD:
+    case PREF_COMPLETION_FUZZY:
     case PREF_COMPOSE_EDITOR:
     case PREF_OUTGOING_STAMP:
     case PREF_INCOMING_STAMP:
@@ -1820,6 +2064,7 @@ _get_group(preference_t pref)
     case PREF_GRLOG:
     case PREF_LOG_ROTATE:
     case PREF_LOG_SHARED:
+    case PREF_LOG_COMPRESS:
         return PREF_GROUP_LOGGING;
     case PREF_AVATAR_CMD:
     case PREF_URL_OPEN_CMD:
@@ -1831,6 +2076,7 @@ _get_group(preference_t pref)
     case PREF_AUTOAWAY_MESSAGE:
     case PREF_AUTOXA_MESSAGE:
     case PREF_LASTACTIVITY:
+    case PREF_CSI:
         return PREF_GROUP_PRESENCE;
     case PREF_CONNECT_ACCOUNT:
     case PREF_DEFAULT_ACCOUNT:
@@ -1839,9 +2085,12 @@ _get_group(preference_t pref)
     case PREF_RECEIPTS_REQUEST:
     case PREF_REVEAL_OS:
     case PREF_TLS_CERTPATH:
+    case PREF_URL_DOWNLOAD_LIMIT:
+    case PREF_URL_UPLOAD_RESIZE:
     case PREF_CORRECTION_ALLOW:
     case PREF_MAM:
     case PREF_SILENCE_NON_ROSTER:
+    case PREF_SILENCE_QUARANTINE:
     case PREF_STROPHE_VERBOSITY:
     case PREF_STROPHE_SM_ENABLED:
     case PREF_STROPHE_SM_RESEND:
@@ -1904,6 +2153,8 @@ _get_key(preference_t pref)
         return "history";
     case PREF_CARBONS:
         return "carbons";
+    case PREF_CSI:
+        return "csi";
     case PREF_RECEIPTS_SEND:
         return "receipts.send";
     case PREF_RECEIPTS_REQUEST:
@@ -1990,10 +2241,14 @@ _get_key(preference_t pref)
         return "rotate";
     case PREF_LOG_SHARED:
         return "shared";
+    case PREF_LOG_COMPRESS:
+        return "compress";
     case PREF_PRESENCE:
         return "presence";
     case PREF_WRAP:
         return "wrap";
+    case PREF_MAINWIN_SCROLL:
+        return "mainwin.scroll";
     case PREF_TIME_CONSOLE:
         return "time.console";
     case PREF_TIME_CHAT:
@@ -2124,16 +2379,24 @@ _get_key(preference_t pref)
         return "avatar.cmd";
     case PREF_SLASH_GUARD:
         return "slashguard";
+    case PREF_COMPLETION_FUZZY:
+        return "completion.fuzzy";
     case PREF_MAM:
         return "mam";
     case PREF_URL_OPEN_CMD:
         return "url.open.cmd";
     case PREF_URL_SAVE_CMD:
         return "url.save.cmd";
+    case PREF_URL_DOWNLOAD_LIMIT:
+        return "url.download.limit";
+    case PREF_URL_UPLOAD_RESIZE:
+        return "url.upload.resize";
     case PREF_COMPOSE_EDITOR:
         return "compose.editor";
     case PREF_SILENCE_NON_ROSTER:
         return "silence.incoming.nonroster";
+    case PREF_SILENCE_QUARANTINE:
+        return "silence.incoming.quarantine";
     case PREF_OUTGOING_STAMP:
         return "stamp.outgoing";
     case PREF_INCOMING_STAMP:
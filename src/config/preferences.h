@@ -44,6 +44,10 @@
 #define PREFS_MIN_LOG_SIZE 64
 #define PREFS_MAX_LOG_SIZE (10 * 1024 * 1024)
 
+#define PREFS_DEFAULT_SCROLLBACK 200
+#define PREFS_MIN_SCROLLBACK     10
+#define PREFS_MAX_SCROLLBACK     10000
+
 // represents all settings in .profrc
 // each enum value is mapped to a group and key in .profrc (see preferences.c)
 typedef enum {
@@ -136,6 +140,7 @@ typedef enum {
     PREF_DEFAULT_ACCOUNT,
     PREF_LOG_ROTATE,
     PREF_LOG_SHARED,
+    PREF_LOG_COMPRESS,
     PREF_OTR_LOG,
     PREF_OTR_POLICY,
     PREF_OTR_SENDFILE,
@@ -177,6 +182,7 @@ typedef enum {
     PREF_URL_SAVE_CMD,
     PREF_COMPOSE_EDITOR,
     PREF_SILENCE_NON_ROSTER,
+    PREF_SILENCE_QUARANTINE,
     PREF_OUTGOING_STAMP,
     PREF_INCOMING_STAMP,
     PREF_NOTIFY_ROOM_OFFLINE,
@@ -187,6 +193,13 @@ typedef enum {
     PREF_STROPHE_SM_RESEND,
     PREF_VCARD_PHOTO_CMD,
     PREF_STATUSBAR_TABMODE,
+    PREF_URL_DOWNLOAD_LIMIT,
+    PREF_URL_UPLOAD_RESIZE,
+    PREF_COMPLETION_FUZZY,
+    PREF_CSI,
+    PREF_MAINWIN_SCROLL,
+    // number of preferences, keep last
+    PREF_COUNT
 } preference_t;
 
 typedef struct prof_alias_t
@@ -207,6 +220,7 @@ void prefs_load(const char* config_file);
 void prefs_save(void);
 void prefs_close(void);
 void prefs_reload(void);
+guint prefs_fingerprint(void);
 
 gchar* prefs_autocomplete_boolean_choice(const char* const prefix, gboolean previous, void* context);
 void prefs_reset_boolean_choice(void);
@@ -219,9 +233,16 @@ void prefs_set_gone(gint value);
 
 void prefs_set_notify_remind(gint period);
 gint prefs_get_notify_remind(void);
+void prefs_set_notify_room_flood(gint rate);
+gint prefs_get_notify_room_flood(void);
 
 void prefs_set_max_log_size(gint value);
 gint prefs_get_max_log_size(void);
+gchar* prefs_get_db_retention(const char* const barejid);
+void prefs_set_db_retention(const char* const barejid, const char* const policy);
+GList* prefs_get_db_retention_jids(void);
+gint prefs_get_db_archive(void);
+void prefs_set_db_archive(gint days);
 gint prefs_get_priority(void);
 void prefs_set_reconnect(gint value);
 gint prefs_get_reconnect(void);
@@ -229,9 +250,21 @@ void prefs_set_autoping(gint value);
 gint prefs_get_autoping(void);
 void prefs_set_autoping_timeout(gint value);
 gint prefs_get_autoping_timeout(void);
+void prefs_set_iq_inflight(gint value);
+gint prefs_get_iq_inflight(void);
+void prefs_set_redraw_rate(gint value);
+gint prefs_get_redraw_rate(void);
+void prefs_set_frame_budget(gint value);
+gint prefs_get_frame_budget(void);
+void prefs_set_mam_pagesize(gint value);
+gint prefs_get_mam_pagesize(void);
 gint prefs_get_inpblock(void);
 void prefs_set_inpblock(gint value);
 
+// wintype is one of console, chat, muc, private, config, xml
+gint prefs_get_scrollback(const char* const wintype);
+void prefs_set_scrollback(const char* const wintype, gint value);
+
 void prefs_set_statusbartabs(gint value);
 gint prefs_get_statusbartabs(void);
 void prefs_set_statusbartablen(gint value);
@@ -312,6 +345,7 @@ void prefs_free_aliases(GList* aliases);
 gboolean prefs_add_room_notify_trigger(const char* const text);
 gboolean prefs_remove_room_notify_trigger(const char* const text);
 GList* prefs_get_room_notify_triggers(void);
+guint prefs_get_room_notify_triggers_serial(void);
 
 ProfWinPlacement* prefs_get_win_placement(void);
 void prefs_free_win_placement(ProfWinPlacement* placement);
@@ -330,6 +364,7 @@ void prefs_save_win_placement(ProfWinPlacement* placement);
 gboolean prefs_get_boolean(preference_t pref);
 void prefs_set_boolean(preference_t pref, gboolean value);
 gchar* prefs_get_string(preference_t pref);
+const gchar* prefs_peek_string(preference_t pref);
 gchar* prefs_get_string_with_locale(preference_t pref, gchar* locale);
 void prefs_set_string(preference_t pref, gchar* new_value);
 void prefs_set_string_with_option(preference_t pref, char* option, char* value);
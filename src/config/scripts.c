@@ -51,6 +51,24 @@
 #include "ui/window_list.h"
 #include "xmpp/xmpp.h"
 
+static GSList*
+_scripts_read_lines(FILE* scriptfile)
+{
+    auto_char char* line = NULL;
+    size_t len = 0;
+    GSList* result = NULL;
+
+    while (getline(&line, &len, scriptfile) != -1) {
+        if (g_str_has_suffix(line, "\n")) {
+            result = g_slist_append(result, g_strndup(line, strlen(line) - 1));
+        } else {
+            result = g_slist_append(result, g_strdup(line));
+        }
+    }
+
+    return result;
+}
+
 void
 scripts_init(void)
 {
@@ -106,18 +124,7 @@ scripts_read(const char* const script)
 
     g_string_free(scriptpath, TRUE);
 
-    auto_char char* line = NULL;
-    size_t len = 0;
-    GSList* result = NULL;
-
-    while (getline(&line, &len, scriptfile) != -1) {
-        if (g_str_has_suffix(line, "\n")) {
-            result = g_slist_append(result, g_strndup(line, strlen(line) - 1));
-        } else {
-            result = g_slist_append(result, strdup(line));
-        }
-    }
-
+    GSList* result = _scripts_read_lines(scriptfile);
     fclose(scriptfile);
 
     return result;
@@ -140,17 +147,21 @@ scripts_exec(const char* const script)
 
     g_string_free(scriptpath, TRUE);
 
-    auto_char char* line = NULL;
-    size_t len = 0;
+    GSList* commands = _scripts_read_lines(scriptfile);
+    fclose(scriptfile);
 
-    while (getline(&line, &len, scriptfile) != -1) {
+    // Runs as one batch: the stanzas of all commands, joins included, go out
+    // in one burst once the script is done and the screen is drawn once.
+    // Settings and accounts changes are already written together by
+    // save_keyfile().
+    for (GSList* curr = commands; curr; curr = g_slist_next(curr)) {
         ProfWin* win = wins_get_current();
-        cmd_process_input(win, line);
-        session_process_events();
-        ui_update();
+        cmd_process_input(win, curr->data);
     }
+    g_slist_free_full(commands, g_free);
 
-    fclose(scriptfile);
+    session_process_events();
+    ui_mark_dirty();
 
     return TRUE;
 }
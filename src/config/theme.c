@@ -61,10 +61,30 @@ static GKeyFile* theme;
 static GHashTable* bold_items;
 static GHashTable* defaults;
 
+// parsed theme files by path, reused while unchanged on disk so switching
+// back and forth between themes doesn't read and parse them again
+typedef struct theme_file_t
+{
+    GKeyFile* keyfile;
+    gint64 mtime;
+} ThemeFile;
+
+static GHashTable* theme_files;
+
+// THEME_TRACKBAR is the last theme_item_t
+#define THEME_ITEM_COUNT (THEME_TRACKBAR + 1)
+
+// resolved attributes per theme item, filled on first use after a (re)load
+static int theme_attrs_cache[THEME_ITEM_COUNT];
+static gboolean theme_attrs_cached[THEME_ITEM_COUNT];
+
 static void _load_preferences(void);
+static void _theme_attrs_reset(void);
+static int _theme_resolve_attrs(theme_item_t attrs);
 static void _theme_list_dir(const gchar* const dir, GSList** result);
 static GString* _theme_find(const char* const theme_name);
 static gboolean _theme_load_file(const char* const theme_name);
+static GKeyFile* _theme_file_get(const char* const path);
 
 void
 theme_init(const char* const theme_name)
@@ -162,6 +182,8 @@ theme_init(const char* const theme_name)
     g_hash_table_insert(defaults, strdup("untrusted"), strdup("red"));
     g_hash_table_insert(defaults, strdup("cmd.wins.unread"), strdup("default"));
 
+    _theme_attrs_reset();
+
     //_load_preferences();
 }
 
@@ -188,6 +210,7 @@ theme_load(const char* const theme_name, gboolean load_theme_prefs)
         return FALSE;
 
     color_pair_cache_reset();
+    _theme_attrs_reset();
 
     if (_theme_load_file(theme_name)) {
         if (load_theme_prefs) {
@@ -205,7 +228,7 @@ _theme_load_file(const char* const theme_name)
     // use default theme
     if (theme_name == NULL || strcmp(theme_name, "default") == 0) {
         if (theme) {
-            g_key_file_free(theme);
+            g_key_file_unref(theme);
         }
         theme = g_key_file_new();
 
@@ -223,16 +246,46 @@ _theme_load_file(const char* const theme_name)
         theme_loc = new_theme_file;
         log_info("Loading theme \"%s\"", theme_name);
         if (theme) {
-            g_key_file_free(theme);
+            g_key_file_unref(theme);
         }
-        theme = g_key_file_new();
-        g_key_file_load_from_file(theme, theme_loc->str, G_KEY_FILE_KEEP_COMMENTS,
-                                  NULL);
+        theme = _theme_file_get(theme_loc->str);
     }
 
     return TRUE;
 }
 
+static void
+_theme_file_free(gpointer data)
+{
+    ThemeFile* file = data;
+    g_key_file_unref(file->keyfile);
+    g_free(file);
+}
+
+static GKeyFile*
+_theme_file_get(const char* const path)
+{
+    GStatBuf st;
+    gint64 mtime = g_stat(path, &st) == 0 ? (gint64)st.st_mtime : 0;
+
+    if (!theme_files) {
+        theme_files = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, _theme_file_free);
+    }
+
+    ThemeFile* file = g_hash_table_lookup(theme_files, path);
+    if (file && file->mtime == mtime) {
+        return g_key_file_ref(file->keyfile);
+    }
+
+    file = g_new0(ThemeFile, 1);
+    file->keyfile = g_key_file_new();
+    file->mtime = mtime;
+    g_key_file_load_from_file(file->keyfile, path, G_KEY_FILE_KEEP_COMMENTS, NULL);
+    g_hash_table_replace(theme_files, g_strdup(path), file);
+
+    return g_key_file_ref(file->keyfile);
+}
+
 GSList*
 theme_list(void)
 {
@@ -252,9 +305,13 @@ void
 theme_close(void)
 {
     if (theme) {
-        g_key_file_free(theme);
+        g_key_file_unref(theme);
         theme = NULL;
     }
+    if (theme_files) {
+        g_hash_table_destroy(theme_files);
+        theme_files = NULL;
+    }
     if (theme_loc) {
         g_string_free(theme_loc, TRUE);
         theme_loc = NULL;
@@ -274,6 +331,7 @@ theme_init_colours(void)
 {
     assume_default_colors(-1, -1);
     color_pair_cache_reset();
+    _theme_attrs_reset();
 }
 
 static void
@@ -687,7 +745,7 @@ theme_hash_attrs(const char* str)
 {
     color_profile profile = COLOR_PROFILE_DEFAULT;
 
-    auto_gchar gchar* color_pref = prefs_get_string(PREF_COLOR_NICK);
+    const gchar* color_pref = prefs_peek_string(PREF_COLOR_NICK);
     if (strcmp(color_pref, "redgreen") == 0) {
         profile = COLOR_PROFILE_REDGREEN_BLINDNESS;
     } else if (strcmp(color_pref, "blue") == 0) {
@@ -700,6 +758,31 @@ theme_hash_attrs(const char* str)
 /* returns the colours (fgnd and bknd) for a certain attribute ie main.text */
 int
 theme_attrs(theme_item_t attrs)
+{
+    if ((guint)attrs >= THEME_ITEM_COUNT) {
+        return _theme_resolve_attrs(attrs);
+    }
+
+    if (!theme_attrs_cached[attrs]) {
+        theme_attrs_cache[attrs] = _theme_resolve_attrs(attrs);
+        theme_attrs_cached[attrs] = TRUE;
+    }
+
+    return theme_attrs_cache[attrs];
+}
+
+/*
+ * Colour pairs are allocated on first use rather than when the theme loads,
+ * curses may not be initialised yet at that point.
+ */
+static void
+_theme_attrs_reset(void)
+{
+    memset(theme_attrs_cached, 0, sizeof(theme_attrs_cached));
+}
+
+static int
+_theme_resolve_attrs(theme_item_t attrs)
 {
     int result = 0;
 
@@ -43,8 +43,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <stdarg.h>
 
 #include "log.h"
+#include "stats.h"
 #include "common.h"
 #include "config/files.h"
 #include "database.h"
@@ -52,18 +54,205 @@
 #include "ui/ui.h"
 #include "xmpp/xmpp.h"
 #include "xmpp/message.h"
+#include "tools/compress.h"
 
 static sqlite3* g_chatlog_database;
 
+// Statements used for every logged message, prepared once and reused
+typedef enum {
+    DB_STMT_LMC_CHECK,
+    DB_STMT_DUPLICATE_CHECK,
+    DB_STMT_INSERT,
+    DB_STMT_IMPORT_CHECK,
+    DB_STMT_COUNT
+} db_stmt_t;
+
+static const char* const db_stmt_sql[DB_STMT_COUNT] = {
+    [DB_STMT_LMC_CHECK] = "SELECT `id`, `from_jid`, `replaces_db_id` FROM `ChatLogs` WHERE `stanza_id` = ? ORDER BY `timestamp` DESC LIMIT 1",
+    [DB_STMT_DUPLICATE_CHECK] = "SELECT 1 FROM `ChatLogs` WHERE (`archive_id` = ?)",
+    [DB_STMT_INSERT] = "INSERT INTO `ChatLogs` "
+                       "(`from_jid`, `from_resource`, `to_jid`, `to_resource`, "
+                       "`message`, `timestamp`, `stanza_id`, `archive_id`, "
+                       "`replaces_db_id`, `replace_id`, `type`, `encryption`) "
+                       "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)",
+    // same second, flat-file logs and the database take the time separately
+    [DB_STMT_IMPORT_CHECK] = "SELECT 1 FROM `ChatLogs` WHERE `timestamp` >= ?1 AND `timestamp` < ?1 || '~' "
+                             "AND (`from_jid` = ?2 OR `to_jid` = ?2) AND `message` IS ?3 LIMIT 1",
+};
+
+static sqlite3_stmt* db_stmts[DB_STMT_COUNT];
+
+// Messages are written by a dedicated thread on its own connection so a slow
+// disk never stalls the UI. The database is in WAL mode, so the main
+// connection keeps reading history while the writer commits.
+#define DB_WRITE_QUEUE_MAX 10000
+
+typedef struct db_write_job_t
+{
+    gchar* from_barejid;
+    gchar* from_resource;
+    gchar* to_barejid;
+    gchar* to_resource;
+    gchar* sender; // full jid, for error reporting
+    gchar* message;
+    gchar* timestamp;
+    gchar* stanza_id;
+    gchar* archive_id;
+    gchar* replace_id;
+    gchar* type;
+    gchar* enc;
+    gboolean is_mam;
+    gint64 queued_at;
+    struct db_maintenance_t* maintenance; // instead of a message
+    struct db_import_t* import; // instead of a message
+} DbWriteJob;
+
+static sqlite3* g_writer_database;
+static GThread* writer_thread;
+static GAsyncQueue* write_queue;
+static DbWriteJob writer_stop;
+
+// Rows logged before full-text search was set up are indexed by the writer
+// in chunks of this many ids whenever it has nothing else to do
+#define DB_FTS_BACKFILL_CHUNK 1000
+
+static sqlite_int64 fts_backfill_next;
+static sqlite_int64 fts_backfill_until;
+
+// Retention, archiving and vacuuming are queued to the writer every hour and
+// done in transactions of this many rows whenever it has nothing else to do
+#define DB_MAINTENANCE_INTERVAL (60 * 60)
+#define DB_MAINTENANCE_CHUNK    1000
+#define DB_VACUUM_PAGES         1000
+
+#define DB_CHATLOGS_COLUMNS "`id`, `from_jid`, `to_jid`, `from_resource`, `to_resource`, `message`, `timestamp`, `type`, " \
+                            "`stanza_id`, `archive_id`, `encryption`, `marked_read`, `replace_id`, `replaces_db_id`, `replaced_by_db_id`"
+
+// `Conversations` has the first and last message of every pair of jids, kept
+// current by a trigger on insert and rebuilt after retention drops messages.
+// The jids are stored in sorted order, so either direction finds the pair.
+#define DB_CONVERSATIONS_REBUILD                                                                                                  \
+    "DELETE FROM main.`Conversations`;"                                                                                           \
+    "INSERT INTO main.`Conversations` (`jid_a`, `jid_b`, `first_timestamp`, `last_timestamp`, `message_count`) "                  \
+    "SELECT MIN(`from_jid`, `to_jid`) AS a, MAX(`from_jid`, `to_jid`) AS b, MIN(`timestamp`), MAX(`timestamp`), COUNT(*) "        \
+    "FROM `ChatLogsAll` WHERE `from_jid` IS NOT NULL AND `to_jid` IS NOT NULL AND `timestamp` IS NOT NULL GROUP BY a, b;"        \
+    "UPDATE main.`Conversations` SET "                                                                                            \
+    "`first_archive_id` = (SELECT `archive_id` FROM `ChatLogsAll` WHERE ((`from_jid` = `jid_a` AND `to_jid` = `jid_b`) "          \
+    "OR (`from_jid` = `jid_b` AND `to_jid` = `jid_a`)) AND `timestamp` = `first_timestamp` LIMIT 1), "                            \
+    "`last_archive_id` = (SELECT `archive_id` FROM `ChatLogsAll` WHERE ((`from_jid` = `jid_a` AND `to_jid` = `jid_b`) "           \
+    "OR (`from_jid` = `jid_b` AND `to_jid` = `jid_a`)) AND `timestamp` = `last_timestamp` LIMIT 1);"
+
+typedef struct db_retention_t
+{
+    gchar* barejid; // NULL for everyone without a policy of their own
+    gchar* before; // drop messages older than this
+    int keep; // otherwise keep the newest messages
+} DbRetention;
+
+typedef enum {
+    DB_MAINTENANCE_RETENTION,
+    DB_MAINTENANCE_ARCHIVE,
+    DB_MAINTENANCE_VACUUM
+} db_maintenance_stage_t;
+
+typedef struct db_maintenance_t
+{
+    db_maintenance_stage_t stage;
+    GSList* retention; // policies still to apply
+    gchar* exempt; // SQL list of the jids with a policy of their own
+    gchar* archive_before;
+    gchar* vacuum_path; // full VACUUM requested
+} DbMaintenance;
+
+// Importing the flat-file logs written by chatlog.c. The writer walks the
+// account's log directory one file at a time while it is idle, each file is
+// memory mapped and inserted in one transaction.
+#define DB_IMPORT_REPORT_FILES 500
+
+typedef enum {
+    DB_IMPORT_DIR_ACCOUNT,
+    DB_IMPORT_DIR_ROOMS,
+    DB_IMPORT_DIR_CONTACT
+} db_import_dir_t;
+
+typedef struct db_import_level_t
+{
+    GDir* dir;
+    gchar* path;
+    db_import_dir_t type;
+    gchar* contact; // barejid the logs are with, for DB_IMPORT_DIR_CONTACT
+    gboolean is_room;
+} DbImportLevel;
+
+typedef struct db_import_t
+{
+    gchar* myjid;
+    GSList* levels; // innermost directory first
+    guint files;
+    guint imported;
+    guint duplicates;
+} DbImport;
+
+// Old rows can be moved to a second file attached as `archive`, reads go
+// through the `ChatLogsAll` view which spans both
+static gchar* db_path;
+static gchar* archive_path;
+static gboolean writer_archive;
+static guint maintenance_source;
+
+// Scrolling up through history, keyed on (timestamp, id) so messages with
+// the same timestamp are neither skipped nor repeated. The next page is
+// prefetched once the current one was handed out.
+struct prof_history_cursor_t
+{
+    gchar* contact_barejid;
+    gchar* timestamp; // position after everything fetched, NULL for newest
+    sqlite_int64 id;
+    GDateTime* oldest; // oldest message handed out
+    GSList* prefetched;
+    guint prefetch_source;
+    int page_size; // rows of the next fetch, grows while paging back
+    int max_page;
+};
+
+static sqlite3_stmt* history_stmt;
+
 static void _add_to_db(ProfMessage* message, char* type, const Jid* const from_jid, const Jid* const to_jid);
 static char* _get_db_filename(ProfAccount* account);
 static prof_msg_type_t _get_message_type_type(const char* const type);
 static prof_enc_t _get_message_enc_type(const char* const encstr);
 static int _get_db_version(void);
 static gboolean _migrate_to_v2(void);
+static gboolean _migrate_to_v3(void);
+static gboolean _migrate_to_v4(void);
+static gboolean _migrate_to_v5(void);
+static gboolean _fts_backfill_load(void);
+static gboolean _fts_backfill_chunk(void);
 static gboolean _check_available_space_for_db_migration(char* path_to_db);
-
-static const int latest_version = 2;
+static sqlite3_stmt* _get_stmt(db_stmt_t which);
+static void _finalize_stmts(void);
+static gboolean _writer_start(const char* const filename, int db_version);
+static void _writer_stop(void);
+static gpointer _writer_run(gpointer data);
+static void _writer_exec(const char* const query);
+static void _writer_write(DbWriteJob* job);
+static void _writer_show_error(const char* const fmt, ...);
+static gboolean _writer_show_error_cb(gpointer data);
+static void _writer_show_info(const char* const fmt, ...);
+static gboolean _writer_show_info_cb(gpointer data);
+static void _free_write_job(DbWriteJob* job);
+static GSList* _history_fetch(ProfHistoryCursor* cursor);
+static gboolean _history_prefetch_cb(gpointer data);
+static void _archive_open(ProfAccount* account);
+static gboolean _attach_archive(sqlite3* db, const char* const path);
+static void _create_view(sqlite3* db, gboolean archive);
+static gboolean _maintenance_cb(gpointer data);
+static gboolean _maintenance_step(DbMaintenance* maintenance);
+static void _maintenance_free(DbMaintenance* maintenance);
+static gboolean _import_step(DbImport* import);
+static void _import_free(DbImport* import);
+
+static const int latest_version = 5;
 
 static char*
 _db_strdup(const char* str)
@@ -90,6 +279,9 @@ _get_db_filename(ProfAccount* account)
 gboolean
 log_database_init(ProfAccount* account)
 {
+    // reconnecting without a disconnect must not leave a writer thread behind
+    log_database_close();
+
     int ret = sqlite3_initialize();
     if (ret != SQLITE_OK) {
         log_error("Error initializing SQLite database: %d", ret);
@@ -107,12 +299,26 @@ log_database_init(ProfAccount* account)
         log_error("Error opening SQLite database: %s", err_msg);
         return FALSE;
     }
+    sqlite3_busy_timeout(g_chatlog_database, 5000);
 
     char* err_msg;
 
+    if (SQLITE_OK != sqlite3_exec(g_chatlog_database, "PRAGMA journal_mode=WAL;", NULL, 0, &err_msg)) {
+        log_warning("Unable to switch chat log database to WAL mode: %s", err_msg);
+        sqlite3_free(err_msg);
+        err_msg = NULL;
+    }
+
     int db_version = _get_db_version();
     if (db_version == latest_version) {
-        return TRUE;
+        _archive_open(account);
+        return _writer_start(filename, db_version);
+    }
+
+    // only takes effect on a new database, where deleted rows can then be
+    // given back to the file system a few pages at a time
+    if (SQLITE_OK != sqlite3_exec(g_chatlog_database, "PRAGMA auto_vacuum = INCREMENTAL;", NULL, 0, &err_msg)) {
+        goto out;
     }
 
     // ChatLogs Table
@@ -184,7 +390,19 @@ log_database_init(ProfAccount* account)
     }
 
     if (db_version == -1) {
-        query = "INSERT OR IGNORE INTO `DbVersion` (`version`) VALUES ('2')";
+        query = "CREATE INDEX IF NOT EXISTS ChatLogs_archive_id_IDX ON `ChatLogs` (`archive_id`)";
+        if (SQLITE_OK != sqlite3_exec(g_chatlog_database, query, NULL, 0, &err_msg)) {
+            log_error("Unable to create index for archive_id.");
+            goto out;
+        }
+        query = "CREATE INDEX IF NOT EXISTS ChatLogs_stanza_id_IDX ON `ChatLogs` (`stanza_id`)";
+        if (SQLITE_OK != sqlite3_exec(g_chatlog_database, query, NULL, 0, &err_msg)) {
+            log_error("Unable to create index for stanza_id.");
+            goto out;
+        }
+
+        // full-text search is set up by the writer, see _migrate_to_v4()
+        query = "INSERT OR IGNORE INTO `DbVersion` (`version`) VALUES ('3')";
         if (SQLITE_OK != sqlite3_exec(g_chatlog_database, query, NULL, 0, &err_msg)) {
             goto out;
         }
@@ -197,9 +415,9 @@ log_database_init(ProfAccount* account)
         goto out;
     }
 
-    if (db_version < latest_version) {
+    if (db_version < 2) {
         cons_show("Migrating database schema. This operation may take a while...");
-        if (db_version < 2 && (!_check_available_space_for_db_migration(filename) || !_migrate_to_v2())) {
+        if (!_check_available_space_for_db_migration(filename) || !_migrate_to_v2()) {
             cons_show_error("Database Initialization Error: Unable to migrate database to version 2. Please, check error logs for details.");
             goto out;
         }
@@ -207,7 +425,10 @@ log_database_init(ProfAccount* account)
     }
 
     log_debug("Initialized SQLite database: %s", filename);
-    return TRUE;
+
+    // later versions only add indexes, the writer builds them in the background
+    _archive_open(account);
+    return _writer_start(filename, db_version);
 
 out:
     if (err_msg) {
@@ -223,10 +444,251 @@ void
 log_database_close(void)
 {
     if (g_chatlog_database) {
+        if (maintenance_source) {
+            g_source_remove(maintenance_source);
+            maintenance_source = 0;
+        }
+        _writer_stop();
+        sqlite3_finalize(history_stmt);
+        history_stmt = NULL;
         sqlite3_close(g_chatlog_database);
         sqlite3_shutdown();
         g_chatlog_database = NULL;
+        g_free(db_path);
+        db_path = NULL;
+        g_free(archive_path);
+        archive_path = NULL;
+    }
+}
+
+// Opens the archive if archiving is on or there is one from before, and
+// creates the view reads go through
+static void
+_archive_open(ProfAccount* account)
+{
+    auto_char char* path = files_file_in_account_data_path(DIR_DATABASE, account->jid, "chatlog-archive.db");
+    if (!path || (prefs_get_db_archive() == 0 && !g_file_test(path, G_FILE_TEST_EXISTS)) || !_attach_archive(g_chatlog_database, path)) {
+        _create_view(g_chatlog_database, FALSE);
+        return;
+    }
+
+    // same columns as `ChatLogs`, ids are kept when rows are moved over
+    const char* const schema[] = {
+        "PRAGMA archive.auto_vacuum = INCREMENTAL;",
+        "PRAGMA archive.journal_mode = WAL;",
+        "CREATE TABLE IF NOT EXISTS archive.`ChatLogs` ("
+        "`id` INTEGER PRIMARY KEY, "
+        "`from_jid` TEXT NOT NULL, "
+        "`to_jid` TEXT NOT NULL, "
+        "`from_resource` TEXT, "
+        "`to_resource` TEXT, "
+        "`message` TEXT, "
+        "`timestamp` TEXT, "
+        "`type` TEXT, "
+        "`stanza_id` TEXT, "
+        "`archive_id` TEXT, "
+        "`encryption` TEXT, "
+        "`marked_read` INTEGER, "
+        "`replace_id` TEXT, "
+        "`replaces_db_id` INTEGER, "
+        "`replaced_by_db_id` INTEGER);",
+        "CREATE INDEX IF NOT EXISTS archive.ChatLogs_timestamp_IDX ON `ChatLogs` (`timestamp`);",
+        "CREATE INDEX IF NOT EXISTS archive.ChatLogs_to_from_jid_IDX ON `ChatLogs` (`to_jid`, `from_jid`);"
+    };
+
+    char* err_msg = NULL;
+    for (unsigned int i = 0; i < ARRAY_SIZE(schema); i++) {
+        if (SQLITE_OK != sqlite3_exec(g_chatlog_database, schema[i], NULL, 0, &err_msg)) {
+            log_error("SQLite error setting up chat log archive on statement %u: %s", i, err_msg ? err_msg : "unknown");
+            sqlite3_free(err_msg);
+            sqlite3_exec(g_chatlog_database, "DETACH DATABASE archive;", NULL, 0, NULL);
+            _create_view(g_chatlog_database, FALSE);
+            return;
+        }
+    }
+
+    archive_path = g_strdup(path);
+    _create_view(g_chatlog_database, TRUE);
+}
+
+static gboolean
+_attach_archive(sqlite3* db, const char* const path)
+{
+    auto_sqlite char* attach = sqlite3_mprintf("ATTACH DATABASE %Q AS archive;", path);
+    if (SQLITE_OK != sqlite3_exec(db, attach, NULL, 0, NULL)) {
+        log_error("Unable to attach chat log archive %s: %s", path, sqlite3_errmsg(db));
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+// `ChatLogsAll` spans the main database and the archive when it is attached
+static void
+_create_view(sqlite3* db, gboolean archive)
+{
+    const char* query = archive ? "CREATE TEMP VIEW IF NOT EXISTS `ChatLogsAll` AS "
+                                  "SELECT " DB_CHATLOGS_COLUMNS " FROM main.`ChatLogs` "
+                                  "UNION ALL SELECT " DB_CHATLOGS_COLUMNS " FROM archive.`ChatLogs`;"
+                                : "CREATE TEMP VIEW IF NOT EXISTS `ChatLogsAll` AS "
+                                  "SELECT " DB_CHATLOGS_COLUMNS " FROM main.`ChatLogs`;";
+    if (SQLITE_OK != sqlite3_exec(db, query, NULL, 0, NULL)) {
+        log_error("SQLite error creating chat log view: %s", sqlite3_errmsg(db));
+    }
+}
+
+// "<n>d" keeps n days of messages, "<n>" the newest n messages
+static DbRetention*
+_retention_new(const char* const barejid, const char* const policy, GDateTime* now)
+{
+    if (!policy) {
+        return NULL;
+    }
+
+    char* end = NULL;
+    gint64 count = g_ascii_strtoll(policy, &end, 10);
+    if (end == policy || count <= 0 || count > G_MAXINT || (*end != '\0' && g_strcmp0(end, "d") != 0)) {
+        log_warning("Ignoring invalid chat log retention \"%s\" for %s", policy, barejid ? barejid : "all contacts");
+        return NULL;
+    }
+
+    DbRetention* retention = g_new0(DbRetention, 1);
+    retention->barejid = g_strdup(barejid);
+    if (*end == 'd') {
+        GDateTime* before = g_date_time_add_days(now, -count);
+        retention->before = g_date_time_format_iso8601(before);
+        g_date_time_unref(before);
+    } else {
+        retention->keep = count;
+    }
+
+    return retention;
+}
+
+static void
+_retention_free(DbRetention* retention)
+{
+    g_free(retention->barejid);
+    g_free(retention->before);
+    g_free(retention);
+}
+
+static void
+_maintenance_free(DbMaintenance* maintenance)
+{
+    if (!maintenance) {
+        return;
+    }
+
+    g_slist_free_full(maintenance->retention, (GDestroyNotify)_retention_free);
+    g_free(maintenance->exempt);
+    g_free(maintenance->archive_before);
+    g_free(maintenance->vacuum_path);
+    g_free(maintenance);
+}
+
+// Queues retention, archiving and vacuuming to the writer, which does them
+// once it is idle. vacuum asks for a full VACUUM of the main database too.
+void
+log_database_maintenance(gboolean vacuum)
+{
+    if (!write_queue) {
+        return;
+    }
+
+    DbMaintenance* maintenance = g_new0(DbMaintenance, 1);
+    GDateTime* now = g_date_time_new_now_local();
+
+    // a contact's own policy replaces the default one
+    GString* exempt = g_string_new(NULL);
+    GList* jids = prefs_get_db_retention_jids();
+    for (GList* curr = jids; curr; curr = g_list_next(curr)) {
+        auto_gchar gchar* policy = prefs_get_db_retention(curr->data);
+        DbRetention* retention = _retention_new(curr->data, policy, now);
+        if (retention) {
+            maintenance->retention = g_slist_append(maintenance->retention, retention);
+        }
+        auto_sqlite char* quoted = sqlite3_mprintf("%Q", curr->data);
+        g_string_append_printf(exempt, "%s%s", exempt->len ? ", " : "", quoted);
+    }
+    g_list_free_full(jids, g_free);
+    maintenance->exempt = g_string_free(exempt, FALSE);
+
+    // counting messages needs a contact, the default can only be an age
+    auto_gchar gchar* policy = prefs_get_db_retention(NULL);
+    DbRetention* retention = _retention_new(NULL, policy, now);
+    if (retention && retention->before) {
+        maintenance->retention = g_slist_append(maintenance->retention, retention);
+    } else if (retention) {
+        log_warning("Ignoring chat log retention \"%s\", the default retention must be in days", policy);
+        _retention_free(retention);
+    }
+
+    int archive_days = prefs_get_db_archive();
+    if (archive_days > 0 && archive_path) {
+        GDateTime* before = g_date_time_add_days(now, -archive_days);
+        maintenance->archive_before = g_date_time_format_iso8601(before);
+        g_date_time_unref(before);
+    }
+    g_date_time_unref(now);
+
+    maintenance->vacuum_path = vacuum ? g_strdup(db_path) : NULL;
+
+    DbWriteJob* job = g_new0(DbWriteJob, 1);
+    job->maintenance = maintenance;
+    g_async_queue_push(write_queue, job);
+}
+
+// Queues an import of the flat-file chat logs of the connected account,
+// progress is shown in the console
+void
+log_database_import_chatlogs(void)
+{
+    const Jid* myjid = connection_get_jid();
+    if (!write_queue || !myjid || !myjid->barejid) {
+        return;
+    }
+
+    gchar* root = files_get_account_data_path(DIR_CHATLOGS, myjid->barejid);
+    GDir* dir = g_dir_open(root, 0, NULL);
+    if (!dir) {
+        cons_show("No chat logs found in %s.", root);
+        g_free(root);
+        return;
     }
+
+    DbImportLevel* level = g_new0(DbImportLevel, 1);
+    level->dir = dir;
+    level->path = root;
+    level->type = DB_IMPORT_DIR_ACCOUNT;
+
+    DbImport* import = g_new0(DbImport, 1);
+    import->myjid = g_strdup(myjid->barejid);
+    import->levels = g_slist_prepend(NULL, level);
+
+    DbWriteJob* job = g_new0(DbWriteJob, 1);
+    job->import = import;
+    g_async_queue_push(write_queue, job);
+}
+
+gboolean
+log_database_archive_attached(void)
+{
+    return archive_path != NULL;
+}
+
+static gboolean
+_maintenance_cb(gpointer data)
+{
+    log_database_maintenance(FALSE);
+
+    return TRUE;
+}
+
+int
+log_database_queue_depth(void)
+{
+    return write_queue ? MAX(g_async_queue_length(write_queue), 0) : 0;
 }
 
 void
@@ -283,19 +745,31 @@ log_database_get_limits_info(const gchar* const contact_barejid, gboolean is_las
     if (!myjid->str)
         return NULL;
 
-    const char* order = is_last ? "DESC" : "ASC";
-    auto_sqlite char* query = sqlite3_mprintf("SELECT `archive_id`, `timestamp` FROM `ChatLogs` WHERE "
-                                              "(`from_jid` = %Q AND `to_jid` = %Q) OR "
-                                              "(`from_jid` = %Q AND `to_jid` = %Q) "
-                                              "ORDER BY `timestamp` %s LIMIT 1;",
-                                              contact_barejid, myjid->barejid, myjid->barejid, contact_barejid, order);
+    const char* limit = is_last ? "last" : "first";
+    auto_sqlite char* query = sqlite3_mprintf("SELECT `%s_archive_id`, `%s_timestamp` FROM `Conversations` "
+                                              "WHERE `jid_a` = MIN(%Q, %Q) AND `jid_b` = MAX(%Q, %Q);",
+                                              limit, limit, contact_barejid, myjid->barejid, contact_barejid, myjid->barejid);
 
     if (!query) {
         log_error("Could not allocate memory for SQL query in log_database_get_limits_info()");
         return NULL;
     }
 
+    // the summary is missing until the writer has migrated the database
     int rc = sqlite3_prepare_v2(g_chatlog_database, query, -1, &stmt, NULL);
+    if (rc != SQLITE_OK) {
+        const char* order = is_last ? "DESC" : "ASC";
+        auto_sqlite char* scan = sqlite3_mprintf("SELECT `archive_id`, `timestamp` FROM `ChatLogsAll` WHERE "
+                                                 "(`from_jid` = %Q AND `to_jid` = %Q) OR "
+                                                 "(`from_jid` = %Q AND `to_jid` = %Q) "
+                                                 "ORDER BY `timestamp` %s LIMIT 1;",
+                                                 contact_barejid, myjid->barejid, myjid->barejid, contact_barejid, order);
+        if (!scan) {
+            log_error("Could not allocate memory for SQL query in log_database_get_limits_info()");
+            return NULL;
+        }
+        rc = sqlite3_prepare_v2(g_chatlog_database, scan, -1, &stmt, NULL);
+    }
     if (rc != SQLITE_OK) {
         log_error("Unknown SQLite error in log_database_get_last_info().");
         return NULL;
@@ -332,9 +806,8 @@ log_database_get_previous_chat(const gchar* const contact_barejid, const char* s
     GDateTime* now = g_date_time_new_now_local();
     auto_gchar gchar* end_date_fmt = end_time ? end_time : g_date_time_format_iso8601(now);
     auto_sqlite gchar* query = sqlite3_mprintf("SELECT * FROM ("
-                                               "SELECT COALESCE(B.`message`, A.`message`) AS message, "
-                                               "A.`timestamp`, A.`from_jid`, A.`to_jid`, A.`type`, A.`encryption`, A.`stanza_id` FROM `ChatLogs` AS A "
-                                               "LEFT JOIN `ChatLogs` AS B ON (A.`replaced_by_db_id` = B.`id` AND A.`from_jid` = B.`from_jid`) "
+                                               "SELECT COALESCE((SELECT B.`message` FROM `ChatLogsAll` AS B WHERE B.`id` = A.`replaced_by_db_id` AND B.`from_jid` = A.`from_jid`), A.`message`) AS message, "
+                                               "A.`timestamp`, A.`from_jid`, A.`to_jid`, A.`type`, A.`encryption`, A.`stanza_id` FROM `ChatLogsAll` AS A "
                                                "WHERE (A.`replaces_db_id` IS NULL) "
                                                "AND ((A.`from_jid` = %Q AND A.`to_jid` = %Q) OR (A.`from_jid` = %Q AND A.`to_jid` = %Q)) "
                                                "AND A.`timestamp` < %Q "
@@ -383,6 +856,233 @@ log_database_get_previous_chat(const gchar* const contact_barejid, const char* s
     return history;
 }
 
+// Pages start at MESSAGES_TO_RETRIEVE so the first screenful is quick, and
+// double with every page after it up to max_page and the /mam pagesize.
+ProfHistoryCursor*
+log_database_history_cursor_new(const gchar* const contact_barejid, int max_page)
+{
+    ProfHistoryCursor* cursor = g_new0(ProfHistoryCursor, 1);
+    cursor->contact_barejid = g_strdup(contact_barejid);
+    cursor->id = -1;
+    cursor->page_size = MESSAGES_TO_RETRIEVE;
+    cursor->max_page = max_page;
+
+    return cursor;
+}
+
+void
+log_database_history_cursor_free(ProfHistoryCursor* cursor)
+{
+    if (!cursor) {
+        return;
+    }
+
+    if (cursor->prefetch_source) {
+        g_source_remove(cursor->prefetch_source);
+    }
+    g_slist_free_full(cursor->prefetched, (GDestroyNotify)message_free);
+    if (cursor->oldest) {
+        g_date_time_unref(cursor->oldest);
+    }
+    g_free(cursor->timestamp);
+    g_free(cursor->contact_barejid);
+    g_free(cursor);
+}
+
+// Returns the page of messages older than oldest_shown, oldest first. The
+// cursor continues where it left off as long as oldest_shown is the last
+// message it returned, otherwise it restarts from oldest_shown.
+GSList*
+log_database_history_cursor_prev(ProfHistoryCursor* cursor, GDateTime* oldest_shown)
+{
+    if (!cursor->oldest || !oldest_shown || !g_date_time_equal(cursor->oldest, oldest_shown)) {
+        if (cursor->prefetch_source) {
+            g_source_remove(cursor->prefetch_source);
+            cursor->prefetch_source = 0;
+        }
+        g_slist_free_full(cursor->prefetched, (GDestroyNotify)message_free);
+        cursor->prefetched = NULL;
+        g_free(cursor->timestamp);
+        cursor->timestamp = oldest_shown ? g_date_time_format_iso8601(oldest_shown) : NULL;
+        cursor->id = -1;
+        cursor->page_size = MESSAGES_TO_RETRIEVE;
+    }
+
+    GSList* page = cursor->prefetched;
+    cursor->prefetched = NULL;
+    if (cursor->prefetch_source) {
+        g_source_remove(cursor->prefetch_source);
+        cursor->prefetch_source = 0;
+        page = _history_fetch(cursor);
+    } else if (!page) {
+        page = _history_fetch(cursor);
+    }
+
+    if (page) {
+        if (cursor->oldest) {
+            g_date_time_unref(cursor->oldest);
+        }
+        cursor->oldest = g_date_time_ref(((ProfMessage*)page->data)->timestamp);
+        cursor->prefetch_source = g_idle_add(_history_prefetch_cb, cursor);
+    }
+
+    return page;
+}
+
+static gboolean
+_history_prefetch_cb(gpointer data)
+{
+    ProfHistoryCursor* cursor = data;
+    cursor->prefetch_source = 0;
+    cursor->prefetched = _history_fetch(cursor);
+
+    return FALSE;
+}
+
+// fetches the page below the cursor's position, oldest first, and moves the
+// position past it
+static GSList*
+_history_fetch(ProfHistoryCursor* cursor)
+{
+    const Jid* myjid = connection_get_jid();
+    if (!g_chatlog_database || !myjid || !myjid->str) {
+        return NULL;
+    }
+
+    if (!history_stmt) {
+        // corrections are looked up by id rather than joined, a join is not
+        // flattened into the view over both files
+        const char* query = "SELECT COALESCE((SELECT B.`message` FROM `ChatLogsAll` AS B WHERE B.`id` = A.`replaced_by_db_id` AND B.`from_jid` = A.`from_jid`), A.`message`) AS message, "
+                            "A.`timestamp`, A.`from_jid`, A.`to_jid`, A.`type`, A.`encryption`, A.`stanza_id`, A.`id` FROM `ChatLogsAll` AS A "
+                            "WHERE (A.`replaces_db_id` IS NULL) "
+                            "AND ((A.`from_jid` = ?1 AND A.`to_jid` = ?2) OR (A.`from_jid` = ?2 AND A.`to_jid` = ?1)) "
+                            "AND (?3 IS NULL OR (A.`timestamp`, A.`id`) < (?3, ?4)) "
+                            "ORDER BY A.`timestamp` DESC, A.`id` DESC LIMIT ?5";
+        if (sqlite3_prepare_v2(g_chatlog_database, query, -1, &history_stmt, NULL) != SQLITE_OK) {
+            log_error("SQLite error in _history_fetch(): %s", sqlite3_errmsg(g_chatlog_database));
+            history_stmt = NULL;
+            return NULL;
+        }
+    }
+
+    sqlite3_bind_text(history_stmt, 1, cursor->contact_barejid, -1, SQLITE_STATIC);
+    sqlite3_bind_text(history_stmt, 2, myjid->barejid, -1, SQLITE_STATIC);
+    sqlite3_bind_text(history_stmt, 3, cursor->timestamp, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(history_stmt, 4, cursor->id);
+    sqlite3_bind_int(history_stmt, 5, cursor->page_size);
+
+    GSList* page = NULL;
+    gchar* last_timestamp = NULL;
+    sqlite_int64 last_id = -1;
+
+    while (sqlite3_step(history_stmt) == SQLITE_ROW) {
+        char* message = (char*)sqlite3_column_text(history_stmt, 0);
+        char* date = (char*)sqlite3_column_text(history_stmt, 1);
+        char* from = (char*)sqlite3_column_text(history_stmt, 2);
+        char* to_jid = (char*)sqlite3_column_text(history_stmt, 3);
+        char* type = (char*)sqlite3_column_text(history_stmt, 4);
+        char* encryption = (char*)sqlite3_column_text(history_stmt, 5);
+        char* id = (char*)sqlite3_column_text(history_stmt, 6);
+
+        ProfMessage* msg = message_init();
+        msg->id = id ? strdup(id) : NULL;
+        msg->from_jid = jid_create(from);
+        msg->to_jid = jid_create(to_jid);
+        msg->plain = strdup(message ?: "");
+        msg->timestamp = g_date_time_new_from_iso8601(date, NULL);
+        msg->type = _get_message_type_type(type);
+        msg->enc = _get_message_enc_type(encryption);
+
+        g_free(last_timestamp);
+        last_timestamp = g_strdup(date);
+        last_id = sqlite3_column_int64(history_stmt, 7);
+
+        if (!msg->timestamp || !msg->from_jid) {
+            message_free(msg);
+            continue;
+        }
+
+        // rows come newest first
+        page = g_slist_prepend(page, msg);
+    }
+    sqlite3_reset(history_stmt);
+    sqlite3_clear_bindings(history_stmt);
+
+    if (last_timestamp) {
+        g_free(cursor->timestamp);
+        cursor->timestamp = last_timestamp;
+        cursor->id = last_id;
+    }
+
+    int max_page = MIN(cursor->max_page, prefs_get_mam_pagesize());
+    cursor->page_size = MAX(MESSAGES_TO_RETRIEVE, MIN(cursor->page_size * 2, max_page));
+
+    return page;
+}
+
+// Full-text search over all logged messages, best matches first
+GSList*
+log_database_search(const char* const text, int limit)
+{
+    if (!g_chatlog_database) {
+        return NULL;
+    }
+
+    // quote every word so user input is never parsed as FTS5 query syntax
+    GString* match = g_string_new(NULL);
+    auto_gcharv gchar** words = g_strsplit_set(text, " \t", -1);
+    for (int i = 0; words[i]; i++) {
+        if (words[i][0] == '\0') {
+            continue;
+        }
+        auto_char char* escaped = str_replace(words[i], "\"", "\"\"");
+        g_string_append_printf(match, "%s\"%s\"", match->len ? " " : "", escaped);
+    }
+    auto_gchar gchar* match_str = g_string_free(match, FALSE);
+    if (match_str[0] == '\0') {
+        return NULL;
+    }
+
+    const char* query = "SELECT C.`message`, C.`timestamp`, C.`from_jid`, C.`to_jid`, C.`type`, C.`encryption`, C.`stanza_id` "
+                        "FROM `ChatLogsFTS` JOIN `ChatLogs` AS C ON C.`id` = `ChatLogsFTS`.rowid "
+                        "WHERE `ChatLogsFTS` MATCH ? AND C.`replaced_by_db_id` IS NULL "
+                        "ORDER BY rank LIMIT ?";
+
+    sqlite3_stmt* stmt = NULL;
+    if (sqlite3_prepare_v2(g_chatlog_database, query, -1, &stmt, NULL) != SQLITE_OK) {
+        log_error("SQLite error in log_database_search(): %s", sqlite3_errmsg(g_chatlog_database));
+        return NULL;
+    }
+    sqlite3_bind_text(stmt, 1, match_str, -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 2, limit);
+
+    GSList* results = NULL;
+
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        char* message = (char*)sqlite3_column_text(stmt, 0);
+        char* date = (char*)sqlite3_column_text(stmt, 1);
+        char* from = (char*)sqlite3_column_text(stmt, 2);
+        char* to_jid = (char*)sqlite3_column_text(stmt, 3);
+        char* type = (char*)sqlite3_column_text(stmt, 4);
+        char* encryption = (char*)sqlite3_column_text(stmt, 5);
+        char* id = (char*)sqlite3_column_text(stmt, 6);
+
+        ProfMessage* msg = message_init();
+        msg->id = id ? strdup(id) : NULL;
+        msg->from_jid = jid_create(from);
+        msg->to_jid = jid_create(to_jid);
+        msg->plain = strdup(message ?: "");
+        msg->timestamp = date ? g_date_time_new_from_iso8601(date, NULL) : NULL;
+        msg->type = _get_message_type_type(type);
+        msg->enc = _get_message_enc_type(encryption);
+
+        results = g_slist_append(results, msg);
+    }
+    sqlite3_finalize(stmt);
+
+    return results;
+}
+
 static const char*
 _get_message_type_str(prof_msg_type_t type)
 {
@@ -452,7 +1152,6 @@ static void
 _add_to_db(ProfMessage* message, char* type, const Jid* const from_jid, const Jid* const to_jid)
 {
     auto_gchar gchar* pref_dblog = prefs_get_string(PREF_DBLOG);
-    sqlite_int64 original_message_id = -1;
 
     if (g_strcmp0(pref_dblog, "off") == 0) {
         return;
@@ -463,126 +1162,355 @@ _add_to_db(ProfMessage* message, char* type, const Jid* const from_jid, const Ji
         message->plain = strdup("[REDACTED]");
     }
 
-    if (!g_chatlog_database) {
+    if (!write_queue) {
         log_debug("log_database_add() called but db is not initialized");
         return;
     }
 
-    char* err_msg;
-    auto_gchar gchar* date_fmt = NULL;
+    DbWriteJob* job = g_new0(DbWriteJob, 1);
 
     if (message->timestamp) {
-        date_fmt = g_date_time_format_iso8601(message->timestamp);
+        job->timestamp = g_date_time_format_iso8601(message->timestamp);
     } else {
         GDateTime* dt = g_date_time_new_now_local();
-        date_fmt = g_date_time_format_iso8601(dt);
+        job->timestamp = g_date_time_format_iso8601(dt);
         g_date_time_unref(dt);
     }
 
-    const char* enc = _get_message_enc_str(message->enc);
-
     if (!type) {
         type = (char*)_get_message_type_str(message->type);
     }
 
-    // Apply LMC and check its validity (XEP-0308)
-    if (message->replace_id) {
-        auto_sqlite char* replace_check_query = sqlite3_mprintf("SELECT `id`, `from_jid`, `replaces_db_id` FROM `ChatLogs` WHERE `stanza_id` = %Q ORDER BY `timestamp` DESC LIMIT 1",
-                                                                message->replace_id);
+    job->from_barejid = g_strdup(from_jid->barejid);
+    job->from_resource = g_strdup(from_jid->resourcepart);
+    job->to_barejid = g_strdup(to_jid->barejid);
+    job->to_resource = g_strdup(to_jid->resourcepart);
+    job->sender = g_strdup(message->from_jid ? message->from_jid->fulljid : from_jid->fulljid);
+    job->message = g_strdup(message->plain);
+    job->stanza_id = g_strdup(message->id);
+    job->archive_id = g_strdup(message->stanzaid);
+    job->replace_id = g_strdup(message->replace_id);
+    job->type = g_strdup(type);
+    job->enc = g_strdup(_get_message_enc_str(message->enc));
+    job->is_mam = message->is_mam;
+    job->queued_at = g_get_monotonic_time();
+
+    // don't let a stuck disk grow the queue without bounds
+    while (g_async_queue_length(write_queue) >= DB_WRITE_QUEUE_MAX) {
+        g_usleep(G_USEC_PER_SEC / 100);
+    }
+    g_async_queue_push(write_queue, job);
+}
 
-        if (!replace_check_query) {
-            log_error("Could not allocate memory for SQL replace query in log_database_add()");
-            return;
-        }
+static gboolean
+_writer_start(const char* const filename, int db_version)
+{
+    if (SQLITE_OK != sqlite3_open(filename, &g_writer_database)) {
+        log_error("Error opening SQLite database for writing: %s", sqlite3_errmsg(g_writer_database));
+        sqlite3_close(g_writer_database);
+        g_writer_database = NULL;
+        return FALSE;
+    }
+    sqlite3_busy_timeout(g_writer_database, 5000);
 
-        sqlite3_stmt* lmc_stmt = NULL;
+    writer_archive = archive_path && _attach_archive(g_writer_database, archive_path);
+    _create_view(g_writer_database, writer_archive);
+    if (SQLITE_OK != sqlite3_exec(g_writer_database, "CREATE TEMP TABLE IF NOT EXISTS `MaintenanceIds` (`id` INTEGER PRIMARY KEY);", NULL, 0, NULL)) {
+        log_error("SQLite error creating maintenance table: %s", sqlite3_errmsg(g_writer_database));
+    }
 
-        if (SQLITE_OK != sqlite3_prepare_v2(g_chatlog_database, replace_check_query, -1, &lmc_stmt, NULL)) {
-            log_error("SQLite error in _add_to_db() on selecting original message: %s", sqlite3_errmsg(g_chatlog_database));
-            return;
-        }
+    g_free(db_path);
+    db_path = g_strdup(filename);
 
-        if (sqlite3_step(lmc_stmt) == SQLITE_ROW) {
-            original_message_id = sqlite3_column_int64(lmc_stmt, 0);
-            const char* from_jid_orig = (const char*)sqlite3_column_text(lmc_stmt, 1);
+    write_queue = g_async_queue_new();
+    writer_thread = g_thread_new("db-writer", _writer_run, GINT_TO_POINTER(db_version));
 
-            // Handle non-XEP-compliant replacement messages (edit->edit->original)
-            sqlite_int64 tmp = sqlite3_column_int64(lmc_stmt, 2);
-            original_message_id = tmp ? tmp : original_message_id;
+    log_database_maintenance(FALSE);
+    maintenance_source = g_timeout_add_seconds(DB_MAINTENANCE_INTERVAL, _maintenance_cb, NULL);
 
-            if (g_strcmp0(from_jid_orig, from_jid->barejid) != 0) {
-                log_error("Mismatch in sender JIDs when trying to do LMC. Corrected message sender: %s. Original message sender: %s. Replace-ID: %s. Message: %s", from_jid->barejid, from_jid_orig, message->replace_id, message->plain);
-                cons_show_error("%s sent a message correction with mismatched sender. See log for details.", from_jid->barejid);
-                sqlite3_finalize(lmc_stmt);
-                return;
-            }
-        } else {
-            log_warning("Got LMC message that does not have original message counterpart in the database from %s", message->from_jid->fulljid);
-        }
-        sqlite3_finalize(lmc_stmt);
+    return TRUE;
+}
+
+// writes out everything still queued before returning
+static void
+_writer_stop(void)
+{
+    if (!writer_thread) {
+        return;
     }
 
-    // stanza-id (XEP-0359) doesn't have to be present in the message.
-    // But if it's duplicated, it's a serious server-side problem, so we better track it.
-    // Unless it's MAM, in that case it's expected behaviour.
-    if (message->stanzaid && !message->is_mam) {
-        auto_sqlite char* duplicate_check_query = sqlite3_mprintf("SELECT 1 FROM `ChatLogs` WHERE (`archive_id` = %Q)",
-                                                                  message->stanzaid);
+    g_async_queue_push(write_queue, &writer_stop);
+    g_thread_join(writer_thread);
+    writer_thread = NULL;
 
-        if (!duplicate_check_query) {
-            log_error("Could not allocate memory for SQL duplicate query in log_database_add()");
+    g_async_queue_unref(write_queue);
+    write_queue = NULL;
+
+    _finalize_stmts();
+    sqlite3_close(g_writer_database);
+    g_writer_database = NULL;
+}
+
+static gpointer
+_writer_run(gpointer data)
+{
+    gboolean stop = FALSE;
+
+    int db_version = GPOINTER_TO_INT(data);
+
+    // messages queue up meanwhile, reads on the main connection continue
+    if (db_version < 3 && !_migrate_to_v3()) {
+        log_error("[DB Migration] Unable to migrate database to version 3, lookups will be slow.");
+    } else if (db_version < 4 && !_migrate_to_v4()) {
+        log_error("[DB Migration] Unable to migrate database to version 4, history search is unavailable.");
+    } else if (db_version < 5 && !_migrate_to_v5()) {
+        log_error("[DB Migration] Unable to migrate database to version 5, history limits will be slow.");
+    }
+    gboolean backfill = _fts_backfill_load();
+    DbMaintenance* maintenance = NULL;
+    DbImport* import = NULL;
+
+    while (!stop) {
+        DbWriteJob* job;
+        if (backfill || maintenance || import) {
+            job = g_async_queue_try_pop(write_queue);
+            if (!job) {
+                if (backfill) {
+                    backfill = _fts_backfill_chunk();
+                } else if (import) {
+                    if (!_import_step(import)) {
+                        _import_free(import);
+                        import = NULL;
+                    }
+                } else if (!_maintenance_step(maintenance)) {
+                    _maintenance_free(maintenance);
+                    maintenance = NULL;
+                }
+                continue;
+            }
+        } else {
+            job = g_async_queue_pop(write_queue);
+        }
+
+        // everything queued by now, like a page of MAM results, goes into
+        // one transaction
+        gint64 batch_start = stats_trace_begin();
+        _writer_exec("BEGIN TRANSACTION;");
+        while (job) {
+            if (job == &writer_stop) {
+                stop = TRUE;
+                break;
+            }
+            if (job->maintenance) {
+                // a newer request starts over, a pending full vacuum is kept
+                if (maintenance && !job->maintenance->vacuum_path) {
+                    job->maintenance->vacuum_path = maintenance->vacuum_path;
+                    maintenance->vacuum_path = NULL;
+                }
+                _maintenance_free(maintenance);
+                maintenance = job->maintenance;
+                job->maintenance = NULL;
+            } else if (job->import) {
+                if (import) {
+                    _writer_show_info("Chat log import is already running.");
+                } else {
+                    import = job->import;
+                    job->import = NULL;
+                }
+            } else {
+                _writer_write(job);
+                stats_time(STATS_TIMER_DB_QUEUE, job->queued_at);
+            }
+            _free_write_job(job);
+            job = g_async_queue_try_pop(write_queue);
+        }
+        _writer_exec("COMMIT;");
+        stats_span("db_write_batch", batch_start);
+    }
+    _maintenance_free(maintenance);
+    _import_free(import);
+
+    return NULL;
+}
+
+static void
+_writer_exec(const char* const query)
+{
+    char* err_msg = NULL;
+    if (SQLITE_OK != sqlite3_exec(g_writer_database, query, NULL, 0, &err_msg)) {
+        log_error("SQLite error in _writer_exec() on %s: %s", query, err_msg ? err_msg : "unknown");
+        sqlite3_free(err_msg);
+    }
+}
+
+static void
+_writer_write(DbWriteJob* job)
+{
+    sqlite_int64 original_message_id = -1;
+
+    // Apply LMC and check its validity (XEP-0308)
+    if (job->replace_id) {
+        sqlite3_stmt* lmc_stmt = _get_stmt(DB_STMT_LMC_CHECK);
+        if (!lmc_stmt) {
+            log_error("SQLite error in _add_to_db() on selecting original message: %s", sqlite3_errmsg(g_writer_database));
             return;
         }
+        sqlite3_bind_text(lmc_stmt, 1, job->replace_id, -1, SQLITE_STATIC);
+
+        if (sqlite3_step(lmc_stmt) == SQLITE_ROW) {
+            original_message_id = sqlite3_column_int64(lmc_stmt, 0);
+            const char* from_jid_orig = (const char*)sqlite3_column_text(lmc_stmt, 1);
+
+            // Handle non-XEP-compliant replacement messages (edit->edit->original)
+            sqlite_int64 tmp = sqlite3_column_int64(lmc_stmt, 2);
+            original_message_id = tmp ? tmp : original_message_id;
 
-        sqlite3_stmt* stmt;
+            if (g_strcmp0(from_jid_orig, job->from_barejid) != 0) {
+                log_error("Mismatch in sender JIDs when trying to do LMC. Corrected message sender: %s. Original message sender: %s. Replace-ID: %s. Message: %s", job->from_barejid, from_jid_orig, job->replace_id, job->message);
+                _writer_show_error("%s sent a message correction with mismatched sender. See log for details.", job->from_barejid);
+                sqlite3_reset(lmc_stmt);
+                return;
+            }
+        } else {
+            log_warning("Got LMC message that does not have original message counterpart in the database from %s", job->sender);
+        }
+        sqlite3_reset(lmc_stmt);
+    }
 
-        if (SQLITE_OK == sqlite3_prepare_v2(g_chatlog_database, duplicate_check_query, -1, &stmt, NULL)) {
+    // stanza-id (XEP-0359) doesn't have to be present in the message.
+    // But if it's duplicated, it's a serious server-side problem, so we better track it.
+    // Unless it's MAM, in that case it's expected behaviour.
+    if (job->archive_id && !job->is_mam) {
+        sqlite3_stmt* stmt = _get_stmt(DB_STMT_DUPLICATE_CHECK);
+        if (stmt) {
+            sqlite3_bind_text(stmt, 1, job->archive_id, -1, SQLITE_STATIC);
             if (sqlite3_step(stmt) == SQLITE_ROW) {
-                log_error("Duplicate stanza-id found for the message. stanza_id: %s; archive_id: %s; sender: %s; content: %s", message->id, message->stanzaid, from_jid->barejid, message->plain);
-                cons_show_error("Got a message with duplicate (server-generated) stanza-id from %s.", from_jid->fulljid);
+                log_error("Duplicate stanza-id found for the message. stanza_id: %s; archive_id: %s; sender: %s; content: %s", job->stanza_id, job->archive_id, job->from_barejid, job->message);
+                _writer_show_error("Got a message with duplicate (server-generated) stanza-id from %s.", job->sender);
             }
-            sqlite3_finalize(stmt);
-        }
-    }
-
-    auto_sqlite char* orig_message_id = original_message_id == -1 ? NULL : sqlite3_mprintf("%d", original_message_id);
-
-    auto_sqlite char* query = sqlite3_mprintf("INSERT INTO `ChatLogs` "
-                                              "(`from_jid`, `from_resource`, `to_jid`, `to_resource`, "
-                                              "`message`, `timestamp`, `stanza_id`, `archive_id`, "
-                                              "`replaces_db_id`, `replace_id`, `type`, `encryption`) "
-                                              "VALUES (%Q, %Q, %Q, %Q, %Q, %Q, %Q, %Q, %Q, %Q, %Q, %Q)",
-                                              from_jid->barejid,
-                                              from_jid->resourcepart,
-                                              to_jid->barejid,
-                                              to_jid->resourcepart,
-                                              message->plain,
-                                              date_fmt,
-                                              message->id,
-                                              message->stanzaid,
-                                              orig_message_id,
-                                              message->replace_id,
-                                              type,
-                                              enc);
-    if (!query) {
-        log_error("Could not allocate memory for SQL insert query in log_database_add()");
+            sqlite3_reset(stmt);
+        }
+    }
+
+    sqlite3_stmt* stmt = _get_stmt(DB_STMT_INSERT);
+    if (!stmt) {
+        log_error("SQLite error in _add_to_db() on preparing insert: %s", sqlite3_errmsg(g_writer_database));
         return;
     }
 
-    log_debug("Writing to DB. Query: %s", query);
+    // sqlite3_bind_text() binds NULL for NULL strings
+    sqlite3_bind_text(stmt, 1, job->from_barejid, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, job->from_resource, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 3, job->to_barejid, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 4, job->to_resource, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 5, job->message, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 6, job->timestamp, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 7, job->stanza_id, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 8, job->archive_id, -1, SQLITE_STATIC);
+    if (original_message_id != -1) {
+        sqlite3_bind_int64(stmt, 9, original_message_id);
+    }
+    sqlite3_bind_text(stmt, 10, job->replace_id, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 11, job->type, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 12, job->enc, -1, SQLITE_STATIC);
 
-    if (SQLITE_OK != sqlite3_exec(g_chatlog_database, query, NULL, 0, &err_msg)) {
-        if (err_msg) {
-            log_error("SQLite error in _add_to_db(): %s", err_msg);
-            sqlite3_free(err_msg);
-        } else {
-            log_error("Unknown SQLite error in _add_to_db().");
-        }
+    log_debug("Writing to DB. id: %s, archive_id: %s", job->stanza_id, job->archive_id);
+
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        log_error("SQLite error in _add_to_db(): %s", sqlite3_errmsg(g_writer_database));
     } else {
-        int inserted_rows_count = sqlite3_changes(g_chatlog_database);
+        int inserted_rows_count = sqlite3_changes(g_writer_database);
         if (inserted_rows_count < 1) {
-            log_error("SQLite did not insert message (rows: %d, id: %s, content: %s)", inserted_rows_count, message->id, message->plain);
+            log_error("SQLite did not insert message (rows: %d, id: %s, content: %s)", inserted_rows_count, job->stanza_id, job->message);
+        }
+    }
+    sqlite3_reset(stmt);
+}
+
+// the UI belongs to the main thread, hand errors over to it
+static void
+_writer_show_error(const char* const fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    gchar* msg = g_strdup_vprintf(fmt, args);
+    va_end(args);
+
+    g_idle_add(_writer_show_error_cb, msg);
+}
+
+static gboolean
+_writer_show_error_cb(gpointer data)
+{
+    cons_show_error("%s", (char*)data);
+    g_free(data);
+
+    return FALSE;
+}
+
+static void
+_writer_show_info(const char* const fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    gchar* msg = g_strdup_vprintf(fmt, args);
+    va_end(args);
+
+    g_idle_add(_writer_show_info_cb, msg);
+}
+
+static gboolean
+_writer_show_info_cb(gpointer data)
+{
+    cons_show("%s", (char*)data);
+    g_free(data);
+
+    return FALSE;
+}
+
+static void
+_free_write_job(DbWriteJob* job)
+{
+    g_free(job->from_barejid);
+    g_free(job->from_resource);
+    g_free(job->to_barejid);
+    g_free(job->to_resource);
+    g_free(job->sender);
+    g_free(job->message);
+    g_free(job->timestamp);
+    g_free(job->stanza_id);
+    g_free(job->archive_id);
+    g_free(job->replace_id);
+    g_free(job->type);
+    g_free(job->enc);
+    _maintenance_free(job->maintenance);
+    _import_free(job->import);
+    g_free(job);
+}
+
+// returns the writer's cached statement ready for binding, preparing it on
+// first use
+static sqlite3_stmt*
+_get_stmt(db_stmt_t which)
+{
+    if (db_stmts[which] == NULL) {
+        if (SQLITE_OK != sqlite3_prepare_v2(g_writer_database, db_stmt_sql[which], -1, &db_stmts[which], NULL)) {
+            db_stmts[which] = NULL;
+            return NULL;
         }
+    } else {
+        sqlite3_clear_bindings(db_stmts[which]);
+    }
+
+    return db_stmts[which];
+}
+
+static void
+_finalize_stmts(void)
+{
+    for (int i = 0; i < DB_STMT_COUNT; i++) {
+        sqlite3_finalize(db_stmts[i]);
+        db_stmts[i] = NULL;
     }
 }
 
@@ -671,6 +1599,588 @@ cleanup:
     return FALSE;
 }
 
+/**
+ * Migration to version 3 adds indexes for the duplicate stanza-id and
+ * correction lookups done for every logged message. Returns TRUE on success.
+ *
+ * Runs on the writer thread since indexing a big database takes a while.
+ */
+static gboolean
+_migrate_to_v3(void)
+{
+    char* err_msg = NULL;
+
+    const char* sql_statements[] = {
+        "BEGIN TRANSACTION",
+        "CREATE INDEX IF NOT EXISTS ChatLogs_archive_id_IDX ON `ChatLogs` (`archive_id`);",
+        "CREATE INDEX IF NOT EXISTS ChatLogs_stanza_id_IDX ON `ChatLogs` (`stanza_id`);",
+        "UPDATE `DbVersion` SET `version` = 3;",
+        "END TRANSACTION"
+    };
+
+    log_info("[DB Migration] Building indexes for version 3");
+
+    for (unsigned int i = 0; i < ARRAY_SIZE(sql_statements); i++) {
+        if (SQLITE_OK != sqlite3_exec(g_writer_database, sql_statements[i], NULL, 0, &err_msg)) {
+            log_error("SQLite error in _migrate_to_v3() on statement %u: %s", i, err_msg);
+            if (err_msg) {
+                sqlite3_free(err_msg);
+                err_msg = NULL;
+            }
+            goto cleanup;
+        }
+    }
+
+    log_info("[DB Migration] Migrated database to version 3");
+    return TRUE;
+
+cleanup:
+    if (SQLITE_OK != sqlite3_exec(g_writer_database, "ROLLBACK;", NULL, 0, &err_msg)) {
+        log_error("[DB Migration] Unable to ROLLBACK: %s", err_msg);
+        if (err_msg) {
+            sqlite3_free(err_msg);
+        }
+    }
+
+    return FALSE;
+}
+
+/**
+ * Migration to version 4 adds the full-text index over messages. Returns TRUE
+ * on success.
+ *
+ * New rows are indexed by a trigger, existing ones are recorded in
+ * `FtsBackfill` and indexed later by the writer, see _fts_backfill_chunk().
+ */
+static gboolean
+_migrate_to_v4(void)
+{
+    char* err_msg = NULL;
+
+    const char* sql_statements[] = {
+        "BEGIN TRANSACTION",
+        "CREATE VIRTUAL TABLE IF NOT EXISTS `ChatLogsFTS` USING fts5(`message`, content='ChatLogs', content_rowid='id');",
+        "CREATE TRIGGER IF NOT EXISTS ChatLogs_fts_insert "
+        "AFTER INSERT ON ChatLogs "
+        "FOR EACH ROW "
+        "BEGIN "
+        "INSERT INTO ChatLogsFTS (rowid, message) VALUES (NEW.id, NEW.message); "
+        "END;",
+        "CREATE TRIGGER IF NOT EXISTS ChatLogs_fts_delete "
+        "AFTER DELETE ON ChatLogs "
+        "FOR EACH ROW "
+        "BEGIN "
+        "INSERT INTO ChatLogsFTS (ChatLogsFTS, rowid, message) VALUES ('delete', OLD.id, OLD.message); "
+        "END;",
+        "CREATE TABLE IF NOT EXISTS `FtsBackfill` (`next_id` INTEGER, `until_id` INTEGER);",
+        "INSERT INTO `FtsBackfill` (`next_id`, `until_id`) "
+        "SELECT MIN(`id`), MAX(`id`) FROM `ChatLogs` HAVING COUNT(*) > 0;",
+        "UPDATE `DbVersion` SET `version` = 4;",
+        "END TRANSACTION"
+    };
+
+    for (unsigned int i = 0; i < ARRAY_SIZE(sql_statements); i++) {
+        if (SQLITE_OK != sqlite3_exec(g_writer_database, sql_statements[i], NULL, 0, &err_msg)) {
+            log_error("SQLite error in _migrate_to_v4() on statement %u: %s", i, err_msg);
+            if (err_msg) {
+                sqlite3_free(err_msg);
+                err_msg = NULL;
+            }
+            goto cleanup;
+        }
+    }
+
+    log_info("[DB Migration] Migrated database to version 4");
+    return TRUE;
+
+cleanup:
+    if (SQLITE_OK != sqlite3_exec(g_writer_database, "ROLLBACK;", NULL, 0, &err_msg)) {
+        log_error("[DB Migration] Unable to ROLLBACK: %s", err_msg);
+        if (err_msg) {
+            sqlite3_free(err_msg);
+        }
+    }
+
+    return FALSE;
+}
+
+/**
+ * Migration to version 5 adds the `Conversations` summary, filled from the
+ * messages logged so far. Returns TRUE on success.
+ */
+static gboolean
+_migrate_to_v5(void)
+{
+    char* err_msg = NULL;
+
+    const char* sql_statements[] = {
+        "BEGIN TRANSACTION",
+        "CREATE TABLE IF NOT EXISTS `Conversations` ("
+        "`jid_a` TEXT NOT NULL, `jid_b` TEXT NOT NULL, "
+        "`first_timestamp` TEXT, `first_archive_id` TEXT, "
+        "`last_timestamp` TEXT, `last_archive_id` TEXT, "
+        "`message_count` INTEGER NOT NULL DEFAULT 0, "
+        "PRIMARY KEY (`jid_a`, `jid_b`));",
+        "CREATE TRIGGER IF NOT EXISTS ChatLogs_conversations_insert "
+        "AFTER INSERT ON ChatLogs "
+        "FOR EACH ROW WHEN NEW.from_jid IS NOT NULL AND NEW.to_jid IS NOT NULL AND NEW.timestamp IS NOT NULL "
+        "BEGIN "
+        "INSERT OR IGNORE INTO Conversations (jid_a, jid_b, first_timestamp, first_archive_id, last_timestamp, last_archive_id) "
+        "VALUES (MIN(NEW.from_jid, NEW.to_jid), MAX(NEW.from_jid, NEW.to_jid), NEW.timestamp, NEW.archive_id, NEW.timestamp, NEW.archive_id); "
+        "UPDATE Conversations SET "
+        "first_archive_id = CASE WHEN NEW.timestamp < first_timestamp THEN NEW.archive_id ELSE first_archive_id END, "
+        "first_timestamp = MIN(first_timestamp, NEW.timestamp), "
+        "last_archive_id = CASE WHEN NEW.timestamp >= last_timestamp THEN NEW.archive_id ELSE last_archive_id END, "
+        "last_timestamp = MAX(last_timestamp, NEW.timestamp), "
+        "message_count = message_count + 1 "
+        "WHERE jid_a = MIN(NEW.from_jid, NEW.to_jid) AND jid_b = MAX(NEW.from_jid, NEW.to_jid); "
+        "END;",
+        DB_CONVERSATIONS_REBUILD,
+        "UPDATE `DbVersion` SET `version` = 5;",
+        "END TRANSACTION"
+    };
+
+    log_info("[DB Migration] Summarizing conversations for version 5");
+
+    for (unsigned int i = 0; i < ARRAY_SIZE(sql_statements); i++) {
+        if (SQLITE_OK != sqlite3_exec(g_writer_database, sql_statements[i], NULL, 0, &err_msg)) {
+            log_error("SQLite error in _migrate_to_v5() on statement %u: %s", i, err_msg);
+            if (err_msg) {
+                sqlite3_free(err_msg);
+                err_msg = NULL;
+            }
+            goto cleanup;
+        }
+    }
+
+    log_info("[DB Migration] Migrated database to version 5");
+    return TRUE;
+
+cleanup:
+    if (SQLITE_OK != sqlite3_exec(g_writer_database, "ROLLBACK;", NULL, 0, &err_msg)) {
+        log_error("[DB Migration] Unable to ROLLBACK: %s", err_msg);
+        if (err_msg) {
+            sqlite3_free(err_msg);
+        }
+    }
+
+    return FALSE;
+}
+
+// returns TRUE if there are rows left to add to the full-text index
+static gboolean
+_fts_backfill_load(void)
+{
+    sqlite3_stmt* stmt = NULL;
+    gboolean pending = FALSE;
+
+    if (sqlite3_prepare_v2(g_writer_database, "SELECT `next_id`, `until_id` FROM `FtsBackfill` LIMIT 1", -1, &stmt, NULL) != SQLITE_OK) {
+        return FALSE;
+    }
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        fts_backfill_next = sqlite3_column_int64(stmt, 0);
+        fts_backfill_until = sqlite3_column_int64(stmt, 1);
+        pending = TRUE;
+        log_info("Indexing chat history for search in the background");
+    }
+    sqlite3_finalize(stmt);
+
+    return pending;
+}
+
+// indexes the next chunk of old rows, returns TRUE if there are more
+static gboolean
+_fts_backfill_chunk(void)
+{
+    sqlite_int64 end = MIN(fts_backfill_next + DB_FTS_BACKFILL_CHUNK, fts_backfill_until + 1);
+    gboolean more = end <= fts_backfill_until;
+
+    auto_sqlite char* progress = more ? sqlite3_mprintf("UPDATE `FtsBackfill` SET `next_id` = %lld", end)
+                                      : sqlite3_mprintf("DELETE FROM `FtsBackfill`");
+    auto_sqlite char* query = sqlite3_mprintf("BEGIN TRANSACTION;"
+                                              "INSERT INTO `ChatLogsFTS` (rowid, `message`) "
+                                              "SELECT `id`, `message` FROM `ChatLogs` WHERE `id` >= %lld AND `id` < %lld;"
+                                              "%s;"
+                                              "COMMIT;",
+                                              fts_backfill_next, end, progress);
+    if (!progress || !query) {
+        log_error("Could not allocate memory for SQL backfill query");
+        return FALSE;
+    }
+
+    char* err_msg = NULL;
+    if (SQLITE_OK != sqlite3_exec(g_writer_database, query, NULL, 0, &err_msg)) {
+        log_error("SQLite error in _fts_backfill_chunk(): %s", err_msg ? err_msg : "unknown");
+        sqlite3_free(err_msg);
+        _writer_exec("ROLLBACK;");
+        return FALSE;
+    }
+
+    fts_backfill_next = end;
+    if (!more) {
+        log_info("Finished indexing chat history for search");
+    }
+
+    return more;
+}
+
+// returns the first column of the first row, or -1
+static sqlite_int64
+_writer_int(const char* const query)
+{
+    sqlite3_stmt* stmt = NULL;
+    sqlite_int64 result = -1;
+
+    if (sqlite3_prepare_v2(g_writer_database, query, -1, &stmt, NULL) != SQLITE_OK) {
+        log_error("SQLite error in _writer_int() on %s: %s", query, sqlite3_errmsg(g_writer_database));
+        return -1;
+    }
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        result = sqlite3_column_int64(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+
+    return result;
+}
+
+// Collects the ids returned by select into `MaintenanceIds` and runs action on
+// them in one transaction. Returns TRUE if a full chunk was handled.
+static gboolean
+_maintenance_chunk(const char* const select, const char* const action)
+{
+    if (!select) {
+        log_error("Could not allocate memory for SQL maintenance query");
+        return FALSE;
+    }
+
+    auto_sqlite char* query = sqlite3_mprintf("BEGIN TRANSACTION;"
+                                              "DELETE FROM temp.`MaintenanceIds`;"
+                                              "INSERT INTO temp.`MaintenanceIds` (`id`) %s;"
+                                              "%s"
+                                              "COMMIT;",
+                                              select, action);
+    if (!query) {
+        log_error("Could not allocate memory for SQL maintenance query");
+        return FALSE;
+    }
+
+    char* err_msg = NULL;
+    if (SQLITE_OK != sqlite3_exec(g_writer_database, query, NULL, 0, &err_msg)) {
+        log_error("SQLite error in _maintenance_chunk(): %s", err_msg ? err_msg : "unknown");
+        sqlite3_free(err_msg);
+        _writer_exec("ROLLBACK;");
+        return FALSE;
+    }
+
+    return _writer_int("SELECT COUNT(*) FROM temp.`MaintenanceIds`") == DB_MAINTENANCE_CHUNK;
+}
+
+static gboolean
+_retention_chunk(DbRetention* retention, const char* const exempt)
+{
+    auto_sqlite char* match = retention->barejid ? sqlite3_mprintf("(`from_jid` = %Q OR `to_jid` = %Q)", retention->barejid, retention->barejid)
+                                                 : sqlite3_mprintf("`from_jid` NOT IN (%s) AND `to_jid` NOT IN (%s)", exempt, exempt);
+    auto_sqlite char* select = retention->before ? sqlite3_mprintf("SELECT `id` FROM `ChatLogsAll` WHERE %s AND `timestamp` < %Q LIMIT %d",
+                                                                   match, retention->before, DB_MAINTENANCE_CHUNK)
+                                                 : sqlite3_mprintf("SELECT `id` FROM `ChatLogsAll` WHERE %s ORDER BY `timestamp` DESC, `id` DESC LIMIT %d OFFSET %d",
+                                                                   match, DB_MAINTENANCE_CHUNK, retention->keep);
+
+    return _maintenance_chunk(select, writer_archive ? "DELETE FROM main.`ChatLogs` WHERE `id` IN (SELECT `id` FROM temp.`MaintenanceIds`);"
+                                                       "DELETE FROM archive.`ChatLogs` WHERE `id` IN (SELECT `id` FROM temp.`MaintenanceIds`);"
+                                                     : "DELETE FROM main.`ChatLogs` WHERE `id` IN (SELECT `id` FROM temp.`MaintenanceIds`);");
+}
+
+// copies before deleting, a row left in both files by a crash is moved again
+static gboolean
+_archive_chunk(const char* const before)
+{
+    auto_sqlite char* select = sqlite3_mprintf("SELECT `id` FROM main.`ChatLogs` WHERE `timestamp` < %Q LIMIT %d", before, DB_MAINTENANCE_CHUNK);
+
+    return _maintenance_chunk(select, "INSERT OR REPLACE INTO archive.`ChatLogs` (" DB_CHATLOGS_COLUMNS ") "
+                                      "SELECT " DB_CHATLOGS_COLUMNS " FROM main.`ChatLogs` WHERE `id` IN (SELECT `id` FROM temp.`MaintenanceIds`);"
+                                      "DELETE FROM main.`ChatLogs` WHERE `id` IN (SELECT `id` FROM temp.`MaintenanceIds`);");
+}
+
+// gives free pages of an incrementally vacuumed database back, returns TRUE
+// if there are more
+static gboolean
+_vacuum_chunk(const char* const schema)
+{
+    auto_sqlite char* mode = sqlite3_mprintf("PRAGMA %s.auto_vacuum", schema);
+    if (_writer_int(mode) != 2) {
+        return FALSE;
+    }
+
+    auto_sqlite char* vacuum = sqlite3_mprintf("PRAGMA %s.incremental_vacuum(%d)", schema, DB_VACUUM_PAGES);
+    _writer_exec(vacuum);
+
+    auto_sqlite char* freelist = sqlite3_mprintf("PRAGMA %s.freelist_count", schema);
+    return _writer_int(freelist) > 0;
+}
+
+// rewrites the whole database, which also switches a database created
+// before incremental vacuuming over to it
+static void
+_vacuum_full(char* path)
+{
+    if (!_check_available_space_for_db_migration(path)) {
+        _writer_show_error("Not enough disk space to vacuum the chat log database.");
+        return;
+    }
+
+    log_info("Vacuuming chat log database %s", path);
+    _writer_exec("PRAGMA main.auto_vacuum = INCREMENTAL;");
+    _writer_exec("VACUUM main;");
+    log_info("Finished vacuuming chat log database");
+}
+
+// does the next chunk of maintenance, returns TRUE if there is more
+static gboolean
+_maintenance_step(DbMaintenance* maintenance)
+{
+    switch (maintenance->stage) {
+    case DB_MAINTENANCE_RETENTION:
+        if (!maintenance->retention) {
+            maintenance->stage = DB_MAINTENANCE_ARCHIVE;
+        } else if (!_retention_chunk(maintenance->retention->data, maintenance->exempt)) {
+            _retention_free(maintenance->retention->data);
+            maintenance->retention = g_slist_delete_link(maintenance->retention, maintenance->retention);
+            if (!maintenance->retention && _writer_int("SELECT COUNT(*) FROM main.sqlite_master WHERE `name` = 'Conversations'") > 0) {
+                _writer_exec("BEGIN TRANSACTION;" DB_CONVERSATIONS_REBUILD "COMMIT;");
+                if (!sqlite3_get_autocommit(g_writer_database)) {
+                    _writer_exec("ROLLBACK;");
+                }
+            }
+        }
+        return TRUE;
+    case DB_MAINTENANCE_ARCHIVE:
+        if (!maintenance->archive_before || !writer_archive || !_archive_chunk(maintenance->archive_before)) {
+            maintenance->stage = DB_MAINTENANCE_VACUUM;
+        }
+        return TRUE;
+    case DB_MAINTENANCE_VACUUM:
+        if (maintenance->vacuum_path) {
+            _vacuum_full(maintenance->vacuum_path);
+            g_free(maintenance->vacuum_path);
+            maintenance->vacuum_path = NULL;
+            return TRUE;
+        }
+        gboolean more = _vacuum_chunk("main");
+        if (writer_archive) {
+            more = _vacuum_chunk("archive") || more;
+        }
+        return more;
+    }
+
+    return FALSE;
+}
+
+static void
+_import_level_free(DbImportLevel* level)
+{
+    g_dir_close(level->dir);
+    g_free(level->path);
+    g_free(level->contact);
+    g_free(level);
+}
+
+static void
+_import_free(DbImport* import)
+{
+    if (!import) {
+        return;
+    }
+
+    g_slist_free_full(import->levels, (GDestroyNotify)_import_level_free);
+    g_free(import->myjid);
+    g_free(import);
+}
+
+// Directory names are jids with "@" written as "_at_". Logs with a resource
+// appended, like private room messages, can't be told apart from the name,
+// their domain would contain "_".
+static gchar*
+_import_contact(const char* const name)
+{
+    auto_char char* jid = str_replace(name, "_at_", "@");
+    const char* domain = jid ? strchr(jid, '@') : NULL;
+    if (!domain || strchr(domain, '_') || strchr(domain + 1, '@')) {
+        return NULL;
+    }
+
+    return g_strdup(jid);
+}
+
+static void
+_import_message(DbImport* import, DbImportLevel* level, const char* const timestamp, const char* const nick, const char* const message)
+{
+    sqlite3_stmt* check = _get_stmt(DB_STMT_IMPORT_CHECK);
+    if (check) {
+        auto_gchar gchar* second = g_strndup(timestamp, 19);
+        sqlite3_bind_text(check, 1, second, -1, SQLITE_STATIC);
+        sqlite3_bind_text(check, 2, level->contact, -1, SQLITE_STATIC);
+        sqlite3_bind_text(check, 3, message, -1, SQLITE_STATIC);
+        gboolean duplicate = sqlite3_step(check) == SQLITE_ROW;
+        sqlite3_reset(check);
+        if (duplicate) {
+            import->duplicates++;
+            return;
+        }
+    }
+
+    sqlite3_stmt* stmt = _get_stmt(DB_STMT_INSERT);
+    if (!stmt) {
+        log_error("SQLite error in _import_message() on preparing insert: %s", sqlite3_errmsg(g_writer_database));
+        return;
+    }
+
+    // room logs don't say which lines are our own
+    gboolean outgoing = !level->is_room && g_strcmp0(nick, "me") == 0;
+    sqlite3_bind_text(stmt, 1, outgoing ? import->myjid : level->contact, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, level->is_room ? nick : NULL, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 3, outgoing ? level->contact : import->myjid, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 5, message, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 6, timestamp, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 11, level->is_room ? "muc" : "chat", -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 12, "none", -1, SQLITE_STATIC);
+
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        log_error("SQLite error in _import_message(): %s", sqlite3_errmsg(g_writer_database));
+    } else {
+        import->imported++;
+    }
+    sqlite3_reset(stmt);
+}
+
+// Lines are "<timestamp> - <nick>: <message>" or "<timestamp> - *<nick> <message>"
+// for /me, lines without a timestamp continue the message before
+static void
+_import_file(DbImport* import, DbImportLevel* level, const char* const path)
+{
+    GError* error = NULL;
+    GDataInputStream* reader = compress_open_reader(path, &error);
+    if (!reader) {
+        log_warning("Unable to read chat log %s: %s", path, error->message);
+        g_error_free(error);
+        return;
+    }
+
+    gchar* timestamp = NULL;
+    gchar* nick = NULL;
+    GString* message = g_string_new(NULL);
+
+    _writer_exec("BEGIN TRANSACTION;");
+    gsize len = 0;
+    gchar* line;
+    while ((line = g_data_input_stream_read_line(reader, &len, NULL, &error))) {
+        const char* eol = line + len;
+        const char* sep = len > 22 && g_ascii_isdigit(line[0]) ? g_strstr_len(line, MIN(len, 48), " - ") : NULL;
+        auto_gchar gchar* date = sep ? g_strndup(line, sep - line) : NULL;
+        GDateTime* dt = date && sep - line >= 19 ? g_date_time_new_from_iso8601(date, NULL) : NULL;
+        if (dt) {
+            g_date_time_unref(dt);
+            if (timestamp) {
+                _import_message(import, level, timestamp, nick, message->str);
+            }
+            g_free(timestamp);
+            g_free(nick);
+            timestamp = date;
+            date = NULL;
+            nick = NULL;
+            g_string_truncate(message, 0);
+
+            const char* text = sep + 3;
+            if (text < eol && *text == '*') {
+                const char* space = memchr(text, ' ', eol - text);
+                nick = g_strndup(text + 1, (space ? space : eol) - text - 1);
+                g_string_append(message, "/me ");
+                if (space) {
+                    g_string_append_len(message, space + 1, eol - space - 1);
+                }
+            } else {
+                const char* colon = g_strstr_len(text, eol - text, ": ");
+                nick = g_strndup(text, (colon ? colon : eol) - text);
+                if (colon) {
+                    g_string_append_len(message, colon + 2, eol - colon - 2);
+                }
+            }
+        } else if (timestamp) {
+            g_string_append_c(message, '\n');
+            g_string_append_len(message, line, len);
+        }
+        g_free(line);
+    }
+    if (error) {
+        log_warning("Error reading chat log %s: %s", path, error->message);
+        g_error_free(error);
+    }
+    if (timestamp) {
+        _import_message(import, level, timestamp, nick, message->str);
+    }
+    _writer_exec("COMMIT;");
+
+    g_free(timestamp);
+    g_free(nick);
+    g_string_free(message, TRUE);
+    g_object_unref(reader);
+}
+
+// imports the next log file, returns TRUE if there may be more
+static gboolean
+_import_step(DbImport* import)
+{
+    if (!import->levels) {
+        _writer_show_info("Imported %u messages from %u chat log files, %u were already logged.",
+                          import->imported, import->files, import->duplicates);
+        return FALSE;
+    }
+
+    DbImportLevel* level = import->levels->data;
+    const char* name = g_dir_read_name(level->dir);
+    if (!name) {
+        _import_level_free(level);
+        import->levels = g_slist_delete_link(import->levels, import->levels);
+        return TRUE;
+    }
+
+    auto_gchar gchar* path = g_build_filename(level->path, name, NULL);
+
+    if (level->type == DB_IMPORT_DIR_CONTACT) {
+        gboolean is_log = g_str_has_suffix(name, ".log") || g_str_has_suffix(name, ".log.gz");
+        if (is_log && g_file_test(path, G_FILE_TEST_IS_REGULAR)) {
+            _import_file(import, level, path);
+            if (++import->files % DB_IMPORT_REPORT_FILES == 0) {
+                _writer_show_info("Imported %u messages from %u chat log files so far.", import->imported, import->files);
+            }
+        }
+        return TRUE;
+    }
+
+    if (!g_file_test(path, G_FILE_TEST_IS_DIR)) {
+        return TRUE;
+    }
+
+    DbImportLevel* next = g_new0(DbImportLevel, 1);
+    if (level->type == DB_IMPORT_DIR_ACCOUNT && g_strcmp0(name, "rooms") == 0) {
+        next->type = DB_IMPORT_DIR_ROOMS;
+    } else {
+        next->type = DB_IMPORT_DIR_CONTACT;
+        next->is_room = level->type == DB_IMPORT_DIR_ROOMS;
+        next->contact = _import_contact(name);
+    }
+    next->dir = next->type != DB_IMPORT_DIR_CONTACT || next->contact ? g_dir_open(path, 0, NULL) : NULL;
+    if (!next->dir) {
+        g_free(next->contact);
+        g_free(next);
+        return TRUE;
+    }
+    next->path = path;
+    path = NULL;
+    import->levels = g_slist_prepend(import->levels, next);
+
+    return TRUE;
+}
+
 // Checks if there is more system storage space available than current database takes + 40% (for indexing and other potential size increases)
 static gboolean
 _check_available_space_for_db_migration(char* path_to_db)
@@ -41,6 +41,7 @@
 #include "xmpp/xmpp.h"
 
 #define MESSAGES_TO_RETRIEVE 10
+#define MESSAGES_TO_SEARCH   20
 
 gboolean log_database_init(ProfAccount* account);
 void log_database_add_incoming(ProfMessage* message);
@@ -49,6 +50,16 @@ void log_database_add_outgoing_muc(const char* const id, const char* const barej
 void log_database_add_outgoing_muc_pm(const char* const id, const char* const barejid, const char* const message, const char* const replace_id, prof_enc_t enc);
 GSList* log_database_get_previous_chat(const gchar* const contact_barejid, const char* start_time, char* end_time, gboolean from_start, gboolean flip);
 ProfMessage* log_database_get_limits_info(const gchar* const contact_barejid, gboolean is_last);
+GSList* log_database_search(const char* const text, int limit);
+
+typedef struct prof_history_cursor_t ProfHistoryCursor;
+ProfHistoryCursor* log_database_history_cursor_new(const gchar* const contact_barejid, int max_page);
+GSList* log_database_history_cursor_prev(ProfHistoryCursor* cursor, GDateTime* oldest_shown);
+void log_database_history_cursor_free(ProfHistoryCursor* cursor);
 void log_database_close(void);
+int log_database_queue_depth(void);
+void log_database_maintenance(gboolean vacuum);
+gboolean log_database_archive_attached(void);
+void log_database_import_chatlogs(void);
 
 #endif // DATABASE_H
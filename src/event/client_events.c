@@ -120,11 +120,10 @@ cl_ev_presence_send(const resource_presence_t presence_type, const int idle_secs
 
 #ifdef HAVE_LIBGPGME
     char* account_name = session_get_account_name();
-    ProfAccount* account = accounts_get_account(account_name);
-    if (account->pgp_keyid) {
+    const ProfAccount* account = accounts_peek_account(account_name);
+    if (account && account->pgp_keyid) {
         signed_status = p_gpg_sign(connection_get_presence_msg(), account->pgp_keyid);
     }
-    account_free(account);
 #endif
 
     presence_send(presence_type, idle_secs, signed_status);
@@ -133,7 +132,7 @@ cl_ev_presence_send(const resource_presence_t presence_type, const int idle_secs
 void
 cl_ev_send_msg_correct(ProfChatWin* chatwin, const char* const msg, const char* const oob_url, gboolean correct_last_msg)
 {
-    chat_state_active(chatwin->state);
+    chat_state_active(chatwin->barejid, chatwin->state);
 
     gboolean request_receipt = prefs_get_boolean(PREF_RECEIPTS_REQUEST);
 
@@ -35,8 +35,12 @@
 
 #include "config.h"
 
+#include <glib/gstdio.h>
+
+#include "config/files.h"
 #include "config/tlscerts.h"
 #include "ui/ui.h"
+#include "ui/window_list.h"
 #include "xmpp/chat_session.h"
 #include "xmpp/roster_list.h"
 #include "xmpp/muc.h"
@@ -53,19 +57,59 @@
 #include "omemo/omemo.h"
 #endif
 
+// open chats and rooms with their window numbers, written on quit and read
+// back on the first login of the next run, one group per jid
+#define SESSION_SNAPSHOT_FILE "snapshot"
+#define SESSION_TYPE_CHAT     "chat"
+#define SESSION_TYPE_MUC      "muc"
+
 static gint _success_connections_counter = 0;
+static gboolean session_suspended = FALSE;
+static gboolean session_restored = FALSE;
 
 void
 ev_disconnect_cleanup(void)
+{
+    ev_suspend_cleanup();
+    ev_discard_suspended_session();
+}
+
+// tear down the stream but keep roster, rooms and databases, a Stream
+// Management resumption continues the session with them
+void
+ev_suspend_cleanup(void)
 {
     ui_disconnected();
     session_disconnect();
-    roster_destroy();
     iq_autoping_timer_cancel();
-    muc_invites_clear();
-    muc_confserver_clear();
     chat_sessions_clear();
     tlscerts_clear_current();
+    session_suspended = TRUE;
+}
+
+gboolean
+ev_session_suspended(void)
+{
+    return session_suspended;
+}
+
+void
+ev_resume_suspended_session(void)
+{
+    session_suspended = FALSE;
+}
+
+void
+ev_discard_suspended_session(void)
+{
+    if (!session_suspended) {
+        return;
+    }
+    session_suspended = FALSE;
+
+    roster_destroy();
+    muc_invites_clear();
+    muc_confserver_clear();
 #ifdef HAVE_LIBGPGME
     p_gpg_on_disconnect();
 #endif
@@ -106,3 +150,125 @@ ev_reset_connection_counter(void)
 {
     _success_connections_counter = 0;
 }
+
+void
+ev_session_snapshot_save(void)
+{
+    const char* barejid = connection_get_barejid();
+    if (!barejid) {
+        return;
+    }
+    gchar* filename = files_file_in_account_data_path(DIR_SESSION, barejid, SESSION_SNAPSHOT_FILE);
+    if (!filename) {
+        return;
+    }
+
+    prof_keyfile_t snapshot = { filename, g_key_file_new() };
+    GList* nums = wins_get_nums_sorted();
+    for (GList* curr = nums; curr; curr = g_list_next(curr)) {
+        int num = GPOINTER_TO_INT(curr->data);
+        ProfWin* window = wins_get_by_num(num);
+        if (window->type == WIN_CHAT) {
+            ProfChatWin* chatwin = (ProfChatWin*)window;
+            g_key_file_set_string(snapshot.keyfile, chatwin->barejid, "type", SESSION_TYPE_CHAT);
+            g_key_file_set_integer(snapshot.keyfile, chatwin->barejid, "num", num);
+            g_key_file_set_integer(snapshot.keyfile, chatwin->barejid, "unread", chatwin->unread);
+        } else if (window->type == WIN_MUC) {
+            ProfMucWin* mucwin = (ProfMucWin*)window;
+            char* nick = muc_nick(mucwin->roomjid);
+            // rooms with a password are left to their bookmark, it is not written here
+            if (!nick || muc_password(mucwin->roomjid)) {
+                continue;
+            }
+            g_key_file_set_string(snapshot.keyfile, mucwin->roomjid, "type", SESSION_TYPE_MUC);
+            g_key_file_set_integer(snapshot.keyfile, mucwin->roomjid, "num", num);
+            g_key_file_set_integer(snapshot.keyfile, mucwin->roomjid, "unread", mucwin->unread);
+            g_key_file_set_string(snapshot.keyfile, mucwin->roomjid, "nick", nick);
+            g_key_file_set_boolean(snapshot.keyfile, mucwin->roomjid, "mam", muc_supports_mam(mucwin->roomjid));
+            if (mucwin->last_msg_timestamp) {
+                auto_gchar gchar* last = g_date_time_format_iso8601(mucwin->last_msg_timestamp);
+                g_key_file_set_string(snapshot.keyfile, mucwin->roomjid, "last", last);
+            }
+        }
+    }
+    g_list_free(nums);
+
+    save_keyfile(&snapshot);
+    free_keyfile(&snapshot);
+}
+
+static void
+_session_snapshot_place(ProfWin* window, int num, int unread)
+{
+    if (num != wins_get_num(window) && wins_get_by_num(num) == NULL) {
+        wins_swap(wins_get_num(window), num);
+    }
+
+    auto_char char* identifier = win_get_tab_identifier(window);
+    if (unread > 0) {
+        status_bar_new(wins_get_num(window), window->type, identifier);
+    } else {
+        status_bar_active(wins_get_num(window), window->type, identifier);
+    }
+}
+
+// reopen what was open when we quit, before the server answers anything,
+// rooms are rejoined and caught up from their archive like after a reconnect
+void
+ev_session_snapshot_restore(void)
+{
+    if (session_restored) {
+        return;
+    }
+    session_restored = TRUE;
+
+    const char* barejid = connection_get_barejid();
+    if (!barejid) {
+        return;
+    }
+    gchar* filename = files_file_in_account_data_path(DIR_SESSION, barejid, SESSION_SNAPSHOT_FILE);
+    if (!filename || !g_file_test(filename, G_FILE_TEST_EXISTS)) {
+        g_free(filename);
+        return;
+    }
+
+    prof_keyfile_t snapshot = { 0 };
+    load_custom_keyfile(&snapshot, filename);
+
+    gsize len = 0;
+    auto_gcharv gchar** jids = g_key_file_get_groups(snapshot.keyfile, &len);
+    for (gsize i = 0; i < len; i++) {
+        auto_gchar gchar* type = g_key_file_get_string(snapshot.keyfile, jids[i], "type", NULL);
+        int num = g_key_file_get_integer(snapshot.keyfile, jids[i], "num", NULL);
+        int unread = g_key_file_get_integer(snapshot.keyfile, jids[i], "unread", NULL);
+
+        if (g_strcmp0(type, SESSION_TYPE_CHAT) == 0 && !wins_get_chat(jids[i])) {
+            ProfChatWin* chatwin = chatwin_new(jids[i]);
+            chatwin->unread = unread;
+            _session_snapshot_place((ProfWin*)chatwin, num, unread);
+
+        } else if (g_strcmp0(type, SESSION_TYPE_MUC) == 0 && !muc_active(jids[i])) {
+            auto_gchar gchar* nick = g_key_file_get_string(snapshot.keyfile, jids[i], "nick", NULL);
+            if (!nick) {
+                continue;
+            }
+            muc_join(jids[i], nick, NULL, TRUE);
+            muc_set_supports_mam(jids[i], g_key_file_get_boolean(snapshot.keyfile, jids[i], "mam", NULL));
+
+            ProfMucWin* mucwin = wins_get_muc(jids[i]);
+            if (!mucwin) {
+                mucwin = mucwin_new(jids[i]);
+            }
+            auto_gchar gchar* last = g_key_file_get_string(snapshot.keyfile, jids[i], "last", NULL);
+            if (last && !mucwin->last_msg_timestamp) {
+                mucwin->last_msg_timestamp = g_date_time_new_from_iso8601(last, NULL);
+            }
+            mucwin->unread = unread;
+            _session_snapshot_place((ProfWin*)mucwin, num, unread);
+        }
+    }
+
+    // only a clean quit leaves a snapshot, a crash later on must not bring back this one
+    g_unlink(snapshot.filename);
+    free_keyfile(&snapshot);
+}
@@ -36,10 +36,18 @@
 #ifndef EVENT_COMMON_H
 #define EVENT_COMMON_H
 
+#include <glib.h>
+
 void ev_disconnect_cleanup(void);
+void ev_suspend_cleanup(void);
+gboolean ev_session_suspended(void);
+void ev_resume_suspended_session(void);
+void ev_discard_suspended_session(void);
 void ev_inc_connection_counter(void);
 void ev_reset_connection_counter(void);
 gboolean ev_was_connected_already(void);
 gboolean ev_is_first_connect(void);
+void ev_session_snapshot_save(void);
+void ev_session_snapshot_restore(void);
 
 #endif
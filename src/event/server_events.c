@@ -80,6 +80,8 @@
 #include "ui/ui.h"
 
 static void _clean_incoming_message(ProfMessage* message);
+static gboolean _is_own_muc_message(ProfMucWin* mucwin, ProfMessage* message);
+static void _log_muc(ProfMessage* message);
 static void _sv_ev_incoming_plain(ProfChatWin* chatwin, gboolean new_win, ProfMessage* message, gboolean logit);
 
 void
@@ -87,6 +89,9 @@ sv_ev_login_account_success(char* account_name, gboolean secured)
 {
     ProfAccount* account = accounts_get_account(account_name);
 
+    // state kept for a stream resumption that did not happen
+    ev_discard_suspended_session();
+
     bookmark_ignore_on_connect(account->jid);
 
     roster_create();
@@ -109,12 +114,19 @@ sv_ev_login_account_success(char* account_name, gboolean secured)
 
     ui_handle_login_account_success(account, secured);
 
+    // windows and rooms of the last run, their rooms are rejoined just below
+    ev_session_snapshot_restore();
+
     // attempt to rejoin all rooms
     GList* rooms = muc_rooms();
     GList* curr = rooms;
     while (curr) {
         char* password = muc_password(curr->data);
         char* nick = muc_nick(curr->data);
+        // rooms with an archive are caught up from where we left off instead
+        // of having the server resend its discussion history on every rejoin
+        ProfMucWin* mucwin = wins_get_muc(curr->data);
+        muc_set_mam_catchup(curr->data, mucwin && mucwin->last_msg_timestamp && muc_supports_mam(curr->data));
         presence_join_room(curr->data, nick, password);
         curr = g_list_next(curr);
     }
@@ -137,10 +149,34 @@ sv_ev_login_account_success(char* account_name, gboolean secured)
     account_free(account);
 }
 
+void
+sv_ev_login_account_resumed(char* account_name, gboolean secured)
+{
+    ProfAccount* account = accounts_get_account(account_name);
+
+    ev_resume_suspended_session();
+
+    ui_handle_login_account_success(account, secured);
+    if (prefs_get_boolean(PREF_ROSTER)) {
+        ui_show_roster();
+    }
+
+    log_info("%s resumed session", account->jid);
+    cons_show("Connection re-established, session resumed.");
+    wins_reestablished_connection();
+
+    ev_inc_connection_counter();
+
+    plugins_on_connect(account_name, connection_get_fulljid());
+
+    account_free(account);
+}
+
 void
 sv_ev_roster_received(void)
 {
     roster_process_pending_presence();
+    status_bar_names_changed();
 
     if (prefs_get_boolean(PREF_ROSTER)) {
         ui_show_roster();
@@ -206,7 +242,13 @@ sv_ev_connection_features_received(void)
 void
 sv_ev_lost_connection(void)
 {
-    cons_show_error("Lost connection.");
+    // with reconnect enabled the session may survive through Stream Management
+    gboolean resumable = connection_sm_resumable() && prefs_get_reconnect() != 0;
+    if (resumable) {
+        cons_show_error("Lost connection, will try to resume the session.");
+    } else {
+        cons_show_error("Lost connection.");
+    }
 
 #ifdef HAVE_LIBOTR
     GSList* recipients = wins_get_chat_recipients();
@@ -225,7 +267,11 @@ sv_ev_lost_connection(void)
     }
 #endif
 
-    ev_disconnect_cleanup();
+    if (resumable) {
+        ev_suspend_cleanup();
+    } else {
+        ev_disconnect_cleanup();
+    }
 }
 
 void
@@ -313,11 +359,22 @@ sv_ev_room_history(ProfMessage* message)
 
         gboolean younger = g_date_time_compare(mucwin->last_msg_timestamp, message->timestamp) < 0 ? TRUE : FALSE;
         if (ev_is_first_connect() || younger) {
+            // unlike the server's discussion history, a catch-up from the room
+            // archive is exactly what we missed, so keep it
+            if (message->is_mam && !_is_own_muc_message(mucwin, message)) {
+                _log_muc(message);
+            }
             mucwin_history(mucwin, message);
         }
     }
 }
 
+static gboolean
+_is_own_muc_message(ProfMucWin* mucwin, ProfMessage* message)
+{
+    return g_strcmp0(muc_nick(mucwin->roomjid), message->from_jid->resourcepart) == 0 && message_is_sent_by_us(message, TRUE);
+}
+
 static void
 _log_muc(ProfMessage* message)
 {
@@ -341,16 +398,20 @@ sv_ev_room_message(ProfMessage* message)
 
     // only log message not coming from this client (but maybe same account, different client)
     // our messages are logged when outgoing
-    if (!(g_strcmp0(mynick, message->from_jid->resourcepart) == 0 && message_is_sent_by_us(message, TRUE))) {
+    if (!_is_own_muc_message(mucwin, message)) {
         _log_muc(message);
     }
 
     char* old_plain = message->plain;
-    message->plain = plugins_pre_room_message_display(message->from_jid->barejid, message->from_jid->resourcepart, message->plain);
+    auto_char char* display_plain = plugins_pre_room_message_display(message->from_jid->barejid, message->from_jid->resourcepart, message->plain);
+    if (display_plain) {
+        message->plain = display_plain;
+    }
 
-    GSList* mentions = get_mentions(prefs_get_boolean(PREF_NOTIFY_MENTION_WHOLE_WORD), prefs_get_boolean(PREF_NOTIFY_MENTION_CASE_SENSITIVE), message->plain, mynick);
-    gboolean mention = g_slist_length(mentions) > 0;
-    GList* triggers = prefs_message_get_triggers(message->plain);
+    GSList* mentions = NULL;
+    GList* triggers = NULL;
+    muc_message_highlights(mucwin->roomjid, message->plain, &mentions, &triggers);
+    gboolean mention = mentions != NULL;
 
     _clean_incoming_message(message);
     mucwin_incoming_msg(mucwin, message, mentions, triggers, TRUE);
@@ -360,13 +421,19 @@ sv_ev_room_message(ProfMessage* message)
     ProfWin* window = (ProfWin*)mucwin;
     int num = wins_get_num(window);
     gboolean is_current = FALSE;
+    gboolean from_me = g_strcmp0(mynick, message->from_jid->resourcepart) == 0;
+    if (!from_me) {
+        muc_speaker_add(mucwin->roomjid, message->from_jid->resourcepart);
+    }
+    // over /notify room flood: alerts are held back and summarised later
+    gboolean flooding = !from_me && mucwin_flood_count(mucwin);
 
     // currently in groupchat window
     if (wins_is_current(window)) {
         is_current = TRUE;
         status_bar_active(num, WIN_MUC, mucwin->roomjid);
 
-        if ((g_strcmp0(mynick, message->from_jid->resourcepart) != 0) && (prefs_get_boolean(PREF_BEEP))) {
+        if (!from_me && !flooding && (prefs_get_boolean(PREF_BEEP))) {
             beep();
         }
 
@@ -374,11 +441,13 @@ sv_ev_room_message(ProfMessage* message)
     } else {
         status_bar_new(num, WIN_MUC, mucwin->roomjid);
 
-        if ((g_strcmp0(mynick, message->from_jid->resourcepart) != 0) && (prefs_get_boolean(PREF_FLASH))) {
+        if (!from_me && !flooding && (prefs_get_boolean(PREF_FLASH))) {
             flash();
         }
 
-        cons_show_incoming_room_message(message->from_jid->resourcepart, mucwin->roomjid, num, mention, triggers, mucwin->unread, window);
+        if (!flooding) {
+            cons_show_incoming_room_message(message->from_jid->resourcepart, mucwin->roomjid, num, mention, triggers, mucwin->unread, window);
+        }
 
         mucwin->unread++;
 
@@ -388,6 +457,7 @@ sv_ev_room_message(ProfMessage* message)
         if (triggers) {
             mucwin->unread_triggers = TRUE;
         }
+        wins_unread_changed(window);
     }
 
     // save timestamp of last received muc message
@@ -396,7 +466,10 @@ sv_ev_room_message(ProfMessage* message)
     }
     mucwin->last_msg_timestamp = g_date_time_new_now_local();
 
-    if (prefs_do_room_notify(is_current, mucwin->roomjid, mynick, message->from_jid->resourcepart, message->plain, mention, triggers != NULL)) {
+    gboolean do_notify = prefs_do_room_notify(is_current, mucwin->roomjid, mynick, message->from_jid->resourcepart, message->plain, mention, triggers != NULL);
+    if (flooding) {
+        mucwin_flood_hold(mucwin, mention, do_notify);
+    } else if (do_notify) {
         auto_jid Jid* jidp = jid_create(mucwin->roomjid);
         if (jidp) {
             notify_room_message(message->from_jid->resourcepart, jidp->localpart, num, message->plain);
@@ -410,7 +483,6 @@ sv_ev_room_message(ProfMessage* message)
     rosterwin_roster();
 
     plugins_post_room_message_display(message->from_jid->barejid, message->from_jid->resourcepart, message->plain);
-    free(message->plain);
     message->plain = old_plain;
 }
 
@@ -418,7 +490,10 @@ void
 sv_ev_incoming_private_message(ProfMessage* message)
 {
     char* old_plain = message->plain;
-    message->plain = plugins_pre_priv_message_display(message->from_jid->fulljid, message->plain);
+    auto_char char* display_plain = plugins_pre_priv_message_display(message->from_jid->fulljid, message->plain);
+    if (display_plain) {
+        message->plain = display_plain;
+    }
 
     ProfPrivateWin* privatewin = wins_get_private(message->from_jid->fulljid);
     if (privatewin == NULL) {
@@ -433,7 +508,6 @@ sv_ev_incoming_private_message(ProfMessage* message)
 
     plugins_post_priv_message_display(message->from_jid->fulljid, message->plain);
 
-    free(message->plain);
     message->plain = old_plain;
     rosterwin_roster();
 }
@@ -442,7 +516,10 @@ void
 sv_ev_delayed_private_message(ProfMessage* message)
 {
     char* old_plain = message->plain;
-    message->plain = plugins_pre_priv_message_display(message->from_jid->fulljid, message->plain);
+    auto_char char* display_plain = plugins_pre_priv_message_display(message->from_jid->fulljid, message->plain);
+    if (display_plain) {
+        message->plain = display_plain;
+    }
 
     ProfPrivateWin* privatewin = wins_get_private(message->from_jid->fulljid);
     if (privatewin == NULL) {
@@ -457,7 +534,6 @@ sv_ev_delayed_private_message(ProfMessage* message)
 
     plugins_post_priv_message_display(message->from_jid->fulljid, message->plain);
 
-    free(message->plain);
     message->plain = old_plain;
 }
 
@@ -469,7 +545,7 @@ sv_ev_outgoing_carbon(ProfMessage* message)
         chatwin = chatwin_new(message->to_jid->barejid);
     }
 
-    chat_state_active(chatwin->state);
+    chat_state_active(chatwin->barejid, chatwin->state);
 
     if (message->enc == PROF_MSG_ENC_OMEMO) {
         chatwin_outgoing_carbon(chatwin, message);
@@ -642,14 +718,8 @@ sv_ev_incoming_message(ProfMessage* message)
 
     if (!chatwin) {
         chatwin = chatwin_new(looking_for_jid);
-        ProfWin* window = (ProfWin*)chatwin;
         new_win = TRUE;
 
-        if (prefs_get_boolean(PREF_MAM)) {
-            win_print_loading_history(window);
-            iq_mam_request(chatwin, g_date_time_add_seconds(message->timestamp, 0)); // copy timestamp
-        }
-
 #ifdef HAVE_OMEMO
         if (!message->is_mam) {
             if (omemo_automatic_start(message->from_jid->barejid)) {
@@ -963,6 +1033,7 @@ sv_ev_roster_update(const char* const barejid, const char* const name,
 {
     roster_update(barejid, name, groups, subscription, pending_out);
     rosterwin_roster();
+    status_bar_names_changed();
 }
 
 void
@@ -970,7 +1041,7 @@ sv_ev_xmpp_stanza(const char* const msg)
 {
     ProfXMLWin* xmlwin = wins_get_xmlconsole();
     if (xmlwin) {
-        xmlwin_show(xmlwin, msg);
+        xmlwin_capture(xmlwin, msg);
     }
 }
 
@@ -1020,9 +1091,7 @@ sv_ev_muc_self_online(const char* const room, const char* const nick, gboolean c
         // show roster if occupants list disabled by default
         ProfMucWin* mucwin = wins_get_muc(room);
         if (mucwin && !prefs_get_boolean(PREF_OCCUPANTS)) {
-            GList* occupants = muc_roster(room);
-            mucwin_roster(mucwin, occupants, NULL);
-            g_list_free(occupants);
+            mucwin_roster(mucwin, NULL);
         }
 
         char* subject = muc_subject(room);
@@ -1068,6 +1137,14 @@ sv_ev_muc_self_online(const char* const room, const char* const nick, gboolean c
         }
     }
 
+    if (muc_mam_catchup(room)) {
+        muc_set_mam_catchup(room, FALSE);
+        ProfMucWin* mucwin = wins_get_muc(room);
+        if (mucwin) {
+            iq_mam_room_request(mucwin);
+        }
+    }
+
     occupantswin_occupants(room);
 }
 
@@ -1303,9 +1380,8 @@ sv_ev_bookmark_autojoin(Bookmark* bookmark)
         nick = strdup(bookmark->nick);
     } else {
         char* account_name = session_get_account_name();
-        ProfAccount* account = accounts_get_account(account_name);
+        const ProfAccount* account = accounts_peek_account(account_name);
         nick = strdup(account->muc_nick);
-        account_free(account);
     }
 
     log_debug("Autojoin %s with nick=%s", bookmark->barejid, nick);
@@ -1318,14 +1394,26 @@ sv_ev_bookmark_autojoin(Bookmark* bookmark)
     }
 }
 
+// removing only ever shortens the text, so it is done in place and whoever
+// owns message->plain keeps owning it
 static void
 _cut(ProfMessage* message, const char* cut)
 {
-    if (strstr(message->plain, cut)) {
-        auto_gcharv gchar** split = g_strsplit(message->plain, cut, -1);
-        free(message->plain);
-        message->plain = g_strjoinv("", split);
+    char* found = strstr(message->plain, cut);
+    if (!found) {
+        return;
+    }
+
+    size_t cut_len = strlen(cut);
+    char* dst = found;
+    const char* src = found;
+    while (found) {
+        memmove(dst, src, found - src);
+        dst += found - src;
+        src = found + cut_len;
+        found = strstr(src, cut);
     }
+    memmove(dst, src, strlen(src) + 1);
 }
 
 static void
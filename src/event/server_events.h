@@ -40,6 +40,7 @@
 #include "xmpp/message.h"
 
 void sv_ev_login_account_success(char* account_name, gboolean secured);
+void sv_ev_login_account_resumed(char* account_name, gboolean secured);
 void sv_ev_lost_connection(void);
 void sv_ev_failed_login(void);
 void sv_ev_room_invite(jabber_invite_t invite_type,
@@ -39,10 +39,12 @@
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/stat.h>
 
 #include "glib.h"
 #include "glib/gstdio.h"
@@ -51,6 +53,7 @@
 #include "common.h"
 #include "config/files.h"
 #include "config/preferences.h"
+#include "tools/compress.h"
 
 #define PROF "prof"
 
@@ -59,6 +62,22 @@ static gchar* mainlogfile = NULL;
 static gboolean user_provided_log = FALSE;
 static log_level_t level_filter;
 
+// Lines are collected in the stdio buffer and written out by log_flush()
+// from the main loop, or right away for warnings and errors.
+#define LOG_BUFSIZE (64 * 1024)
+static char* log_buf = NULL;
+static long log_size = 0;
+static gboolean log_rotate = FALSE;
+static gboolean log_compress = FALSE;
+static long log_maxsize = 0;
+static int rotate_index = 0;
+G_LOCK_DEFINE_STATIC(log_lock);
+
+// coarse clock, the date part of the timestamp only changes once a second
+static gint64 clock_sec = -1;
+static char clock_date[32];
+static char clock_zone[8];
+
 static int stderr_inited;
 static log_level_t stderr_level;
 static int stderr_pipe[2];
@@ -70,37 +89,93 @@ enum {
     STDERR_RETRY_NR = 5,
 };
 
+// highest .NNN.log(.gz) suffix in use, found by one directory scan on the first
+// rotation instead of probing every name on each one
+static int
+_rotate_next_index(const char* const base)
+{
+    if (rotate_index == 0) {
+        auto_gchar gchar* dirname = g_path_get_dirname(base);
+        auto_gchar gchar* prefix = g_path_get_basename(base);
+        size_t prefix_len = strlen(prefix);
+        GDir* dir = g_dir_open(dirname, 0, NULL);
+        if (dir) {
+            const gchar* name;
+            while ((name = g_dir_read_name(dir))) {
+                if (strncmp(name, prefix, prefix_len) != 0 || name[prefix_len] != '.') {
+                    continue;
+                }
+                char* end = NULL;
+                long index = strtol(name + prefix_len + 1, &end, 10);
+                gboolean log_suffix = g_strcmp0(end, ".log") == 0 || g_strcmp0(end, ".log.gz") == 0;
+                if (end != name + prefix_len + 1 && log_suffix && index > rotate_index && index < INT_MAX) {
+                    rotate_index = index;
+                }
+            }
+            g_dir_close(dir);
+        }
+    }
+    return ++rotate_index;
+}
+
 static void
 _rotate_log_file(void)
 {
-    auto_gchar gchar* log_file = g_strdup(mainlogfile);
-    size_t len = strlen(log_file);
-    auto_gchar gchar* log_file_new = malloc(len + 5);
-
     // the mainlog file should always end in '.log', lets remove this last part
     // so that we can have profanity.001.log later
-    if (len > 4) {
-        log_file[len - 4] = '\0';
-    }
+    size_t len = strlen(mainlogfile);
+    auto_gchar gchar* base = g_strndup(mainlogfile, len > 4 ? len - 4 : len);
+    auto_gchar gchar* log_file_new = g_strdup_printf("%s.%03d.log", base, _rotate_next_index(base));
 
-    // find an empty name. from .log -> log.001 -> log.999
-    for (int i = 1; i < 1000; i++) {
-        g_sprintf(log_file_new, "%s.%03d.log", log_file, i);
-        if (!g_file_test(log_file_new, G_FILE_TEST_EXISTS))
-            break;
+    // the open stream follows the rename, other threads keep writing to it
+    // until the new file is swapped in
+    rename(mainlogfile, log_file_new);
+
+    FILE* newp = fopen(mainlogfile, "a");
+    if (!newp) {
+        return;
     }
+    g_chmod(mainlogfile, S_IRUSR | S_IWUSR);
+    char* new_buf = malloc(LOG_BUFSIZE);
+    setvbuf(newp, new_buf, _IOFBF, LOG_BUFSIZE);
 
-    log_close();
+    G_LOCK(log_lock);
+    FILE* oldp = logp;
+    char* old_buf = log_buf;
+    logp = newp;
+    log_buf = new_buf;
+    G_UNLOCK(log_lock);
 
-    if (len > 4) {
-        log_file[len - 4] = '.';
+    fclose(oldp);
+    free(old_buf);
+
+    if (log_compress) {
+        compress_file_async(log_file_new);
     }
 
-    rename(log_file, log_file_new);
+    log_info("Log has been rotated");
+}
 
-    log_init(log_get_filter(), NULL);
+static void
+_log_prefs_update(void)
+{
+    log_rotate = prefs_get_boolean(PREF_LOG_ROTATE) && !user_provided_log;
+    log_maxsize = prefs_get_max_log_size();
+    log_compress = prefs_get_boolean(PREF_LOG_COMPRESS);
+}
 
-    log_info("Log has been rotated");
+// same format as g_date_time_format_iso8601()
+static void
+_log_clock_update(gint64 sec)
+{
+    GDateTime* dt = g_date_time_new_from_unix_local(sec);
+    auto_gchar gchar* date = g_date_time_format(dt, "%Y-%m-%dT%H:%M:%S");
+    auto_gchar gchar* zone = g_date_time_get_utc_offset(dt) == 0 ? g_strdup("Z") : g_date_time_format(dt, "%:z");
+    g_date_time_unref(dt);
+
+    g_strlcpy(clock_date, date, sizeof(clock_date));
+    g_strlcpy(clock_zone, zone, sizeof(clock_zone));
+    clock_sec = sec;
 }
 
 // abbreviation string is the prefix that's used in the log file
@@ -124,48 +199,56 @@ _log_abbreviation_string_from_level(log_level_t level)
 void
 log_debug(const char* const msg, ...)
 {
+    if (PROF_LEVEL_DEBUG < level_filter || !logp) {
+        return;
+    }
+
     va_list arg;
     va_start(arg, msg);
-    GString* fmt_msg = g_string_new(NULL);
-    g_string_vprintf(fmt_msg, msg, arg);
-    log_msg(PROF_LEVEL_DEBUG, PROF, fmt_msg->str);
-    g_string_free(fmt_msg, TRUE);
+    auto_gchar gchar* fmt_msg = g_strdup_vprintf(msg, arg);
+    log_msg(PROF_LEVEL_DEBUG, PROF, fmt_msg);
     va_end(arg);
 }
 
 void
 log_info(const char* const msg, ...)
 {
+    if (PROF_LEVEL_INFO < level_filter || !logp) {
+        return;
+    }
+
     va_list arg;
     va_start(arg, msg);
-    GString* fmt_msg = g_string_new(NULL);
-    g_string_vprintf(fmt_msg, msg, arg);
-    log_msg(PROF_LEVEL_INFO, PROF, fmt_msg->str);
-    g_string_free(fmt_msg, TRUE);
+    auto_gchar gchar* fmt_msg = g_strdup_vprintf(msg, arg);
+    log_msg(PROF_LEVEL_INFO, PROF, fmt_msg);
     va_end(arg);
 }
 
 void
 log_warning(const char* const msg, ...)
 {
+    if (PROF_LEVEL_WARN < level_filter || !logp) {
+        return;
+    }
+
     va_list arg;
     va_start(arg, msg);
-    GString* fmt_msg = g_string_new(NULL);
-    g_string_vprintf(fmt_msg, msg, arg);
-    log_msg(PROF_LEVEL_WARN, PROF, fmt_msg->str);
-    g_string_free(fmt_msg, TRUE);
+    auto_gchar gchar* fmt_msg = g_strdup_vprintf(msg, arg);
+    log_msg(PROF_LEVEL_WARN, PROF, fmt_msg);
     va_end(arg);
 }
 
 void
 log_error(const char* const msg, ...)
 {
+    if (PROF_LEVEL_ERROR < level_filter || !logp) {
+        return;
+    }
+
     va_list arg;
     va_start(arg, msg);
-    GString* fmt_msg = g_string_new(NULL);
-    g_string_vprintf(fmt_msg, msg, arg);
-    log_msg(PROF_LEVEL_ERROR, PROF, fmt_msg->str);
-    g_string_free(fmt_msg, TRUE);
+    auto_gchar gchar* fmt_msg = g_strdup_vprintf(msg, arg);
+    log_msg(PROF_LEVEL_ERROR, PROF, fmt_msg);
     va_end(arg);
 }
 
@@ -182,6 +265,18 @@ log_init(log_level_t filter, char* log_file)
 
     logp = fopen(mainlogfile, "a");
     g_chmod(mainlogfile, S_IRUSR | S_IWUSR);
+
+    log_size = 0;
+    if (logp) {
+        log_buf = malloc(LOG_BUFSIZE);
+        setvbuf(logp, log_buf, _IOFBF, LOG_BUFSIZE);
+
+        struct stat st;
+        if (fstat(fileno(logp), &st) == 0) {
+            log_size = st.st_size;
+        }
+    }
+    _log_prefs_update();
 }
 
 const gchar*
@@ -203,30 +298,58 @@ log_close(void)
     mainlogfile = NULL;
     if (logp) {
         fclose(logp);
+        logp = NULL;
     }
+    free(log_buf);
+    log_buf = NULL;
 }
 
 void
-log_msg(log_level_t level, const char* const area, const char* const msg)
+log_flush(void)
 {
-    if (level >= level_filter && logp) {
-        GDateTime* dt = g_date_time_new_now_local();
+    G_LOCK(log_lock);
+    if (logp) {
+        fflush(logp);
+    }
+    G_UNLOCK(log_lock);
 
-        char* level_str = _log_abbreviation_string_from_level(level);
+    // picks up /log rotate and /log maxsize changes
+    _log_prefs_update();
+}
 
-        auto_gchar gchar* date_fmt = g_date_time_format_iso8601(dt);
+void
+log_msg(log_level_t level, const char* const area, const char* const msg)
+{
+    if (level < level_filter || !logp) {
+        return;
+    }
 
-        fprintf(logp, "%s: %s: %s: %s\n", date_fmt, area, level_str, msg);
-        g_date_time_unref(dt);
+    gint64 now = g_get_real_time();
+    gint64 sec = now / G_USEC_PER_SEC;
+    int usec = now % G_USEC_PER_SEC;
+    char* level_str = _log_abbreviation_string_from_level(level);
 
+    G_LOCK(log_lock);
+    if (sec != clock_sec) {
+        _log_clock_update(sec);
+    }
+    int written = usec ? fprintf(logp, "%s.%06d%s: %s: %s: %s\n", clock_date, usec, clock_zone, area, level_str, msg)
+                       : fprintf(logp, "%s%s: %s: %s: %s\n", clock_date, clock_zone, area, level_str, msg);
+    if (written > 0) {
+        log_size += written;
+    }
+    if (level >= PROF_LEVEL_WARN) {
         fflush(logp);
+    }
+    gboolean rotate = log_rotate && log_size >= log_maxsize;
+    if (rotate) {
+        // only one thread rotates, the new file starts empty
+        log_size = 0;
+    }
+    G_UNLOCK(log_lock);
 
-        if (prefs_get_boolean(PREF_LOG_ROTATE) && !user_provided_log) {
-            long result = ftell(logp);
-            if (result != -1 && result >= prefs_get_max_log_size()) {
-                _rotate_log_file();
-            }
-        }
+    if (rotate) {
+        _rotate_log_file();
     }
 }
 
@@ -61,6 +61,8 @@ static char* log_file = NULL;
 static char* account_name = NULL;
 static char* config_file = NULL;
 static char* theme_name = NULL;
+static gboolean profile_startup = FALSE;
+static char* headless = NULL;
 
 int
 main(int argc, char** argv)
@@ -82,6 +84,8 @@ main(int argc, char** argv)
         { "config", 'c', 0, G_OPTION_ARG_STRING, &config_file, "Use an alternative configuration file", NULL },
         { "logfile", 'f', 0, G_OPTION_ARG_STRING, &log_file, "Specify log file", NULL },
         { "theme", 't', 0, G_OPTION_ARG_STRING, &theme_name, "Specify theme name", NULL },
+        { "profile-startup", 0, 0, G_OPTION_ARG_NONE, &profile_startup, "Show the time taken by each startup phase", NULL },
+        { "headless", 0, 0, G_OPTION_ARG_FILENAME, &headless, "Run without a terminal, taking commands on a control socket", "SOCKET" },
         { NULL }
     };
 
@@ -171,7 +175,7 @@ main(int argc, char** argv)
     }
 
     /* Default logging WARN */
-    prof_run(log ? log : "WARN", account_name, config_file, log_file, theme_name);
+    prof_run(log ? log : "WARN", account_name, config_file, log_file, theme_name, profile_startup, headless);
 
     /* Free resources allocated by GOptionContext */
     g_free(log);
@@ -179,6 +183,7 @@ main(int argc, char** argv)
     g_free(config_file);
     g_free(log_file);
     g_free(theme_name);
+    g_free(headless);
 
     return 0;
 }
@@ -35,6 +35,9 @@
 #include "config.h"
 
 #include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
 #include <signal/signal_protocol.h>
 #include <signal/signal_protocol_types.h>
 
@@ -42,9 +45,22 @@
 #include "omemo/omemo.h"
 #include "omemo/crypto.h"
 
-#define AES256_GCM_TAG_LENGTH  16
+#define AES256_GCM_TAG_LENGTH  OMEMO_AESGCM_TAG_LENGTH
 #define AES256_GCM_BUFFER_SIZE 1024
 
+struct aes256gcm_stream_t
+{
+    gcry_cipher_hd_t hd;
+    bool encrypt;
+    // plaintext bytes still to be read when encrypting
+    off_t remaining;
+    // encrypting: the tag and how much of it was handed out
+    // decrypting: the trailing bytes held back, they may be the tag
+    unsigned char tag[AES256_GCM_TAG_LENGTH];
+    size_t tag_len;
+    bool tag_ready;
+};
+
 int
 omemo_crypto_init(void)
 {
@@ -466,6 +482,159 @@ out:
     return res;
 }
 
+aes256gcm_stream_t*
+aes256gcm_stream_new(unsigned char key[], unsigned char nonce[], bool encrypt,
+                     off_t file_size, gcry_error_t* res)
+{
+    gcry_cipher_hd_t hd;
+
+    *res = gcry_cipher_open(&hd, GCRY_CIPHER_AES256, GCRY_CIPHER_MODE_GCM,
+                            GCRY_CIPHER_SECURE);
+    if (*res != GPG_ERR_NO_ERROR) {
+        return NULL;
+    }
+
+    *res = gcry_cipher_setkey(hd, key, OMEMO_AESGCM_KEY_LENGTH);
+    if (*res == GPG_ERR_NO_ERROR) {
+        *res = gcry_cipher_setiv(hd, nonce, OMEMO_AESGCM_NONCE_LENGTH);
+    }
+    if (*res != GPG_ERR_NO_ERROR) {
+        gcry_cipher_close(hd);
+        return NULL;
+    }
+
+    aes256gcm_stream_t* stream = malloc(sizeof(aes256gcm_stream_t));
+    stream->hd = hd;
+    stream->encrypt = encrypt;
+    stream->remaining = encrypt ? file_size : 0;
+    stream->tag_len = 0;
+    stream->tag_ready = false;
+
+    return stream;
+}
+
+gcry_error_t
+aes256gcm_stream_read(aes256gcm_stream_t* stream, FILE* in,
+                      unsigned char* buffer, size_t len, size_t* read_len)
+{
+    gcry_error_t res = GPG_ERR_NO_ERROR;
+    *read_len = 0;
+
+    if (stream->remaining > 0) {
+        size_t size = len;
+        if ((off_t)size > stream->remaining) {
+            size = stream->remaining;
+        }
+
+        size_t bytes = fread(buffer, 1, size, in);
+        if (bytes == 0) {
+            // the file got shorter than announced
+            return gcry_error_from_errno(ferror(in) ? errno : EIO);
+        }
+        stream->remaining -= bytes;
+
+        res = gcry_cipher_encrypt(stream->hd, buffer, bytes, NULL, 0);
+        if (res == GPG_ERR_NO_ERROR) {
+            *read_len = bytes;
+        }
+        return res;
+    }
+
+    // Plaintext is done, hand out the authentication tag.
+    if (!stream->tag_ready) {
+        res = gcry_cipher_gettag(stream->hd, stream->tag, AES256_GCM_TAG_LENGTH);
+        if (res != GPG_ERR_NO_ERROR) {
+            return res;
+        }
+        stream->tag_ready = true;
+    }
+
+    size_t size = AES256_GCM_TAG_LENGTH - stream->tag_len;
+    if (size > len) {
+        size = len;
+    }
+    memcpy(buffer, stream->tag + stream->tag_len, size);
+    stream->tag_len += size;
+    *read_len = size;
+
+    return res;
+}
+
+static gcry_error_t
+_aes256gcm_stream_output(aes256gcm_stream_t* stream, FILE* out,
+                         const unsigned char* data, size_t len)
+{
+    unsigned char buffer[AES256_GCM_BUFFER_SIZE];
+
+    while (len > 0) {
+        size_t size = len < AES256_GCM_BUFFER_SIZE ? len : AES256_GCM_BUFFER_SIZE;
+        gcry_error_t res = gcry_cipher_decrypt(stream->hd, buffer, size, data, size);
+        if (res != GPG_ERR_NO_ERROR) {
+            return res;
+        }
+        if (fwrite(buffer, 1, size, out) != size) {
+            return gcry_error_from_errno(errno);
+        }
+        data += size;
+        len -= size;
+    }
+
+    return GPG_ERR_NO_ERROR;
+}
+
+gcry_error_t
+aes256gcm_stream_write(aes256gcm_stream_t* stream, FILE* out,
+                       const unsigned char* data, size_t len)
+{
+    // Everything except the last AES256_GCM_TAG_LENGTH bytes seen so far is
+    // ciphertext, the rest stays held back until more data or the end.
+    if (stream->tag_len + len <= AES256_GCM_TAG_LENGTH) {
+        memcpy(stream->tag + stream->tag_len, data, len);
+        stream->tag_len += len;
+        return GPG_ERR_NO_ERROR;
+    }
+
+    size_t emit = stream->tag_len + len - AES256_GCM_TAG_LENGTH;
+    gcry_error_t res;
+
+    if (emit < stream->tag_len) {
+        res = _aes256gcm_stream_output(stream, out, stream->tag, emit);
+        memmove(stream->tag, stream->tag + emit, stream->tag_len - emit);
+        stream->tag_len -= emit;
+        memcpy(stream->tag + stream->tag_len, data, len);
+        stream->tag_len += len;
+        return res;
+    }
+
+    res = _aes256gcm_stream_output(stream, out, stream->tag, stream->tag_len);
+    if (res != GPG_ERR_NO_ERROR) {
+        return res;
+    }
+    size_t emit_data = emit - stream->tag_len;
+    res = _aes256gcm_stream_output(stream, out, data, emit_data);
+    memcpy(stream->tag, data + emit_data, AES256_GCM_TAG_LENGTH);
+    stream->tag_len = AES256_GCM_TAG_LENGTH;
+
+    return res;
+}
+
+gcry_error_t
+aes256gcm_stream_finish(aes256gcm_stream_t* stream)
+{
+    return gcry_cipher_checktag(stream->hd, stream->tag, stream->tag_len);
+}
+
+void
+aes256gcm_stream_free(aes256gcm_stream_t* stream)
+{
+    if (!stream) {
+        return;
+    }
+    gcry_cipher_close(stream->hd);
+    memset(stream->tag, 0, sizeof(stream->tag));
+    free(stream);
+}
+
 char*
 aes256gcm_create_secure_fragment(unsigned char* key, unsigned char* nonce)
 {
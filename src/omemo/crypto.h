@@ -187,5 +187,24 @@ int aes128gcm_decrypt(unsigned char* plaintext,
 gcry_error_t aes256gcm_crypt_file(FILE* in, FILE* out, off_t file_size,
                                   unsigned char key[], unsigned char nonce[], bool encrypt);
 
+/*
+ * Encrypts or decrypts a file while it is transferred, with constant memory.
+ *
+ * Encrypting streams read file_size bytes of plaintext with
+ * aes256gcm_stream_read() and append the tag. Decrypting streams take the
+ * ciphertext including the trailing tag in chunks of any size through
+ * aes256gcm_stream_write(), aes256gcm_stream_finish() verifies the tag.
+ */
+typedef struct aes256gcm_stream_t aes256gcm_stream_t;
+
+aes256gcm_stream_t* aes256gcm_stream_new(unsigned char key[], unsigned char nonce[], bool encrypt,
+                                         off_t file_size, gcry_error_t* res);
+gcry_error_t aes256gcm_stream_read(aes256gcm_stream_t* stream, FILE* in,
+                                   unsigned char* buffer, size_t len, size_t* read_len);
+gcry_error_t aes256gcm_stream_write(aes256gcm_stream_t* stream, FILE* out,
+                                    const unsigned char* data, size_t len);
+gcry_error_t aes256gcm_stream_finish(aes256gcm_stream_t* stream);
+void aes256gcm_stream_free(aes256gcm_stream_t* stream);
+
 char* aes256gcm_create_secure_fragment(unsigned char* key,
                                        unsigned char* nonce);
@@ -52,9 +52,11 @@
 #include "config/files.h"
 #include "config/preferences.h"
 #include "log.h"
+#include "stats.h"
 #include "omemo/crypto.h"
 #include "omemo/omemo.h"
 #include "omemo/store.h"
+#include "tools/base64.h"
 #include "ui/ui.h"
 #include "ui/window_list.h"
 #include "xmpp/connection.h"
@@ -66,8 +68,12 @@
 #define AESGCM_URL_NONCE_LEN (2 * OMEMO_AESGCM_NONCE_LENGTH)
 #define AESGCM_URL_KEY_LEN   (2 * OMEMO_AESGCM_KEY_LENGTH)
 
+// seconds without new sessions before used pre keys are replaced
+#define OMEMO_PRE_KEY_REPLENISH_DELAY 2
+
 static void _generate_pre_keys(int count);
 static void _generate_signed_pre_key(void);
+static void _pre_key_used(uint32_t pre_key_id);
 static gboolean _load_identity(void);
 static void _load_trust(void);
 static void _load_sessions(void);
@@ -81,7 +87,12 @@ static char* _omemo_fingerprint(ec_public_key* identity, gboolean formatted);
 static unsigned char* _omemo_fingerprint_decode(const char* const fingerprint, size_t* len);
 static char* _omemo_unformat_fingerprint(const char* const fingerprint_formatted);
 static void _cache_device_identity(const char* const jid, uint32_t device_id, ec_public_key* identity);
+static Autocomplete _fingerprint_ac(const char* const jid);
 static void _acquire_sender_devices_list(void);
+static char* _omemo_message_send(ProfWin* win, const char* const message, gboolean request_receipt, gboolean muc, const char* const replace_id);
+static char* _omemo_message_recv(const char* const from_jid, uint32_t sid,
+                                 const unsigned char* const iv, size_t iv_len, GList* keys,
+                                 const unsigned char* const payload, size_t payload_len, gboolean muc, gboolean* trusted);
 
 typedef gboolean (*OmemoDeviceListHandler)(const char* const jid, GList* device_list);
 
@@ -104,6 +115,9 @@ typedef struct omemo_context
     prof_keyfile_t sessions;
     prof_keyfile_t knowndevices;
     GHashTable* known_devices;
+    // ids of pre keys used by new sessions, replaced by _replenish_pre_keys()
+    GArray* used_pre_keys;
+    guint replenish_source;
     gboolean loaded;
 } omemo_context;
 
@@ -227,6 +241,8 @@ omemo_on_connect(ProfAccount* account)
     omemo_ctx.device_list = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)g_list_free);
     omemo_ctx.device_list_handler = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
     omemo_ctx.known_devices = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)g_hash_table_destroy);
+    omemo_ctx.used_pre_keys = g_array_new(FALSE, FALSE, sizeof(uint32_t));
+    omemo_ctx.replenish_source = 0;
 
     auto_gchar gchar* omemo_dir = files_file_in_account_data_path(DIR_OMEMO, account->jid, NULL);
     if (!omemo_dir) {
@@ -243,8 +259,12 @@ omemo_on_connect(ProfAccount* account)
         _load_trust();
     }
 
-    if (load_custom_keyfile(&omemo_ctx.sessions, g_strdup_printf("%s/%s", omemo_dir, "sessions.txt"))) {
-        _load_sessions();
+    auto_gchar gchar* sessions_filename = g_strdup_printf("%s/%s", omemo_dir, "sessions.txt");
+    auto_gchar gchar* sessions_db_filename = g_strdup_printf("%s/%s", omemo_dir, "sessions.db");
+    if (!session_db_open(sessions_db_filename, sessions_filename)) {
+        if (load_custom_keyfile(&omemo_ctx.sessions, g_strdup(sessions_filename))) {
+            _load_sessions();
+        }
     }
 
     if (load_custom_keyfile(&omemo_ctx.knowndevices, g_strdup_printf("%s/%s", omemo_dir, "known_devices.txt"))) {
@@ -257,6 +277,18 @@ omemo_on_connect(ProfAccount* account)
 void
 omemo_on_disconnect(void)
 {
+    omemo_requests_clear();
+
+    // pre keys still missing are generated when the identity is loaded again
+    if (omemo_ctx.replenish_source) {
+        g_source_remove(omemo_ctx.replenish_source);
+        omemo_ctx.replenish_source = 0;
+    }
+    if (omemo_ctx.used_pre_keys) {
+        g_array_free(omemo_ctx.used_pre_keys, TRUE);
+        omemo_ctx.used_pre_keys = NULL;
+    }
+
     if (!omemo_ctx.loaded) {
         return;
     }
@@ -267,6 +299,7 @@ omemo_on_disconnect(void)
 
     free_keyfile(&omemo_ctx.knowndevices);
     free_keyfile(&omemo_ctx.sessions);
+    session_db_close();
     free_keyfile(&omemo_ctx.trust);
     free_keyfile(&omemo_ctx.identity);
 
@@ -300,11 +333,11 @@ omemo_generate_crypto_materials(ProfAccount* account)
     signal_protocol_key_helper_generate_identity_key_pair(&omemo_ctx.identity_key_pair, omemo_ctx.signal);
 
     ec_public_key_serialize(&omemo_ctx.identity_key_store.public, ratchet_identity_key_pair_get_public(omemo_ctx.identity_key_pair));
-    auto_gchar gchar* identity_key_public = g_base64_encode(signal_buffer_data(omemo_ctx.identity_key_store.public), signal_buffer_len(omemo_ctx.identity_key_store.public));
+    auto_gchar gchar* identity_key_public = base64_encode(signal_buffer_data(omemo_ctx.identity_key_store.public), signal_buffer_len(omemo_ctx.identity_key_store.public));
     g_key_file_set_string(omemo_ctx.identity.keyfile, OMEMO_STORE_GROUP_IDENTITY, OMEMO_STORE_KEY_IDENTITY_KEY_PUBLIC, identity_key_public);
 
     ec_private_key_serialize(&omemo_ctx.identity_key_store.private, ratchet_identity_key_pair_get_private(omemo_ctx.identity_key_pair));
-    auto_gchar gchar* identity_key_private = g_base64_encode(signal_buffer_data(omemo_ctx.identity_key_store.private), signal_buffer_len(omemo_ctx.identity_key_store.private));
+    auto_gchar gchar* identity_key_private = base64_encode(signal_buffer_data(omemo_ctx.identity_key_store.private), signal_buffer_len(omemo_ctx.identity_key_store.private));
     g_key_file_set_string(omemo_ctx.identity.keyfile, OMEMO_STORE_GROUP_IDENTITY, OMEMO_STORE_KEY_IDENTITY_KEY_PRIVATE, identity_key_private);
 
     /* Registration ID */
@@ -387,7 +420,17 @@ omemo_start_session(const char* const barejid)
 
         GList* device_id;
         for (device_id = device_list; device_id != NULL; device_id = device_id->next) {
-            omemo_bundle_request(barejid, GPOINTER_TO_INT(device_id->data), omemo_start_device_session_handle_bundle, free, strdup(barejid));
+            uint32_t id = GPOINTER_TO_INT(device_id->data);
+            signal_protocol_address address = {
+                .name = barejid,
+                .name_len = strlen(barejid),
+                .device_id = id,
+            };
+            // established sessions don't need a fresh bundle
+            if (contains_session(&address, omemo_ctx.session_store)) {
+                continue;
+            }
+            omemo_session_bundle_request(barejid, id);
         }
     }
 }
@@ -395,13 +438,9 @@ omemo_start_session(const char* const barejid)
 void
 omemo_start_muc_sessions(const char* const roomjid)
 {
-    GList* members = muc_members(roomjid);
-    GList* iter;
-    for (iter = members; iter != NULL; iter = iter->next) {
-        auto_jid Jid* jid = jid_create(iter->data);
-        omemo_start_session(jid->barejid);
+    for (const GList* iter = muc_member_barejids(roomjid); iter != NULL; iter = iter->next) {
+        omemo_start_session(iter->data);
     }
-    g_list_free(members);
 }
 
 gboolean
@@ -677,8 +716,84 @@ out:
     SIGNAL_UNREF(identity_key);
 }
 
+/*
+ * Wraps key_tag once for every device of barejid we have a session with and
+ * prepends the results to keys. Our own device is skipped according to
+ * <https://xmpp.org/extensions/xep-0384.html#encrypt>.
+ */
+static GList*
+_omemo_encrypt_key_for_devices(const char* const barejid, GList* device_ids, const unsigned char* const key_tag, GList* keys)
+{
+    gboolean ours = equals_our_barejid(barejid);
+    size_t name_len = strlen(barejid);
+
+    GList* device_ids_iter;
+    for (device_ids_iter = device_ids; device_ids_iter != NULL; device_ids_iter = device_ids_iter->next) {
+        int res;
+        ciphertext_message* ciphertext;
+        session_cipher* cipher;
+        signal_protocol_address address = {
+            .name = barejid,
+            .name_len = name_len,
+            .device_id = GPOINTER_TO_INT(device_ids_iter->data)
+        };
+
+        if (ours && address.device_id == omemo_ctx.device_id) {
+            log_debug("[OMEMO][SEND] Skipping %d (my device) ", address.device_id);
+            continue;
+        }
+
+        log_debug("[OMEMO][SEND] recipients with device id %d for %s", address.device_id, barejid);
+        res = session_cipher_create(&cipher, omemo_ctx.store, &address, omemo_ctx.signal);
+        if (res != SG_SUCCESS) {
+            log_error("[OMEMO][SEND] cannot create cipher for %s device id %d - code: %d", address.name, address.device_id, res);
+            continue;
+        }
+
+        res = session_cipher_encrypt(cipher, key_tag, AES128_GCM_KEY_LENGTH + AES128_GCM_TAG_LENGTH, &ciphertext);
+        session_cipher_free(cipher);
+        if (res != SG_SUCCESS) {
+            log_info("[OMEMO][SEND] cannot encrypt key for %s device id %d - code: %d", address.name, address.device_id, res);
+            continue;
+        }
+        signal_buffer* buffer = ciphertext_message_get_serialized(ciphertext);
+        omemo_key_t* key = malloc(sizeof(omemo_key_t));
+        key->length = signal_buffer_len(buffer);
+        key->data = malloc(key->length);
+        memcpy(key->data, signal_buffer_data(buffer), key->length);
+        key->device_id = address.device_id;
+        key->prekey = ciphertext_message_get_type(ciphertext) == CIPHERTEXT_PREKEY_TYPE;
+        keys = g_list_prepend(keys, key);
+        SIGNAL_UNREF(ciphertext);
+    }
+
+    return keys;
+}
+
 char*
 omemo_on_message_send(ProfWin* win, const char* const message, gboolean request_receipt, gboolean muc, const char* const replace_id)
+{
+    gint64 start = g_get_monotonic_time();
+    char* id = _omemo_message_send(win, message, request_receipt, muc, replace_id);
+    stats_time(STATS_TIMER_OMEMO_ENCRYPT, start);
+
+    return id;
+}
+
+char*
+omemo_on_message_recv(const char* const from_jid, uint32_t sid,
+                      const unsigned char* const iv, size_t iv_len, GList* keys,
+                      const unsigned char* const payload, size_t payload_len, gboolean muc, gboolean* trusted)
+{
+    gint64 start = g_get_monotonic_time();
+    char* plaintext = _omemo_message_recv(from_jid, sid, iv, iv_len, keys, payload, payload_len, muc, trusted);
+    stats_time(STATS_TIMER_OMEMO_DECRYPT, start);
+
+    return plaintext;
+}
+
+static char*
+_omemo_message_send(ProfWin* win, const char* const message, gboolean request_receipt, gboolean muc, const char* const replace_id)
 {
     char* id = NULL;
     int res;
@@ -710,30 +825,25 @@ omemo_on_message_send(ProfWin* win, const char* const message, gboolean request_
     memcpy(key_tag, key, AES128_GCM_KEY_LENGTH);
     memcpy(key_tag + AES128_GCM_KEY_LENGTH, tag, AES128_GCM_TAG_LENGTH);
 
-    // List of barejids of the recipients of this message
-    GList* recipients = NULL;
+    // Bare JIDs of the recipients of this message, in a MUC kept by the room
+    // so several occupants sharing a bare JID are encrypted for once
+    const GList* recipients = NULL;
+    GList chat_recipient = { 0 };
     if (muc) {
         ProfMucWin* mucwin = (ProfMucWin*)win;
         assert(mucwin->memcheck == PROFMUCWIN_MEMCHECK);
-        GList* members = muc_members(mucwin->roomjid);
-        GList* iter;
-        for (iter = members; iter != NULL; iter = iter->next) {
-            auto_jid Jid* jidp = jid_create(iter->data);
-            recipients = g_list_append(recipients, strdup(jidp->barejid));
-        }
-        g_list_free(members);
+        recipients = muc_member_barejids(mucwin->roomjid);
     } else {
         ProfChatWin* chatwin = (ProfChatWin*)win;
         assert(chatwin->memcheck == PROFCHATWIN_MEMCHECK);
-        recipients = g_list_append(recipients, strdup(chatwin->barejid));
+        chat_recipient.data = chatwin->barejid;
+        recipients = &chat_recipient;
     }
 
-    GList* device_ids_iter;
-
     omemo_ctx.identity_key_store.recv = false;
 
     // Encrypt keys for the recipients
-    GList* recipients_iter;
+    const GList* recipients_iter;
     for (recipients_iter = recipients; recipients_iter != NULL; recipients_iter = recipients_iter->next) {
         GList* recipient_device_id = NULL;
         recipient_device_id = g_hash_table_lookup(omemo_ctx.device_list, recipients_iter->data);
@@ -743,53 +853,9 @@ omemo_on_message_send(ProfWin* win, const char* const message, gboolean request_
             continue;
         }
 
-        for (device_ids_iter = recipient_device_id; device_ids_iter != NULL; device_ids_iter = device_ids_iter->next) {
-            int res;
-            ciphertext_message* ciphertext;
-            session_cipher* cipher;
-            signal_protocol_address address = {
-                .name = recipients_iter->data,
-                .name_len = strlen(recipients_iter->data),
-                .device_id = GPOINTER_TO_INT(device_ids_iter->data)
-            };
-
-            // Don't encrypt for this device (according to
-            // <https://xmpp.org/extensions/xep-0384.html#encrypt>).
-            // Yourself as recipients in case of MUC
-            if (equals_our_barejid(recipients_iter->data)) {
-                if (GPOINTER_TO_INT(device_ids_iter->data) == omemo_ctx.device_id) {
-                    log_debug("[OMEMO][SEND] Skipping %d (my device) ", GPOINTER_TO_INT(device_ids_iter->data));
-                    continue;
-                }
-            }
-
-            log_debug("[OMEMO][SEND] recipients with device id %d for %s", GPOINTER_TO_INT(device_ids_iter->data), recipients_iter->data);
-            res = session_cipher_create(&cipher, omemo_ctx.store, &address, omemo_ctx.signal);
-            if (res != SG_SUCCESS) {
-                log_error("[OMEMO][SEND] cannot create cipher for %s device id %d - code: %d", address.name, address.device_id, res);
-                continue;
-            }
-
-            res = session_cipher_encrypt(cipher, key_tag, AES128_GCM_KEY_LENGTH + AES128_GCM_TAG_LENGTH, &ciphertext);
-            session_cipher_free(cipher);
-            if (res != SG_SUCCESS) {
-                log_info("[OMEMO][SEND] cannot encrypt key for %s device id %d - code: %d", address.name, address.device_id, res);
-                continue;
-            }
-            signal_buffer* buffer = ciphertext_message_get_serialized(ciphertext);
-            omemo_key_t* key = malloc(sizeof(omemo_key_t));
-            key->length = signal_buffer_len(buffer);
-            key->data = malloc(key->length);
-            memcpy(key->data, signal_buffer_data(buffer), key->length);
-            key->device_id = GPOINTER_TO_INT(device_ids_iter->data);
-            key->prekey = ciphertext_message_get_type(ciphertext) == CIPHERTEXT_PREKEY_TYPE;
-            keys = g_list_append(keys, key);
-            SIGNAL_UNREF(ciphertext);
-        }
+        keys = _omemo_encrypt_key_for_devices(recipients_iter->data, recipient_device_id, key_tag, keys);
     }
 
-    g_list_free_full(recipients, free);
-
     // Don't send the message if no key could be encrypted.
     // (Since none of the recipients would be able to read the message.)
     if (keys == NULL) {
@@ -803,45 +869,7 @@ omemo_on_message_send(ProfWin* win, const char* const message, gboolean request_
     // Encrypt keys for the sender
     if (!muc) {
         GList* sender_device_id = g_hash_table_lookup(omemo_ctx.device_list, jid->barejid);
-
-        for (device_ids_iter = sender_device_id; device_ids_iter != NULL; device_ids_iter = device_ids_iter->next) {
-            int res;
-            ciphertext_message* ciphertext;
-            session_cipher* cipher;
-            signal_protocol_address address = {
-                .name = jid->barejid,
-                .name_len = strlen(jid->barejid),
-                .device_id = GPOINTER_TO_INT(device_ids_iter->data)
-            };
-            log_debug("[OMEMO][SEND][Sender] Sending to device %d for %s ", address.device_id, address.name);
-            // Don't encrypt for this device (according to
-            // <https://xmpp.org/extensions/xep-0384.html#encrypt>).
-            if (address.device_id == omemo_ctx.device_id) {
-                continue;
-            }
-
-            res = session_cipher_create(&cipher, omemo_ctx.store, &address, omemo_ctx.signal);
-            if (res != 0) {
-                log_info("[OMEMO][SEND][Sender] cannot create cipher for %s device id %d", address.name, address.device_id);
-                continue;
-            }
-
-            res = session_cipher_encrypt(cipher, key_tag, AES128_GCM_KEY_LENGTH + AES128_GCM_TAG_LENGTH, &ciphertext);
-            session_cipher_free(cipher);
-            if (res != 0) {
-                log_info("[OMEMO][SEND][Sender] cannot encrypt key for %s device id %d", address.name, address.device_id);
-                continue;
-            }
-            signal_buffer* buffer = ciphertext_message_get_serialized(ciphertext);
-            omemo_key_t* key = malloc(sizeof(omemo_key_t));
-            key->length = signal_buffer_len(buffer);
-            key->data = malloc(key->length);
-            memcpy(key->data, signal_buffer_data(buffer), key->length);
-            key->device_id = GPOINTER_TO_INT(device_ids_iter->data);
-            key->prekey = ciphertext_message_get_type(ciphertext) == CIPHERTEXT_PREKEY_TYPE;
-            keys = g_list_append(keys, key);
-            SIGNAL_UNREF(ciphertext);
-        }
+        keys = _omemo_encrypt_key_for_devices(jid->barejid, sender_device_id, key_tag, keys);
     }
 
     // Send the message
@@ -866,10 +894,10 @@ out:
     return id;
 }
 
-char*
-omemo_on_message_recv(const char* const from_jid, uint32_t sid,
-                      const unsigned char* const iv, size_t iv_len, GList* keys,
-                      const unsigned char* const payload, size_t payload_len, gboolean muc, gboolean* trusted)
+static char*
+_omemo_message_recv(const char* const from_jid, uint32_t sid,
+                    const unsigned char* const iv, size_t iv_len, GList* keys,
+                    const unsigned char* const payload, size_t payload_len, gboolean muc, gboolean* trusted)
 {
     unsigned char* plaintext = NULL;
     auto_jid Jid* sender = NULL;
@@ -895,16 +923,10 @@ omemo_on_message_recv(const char* const from_jid, uint32_t sid,
     }
 
     if (muc) {
-        GList* roster = muc_roster(from->barejid);
-        GList* iter;
-        for (iter = roster; iter != NULL; iter = iter->next) {
-            Occupant* occupant = (Occupant*)iter->data;
-            if (g_strcmp0(occupant->nick, from->resourcepart) == 0) {
-                sender = jid_create(occupant->jid);
-                break;
-            }
+        Occupant* occupant = muc_roster_item(from->barejid, from->resourcepart);
+        if (occupant) {
+            sender = jid_create(occupant->jid);
         }
-        g_list_free(roster);
         if (!sender) {
             log_warning("[OMEMO][RECV] cannot find MUC message sender fulljid");
             return NULL;
@@ -949,21 +971,13 @@ omemo_on_message_recv(const char* const from_jid, uint32_t sid,
         signal_buffer_free(identity_buffer);
 
         /* Replace used pre_key in bundle */
-        uint32_t pre_key_id = pre_key_signal_message_get_pre_key_id(message);
-        ec_key_pair* ec_pair;
-        session_pre_key* new_pre_key;
-        curve_generate_key_pair(omemo_ctx.signal, &ec_pair);
-        session_pre_key_create(&new_pre_key, pre_key_id, ec_pair);
-        signal_protocol_pre_key_store_key(omemo_ctx.store, new_pre_key);
-        SIGNAL_UNREF(new_pre_key);
+        _pre_key_used(pre_key_signal_message_get_pre_key_id(message));
         SIGNAL_UNREF(message);
-        SIGNAL_UNREF(ec_pair);
-        omemo_bundle_publish(true);
 
         if (res == 0) {
             /* Start a new session */
             log_debug("[OMEMO][RECV] Res is 0 => omemo_bundle_request");
-            omemo_bundle_request(sender->barejid, sid, omemo_start_device_session_handle_bundle, free, strdup(sender->barejid));
+            omemo_session_bundle_request(sender->barejid, sid);
         }
     } else {
         log_debug("[OMEMO][RECV] decrypting message with existing session");
@@ -1077,24 +1091,18 @@ omemo_is_trusted_identity(const char* const jid, const char* const fingerprint)
         return FALSE;
     }
 
-    signal_protocol_address address = {
-        .name = jid,
-        .name_len = strlen(jid),
-        .device_id = GPOINTER_TO_INT(device_id),
-    };
-
-    size_t fingerprint_len;
-    unsigned char* fingerprint_raw = _omemo_fingerprint_decode(fingerprint, &fingerprint_len);
-    unsigned char djb_type[] = { '\x05' };
-    signal_buffer* buffer = signal_buffer_create(djb_type, 1);
-    buffer = signal_buffer_append(buffer, fingerprint_raw, fingerprint_len);
-
-    gboolean trusted = is_trusted_identity(&address, signal_buffer_data(buffer), signal_buffer_len(buffer), &omemo_ctx.identity_key_store);
+    // the trusted identity key is the fingerprint preceded by the DJB type
+    gboolean trusted = FALSE;
+    GHashTable* trusted_keys = g_hash_table_lookup(omemo_ctx.identity_key_store.trusted, jid);
+    signal_buffer* trusted_key = trusted_keys ? g_hash_table_lookup(trusted_keys, device_id) : NULL;
+    if (trusted_key && signal_buffer_len(trusted_key) > 1) {
+        size_t fingerprint_len;
+        auto_guchar guchar* fingerprint_raw = _omemo_fingerprint_decode(fingerprint, &fingerprint_len);
+        trusted = fingerprint_len == signal_buffer_len(trusted_key) - 1
+                  && memcmp(signal_buffer_data(trusted_key) + 1, fingerprint_raw, fingerprint_len) == 0;
+    }
     log_debug("[OMEMO] Device trusted %s (%d): %d", jid, GPOINTER_TO_INT(device_id), trusted);
 
-    free(fingerprint_raw);
-    signal_buffer_free(buffer);
-
     return trusted;
 }
 
@@ -1203,7 +1211,7 @@ omemo_trust(const char* const jid, const char* const fingerprint_formatted)
     free(fingerprint_raw);
     signal_buffer_free(buffer);
 
-    omemo_bundle_request(jid, device_id, omemo_start_device_session_handle_bundle, free, strdup(jid));
+    omemo_session_bundle_request(jid, device_id);
 }
 
 void
@@ -1309,7 +1317,7 @@ _handle_own_device_list(const char* const jid, GList* device_list)
     log_debug("[OMEMO] Request OMEMO Bundles for our devices");
     GList* device_id;
     for (device_id = device_list; device_id != NULL; device_id = device_id->next) {
-        omemo_bundle_request(jid, GPOINTER_TO_INT(device_id->data), omemo_start_device_session_handle_bundle, free, strdup(jid));
+        omemo_session_bundle_request(jid, GPOINTER_TO_INT(device_id->data));
     }
 
     return TRUE;
@@ -1366,7 +1374,7 @@ omemo_automatic_start(const char* const recipient)
 {
     gboolean result = FALSE;
     char* account_name = session_get_account_name();
-    ProfAccount* account = accounts_get_account(account_name);
+    const ProfAccount* account = accounts_peek_account(account_name);
     prof_omemopolicy_t policy;
 
     if (account->omemo_policy) {
@@ -1416,7 +1424,6 @@ omemo_automatic_start(const char* const recipient)
         break;
     }
 
-    account_free(account);
     return result;
 }
 
@@ -1452,7 +1459,7 @@ _load_identity(void)
     }
 
     size_t identity_key_public_len;
-    auto_guchar guchar* identity_key_public = g_base64_decode(identity_key_public_b64, &identity_key_public_len);
+    auto_guchar guchar* identity_key_public = base64_decode(identity_key_public_b64, &identity_key_public_len);
     omemo_ctx.identity_key_store.public = signal_buffer_create(identity_key_public, identity_key_public_len);
 
     error = NULL;
@@ -1463,7 +1470,7 @@ _load_identity(void)
     }
 
     size_t identity_key_private_len;
-    auto_guchar guchar* identity_key_private = g_base64_decode(identity_key_private_b64, &identity_key_private_len);
+    auto_guchar guchar* identity_key_private = base64_decode(identity_key_private_b64, &identity_key_private_len);
     omemo_ctx.identity_key_store.private = signal_buffer_create(identity_key_private, identity_key_private_len);
 
     ec_public_key* public_key;
@@ -1481,7 +1488,7 @@ _load_identity(void)
         for (i = 0; keys[i] != NULL; i++) {
             auto_gchar gchar* pre_key_b64 = g_key_file_get_string(omemo_ctx.identity.keyfile, OMEMO_STORE_GROUP_PREKEYS, keys[i], NULL);
             size_t pre_key_len;
-            auto_guchar guchar* pre_key = g_base64_decode(pre_key_b64, &pre_key_len);
+            auto_guchar guchar* pre_key = base64_decode(pre_key_b64, &pre_key_len);
             signal_buffer* buffer = signal_buffer_create(pre_key, pre_key_len);
             g_hash_table_insert(omemo_ctx.pre_key_store, GINT_TO_POINTER(strtoul(keys[i], NULL, 10)), buffer);
         }
@@ -1501,7 +1508,7 @@ _load_identity(void)
         for (i = 0; keys[i] != NULL; i++) {
             auto_gchar gchar* signed_pre_key_b64 = g_key_file_get_string(omemo_ctx.identity.keyfile, OMEMO_STORE_GROUP_SIGNED_PREKEYS, keys[i], NULL);
             size_t signed_pre_key_len;
-            auto_guchar guchar* signed_pre_key = g_base64_decode(signed_pre_key_b64, &signed_pre_key_len);
+            auto_guchar guchar* signed_pre_key = base64_decode(signed_pre_key_b64, &signed_pre_key_len);
             signal_buffer* buffer = signal_buffer_create(signed_pre_key, signed_pre_key_len);
             g_hash_table_insert(omemo_ctx.signed_pre_key_store, GINT_TO_POINTER(strtoul(keys[i], NULL, 10)), buffer);
             omemo_ctx.signed_pre_key_id = strtoul(keys[i], NULL, 10);
@@ -1543,7 +1550,7 @@ _load_trust(void)
         for (int j = 0; keys[j] != NULL; j++) {
             auto_gchar gchar* key_b64 = g_key_file_get_string(omemo_ctx.trust.keyfile, groups[i], keys[j], NULL);
             size_t key_len;
-            auto_guchar guchar* key = g_base64_decode(key_b64, &key_len);
+            auto_guchar guchar* key = base64_decode(key_b64, &key_len);
             signal_buffer* buffer = signal_buffer_create(key, key_len);
             uint32_t device_id = strtoul(keys[j], NULL, 10);
             g_hash_table_insert(trusted, GINT_TO_POINTER(device_id), buffer);
@@ -1560,6 +1567,8 @@ _load_sessions(void)
         return;
     }
 
+    // one buffer for all records instead of one allocation each
+    GByteArray* decoded = g_byte_array_new();
     for (int i = 0; groups[i] != NULL; i++) {
         GHashTable* device_store = NULL;
 
@@ -1573,12 +1582,16 @@ _load_sessions(void)
         for (int j = 0; keys[j] != NULL; j++) {
             uint32_t id = strtoul(keys[j], NULL, 10);
             auto_gchar gchar* record_b64 = g_key_file_get_string(omemo_ctx.sessions.keyfile, groups[i], keys[j], NULL);
+            if (!record_b64) {
+                continue;
+            }
             size_t record_len;
-            auto_guchar guchar* record = g_base64_decode(record_b64, &record_len);
+            guchar* record = base64_decode_into(decoded, record_b64, &record_len);
             signal_buffer* buffer = signal_buffer_create(record, record_len);
             g_hash_table_insert(device_store, GINT_TO_POINTER(id), buffer);
         }
     }
+    g_byte_array_free(decoded, TRUE);
 }
 
 static void
@@ -1599,15 +1612,32 @@ _load_known_devices(void)
             g_hash_table_insert(omemo_ctx.known_devices, strdup(groups[i]), known_identities);
         }
 
+        Autocomplete ac = _fingerprint_ac(groups[i]);
+
         auto_gcharv gchar** keys = g_key_file_get_keys(omemo_ctx.knowndevices.keyfile, groups[i], NULL, NULL);
         for (int j = 0; keys[j] != NULL; j++) {
             uint32_t device_id = strtoul(keys[j], NULL, 10);
             auto_gchar gchar* fingerprint = g_key_file_get_string(omemo_ctx.knowndevices.keyfile, groups[i], keys[j], NULL);
             g_hash_table_insert(known_identities, strdup(fingerprint), GINT_TO_POINTER(device_id));
+
+            auto_char char* formatted_fingerprint = omemo_format_fingerprint(fingerprint);
+            autocomplete_add(ac, formatted_fingerprint);
         }
     }
 }
 
+static Autocomplete
+_fingerprint_ac(const char* const jid)
+{
+    Autocomplete ac = g_hash_table_lookup(omemo_static_data.fingerprint_ac, jid);
+    if (ac == NULL) {
+        ac = autocomplete_new();
+        g_hash_table_insert(omemo_static_data.fingerprint_ac, strdup(jid), ac);
+    }
+
+    return ac;
+}
+
 static void
 _cache_device_identity(const char* const jid, uint32_t device_id, ec_public_key* identity)
 {
@@ -1617,7 +1647,15 @@ _cache_device_identity(const char* const jid, uint32_t device_id, ec_public_key*
         g_hash_table_insert(omemo_ctx.known_devices, strdup(jid), known_identities);
     }
 
-    char* fingerprint = _omemo_fingerprint(identity, FALSE);
+    auto_char char* fingerprint = _omemo_fingerprint(identity, FALSE);
+
+    // bundles are fetched again with every new session, most are known already
+    gpointer known_device_id;
+    if (g_hash_table_lookup_extended(known_identities, fingerprint, NULL, &known_device_id)
+        && GPOINTER_TO_UINT(known_device_id) == device_id) {
+        return;
+    }
+
     log_debug("[OMEMO] cache identity for %s:%d: %s", jid, device_id, fingerprint);
     g_hash_table_insert(known_identities, strdup(fingerprint), GINT_TO_POINTER(device_id));
 
@@ -1625,16 +1663,8 @@ _cache_device_identity(const char* const jid, uint32_t device_id, ec_public_key*
     g_key_file_set_string(omemo_ctx.knowndevices.keyfile, jid, device_id_str, fingerprint);
     omemo_known_devices_keyfile_save();
 
-    Autocomplete ac = g_hash_table_lookup(omemo_static_data.fingerprint_ac, jid);
-    if (ac == NULL) {
-        ac = autocomplete_new();
-        g_hash_table_insert(omemo_static_data.fingerprint_ac, strdup(jid), ac);
-    }
-
-    char* formatted_fingerprint = omemo_format_fingerprint(fingerprint);
-    autocomplete_add(ac, formatted_fingerprint);
-    free(formatted_fingerprint);
-    free(fingerprint);
+    auto_char char* formatted_fingerprint = omemo_format_fingerprint(fingerprint);
+    autocomplete_add(_fingerprint_ac(jid), formatted_fingerprint);
 }
 
 static void
@@ -1653,6 +1683,43 @@ _generate_pre_keys(int count)
     signal_protocol_key_helper_key_list_free(pre_keys_head);
 }
 
+static gboolean
+_replenish_pre_keys(gpointer data)
+{
+    omemo_ctx.replenish_source = 0;
+
+    for (guint i = 0; i < omemo_ctx.used_pre_keys->len; i++) {
+        ec_key_pair* ec_pair;
+        session_pre_key* new_pre_key;
+        curve_generate_key_pair(omemo_ctx.signal, &ec_pair);
+        session_pre_key_create(&new_pre_key, g_array_index(omemo_ctx.used_pre_keys, uint32_t, i), ec_pair);
+        signal_protocol_pre_key_store_key(omemo_ctx.store, new_pre_key);
+        SIGNAL_UNREF(new_pre_key);
+        SIGNAL_UNREF(ec_pair);
+    }
+    log_debug("[OMEMO] replaced %u used pre keys", omemo_ctx.used_pre_keys->len);
+    g_array_set_size(omemo_ctx.used_pre_keys, 0);
+
+    omemo_bundle_publish(true);
+
+    return G_SOURCE_REMOVE;
+}
+
+/*
+ * A new session consumed one of our pre keys. Sessions tend to arrive in
+ * bursts, e.g. after reconnecting, so the keys are replaced and the bundle
+ * published once the burst is over instead of for every message.
+ */
+static void
+_pre_key_used(uint32_t pre_key_id)
+{
+    g_array_append_val(omemo_ctx.used_pre_keys, pre_key_id);
+
+    if (omemo_ctx.replenish_source == 0) {
+        omemo_ctx.replenish_source = g_timeout_add_seconds(OMEMO_PRE_KEY_REPLENISH_DELAY, _replenish_pre_keys, NULL);
+    }
+}
+
 static void
 _generate_signed_pre_key(void)
 {
@@ -1723,8 +1790,8 @@ _bytes_from_hex(const char* hex, size_t hex_size,
     }
 }
 
-gcry_error_t
-omemo_decrypt_file(FILE* in, FILE* out, off_t file_size, const char* fragment)
+static void
+_omemo_fragment_parse(const char* fragment, unsigned char nonce[], unsigned char* key)
 {
     char nonce_hex[AESGCM_URL_NONCE_LEN];
     char key_hex[AESGCM_URL_KEY_LEN];
@@ -1735,13 +1802,19 @@ omemo_decrypt_file(FILE* in, FILE* out, off_t file_size, const char* fragment)
     memcpy(nonce_hex, &(fragment[nonce_pos]), AESGCM_URL_NONCE_LEN);
     memcpy(key_hex, &(fragment[key_pos]), AESGCM_URL_KEY_LEN);
 
-    unsigned char nonce[OMEMO_AESGCM_NONCE_LENGTH];
-    unsigned char* key = gcry_malloc_secure(OMEMO_AESGCM_KEY_LENGTH);
-
     _bytes_from_hex(nonce_hex, AESGCM_URL_NONCE_LEN,
                     nonce, OMEMO_AESGCM_NONCE_LENGTH);
     _bytes_from_hex(key_hex, AESGCM_URL_KEY_LEN,
                     key, OMEMO_AESGCM_KEY_LENGTH);
+}
+
+gcry_error_t
+omemo_decrypt_file(FILE* in, FILE* out, off_t file_size, const char* fragment)
+{
+    unsigned char nonce[OMEMO_AESGCM_NONCE_LENGTH];
+    unsigned char* key = gcry_malloc_secure(OMEMO_AESGCM_KEY_LENGTH);
+
+    _omemo_fragment_parse(fragment, nonce, key);
 
     gcry_error_t crypt_res;
     crypt_res = aes256gcm_crypt_file(in, out, file_size, key, nonce, false);
@@ -1751,6 +1824,44 @@ omemo_decrypt_file(FILE* in, FILE* out, off_t file_size, const char* fragment)
     return crypt_res;
 }
 
+struct aes256gcm_stream_t*
+omemo_encrypt_file_stream(off_t file_size, char** fragment, gcry_error_t* gcry_res)
+{
+    unsigned char* key = gcry_random_bytes_secure(
+        OMEMO_AESGCM_KEY_LENGTH,
+        GCRY_VERY_STRONG_RANDOM);
+
+    // Create nonce/IV with random bytes.
+    unsigned char nonce[OMEMO_AESGCM_NONCE_LENGTH];
+    gcry_create_nonce(nonce, OMEMO_AESGCM_NONCE_LENGTH);
+
+    aes256gcm_stream_t* stream = aes256gcm_stream_new(key, nonce, true, file_size, gcry_res);
+    if (stream) {
+        *fragment = aes256gcm_create_secure_fragment(key, nonce);
+    } else {
+        *fragment = NULL;
+    }
+
+    gcry_free(key);
+
+    return stream;
+}
+
+struct aes256gcm_stream_t*
+omemo_decrypt_file_stream(const char* fragment, gcry_error_t* gcry_res)
+{
+    unsigned char nonce[OMEMO_AESGCM_NONCE_LENGTH];
+    unsigned char* key = gcry_malloc_secure(OMEMO_AESGCM_KEY_LENGTH);
+
+    _omemo_fragment_parse(fragment, nonce, key);
+
+    aes256gcm_stream_t* stream = aes256gcm_stream_new(key, nonce, false, 0, gcry_res);
+
+    gcry_free(key);
+
+    return stream;
+}
+
 int
 omemo_parse_aesgcm_url(const char* aesgcm_url,
                        char** https_url,
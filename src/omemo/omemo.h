@@ -43,6 +43,7 @@
 
 #define OMEMO_AESGCM_NONCE_LENGTH AES128_GCM_IV_LENGTH
 #define OMEMO_AESGCM_KEY_LENGTH   32
+#define OMEMO_AESGCM_TAG_LENGTH   16
 #define OMEMO_AESGCM_URL_SCHEME   "aesgcm"
 
 typedef enum {
@@ -101,6 +102,8 @@ char* omemo_on_message_recv(const char* const from, uint32_t sid, const unsigned
 
 char* omemo_encrypt_file(FILE* in, FILE* out, off_t file_size, int* gcry_res);
 gcry_error_t omemo_decrypt_file(FILE* in, FILE* out, off_t file_size, const char* fragment);
+struct aes256gcm_stream_t* omemo_encrypt_file_stream(off_t file_size, char** fragment, gcry_error_t* gcry_res);
+struct aes256gcm_stream_t* omemo_decrypt_file_stream(const char* fragment, gcry_error_t* gcry_res);
 void omemo_free(void* a);
 int omemo_parse_aesgcm_url(const char* aesgcm_url, char** https_url, char** fragment);
 
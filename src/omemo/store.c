@@ -32,13 +32,34 @@
  * source files in the program, then also delete it here.
  *
  */
+#include <string.h>
+#include <sys/stat.h>
+
 #include <glib.h>
+#include <glib/gstdio.h>
+#include <sqlite3.h>
 #include <signal/signal_protocol.h>
 
 #include "config.h"
+#include "common.h"
 #include "log.h"
 #include "omemo/omemo.h"
 #include "omemo/store.h"
+#include "tools/base64.h"
+
+// Sessions database, when open session records are stored per row in it and
+// a contact's devices are only read on first use. Without it the whole
+// sessions keyfile is loaded up front and rewritten on every change.
+static sqlite3* session_db = NULL;
+
+// Every decrypted message ratchets its session and stores the record again.
+// Writes made in one main loop iteration, e.g. a page of MAM history, share a
+// transaction committed once the loop is idle.
+static guint session_db_commit_source = 0;
+
+static GHashTable* _device_store_get(GHashTable* session_store, const char* const name);
+static void _session_db_import(GKeyFile* keyfile);
+static gboolean _session_db_commit(gpointer data);
 
 GHashTable*
 session_store_new(void)
@@ -46,6 +67,189 @@ session_store_new(void)
     return g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)g_hash_table_destroy);
 }
 
+gboolean
+session_db_open(const char* const filename, const char* const legacy_filename)
+{
+    session_db_close();
+
+    if (sqlite3_open(filename, &session_db) != SQLITE_OK) {
+        log_error("[OMEMO][STORE] Unable to open session database %s: %s", filename, sqlite3_errmsg(session_db));
+        sqlite3_close(session_db);
+        session_db = NULL;
+        return FALSE;
+    }
+    g_chmod(filename, S_IRUSR | S_IWUSR);
+
+    sqlite3_busy_timeout(session_db, 5000);
+    sqlite3_exec(session_db, "PRAGMA journal_mode=WAL; PRAGMA synchronous=NORMAL;", NULL, NULL, NULL);
+
+    char* err_msg = NULL;
+    const char* create = "CREATE TABLE IF NOT EXISTS `OmemoSessions` ("
+                         "`jid` TEXT NOT NULL, "
+                         "`device_id` INTEGER NOT NULL, "
+                         "`record` BLOB NOT NULL, "
+                         "PRIMARY KEY (`jid`, `device_id`))";
+    if (sqlite3_exec(session_db, create, NULL, NULL, &err_msg) != SQLITE_OK) {
+        log_error("[OMEMO][STORE] Unable to create session table: %s", err_msg);
+        sqlite3_free(err_msg);
+        session_db_close();
+        return FALSE;
+    }
+
+    int version = 0;
+    sqlite3_stmt* stmt = NULL;
+    if (sqlite3_prepare_v2(session_db, "PRAGMA user_version", -1, &stmt, NULL) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            version = sqlite3_column_int(stmt, 0);
+        }
+        sqlite3_finalize(stmt);
+    }
+
+    // one-shot migration of the sessions keyfile used before
+    if (version == 0) {
+        GKeyFile* keyfile = g_key_file_new();
+        if (legacy_filename && g_key_file_load_from_file(keyfile, legacy_filename, G_KEY_FILE_NONE, NULL)) {
+            log_info("[OMEMO][STORE] Import sessions from %s", legacy_filename);
+            _session_db_import(keyfile);
+        }
+        g_key_file_free(keyfile);
+        sqlite3_exec(session_db, "PRAGMA user_version=1", NULL, NULL, NULL);
+    }
+
+    return TRUE;
+}
+
+void
+session_db_close(void)
+{
+    if (session_db_commit_source) {
+        g_source_remove(session_db_commit_source);
+        _session_db_commit(NULL);
+    }
+    if (session_db) {
+        sqlite3_close(session_db);
+        session_db = NULL;
+    }
+}
+
+gboolean
+session_db_is_open(void)
+{
+    return session_db != NULL;
+}
+
+static void
+_session_db_import(GKeyFile* keyfile)
+{
+    auto_gcharv gchar** groups = g_key_file_get_groups(keyfile, NULL);
+    if (!groups) {
+        return;
+    }
+
+    sqlite3_stmt* stmt = NULL;
+    if (sqlite3_prepare_v2(session_db, "INSERT OR REPLACE INTO `OmemoSessions` (`jid`, `device_id`, `record`) VALUES (?, ?, ?)", -1, &stmt, NULL) != SQLITE_OK) {
+        log_error("[OMEMO][STORE] Unable to prepare session import: %s", sqlite3_errmsg(session_db));
+        return;
+    }
+
+    // one buffer for all records instead of one allocation each
+    GByteArray* decoded = g_byte_array_new();
+    sqlite3_exec(session_db, "BEGIN TRANSACTION", NULL, NULL, NULL);
+    for (int i = 0; groups[i] != NULL; i++) {
+        auto_gcharv gchar** keys = g_key_file_get_keys(keyfile, groups[i], NULL, NULL);
+        for (int j = 0; keys && keys[j] != NULL; j++) {
+            auto_gchar gchar* record_b64 = g_key_file_get_string(keyfile, groups[i], keys[j], NULL);
+            if (!record_b64) {
+                continue;
+            }
+            size_t record_len;
+            guchar* record = base64_decode_into(decoded, record_b64, &record_len);
+
+            sqlite3_bind_text(stmt, 1, groups[i], -1, SQLITE_STATIC);
+            sqlite3_bind_int64(stmt, 2, strtoul(keys[j], NULL, 10));
+            sqlite3_bind_blob(stmt, 3, record, record_len, SQLITE_STATIC);
+            if (sqlite3_step(stmt) != SQLITE_DONE) {
+                log_error("[OMEMO][STORE] Unable to import session of %s: %s", groups[i], sqlite3_errmsg(session_db));
+            }
+            sqlite3_reset(stmt);
+            sqlite3_clear_bindings(stmt);
+        }
+    }
+    sqlite3_exec(session_db, "END TRANSACTION", NULL, NULL, NULL);
+    sqlite3_finalize(stmt);
+    g_byte_array_free(decoded, TRUE);
+}
+
+static GHashTable*
+_device_store_get(GHashTable* session_store, const char* const name)
+{
+    GHashTable* device_store = g_hash_table_lookup(session_store, name);
+    if (device_store || !session_db) {
+        return device_store;
+    }
+
+    // first use of this contact, an empty device store marks it as loaded
+    device_store = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)signal_buffer_free);
+    g_hash_table_insert(session_store, strdup(name), device_store);
+
+    sqlite3_stmt* stmt = NULL;
+    if (sqlite3_prepare_v2(session_db, "SELECT `device_id`, `record` FROM `OmemoSessions` WHERE `jid` = ?", -1, &stmt, NULL) != SQLITE_OK) {
+        log_error("[OMEMO][STORE] Unable to prepare session lookup: %s", sqlite3_errmsg(session_db));
+        return device_store;
+    }
+    sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        uint32_t device_id = (uint32_t)sqlite3_column_int64(stmt, 0);
+        const uint8_t* record = sqlite3_column_blob(stmt, 1);
+        int record_len = sqlite3_column_bytes(stmt, 1);
+        g_hash_table_insert(device_store, GINT_TO_POINTER(device_id), signal_buffer_create(record, record_len));
+    }
+    sqlite3_finalize(stmt);
+    log_debug("[OMEMO][STORE] Loaded %u sessions of %s", g_hash_table_size(device_store), name);
+
+    return device_store;
+}
+
+static gboolean
+_session_db_commit(gpointer data)
+{
+    session_db_commit_source = 0;
+    if (session_db && !sqlite3_get_autocommit(session_db)) {
+        if (sqlite3_exec(session_db, "END TRANSACTION", NULL, NULL, NULL) != SQLITE_OK) {
+            log_error("[OMEMO][STORE] Unable to commit session updates: %s", sqlite3_errmsg(session_db));
+        }
+    }
+
+    return FALSE;
+}
+
+static void
+_session_db_exec(const char* const sql, const char* const name, uint32_t device_id, const uint8_t* record, size_t record_len)
+{
+    if (session_db_commit_source == 0 && sqlite3_get_autocommit(session_db)) {
+        if (sqlite3_exec(session_db, "BEGIN TRANSACTION", NULL, NULL, NULL) == SQLITE_OK) {
+            session_db_commit_source = g_idle_add(_session_db_commit, NULL);
+        }
+    }
+
+    sqlite3_stmt* stmt = NULL;
+    if (sqlite3_prepare_v2(session_db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        log_error("[OMEMO][STORE] Unable to prepare session update: %s", sqlite3_errmsg(session_db));
+        return;
+    }
+    sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
+    if (sqlite3_bind_parameter_count(stmt) > 1) {
+        sqlite3_bind_int64(stmt, 2, device_id);
+    }
+    if (record) {
+        sqlite3_bind_blob(stmt, 3, record, record_len, SQLITE_STATIC);
+    }
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        log_error("[OMEMO][STORE] Unable to update sessions of %s: %s", name, sqlite3_errmsg(session_db));
+    }
+    sqlite3_finalize(stmt);
+}
+
 GHashTable*
 pre_key_store_new(void)
 {
@@ -82,7 +286,7 @@ load_session(signal_buffer** record, signal_buffer** user_record,
     GHashTable* device_store = NULL;
 
     log_debug("[OMEMO][STORE] Looking for %s in session_store", address->name);
-    device_store = g_hash_table_lookup(session_store, address->name);
+    device_store = _device_store_get(session_store, address->name);
     if (!device_store) {
         *record = NULL;
         log_info("[OMEMO][STORE] No device store for %s found", address->name);
@@ -109,7 +313,7 @@ get_sub_device_sessions(signal_int_list** sessions, const char* name,
     GHashTableIter iter;
     gpointer key, value;
 
-    device_store = g_hash_table_lookup(session_store, name);
+    device_store = _device_store_get(session_store, name);
     if (!device_store) {
         log_debug("[OMEMO][STORE] What?");
         return SG_SUCCESS;
@@ -134,7 +338,7 @@ store_session(const signal_protocol_address* address,
     GHashTable* device_store = NULL;
 
     log_debug("[OMEMO][STORE] Store session for %s (%d)", address->name, address->device_id);
-    device_store = g_hash_table_lookup(session_store, (void*)address->name);
+    device_store = _device_store_get(session_store, address->name);
     if (!device_store) {
         device_store = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)signal_buffer_free);
         g_hash_table_insert(session_store, strdup(address->name), device_store);
@@ -143,7 +347,13 @@ store_session(const signal_protocol_address* address,
     signal_buffer* buffer = signal_buffer_create(record, record_len);
     g_hash_table_insert(device_store, GINT_TO_POINTER(address->device_id), buffer);
 
-    auto_gchar gchar* record_b64 = g_base64_encode(record, record_len);
+    if (session_db) {
+        _session_db_exec("INSERT OR REPLACE INTO `OmemoSessions` (`jid`, `device_id`, `record`) VALUES (?1, ?2, ?3)",
+                         address->name, address->device_id, record, record_len);
+        return SG_SUCCESS;
+    }
+
+    auto_gchar gchar* record_b64 = base64_encode(record, record_len);
     auto_gchar gchar* device_id = g_strdup_printf("%d", address->device_id);
     g_key_file_set_string(omemo_sessions_keyfile(), address->name, device_id, record_b64);
 
@@ -158,7 +368,7 @@ contains_session(const signal_protocol_address* address, void* user_data)
     GHashTable* session_store = (GHashTable*)user_data;
     GHashTable* device_store = NULL;
 
-    device_store = g_hash_table_lookup(session_store, address->name);
+    device_store = _device_store_get(session_store, address->name);
     if (!device_store) {
         log_debug("[OMEMO][STORE] No Device");
         return 0;
@@ -178,13 +388,19 @@ delete_session(const signal_protocol_address* address, void* user_data)
     GHashTable* session_store = (GHashTable*)user_data;
     GHashTable* device_store = NULL;
 
-    device_store = g_hash_table_lookup(session_store, address->name);
+    device_store = _device_store_get(session_store, address->name);
     if (!device_store) {
         return SG_SUCCESS;
     }
 
     g_hash_table_remove(device_store, GINT_TO_POINTER(address->device_id));
 
+    if (session_db) {
+        _session_db_exec("DELETE FROM `OmemoSessions` WHERE `jid` = ?1 AND `device_id` = ?2",
+                         address->name, address->device_id, NULL, 0);
+        return SG_SUCCESS;
+    }
+
     auto_gchar gchar* device_id_str = g_strdup_printf("%d", address->device_id);
     g_key_file_remove_key(omemo_sessions_keyfile(), address->name, device_id_str, NULL);
     omemo_sessions_keyfile_save();
@@ -198,7 +414,7 @@ delete_all_sessions(const char* name, size_t name_len, void* user_data)
     GHashTable* session_store = (GHashTable*)user_data;
     GHashTable* device_store = NULL;
 
-    device_store = g_hash_table_lookup(session_store, name);
+    device_store = _device_store_get(session_store, name);
     if (!device_store) {
         log_debug("[OMEMO][STORE] No device => no delete");
         return SG_SUCCESS;
@@ -206,6 +422,13 @@ delete_all_sessions(const char* name, size_t name_len, void* user_data)
 
     guint len = g_hash_table_size(device_store);
     g_hash_table_remove_all(device_store);
+
+    if (session_db) {
+        _session_db_exec("DELETE FROM `OmemoSessions` WHERE `jid` = ?1", name, 0, NULL, 0);
+    } else {
+        g_key_file_remove_group(omemo_sessions_keyfile(), name, NULL);
+        omemo_sessions_keyfile_save();
+    }
     return len;
 }
 
@@ -236,7 +459,7 @@ store_pre_key(uint32_t pre_key_id, uint8_t* record, size_t record_len,
 
     /* Long term storage */
     auto_gchar gchar* pre_key_id_str = g_strdup_printf("%d", pre_key_id);
-    auto_gchar gchar* record_b64 = g_base64_encode(record, record_len);
+    auto_gchar gchar* record_b64 = base64_encode(record, record_len);
     g_key_file_set_string(omemo_identity_keyfile(), OMEMO_STORE_GROUP_PREKEYS, pre_key_id_str, record_b64);
 
     omemo_identity_keyfile_save();
@@ -301,7 +524,7 @@ store_signed_pre_key(uint32_t signed_pre_key_id, uint8_t* record,
 
     /* Long term storage */
     auto_gchar gchar* signed_pre_key_id_str = g_strdup_printf("%d", signed_pre_key_id);
-    auto_gchar gchar* record_b64 = g_base64_encode(record, record_len);
+    auto_gchar gchar* record_b64 = base64_encode(record, record_len);
     g_key_file_set_string(omemo_identity_keyfile(), OMEMO_STORE_GROUP_SIGNED_PREKEYS, signed_pre_key_id_str, record_b64);
 
     omemo_identity_keyfile_save();
@@ -384,7 +607,7 @@ save_identity(const signal_protocol_address* address, uint8_t* key_data,
     g_hash_table_insert(trusted, GINT_TO_POINTER(address->device_id), buffer);
 
     /* Long term storage */
-    auto_gchar gchar* key_b64 = g_base64_encode(key_data, key_len);
+    auto_gchar gchar* key_b64 = base64_encode(key_data, key_len);
     auto_gchar gchar* device_id = g_strdup_printf("%d", address->device_id);
     g_key_file_set_string(omemo_trust_keyfile(), address->name, device_id, key_b64);
 
@@ -411,15 +634,13 @@ is_trusted_identity(const signal_protocol_address* address, uint8_t* key_data,
         }
     }
 
-    signal_buffer* buffer = signal_buffer_create(key_data, key_len);
     signal_buffer* original = g_hash_table_lookup(trusted, GINT_TO_POINTER(address->device_id));
 
     if (!original) {
         log_debug("[OMEMO][STORE] original not found %s (%d)", address->name, address->device_id);
     }
-    ret = original != NULL && signal_buffer_compare(buffer, original) == 0;
-
-    signal_buffer_free(buffer);
+    ret = original != NULL && signal_buffer_len(original) == key_len
+          && memcmp(signal_buffer_data(original), key_data, key_len) == 0;
 
     if (identity_key_store->recv) {
         log_debug("[OMEMO][STORE] 1 identity_key_store->recv");
@@ -54,6 +54,19 @@ typedef struct
 } identity_key_store_t;
 
 GHashTable* session_store_new(void);
+
+/**
+ * Opens the sessions database, creating it if needed.
+ *
+ * On first use the sessions found in the keyfile at legacy_filename are
+ * imported once. While the database is open, sessions are stored per row and
+ * loaded for each contact on first use.
+ *
+ * @return TRUE if the database can be used, FALSE to stay on the keyfile
+ */
+gboolean session_db_open(const char* const filename, const char* const legacy_filename);
+void session_db_close(void);
+gboolean session_db_is_open(void);
 GHashTable* pre_key_store_new(void);
 GHashTable* signed_pre_key_store_new(void);
 void identity_key_store_new(identity_key_store_t* identity_key_store);
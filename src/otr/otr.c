@@ -196,12 +196,6 @@ otr_shutdown(void)
     }
 }
 
-void
-otr_poll(void)
-{
-    otrlib_poll();
-}
-
 void
 otr_on_connect(ProfAccount* account)
 {
@@ -634,18 +628,15 @@ prof_otrpolicy_t
 otr_get_policy(const char* const recipient)
 {
     char* account_name = session_get_account_name();
-    ProfAccount* account = accounts_get_account(account_name);
+    const ProfAccount* account = accounts_peek_account(account_name);
     // check contact specific setting
     if (g_list_find_custom(account->otr_manual, recipient, (GCompareFunc)g_strcmp0)) {
-        account_free(account);
         return PROF_OTRPOLICY_MANUAL;
     }
     if (g_list_find_custom(account->otr_opportunistic, recipient, (GCompareFunc)g_strcmp0)) {
-        account_free(account);
         return PROF_OTRPOLICY_OPPORTUNISTIC;
     }
     if (g_list_find_custom(account->otr_always, recipient, (GCompareFunc)g_strcmp0)) {
-        account_free(account);
         return PROF_OTRPOLICY_ALWAYS;
     }
 
@@ -661,10 +652,8 @@ otr_get_policy(const char* const recipient)
         if (g_strcmp0(account->otr_policy, "always") == 0) {
             result = PROF_OTRPOLICY_ALWAYS;
         }
-        account_free(account);
         return result;
     }
-    account_free(account);
 
     // check global setting
     auto_gchar gchar* pref_otr_policy = prefs_get_string(PREF_OTR_POLICY);
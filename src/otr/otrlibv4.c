@@ -45,8 +45,8 @@
 #include "ui/ui.h"
 #include "ui/window_list.h"
 
-static GTimer* timer;
-static unsigned int current_interval;
+// armed by libotr through timer_control only while it has something to expire
+static guint poll_timer = 0;
 
 OtrlPolicy
 otrlib_policy(void)
@@ -54,24 +54,22 @@ otrlib_policy(void)
     return OTRL_POLICY_ALLOW_V1 | OTRL_POLICY_ALLOW_V2;
 }
 
-void
-otrlib_init_timer(void)
+static gboolean
+_otrlib_poll(gpointer data)
 {
     OtrlUserState user_state = otr_userstate();
-    timer = g_timer_new();
-    current_interval = otrl_message_poll_get_default_interval(user_state);
+    OtrlMessageAppOps* ops = otr_messageops();
+    otrl_message_poll(user_state, ops, NULL);
+
+    return G_SOURCE_CONTINUE;
 }
 
 void
-otrlib_poll(void)
+otrlib_init_timer(void)
 {
-    gdouble elapsed = g_timer_elapsed(timer, NULL);
-
-    if (current_interval != 0 && elapsed > current_interval) {
-        OtrlUserState user_state = otr_userstate();
-        OtrlMessageAppOps* ops = otr_messageops();
-        otrl_message_poll(user_state, ops, NULL);
-        g_timer_start(timer);
+    if (poll_timer) {
+        g_source_remove(poll_timer);
+        poll_timer = 0;
     }
 }
 
@@ -107,7 +105,10 @@ cb_otr_error_message_free(void* opdata, const char* err_msg)
 static void
 cb_timer_control(void* opdata, unsigned int interval)
 {
-    current_interval = interval;
+    otrlib_init_timer();
+    if (interval > 0) {
+        poll_timer = g_timeout_add_seconds(interval, _otrlib_poll, NULL);
+    }
 }
 
 static void
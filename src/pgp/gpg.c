@@ -49,6 +49,7 @@
 #include "log.h"
 #include "common.h"
 #include "pgp/gpg.h"
+#include "pgp/ox.h"
 #include "config/files.h"
 #include "tools/autocomplete.h"
 #include "ui/ui.h"
@@ -69,12 +70,48 @@ static GKeyFile* pubkeyfile;
 static char* passphrase;
 static char* passphrase_attempt;
 
+// Every presence we send carries a signature of the status text, the last one
+// is kept so only a change of text or key signs again.
+static char* sign_cache_text;
+static char* sign_cache_fp;
+static char* sign_cache_result;
+
+// Presence signatures are verified on a worker thread with its own gpgme
+// context, results are applied on the main loop. Contacts in several rooms
+// send the same signed presence many times, so results are cached by hash.
+typedef struct prof_gpg_verify_t
+{
+    char* sign;
+    char* sig_hash;
+    guint generation;
+    char* keyid;
+    char* fpr;
+    char* error;
+} ProfGPGVerify;
+
+static GThreadPool* verify_pool = NULL;
+static GPrivate verify_ctx = G_PRIVATE_INIT((GDestroyNotify)gpgme_release);
+// signature hash to key id, "" when the key is not in the keyring
+static GHashTable* verify_cache = NULL;
+// signature hash to the barejids waiting for it to be verified
+static GHashTable* verify_pending = NULL;
+// barejid to the hash of the last signature it sent
+static GHashTable* verify_latest = NULL;
+// results from before the last p_gpg_close() are dropped
+static guint verify_generation = 0;
+
 static Autocomplete key_ac;
+// the keyring is only listed for key_ac once a key is first completed
+static gboolean key_ac_loaded = FALSE;
 
 static char* _remove_header_footer(char* str, const char* const footer);
+static void _p_gpg_verify_init(void);
+static void _p_gpg_verify_close(void);
+static gboolean _p_gpg_verify_done(gpointer data);
 static char* _add_header_footer(const char* const str, const char* const header, const char* const footer);
 static char* _gpgme_data_to_char(gpgme_data_t data);
 static void _save_pubkeys(void);
+static void _p_gpg_sign_cache_clear(void);
 static ProfPGPKey* _gpgme_key_to_ProfPGPKey(gpgme_key_t key);
 
 void
@@ -119,10 +156,10 @@ p_gpg_init(void)
     gpgme_set_locale(NULL, LC_CTYPE, setlocale(LC_CTYPE, NULL));
 
     pubkeys = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)_p_gpg_free_pubkeyid);
+    _p_gpg_verify_init();
 
     key_ac = autocomplete_new();
-    GHashTable* keys = p_gpg_list_keys();
-    p_gpg_free_keys(keys);
+    key_ac_loaded = FALSE;
 
     passphrase = NULL;
     passphrase_attempt = NULL;
@@ -131,6 +168,9 @@ p_gpg_init(void)
 void
 p_gpg_close(void)
 {
+    _p_gpg_verify_close();
+    ox_key_cache_clear();
+
     if (pubkeys) {
         g_hash_table_destroy(pubkeys);
         pubkeys = NULL;
@@ -141,6 +181,7 @@ p_gpg_close(void)
 
     autocomplete_free(key_ac);
     key_ac = NULL;
+    key_ac_loaded = FALSE;
 
     if (passphrase) {
         free(passphrase);
@@ -151,6 +192,8 @@ p_gpg_close(void)
         free(passphrase_attempt);
         passphrase_attempt = NULL;
     }
+
+    _p_gpg_sign_cache_clear();
 }
 
 void
@@ -210,6 +253,7 @@ p_gpg_on_disconnect(void)
 {
     p_gpg_close();
     pubkeys = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)_p_gpg_free_pubkeyid);
+    _p_gpg_verify_init();
     key_ac = autocomplete_new();
 }
 
@@ -351,6 +395,7 @@ p_gpg_list_keys(void)
         curr = curr->next;
     }
     g_list_free(ids);
+    key_ac_loaded = TRUE;
 
     return result;
 }
@@ -413,63 +458,202 @@ p_gpg_available(const char* const barejid)
     return (pubkey != NULL);
 }
 
-void
-p_gpg_verify(const char* const barejid, const char* const sign)
+static void
+_p_gpg_verify_init(void)
 {
-    if (!sign) {
-        return;
+    verify_cache = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
+    verify_pending = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)g_ptr_array_unref);
+    verify_latest = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
+}
+
+static void
+_p_gpg_verify_close(void)
+{
+    verify_generation++;
+    if (verify_pool) {
+        // drops queued jobs and waits for the running one
+        g_thread_pool_free(verify_pool, TRUE, TRUE);
+        verify_pool = NULL;
+    }
+    if (verify_cache) {
+        g_hash_table_destroy(verify_cache);
+        verify_cache = NULL;
+    }
+    if (verify_pending) {
+        g_hash_table_destroy(verify_pending);
+        verify_pending = NULL;
+    }
+    if (verify_latest) {
+        g_hash_table_destroy(verify_latest);
+        verify_latest = NULL;
     }
+}
 
-    gpgme_ctx_t ctx;
-    gpgme_error_t error = gpgme_new(&ctx);
+static void
+_p_gpg_verify_free(ProfGPGVerify* job)
+{
+    free(job->sign);
+    free(job->sig_hash);
+    free(job->keyid);
+    free(job->fpr);
+    g_free(job->error);
+    free(job);
+}
 
-    if (error) {
-        log_error("GPG: Failed to create gpgme context. %s %s", gpgme_strsource(error), gpgme_strerror(error));
+static void
+_p_gpg_verify_apply(const char* const barejid, const char* const keyid)
+{
+    if (keyid[0] == '\0') {
+        log_debug("Could not find PGP key for %s", barejid);
         return;
     }
 
-    auto_char char* sign_with_header_footer = _add_header_footer(sign, PGP_SIGNATURE_HEADER, PGP_SIGNATURE_FOOTER);
+    log_debug("Key ID found for %s: %s", barejid, keyid);
+    ProfPGPPubKeyId* pubkeyid = malloc(sizeof(ProfPGPPubKeyId));
+    pubkeyid->id = strdup(keyid);
+    pubkeyid->received = TRUE;
+    g_hash_table_replace(pubkeys, strdup(barejid), pubkeyid);
+}
+
+// runs on the worker thread, must not touch anything but the job
+static void
+_p_gpg_verify_worker(gpointer data, gpointer user_data)
+{
+    ProfGPGVerify* job = data;
+
+    gpgme_ctx_t ctx = g_private_get(&verify_ctx);
+    if (ctx == NULL) {
+        gpgme_error_t error = gpgme_new(&ctx);
+        if (error) {
+            job->error = g_strdup_printf("Failed to create gpgme context. %s %s", gpgme_strsource(error), gpgme_strerror(error));
+            g_idle_add(_p_gpg_verify_done, job);
+            return;
+        }
+        g_private_set(&verify_ctx, ctx);
+    }
+
+    auto_char char* sign_with_header_footer = _add_header_footer(job->sign, PGP_SIGNATURE_HEADER, PGP_SIGNATURE_FOOTER);
     gpgme_data_t sign_data;
     gpgme_data_new_from_mem(&sign_data, sign_with_header_footer, strlen(sign_with_header_footer), 1);
 
     gpgme_data_t plain_data;
     gpgme_data_new(&plain_data);
 
-    error = gpgme_op_verify(ctx, sign_data, NULL, plain_data);
+    gpgme_error_t error = gpgme_op_verify(ctx, sign_data, NULL, plain_data);
     gpgme_data_release(sign_data);
     gpgme_data_release(plain_data);
 
     if (error) {
-        log_error("GPG: Failed to verify. %s %s", gpgme_strsource(error), gpgme_strerror(error));
-        gpgme_release(ctx);
+        job->error = g_strdup_printf("Failed to verify. %s %s", gpgme_strsource(error), gpgme_strerror(error));
+        g_idle_add(_p_gpg_verify_done, job);
         return;
     }
 
     gpgme_verify_result_t result = gpgme_op_verify_result(ctx);
-    if (result) {
-        if (result->signatures) {
-            gpgme_key_t key = NULL;
-            error = gpgme_get_key(ctx, result->signatures->fpr, &key, 0);
-            if (error) {
-                log_debug("Could not find PGP key with ID %s for %s", result->signatures->fpr, barejid);
-            } else {
-                log_debug("Fingerprint found for %s: %s ", barejid, key->subkeys->fpr);
-                ProfPGPPubKeyId* pubkeyid = malloc(sizeof(ProfPGPPubKeyId));
-                pubkeyid->id = strdup(key->subkeys->keyid);
-                pubkeyid->received = TRUE;
-                g_hash_table_replace(pubkeys, strdup(barejid), pubkeyid);
-            }
+    if (result && result->signatures) {
+        job->fpr = strdup(result->signatures->fpr);
+        gpgme_key_t key = NULL;
+        error = gpgme_get_key(ctx, result->signatures->fpr, &key, 0);
+        if (!error) {
+            job->keyid = strdup(key->subkeys->keyid);
+        }
+        gpgme_key_unref(key);
+    }
 
-            gpgme_key_unref(key);
+    g_idle_add(_p_gpg_verify_done, job);
+}
+
+static gboolean
+_p_gpg_verify_done(gpointer data)
+{
+    ProfGPGVerify* job = data;
+
+    if (job->generation != verify_generation) {
+        _p_gpg_verify_free(job);
+        return G_SOURCE_REMOVE;
+    }
+
+    const char* keyid = job->keyid ? job->keyid : "";
+    if (job->error) {
+        log_error("GPG: %s", job->error);
+    } else {
+        if (job->keyid == NULL && job->fpr) {
+            log_debug("Could not find PGP key with ID %s", job->fpr);
         }
+        g_hash_table_replace(verify_cache, strdup(job->sig_hash), strdup(keyid));
     }
 
-    gpgme_release(ctx);
+    GPtrArray* waiting = g_hash_table_lookup(verify_pending, job->sig_hash);
+    if (waiting && !job->error) {
+        for (guint i = 0; i < waiting->len; i++) {
+            const char* barejid = g_ptr_array_index(waiting, i);
+            // a newer signature from the same contact takes precedence
+            if (g_strcmp0(g_hash_table_lookup(verify_latest, barejid), job->sig_hash) == 0) {
+                _p_gpg_verify_apply(barejid, keyid);
+            }
+        }
+    }
+    g_hash_table_remove(verify_pending, job->sig_hash);
+
+    _p_gpg_verify_free(job);
+    return G_SOURCE_REMOVE;
+}
+
+void
+p_gpg_verify(const char* const barejid, const char* const sign)
+{
+    if (!sign || !verify_cache) {
+        return;
+    }
+
+    auto_gchar gchar* sig_hash = g_compute_checksum_for_string(G_CHECKSUM_SHA256, sign, -1);
+    g_hash_table_replace(verify_latest, strdup(barejid), strdup(sig_hash));
+
+    const char* keyid = g_hash_table_lookup(verify_cache, sig_hash);
+    if (keyid) {
+        _p_gpg_verify_apply(barejid, keyid);
+        return;
+    }
+
+    GPtrArray* waiting = g_hash_table_lookup(verify_pending, sig_hash);
+    if (waiting) {
+        g_ptr_array_add(waiting, strdup(barejid));
+        return;
+    }
+
+    waiting = g_ptr_array_new_with_free_func(free);
+    g_ptr_array_add(waiting, strdup(barejid));
+    g_hash_table_insert(verify_pending, strdup(sig_hash), waiting);
+
+    if (verify_pool == NULL) {
+        verify_pool = g_thread_pool_new(_p_gpg_verify_worker, NULL, 1, TRUE, NULL);
+    }
+
+    ProfGPGVerify* job = calloc(1, sizeof(ProfGPGVerify));
+    job->sign = strdup(sign);
+    job->sig_hash = strdup(sig_hash);
+    job->generation = verify_generation;
+    g_thread_pool_push(verify_pool, job, NULL);
+}
+
+static void
+_p_gpg_sign_cache_clear(void)
+{
+    free(sign_cache_text);
+    free(sign_cache_fp);
+    free(sign_cache_result);
+    sign_cache_text = NULL;
+    sign_cache_fp = NULL;
+    sign_cache_result = NULL;
 }
 
 char*
 p_gpg_sign(const char* const str, const char* const fp)
 {
+    if (sign_cache_result && g_strcmp0(sign_cache_text, str ?: "") == 0 && g_strcmp0(sign_cache_fp, fp) == 0) {
+        return strdup(sign_cache_result);
+    }
+
     gpgme_ctx_t ctx;
     gpgme_error_t error = gpgme_new(&ctx);
     if (error) {
@@ -537,6 +721,13 @@ p_gpg_sign(const char* const str, const char* const fp)
         passphrase = strdup(passphrase_attempt);
     }
 
+    if (result) {
+        _p_gpg_sign_cache_clear();
+        sign_cache_text = strdup(str_or_empty);
+        sign_cache_fp = strdup(fp);
+        sign_cache_result = strdup(result);
+    }
+
     return result;
 }
 
@@ -689,6 +880,13 @@ p_gpg_free_decrypted(char* decrypted)
 char*
 p_gpg_autocomplete_key(const char* const search_str, gboolean previous, void* context)
 {
+    if (!key_ac_loaded) {
+        GHashTable* keys = p_gpg_list_keys();
+        if (keys) {
+            p_gpg_free_keys(keys);
+        }
+    }
+
     return autocomplete_complete(key_ac, search_str, TRUE, previous);
 }
 
@@ -53,8 +53,15 @@
 #include "ui/ui.h"
 
 static gpgme_key_t _ox_key_lookup(const char* const barejid, gboolean secret_only);
+static gpgme_key_t _ox_key_lookup_keyring(const char* const barejid, gboolean secret_only);
 static gboolean _ox_key_is_usable(gpgme_key_t key, const char* const barejid, gboolean secret);
 
+// Keys found by XMPP URI, so sending does not list the keyring for every
+// message. Dropped on import and when the keyring files change on disk.
+static GHashTable* public_key_cache = NULL;
+static GHashTable* secret_key_cache = NULL;
+static gint64 key_cache_stamp = 0;
+
 /*!
  * \brief Public keys with XMPP-URI.
  *
@@ -278,8 +285,73 @@ ox_is_public_key_available(const char* const barejid)
     return result;
 }
 
+void
+ox_key_cache_clear(void)
+{
+    if (public_key_cache) {
+        g_hash_table_remove_all(public_key_cache);
+    }
+    if (secret_key_cache) {
+        g_hash_table_remove_all(secret_key_cache);
+    }
+}
+
+// changes whenever gpg writes to the keyring
+static gint64
+_ox_keyring_stamp(void)
+{
+    static const char* const files[] = { "pubring.kbx", "pubring.gpg", "secring.gpg", "private-keys-v1.d" };
+
+    const char* homedir = gpgme_get_dirinfo("homedir");
+    if (homedir == NULL) {
+        return 0;
+    }
+
+    gint64 stamp = 0;
+    for (int i = 0; i < G_N_ELEMENTS(files); i++) {
+        auto_gchar gchar* path = g_build_filename(homedir, files[i], NULL);
+        GStatBuf st;
+        if (g_stat(path, &st) == 0) {
+            stamp += (gint64)st.st_mtime + st.st_size;
+        }
+    }
+
+    return stamp;
+}
+
 static gpgme_key_t
 _ox_key_lookup(const char* const barejid, gboolean secret_only)
+{
+    g_assert(barejid);
+
+    if (public_key_cache == NULL) {
+        public_key_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)gpgme_key_unref);
+        secret_key_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)gpgme_key_unref);
+    }
+
+    gint64 stamp = _ox_keyring_stamp();
+    if (stamp != key_cache_stamp) {
+        ox_key_cache_clear();
+        key_cache_stamp = stamp;
+    }
+
+    GHashTable* cache = secret_only ? secret_key_cache : public_key_cache;
+    gpgme_key_t key = g_hash_table_lookup(cache, barejid);
+    if (key == NULL) {
+        key = _ox_key_lookup_keyring(barejid, secret_only);
+        if (key == NULL) {
+            return NULL;
+        }
+        g_hash_table_insert(cache, g_strdup(barejid), key);
+    }
+
+    // the caller releases its own reference
+    gpgme_key_ref(key);
+    return key;
+}
+
+static gpgme_key_t
+_ox_key_lookup_keyring(const char* const barejid, gboolean secret_only)
 {
     g_assert(barejid);
     log_debug("OX: Looking for %s key: %s", secret_only == TRUE ? "Private" : "Public", barejid);
@@ -571,6 +643,7 @@ p_ox_gpg_import(char* base64_public_key)
     if (error != GPG_ERR_NO_ERROR) {
         log_error("OX: Failed to import key");
     }
+    ox_key_cache_clear();
 
     return TRUE;
 }
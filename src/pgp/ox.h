@@ -48,5 +48,6 @@ GHashTable* ox_gpg_public_keys(void);
 
 gboolean ox_is_private_key_available(const char* const barejid);
 gboolean ox_is_public_key_available(const char* const barejid);
+void ox_key_cache_clear(void);
 
 #endif
@@ -43,7 +43,9 @@
 
 #include "profanity.h"
 #include "log.h"
+#include "stats.h"
 #include "common.h"
+#include "database.h"
 #include "config/theme.h"
 #include "command/cmd_defs.h"
 #include "event/server_events.h"
@@ -53,8 +55,10 @@
 #include "plugins/themes.h"
 #include "plugins/settings.h"
 #include "plugins/disco.h"
+#include "plugins/plugins.h"
 #include "ui/ui.h"
 #include "ui/window_list.h"
+#include "xmpp/xmpp.h"
 #include "xmpp/roster_list.h"
 
 void
@@ -156,7 +160,6 @@ api_register_timed(const char* const plugin_name, void* callback, int interval_s
     timed_function->callback_exec = callback_exec;
     timed_function->callback_destroy = callback_destroy;
     timed_function->interval_seconds = interval_seconds;
-    timed_function->timer = g_timer_new();
 
     callbacks_add_timed(plugin_name, timed_function);
 }
@@ -256,14 +259,12 @@ api_get_current_occupants(void)
     if (current->type == WIN_MUC) {
         ProfMucWin* mucwin = (ProfMucWin*)current;
         assert(mucwin->memcheck == PROFMUCWIN_MEMCHECK);
-        GList* occupants_list = muc_roster(mucwin->roomjid);
-        char** result = malloc((g_list_length(occupants_list) + 1) * sizeof(char*));
-        GList* curr = occupants_list;
+        char** result = malloc((muc_roster_size(mucwin->roomjid) + 1) * sizeof(char*));
+        GSequenceIter* iter = muc_roster_iter(mucwin->roomjid);
+        Occupant* occupant;
         int i = 0;
-        while (curr) {
-            Occupant* occupant = curr->data;
+        while ((occupant = muc_roster_iter_next(&iter))) {
             result[i++] = strdup(occupant->nick);
-            curr = g_list_next(curr);
         }
         result[i] = NULL;
         return result;
@@ -272,6 +273,79 @@ api_get_current_occupants(void)
     }
 }
 
+char**
+api_get_plugin_stats(void)
+{
+    GList* stats = plugins_get_stats();
+    char** result = malloc((g_list_length(stats) + 1) * sizeof(char*));
+    GList* curr = stats;
+    int i = 0;
+    while (curr) {
+        PluginHookStats* entry = curr->data;
+        result[i++] = g_strdup_printf("%s\t%s\t%" G_GUINT64_FORMAT "\t%" G_GINT64_FORMAT "\t%" G_GINT64_FORMAT "\t%" G_GINT64_FORMAT "\t%" G_GINT64_FORMAT,
+                                      entry->plugin_name, entry->hook, entry->calls, entry->total_us, entry->avg_us, entry->p99_us, entry->max_us);
+        curr = g_list_next(curr);
+    }
+    result[i] = NULL;
+    plugins_free_stats(stats);
+
+    return result;
+}
+
+// one "metric<TAB>value" line per counter, metric names and labels follow
+// the Prometheus text format so plugins can pass them on unchanged
+char**
+api_get_stats(void)
+{
+    GPtrArray* lines = g_ptr_array_new();
+
+    for (int type = 0; type < STATS_STANZA_COUNT; type++) {
+        const char* name = stats_stanza_name(type);
+        g_ptr_array_add(lines, g_strdup_printf("profanity_stanzas_received_total{type=\"%s\"}\t%" G_GUINT64_FORMAT, name, stats_stanza_total(FALSE, type)));
+        g_ptr_array_add(lines, g_strdup_printf("profanity_stanzas_sent_total{type=\"%s\"}\t%" G_GUINT64_FORMAT, name, stats_stanza_total(TRUE, type)));
+        g_ptr_array_add(lines, g_strdup_printf("profanity_stanzas_received_per_second{type=\"%s\"}\t%" G_GUINT64_FORMAT, name, stats_stanza_rate(FALSE, type)));
+        g_ptr_array_add(lines, g_strdup_printf("profanity_stanzas_sent_per_second{type=\"%s\"}\t%" G_GUINT64_FORMAT, name, stats_stanza_rate(TRUE, type)));
+    }
+
+    for (int i = 0; i < STATS_COUNTER_COUNT; i++) {
+        g_ptr_array_add(lines, g_strdup_printf("profanity_skipped_total{counter=\"%s\"}\t%" G_GUINT64_FORMAT, stats_counter_name(i), stats_counter_total(i)));
+    }
+
+    for (int i = 0; i < STATS_TIMER_COUNT; i++) {
+        ProfStatsTimer timer;
+        stats_timer_get(i, &timer);
+        const char* name = stats_timer_name(i);
+        g_ptr_array_add(lines, g_strdup_printf("profanity_timer_calls_total{timer=\"%s\"}\t%" G_GUINT64_FORMAT, name, timer.calls));
+        g_ptr_array_add(lines, g_strdup_printf("profanity_timer_microseconds_total{timer=\"%s\"}\t%" G_GINT64_FORMAT, name, timer.total_us));
+        g_ptr_array_add(lines, g_strdup_printf("profanity_timer_microseconds_p99{timer=\"%s\"}\t%" G_GINT64_FORMAT, name, timer.p99_us));
+        g_ptr_array_add(lines, g_strdup_printf("profanity_timer_microseconds_max{timer=\"%s\"}\t%" G_GINT64_FORMAT, name, timer.max_us));
+    }
+
+    GList* plugin_stats = plugins_get_stats();
+    for (GList* curr = plugin_stats; curr; curr = g_list_next(curr)) {
+        PluginHookStats* entry = curr->data;
+        g_ptr_array_add(lines, g_strdup_printf("profanity_plugin_hook_calls_total{plugin=\"%s\",hook=\"%s\"}\t%" G_GUINT64_FORMAT, entry->plugin_name, entry->hook, entry->calls));
+        g_ptr_array_add(lines, g_strdup_printf("profanity_plugin_hook_microseconds_total{plugin=\"%s\",hook=\"%s\"}\t%" G_GINT64_FORMAT, entry->plugin_name, entry->hook, entry->total_us));
+    }
+    plugins_free_stats(plugin_stats);
+
+    g_ptr_array_add(lines, g_strdup_printf("profanity_iq_pending\t%u", iq_id_handlers_count()));
+    g_ptr_array_add(lines, g_strdup_printf("profanity_db_write_queue\t%d", log_database_queue_depth()));
+
+    GList* nums = wins_get_nums_sorted();
+    for (GList* curr = nums; curr; curr = g_list_next(curr)) {
+        int entries = 0;
+        gsize bytes = 0;
+        win_buffer_stats(wins_get_by_num(GPOINTER_TO_INT(curr->data)), &entries, &bytes);
+        g_ptr_array_add(lines, g_strdup_printf("profanity_window_buffer_entries{window=\"%d\"}\t%d", GPOINTER_TO_INT(curr->data), entries));
+        g_ptr_array_add(lines, g_strdup_printf("profanity_window_buffer_bytes{window=\"%d\"}\t%" G_GSIZE_FORMAT, GPOINTER_TO_INT(curr->data), bytes));
+    }
+    g_list_free(nums);
+
+    g_ptr_array_add(lines, NULL);
+    return (char**)g_ptr_array_free(lines, FALSE);
+}
+
 int
 api_current_win_is_console(void)
 {
@@ -423,6 +497,95 @@ api_send_stanza(const char* const stanza)
     return connection_send_stanza(stanza);
 }
 
+const char*
+api_stanza_get_name(xmpp_stanza_t* const stanza)
+{
+    return stanza ? xmpp_stanza_get_name(stanza) : NULL;
+}
+
+const char*
+api_stanza_get_ns(xmpp_stanza_t* const stanza)
+{
+    return stanza ? xmpp_stanza_get_ns(stanza) : NULL;
+}
+
+const char*
+api_stanza_get_attribute(xmpp_stanza_t* const stanza, const char* const name)
+{
+    if (stanza == NULL || name == NULL) {
+        return NULL;
+    }
+
+    return xmpp_stanza_get_attribute(stanza, name);
+}
+
+xmpp_stanza_t*
+api_stanza_get_child(xmpp_stanza_t* const stanza, const char* const name, const char* const ns)
+{
+    if (stanza == NULL) {
+        return NULL;
+    }
+    if (name && ns) {
+        return xmpp_stanza_get_child_by_name_and_ns(stanza, name, ns);
+    }
+    if (name) {
+        return xmpp_stanza_get_child_by_name(stanza, name);
+    }
+    if (ns) {
+        return xmpp_stanza_get_child_by_ns(stanza, ns);
+    }
+
+    return xmpp_stanza_get_children(stanza);
+}
+
+xmpp_stanza_t*
+api_stanza_get_children(xmpp_stanza_t* const stanza)
+{
+    return stanza ? xmpp_stanza_get_children(stanza) : NULL;
+}
+
+xmpp_stanza_t*
+api_stanza_get_next(xmpp_stanza_t* const stanza)
+{
+    return stanza ? xmpp_stanza_get_next(stanza) : NULL;
+}
+
+// copies owned by the plugin, strophe's allocator is not the plugin's
+char*
+api_stanza_get_text(xmpp_stanza_t* const stanza)
+{
+    if (stanza == NULL) {
+        return NULL;
+    }
+
+    char* text = xmpp_stanza_get_text(stanza);
+    if (text == NULL) {
+        return NULL;
+    }
+    char* result = strdup(text);
+    xmpp_free(xmpp_stanza_get_context(stanza), text);
+
+    return result;
+}
+
+char*
+api_stanza_to_text(xmpp_stanza_t* const stanza)
+{
+    if (stanza == NULL) {
+        return NULL;
+    }
+
+    char* text = NULL;
+    size_t text_size;
+    if (xmpp_stanza_to_text(stanza, &text, &text_size) != XMPP_EOK) {
+        return NULL;
+    }
+    char* result = strdup(text);
+    xmpp_free(xmpp_stanza_get_context(stanza), text);
+
+    return result;
+}
+
 gboolean
 api_settings_boolean_get(const char* const group, const char* const key, gboolean def)
 {
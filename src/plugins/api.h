@@ -36,6 +36,8 @@
 #ifndef PLUGINS_API_H
 #define PLUGINS_API_H
 
+#include <strophe.h>
+
 #include "plugins/callbacks.h"
 
 void api_cons_alert(void);
@@ -52,6 +54,8 @@ char* api_get_current_nick(void);
 char* api_get_name_from_roster(const char* barejid);
 char* api_get_barejid_from_roster(const char* name);
 char** api_get_current_occupants(void);
+char** api_get_plugin_stats(void);
+char** api_get_stats(void);
 
 char* api_get_room_nick(const char* barejid);
 
@@ -84,6 +88,15 @@ int api_win_show_themed(const char* tag, const char* const group, const char* co
 
 int api_send_stanza(const char* const stanza);
 
+const char* api_stanza_get_name(xmpp_stanza_t* const stanza);
+const char* api_stanza_get_ns(xmpp_stanza_t* const stanza);
+const char* api_stanza_get_attribute(xmpp_stanza_t* const stanza, const char* const name);
+xmpp_stanza_t* api_stanza_get_child(xmpp_stanza_t* const stanza, const char* const name, const char* const ns);
+xmpp_stanza_t* api_stanza_get_children(xmpp_stanza_t* const stanza);
+xmpp_stanza_t* api_stanza_get_next(xmpp_stanza_t* const stanza);
+char* api_stanza_get_text(xmpp_stanza_t* const stanza);
+char* api_stanza_to_text(xmpp_stanza_t* const stanza);
+
 gboolean api_settings_boolean_get(const char* const group, const char* const key, gboolean def);
 void api_settings_boolean_set(const char* const group, const char* const key, gboolean value);
 char* api_settings_string_get(const char* const group, const char* const key, const char* const def);
@@ -39,12 +39,73 @@
 
 #include <glib.h>
 
+#include "common.h"
 #include "tools/autocomplete.h"
 #include "command/cmd_ac.h"
 
 static GHashTable* plugin_to_acs;
 static GHashTable* plugin_to_filepath_acs;
 
+// the completers of all plugins by the command they complete, the first word of
+// their key or prefix, so Tab only tries the ones for the command typed
+typedef struct plugin_ac_t
+{
+    char* key;
+    Autocomplete ac;
+} PluginAc;
+
+static GHashTable* command_to_acs;
+static GHashTable* command_to_filepath_prefixes;
+
+static char*
+_command_of(const char* const input)
+{
+    const char* space = strchr(input, ' ');
+    return space ? g_strndup(input, space - input) : g_strdup(input);
+}
+
+static void
+_free_plugin_ac(PluginAc* plugin_ac)
+{
+    g_free(plugin_ac->key);
+    g_free(plugin_ac);
+}
+
+static void
+_free_plugin_acs(GList* plugin_acs)
+{
+    g_list_free_full(plugin_acs, (GDestroyNotify)_free_plugin_ac);
+}
+
+static void
+_free_prefixes(GList* prefixes)
+{
+    g_list_free_full(prefixes, g_free);
+}
+
+static void
+_index_add(GHashTable* index, const char* const key, gpointer value)
+{
+    char* command = _command_of(key);
+    GList* values = g_hash_table_lookup(index, command);
+    if (values) {
+        // keeps the head so the table still owns the list
+        values = g_list_append(values, value);
+        g_free(command);
+    } else {
+        g_hash_table_insert(index, command, g_list_append(NULL, value));
+    }
+}
+
+static void
+_index_add_ac(const char* const key, Autocomplete ac)
+{
+    PluginAc* plugin_ac = g_new(PluginAc, 1);
+    plugin_ac->key = g_strdup(key);
+    plugin_ac->ac = ac;
+    _index_add(command_to_acs, key, plugin_ac);
+}
+
 static void
 _free_autocompleters(GHashTable* key_to_ac)
 {
@@ -62,6 +123,8 @@ autocompleters_init(void)
 {
     plugin_to_acs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)_free_autocompleters);
     plugin_to_filepath_acs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)_free_filepath_autocompleters);
+    command_to_acs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)_free_plugin_acs);
+    command_to_filepath_prefixes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)_free_prefixes);
 }
 
 void
@@ -76,6 +139,7 @@ autocompleters_add(const char* const plugin_name, const char* key, char** items)
             Autocomplete new_ac = autocomplete_new();
             autocomplete_add_all(new_ac, items);
             g_hash_table_insert(key_to_ac, strdup(key), new_ac);
+            _index_add_ac(key, new_ac);
         }
     } else {
         key_to_ac = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)autocomplete_free);
@@ -83,6 +147,7 @@ autocompleters_add(const char* const plugin_name, const char* key, char** items)
         autocomplete_add_all(new_ac, items);
         g_hash_table_insert(key_to_ac, strdup(key), new_ac);
         g_hash_table_insert(plugin_to_acs, strdup(plugin_name), key_to_ac);
+        _index_add_ac(key, new_ac);
     }
 }
 
@@ -123,65 +188,45 @@ autocompleters_filepath_add(const char* const plugin_name, const char* prefix)
 {
     GHashTable* prefixes = g_hash_table_lookup(plugin_to_filepath_acs, plugin_name);
     if (prefixes) {
+        if (g_hash_table_contains(prefixes, prefix)) {
+            return;
+        }
         g_hash_table_add(prefixes, strdup(prefix));
     } else {
         prefixes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
         g_hash_table_add(prefixes, strdup(prefix));
         g_hash_table_insert(plugin_to_filepath_acs, strdup(plugin_name), prefixes);
     }
+    _index_add(command_to_filepath_prefixes, prefix, g_strdup(prefix));
 }
 
 char*
 autocompleters_complete(const char* const input, gboolean previous)
 {
     char* result = NULL;
+    auto_gchar gchar* command = _command_of(input);
 
-    GList* ac_hashes = g_hash_table_get_values(plugin_to_acs);
-    GList* curr_hash = ac_hashes;
-    while (curr_hash) {
-        GHashTable* key_to_ac = curr_hash->data;
-
-        GList* keys = g_hash_table_get_keys(key_to_ac);
-        GList* curr = keys;
-        while (curr) {
-            result = autocomplete_param_with_ac(input, curr->data, g_hash_table_lookup(key_to_ac, curr->data), TRUE, previous);
-            if (result) {
-                g_list_free(ac_hashes);
-                g_list_free(keys);
-                return result;
-            }
-            curr = g_list_next(curr);
+    GList* curr = g_hash_table_lookup(command_to_acs, command);
+    while (curr) {
+        PluginAc* plugin_ac = curr->data;
+        result = autocomplete_param_with_ac(input, plugin_ac->key, plugin_ac->ac, TRUE, previous);
+        if (result) {
+            return result;
         }
-        g_list_free(keys);
-
-        curr_hash = g_list_next(curr_hash);
+        curr = g_list_next(curr);
     }
-    g_list_free(ac_hashes);
 
-    GList* filepath_hashes = g_hash_table_get_values(plugin_to_filepath_acs);
-    curr_hash = filepath_hashes;
-    while (curr_hash) {
-        GHashTable* prefixes_hash = curr_hash->data;
-        GList* prefixes = g_hash_table_get_keys(prefixes_hash);
-        GList* curr_prefix = prefixes;
-        while (curr_prefix) {
-            char* prefix = curr_prefix->data;
-            if (g_str_has_prefix(input, prefix)) {
-                result = cmd_ac_complete_filepath(input, prefix, previous);
-                if (result) {
-                    g_list_free(filepath_hashes);
-                    g_list_free(prefixes);
-                    return result;
-                }
+    curr = g_hash_table_lookup(command_to_filepath_prefixes, command);
+    while (curr) {
+        char* prefix = curr->data;
+        if (g_str_has_prefix(input, prefix)) {
+            result = cmd_ac_complete_filepath(input, prefix, previous);
+            if (result) {
+                return result;
             }
-
-            curr_prefix = g_list_next(curr_prefix);
         }
-        g_list_free(prefixes);
-
-        curr_hash = g_list_next(curr_hash);
+        curr = g_list_next(curr);
     }
-    g_list_free(filepath_hashes);
 
     return NULL;
 }
@@ -209,6 +254,10 @@ autocompleters_reset(void)
 void
 autocompleters_destroy(void)
 {
+    g_hash_table_destroy(command_to_acs);
+    g_hash_table_destroy(command_to_filepath_prefixes);
+    command_to_acs = NULL;
+    command_to_filepath_prefixes = NULL;
     g_hash_table_destroy(plugin_to_acs);
     g_hash_table_destroy(plugin_to_filepath_acs);
     plugin_to_acs = NULL;
@@ -201,6 +201,18 @@ c_api_get_current_occupants(void)
     return api_get_current_occupants();
 }
 
+static char**
+c_api_get_plugin_stats(void)
+{
+    return api_get_plugin_stats();
+}
+
+static char**
+c_api_get_stats(void)
+{
+    return api_get_stats();
+}
+
 static char*
 c_api_get_room_nick(const char* barejid)
 {
@@ -271,6 +283,54 @@ c_api_send_stanza(char* stanza)
     return api_send_stanza(stanza);
 }
 
+static const char*
+c_api_stanza_get_name(PROF_STANZA stanza)
+{
+    return api_stanza_get_name(stanza);
+}
+
+static const char*
+c_api_stanza_get_ns(PROF_STANZA stanza)
+{
+    return api_stanza_get_ns(stanza);
+}
+
+static const char*
+c_api_stanza_get_attribute(PROF_STANZA stanza, const char* name)
+{
+    return api_stanza_get_attribute(stanza, name);
+}
+
+static PROF_STANZA
+c_api_stanza_get_child(PROF_STANZA stanza, const char* name, const char* ns)
+{
+    return api_stanza_get_child(stanza, name, ns);
+}
+
+static PROF_STANZA
+c_api_stanza_get_children(PROF_STANZA stanza)
+{
+    return api_stanza_get_children(stanza);
+}
+
+static PROF_STANZA
+c_api_stanza_get_next(PROF_STANZA stanza)
+{
+    return api_stanza_get_next(stanza);
+}
+
+static char*
+c_api_stanza_get_text(PROF_STANZA stanza)
+{
+    return api_stanza_get_text(stanza);
+}
+
+static char*
+c_api_stanza_to_text(PROF_STANZA stanza)
+{
+    return api_stanza_to_text(stanza);
+}
+
 static int
 c_api_settings_boolean_get(char* group, char* key, int def)
 {
@@ -483,6 +543,8 @@ c_api_init(void)
     prof_get_name_from_roster = c_api_get_name_from_roster;
     prof_get_barejid_from_roster = c_api_get_barejid_from_roster;
     prof_get_current_occupants = c_api_get_current_occupants;
+    prof_get_plugin_stats = c_api_get_plugin_stats;
+    prof_get_stats = c_api_get_stats;
     prof_get_room_nick = c_api_get_room_nick;
     prof_log_debug = c_api_log_debug;
     prof_log_info = c_api_log_info;
@@ -493,6 +555,14 @@ c_api_init(void)
     prof_win_show = c_api_win_show;
     prof_win_show_themed = c_api_win_show_themed;
     prof_send_stanza = c_api_send_stanza;
+    prof_stanza_get_name = c_api_stanza_get_name;
+    prof_stanza_get_ns = c_api_stanza_get_ns;
+    prof_stanza_get_attribute = c_api_stanza_get_attribute;
+    prof_stanza_get_child = c_api_stanza_get_child;
+    prof_stanza_get_children = c_api_stanza_get_children;
+    prof_stanza_get_next = c_api_stanza_get_next;
+    prof_stanza_get_text = c_api_stanza_get_text;
+    prof_stanza_to_text = c_api_stanza_to_text;
     prof_settings_boolean_get = c_api_settings_boolean_get;
     prof_settings_boolean_set = c_api_settings_boolean_set;
     prof_settings_string_get = c_api_settings_string_get;
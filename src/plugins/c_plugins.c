@@ -108,6 +108,7 @@ c_plugin_create(const char* const filename)
     plugin->on_presence_stanza_receive = c_on_presence_stanza_receive_hook;
     plugin->on_iq_stanza_send = c_on_iq_stanza_send_hook;
     plugin->on_iq_stanza_receive = c_on_iq_stanza_receive_hook;
+    plugin->on_stanza_receive_parsed = c_on_stanza_receive_parsed_hook;
     plugin->on_contact_offline = c_on_contact_offline_hook;
     plugin->on_contact_presence = c_on_contact_presence_hook;
     plugin->on_chat_win_focus = c_on_chat_win_focus_hook;
@@ -489,6 +490,20 @@ c_on_iq_stanza_receive_hook(ProfPlugin* plugin, const char* const text)
     return func(text);
 }
 
+gboolean
+c_on_stanza_receive_parsed_hook(ProfPlugin* plugin, const char* const hook, xmpp_stanza_t* const stanza)
+{
+    void* f = NULL;
+    int (*func)(void* __stanza);
+    assert(plugin && plugin->module);
+
+    if (NULL == (f = dlsym(plugin->module, hook)))
+        return TRUE;
+
+    func = (int (*)(void*))f;
+    return func(stanza);
+}
+
 void
 c_on_contact_offline_hook(ProfPlugin* plugin, const char* const barejid, const char* const resource,
                           const char* const status)
@@ -87,6 +87,8 @@ gboolean c_on_presence_stanza_receive_hook(ProfPlugin* plugin, const char* const
 char* c_on_iq_stanza_send_hook(ProfPlugin* plugin, const char* const text);
 gboolean c_on_iq_stanza_receive_hook(ProfPlugin* plugin, const char* const text);
 
+gboolean c_on_stanza_receive_parsed_hook(ProfPlugin* plugin, const char* const hook, xmpp_stanza_t* const stanza);
+
 void c_on_contact_offline_hook(ProfPlugin* plugin, const char* const barejid, const char* const resource,
                                const char* const status);
 void c_on_contact_presence_hook(ProfPlugin* plugin, const char* const barejid, const char* const resource,
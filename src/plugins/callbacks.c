@@ -38,6 +38,7 @@
 #include <string.h>
 #include <stdlib.h>
 
+#include "common.h"
 #include "command/cmd_defs.h"
 #include "command/cmd_ac.h"
 #include "plugins/callbacks.h"
@@ -48,8 +49,17 @@
 #include "ui/window_list.h"
 
 static GHashTable* p_commands = NULL;
+// command name to the PluginCommand of whichever plugin registered it, a
+// single lookup when running a command
+static GHashTable* p_command_index = NULL;
 static GHashTable* p_timed_functions = NULL;
+// timed functions of all plugins ordered on next_fire as a binary min-heap,
+// a single timeout is armed for the earliest
+static GPtrArray* p_timed_heap = NULL;
+static guint p_timed_source = 0;
 static GHashTable* p_window_callbacks = NULL;
+// command name to plugin name, for plugins not loaded until first use
+static GHashTable* p_deferred_commands = NULL;
 
 static void
 _free_window_callback(PluginWindowCallback* window_callback)
@@ -122,8 +132,7 @@ _free_timed_function(PluginTimedFunction* timed_function)
         timed_function->callback_destroy(timed_function->callback);
     }
 
-    g_timer_destroy(timed_function->timer);
-
+    free(timed_function->plugin_name);
     free(timed_function);
 }
 
@@ -133,12 +142,142 @@ _free_timed_function_list(GList* timed_functions)
     g_list_free_full(timed_functions, (GDestroyNotify)_free_timed_function);
 }
 
+static void
+_timed_heap_swap(guint i, guint j)
+{
+    gpointer tmp = p_timed_heap->pdata[i];
+    p_timed_heap->pdata[i] = p_timed_heap->pdata[j];
+    p_timed_heap->pdata[j] = tmp;
+}
+
+static gint64
+_timed_heap_key(guint i)
+{
+    return ((PluginTimedFunction*)p_timed_heap->pdata[i])->next_fire;
+}
+
+static void
+_timed_heap_up(guint i)
+{
+    while (i > 0 && _timed_heap_key(i) < _timed_heap_key((i - 1) / 2)) {
+        _timed_heap_swap(i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static void
+_timed_heap_down(guint i)
+{
+    while (TRUE) {
+        guint smallest = i;
+        guint left = 2 * i + 1;
+        guint right = 2 * i + 2;
+        if (left < p_timed_heap->len && _timed_heap_key(left) < _timed_heap_key(smallest)) {
+            smallest = left;
+        }
+        if (right < p_timed_heap->len && _timed_heap_key(right) < _timed_heap_key(smallest)) {
+            smallest = right;
+        }
+        if (smallest == i) {
+            return;
+        }
+        _timed_heap_swap(i, smallest);
+        i = smallest;
+    }
+}
+
+static void
+_timed_heap_push(PluginTimedFunction* timed_function)
+{
+    g_ptr_array_add(p_timed_heap, timed_function);
+    _timed_heap_up(p_timed_heap->len - 1);
+}
+
+static PluginTimedFunction*
+_timed_heap_pop(void)
+{
+    PluginTimedFunction* top = p_timed_heap->pdata[0];
+    g_ptr_array_remove_index_fast(p_timed_heap, 0);
+    if (p_timed_heap->len > 0) {
+        _timed_heap_down(0);
+    }
+
+    return top;
+}
+
+static gboolean _timed_fire(gpointer data);
+
+static void
+_timed_arm(void)
+{
+    if (p_timed_source) {
+        g_source_remove(p_timed_source);
+        p_timed_source = 0;
+    }
+    if (p_timed_heap->len == 0) {
+        return;
+    }
+
+    gint64 delay = _timed_heap_key(0) - g_get_monotonic_time();
+    p_timed_source = g_timeout_add(delay > 0 ? delay / 1000 + 1 : 0, _timed_fire, NULL);
+}
+
+static gboolean
+_timed_fire(gpointer data)
+{
+    p_timed_source = 0;
+
+    while (p_timed_heap->len > 0 && _timed_heap_key(0) <= g_get_monotonic_time()) {
+        PluginTimedFunction* timed_function = _timed_heap_pop();
+        auto_char char* plugin_name = strdup(timed_function->plugin_name);
+
+        gint64 start = g_get_monotonic_time();
+        timed_function->callback_exec(timed_function);
+        plugins_stats_add_timed(plugin_name, start);
+
+        // the plugin may have been unloaded from its own callback
+        GList* timed_function_list = g_hash_table_lookup(p_timed_functions, plugin_name);
+        if (g_list_find(timed_function_list, timed_function)) {
+            timed_function->next_fire = g_get_monotonic_time() + timed_function->interval_seconds * G_USEC_PER_SEC;
+            _timed_heap_push(timed_function);
+        }
+    }
+
+    _timed_arm();
+
+    return FALSE;
+}
+
+// another plugin registering the same command takes over when the one in
+// the index goes away
+static void
+_command_index_fallback(const char* const removed_plugin, const char* const command_name)
+{
+    GHashTableIter iter;
+    gpointer plugin_name;
+    gpointer command_hash;
+    g_hash_table_iter_init(&iter, p_commands);
+    while (g_hash_table_iter_next(&iter, &plugin_name, &command_hash)) {
+        if (g_strcmp0(plugin_name, removed_plugin) == 0) {
+            continue;
+        }
+        PluginCommand* command = g_hash_table_lookup(command_hash, command_name);
+        if (command) {
+            g_hash_table_replace(p_command_index, command->command_name, command);
+            return;
+        }
+    }
+}
+
 void
 callbacks_init(void)
 {
     p_commands = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)_free_command_hash);
+    p_command_index = g_hash_table_new(g_str_hash, g_str_equal);
     p_timed_functions = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)_free_timed_function_list);
+    p_timed_heap = g_ptr_array_new();
     p_window_callbacks = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)_free_window_callbacks);
+    p_deferred_commands = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
 }
 
 void
@@ -150,6 +289,10 @@ callbacks_remove(const char* const plugin_name)
         GList* curr = commands;
         while (curr) {
             char* command = curr->data;
+            if (g_hash_table_lookup(p_command_index, command) == g_hash_table_lookup(command_hash, command)) {
+                g_hash_table_remove(p_command_index, command);
+                _command_index_fallback(plugin_name, command);
+            }
             cmd_ac_remove(command);
             cmd_ac_remove_help(&command[1]);
             curr = g_list_next(curr);
@@ -158,7 +301,24 @@ callbacks_remove(const char* const plugin_name)
     }
 
     g_hash_table_remove(p_commands, plugin_name);
-    g_hash_table_remove(p_timed_functions, plugin_name);
+
+    if (g_hash_table_contains(p_timed_functions, plugin_name)) {
+        // rebuild the heap without the plugin's functions
+        guint i = 0;
+        while (i < p_timed_heap->len) {
+            PluginTimedFunction* timed_function = p_timed_heap->pdata[i];
+            if (g_strcmp0(timed_function->plugin_name, plugin_name) == 0) {
+                g_ptr_array_remove_index_fast(p_timed_heap, i);
+            } else {
+                i++;
+            }
+        }
+        for (i = p_timed_heap->len / 2; i > 0; i--) {
+            _timed_heap_down(i - 1);
+        }
+        g_hash_table_remove(p_timed_functions, plugin_name);
+        _timed_arm();
+    }
 
     GHashTable* tag_to_win_cb_hash = g_hash_table_lookup(p_window_callbacks, plugin_name);
     if (tag_to_win_cb_hash) {
@@ -177,14 +337,24 @@ callbacks_remove(const char* const plugin_name)
 void
 callbacks_close(void)
 {
+    g_hash_table_destroy(p_command_index);
     g_hash_table_destroy(p_commands);
+    if (p_timed_source) {
+        g_source_remove(p_timed_source);
+        p_timed_source = 0;
+    }
+    g_ptr_array_free(p_timed_heap, TRUE);
+    p_timed_heap = NULL;
     g_hash_table_destroy(p_timed_functions);
     g_hash_table_destroy(p_window_callbacks);
+    g_hash_table_destroy(p_deferred_commands);
 }
 
 void
 callbacks_add_command(const char* const plugin_name, PluginCommand* command)
 {
+    g_hash_table_replace(p_command_index, command->command_name, command);
+
     GHashTable* command_hash = g_hash_table_lookup(p_commands, plugin_name);
     if (command_hash) {
         g_hash_table_insert(command_hash, strdup(command->command_name), command);
@@ -197,6 +367,58 @@ callbacks_add_command(const char* const plugin_name, PluginCommand* command)
     cmd_ac_add_help(&command->command_name[1]);
 }
 
+GList*
+callbacks_get_command_names(const char* const plugin_name)
+{
+    GHashTable* command_hash = g_hash_table_lookup(p_commands, plugin_name);
+    if (command_hash == NULL) {
+        return NULL;
+    }
+
+    return g_hash_table_get_keys(command_hash);
+}
+
+// register a command name for a plugin that is only loaded once it is used
+void
+callbacks_add_deferred_command(const char* const plugin_name, const char* const command_name)
+{
+    g_hash_table_insert(p_deferred_commands, strdup(command_name), strdup(plugin_name));
+    cmd_ac_add(command_name);
+    cmd_ac_add_help(&command_name[1]);
+}
+
+void
+callbacks_remove_deferred(const char* const plugin_name)
+{
+    GHashTableIter iter;
+    gpointer command_name, name;
+    g_hash_table_iter_init(&iter, p_deferred_commands);
+    while (g_hash_table_iter_next(&iter, &command_name, &name)) {
+        if (g_strcmp0(name, plugin_name) == 0) {
+            cmd_ac_remove(command_name);
+            cmd_ac_remove_help(&((char*)command_name)[1]);
+            g_hash_table_iter_remove(&iter);
+        }
+    }
+}
+
+// load the deferred plugin providing command_name, if there is one
+gboolean
+callbacks_load_deferred(const char* const command_name)
+{
+    if (p_deferred_commands == NULL) {
+        return FALSE;
+    }
+
+    const char* plugin_name = g_hash_table_lookup(p_deferred_commands, command_name);
+    if (plugin_name == NULL) {
+        return FALSE;
+    }
+
+    auto_gchar gchar* name = g_strdup(plugin_name);
+    return plugins_load_deferred(name);
+}
+
 void
 callbacks_add_timed(const char* const plugin_name, PluginTimedFunction* timed_function)
 {
@@ -208,6 +430,21 @@ callbacks_add_timed(const char* const plugin_name, PluginTimedFunction* timed_fu
         timed_function_list = g_list_append(timed_function_list, timed_function);
         g_hash_table_insert(p_timed_functions, strdup(plugin_name), timed_function_list);
     }
+
+    timed_function->plugin_name = strdup(plugin_name);
+    if (timed_function->interval_seconds > 0) {
+        timed_function->next_fire = g_get_monotonic_time() + timed_function->interval_seconds * G_USEC_PER_SEC;
+        _timed_heap_push(timed_function);
+        if (p_timed_heap->pdata[0] == timed_function) {
+            _timed_arm();
+        }
+    }
+}
+
+gboolean
+callbacks_has_timed(const char* const plugin_name)
+{
+    return g_hash_table_lookup(p_timed_functions, plugin_name) != NULL;
 }
 
 gboolean
@@ -273,80 +510,41 @@ callbacks_get_window_handler(const char* tag)
 gboolean
 plugins_run_command(const char* const input)
 {
-    auto_gcharv gchar** split = g_strsplit(input, " ", -1);
-
-    GList* command_hashes = g_hash_table_get_values(p_commands);
-    GList* curr_hash = command_hashes;
-    while (curr_hash) {
-        GHashTable* command_hash = curr_hash->data;
-
-        PluginCommand* command = g_hash_table_lookup(command_hash, split[0]);
-        if (command) {
-            gboolean result;
-            auto_gcharv gchar** args = parse_args_with_freetext(input, command->min_args, command->max_args, &result);
-            if (result == FALSE) {
-                ui_invalid_command_usage(command->command_name, NULL);
-            } else {
-                command->callback_exec(command, args);
-            }
-            g_list_free(command_hashes);
-            return TRUE;
+    const char* space = strchr(input, ' ');
+    auto_gchar gchar* command_name = space ? g_strndup(input, space - input) : g_strdup(input);
+
+    PluginCommand* command = g_hash_table_lookup(p_command_index, command_name);
+    if (command) {
+        gboolean result;
+        auto_gcharv gchar** args = parse_args_with_freetext(input, command->min_args, command->max_args, &result);
+        if (result == FALSE) {
+            ui_invalid_command_usage(command->command_name, NULL);
+        } else {
+            command->callback_exec(command, args);
         }
+        return TRUE;
+    }
 
-        curr_hash = g_list_next(curr_hash);
+    if (callbacks_load_deferred(command_name)) {
+        return plugins_run_command(input);
     }
 
-    g_list_free(command_hashes);
     return FALSE;
 }
 
 CommandHelp*
 plugins_get_help(const char* const cmd)
 {
-    GList* command_hashes = g_hash_table_get_values(p_commands);
-    GList* curr_hash = command_hashes;
-    while (curr_hash) {
-        GHashTable* command_hash = curr_hash->data;
-
-        PluginCommand* command = g_hash_table_lookup(command_hash, cmd);
-        if (command) {
-            g_list_free(command_hashes);
-            return command->help;
-        }
-
-        curr_hash = g_list_next(curr_hash);
+    PluginCommand* command = g_hash_table_lookup(p_command_index, cmd);
+    if (command) {
+        return command->help;
     }
 
-    g_list_free(command_hashes);
-
-    return NULL;
-}
-
-void
-plugins_run_timed(void)
-{
-    GList* timed_functions_lists = g_hash_table_get_values(p_timed_functions);
-
-    GList* curr_list = timed_functions_lists;
-    while (curr_list) {
-        GList* timed_function_list = curr_list->data;
-        GList* curr = timed_function_list;
-        while (curr) {
-            PluginTimedFunction* timed_function = curr->data;
-
-            gdouble elapsed = g_timer_elapsed(timed_function->timer, NULL);
-
-            if (timed_function->interval_seconds > 0 && elapsed >= timed_function->interval_seconds) {
-                timed_function->callback_exec(timed_function);
-                g_timer_start(timed_function->timer);
-            }
-
-            curr = g_list_next(curr);
-        }
-        curr_list = g_list_next(curr_list);
+    if (callbacks_load_deferred(cmd)) {
+        return plugins_get_help(cmd);
     }
 
-    g_list_free(timed_functions_lists);
+    return NULL;
 }
 
 GList*
@@ -371,5 +569,9 @@ plugins_get_command_names(void)
 
     g_list_free(command_hashes);
 
+    if (p_deferred_commands) {
+        result = g_list_concat(result, g_hash_table_get_keys(p_deferred_commands));
+    }
+
     return result;
 }
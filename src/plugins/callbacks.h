@@ -57,7 +57,8 @@ typedef struct p_timed_function
     void (*callback_exec)(struct p_timed_function* timed_function);
     void (*callback_destroy)(void* callback);
     int interval_seconds;
-    GTimer* timer;
+    char* plugin_name;
+    gint64 next_fire; // monotonic time of the next call
 } PluginTimedFunction;
 
 typedef struct p_window_input_callback
@@ -72,7 +73,12 @@ void callbacks_remove(const char* const plugin_name);
 void callbacks_close(void);
 
 void callbacks_add_command(const char* const plugin_name, PluginCommand* command);
+GList* callbacks_get_command_names(const char* const plugin_name);
+void callbacks_add_deferred_command(const char* const plugin_name, const char* const command_name);
+void callbacks_remove_deferred(const char* const plugin_name);
+gboolean callbacks_load_deferred(const char* const command_name);
 void callbacks_add_timed(const char* const plugin_name, PluginTimedFunction* timed_function);
+gboolean callbacks_has_timed(const char* const plugin_name);
 gboolean callbacks_win_exists(const char* const plugin_name, const char* tag);
 void callbacks_add_window_handler(const char* const plugin_name, const char* tag, PluginWindowCallback* window_callback);
 void* callbacks_get_window_handler(const char* tag);
@@ -127,6 +127,17 @@ disco_remove_features(const char* plugin_name)
     g_list_free(plugin_feature_list);
 }
 
+gboolean
+disco_has_features(const char* plugin_name)
+{
+    if (!plugin_to_features) {
+        return FALSE;
+    }
+
+    GHashTable* plugin_features = g_hash_table_lookup(plugin_to_features, plugin_name);
+    return plugin_features && g_hash_table_size(plugin_features) > 0;
+}
+
 GList*
 disco_get_features(void)
 {
@@ -40,6 +40,7 @@
 
 void disco_add_feature(const char* plugin_name, char* feature);
 void disco_remove_features(const char* plugin_name);
+gboolean disco_has_features(const char* plugin_name);
 GList* disco_get_features(void);
 void disco_close(void);
 
@@ -36,6 +36,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <gio/gio.h>
+#include <glib/gstdio.h>
 
 #include "log.h"
 #include "config.h"
@@ -50,6 +51,7 @@
 #include "plugins/themes.h"
 #include "plugins/settings.h"
 #include "plugins/disco.h"
+#include "tools/control.h"
 #include "ui/ui.h"
 #include "xmpp/xmpp.h"
 
@@ -61,10 +63,490 @@
 #ifdef HAVE_C
 #include "plugins/c_plugins.h"
 #include "plugins/c_api.h"
+#include "stats.h"
 #endif
 
 static GHashTable* plugins;
 
+// Plugins whose last load only registered commands (no hooks, timed functions
+// or disco features) are deferred: at startup just their command names are
+// registered from the manifest, and the plugin is loaded when one of them is
+// first used.
+static prof_keyfile_t manifest_prof_keyfile;
+static GHashTable* deferred_plugins;
+
+typedef enum {
+    PLUGIN_HOOK_ON_START,
+    PLUGIN_HOOK_ON_SHUTDOWN,
+    PLUGIN_HOOK_ON_CONNECT,
+    PLUGIN_HOOK_ON_DISCONNECT,
+    PLUGIN_HOOK_PRE_CHAT_MESSAGE_DISPLAY,
+    PLUGIN_HOOK_POST_CHAT_MESSAGE_DISPLAY,
+    PLUGIN_HOOK_PRE_CHAT_MESSAGE_SEND,
+    PLUGIN_HOOK_POST_CHAT_MESSAGE_SEND,
+    PLUGIN_HOOK_PRE_ROOM_MESSAGE_DISPLAY,
+    PLUGIN_HOOK_POST_ROOM_MESSAGE_DISPLAY,
+    PLUGIN_HOOK_PRE_ROOM_MESSAGE_SEND,
+    PLUGIN_HOOK_POST_ROOM_MESSAGE_SEND,
+    PLUGIN_HOOK_ON_ROOM_HISTORY_MESSAGE,
+    PLUGIN_HOOK_PRE_PRIV_MESSAGE_DISPLAY,
+    PLUGIN_HOOK_POST_PRIV_MESSAGE_DISPLAY,
+    PLUGIN_HOOK_PRE_PRIV_MESSAGE_SEND,
+    PLUGIN_HOOK_POST_PRIV_MESSAGE_SEND,
+    PLUGIN_HOOK_ON_MESSAGE_STANZA_SEND,
+    PLUGIN_HOOK_ON_MESSAGE_STANZA_RECEIVE,
+    PLUGIN_HOOK_ON_PRESENCE_STANZA_SEND,
+    PLUGIN_HOOK_ON_PRESENCE_STANZA_RECEIVE,
+    PLUGIN_HOOK_ON_IQ_STANZA_SEND,
+    PLUGIN_HOOK_ON_IQ_STANZA_RECEIVE,
+    PLUGIN_HOOK_ON_MESSAGE_STANZA_RECEIVE_PARSED,
+    PLUGIN_HOOK_ON_PRESENCE_STANZA_RECEIVE_PARSED,
+    PLUGIN_HOOK_ON_IQ_STANZA_RECEIVE_PARSED,
+    PLUGIN_HOOK_ON_CONTACT_OFFLINE,
+    PLUGIN_HOOK_ON_CONTACT_PRESENCE,
+    PLUGIN_HOOK_ON_CHAT_WIN_FOCUS,
+    PLUGIN_HOOK_ON_ROOM_WIN_FOCUS,
+    PLUGIN_HOOK_COUNT
+} plugin_hook_t;
+
+static const char* const hook_names[PLUGIN_HOOK_COUNT] = {
+    [PLUGIN_HOOK_ON_START] = "prof_on_start",
+    [PLUGIN_HOOK_ON_SHUTDOWN] = "prof_on_shutdown",
+    [PLUGIN_HOOK_ON_CONNECT] = "prof_on_connect",
+    [PLUGIN_HOOK_ON_DISCONNECT] = "prof_on_disconnect",
+    [PLUGIN_HOOK_PRE_CHAT_MESSAGE_DISPLAY] = "prof_pre_chat_message_display",
+    [PLUGIN_HOOK_POST_CHAT_MESSAGE_DISPLAY] = "prof_post_chat_message_display",
+    [PLUGIN_HOOK_PRE_CHAT_MESSAGE_SEND] = "prof_pre_chat_message_send",
+    [PLUGIN_HOOK_POST_CHAT_MESSAGE_SEND] = "prof_post_chat_message_send",
+    [PLUGIN_HOOK_PRE_ROOM_MESSAGE_DISPLAY] = "prof_pre_room_message_display",
+    [PLUGIN_HOOK_POST_ROOM_MESSAGE_DISPLAY] = "prof_post_room_message_display",
+    [PLUGIN_HOOK_PRE_ROOM_MESSAGE_SEND] = "prof_pre_room_message_send",
+    [PLUGIN_HOOK_POST_ROOM_MESSAGE_SEND] = "prof_post_room_message_send",
+    [PLUGIN_HOOK_ON_ROOM_HISTORY_MESSAGE] = "prof_on_room_history_message",
+    [PLUGIN_HOOK_PRE_PRIV_MESSAGE_DISPLAY] = "prof_pre_priv_message_display",
+    [PLUGIN_HOOK_POST_PRIV_MESSAGE_DISPLAY] = "prof_post_priv_message_display",
+    [PLUGIN_HOOK_PRE_PRIV_MESSAGE_SEND] = "prof_pre_priv_message_send",
+    [PLUGIN_HOOK_POST_PRIV_MESSAGE_SEND] = "prof_post_priv_message_send",
+    [PLUGIN_HOOK_ON_MESSAGE_STANZA_SEND] = "prof_on_message_stanza_send",
+    [PLUGIN_HOOK_ON_MESSAGE_STANZA_RECEIVE] = "prof_on_message_stanza_receive",
+    [PLUGIN_HOOK_ON_PRESENCE_STANZA_SEND] = "prof_on_presence_stanza_send",
+    [PLUGIN_HOOK_ON_PRESENCE_STANZA_RECEIVE] = "prof_on_presence_stanza_receive",
+    [PLUGIN_HOOK_ON_IQ_STANZA_SEND] = "prof_on_iq_stanza_send",
+    [PLUGIN_HOOK_ON_IQ_STANZA_RECEIVE] = "prof_on_iq_stanza_receive",
+    [PLUGIN_HOOK_ON_MESSAGE_STANZA_RECEIVE_PARSED] = "prof_on_message_stanza_receive_parsed",
+    [PLUGIN_HOOK_ON_PRESENCE_STANZA_RECEIVE_PARSED] = "prof_on_presence_stanza_receive_parsed",
+    [PLUGIN_HOOK_ON_IQ_STANZA_RECEIVE_PARSED] = "prof_on_iq_stanza_receive_parsed",
+    [PLUGIN_HOOK_ON_CONTACT_OFFLINE] = "prof_on_contact_offline",
+    [PLUGIN_HOOK_ON_CONTACT_PRESENCE] = "prof_on_contact_presence",
+    [PLUGIN_HOOK_ON_CHAT_WIN_FOCUS] = "prof_on_chat_win_focus",
+    [PLUGIN_HOOK_ON_ROOM_WIN_FOCUS] = "prof_on_room_win_focus",
+};
+
+// plugins that define each hook, in load order, so events skip everyone else
+static GPtrArray* hook_subscribers[PLUGIN_HOOK_COUNT];
+
+// returns the number of hooks the plugin subscribed to
+static int
+_plugins_subscribe(ProfPlugin* plugin)
+{
+    int count = 0;
+    for (int i = 0; i < PLUGIN_HOOK_COUNT; i++) {
+        if (plugin->contains_hook(plugin, hook_names[i])) {
+            if (!hook_subscribers[i]) {
+                hook_subscribers[i] = g_ptr_array_new();
+            }
+            g_ptr_array_add(hook_subscribers[i], plugin);
+            count++;
+        }
+    }
+
+    return count;
+}
+
+static gint64
+_plugins_mtime(const char* const filename)
+{
+    auto_gchar gchar* plugins_dir = files_get_data_path(DIR_PLUGINS);
+    auto_gchar gchar* path = g_build_filename(plugins_dir, filename, NULL);
+    GStatBuf st;
+    if (g_stat(path, &st) != 0) {
+        return 0;
+    }
+
+    return st.st_mtime;
+}
+
+// record what the plugin registered while it was initialised
+static void
+_plugins_manifest_update(ProfPlugin* plugin, int hooks)
+{
+    GKeyFile* manifest = manifest_prof_keyfile.keyfile;
+    if (manifest == NULL) {
+        return;
+    }
+
+    GList* commands = callbacks_get_command_names(plugin->name);
+    gboolean deferrable = hooks == 0 && commands != NULL
+                          && !callbacks_has_timed(plugin->name) && !disco_has_features(plugin->name);
+
+    guint len = g_list_length(commands);
+    const gchar* command_list[len + 1];
+    guint i = 0;
+    for (GList* curr = commands; curr; curr = g_list_next(curr)) {
+        command_list[i++] = curr->data;
+    }
+    command_list[i] = NULL;
+    g_list_free(commands);
+
+    g_key_file_set_boolean(manifest, plugin->name, "deferrable", deferrable);
+    g_key_file_set_int64(manifest, plugin->name, "mtime", _plugins_mtime(plugin->name));
+    g_key_file_set_string_list(manifest, plugin->name, "commands", command_list, len);
+    save_keyfile(&manifest_prof_keyfile);
+}
+
+// register only the plugin's commands if its manifest allows and is current
+static gboolean
+_plugins_defer(const char* const filename)
+{
+    GKeyFile* manifest = manifest_prof_keyfile.keyfile;
+    if (manifest == NULL || !g_key_file_get_boolean(manifest, filename, "deferrable", NULL)) {
+        return FALSE;
+    }
+
+    gint64 mtime = _plugins_mtime(filename);
+    if (mtime == 0 || g_key_file_get_int64(manifest, filename, "mtime", NULL) != mtime) {
+        return FALSE;
+    }
+
+    gsize len = 0;
+    auto_gcharv gchar** commands = g_key_file_get_string_list(manifest, filename, "commands", &len, NULL);
+    if (commands == NULL || len == 0) {
+        return FALSE;
+    }
+
+    g_hash_table_add(deferred_plugins, g_strdup(filename));
+    for (gsize i = 0; i < len; i++) {
+        callbacks_add_deferred_command(filename, commands[i]);
+    }
+
+    return TRUE;
+}
+
+static void
+_plugins_unsubscribe(ProfPlugin* plugin)
+{
+    for (int i = 0; i < PLUGIN_HOOK_COUNT; i++) {
+        if (hook_subscribers[i]) {
+            g_ptr_array_remove(hook_subscribers[i], plugin);
+        }
+    }
+}
+
+static void
+_plugins_unsubscribe_all(void)
+{
+    for (int i = 0; i < PLUGIN_HOOK_COUNT; i++) {
+        if (hook_subscribers[i]) {
+            g_ptr_array_free(hook_subscribers[i], TRUE);
+            hook_subscribers[i] = NULL;
+        }
+    }
+}
+
+static GPtrArray*
+_plugins_subscribers(plugin_hook_t hook)
+{
+    GPtrArray* subscribers = hook_subscribers[hook];
+    if (!subscribers || subscribers->len == 0) {
+        return NULL;
+    }
+
+    return subscribers;
+}
+
+// latency accounting per plugin, one slot per hook plus one for timed functions
+#define PLUGIN_STATS_TIMED   PLUGIN_HOOK_COUNT
+#define PLUGIN_STATS_SLOTS   (PLUGIN_HOOK_COUNT + 1)
+#define PLUGIN_STATS_BUCKETS 32
+
+typedef struct plugin_slot_stats_t
+{
+    guint64 calls;
+    gint64 total_us;
+    gint64 max_us;
+    // buckets[b] counts calls that took less than 2^b microseconds
+    guint64 buckets[PLUGIN_STATS_BUCKETS];
+} PluginSlotStats;
+
+static GHashTable* plugin_stats;
+
+static void
+_plugins_stats_add(const char* const plugin_name, int slot, gint64 start)
+{
+    if (!plugin_stats) {
+        plugin_stats = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
+    }
+
+    PluginSlotStats* slots = g_hash_table_lookup(plugin_stats, plugin_name);
+    if (!slots) {
+        slots = calloc(PLUGIN_STATS_SLOTS, sizeof(PluginSlotStats));
+        g_hash_table_insert(plugin_stats, strdup(plugin_name), slots);
+    }
+
+    gint64 elapsed = g_get_monotonic_time() - start;
+    if (elapsed < 0) {
+        elapsed = 0;
+    }
+
+    PluginSlotStats* stats = &slots[slot];
+    stats->calls++;
+    stats->total_us += elapsed;
+    if (elapsed > stats->max_us) {
+        stats->max_us = elapsed;
+    }
+    guint bucket = g_bit_storage((gulong)elapsed);
+    if (bucket >= PLUGIN_STATS_BUCKETS) {
+        bucket = PLUGIN_STATS_BUCKETS - 1;
+    }
+    stats->buckets[bucket]++;
+
+    if (stats_tracing()) {
+        auto_gchar gchar* name = g_strdup_printf("plugin %s %s", plugin_name, slot == PLUGIN_STATS_TIMED ? "timed" : hook_names[slot]);
+        stats_span(g_intern_string(name), start);
+    }
+}
+
+static gint64
+_plugins_stats_p99(PluginSlotStats* stats)
+{
+    guint64 wanted = stats->calls - stats->calls / 100;
+    guint64 seen = 0;
+    for (int b = 0; b < PLUGIN_STATS_BUCKETS; b++) {
+        seen += stats->buckets[b];
+        if (seen >= wanted) {
+            gint64 upper = ((gint64)1 << b) - 1;
+            return MIN(upper, stats->max_us);
+        }
+    }
+
+    return stats->max_us;
+}
+
+void
+plugins_stats_add_timed(const char* const plugin_name, gint64 start)
+{
+    _plugins_stats_add(plugin_name, PLUGIN_STATS_TIMED, start);
+}
+
+static gint
+_plugins_stats_cmp(PluginHookStats* a, PluginHookStats* b)
+{
+    if (a->total_us != b->total_us) {
+        return a->total_us > b->total_us ? -1 : 1;
+    }
+
+    return g_strcmp0(a->plugin_name, b->plugin_name);
+}
+
+GList*
+plugins_get_stats(void)
+{
+    GList* result = NULL;
+    if (!plugin_stats) {
+        return NULL;
+    }
+
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, plugin_stats);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        PluginSlotStats* slots = value;
+        for (int i = 0; i < PLUGIN_STATS_SLOTS; i++) {
+            PluginSlotStats* stats = &slots[i];
+            if (stats->calls == 0) {
+                continue;
+            }
+            PluginHookStats* entry = malloc(sizeof(PluginHookStats));
+            entry->plugin_name = strdup(key);
+            entry->hook = strdup(i == PLUGIN_STATS_TIMED ? "timed" : hook_names[i]);
+            entry->calls = stats->calls;
+            entry->total_us = stats->total_us;
+            entry->avg_us = stats->total_us / stats->calls;
+            entry->p99_us = _plugins_stats_p99(stats);
+            entry->max_us = stats->max_us;
+            result = g_list_prepend(result, entry);
+        }
+    }
+
+    return g_list_sort(result, (GCompareFunc)_plugins_stats_cmp);
+}
+
+static void
+_plugins_hook_stats_free(PluginHookStats* entry)
+{
+    free(entry->plugin_name);
+    free(entry->hook);
+    free(entry);
+}
+
+void
+plugins_free_stats(GList* stats)
+{
+    g_list_free_full(stats, (GDestroyNotify)_plugins_hook_stats_free);
+}
+
+void
+plugins_reset_stats(void)
+{
+    if (plugin_stats) {
+        g_hash_table_remove_all(plugin_stats);
+    }
+}
+
+// observe-only hooks are queued and run once the main loop is idle, so a
+// slow plugin never delays handling or drawing of the message itself
+#define PLUGINS_DEFERRED_MAX   1024
+#define PLUGINS_DEFERRED_BATCH 32
+
+typedef struct plugin_event_t
+{
+    plugin_hook_t hook;
+    char* args[4];
+    int priority;
+} PluginEvent;
+
+static GQueue deferred_events = G_QUEUE_INIT;
+static guint deferred_source = 0;
+static guint deferred_dropped = 0;
+
+static void
+_plugins_event_free(PluginEvent* event)
+{
+    for (int i = 0; i < ARRAY_SIZE(event->args); i++) {
+        free(event->args[i]);
+    }
+    free(event);
+}
+
+static void
+_plugins_event_run(PluginEvent* event)
+{
+    // plugins may have been unloaded since the event was queued
+    GPtrArray* subscribers = _plugins_subscribers(event->hook);
+    if (!subscribers) {
+        return;
+    }
+
+    char** args = event->args;
+    for (guint i = 0; i < subscribers->len; i++) {
+        ProfPlugin* plugin = g_ptr_array_index(subscribers, i);
+        gint64 start = g_get_monotonic_time();
+        switch (event->hook) {
+        case PLUGIN_HOOK_POST_CHAT_MESSAGE_DISPLAY:
+            plugin->post_chat_message_display(plugin, args[0], args[1], args[2]);
+            break;
+        case PLUGIN_HOOK_POST_CHAT_MESSAGE_SEND:
+            plugin->post_chat_message_send(plugin, args[0], args[1]);
+            break;
+        case PLUGIN_HOOK_POST_ROOM_MESSAGE_DISPLAY:
+            plugin->post_room_message_display(plugin, args[0], args[1], args[2]);
+            break;
+        case PLUGIN_HOOK_POST_ROOM_MESSAGE_SEND:
+            plugin->post_room_message_send(plugin, args[0], args[1]);
+            break;
+        case PLUGIN_HOOK_ON_ROOM_HISTORY_MESSAGE:
+            plugin->on_room_history_message(plugin, args[0], args[1], args[2], args[3]);
+            break;
+        case PLUGIN_HOOK_POST_PRIV_MESSAGE_DISPLAY:
+            plugin->post_priv_message_display(plugin, args[0], args[1], args[2]);
+            break;
+        case PLUGIN_HOOK_POST_PRIV_MESSAGE_SEND:
+            plugin->post_priv_message_send(plugin, args[0], args[1], args[2]);
+            break;
+        case PLUGIN_HOOK_ON_CONTACT_OFFLINE:
+            plugin->on_contact_offline(plugin, args[0], args[1], args[2]);
+            break;
+        case PLUGIN_HOOK_ON_CONTACT_PRESENCE:
+            plugin->on_contact_presence(plugin, args[0], args[1], args[2], args[3], event->priority);
+            break;
+        default:
+            log_error("Plugin hook %s cannot be deferred", hook_names[event->hook]);
+            return;
+        }
+        _plugins_stats_add(plugin->name, event->hook, start);
+    }
+}
+
+static void
+_plugins_deferred_flush(void)
+{
+    PluginEvent* event;
+    while ((event = g_queue_pop_head(&deferred_events))) {
+        _plugins_event_run(event);
+        _plugins_event_free(event);
+    }
+}
+
+static void
+_plugins_deferred_clear(void)
+{
+    if (deferred_source) {
+        g_source_remove(deferred_source);
+        deferred_source = 0;
+    }
+    g_queue_clear_full(&deferred_events, (GDestroyNotify)_plugins_event_free);
+}
+
+static gboolean
+_plugins_deferred_cb(gpointer data)
+{
+    if (deferred_dropped > 0) {
+        log_warning("Plugin event queue full, dropped %u events", deferred_dropped);
+        deferred_dropped = 0;
+    }
+
+    // run a batch per idle pass so input and redraws keep their turn
+    for (int i = 0; i < PLUGINS_DEFERRED_BATCH; i++) {
+        PluginEvent* event = g_queue_pop_head(&deferred_events);
+        if (!event) {
+            break;
+        }
+        _plugins_event_run(event);
+        _plugins_event_free(event);
+    }
+
+    if (g_queue_is_empty(&deferred_events)) {
+        deferred_source = 0;
+        return G_SOURCE_REMOVE;
+    }
+
+    return G_SOURCE_CONTINUE;
+}
+
+static void
+_plugins_defer(plugin_hook_t hook, const char* const arg0, const char* const arg1, const char* const arg2,
+               const char* const arg3, int priority)
+{
+    // under backpressure the oldest events go first, recent activity is what plugins care about
+    if (g_queue_get_length(&deferred_events) >= PLUGINS_DEFERRED_MAX) {
+        _plugins_event_free(g_queue_pop_head(&deferred_events));
+        deferred_dropped++;
+    }
+
+    PluginEvent* event = malloc(sizeof(PluginEvent));
+    event->hook = hook;
+    event->args[0] = arg0 ? strdup(arg0) : NULL;
+    event->args[1] = arg1 ? strdup(arg1) : NULL;
+    event->args[2] = arg2 ? strdup(arg2) : NULL;
+    event->args[3] = arg3 ? strdup(arg3) : NULL;
+    event->priority = priority;
+    g_queue_push_tail(&deferred_events, event);
+
+    if (deferred_source == 0) {
+        deferred_source = g_idle_add_full(G_PRIORITY_LOW, _plugins_deferred_cb, NULL, NULL);
+    }
+}
+
 void
 plugins_init(void)
 {
@@ -73,10 +555,9 @@ plugins_init(void)
     autocompleters_init();
     plugin_themes_init();
     plugin_settings_init();
+    load_data_keyfile(&manifest_prof_keyfile, FILE_PLUGIN_MANIFEST);
+    deferred_plugins = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
 
-#ifdef HAVE_PYTHON
-    python_env_init();
-#endif
 #ifdef HAVE_C
     c_env_init();
 #endif
@@ -89,6 +570,10 @@ plugins_init(void)
     for (int i = 0; i < g_strv_length(plugins_pref); i++) {
         gboolean loaded = FALSE;
         gchar* filename = plugins_pref[i];
+        if (_plugins_defer(filename)) {
+            log_info("Deferred plugin: %s", filename);
+            continue;
+        }
 #ifdef HAVE_PYTHON
         if (g_str_has_suffix(filename, ".py")) {
             ProfPlugin* plugin = python_plugin_create(filename);
@@ -120,6 +605,7 @@ plugins_init(void)
     while (curr) {
         ProfPlugin* plugin = curr->data;
         plugin->init_func(plugin, PACKAGE_VERSION, PACKAGE_STATUS, NULL, NULL);
+        _plugins_manifest_update(plugin, _plugins_subscribe(plugin));
         curr = g_list_next(curr);
     }
     g_list_free(values);
@@ -229,7 +715,7 @@ gboolean
 plugins_load(const char* const name, GString* error_message)
 {
     ProfPlugin* plugin = g_hash_table_lookup(plugins, name);
-    if (plugin) {
+    if (plugin || g_hash_table_contains(deferred_plugins, name)) {
         log_info("Failed to load plugin: %s, plugin already loaded", name);
         return FALSE;
     }
@@ -256,6 +742,7 @@ plugins_load(const char* const name, GString* error_message)
         } else {
             plugin->init_func(plugin, PACKAGE_VERSION, PACKAGE_STATUS, NULL, NULL);
         }
+        _plugins_manifest_update(plugin, _plugins_subscribe(plugin));
         log_info("Loaded plugin: %s", name);
         prefs_add_plugin(name);
         return TRUE;
@@ -265,11 +752,30 @@ plugins_load(const char* const name, GString* error_message)
     }
 }
 
+// load a deferred plugin now that one of its commands is used
+gboolean
+plugins_load_deferred(const char* const name)
+{
+    if (!g_hash_table_remove(deferred_plugins, name)) {
+        return FALSE;
+    }
+    callbacks_remove_deferred(name);
+
+    GString* error_message = g_string_new(NULL);
+    gboolean res = plugins_load(name, error_message);
+    if (!res && error_message->len > 0) {
+        log_error("Failed to load deferred plugin %s: %s", name, error_message->str);
+    }
+    g_string_free(error_message, TRUE);
+
+    return res;
+}
+
 gboolean
 plugins_unload_all(void)
 {
     gboolean result = TRUE;
-    GList* plugin_names = g_hash_table_get_keys(plugins);
+    GList* plugin_names = plugins_loaded_list();
     GList* plugin_names_dup = NULL;
     GList* curr = plugin_names;
     while (curr) {
@@ -294,9 +800,16 @@ plugins_unload_all(void)
 gboolean
 plugins_unload(const char* const name)
 {
+    if (g_hash_table_remove(deferred_plugins, name)) {
+        callbacks_remove_deferred(name);
+        prefs_remove_plugin(name);
+        return TRUE;
+    }
+
     ProfPlugin* plugin = g_hash_table_lookup(plugins, name);
     if (plugin) {
         plugin->on_unload_func(plugin);
+        _plugins_unsubscribe(plugin);
 #ifdef HAVE_PYTHON
         if (plugin->lang == LANG_PYTHON) {
             python_plugin_destroy(plugin);
@@ -370,7 +883,7 @@ _plugins_unloaded_list_dir(const gchar* const dir, GSList** result)
 
     const gchar* plugin = g_dir_read_name(plugins_dir);
     while (plugin) {
-        ProfPlugin* found = g_hash_table_lookup(plugins, plugin);
+        gboolean found = g_hash_table_contains(plugins, plugin) || g_hash_table_contains(deferred_plugins, plugin);
         if ((g_str_has_suffix(plugin, ".so") || g_str_has_suffix(plugin, ".py")) && !found) {
             *result = g_slist_append(*result, strdup(plugin));
         }
@@ -392,12 +905,19 @@ plugins_unloaded_list(void)
 GList*
 plugins_loaded_list(void)
 {
-    return g_hash_table_get_keys(plugins);
+    return g_list_concat(g_hash_table_get_keys(plugins), g_hash_table_get_keys(deferred_plugins));
 }
 
 char*
 plugins_autocomplete(const char* const input, gboolean previous)
 {
+    // argument completions are registered when the plugin loads
+    const char* space = strchr(input, ' ');
+    if (space) {
+        auto_gchar gchar* command = g_strndup(input, space - input);
+        callbacks_load_deferred(command);
+    }
+
     return autocompleters_complete(input, previous);
 }
 
@@ -425,216 +945,227 @@ plugins_close_win(const char* const plugin_name, const char* const tag)
 void
 plugins_on_start(void)
 {
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
+    GPtrArray* subscribers = _plugins_subscribers(PLUGIN_HOOK_ON_START);
+    if (!subscribers) {
+        return;
+    }
+
+    for (guint i = 0; i < subscribers->len; i++) {
+        ProfPlugin* plugin = g_ptr_array_index(subscribers, i);
+        gint64 start = g_get_monotonic_time();
         plugin->on_start_func(plugin);
-        curr = g_list_next(curr);
+        _plugins_stats_add(plugin->name, PLUGIN_HOOK_ON_START, start);
     }
-    g_list_free(values);
 }
 
 void
 plugins_on_shutdown(void)
 {
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
+    _plugins_deferred_flush();
+
+    GPtrArray* subscribers = _plugins_subscribers(PLUGIN_HOOK_ON_SHUTDOWN);
+    if (!subscribers) {
+        return;
+    }
+
+    for (guint i = 0; i < subscribers->len; i++) {
+        ProfPlugin* plugin = g_ptr_array_index(subscribers, i);
+        gint64 start = g_get_monotonic_time();
         plugin->on_shutdown_func(plugin);
-        curr = g_list_next(curr);
+        _plugins_stats_add(plugin->name, PLUGIN_HOOK_ON_SHUTDOWN, start);
     }
-    g_list_free(values);
 }
 
 void
 plugins_on_connect(const char* const account_name, const char* const fulljid)
 {
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
+    control_event("connect", "account", account_name, "jid", fulljid, NULL);
+
+    GPtrArray* subscribers = _plugins_subscribers(PLUGIN_HOOK_ON_CONNECT);
+    if (!subscribers) {
+        return;
+    }
+
+    for (guint i = 0; i < subscribers->len; i++) {
+        ProfPlugin* plugin = g_ptr_array_index(subscribers, i);
+        gint64 start = g_get_monotonic_time();
         plugin->on_connect_func(plugin, account_name, fulljid);
-        curr = g_list_next(curr);
+        _plugins_stats_add(plugin->name, PLUGIN_HOOK_ON_CONNECT, start);
     }
-    g_list_free(values);
 }
 
 void
 plugins_on_disconnect(const char* const account_name, const char* const fulljid)
 {
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
+    control_event("disconnect", "account", account_name, "jid", fulljid, NULL);
+
+    GPtrArray* subscribers = _plugins_subscribers(PLUGIN_HOOK_ON_DISCONNECT);
+    if (!subscribers) {
+        return;
+    }
+
+    for (guint i = 0; i < subscribers->len; i++) {
+        ProfPlugin* plugin = g_ptr_array_index(subscribers, i);
+        gint64 start = g_get_monotonic_time();
         plugin->on_disconnect_func(plugin, account_name, fulljid);
-        curr = g_list_next(curr);
+        _plugins_stats_add(plugin->name, PLUGIN_HOOK_ON_DISCONNECT, start);
     }
-    g_list_free(values);
 }
 
 char*
-plugins_pre_chat_message_display(const char* const barejid, const char* const resource, char* message)
+plugins_pre_chat_message_display(const char* const barejid, const char* const resource, const char* message)
 {
-    char* new_message = NULL;
-    char* curr_message = message;
+    GPtrArray* subscribers = _plugins_subscribers(PLUGIN_HOOK_PRE_CHAT_MESSAGE_DISPLAY);
+    if (!subscribers) {
+        return NULL;
+    }
 
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
-        new_message = plugin->pre_chat_message_display(plugin, barejid, resource, curr_message);
+    char* curr_message = NULL;
+    for (guint i = 0; i < subscribers->len; i++) {
+        ProfPlugin* plugin = g_ptr_array_index(subscribers, i);
+        gint64 start = g_get_monotonic_time();
+        char* new_message = plugin->pre_chat_message_display(plugin, barejid, resource, curr_message ? curr_message : message);
+        _plugins_stats_add(plugin->name, PLUGIN_HOOK_PRE_CHAT_MESSAGE_DISPLAY, start);
         if (new_message) {
             free(curr_message);
             curr_message = new_message;
         }
-        curr = g_list_next(curr);
     }
-    g_list_free(values);
-
     return curr_message;
 }
 
 void
 plugins_post_chat_message_display(const char* const barejid, const char* const resource, const char* message)
 {
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
-        plugin->post_chat_message_display(plugin, barejid, resource, message);
-        curr = g_list_next(curr);
+    control_event("chat", "from", barejid, "resource", resource, "message", message, NULL);
+
+    if (!_plugins_subscribers(PLUGIN_HOOK_POST_CHAT_MESSAGE_DISPLAY)) {
+        return;
     }
-    g_list_free(values);
+
+    _plugins_defer(PLUGIN_HOOK_POST_CHAT_MESSAGE_DISPLAY, barejid, resource, message, NULL, 0);
 }
 
 char*
 plugins_pre_chat_message_send(const char* const barejid, const char* message)
 {
+    GPtrArray* subscribers = _plugins_subscribers(PLUGIN_HOOK_PRE_CHAT_MESSAGE_SEND);
+    if (!subscribers) {
+        return strdup(message);
+    }
+
     char* new_message = NULL;
     char* curr_message = strdup(message);
 
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
-        if (plugin->contains_hook(plugin, "prof_pre_chat_message_send")) {
-            new_message = plugin->pre_chat_message_send(plugin, barejid, curr_message);
-            if (new_message) {
-                free(curr_message);
-                curr_message = strdup(new_message);
-                free(new_message);
-            } else {
-                free(curr_message);
-                g_list_free(values);
+    for (guint i = 0; i < subscribers->len; i++) {
+        ProfPlugin* plugin = g_ptr_array_index(subscribers, i);
+        gint64 start = g_get_monotonic_time();
+        new_message = plugin->pre_chat_message_send(plugin, barejid, curr_message);
+        _plugins_stats_add(plugin->name, PLUGIN_HOOK_PRE_CHAT_MESSAGE_SEND, start);
+        if (new_message) {
+            free(curr_message);
+            curr_message = strdup(new_message);
+            free(new_message);
+        } else {
+            free(curr_message);
 
-                return NULL;
-            }
+            return NULL;
         }
-        curr = g_list_next(curr);
     }
-    g_list_free(values);
-
     return curr_message;
 }
 
 void
 plugins_post_chat_message_send(const char* const barejid, const char* message)
 {
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
-        plugin->post_chat_message_send(plugin, barejid, message);
-        curr = g_list_next(curr);
+    if (!_plugins_subscribers(PLUGIN_HOOK_POST_CHAT_MESSAGE_SEND)) {
+        return;
     }
-    g_list_free(values);
+
+    _plugins_defer(PLUGIN_HOOK_POST_CHAT_MESSAGE_SEND, barejid, message, NULL, NULL, 0);
 }
 
 char*
 plugins_pre_room_message_display(const char* const barejid, const char* const nick, const char* message)
 {
-    char* new_message = NULL;
-    char* curr_message = strdup(message);
+    GPtrArray* subscribers = _plugins_subscribers(PLUGIN_HOOK_PRE_ROOM_MESSAGE_DISPLAY);
+    if (!subscribers) {
+        return NULL;
+    }
 
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
-        new_message = plugin->pre_room_message_display(plugin, barejid, nick, curr_message);
+    char* curr_message = NULL;
+    for (guint i = 0; i < subscribers->len; i++) {
+        ProfPlugin* plugin = g_ptr_array_index(subscribers, i);
+        gint64 start = g_get_monotonic_time();
+        char* new_message = plugin->pre_room_message_display(plugin, barejid, nick, curr_message ? curr_message : message);
+        _plugins_stats_add(plugin->name, PLUGIN_HOOK_PRE_ROOM_MESSAGE_DISPLAY, start);
         if (new_message) {
             free(curr_message);
-            curr_message = strdup(new_message);
-            free(new_message);
+            curr_message = new_message;
         }
-        curr = g_list_next(curr);
     }
-    g_list_free(values);
-
     return curr_message;
 }
 
 void
 plugins_post_room_message_display(const char* const barejid, const char* const nick, const char* message)
 {
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
-        plugin->post_room_message_display(plugin, barejid, nick, message);
-        curr = g_list_next(curr);
+    control_event("room", "room", barejid, "nick", nick, "message", message, NULL);
+
+    if (!_plugins_subscribers(PLUGIN_HOOK_POST_ROOM_MESSAGE_DISPLAY)) {
+        return;
     }
-    g_list_free(values);
+
+    _plugins_defer(PLUGIN_HOOK_POST_ROOM_MESSAGE_DISPLAY, barejid, nick, message, NULL, 0);
 }
 
 char*
 plugins_pre_room_message_send(const char* const barejid, const char* message)
 {
+    GPtrArray* subscribers = _plugins_subscribers(PLUGIN_HOOK_PRE_ROOM_MESSAGE_SEND);
+    if (!subscribers) {
+        return strdup(message);
+    }
+
     char* new_message = NULL;
     char* curr_message = strdup(message);
 
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
-        if (plugin->contains_hook(plugin, "prof_pre_room_message_send")) {
-            new_message = plugin->pre_room_message_send(plugin, barejid, curr_message);
-            if (new_message) {
-                free(curr_message);
-                curr_message = strdup(new_message);
-                free(new_message);
-            } else {
-                free(curr_message);
-                g_list_free(values);
+    for (guint i = 0; i < subscribers->len; i++) {
+        ProfPlugin* plugin = g_ptr_array_index(subscribers, i);
+        gint64 start = g_get_monotonic_time();
+        new_message = plugin->pre_room_message_send(plugin, barejid, curr_message);
+        _plugins_stats_add(plugin->name, PLUGIN_HOOK_PRE_ROOM_MESSAGE_SEND, start);
+        if (new_message) {
+            free(curr_message);
+            curr_message = strdup(new_message);
+            free(new_message);
+        } else {
+            free(curr_message);
 
-                return NULL;
-            }
+            return NULL;
         }
-        curr = g_list_next(curr);
     }
-    g_list_free(values);
-
     return curr_message;
 }
 
 void
 plugins_post_room_message_send(const char* const barejid, const char* message)
 {
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
-        plugin->post_room_message_send(plugin, barejid, message);
-        curr = g_list_next(curr);
+    if (!_plugins_subscribers(PLUGIN_HOOK_POST_ROOM_MESSAGE_SEND)) {
+        return;
     }
-    g_list_free(values);
+
+    _plugins_defer(PLUGIN_HOOK_POST_ROOM_MESSAGE_SEND, barejid, message, NULL, NULL, 0);
 }
 
 void
 plugins_on_room_history_message(const char* const barejid, const char* const nick, const char* const message,
                                 GDateTime* timestamp)
 {
+    if (!_plugins_subscribers(PLUGIN_HOOK_ON_ROOM_HISTORY_MESSAGE)) {
+        return;
+    }
+
     char* timestamp_str = NULL;
     GTimeVal timestamp_tv;
     gboolean res = g_date_time_to_timeval(timestamp, &timestamp_tv);
@@ -642,282 +1173,293 @@ plugins_on_room_history_message(const char* const barejid, const char* const nic
         timestamp_str = g_time_val_to_iso8601(&timestamp_tv);
     }
 
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
-        plugin->on_room_history_message(plugin, barejid, nick, message, timestamp_str);
-        curr = g_list_next(curr);
-    }
-    g_list_free(values);
-
+    _plugins_defer(PLUGIN_HOOK_ON_ROOM_HISTORY_MESSAGE, barejid, nick, message, timestamp_str, 0);
     free(timestamp_str);
 }
 
 char*
 plugins_pre_priv_message_display(const char* const fulljid, const char* message)
 {
-    auto_jid Jid* jidp = jid_create(fulljid);
-    char* new_message = NULL;
-    char* curr_message = strdup(message);
+    GPtrArray* subscribers = _plugins_subscribers(PLUGIN_HOOK_PRE_PRIV_MESSAGE_DISPLAY);
+    if (!subscribers) {
+        return NULL;
+    }
 
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
-        new_message = plugin->pre_priv_message_display(plugin, jidp->barejid, jidp->resourcepart, curr_message);
+    auto_jid Jid* jidp = jid_create(fulljid);
+    char* curr_message = NULL;
+    for (guint i = 0; i < subscribers->len; i++) {
+        ProfPlugin* plugin = g_ptr_array_index(subscribers, i);
+        gint64 start = g_get_monotonic_time();
+        char* new_message = plugin->pre_priv_message_display(plugin, jidp->barejid, jidp->resourcepart, curr_message ? curr_message : message);
+        _plugins_stats_add(plugin->name, PLUGIN_HOOK_PRE_PRIV_MESSAGE_DISPLAY, start);
         if (new_message) {
             free(curr_message);
-            curr_message = strdup(new_message);
-            free(new_message);
+            curr_message = new_message;
         }
-        curr = g_list_next(curr);
     }
-    g_list_free(values);
     return curr_message;
 }
 
 void
 plugins_post_priv_message_display(const char* const fulljid, const char* message)
 {
-    auto_jid Jid* jidp = jid_create(fulljid);
+    control_event("private", "from", fulljid, "message", message, NULL);
 
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
-        plugin->post_priv_message_display(plugin, jidp->barejid, jidp->resourcepart, message);
-        curr = g_list_next(curr);
+    if (!_plugins_subscribers(PLUGIN_HOOK_POST_PRIV_MESSAGE_DISPLAY)) {
+        return;
     }
-    g_list_free(values);
+
+    auto_jid Jid* jidp = jid_create(fulljid);
+
+    _plugins_defer(PLUGIN_HOOK_POST_PRIV_MESSAGE_DISPLAY, jidp->barejid, jidp->resourcepart, message, NULL, 0);
 }
 
 char*
 plugins_pre_priv_message_send(const char* const fulljid, const char* const message)
 {
+    GPtrArray* subscribers = _plugins_subscribers(PLUGIN_HOOK_PRE_PRIV_MESSAGE_SEND);
+    if (!subscribers) {
+        return strdup(message);
+    }
+
     auto_jid Jid* jidp = jid_create(fulljid);
     char* new_message = NULL;
     char* curr_message = strdup(message);
 
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
-        if (plugin->contains_hook(plugin, "prof_pre_priv_message_send")) {
-            new_message = plugin->pre_priv_message_send(plugin, jidp->barejid, jidp->resourcepart, curr_message);
-            if (new_message) {
-                free(curr_message);
-                curr_message = strdup(new_message);
-                free(new_message);
-            } else {
-                free(curr_message);
-                g_list_free(values);
+    for (guint i = 0; i < subscribers->len; i++) {
+        ProfPlugin* plugin = g_ptr_array_index(subscribers, i);
+        gint64 start = g_get_monotonic_time();
+        new_message = plugin->pre_priv_message_send(plugin, jidp->barejid, jidp->resourcepart, curr_message);
+        _plugins_stats_add(plugin->name, PLUGIN_HOOK_PRE_PRIV_MESSAGE_SEND, start);
+        if (new_message) {
+            free(curr_message);
+            curr_message = strdup(new_message);
+            free(new_message);
+        } else {
+            free(curr_message);
 
-                return NULL;
-            }
+            return NULL;
         }
-        curr = g_list_next(curr);
     }
-    g_list_free(values);
-
     return curr_message;
 }
 
 void
 plugins_post_priv_message_send(const char* const fulljid, const char* const message)
 {
-    auto_jid Jid* jidp = jid_create(fulljid);
-
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
-        plugin->post_priv_message_send(plugin, jidp->barejid, jidp->resourcepart, message);
-        curr = g_list_next(curr);
+    if (!_plugins_subscribers(PLUGIN_HOOK_POST_PRIV_MESSAGE_SEND)) {
+        return;
     }
 
-    g_list_free(values);
+    auto_jid Jid* jidp = jid_create(fulljid);
+
+    _plugins_defer(PLUGIN_HOOK_POST_PRIV_MESSAGE_SEND, jidp->barejid, jidp->resourcepart, message, NULL, 0);
 }
 
 char*
 plugins_on_message_stanza_send(const char* const text)
 {
+    GPtrArray* subscribers = _plugins_subscribers(PLUGIN_HOOK_ON_MESSAGE_STANZA_SEND);
+    if (!subscribers) {
+        return strdup(text);
+    }
+
     char* new_stanza = NULL;
     char* curr_stanza = strdup(text);
 
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
+    for (guint i = 0; i < subscribers->len; i++) {
+        ProfPlugin* plugin = g_ptr_array_index(subscribers, i);
+        gint64 start = g_get_monotonic_time();
         new_stanza = plugin->on_message_stanza_send(plugin, curr_stanza);
+        _plugins_stats_add(plugin->name, PLUGIN_HOOK_ON_MESSAGE_STANZA_SEND, start);
         if (new_stanza) {
             free(curr_stanza);
             curr_stanza = strdup(new_stanza);
             free(new_stanza);
         }
-        curr = g_list_next(curr);
     }
-    g_list_free(values);
-
     return curr_stanza;
 }
 
-gboolean
-plugins_on_message_stanza_receive(const char* const text)
+// Plugins subscribed to the parsed hook get the stanza itself, it is only
+// serialised when a plugin handling the stanza as text is subscribed too.
+static gboolean
+_plugins_stanza_receive(plugin_hook_t parsed_hook, plugin_hook_t text_hook, xmpp_stanza_t* const stanza)
 {
     gboolean cont = TRUE;
 
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
-        gboolean res = plugin->on_message_stanza_receive(plugin, text);
+    GPtrArray* subscribers = _plugins_subscribers(parsed_hook);
+    for (guint i = 0; subscribers && i < subscribers->len; i++) {
+        ProfPlugin* plugin = g_ptr_array_index(subscribers, i);
+        if (!plugin->on_stanza_receive_parsed) {
+            continue;
+        }
+        gint64 start = g_get_monotonic_time();
+        gboolean res = plugin->on_stanza_receive_parsed(plugin, hook_names[parsed_hook], stanza);
+        _plugins_stats_add(plugin->name, parsed_hook, start);
         if (res == FALSE) {
             cont = FALSE;
         }
-        curr = g_list_next(curr);
     }
-    g_list_free(values);
+
+    subscribers = _plugins_subscribers(text_hook);
+    if (!subscribers) {
+        return cont;
+    }
+
+    char* text = NULL;
+    size_t text_size;
+    if (xmpp_stanza_to_text(stanza, &text, &text_size) != XMPP_EOK) {
+        return cont;
+    }
+
+    for (guint i = 0; i < subscribers->len; i++) {
+        ProfPlugin* plugin = g_ptr_array_index(subscribers, i);
+        gint64 start = g_get_monotonic_time();
+        gboolean res;
+        switch (text_hook) {
+        case PLUGIN_HOOK_ON_MESSAGE_STANZA_RECEIVE:
+            res = plugin->on_message_stanza_receive(plugin, text);
+            break;
+        case PLUGIN_HOOK_ON_PRESENCE_STANZA_RECEIVE:
+            res = plugin->on_presence_stanza_receive(plugin, text);
+            break;
+        default:
+            res = plugin->on_iq_stanza_receive(plugin, text);
+            break;
+        }
+        _plugins_stats_add(plugin->name, text_hook, start);
+        if (res == FALSE) {
+            cont = FALSE;
+        }
+    }
+    xmpp_free(xmpp_stanza_get_context(stanza), text);
 
     return cont;
 }
 
+gboolean
+plugins_on_message_stanza_receive(xmpp_stanza_t* const stanza)
+{
+    return _plugins_stanza_receive(PLUGIN_HOOK_ON_MESSAGE_STANZA_RECEIVE_PARSED, PLUGIN_HOOK_ON_MESSAGE_STANZA_RECEIVE, stanza);
+}
+
 char*
 plugins_on_presence_stanza_send(const char* const text)
 {
+    GPtrArray* subscribers = _plugins_subscribers(PLUGIN_HOOK_ON_PRESENCE_STANZA_SEND);
+    if (!subscribers) {
+        return strdup(text);
+    }
+
     char* new_stanza = NULL;
     char* curr_stanza = strdup(text);
 
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
+    for (guint i = 0; i < subscribers->len; i++) {
+        ProfPlugin* plugin = g_ptr_array_index(subscribers, i);
+        gint64 start = g_get_monotonic_time();
         new_stanza = plugin->on_presence_stanza_send(plugin, curr_stanza);
+        _plugins_stats_add(plugin->name, PLUGIN_HOOK_ON_PRESENCE_STANZA_SEND, start);
         if (new_stanza) {
             free(curr_stanza);
             curr_stanza = strdup(new_stanza);
             free(new_stanza);
         }
-        curr = g_list_next(curr);
     }
-    g_list_free(values);
-
     return curr_stanza;
 }
 
 gboolean
-plugins_on_presence_stanza_receive(const char* const text)
+plugins_on_presence_stanza_receive(xmpp_stanza_t* const stanza)
 {
-    gboolean cont = TRUE;
-
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
-        gboolean res = plugin->on_presence_stanza_receive(plugin, text);
-        if (res == FALSE) {
-            cont = FALSE;
-        }
-        curr = g_list_next(curr);
-    }
-    g_list_free(values);
-
-    return cont;
+    return _plugins_stanza_receive(PLUGIN_HOOK_ON_PRESENCE_STANZA_RECEIVE_PARSED, PLUGIN_HOOK_ON_PRESENCE_STANZA_RECEIVE, stanza);
 }
 
 char*
 plugins_on_iq_stanza_send(const char* const text)
 {
+    GPtrArray* subscribers = _plugins_subscribers(PLUGIN_HOOK_ON_IQ_STANZA_SEND);
+    if (!subscribers) {
+        return strdup(text);
+    }
+
     char* new_stanza = NULL;
     char* curr_stanza = strdup(text);
 
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
+    for (guint i = 0; i < subscribers->len; i++) {
+        ProfPlugin* plugin = g_ptr_array_index(subscribers, i);
+        gint64 start = g_get_monotonic_time();
         new_stanza = plugin->on_iq_stanza_send(plugin, curr_stanza);
+        _plugins_stats_add(plugin->name, PLUGIN_HOOK_ON_IQ_STANZA_SEND, start);
         if (new_stanza) {
             free(curr_stanza);
             curr_stanza = strdup(new_stanza);
             free(new_stanza);
         }
-        curr = g_list_next(curr);
     }
-    g_list_free(values);
-
     return curr_stanza;
 }
 
 gboolean
-plugins_on_iq_stanza_receive(const char* const text)
+plugins_on_iq_stanza_receive(xmpp_stanza_t* const stanza)
 {
-    gboolean cont = TRUE;
-
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
-        gboolean res = plugin->on_iq_stanza_receive(plugin, text);
-        if (res == FALSE) {
-            cont = FALSE;
-        }
-        curr = g_list_next(curr);
-    }
-    g_list_free(values);
-
-    return cont;
+    return _plugins_stanza_receive(PLUGIN_HOOK_ON_IQ_STANZA_RECEIVE_PARSED, PLUGIN_HOOK_ON_IQ_STANZA_RECEIVE, stanza);
 }
 
 void
 plugins_on_contact_offline(const char* const barejid, const char* const resource, const char* const status)
 {
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
-        plugin->on_contact_offline(plugin, barejid, resource, status);
-        curr = g_list_next(curr);
+    control_event("presence", "jid", barejid, "resource", resource, "presence", "offline", "status", status, NULL);
+
+    if (!_plugins_subscribers(PLUGIN_HOOK_ON_CONTACT_OFFLINE)) {
+        return;
     }
-    g_list_free(values);
+
+    _plugins_defer(PLUGIN_HOOK_ON_CONTACT_OFFLINE, barejid, resource, status, NULL, 0);
 }
 
 void
 plugins_on_contact_presence(const char* const barejid, const char* const resource, const char* const presence, const char* const status, const int priority)
 {
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
-        plugin->on_contact_presence(plugin, barejid, resource, presence, status, priority);
-        curr = g_list_next(curr);
+    control_event("presence", "jid", barejid, "resource", resource, "presence", presence, "status", status, NULL);
+
+    if (!_plugins_subscribers(PLUGIN_HOOK_ON_CONTACT_PRESENCE)) {
+        return;
     }
-    g_list_free(values);
+
+    _plugins_defer(PLUGIN_HOOK_ON_CONTACT_PRESENCE, barejid, resource, presence, status, priority);
 }
 
 void
 plugins_on_chat_win_focus(const char* const barejid)
 {
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
+    GPtrArray* subscribers = _plugins_subscribers(PLUGIN_HOOK_ON_CHAT_WIN_FOCUS);
+    if (!subscribers) {
+        return;
+    }
+
+    for (guint i = 0; i < subscribers->len; i++) {
+        ProfPlugin* plugin = g_ptr_array_index(subscribers, i);
+        gint64 start = g_get_monotonic_time();
         plugin->on_chat_win_focus(plugin, barejid);
-        curr = g_list_next(curr);
+        _plugins_stats_add(plugin->name, PLUGIN_HOOK_ON_CHAT_WIN_FOCUS, start);
     }
-    g_list_free(values);
 }
 
 void
 plugins_on_room_win_focus(const char* const barejid)
 {
-    GList* values = g_hash_table_get_values(plugins);
-    GList* curr = values;
-    while (curr) {
-        ProfPlugin* plugin = curr->data;
+    GPtrArray* subscribers = _plugins_subscribers(PLUGIN_HOOK_ON_ROOM_WIN_FOCUS);
+    if (!subscribers) {
+        return;
+    }
+
+    for (guint i = 0; i < subscribers->len; i++) {
+        ProfPlugin* plugin = g_ptr_array_index(subscribers, i);
+        gint64 start = g_get_monotonic_time();
         plugin->on_room_win_focus(plugin, barejid);
-        curr = g_list_next(curr);
+        _plugins_stats_add(plugin->name, PLUGIN_HOOK_ON_ROOM_WIN_FOCUS, start);
     }
-    g_list_free(values);
 }
 
 GList*
@@ -929,6 +1471,9 @@ plugins_get_disco_features(void)
 void
 plugins_shutdown(void)
 {
+    _plugins_deferred_clear();
+    _plugins_unsubscribe_all();
+
     GList* values = g_hash_table_get_values(plugins);
     GList *curr = values, *next;
 
@@ -961,6 +1506,13 @@ plugins_shutdown(void)
     plugin_settings_close();
     callbacks_close();
     disco_close();
+    if (plugin_stats) {
+        g_hash_table_destroy(plugin_stats);
+        plugin_stats = NULL;
+    }
     g_hash_table_destroy(plugins);
     plugins = NULL;
+    g_hash_table_destroy(deferred_plugins);
+    deferred_plugins = NULL;
+    free_keyfile(&manifest_prof_keyfile);
 }
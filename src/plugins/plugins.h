@@ -36,6 +36,8 @@
 #ifndef PLUGINS_PLUGINS_H
 #define PLUGINS_PLUGINS_H
 
+#include <strophe.h>
+
 #include "command/cmd_defs.h"
 
 typedef enum {
@@ -49,6 +51,17 @@ typedef struct prof_plugins_install_t
     GSList* failed;
 } PluginsInstallResult;
 
+typedef struct prof_plugin_hook_stats_t
+{
+    char* plugin_name;
+    char* hook;
+    guint64 calls;
+    gint64 total_us;
+    gint64 avg_us;
+    gint64 p99_us;
+    gint64 max_us;
+} PluginHookStats;
+
 typedef struct prof_plugin_t
 {
     char* name;
@@ -99,6 +112,10 @@ typedef struct prof_plugin_t
     char* (*on_iq_stanza_send)(struct prof_plugin_t* plugin, const char* const text);
     gboolean (*on_iq_stanza_receive)(struct prof_plugin_t* plugin, const char* const text);
 
+    // received stanza passed parsed and read-only to the named hook, NULL when
+    // the plugin language only handles stanzas as text
+    gboolean (*on_stanza_receive_parsed)(struct prof_plugin_t* plugin, const char* const hook, xmpp_stanza_t* const stanza);
+
     void (*on_contact_offline)(struct prof_plugin_t* plugin, const char* const barejid, const char* const resource,
                                const char* const status);
     void (*on_contact_presence)(struct prof_plugin_t* plugin, const char* const barejid, const char* const resource,
@@ -122,6 +139,7 @@ gboolean plugins_uninstall(const char* const plugin_name);
 gboolean plugins_update(const char* const plugin_name, const char* const filename, GString* error_message);
 PluginsInstallResult* plugins_install_all(const char* const path);
 gboolean plugins_load(const char* const name, GString* error_message);
+gboolean plugins_load_deferred(const char* const name);
 GSList* plugins_load_all(void);
 gboolean plugins_unload(const char* const name);
 gboolean plugins_unload_all(void);
@@ -134,7 +152,9 @@ void plugins_on_shutdown(void);
 void plugins_on_connect(const char* const account_name, const char* const fulljid);
 void plugins_on_disconnect(const char* const account_name, const char* const fulljid);
 
-char* plugins_pre_chat_message_display(const char* const barejid, const char* const resource, char* message);
+// the pre display hooks return the message as plugins changed it, or NULL when
+// it is to be shown as it is
+char* plugins_pre_chat_message_display(const char* const barejid, const char* const resource, const char* message);
 void plugins_post_chat_message_display(const char* const barejid, const char* const resource, const char* message);
 char* plugins_pre_chat_message_send(const char* const barejid, const char* message);
 void plugins_post_chat_message_send(const char* const barejid, const char* message);
@@ -155,13 +175,13 @@ void plugins_win_process_line(char* win, const char* const line);
 void plugins_close_win(const char* const plugin_name, const char* const tag);
 
 char* plugins_on_message_stanza_send(const char* const text);
-gboolean plugins_on_message_stanza_receive(const char* const text);
+gboolean plugins_on_message_stanza_receive(xmpp_stanza_t* const stanza);
 
 char* plugins_on_presence_stanza_send(const char* const text);
-gboolean plugins_on_presence_stanza_receive(const char* const text);
+gboolean plugins_on_presence_stanza_receive(xmpp_stanza_t* const stanza);
 
 char* plugins_on_iq_stanza_send(const char* const text);
-gboolean plugins_on_iq_stanza_receive(const char* const text);
+gboolean plugins_on_iq_stanza_receive(xmpp_stanza_t* const stanza);
 
 void plugins_on_contact_offline(const char* const barejid, const char* const resource, const char* const status);
 void plugins_on_contact_presence(const char* const barejid, const char* const resource, const char* const presence,
@@ -171,11 +191,15 @@ void plugins_on_chat_win_focus(const char* const barejid);
 void plugins_on_room_win_focus(const char* const barejid);
 
 gboolean plugins_run_command(const char* const cmd);
-void plugins_run_timed(void);
 GList* plugins_get_command_names(void);
 gchar* plugins_get_dir(void);
 CommandHelp* plugins_get_help(const char* const cmd);
 
 GList* plugins_get_disco_features(void);
 
+GList* plugins_get_stats(void);
+void plugins_free_stats(GList* stats);
+void plugins_reset_stats(void);
+void plugins_stats_add_timed(const char* const plugin_name, gint64 start);
+
 #endif
@@ -68,6 +68,8 @@ char* (*prof_get_current_nick)(void) = NULL;
 char* (*prof_get_name_from_roster)(const char* barejid) = NULL;
 char* (*prof_get_barejid_from_roster)(const char* name) = NULL;
 char** (*prof_get_current_occupants)(void) = NULL;
+char** (*prof_get_plugin_stats)(void) = NULL;
+char** (*prof_get_stats)(void) = NULL;
 
 char* (*prof_get_room_nick)(const char* barejid) = NULL;
 
@@ -84,6 +86,15 @@ int (*prof_win_show_themed)(PROF_WIN_TAG tag, char* group, char* key, char* def,
 
 int (*prof_send_stanza)(char* stanza) = NULL;
 
+const char* (*prof_stanza_get_name)(PROF_STANZA stanza) = NULL;
+const char* (*prof_stanza_get_ns)(PROF_STANZA stanza) = NULL;
+const char* (*prof_stanza_get_attribute)(PROF_STANZA stanza, const char* name) = NULL;
+PROF_STANZA (*prof_stanza_get_child)(PROF_STANZA stanza, const char* name, const char* ns) = NULL;
+PROF_STANZA (*prof_stanza_get_children)(PROF_STANZA stanza) = NULL;
+PROF_STANZA (*prof_stanza_get_next)(PROF_STANZA stanza) = NULL;
+char* (*prof_stanza_get_text)(PROF_STANZA stanza) = NULL;
+char* (*prof_stanza_to_text)(PROF_STANZA stanza) = NULL;
+
 int (*prof_settings_boolean_get)(char* group, char* key, int def) = NULL;
 void (*prof_settings_boolean_set)(char* group, char* key, int value) = NULL;
 char* (*prof_settings_string_get)(char* group, char* key, char* def) = NULL;
@@ -46,6 +46,7 @@
 #define prof_disco_add_feature(feature)                                                                               _prof_disco_add_feature(__FILE__, feature)
 
 typedef char* PROF_WIN_TAG;
+typedef void* PROF_STANZA;
 typedef void (*CMD_CB)(char** args);
 typedef void (*TIMED_CB)(void);
 typedef void (*WINDOW_CB)(PROF_WIN_TAG win, char* line);
@@ -77,6 +78,8 @@ char* (*prof_get_current_nick)(void);
 char* (*prof_get_name_from_roster)(const char* barejid);
 char* (*prof_get_barejid_from_roster)(const char* name);
 char** (*prof_get_current_occupants)(void);
+char** (*prof_get_plugin_stats)(void);
+char** (*prof_get_stats)(void);
 
 char* (*prof_get_room_nick)(const char* barejid);
 
@@ -93,6 +96,17 @@ int (*prof_win_show_themed)(PROF_WIN_TAG tag, char* group, char* key, char* def,
 
 int (*prof_send_stanza)(char* stanza);
 
+// Read-only access to the stanza passed to the prof_on_*_stanza_receive_parsed
+// hooks, valid until the hook returns. Text results are freed by the caller.
+const char* (*prof_stanza_get_name)(PROF_STANZA stanza);
+const char* (*prof_stanza_get_ns)(PROF_STANZA stanza);
+const char* (*prof_stanza_get_attribute)(PROF_STANZA stanza, const char* name);
+PROF_STANZA (*prof_stanza_get_child)(PROF_STANZA stanza, const char* name, const char* ns);
+PROF_STANZA (*prof_stanza_get_children)(PROF_STANZA stanza);
+PROF_STANZA (*prof_stanza_get_next)(PROF_STANZA stanza);
+char* (*prof_stanza_get_text)(PROF_STANZA stanza);
+char* (*prof_stanza_to_text)(PROF_STANZA stanza);
+
 int (*prof_settings_boolean_get)(char* group, char* key, int def);
 void (*prof_settings_boolean_set)(char* group, char* key, int value);
 char* (*prof_settings_string_get)(char* group, char* key, char* def);
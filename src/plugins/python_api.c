@@ -502,6 +502,38 @@ python_api_get_current_occupants(PyObject* self, PyObject* args)
     }
 }
 
+static PyObject*
+python_api_get_plugin_stats(PyObject* self, PyObject* args)
+{
+    allow_python_threads();
+    char** stats = api_get_plugin_stats();
+    disable_python_threads();
+    PyObject* result = PyList_New(0);
+    int len = g_strv_length(stats);
+    for (int i = 0; i < len; i++) {
+        PyList_Append(result, Py_BuildValue("s", stats[i]));
+    }
+    g_strfreev(stats);
+
+    return result;
+}
+
+static PyObject*
+python_api_get_stats(PyObject* self, PyObject* args)
+{
+    allow_python_threads();
+    char** stats = api_get_stats();
+    disable_python_threads();
+    PyObject* result = PyList_New(0);
+    int len = g_strv_length(stats);
+    for (int i = 0; i < len; i++) {
+        PyList_Append(result, Py_BuildValue("s", stats[i]));
+    }
+    g_strfreev(stats);
+
+    return result;
+}
+
 static PyObject*
 python_api_current_win_is_console(PyObject* self, PyObject* args)
 {
@@ -1533,6 +1565,8 @@ static PyMethodDef apiMethods[] = {
     { "get_name_from_roster", python_api_get_name_from_roster, METH_VARARGS, "Return nickname in roster of barejid." },
     { "get_barejid_from_roster", python_api_get_barejid_from_roster, METH_VARARGS, "Return nickname in roster of barejid." },
     { "get_current_occupants", python_api_get_current_occupants, METH_VARARGS, "Return list of occupants in current room." },
+    { "get_plugin_stats", python_api_get_plugin_stats, METH_VARARGS, "Return hook latency statistics for loaded plugins." },
+    { "get_stats", python_api_get_stats, METH_VARARGS, "Return runtime counters as metric and value lines." },
     { "current_win_is_console", python_api_current_win_is_console, METH_VARARGS, "Returns whether the current window is the console." },
     { "get_room_nick", python_api_get_room_nick, METH_VARARGS, "Return the nickname used in the specified room, or None if not in the room." },
     { "log_debug", python_api_log_debug, METH_VARARGS, "Log a debug message" },
@@ -1650,10 +1684,13 @@ python_str_or_unicode_to_string(void* obj)
 
 #ifdef PY_IS_PYTHON3
     if (PyUnicode_Check(pyobj)) {
-        PyObject* utf8_str = PyUnicode_AsUTF8String(pyobj);
-        char* result = strdup(PyBytes_AS_STRING(utf8_str));
-        Py_XDECREF(utf8_str);
-        return result;
+        // UTF-8 form cached in the object, no intermediate bytes object
+        const char* utf8_str = PyUnicode_AsUTF8(pyobj);
+        if (!utf8_str) {
+            PyErr_Clear();
+            return NULL;
+        }
+        return strdup(utf8_str);
     } else {
         return strdup(PyBytes_AS_STRING(pyobj));
     }
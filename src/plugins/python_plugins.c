@@ -51,11 +51,17 @@
 static PyThreadState* thread_state;
 static GHashTable* loaded_modules;
 
+// Interned Python strings of the bare JIDs passed to hooks, a chatty
+// contact or room is converted once instead of on every message
+#define PYTHON_JID_CACHE_MAX 512
+static GHashTable* jid_objects;
+
 static void _python_undefined_error(ProfPlugin* plugin, char* hook, char* type);
 static void _python_type_error(ProfPlugin* plugin, char* hook, char* type);
 
 static char* _handle_string_or_none_result(ProfPlugin* plugin, PyObject* result, char* hook);
 static gboolean _handle_boolean_result(ProfPlugin* plugin, PyObject* result, char* hook);
+static PyObject* _python_jid(const char* const barejid);
 
 void
 allow_python_threads()
@@ -92,9 +98,14 @@ python_get_version_number(void)
     return version_number;
 }
 
+// the interpreter is only started once the first Python plugin is loaded
 void
 python_env_init(void)
 {
+    if (loaded_modules) {
+        return;
+    }
+
     loaded_modules = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)_unref_module);
 
     python_init_prof();
@@ -116,6 +127,7 @@ python_env_init(void)
 ProfPlugin*
 python_plugin_create(const char* const filename)
 {
+    python_env_init();
     disable_python_threads();
 
     PyObject* p_module = g_hash_table_lookup(loaded_modules, filename);
@@ -162,6 +174,7 @@ python_plugin_create(const char* const filename)
         plugin->on_presence_stanza_receive = python_on_presence_stanza_receive_hook;
         plugin->on_iq_stanza_send = python_on_iq_stanza_send_hook;
         plugin->on_iq_stanza_receive = python_on_iq_stanza_receive_hook;
+        plugin->on_stanza_receive_parsed = NULL;
         plugin->on_contact_offline = python_on_contact_offline_hook;
         plugin->on_contact_presence = python_on_contact_presence_hook;
         plugin->on_chat_win_focus = python_on_chat_win_focus_hook;
@@ -317,7 +330,7 @@ python_pre_chat_message_display_hook(ProfPlugin* plugin, const char* const barej
                                      const char* message)
 {
     disable_python_threads();
-    PyObject* p_args = Py_BuildValue("sss", barejid, resource, message);
+    PyObject* p_args = Py_BuildValue("Oss", _python_jid(barejid), resource, message);
     if (!p_args) {
         log_warning("Unable to convert strings in `python_pre_chat_message_display_hook` to 'UTF8'. barejid: %s, resource: %s, message: %s", barejid, resource, message);
         allow_python_threads();
@@ -346,7 +359,7 @@ void
 python_post_chat_message_display_hook(ProfPlugin* plugin, const char* const barejid, const char* const resource, const char* message)
 {
     disable_python_threads();
-    PyObject* p_args = Py_BuildValue("sss", barejid, resource, message);
+    PyObject* p_args = Py_BuildValue("Oss", _python_jid(barejid), resource, message);
     PyObject* p_function;
 
     PyObject* p_module = plugin->module;
@@ -367,7 +380,7 @@ char*
 python_pre_chat_message_send_hook(ProfPlugin* plugin, const char* const barejid, const char* message)
 {
     disable_python_threads();
-    PyObject* p_args = Py_BuildValue("ss", barejid, message);
+    PyObject* p_args = Py_BuildValue("Os", _python_jid(barejid), message);
     PyObject* p_function;
 
     PyObject* p_module = plugin->module;
@@ -391,7 +404,7 @@ void
 python_post_chat_message_send_hook(ProfPlugin* plugin, const char* const barejid, const char* message)
 {
     disable_python_threads();
-    PyObject* p_args = Py_BuildValue("ss", barejid, message);
+    PyObject* p_args = Py_BuildValue("Os", _python_jid(barejid), message);
     PyObject* p_function;
 
     PyObject* p_module = plugin->module;
@@ -412,7 +425,7 @@ char*
 python_pre_room_message_display_hook(ProfPlugin* plugin, const char* const barejid, const char* const nick, const char* message)
 {
     disable_python_threads();
-    PyObject* p_args = Py_BuildValue("sss", barejid, nick, message);
+    PyObject* p_args = Py_BuildValue("Oss", _python_jid(barejid), nick, message);
     if (!p_args) {
         log_warning("Unable to convert strings in `python_pre_room_message_display_hook` to 'UTF8'. barejid: %s, nick: %s, message: %s", barejid, nick, message);
         allow_python_threads();
@@ -443,7 +456,7 @@ python_post_room_message_display_hook(ProfPlugin* plugin, const char* const bare
                                       const char* message)
 {
     disable_python_threads();
-    PyObject* p_args = Py_BuildValue("sss", barejid, nick, message);
+    PyObject* p_args = Py_BuildValue("Oss", _python_jid(barejid), nick, message);
     PyObject* p_function;
 
     PyObject* p_module = plugin->module;
@@ -464,7 +477,7 @@ char*
 python_pre_room_message_send_hook(ProfPlugin* plugin, const char* const barejid, const char* message)
 {
     disable_python_threads();
-    PyObject* p_args = Py_BuildValue("ss", barejid, message);
+    PyObject* p_args = Py_BuildValue("Os", _python_jid(barejid), message);
     PyObject* p_function;
 
     PyObject* p_module = plugin->module;
@@ -488,7 +501,7 @@ void
 python_post_room_message_send_hook(ProfPlugin* plugin, const char* const barejid, const char* message)
 {
     disable_python_threads();
-    PyObject* p_args = Py_BuildValue("ss", barejid, message);
+    PyObject* p_args = Py_BuildValue("Os", _python_jid(barejid), message);
     PyObject* p_function;
 
     PyObject* p_module = plugin->module;
@@ -510,7 +523,7 @@ python_on_room_history_message_hook(ProfPlugin* plugin, const char* const bareji
                                     const char* const message, const char* const timestamp)
 {
     disable_python_threads();
-    PyObject* p_args = Py_BuildValue("ssss", barejid, nick, message, timestamp);
+    PyObject* p_args = Py_BuildValue("Osss", _python_jid(barejid), nick, message, timestamp);
     PyObject* p_function;
 
     PyObject* p_module = plugin->module;
@@ -532,7 +545,7 @@ python_pre_priv_message_display_hook(ProfPlugin* plugin, const char* const barej
                                      const char* message)
 {
     disable_python_threads();
-    PyObject* p_args = Py_BuildValue("sss", barejid, nick, message);
+    PyObject* p_args = Py_BuildValue("Oss", _python_jid(barejid), nick, message);
     PyObject* p_function;
 
     PyObject* p_module = plugin->module;
@@ -557,7 +570,7 @@ python_post_priv_message_display_hook(ProfPlugin* plugin, const char* const bare
                                       const char* message)
 {
     disable_python_threads();
-    PyObject* p_args = Py_BuildValue("sss", barejid, nick, message);
+    PyObject* p_args = Py_BuildValue("Oss", _python_jid(barejid), nick, message);
     PyObject* p_function;
 
     PyObject* p_module = plugin->module;
@@ -579,7 +592,7 @@ python_pre_priv_message_send_hook(ProfPlugin* plugin, const char* const barejid,
                                   const char* const message)
 {
     disable_python_threads();
-    PyObject* p_args = Py_BuildValue("sss", barejid, nick, message);
+    PyObject* p_args = Py_BuildValue("Oss", _python_jid(barejid), nick, message);
     PyObject* p_function;
 
     PyObject* p_module = plugin->module;
@@ -604,7 +617,7 @@ python_post_priv_message_send_hook(ProfPlugin* plugin, const char* const barejid
                                    const char* const message)
 {
     disable_python_threads();
-    PyObject* p_args = Py_BuildValue("sss", barejid, nick, message);
+    PyObject* p_args = Py_BuildValue("Oss", _python_jid(barejid), nick, message);
     PyObject* p_function;
 
     PyObject* p_module = plugin->module;
@@ -770,7 +783,7 @@ python_on_contact_offline_hook(ProfPlugin* plugin, const char* const barejid, co
                                const char* const status)
 {
     disable_python_threads();
-    PyObject* p_args = Py_BuildValue("sss", barejid, resource, status);
+    PyObject* p_args = Py_BuildValue("Oss", _python_jid(barejid), resource, status);
     PyObject* p_function;
 
     PyObject* p_module = plugin->module;
@@ -792,7 +805,7 @@ python_on_contact_presence_hook(ProfPlugin* plugin, const char* const barejid, c
                                 const char* const presence, const char* const status, const int priority)
 {
     disable_python_threads();
-    PyObject* p_args = Py_BuildValue("ssssi", barejid, resource, presence, status, priority);
+    PyObject* p_args = Py_BuildValue("Osssi", _python_jid(barejid), resource, presence, status, priority);
     PyObject* p_function;
 
     PyObject* p_module = plugin->module;
@@ -813,7 +826,7 @@ void
 python_on_chat_win_focus_hook(ProfPlugin* plugin, const char* const barejid)
 {
     disable_python_threads();
-    PyObject* p_args = Py_BuildValue("(s)", barejid);
+    PyObject* p_args = Py_BuildValue("(O)", _python_jid(barejid));
     PyObject* p_function;
 
     PyObject* p_module = plugin->module;
@@ -834,7 +847,7 @@ void
 python_on_room_win_focus_hook(ProfPlugin* plugin, const char* const barejid)
 {
     disable_python_threads();
-    PyObject* p_args = Py_BuildValue("(s)", barejid);
+    PyObject* p_args = Py_BuildValue("(O)", _python_jid(barejid));
     PyObject* p_function;
 
     PyObject* p_module = plugin->module;
@@ -875,8 +888,17 @@ python_plugin_destroy(ProfPlugin* plugin)
 void
 python_shutdown(void)
 {
+    if (loaded_modules == NULL) {
+        return;
+    }
+
     disable_python_threads();
+    if (jid_objects) {
+        g_hash_table_destroy(jid_objects);
+        jid_objects = NULL;
+    }
     g_hash_table_destroy(loaded_modules);
+    loaded_modules = NULL;
     Py_Finalize();
 }
 
@@ -908,6 +930,40 @@ _python_type_error(ProfPlugin* plugin, char* hook, char* type)
     g_string_free(err_msg, TRUE);
 }
 
+// Borrowed reference, only valid while the GIL is held. NULL with the
+// exception set when the JID can't be decoded, like Py_BuildValue's "s".
+static PyObject*
+_python_jid(const char* const barejid)
+{
+    if (!barejid) {
+        return Py_None;
+    }
+
+    if (!jid_objects) {
+        jid_objects = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)Py_DecRef);
+    }
+
+    PyObject* obj = g_hash_table_lookup(jid_objects, barejid);
+    if (obj) {
+        return obj;
+    }
+
+    if (g_hash_table_size(jid_objects) >= PYTHON_JID_CACHE_MAX) {
+        g_hash_table_remove_all(jid_objects);
+    }
+
+#ifdef PY_IS_PYTHON3
+    obj = PyUnicode_InternFromString(barejid);
+#else
+    obj = PyString_InternFromString(barejid);
+#endif
+    if (obj) {
+        g_hash_table_insert(jid_objects, strdup(barejid), obj);
+    }
+
+    return obj;
+}
+
 static char*
 _handle_string_or_none_result(ProfPlugin* plugin, PyObject* result, char* hook)
 {
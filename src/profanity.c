@@ -46,10 +46,12 @@
 #include <stdio.h>
 
 #include <glib.h>
+#include <glib-unix.h>
 
 #include "profanity.h"
 #include "common.h"
 #include "log.h"
+#include "stats.h"
 #include "chatlog.h"
 #include "config/files.h"
 #include "config/tlscerts.h"
@@ -60,7 +62,9 @@
 #include "config/scripts.h"
 #include "command/cmd_defs.h"
 #include "plugins/plugins.h"
+#include "tools/control.h"
 #include "event/client_events.h"
+#include "event/common.h"
 #include "ui/inputwin.h"
 #include "ui/ui.h"
 #include "ui/window_list.h"
@@ -86,19 +90,75 @@
 #endif
 
 static void _init(char* log_level, char* config_file, char* log_file, char* theme_name);
+static void _init_phase(const char* const name);
+static void _init_report(void);
 static void _shutdown(void);
 static void _connect_default(const char* const account);
-static gboolean _main_update(gpointer data);
+static void _schedule_tasks(void);
+static gboolean _run_task(gpointer data);
+static gboolean _main_xmpp(gpointer data);
+static void _schedule_xmpp(void);
+static guint _xmpp_interval(void);
+static gboolean _main_sigwinch(gpointer data);
+static gint _stats_poll(GPollFD* ufds, guint nfds, gint timeout);
+
+// Periodic work, each subsystem on its own period. Whole second periods are
+// registered with g_timeout_add_seconds() so GLib serves them with a single
+// wakeup. Screen updates are not polled, see ui_mark_dirty().
+typedef struct prof_task_t
+{
+    guint interval_ms;
+    void (*run)(void);
+    const char* name;
+} ProfTask;
+
+#define PROF_TASK(interval, func) { interval, func, #func }
+
+static ProfTask tasks[] = {
+    PROF_TASK(1000, log_stderr_handler),
+    PROF_TASK(1000, log_flush),
+    PROF_TASK(1000, session_check_autoaway),
+    PROF_TASK(1000, notify_remind),
+    PROF_TASK(1000, iq_timeouts_check),
+    PROF_TASK(1000, chat_state_idle),
+    PROF_TASK(1000, stats_tick),
+    PROF_TASK(1000, ui_tick),
+    PROF_TASK(1000, mucwin_flood_check),
+};
 
-pthread_mutex_t lock;
 static gboolean force_quit = FALSE;
+static guint xmpp_interval = 0;
+static GPollFunc default_poll = NULL;
+static gint64 tick_start = 0;
 GMainLoop* mainloop = NULL;
 
+// --profile-startup, time spent in each startup phase
+typedef struct prof_init_phase_t
+{
+    const char* name;
+    gint64 elapsed_us;
+} ProfInitPhase;
+
+static GArray* init_phases = NULL;
+static gint64 init_start = 0;
+static gint64 init_phase_start = 0;
+
 void
-prof_run(char* log_level, char* account_name, char* config_file, char* log_file, char* theme_name)
+prof_run(char* log_level, char* account_name, char* config_file, char* log_file, char* theme_name, gboolean profile_startup, char* control_path)
 {
+    if (profile_startup) {
+        init_phases = g_array_new(FALSE, FALSE, sizeof(ProfInitPhase));
+    }
+    init_start = g_get_monotonic_time();
+    init_phase_start = init_start;
+
+    if (control_path) {
+        ui_set_headless();
+    }
     _init(log_level, config_file, log_file, theme_name);
     plugins_on_start();
+    _init_phase("plugins start");
+    _init_report();
     _connect_default(account_name);
 
     ui_update();
@@ -108,8 +168,17 @@ prof_run(char* log_level, char* account_name, char* config_file, char* log_file,
     session_init_activity();
 
     mainloop = g_main_loop_new(NULL, TRUE);
-    g_timeout_add(1000 / 60, _main_update, NULL);
-    inp_add_watch();
+    default_poll = g_main_context_get_poll_func(NULL);
+    g_main_context_set_poll_func(NULL, _stats_poll);
+    _schedule_tasks();
+    _schedule_xmpp();
+    if (control_path) {
+        if (!control_init(control_path)) {
+            return;
+        }
+    } else {
+        inp_add_watch();
+    }
     g_main_loop_run(mainloop);
 }
 
@@ -119,26 +188,86 @@ prof_set_quit(void)
     force_quit = TRUE;
 }
 
+// everything between two polls is the work of one main loop iteration
+static gint
+_stats_poll(GPollFD* ufds, guint nfds, gint timeout)
+{
+    if (tick_start) {
+        stats_iteration(tick_start);
+    }
+    gint res = default_poll(ufds, nfds, timeout);
+    tick_start = g_get_monotonic_time();
+
+    return res;
+}
+
+static void
+_schedule_tasks(void)
+{
+    for (unsigned int i = 0; i < ARRAY_SIZE(tasks); i++) {
+        if (tasks[i].interval_ms % 1000 == 0) {
+            g_timeout_add_seconds(tasks[i].interval_ms / 1000, _run_task, &tasks[i]);
+        } else {
+            g_timeout_add(tasks[i].interval_ms, _run_task, &tasks[i]);
+        }
+    }
+}
+
 static gboolean
-_main_update(gpointer data)
+_run_task(gpointer data)
 {
-    log_stderr_handler();
-    session_check_autoaway();
+    ProfTask* task = data;
+    gint64 start = stats_trace_begin();
+    task->run();
+    stats_span(task->name, start);
 
-#ifdef HAVE_LIBOTR
-    otr_poll();
-#endif
-    plugins_run_timed();
-    notify_remind();
+    // Always repeat
+    return TRUE;
+}
+
+// Incoming stanzas are dispatched from the socket watch, the periodic run is
+// for connection setup and teardown, libstrophe's timed handlers and
+// reconnecting. Poll fast only while a connection is changing state.
+static guint
+_xmpp_interval(void)
+{
+    switch (connection_get_status()) {
+    case JABBER_CONNECTED:
+    case JABBER_DISCONNECTED:
+        return 1000;
+    default:
+        return 1000 / 60;
+    }
+}
+
+static void
+_schedule_xmpp(void)
+{
+    xmpp_interval = _xmpp_interval();
+    g_timeout_add(xmpp_interval, _main_xmpp, NULL);
+}
+
+static gboolean
+_main_xmpp(gpointer data)
+{
+    gint64 start = stats_trace_begin();
     session_process_events();
-    iq_autoping_check();
-    ui_update();
-    chat_state_idle();
-#ifdef HAVE_GTK
-    tray_update();
-#endif
+    stats_span("xmpp_events", start);
+
+    if (_xmpp_interval() != xmpp_interval) {
+        _schedule_xmpp();
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static gboolean
+_main_sigwinch(gpointer data)
+{
+    ui_sigwinch_handler(SIGWINCH);
+    ui_mark_dirty();
 
-    // Always repeat
     return TRUE;
 }
 
@@ -164,26 +293,25 @@ _init(char* log_level, char* config_file, char* log_file, char* theme_name)
     signal(SIGPIPE, SIG_IGN);
     signal(SIGINT, SIG_IGN);
     signal(SIGTSTP, SIG_IGN);
-    signal(SIGWINCH, ui_sigwinch_handler);
-    if (pthread_mutex_init(&lock, NULL) != 0) {
-        log_error("Mutex init failed");
-        exit(1);
-    }
-
-    pthread_mutex_lock(&lock);
+    g_unix_signal_add(SIGWINCH, _main_sigwinch, NULL);
     files_create_directories();
     log_level_t prof_log_level;
     log_level_from_string(log_level, &prof_log_level);
     prefs_load(config_file);
+    _init_phase("prefs");
     log_init(prof_log_level, log_file);
     log_stderr_init(PROF_LEVEL_ERROR);
+    stats_set_budget(prefs_get_frame_budget());
+    _init_phase("log");
 
     auto_gchar gchar* prof_version = prof_get_version();
     log_info("Starting Profanity (%s)…", prof_version);
 
     chat_log_init();
     groupchat_log_init();
+    _init_phase("chat log");
     accounts_load();
+    _init_phase("accounts");
 
     if (theme_name) {
         theme_init(theme_name);
@@ -191,6 +319,7 @@ _init(char* log_level, char* config_file, char* log_file, char* theme_name)
         auto_gchar gchar* theme = prefs_get_string(PREF_THEME);
         theme_init(theme);
     }
+    _init_phase("theme");
 
     ui_init();
     if (prof_log_level == PROF_LEVEL_DEBUG) {
@@ -198,28 +327,70 @@ _init(char* log_level, char* config_file, char* log_file, char* theme_name)
         win_println(console, THEME_DEFAULT, "-", "Debug mode enabled! Logging to: ");
         win_println(console, THEME_DEFAULT, "-", get_log_file_location());
     }
+    _init_phase("ui");
     session_init();
+    _init_phase("session");
     cmd_init();
+    _init_phase("commands");
     log_info("Initialising contact list");
     muc_init();
     tlscerts_init();
     scripts_init();
 #ifdef HAVE_LIBOTR
     otr_init();
+    _init_phase("otr");
 #endif
 #ifdef HAVE_LIBGPGME
     p_gpg_init();
+    _init_phase("pgp");
 #endif
 #ifdef HAVE_OMEMO
     omemo_init();
+    _init_phase("omemo");
 #endif
     atexit(_shutdown);
     plugins_init();
+    _init_phase("plugins");
 #ifdef HAVE_GTK
     tray_init();
+    _init_phase("tray");
 #endif
     inp_nonblocking(TRUE);
     ui_resize();
+    _init_phase("draw");
+}
+
+// close the current startup phase, only recorded with --profile-startup
+static void
+_init_phase(const char* const name)
+{
+    gint64 now = g_get_monotonic_time();
+    if (init_phases) {
+        ProfInitPhase phase = { name, now - init_phase_start };
+        g_array_append_val(init_phases, phase);
+    }
+    init_phase_start = now;
+}
+
+static void
+_init_report(void)
+{
+    if (init_phases == NULL) {
+        return;
+    }
+
+    gint64 total_us = g_get_monotonic_time() - init_start;
+    cons_show("Startup profile:");
+    for (guint i = 0; i < init_phases->len; i++) {
+        ProfInitPhase* phase = &g_array_index(init_phases, ProfInitPhase, i);
+        cons_show("  %-14s %8.1f ms", phase->name, phase->elapsed_us / 1000.0);
+        log_info("Startup phase %s: %.1f ms", phase->name, phase->elapsed_us / 1000.0);
+    }
+    cons_show("  %-14s %8.1f ms", "total", total_us / 1000.0);
+    log_info("Startup total: %.1f ms", total_us / 1000.0);
+
+    g_array_free(init_phases, TRUE);
+    init_phases = NULL;
 }
 
 static void
@@ -235,6 +406,7 @@ _shutdown(void)
 
     jabber_conn_status_t conn_status = connection_get_status();
     if (conn_status == JABBER_CONNECTED) {
+        ev_session_snapshot_save();
         cl_ev_disconnect();
     }
 #ifdef HAVE_GTK
@@ -258,9 +430,12 @@ _shutdown(void)
     accounts_close();
     tlscerts_close();
     log_stderr_close();
+    control_close();
     plugins_shutdown();
     cmd_uninit();
     ui_close();
     prefs_close();
+    flush_keyfiles();
+    jid_pool_clear();
     log_close();
 }
@@ -40,10 +40,9 @@
 #include <pthread.h>
 #include <glib.h>
 
-void prof_run(char* log_level, char* account_name, char* config_file, char* log_file, char* theme_name);
+void prof_run(char* log_level, char* account_name, char* config_file, char* log_file, char* theme_name, gboolean profile_startup, char* control_path);
 void prof_set_quit(void);
 
-extern pthread_mutex_t lock;
 extern GMainLoop* mainloop;
 
 #endif
@@ -0,0 +1,440 @@
+/*
+ * stats.c
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2012 - 2019 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "log.h"
+#include "stats.h"
+
+// Timers are also fed from the database writer thread
+G_LOCK_DEFINE_STATIC(stats_lock);
+
+static guint64 stanzas[2][STATS_STANZA_COUNT];
+// stanza totals at the last tick and the difference over the second before
+static guint64 stanzas_last[2][STATS_STANZA_COUNT];
+static guint64 stanzas_rate[2][STATS_STANZA_COUNT];
+
+static guint64 counters[STATS_COUNTER_COUNT];
+
+static ProfStatsTimer timers[STATS_TIMER_COUNT];
+
+static const char* stanza_names[STATS_STANZA_COUNT] = {
+    [STATS_STANZA_MESSAGE] = "message",
+    [STATS_STANZA_PRESENCE] = "presence",
+    [STATS_STANZA_IQ] = "iq",
+};
+
+static const char* counter_names[STATS_COUNTER_COUNT] = {
+    [STATS_COUNTER_PRESENCE_UNCHANGED] = "presence_unchanged",
+};
+
+// Trace spans go into a ring buffer that keeps the latest TRACE_RING_SIZE
+#define TRACE_RING_SIZE (1 << 16)
+
+typedef struct trace_span_t
+{
+    const char* name;
+    gint64 start;
+    gint64 dur;
+    guint tid;
+} TraceSpan;
+
+G_LOCK_DEFINE_STATIC(trace_lock);
+static gint tracing = 0;
+static TraceSpan* trace_ring = NULL;
+static guint64 trace_count = 0;
+static char* trace_path = NULL;
+static gint64 trace_started = 0;
+static GPrivate trace_tid;
+static gint trace_next_tid = 0;
+
+static const char* timer_names[STATS_TIMER_COUNT] = {
+    [STATS_TIMER_TICK] = "main_loop_tick",
+    [STATS_TIMER_UI_UPDATE] = "ui_update",
+    [STATS_TIMER_DOUPDATE] = "doupdate",
+    [STATS_TIMER_DB_QUEUE] = "db_queue",
+    [STATS_TIMER_OMEMO_ENCRYPT] = "omemo_encrypt",
+    [STATS_TIMER_OMEMO_DECRYPT] = "omemo_decrypt",
+    [STATS_TIMER_KEY_TO_SCREEN] = "key_to_screen",
+    [STATS_TIMER_STANZA_TO_SCREEN] = "stanza_to_screen",
+};
+
+// Frame budget watchdog, only ever looks at work on the main thread
+static gint budget_ms = 0;
+static GThread* budget_thread = NULL;
+static const char* phase_longest = NULL;
+static gint64 phase_longest_us = 0;
+
+static gint64 latency_start[STATS_TIMER_COUNT];
+
+void
+stats_stanza_received(stats_stanza_t type)
+{
+    stanzas[FALSE][type]++;
+}
+
+void
+stats_stanza_sent(stats_stanza_t type)
+{
+    stanzas[TRUE][type]++;
+}
+
+guint64
+stats_stanza_total(gboolean sent, stats_stanza_t type)
+{
+    return stanzas[sent ? 1 : 0][type];
+}
+
+// stanzas in the last full second
+guint64
+stats_stanza_rate(gboolean sent, stats_stanza_t type)
+{
+    return stanzas_rate[sent ? 1 : 0][type];
+}
+
+const char*
+stats_stanza_name(stats_stanza_t type)
+{
+    return stanza_names[type];
+}
+
+void
+stats_count(stats_counter_t counter)
+{
+    counters[counter]++;
+}
+
+guint64
+stats_counter_total(stats_counter_t counter)
+{
+    return counters[counter];
+}
+
+const char*
+stats_counter_name(stats_counter_t counter)
+{
+    return counter_names[counter];
+}
+
+static gint64
+_stats_elapsed(gint64 start, gint64 now)
+{
+    return MAX(now - start, 0);
+}
+
+static void
+_stats_record(stats_timer_t timer, gint64 elapsed)
+{
+    guint bucket = MIN(g_bit_storage((gulong)elapsed), STATS_BUCKETS - 1);
+
+    G_LOCK(stats_lock);
+    ProfStatsTimer* stats = &timers[timer];
+    stats->calls++;
+    stats->total_us += elapsed;
+    if (elapsed > stats->max_us) {
+        stats->max_us = elapsed;
+    }
+    stats->buckets[bucket]++;
+    G_UNLOCK(stats_lock);
+}
+
+static gboolean
+_stats_watching(void)
+{
+    return budget_ms > 0 && g_thread_self() == budget_thread;
+}
+
+// one part of the current main loop iteration is done
+static void
+_stats_phase(const char* const name, gint64 elapsed)
+{
+    if (elapsed > phase_longest_us) {
+        phase_longest = name;
+        phase_longest_us = elapsed;
+    }
+    if (elapsed > (gint64)budget_ms * 1000) {
+        log_warning("%s took %" G_GINT64_FORMAT " ms, over the %d ms frame budget", name, elapsed / 1000, budget_ms);
+    }
+}
+
+void
+stats_time(stats_timer_t timer, gint64 start)
+{
+    _stats_record(timer, _stats_elapsed(start, g_get_monotonic_time()));
+    stats_span(timer_names[timer], start);
+}
+
+void
+stats_timer_get(stats_timer_t timer, ProfStatsTimer* result)
+{
+    G_LOCK(stats_lock);
+    *result = timers[timer];
+    G_UNLOCK(stats_lock);
+
+    result->avg_us = result->calls ? result->total_us / (gint64)result->calls : 0;
+    result->p99_us = result->max_us;
+
+    guint64 wanted = result->calls - result->calls / 100;
+    guint64 seen = 0;
+    for (int b = 0; b < STATS_BUCKETS; b++) {
+        seen += result->buckets[b];
+        if (seen >= wanted) {
+            result->p99_us = MIN(((gint64)1 << b) - 1, result->max_us);
+            break;
+        }
+    }
+}
+
+const char*
+stats_timer_name(stats_timer_t timer)
+{
+    return timer_names[timer];
+}
+
+void
+stats_tick(void)
+{
+    for (int dir = 0; dir < 2; dir++) {
+        for (int type = 0; type < STATS_STANZA_COUNT; type++) {
+            stanzas_rate[dir][type] = stanzas[dir][type] - stanzas_last[dir][type];
+            stanzas_last[dir][type] = stanzas[dir][type];
+        }
+    }
+}
+
+void
+stats_reset(void)
+{
+    memset(stanzas, 0, sizeof(stanzas));
+    memset(stanzas_last, 0, sizeof(stanzas_last));
+    memset(stanzas_rate, 0, sizeof(stanzas_rate));
+    memset(counters, 0, sizeof(counters));
+
+    G_LOCK(stats_lock);
+    memset(timers, 0, sizeof(timers));
+    G_UNLOCK(stats_lock);
+}
+
+static guint
+_trace_tid(void)
+{
+    guint tid = GPOINTER_TO_UINT(g_private_get(&trace_tid));
+    if (!tid) {
+        tid = g_atomic_int_add(&trace_next_tid, 1) + 1;
+        g_private_set(&trace_tid, GUINT_TO_POINTER(tid));
+    }
+
+    return tid;
+}
+
+gboolean
+stats_trace_start(const char* const path)
+{
+    if (g_atomic_int_get(&tracing)) {
+        return FALSE;
+    }
+
+    G_LOCK(trace_lock);
+    trace_ring = g_new(TraceSpan, TRACE_RING_SIZE);
+    trace_count = 0;
+    trace_path = g_strdup(path);
+    trace_started = g_get_monotonic_time();
+    G_UNLOCK(trace_lock);
+
+    g_atomic_int_set(&tracing, 1);
+
+    return TRUE;
+}
+
+gboolean
+stats_tracing(void)
+{
+    return g_atomic_int_get(&tracing);
+}
+
+gint64
+stats_trace_begin(void)
+{
+    return g_atomic_int_get(&tracing) || _stats_watching() ? g_get_monotonic_time() : 0;
+}
+
+static void
+_trace_add(const char* const name, gint64 start, gint64 dur)
+{
+    guint tid = _trace_tid();
+
+    G_LOCK(trace_lock);
+    if (trace_ring) {
+        TraceSpan* span = &trace_ring[trace_count % TRACE_RING_SIZE];
+        span->name = name;
+        span->start = start;
+        span->dur = dur;
+        span->tid = tid;
+        trace_count++;
+    }
+    G_UNLOCK(trace_lock);
+}
+
+void
+stats_span(const char* const name, gint64 start)
+{
+    if (!start) {
+        return;
+    }
+
+    gint64 dur = _stats_elapsed(start, g_get_monotonic_time());
+    if (g_atomic_int_get(&tracing)) {
+        _trace_add(name, start, dur);
+    }
+    if (_stats_watching()) {
+        _stats_phase(name, dur);
+    }
+}
+
+void
+stats_iteration(gint64 start)
+{
+    gint64 elapsed = _stats_elapsed(start, g_get_monotonic_time());
+    _stats_record(STATS_TIMER_TICK, elapsed);
+    if (g_atomic_int_get(&tracing)) {
+        _trace_add(timer_names[STATS_TIMER_TICK], start, elapsed);
+    }
+
+    // a part over the budget has already said so
+    gint64 budget_us = (gint64)budget_ms * 1000;
+    if (_stats_watching() && elapsed > budget_us && phase_longest_us <= budget_us) {
+        if (phase_longest) {
+            log_warning("Main loop iteration took %" G_GINT64_FORMAT " ms, over the %d ms frame budget, longest part %s took %" G_GINT64_FORMAT " ms",
+                        elapsed / 1000, budget_ms, phase_longest, phase_longest_us / 1000);
+        } else {
+            log_warning("Main loop iteration took %" G_GINT64_FORMAT " ms, over the %d ms frame budget", elapsed / 1000, budget_ms);
+        }
+    }
+    phase_longest = NULL;
+    phase_longest_us = 0;
+}
+
+// 0 turns the watchdog off, call from the main thread
+void
+stats_set_budget(gint ms)
+{
+    budget_ms = MAX(ms, 0);
+    budget_thread = g_thread_self();
+    phase_longest = NULL;
+    phase_longest_us = 0;
+}
+
+gint
+stats_get_budget(void)
+{
+    return budget_ms;
+}
+
+void
+stats_latency_begin(stats_timer_t timer)
+{
+    if (!latency_start[timer]) {
+        latency_start[timer] = g_get_monotonic_time();
+    }
+}
+
+void
+stats_latency_end(void)
+{
+    gint64 now = g_get_monotonic_time();
+    for (int i = 0; i < STATS_TIMER_COUNT; i++) {
+        if (latency_start[i]) {
+            _stats_record(i, _stats_elapsed(latency_start[i], now));
+            latency_start[i] = 0;
+        }
+    }
+}
+
+static void
+_trace_append_name(GString* json, const char* const name)
+{
+    for (const char* c = name; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            g_string_append_c(json, '\\');
+            g_string_append_c(json, *c);
+        } else if ((guchar)*c < 0x20) {
+            g_string_append_printf(json, "\\u%04x", (guchar)*c);
+        } else {
+            g_string_append_c(json, *c);
+        }
+    }
+}
+
+// stops tracing and writes the spans to the file given to stats_trace_start(),
+// returns the number of spans written or -1 with error set
+gint
+stats_trace_stop(GError** error)
+{
+    if (!g_atomic_int_get(&tracing)) {
+        return 0;
+    }
+    g_atomic_int_set(&tracing, 0);
+
+    G_LOCK(trace_lock);
+    TraceSpan* ring = trace_ring;
+    guint64 count = trace_count;
+    char* path = trace_path;
+    gint64 started = trace_started;
+    trace_ring = NULL;
+    trace_path = NULL;
+    G_UNLOCK(trace_lock);
+
+    guint64 first = count > TRACE_RING_SIZE ? count - TRACE_RING_SIZE : 0;
+    GString* json = g_string_sized_new((count - first) * 96 + 32);
+    g_string_append(json, "{\"traceEvents\":[");
+    for (guint64 i = first; i < count; i++) {
+        TraceSpan* span = &ring[i % TRACE_RING_SIZE];
+        g_string_append(json, i == first ? "\n{\"name\":\"" : ",\n{\"name\":\"");
+        _trace_append_name(json, span->name);
+        g_string_append_printf(json, "\",\"ph\":\"X\",\"ts\":%" G_GINT64_FORMAT ",\"dur\":%" G_GINT64_FORMAT ",\"pid\":1,\"tid\":%u}",
+                               span->start - started, span->dur, span->tid);
+    }
+    g_string_append(json, "\n]}\n");
+
+    gboolean res = g_file_set_contents(path, json->str, json->len, error);
+
+    g_string_free(json, TRUE);
+    g_free(ring);
+    g_free(path);
+
+    return res ? (gint)(count - first) : -1;
+}
@@ -0,0 +1,123 @@
+/*
+ * stats.h
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2012 - 2019 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <glib.h>
+
+// Runtime counters behind /stats and prof_get_stats(). Cheap enough to stay
+// on in normal use: a few integer adds per event, no allocation.
+
+typedef enum {
+    STATS_STANZA_MESSAGE,
+    STATS_STANZA_PRESENCE,
+    STATS_STANZA_IQ,
+    STATS_STANZA_COUNT
+} stats_stanza_t;
+
+typedef enum {
+    STATS_TIMER_TICK,
+    STATS_TIMER_UI_UPDATE,
+    STATS_TIMER_DOUPDATE,
+    STATS_TIMER_DB_QUEUE,
+    STATS_TIMER_OMEMO_ENCRYPT,
+    STATS_TIMER_OMEMO_DECRYPT,
+    STATS_TIMER_KEY_TO_SCREEN,
+    STATS_TIMER_STANZA_TO_SCREEN,
+    STATS_TIMER_COUNT
+} stats_timer_t;
+
+// work skipped because it would not have changed anything
+typedef enum {
+    STATS_COUNTER_PRESENCE_UNCHANGED,
+    STATS_COUNTER_COUNT
+} stats_counter_t;
+
+#define STATS_BUCKETS 32
+
+typedef struct prof_stats_timer_t
+{
+    guint64 calls;
+    gint64 total_us;
+    gint64 avg_us;
+    gint64 p99_us;
+    gint64 max_us;
+    // buckets[b] counts runs that took less than 2^b microseconds
+    guint64 buckets[STATS_BUCKETS];
+} ProfStatsTimer;
+
+void stats_stanza_received(stats_stanza_t type);
+void stats_stanza_sent(stats_stanza_t type);
+guint64 stats_stanza_total(gboolean sent, stats_stanza_t type);
+guint64 stats_stanza_rate(gboolean sent, stats_stanza_t type);
+const char* stats_stanza_name(stats_stanza_t type);
+
+void stats_count(stats_counter_t counter);
+guint64 stats_counter_total(stats_counter_t counter);
+const char* stats_counter_name(stats_counter_t counter);
+
+void stats_time(stats_timer_t timer, gint64 start);
+void stats_timer_get(stats_timer_t timer, ProfStatsTimer* result);
+const char* stats_timer_name(stats_timer_t timer);
+
+void stats_tick(void);
+void stats_reset(void);
+
+// Main loop iterations, recorded as STATS_TIMER_TICK. With a frame budget set
+// any span or main thread timer that goes over it logs a warning, and so does
+// an iteration that goes over it without one, naming its longest part.
+void stats_iteration(gint64 start);
+void stats_set_budget(gint ms);
+gint stats_get_budget(void);
+
+// Latency from an input to the screen update that shows it. Begin keeps the
+// earliest start until the next stats_latency_end(), which the screen update
+// calls after doupdate(). Main thread only.
+void stats_latency_begin(stats_timer_t timer);
+void stats_latency_end(void);
+
+// Trace spans, written as Chrome trace JSON (chrome://tracing, Perfetto).
+// While neither a trace runs nor a frame budget is set stats_trace_begin()
+// returns 0 and stats_span() does nothing with it, so spans can stay in hot
+// paths. Names are not copied, pass
+// string literals or g_intern_string().
+gboolean stats_trace_start(const char* const path);
+gint stats_trace_stop(GError** error);
+gboolean stats_tracing(void);
+gint64 stats_trace_begin(void);
+void stats_span(const char* const name, gint64 start);
+
+#endif
@@ -52,104 +52,81 @@
 #include "tools/http_common.h"
 #include "tools/aesgcm_download.h"
 #include "omemo/omemo.h"
+#include "omemo/crypto.h"
 #include "config/preferences.h"
 #include "ui/ui.h"
 #include "ui/window.h"
 #include "common.h"
 
-#define FALLBACK_MSG ""
-
 void*
 aesgcm_file_get(void* userdata)
 {
     AESGCMDownload* aesgcm_dl = (AESGCMDownload*)userdata;
+    HTTPDownload* http_dl = aesgcm_dl->http_dl;
 
     char* https_url = NULL;
     char* fragment = NULL;
 
+    // What the key in the fragment decrypts never changes, so a cached
+    // cleartext is used without asking the server.
+    auto_gchar gchar* cache_key = http_download_cache_key(aesgcm_dl->url);
+    if (http_download_cache_restore(cache_key, aesgcm_dl->filename)) {
+        http_print_transfer(aesgcm_dl->window, aesgcm_dl->id,
+                            "Downloading '%s': done\nSaved to '%s'",
+                            aesgcm_dl->url, aesgcm_dl->filename);
+        http_mark_transfer_done(aesgcm_dl->window, aesgcm_dl->id);
+        http_download_done(http_dl);
+        goto out;
+    }
+
     // Convert the aesgcm:// URL to a https:// URL and extract the encoded key
     // and tag stored in the URL fragment.
     if (omemo_parse_aesgcm_url(aesgcm_dl->url, &https_url, &fragment) != 0) {
-        cons_show_error("Download failed: Cannot parse URL '%s'.", aesgcm_dl->url);
         http_print_transfer_update(aesgcm_dl->window, aesgcm_dl->id,
                                    "Download failed: Cannot parse URL '%s'.",
                                    aesgcm_dl->url);
+        http_download_done(http_dl);
         return NULL;
     }
 
-    // Create a temporary file used for storing the ciphertext that is to be
-    // retrieved from the https:// URL.
-    gchar* tmpname = NULL;
-    gint tmpfd;
-    if ((tmpfd = g_file_open_tmp("profanity.XXXXXX", &tmpname, NULL)) == -1) {
-        http_print_transfer_update(aesgcm_dl->window, aesgcm_dl->id,
-                                   "Downloading '%s' failed: Unable to create "
-                                   "temporary ciphertext file for writing "
-                                   "(%s).",
-                                   https_url, g_strerror(errno));
-        return NULL;
-    }
-
-    // Open the target file for storing the cleartext.
-    FILE* outfh = fopen(aesgcm_dl->filename, "wb");
-    if (outfh == NULL) {
+    // The ciphertext is decrypted while it is downloaded, with the
+    // authentication tag checked once the transfer is complete.
+    gcry_error_t crypt_res;
+    struct aes256gcm_stream_t* stream = omemo_decrypt_file_stream(fragment, &crypt_res);
+    if (stream == NULL) {
         http_print_transfer_update(aesgcm_dl->window, aesgcm_dl->id,
-                                   "Downloading '%s' failed: Unable to open "
-                                   "output file at '%s' for writing (%s).",
-                                   https_url, aesgcm_dl->filename,
-                                   g_strerror(errno));
+                                   "Downloading '%s' failed: Failed to set up "
+                                   "decryption (%s).",
+                                   https_url, gcry_strerror(crypt_res));
+        http_download_done(http_dl);
+        free(https_url);
+        free(fragment);
         return NULL;
     }
 
-    // We wrap the HTTPDownload tool and use it for retrieving the ciphertext
-    // and storing it in the temporary file previously opened.
-    HTTPDownload* http_dl = malloc(sizeof(HTTPDownload));
-    http_dl->window = aesgcm_dl->window;
-    http_dl->worker = aesgcm_dl->worker;
-    http_dl->id = strdup(aesgcm_dl->id);
     http_dl->url = strdup(https_url);
-    http_dl->filename = strdup(tmpname);
-    http_dl->cmd_template = NULL;
-    aesgcm_dl->http_dl = http_dl;
+    http_dl->decrypt_stream = stream;
 
     http_file_get(http_dl); // TODO(wstrm): Verify result.
 
-    FILE* tmpfh = fopen(tmpname, "rb");
-    if (tmpfh == NULL) {
-        http_print_transfer_update(aesgcm_dl->window, aesgcm_dl->id,
-                                   "Downloading '%s' failed: Unable to open "
-                                   "temporary file at '%s' for reading (%s).",
-                                   aesgcm_dl->url, tmpname,
-                                   g_strerror(errno));
-        return NULL;
-    }
-
-    gcry_error_t crypt_res;
-    crypt_res = omemo_decrypt_file(tmpfh, outfh,
-                                   http_dl->bytes_received, fragment);
-
-    if (fclose(tmpfh) == EOF) {
-        cons_show_error(g_strerror(errno));
-    }
-
-    close(tmpfd);
-    remove(tmpname);
-    g_free(tmpname);
+    crypt_res = aes256gcm_stream_finish(stream);
+    aes256gcm_stream_free(stream);
 
     if (crypt_res != GPG_ERR_NO_ERROR) {
+        // Never leave unauthenticated cleartext behind.
+        remove(aesgcm_dl->filename);
         http_print_transfer_update(aesgcm_dl->window, aesgcm_dl->id,
                                    "Downloading '%s' failed: Failed to decrypt "
                                    "file (%s).",
                                    https_url, gcry_strerror(crypt_res));
-    }
-
-    if (fclose(outfh) == EOF) {
-        cons_show_error(g_strerror(errno));
+    } else {
+        http_download_cache_store(cache_key, aesgcm_dl->filename, NULL, NULL);
     }
 
     free(https_url);
     free(fragment);
 
+out:
     if (aesgcm_dl->cmd_template != NULL) {
         gchar** argv = format_call_external_argv(aesgcm_dl->cmd_template,
                                                  aesgcm_dl->filename,
@@ -184,8 +161,20 @@ aesgcm_download_cancel_processes(ProfWin* window)
     http_download_cancel_processes(window);
 }
 
+// We wrap the HTTPDownload tool and use it for retrieving the ciphertext and
+// storing the cleartext in the target file. It is set up here on the main
+// thread so it can be canceled right away, call before the thread is started.
 void
 aesgcm_download_add_download(AESGCMDownload* aesgcm_dl)
 {
-    http_download_add_download(aesgcm_dl->http_dl);
+    HTTPDownload* http_dl = malloc(sizeof(HTTPDownload));
+    http_dl->window = aesgcm_dl->window;
+    http_dl->id = strdup(aesgcm_dl->id);
+    http_dl->url = NULL;
+    http_dl->filename = strdup(aesgcm_dl->filename);
+    http_dl->cmd_template = NULL;
+    http_dl->decrypt_stream = NULL;
+    aesgcm_dl->http_dl = http_dl;
+
+    http_download_add_download(http_dl);
 }
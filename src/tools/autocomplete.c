@@ -50,22 +50,206 @@ typedef enum {
     NEXT
 } search_direction;
 
+typedef struct autocomplete_item_t
+{
+    gchar* value;
+    // ASCII lowercase version of value that searches compare against
+    gchar* folded;
+} AutocompleteItem;
+
 struct autocomplete_t
 {
-    GList* items;
-    GList* last_found;
+    // AutocompleteItem, in the order completions are offered
+    GPtrArray* items;
+    // value -> AutocompleteItem, for duplicate checks and removal
+    GHashTable* index;
+    // position of the last match in items, -1 when no search is ongoing
+    gint last_found;
+    // folded search string
     gchar* search_str;
+    // sorted adds are appended and sorted on autocomplete_bulk_end()
+    gboolean bulk;
+    // items were appended since the last sort
+    gboolean unsorted;
+    // items are in sorted order, not added with autocomplete_add_unsorted()
+    gboolean ordered;
+    // AutocompleteItem sorted by folded, so the matches of a search are one
+    // run found by binary search. Built on the next search after a change.
+    GPtrArray* prefix_index;
+    // FuzzyMatch, ranked candidates for fuzzy_query
+    GArray* fuzzy_matches;
+    // folded query fuzzy_matches belongs to, kept across resets so the next
+    // keystroke only has to narrow the previous candidates
+    gchar* fuzzy_query;
+    // position in fuzzy_matches while cycling, -1 when no search is ongoing
+    gint fuzzy_pos;
 };
 
-static gchar* _search(Autocomplete ac, GList* curr, gboolean quote, search_direction direction);
+typedef struct fuzzy_match_t
+{
+    AutocompleteItem* item;
+    gint score;
+    // position of item in items, keeps ties in completion order
+    guint pos;
+} FuzzyMatch;
+
+// ranked subsequence matching instead of prefix matching
+static gboolean fuzzy = FALSE;
+
+static gchar* _search(Autocomplete ac, gint start, gboolean quote, search_direction direction);
+static gchar* _fuzzy_complete(Autocomplete ac, const gchar* search_str, gboolean quote, gboolean previous);
+static void _fuzzy_invalidate(Autocomplete ac);
+static void _prefix_invalidate(Autocomplete ac);
+
+static gchar*
+_fold(const char* const str)
+{
+    auto_gchar gchar* ascii = g_str_to_ascii(str, NULL);
+    return g_ascii_strdown(ascii, -1);
+}
+
+static AutocompleteItem*
+_item_new(const char* const value)
+{
+    AutocompleteItem* item = g_new(AutocompleteItem, 1);
+    item->value = g_strdup(value);
+    item->folded = _fold(value);
+
+    return item;
+}
+
+static void
+_item_free(gpointer data)
+{
+    AutocompleteItem* item = data;
+    g_free(item->value);
+    g_free(item->folded);
+    g_free(item);
+}
+
+static gchar*
+_item_result(AutocompleteItem* item, gboolean quote)
+{
+    // if contains space, quote before returning
+    if (quote && g_strrstr(item->value, " ")) {
+        return g_strdup_printf("\"%s\"", item->value);
+        // otherwise just return the string
+    } else {
+        return strdup(item->value);
+    }
+}
+
+static gint
+_item_cmp(gconstpointer a, gconstpointer b)
+{
+    const AutocompleteItem* item_a = *(AutocompleteItem* const*)a;
+    const AutocompleteItem* item_b = *(AutocompleteItem* const*)b;
+
+    return strcmp(item_a->value, item_b->value);
+}
+
+// first position whose value does not sort before value
+static guint
+_sorted_position(Autocomplete ac, const char* const value)
+{
+    guint low = 0;
+    guint high = ac->items->len;
+
+    while (low < high) {
+        guint mid = low + (high - low) / 2;
+        AutocompleteItem* item = g_ptr_array_index(ac->items, mid);
+        if (strcmp(item->value, value) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+static void
+_insert(Autocomplete ac, guint pos, const char* const value)
+{
+    AutocompleteItem* item = _item_new(value);
+    _fuzzy_invalidate(ac);
+    _prefix_invalidate(ac);
+    g_ptr_array_insert(ac->items, pos, item);
+    g_hash_table_insert(ac->index, item->value, item);
+
+    // keep pointing at the same item
+    if (ac->last_found >= 0 && pos <= ac->last_found) {
+        ac->last_found++;
+    }
+}
+
+static void
+_append(Autocomplete ac, const char* const value)
+{
+    AutocompleteItem* item = _item_new(value);
+    _fuzzy_invalidate(ac);
+    _prefix_invalidate(ac);
+    g_ptr_array_add(ac->items, item);
+    g_hash_table_insert(ac->index, item->value, item);
+    ac->unsorted = TRUE;
+}
+
+static void
+_sort_pending(Autocomplete ac)
+{
+    if (!ac->unsorted) {
+        return;
+    }
+
+    AutocompleteItem* last_found = NULL;
+    if (ac->last_found >= 0) {
+        last_found = g_ptr_array_index(ac->items, ac->last_found);
+    }
+
+    _fuzzy_invalidate(ac);
+    g_ptr_array_sort(ac->items, _item_cmp);
+    ac->unsorted = FALSE;
+
+    guint pos;
+    if (last_found && g_ptr_array_find(ac->items, last_found, &pos)) {
+        ac->last_found = pos;
+    }
+}
+
+static void
+_remove_index(Autocomplete ac, guint pos)
+{
+    AutocompleteItem* item = g_ptr_array_index(ac->items, pos);
+
+    _fuzzy_invalidate(ac);
+    _prefix_invalidate(ac);
+
+    // reset last found if it points to the item to be removed
+    if (ac->last_found == pos) {
+        ac->last_found = -1;
+    } else if (ac->last_found > (gint)pos) {
+        ac->last_found--;
+    }
+
+    g_hash_table_remove(ac->index, item->value);
+    g_ptr_array_remove_index(ac->items, pos);
+}
 
 Autocomplete
 autocomplete_new(void)
 {
     Autocomplete new = malloc(sizeof(struct autocomplete_t));
-    new->items = NULL;
-    new->last_found = NULL;
+    new->items = g_ptr_array_new_with_free_func(_item_free);
+    new->index = g_hash_table_new(g_str_hash, g_str_equal);
+    new->last_found = -1;
     new->search_str = NULL;
+    new->bulk = FALSE;
+    new->unsorted = FALSE;
+    new->ordered = TRUE;
+    new->prefix_index = NULL;
+    new->fuzzy_matches = NULL;
+    new->fuzzy_query = NULL;
+    new->fuzzy_pos = -1;
 
     return new;
 }
@@ -74,27 +258,55 @@ void
 autocomplete_clear(Autocomplete ac)
 {
     if (ac) {
-        if (ac->items) {
-            g_list_free_full(ac->items, free);
-            ac->items = NULL;
-        }
+        g_hash_table_remove_all(ac->index);
+        _fuzzy_invalidate(ac);
+        _prefix_invalidate(ac);
+        g_ptr_array_set_size(ac->items, 0);
+        ac->unsorted = FALSE;
+        ac->ordered = TRUE;
 
         autocomplete_reset(ac);
     }
 }
 
+void
+autocomplete_bulk_begin(Autocomplete ac)
+{
+    if (ac) {
+        ac->bulk = TRUE;
+    }
+}
+
+void
+autocomplete_bulk_end(Autocomplete ac)
+{
+    if (ac) {
+        ac->bulk = FALSE;
+        _sort_pending(ac);
+    }
+}
+
 void
 autocomplete_reset(Autocomplete ac)
 {
-    ac->last_found = NULL;
+    ac->last_found = -1;
+    ac->fuzzy_pos = -1;
     FREE_SET_NULL(ac->search_str);
 }
 
+void
+autocomplete_set_fuzzy(gboolean enabled)
+{
+    fuzzy = enabled;
+}
+
 void
 autocomplete_free(Autocomplete ac)
 {
     if (ac) {
         autocomplete_clear(ac);
+        g_hash_table_destroy(ac->index);
+        g_ptr_array_free(ac->items, TRUE);
         free(ac);
     }
 }
@@ -104,10 +316,8 @@ autocomplete_length(Autocomplete ac)
 {
     if (!ac) {
         return 0;
-    } else if (!ac->items) {
-        return 0;
     } else {
-        return g_list_length(ac->items);
+        return ac->items->len;
     }
 }
 
@@ -117,8 +327,9 @@ autocomplete_update(Autocomplete ac, char** items)
     auto_gchar gchar* last_found = NULL;
     auto_gchar gchar* search_str = NULL;
 
-    if (ac->last_found) {
-        last_found = strdup(ac->last_found->data);
+    if (ac->last_found >= 0) {
+        AutocompleteItem* item = g_ptr_array_index(ac->items, ac->last_found);
+        last_found = strdup(item->value);
     }
 
     if (ac->search_str) {
@@ -129,8 +340,12 @@ autocomplete_update(Autocomplete ac, char** items)
     autocomplete_add_all(ac, items);
 
     if (last_found) {
-        // NULL if last_found was removed on update.
-        ac->last_found = g_list_find_custom(ac->items, last_found, (GCompareFunc)strcmp);
+        // -1 if last_found was removed on update.
+        AutocompleteItem* item = g_hash_table_lookup(ac->index, last_found);
+        guint pos;
+        if (item && g_ptr_array_find(ac->items, item, &pos)) {
+            ac->last_found = pos;
+        }
     }
 
     if (search_str) {
@@ -142,21 +357,13 @@ void
 autocomplete_add_unsorted(Autocomplete ac, const char* item, const gboolean is_reversed)
 {
     if (ac) {
-        char* item_cpy;
-        GList* curr = g_list_find_custom(ac->items, item, (GCompareFunc)strcmp);
-
         // if item already exists
-        if (curr) {
+        if (g_hash_table_contains(ac->index, item)) {
             return;
         }
 
-        item_cpy = strdup(item);
-
-        if (is_reversed) {
-            ac->items = g_list_prepend(ac->items, item_cpy);
-        } else {
-            ac->items = g_list_append(ac->items, item_cpy);
-        }
+        ac->ordered = FALSE;
+        _insert(ac, is_reversed ? 0 : ac->items->len, item);
     }
 }
 
@@ -164,24 +371,36 @@ void
 autocomplete_add(Autocomplete ac, const char* item)
 {
     if (ac) {
-        char* item_cpy;
-        GList* curr = g_list_find_custom(ac->items, item, (GCompareFunc)strcmp);
-
         // if item already exists
-        if (curr) {
+        if (g_hash_table_contains(ac->index, item)) {
             return;
         }
 
-        item_cpy = strdup(item);
-        ac->items = g_list_insert_sorted(ac->items, item_cpy, (GCompareFunc)strcmp);
+        if (ac->bulk) {
+            _append(ac, item);
+        } else {
+            _sort_pending(ac);
+            _insert(ac, _sorted_position(ac, item), item);
+        }
     }
 }
 
 void
 autocomplete_add_all(Autocomplete ac, char** items)
 {
+    if (!ac) {
+        return;
+    }
+
+    // append everything and sort once instead of a sorted insert per item
     for (int i = 0; i < g_strv_length(items); i++) {
-        autocomplete_add(ac, items[i]);
+        if (!g_hash_table_contains(ac->index, items[i])) {
+            _append(ac, items[i]);
+        }
+    }
+
+    if (!ac->bulk) {
+        _sort_pending(ac);
     }
 }
 
@@ -189,19 +408,14 @@ void
 autocomplete_remove(Autocomplete ac, const char* const item)
 {
     if (ac) {
-        GList* curr = g_list_find_custom(ac->items, item, (GCompareFunc)strcmp);
+        AutocompleteItem* curr = g_hash_table_lookup(ac->index, item);
+        guint pos;
 
-        if (!curr) {
+        if (!curr || !g_ptr_array_find(ac->items, curr, &pos)) {
             return;
         }
 
-        // reset last found if it points to the item to be removed
-        if (ac->last_found == curr) {
-            ac->last_found = NULL;
-        }
-
-        free(curr->data);
-        ac->items = g_list_delete_link(ac->items, curr);
+        _remove_index(ac, pos);
     }
 
     return;
@@ -219,11 +433,11 @@ GList*
 autocomplete_create_list(Autocomplete ac)
 {
     GList* copy = NULL;
-    GList* curr = ac->items;
 
-    while (curr) {
-        copy = g_list_append(copy, strdup(curr->data));
-        curr = g_list_next(curr);
+    _sort_pending(ac);
+    for (guint i = ac->items->len; i > 0; i--) {
+        AutocompleteItem* item = g_ptr_array_index(ac->items, i - 1);
+        copy = g_list_prepend(copy, strdup(item->value));
     }
 
     return copy;
@@ -232,16 +446,7 @@ autocomplete_create_list(Autocomplete ac)
 gboolean
 autocomplete_contains(Autocomplete ac, const char* value)
 {
-    GList* curr = ac->items;
-
-    while (curr) {
-        if (strcmp(curr->data, value) == 0) {
-            return TRUE;
-        }
-        curr = g_list_next(curr);
-    }
-
-    return FALSE;
+    return g_hash_table_contains(ac->index, value);
 }
 
 gchar*
@@ -255,18 +460,24 @@ autocomplete_complete(Autocomplete ac, const gchar* search_str, gboolean quote,
     }
 
     // no items to search
-    if (!ac->items) {
+    if (ac->items->len == 0) {
         return NULL;
     }
 
+    _sort_pending(ac);
+
+    if (fuzzy) {
+        return _fuzzy_complete(ac, search_str, quote, previous);
+    }
+
     // first search attempt
-    if (!ac->last_found) {
+    if (ac->last_found < 0) {
         if (ac->search_str) {
             FREE_SET_NULL(ac->search_str);
         }
 
-        ac->search_str = strdup(search_str);
-        found = _search(ac, ac->items, quote, NEXT);
+        ac->search_str = _fold(search_str);
+        found = _search(ac, 0, quote, NEXT);
 
         return found;
 
@@ -274,13 +485,13 @@ autocomplete_complete(Autocomplete ac, const gchar* search_str, gboolean quote,
     } else {
         if (previous) {
             // search from here-1 to beginning
-            found = _search(ac, g_list_previous(ac->last_found), quote, PREVIOUS);
+            found = _search(ac, ac->last_found - 1, quote, PREVIOUS);
             if (found) {
                 return found;
             }
         } else {
             // search from here+1 to end
-            found = _search(ac, g_list_next(ac->last_found), quote, NEXT);
+            found = _search(ac, ac->last_found + 1, quote, NEXT);
             if (found) {
                 return found;
             }
@@ -288,13 +499,13 @@ autocomplete_complete(Autocomplete ac, const gchar* search_str, gboolean quote,
 
         if (previous) {
             // search from end
-            found = _search(ac, g_list_last(ac->items), quote, PREVIOUS);
+            found = _search(ac, ac->items->len - 1, quote, PREVIOUS);
             if (found) {
                 return found;
             }
         } else {
             // search from beginning
-            found = _search(ac, ac->items, quote, NEXT);
+            found = _search(ac, 0, quote, NEXT);
             if (found) {
                 return found;
             }
@@ -369,15 +580,12 @@ autocomplete_param_no_with_func(const char* const input, char* command, int arg_
 
         // if correct number of tokens, then candidate for autocompletion of last param
         if (num_tokens == arg_number) {
-            auto_gchar gchar* start_str = get_start(input, arg_number);
-            auto_gchar gchar* comp_str = g_strdup(&input[strlen(start_str)]);
+            int start_len = get_start_len(input, arg_number);
 
             // autocomplete param
-            if (comp_str) {
-                auto_gchar gchar* found = func(comp_str, previous, context);
-                if (found) {
-                    return g_strdup_printf("%s%s", start_str, found);
-                }
+            auto_gchar gchar* found = func(&input[start_len], previous, context);
+            if (found) {
+                return g_strdup_printf("%.*s%s", start_len, input, found);
             }
         }
     }
@@ -390,45 +598,237 @@ void
 autocomplete_remove_older_than_max_reverse(Autocomplete ac, int maxsize)
 {
     if (autocomplete_length(ac) > maxsize) {
-        GList* last = g_list_last(ac->items);
-        if (last) {
-            free(last->data);
-            ac->items = g_list_delete_link(ac->items, last);
+        _remove_index(ac, ac->items->len - 1);
+    }
+}
+
+static gint
+_folded_cmp(gconstpointer a, gconstpointer b)
+{
+    const AutocompleteItem* item_a = *(AutocompleteItem* const*)a;
+    const AutocompleteItem* item_b = *(AutocompleteItem* const*)b;
+
+    return strcmp(item_a->folded, item_b->folded);
+}
+
+static void
+_prefix_invalidate(Autocomplete ac)
+{
+    if (ac->prefix_index) {
+        g_ptr_array_free(ac->prefix_index, TRUE);
+        ac->prefix_index = NULL;
+    }
+}
+
+/*
+ * Search the sorted items through the prefix index. The matches are the run
+ * of the index starting with the search string, the result is the match
+ * closest to start in the direction searched.
+ */
+static gchar*
+_prefix_search(Autocomplete ac, gint start, gboolean quote, search_direction direction)
+{
+    if (!ac->prefix_index) {
+        ac->prefix_index = g_ptr_array_sized_new(ac->items->len);
+        for (guint i = 0; i < ac->items->len; i++) {
+            g_ptr_array_add(ac->prefix_index, g_ptr_array_index(ac->items, i));
+        }
+        g_ptr_array_sort(ac->prefix_index, _folded_cmp);
+    }
+
+    guint low = 0;
+    guint high = ac->prefix_index->len;
+    while (low < high) {
+        guint mid = low + (high - low) / 2;
+        AutocompleteItem* item = g_ptr_array_index(ac->prefix_index, mid);
+        if (strcmp(item->folded, ac->search_str) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
         }
     }
+
+    const AutocompleteItem* from = g_ptr_array_index(ac->items, start);
+    AutocompleteItem* best = NULL;
+    for (guint i = low; i < ac->prefix_index->len; i++) {
+        AutocompleteItem* item = g_ptr_array_index(ac->prefix_index, i);
+        if (!g_str_has_prefix(item->folded, ac->search_str)) {
+            break;
+        }
+
+        gint cmp = strcmp(item->value, from->value);
+        if (direction == NEXT && cmp >= 0 && (!best || strcmp(item->value, best->value) < 0)) {
+            best = item;
+        } else if (direction == PREVIOUS && cmp <= 0 && (!best || strcmp(item->value, best->value) > 0)) {
+            best = item;
+        }
+    }
+
+    if (!best) {
+        return NULL;
+    }
+
+    ac->last_found = _sorted_position(ac, best->value);
+
+    return _item_result(best, quote);
 }
 
 static gchar*
-_search(Autocomplete ac, GList* curr, gboolean quote, search_direction direction)
+_search(Autocomplete ac, gint start, gboolean quote, search_direction direction)
 {
-    auto_gchar gchar* search_str_ascii = g_str_to_ascii(ac->search_str, NULL);
-    auto_gchar gchar* search_str_lower = g_ascii_strdown(search_str_ascii, -1);
+    if (start < 0 || start >= (gint)ac->items->len) {
+        return NULL;
+    }
+    if (ac->ordered) {
+        return _prefix_search(ac, start, quote, direction);
+    }
+
+    size_t search_len = strlen(ac->search_str);
+    gint step = direction == PREVIOUS ? -1 : 1;
 
-    while (curr) {
-        auto_gchar gchar* curr_ascii = g_str_to_ascii(curr->data, NULL);
-        auto_gchar gchar* curr_lower = g_ascii_strdown(curr_ascii, -1);
+    for (gint i = start; i >= 0 && i < (gint)ac->items->len; i += step) {
+        AutocompleteItem* curr = g_ptr_array_index(ac->items, i);
 
         // match found
-        if (strncmp(curr_lower, search_str_lower, strlen(search_str_lower)) == 0) {
+        if (strncmp(curr->folded, ac->search_str, search_len) == 0) {
+
+            // set position of last found
+            ac->last_found = i;
 
-            // set pointer to last found
-            ac->last_found = curr;
+            return _item_result(curr, quote);
+        }
+    }
 
-            // if contains space, quote before returning
-            if (quote && g_strrstr(curr->data, " ")) {
-                return g_strdup_printf("\"%s\"", (gchar*)curr->data);
-                // otherwise just return the string
+    return NULL;
+}
+
+static void
+_fuzzy_invalidate(Autocomplete ac)
+{
+    if (ac->fuzzy_matches) {
+        g_array_free(ac->fuzzy_matches, TRUE);
+        ac->fuzzy_matches = NULL;
+    }
+    FREE_SET_NULL(ac->fuzzy_query);
+    ac->fuzzy_pos = -1;
+}
+
+static gboolean
+_fuzzy_is_boundary(gchar c)
+{
+    return c == ' ' || c == '.' || c == '@' || c == '/' || c == '-' || c == '_';
+}
+
+/*
+ * Score folded as a subsequence match of query, -1 if it does not match.
+ * Matches at the start of the item or a word, and consecutive runs, rank
+ * higher, gaps between matched characters rank lower.
+ */
+static gint
+_fuzzy_score(const gchar* const folded, const gchar* const query)
+{
+    gint score = 0;
+    gint prev = -1;
+    const gchar* q = query;
+
+    for (gint i = 0; folded[i] != '\0' && *q != '\0'; i++) {
+        if (folded[i] != *q) {
+            continue;
+        }
+
+        score += 16;
+        if (i == 0 || _fuzzy_is_boundary(folded[i - 1])) {
+            score += 8;
+        }
+        if (prev >= 0) {
+            if (prev == i - 1) {
+                score += 12;
             } else {
-                return strdup(curr->data);
+                score -= MIN(i - prev - 1, 8);
+            }
+        }
+
+        prev = i;
+        q++;
+    }
+
+    if (*q != '\0') {
+        return -1;
+    }
+
+    return score;
+}
+
+static gint
+_fuzzy_cmp(gconstpointer a, gconstpointer b)
+{
+    const FuzzyMatch* match_a = a;
+    const FuzzyMatch* match_b = b;
+
+    if (match_a->score != match_b->score) {
+        return match_b->score - match_a->score;
+    }
+
+    return match_a->pos < match_b->pos ? -1 : 1;
+}
+
+/*
+ * Rank the items matching query. When query extends the previous query only
+ * its candidates need to be scored again, a subsequence of query is also a
+ * subsequence of every prefix of it.
+ */
+static void
+_fuzzy_narrow(Autocomplete ac, gchar* query)
+{
+    GArray* matches = g_array_new(FALSE, FALSE, sizeof(FuzzyMatch));
+
+    if (ac->fuzzy_matches && g_str_has_prefix(query, ac->fuzzy_query)) {
+        for (guint i = 0; i < ac->fuzzy_matches->len; i++) {
+            FuzzyMatch match = g_array_index(ac->fuzzy_matches, FuzzyMatch, i);
+            match.score = _fuzzy_score(match.item->folded, query);
+            if (match.score >= 0) {
+                g_array_append_val(matches, match);
             }
         }
+    } else {
+        for (guint i = 0; i < ac->items->len; i++) {
+            FuzzyMatch match = { g_ptr_array_index(ac->items, i), 0, i };
+            match.score = _fuzzy_score(match.item->folded, query);
+            if (match.score >= 0) {
+                g_array_append_val(matches, match);
+            }
+        }
+    }
+
+    g_array_sort(matches, _fuzzy_cmp);
 
-        if (direction == PREVIOUS) {
-            curr = g_list_previous(curr);
+    _fuzzy_invalidate(ac);
+    ac->fuzzy_matches = matches;
+    ac->fuzzy_query = query;
+}
+
+static gchar*
+_fuzzy_complete(Autocomplete ac, const gchar* search_str, gboolean quote, gboolean previous)
+{
+    // first search attempt
+    if (ac->fuzzy_pos < 0) {
+        _fuzzy_narrow(ac, _fold(search_str));
+        if (ac->fuzzy_matches->len == 0) {
+            return NULL;
+        }
+        ac->fuzzy_pos = 0;
+
+        // subsequent search attempt, cycle through the ranked matches
+    } else {
+        guint len = ac->fuzzy_matches->len;
+        if (previous) {
+            ac->fuzzy_pos = (ac->fuzzy_pos + len - 1) % len;
         } else {
-            curr = g_list_next(curr);
+            ac->fuzzy_pos = (ac->fuzzy_pos + 1) % len;
         }
     }
 
-    return NULL;
+    FuzzyMatch* match = &g_array_index(ac->fuzzy_matches, FuzzyMatch, ac->fuzzy_pos);
+
+    return _item_result(match->item, quote);
 }
@@ -57,6 +57,14 @@ void autocomplete_remove(Autocomplete ac, const char* const item);
 void autocomplete_remove_all(Autocomplete ac, char** items);
 void autocomplete_add_unsorted(Autocomplete ac, const char* item, const gboolean is_reversed);
 
+// defer sorting of autocomplete_add() items until the matching autocomplete_bulk_end()
+void autocomplete_bulk_begin(Autocomplete ac);
+void autocomplete_bulk_end(Autocomplete ac);
+
+// rank items containing the search string's characters in order instead of
+// matching prefixes only
+void autocomplete_set_fuzzy(gboolean enabled);
+
 // find the next item prefixed with search string
 gchar* autocomplete_complete(Autocomplete ac, const gchar* search_str, gboolean quote, gboolean previous);
 
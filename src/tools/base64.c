@@ -0,0 +1,201 @@
+/*
+ * base64.c
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2024 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <glib.h>
+
+#include "tools/base64.h"
+
+#define DECODE_PAD  0x40
+#define DECODE_SKIP 0x80
+
+static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// 6 bit value of each alphabet character, DECODE_PAD or DECODE_SKIP otherwise
+static guint8 decode_table[256];
+
+static const guint8*
+_decode_table(void)
+{
+    static gsize initialised = 0;
+
+    if (g_once_init_enter(&initialised)) {
+        memset(decode_table, DECODE_SKIP, sizeof(decode_table));
+        for (int i = 0; i < 64; i++) {
+            decode_table[(guchar)alphabet[i]] = i;
+        }
+        decode_table['='] = DECODE_PAD;
+        g_once_init_leave(&initialised, 1);
+    }
+
+    return decode_table;
+}
+
+gsize
+base64_encode_to(const guchar* data, gsize len, gchar* out)
+{
+    gchar* start = out;
+    gsize i = 0;
+
+    for (; i + 3 <= len; i += 3) {
+        guint32 v = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+        out[0] = alphabet[v >> 18];
+        out[1] = alphabet[(v >> 12) & 0x3f];
+        out[2] = alphabet[(v >> 6) & 0x3f];
+        out[3] = alphabet[v & 0x3f];
+        out += 4;
+    }
+
+    if (len - i == 1) {
+        guint32 v = data[i] << 16;
+        out[0] = alphabet[v >> 18];
+        out[1] = alphabet[(v >> 12) & 0x3f];
+        out[2] = '=';
+        out[3] = '=';
+        out += 4;
+    } else if (len - i == 2) {
+        guint32 v = (data[i] << 16) | (data[i + 1] << 8);
+        out[0] = alphabet[v >> 18];
+        out[1] = alphabet[(v >> 12) & 0x3f];
+        out[2] = alphabet[(v >> 6) & 0x3f];
+        out[3] = '=';
+        out += 4;
+    }
+    *out = '\0';
+
+    return out - start;
+}
+
+gsize
+base64_decode_to(const gchar* text, gsize len, guchar* out)
+{
+    const guint8* table = _decode_table();
+    const guchar* in = (const guchar*)text;
+    const guchar* end = in + len;
+    guchar* start = out;
+    guint32 acc = 0;
+    int groups = 0;
+
+    while (in < end) {
+        // whole quads without padding or other characters take the short way
+        while (groups == 0 && end - in >= 4) {
+            guint8 a = table[in[0]];
+            guint8 b = table[in[1]];
+            guint8 c = table[in[2]];
+            guint8 d = table[in[3]];
+            if ((a | b | c | d) & (DECODE_PAD | DECODE_SKIP)) {
+                break;
+            }
+            guint32 v = (a << 18) | (b << 12) | (c << 6) | d;
+            out[0] = v >> 16;
+            out[1] = v >> 8;
+            out[2] = v;
+            out += 3;
+            in += 4;
+        }
+        if (in == end) {
+            break;
+        }
+
+        guint8 v = table[*in++];
+        if (v == DECODE_PAD) {
+            break;
+        }
+        if (v == DECODE_SKIP) {
+            continue;
+        }
+        acc = (acc << 6) | v;
+        if (++groups == 4) {
+            out[0] = acc >> 16;
+            out[1] = acc >> 8;
+            out[2] = acc;
+            out += 3;
+            acc = 0;
+            groups = 0;
+        }
+    }
+
+    // a trailing partial quad still carries whole bytes
+    if (groups == 2) {
+        out[0] = acc >> 4;
+        out += 1;
+    } else if (groups == 3) {
+        out[0] = acc >> 10;
+        out[1] = acc >> 2;
+        out += 2;
+    }
+
+    return out - start;
+}
+
+gchar*
+base64_encode(const guchar* data, gsize len)
+{
+    gchar* out = g_malloc(BASE64_ENCODED_LEN(len) + 1);
+    base64_encode_to(data, len, out);
+    return out;
+}
+
+guchar*
+base64_decode(const gchar* text, gsize* out_len)
+{
+    g_return_val_if_fail(text != NULL, NULL);
+
+    gsize len = strlen(text);
+    guchar* out = g_malloc(BASE64_DECODED_MAX(len) + 1);
+    gsize decoded = base64_decode_to(text, len, out);
+    out[decoded] = '\0';
+    if (out_len) {
+        *out_len = decoded;
+    }
+    return out;
+}
+
+guchar*
+base64_decode_into(GByteArray* buffer, const gchar* text, gsize* out_len)
+{
+    g_return_val_if_fail(text != NULL, NULL);
+
+    gsize len = strlen(text);
+    g_byte_array_set_size(buffer, BASE64_DECODED_MAX(len));
+    gsize decoded = base64_decode_to(text, len, buffer->data);
+    g_byte_array_set_size(buffer, decoded);
+    if (out_len) {
+        *out_len = decoded;
+    }
+    return buffer->data;
+}
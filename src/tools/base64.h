@@ -0,0 +1,65 @@
+/*
+ * base64.h
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2024 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+#ifndef TOOLS_BASE64_H
+#define TOOLS_BASE64_H
+
+#include <glib.h>
+
+/*
+ * Standard base64 with padding, a drop in for g_base64_encode() and
+ * g_base64_decode() that also decodes into buffers the caller reuses.
+ * Decoding skips characters outside the alphabet, like line breaks in
+ * vCard photos, and stops at the first '='.
+ */
+
+// characters len bytes encode to, without the terminating NUL
+#define BASE64_ENCODED_LEN(len) (((len) + 2) / 3 * 4)
+// most bytes len characters decode to
+#define BASE64_DECODED_MAX(len) ((len) / 4 * 3 + 3)
+
+// out holds BASE64_ENCODED_LEN(len) + 1, returns the length written before the NUL
+gsize base64_encode_to(const guchar* data, gsize len, gchar* out);
+// out holds BASE64_DECODED_MAX(len), returns the number of bytes written
+gsize base64_decode_to(const gchar* text, gsize len, guchar* out);
+
+// free with g_free()
+gchar* base64_encode(const guchar* data, gsize len);
+guchar* base64_decode(const gchar* text, gsize* out_len);
+
+// decode into buffer, grown as needed, and return its data
+guchar* base64_decode_into(GByteArray* buffer, const gchar* text, gsize* out_len);
+
+#endif
@@ -0,0 +1,167 @@
+/*
+ * compress.c
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2024 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include "log.h"
+#include "common.h"
+#include "tools/compress.h"
+
+#define COMPRESS_SUFFIX ".gz"
+#define COMPRESS_BUFSIZE (64 * 1024)
+
+static gboolean
+_compress_file(const char* const path)
+{
+    auto_gchar gchar* target = g_strconcat(path, COMPRESS_SUFFIX, NULL);
+    auto_gchar gchar* tmpname = g_strconcat(target, ".tmp", NULL);
+    GError* error = NULL;
+    gboolean res = FALSE;
+
+    GFile* in_file = g_file_new_for_path(path);
+    GFileInputStream* in = g_file_read(in_file, NULL, &error);
+    g_object_unref(in_file);
+    if (!in) {
+        log_warning("Unable to compress %s: %s", path, error->message);
+        g_error_free(error);
+        return FALSE;
+    }
+
+    GFile* tmp_file = g_file_new_for_path(tmpname);
+    GFileOutputStream* tmp_out = g_file_replace(tmp_file, NULL, FALSE, G_FILE_CREATE_PRIVATE, NULL, &error);
+    g_object_unref(tmp_file);
+    if (!tmp_out) {
+        log_warning("Unable to compress %s: %s", path, error->message);
+        g_error_free(error);
+        g_object_unref(in);
+        return FALSE;
+    }
+
+    GZlibCompressor* compressor = g_zlib_compressor_new(G_ZLIB_COMPRESSOR_FORMAT_GZIP, -1);
+    GOutputStream* out = g_converter_output_stream_new(G_OUTPUT_STREAM(tmp_out), G_CONVERTER(compressor));
+    g_object_unref(compressor);
+    g_object_unref(tmp_out);
+
+    if (g_output_stream_splice(out, G_INPUT_STREAM(in),
+                               G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE | G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET,
+                               NULL, &error)
+        < 0) {
+        log_warning("Unable to compress %s: %s", path, error->message);
+        g_error_free(error);
+        g_unlink(tmpname);
+    } else if (g_rename(tmpname, target) != 0) {
+        log_warning("Unable to compress %s: %s", path, g_strerror(errno));
+        g_unlink(tmpname);
+    } else {
+        g_unlink(path);
+        res = TRUE;
+    }
+
+    g_object_unref(out);
+    g_object_unref(in);
+
+    return res;
+}
+
+static gpointer
+_compress_thread(gpointer data)
+{
+    gchar* path = data;
+    _compress_file(path);
+    g_free(path);
+
+    return NULL;
+}
+
+/**
+ * Replaces a finished log file by a gzip compressed copy with ".gz"
+ * appended to its name.
+ *
+ * The work happens on a thread of its own, the original is only removed
+ * once the compressed copy is complete.
+ */
+void
+compress_file_async(const char* const path)
+{
+    GThread* thread = g_thread_try_new("compress", _compress_thread, g_strdup(path), NULL);
+    if (thread) {
+        g_thread_unref(thread);
+    }
+}
+
+gboolean
+compress_is_compressed(const char* const path)
+{
+    return g_str_has_suffix(path, COMPRESS_SUFFIX);
+}
+
+/**
+ * Opens a log file for reading line by line, files ending in ".gz" are
+ * decompressed while they are read.
+ *
+ * Free the returned stream with g_object_unref().
+ */
+GDataInputStream*
+compress_open_reader(const char* const path, GError** error)
+{
+    GFile* file = g_file_new_for_path(path);
+    GFileInputStream* in = g_file_read(file, NULL, error);
+    g_object_unref(file);
+    if (!in) {
+        return NULL;
+    }
+
+    GInputStream* base = G_INPUT_STREAM(in);
+    if (compress_is_compressed(path)) {
+        GZlibDecompressor* decompressor = g_zlib_decompressor_new(G_ZLIB_COMPRESSOR_FORMAT_GZIP);
+        base = g_converter_input_stream_new(G_INPUT_STREAM(in), G_CONVERTER(decompressor));
+        g_object_unref(decompressor);
+        g_object_unref(in);
+    }
+
+    GDataInputStream* reader = g_data_input_stream_new(base);
+    g_object_unref(base);
+    g_buffered_input_stream_set_buffer_size(G_BUFFERED_INPUT_STREAM(reader), COMPRESS_BUFSIZE);
+    g_data_input_stream_set_newline_type(reader, G_DATA_STREAM_NEWLINE_TYPE_LF);
+
+    return reader;
+}
@@ -0,0 +1,334 @@
+/*
+ * control.c
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2024 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "log.h"
+#include "common.h"
+#include "profanity.h"
+#include "command/cmd_funcs.h"
+#include "ui/window_list.h"
+#include "tools/control.h"
+
+// Control socket of --headless: each line a client writes is run as if it
+// was typed, events go to every client as one JSON object per line.
+
+#define CONTROL_BACKLOG 8
+
+typedef struct control_client_t
+{
+    GIOChannel* channel;
+    guint source;
+} ControlClient;
+
+static int listen_fd = -1;
+static guint listen_source = 0;
+static gchar* control_path = NULL;
+static GSList* clients = NULL;
+
+static void
+_control_client_free(ControlClient* client)
+{
+    if (client->source) {
+        g_source_remove(client->source);
+    }
+    g_io_channel_shutdown(client->channel, FALSE, NULL);
+    g_io_channel_unref(client->channel);
+    g_free(client);
+}
+
+static void
+_control_client_drop(ControlClient* client)
+{
+    clients = g_slist_remove(clients, client);
+    _control_client_free(client);
+}
+
+static gboolean
+_control_send(ControlClient* client, const GString* const line)
+{
+    int fd = g_io_channel_unix_get_fd(client->channel);
+    gsize sent = 0;
+    while (sent < line->len) {
+        ssize_t res = send(fd, line->str + sent, line->len - sent, MSG_NOSIGNAL);
+        if (res < 0 && errno == EINTR) {
+            continue;
+        }
+        if (res < 0) {
+            // a client that doesn't keep up is dropped rather than stalling the loop
+            log_warning("Control client dropped: %s", strerror(errno));
+            return FALSE;
+        }
+        sent += res;
+    }
+
+    return TRUE;
+}
+
+static void
+_control_json_string(GString* out, const char* const str)
+{
+    if (!str) {
+        g_string_append(out, "null");
+        return;
+    }
+
+    g_string_append_c(out, '"');
+    for (const char* c = str; *c; c++) {
+        switch (*c) {
+        case '"':
+            g_string_append(out, "\\\"");
+            break;
+        case '\\':
+            g_string_append(out, "\\\\");
+            break;
+        case '\n':
+            g_string_append(out, "\\n");
+            break;
+        case '\r':
+            g_string_append(out, "\\r");
+            break;
+        case '\t':
+            g_string_append(out, "\\t");
+            break;
+        default:
+            if ((unsigned char)*c < 0x20) {
+                g_string_append_printf(out, "\\u%04x", (unsigned char)*c);
+            } else {
+                g_string_append_c(out, *c);
+            }
+            break;
+        }
+    }
+    g_string_append_c(out, '"');
+}
+
+// {"event":"<event>","<key>":"<value>",...} terminated by a newline
+static GString*
+_control_format(const char* const event, va_list args)
+{
+    GString* line = g_string_new("{\"event\":");
+    _control_json_string(line, event);
+
+    const char* key;
+    while ((key = va_arg(args, const char*))) {
+        const char* value = va_arg(args, const char*);
+        g_string_append_c(line, ',');
+        _control_json_string(line, key);
+        g_string_append_c(line, ':');
+        _control_json_string(line, value);
+    }
+    g_string_append(line, "}\n");
+
+    return line;
+}
+
+static void
+_control_reply(ControlClient* client, const char* const event, ...)
+{
+    va_list args;
+    va_start(args, event);
+    GString* line = _control_format(event, args);
+    va_end(args);
+
+    if (!_control_send(client, line)) {
+        _control_client_drop(client);
+    }
+    g_string_free(line, TRUE);
+}
+
+// key value pairs of strings after the event name, NULL values become null
+void
+control_event(const char* const event, ...)
+{
+    if (!clients) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, event);
+    GString* line = _control_format(event, args);
+    va_end(args);
+
+    GSList* curr = clients;
+    while (curr) {
+        ControlClient* client = curr->data;
+        curr = g_slist_next(curr);
+        if (!_control_send(client, line)) {
+            _control_client_drop(client);
+        }
+    }
+    g_string_free(line, TRUE);
+}
+
+static gboolean
+_control_client_cb(GIOChannel* source, GIOCondition condition, gpointer data)
+{
+    ControlClient* client = data;
+
+    // the channel buffers, read every complete line before waiting again
+    GIOStatus status = G_IO_STATUS_NORMAL;
+    while (status == G_IO_STATUS_NORMAL) {
+        gchar* line = NULL;
+        status = g_io_channel_read_line(source, &line, NULL, NULL, NULL);
+        if (status != G_IO_STATUS_NORMAL || !line) {
+            g_free(line);
+            break;
+        }
+
+        g_strchomp(line);
+        if (line[0] != '\0') {
+            gboolean running = cmd_process_input(wins_get_current(), line);
+            // events sent by the command may have dropped the client
+            if (g_slist_find(clients, client)) {
+                _control_reply(client, "command", "line", line, NULL);
+            }
+            if (!running) {
+                g_free(line);
+                g_main_loop_quit(mainloop);
+                return TRUE;
+            }
+        }
+        g_free(line);
+
+        if (!g_slist_find(clients, client)) {
+            return FALSE;
+        }
+    }
+
+    if (status == G_IO_STATUS_EOF || status == G_IO_STATUS_ERROR) {
+        client->source = 0;
+        _control_client_drop(client);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static gboolean
+_control_accept_cb(GIOChannel* source, GIOCondition condition, gpointer data)
+{
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) {
+        log_warning("Control socket accept failed: %s", strerror(errno));
+        return TRUE;
+    }
+
+    ControlClient* client = g_new0(ControlClient, 1);
+    client->channel = g_io_channel_unix_new(fd);
+    g_io_channel_set_close_on_unref(client->channel, TRUE);
+    g_io_channel_set_encoding(client->channel, NULL, NULL);
+    g_io_channel_set_flags(client->channel, G_IO_FLAG_NONBLOCK, NULL);
+    client->source = g_io_add_watch(client->channel, G_IO_IN | G_IO_HUP | G_IO_ERR, _control_client_cb, client);
+    clients = g_slist_prepend(clients, client);
+    log_info("Control client connected");
+
+    return TRUE;
+}
+
+gboolean
+control_init(const char* const path)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        log_error("Control socket path too long: %s", path);
+        return FALSE;
+    }
+    g_strlcpy(addr.sun_path, path, sizeof(addr.sun_path));
+
+    // a socket left behind by an instance that didn't shut down cleanly
+    GStatBuf st;
+    if (g_lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        g_unlink(path);
+    }
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        log_error("Unable to create control socket: %s", strerror(errno));
+        return FALSE;
+    }
+
+    mode_t old_umask = umask(S_IRWXG | S_IRWXO);
+    int res = bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr));
+    umask(old_umask);
+    if (res < 0 || listen(listen_fd, CONTROL_BACKLOG) < 0) {
+        log_error("Unable to listen on control socket %s: %s", path, strerror(errno));
+        close(listen_fd);
+        listen_fd = -1;
+        return FALSE;
+    }
+
+    control_path = g_strdup(path);
+    GIOChannel* channel = g_io_channel_unix_new(listen_fd);
+    listen_source = g_io_add_watch(channel, G_IO_IN, _control_accept_cb, NULL);
+    g_io_channel_unref(channel);
+    log_info("Listening for commands on %s", path);
+
+    return TRUE;
+}
+
+void
+control_close(void)
+{
+    g_slist_free_full(clients, (GDestroyNotify)_control_client_free);
+    clients = NULL;
+
+    if (listen_source) {
+        g_source_remove(listen_source);
+        listen_source = 0;
+    }
+    if (listen_fd >= 0) {
+        close(listen_fd);
+        listen_fd = -1;
+    }
+    if (control_path) {
+        g_unlink(control_path);
+        g_free(control_path);
+        control_path = NULL;
+    }
+}
@@ -39,10 +39,229 @@
 #include <stdio.h>
 #include <string.h>
 #include <gio/gio.h>
+#include <curl/curl.h>
 
+#include "common.h"
+#include "config/cafile.h"
+#include "config/preferences.h"
 #include "tools/http_common.h"
+#include "ui/ui.h"
+#include "ui/window_list.h"
+#include "xmpp/xmpp.h"
 
-#define FALLBACK_MSG ""
+// Transfers to the same host beyond this wait for a free slot.
+#define HTTP_TRANSFERS_PER_HOST 4
+// Progress is shown at most this often per transfer.
+#define HTTP_PROGRESS_INTERVAL_USEC (250 * 1000)
+
+static GMutex transfers_lock;
+static GCond transfers_cond;
+static GHashTable* transfers_per_host = NULL;
+
+static CURLSH* transfers_share = NULL;
+static GMutex share_locks[CURL_LOCK_DATA_LAST];
+
+static void
+_share_lock(CURL* handle, curl_lock_data data, curl_lock_access access, void* userptr)
+{
+    g_mutex_lock(&share_locks[data]);
+}
+
+static void
+_share_unlock(CURL* handle, curl_lock_data data, void* userptr)
+{
+    g_mutex_unlock(&share_locks[data]);
+}
+
+static gpointer
+_transfers_init(gpointer data)
+{
+    // curl_global_init() is not thread safe, run it once and never clean up
+    // while transfers may still be running.
+    curl_global_init(CURL_GLOBAL_ALL);
+
+    transfers_per_host = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+    transfers_share = curl_share_init();
+    curl_share_setopt(transfers_share, CURLSHOPT_LOCKFUNC, _share_lock);
+    curl_share_setopt(transfers_share, CURLSHOPT_UNLOCKFUNC, _share_unlock);
+    curl_share_setopt(transfers_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(transfers_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    curl_share_setopt(transfers_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+
+    return NULL;
+}
+
+static char*
+_transfer_host(const char* const url)
+{
+    char* host = NULL;
+    CURLU* h = curl_url();
+    if (h && curl_url_set(h, CURLUPART_URL, url, 0) == CURLUE_OK) {
+        char* part = NULL;
+        if (curl_url_get(h, CURLUPART_HOST, &part, 0) == CURLUE_OK) {
+            host = g_strdup(part);
+            curl_free(part);
+        }
+    }
+    curl_url_cleanup(h);
+
+    return host ? host : g_strdup("");
+}
+
+char*
+http_transfer_begin(const char* const url)
+{
+    static GOnce init_once = G_ONCE_INIT;
+    g_once(&init_once, _transfers_init, NULL);
+
+    char* host = _transfer_host(url);
+
+    g_mutex_lock(&transfers_lock);
+    while (GPOINTER_TO_UINT(g_hash_table_lookup(transfers_per_host, host)) >= HTTP_TRANSFERS_PER_HOST) {
+        g_cond_wait(&transfers_cond, &transfers_lock);
+    }
+    guint running = GPOINTER_TO_UINT(g_hash_table_lookup(transfers_per_host, host));
+    g_hash_table_insert(transfers_per_host, g_strdup(host), GUINT_TO_POINTER(running + 1));
+    g_mutex_unlock(&transfers_lock);
+
+    return host;
+}
+
+void
+http_transfer_setup(CURL* curl)
+{
+    // Reuse connections, TLS sessions and DNS lookups of earlier transfers
+    curl_easy_setopt(curl, CURLOPT_SHARE, transfers_share);
+    curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+}
+
+void
+http_transfer_end(char* host)
+{
+    g_mutex_lock(&transfers_lock);
+    guint running = GPOINTER_TO_UINT(g_hash_table_lookup(transfers_per_host, host));
+    if (running > 1) {
+        g_hash_table_insert(transfers_per_host, g_strdup(host), GUINT_TO_POINTER(running - 1));
+    } else {
+        g_hash_table_remove(transfers_per_host, host);
+    }
+    g_cond_broadcast(&transfers_cond);
+    g_mutex_unlock(&transfers_lock);
+
+    g_free(host);
+}
+
+gboolean
+http_progress_due(gint64* last_update, curl_off_t now, curl_off_t total)
+{
+    gint64 time = g_get_monotonic_time();
+    if ((total > 0 && now >= total) || time - *last_update >= HTTP_PROGRESS_INTERVAL_USEC) {
+        *last_update = time;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+void
+http_tls_load(HTTPTls* tls)
+{
+    tls->cafile = cafile_get_name();
+    tls->cert_path = prefs_get_string(PREF_TLS_CERTPATH);
+    tls->insecure = FALSE;
+    const ProfAccount* account = accounts_peek_account(session_get_account_name());
+    if (account) {
+        tls->insecure = account->tls_policy && strcmp(account->tls_policy, "trust") == 0;
+    }
+}
+
+void
+http_tls_apply(CURL* curl, const HTTPTls* tls)
+{
+    if (tls->cafile) {
+        curl_easy_setopt(curl, CURLOPT_CAINFO, tls->cafile);
+    }
+    if (tls->cert_path) {
+        curl_easy_setopt(curl, CURLOPT_CAPATH, tls->cert_path);
+    }
+    if (tls->insecure) {
+        curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
+        curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
+    }
+}
+
+void
+http_tls_clear(HTTPTls* tls)
+{
+    g_free(tls->cafile);
+    tls->cafile = NULL;
+    g_free(tls->cert_path);
+    tls->cert_path = NULL;
+}
+
+typedef enum {
+    HTTP_TRANSFER_PRINT,
+    HTTP_TRANSFER_UPDATE,
+    HTTP_TRANSFER_DONE,
+} http_transfer_event_t;
+
+typedef struct http_transfer_msg_t
+{
+    http_transfer_event_t event;
+    ProfWin* window;
+    char* id;
+    gchar* msg;
+} HTTPTransferMsg;
+
+static gboolean
+_transfer_msg_cb(gpointer data)
+{
+    HTTPTransferMsg* transfer = data;
+
+    // the window may have been closed while the transfer was running
+    if (wins_get_num(transfer->window) == -1) {
+        return G_SOURCE_REMOVE;
+    }
+
+    switch (transfer->event) {
+    case HTTP_TRANSFER_PRINT:
+        win_print_http_transfer(transfer->window, transfer->msg, transfer->id);
+        break;
+    case HTTP_TRANSFER_UPDATE:
+        if (transfer->window->type != WIN_CONSOLE) {
+            win_update_entry_message(transfer->window, transfer->id, transfer->msg);
+        } else {
+            cons_show("%s", transfer->msg);
+        }
+        break;
+    case HTTP_TRANSFER_DONE:
+        win_mark_received(transfer->window, transfer->id);
+        break;
+    }
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+_transfer_msg_free(gpointer data)
+{
+    HTTPTransferMsg* transfer = data;
+    g_free(transfer->id);
+    g_free(transfer->msg);
+    g_free(transfer);
+}
+
+static void
+_transfer_msg_post(http_transfer_event_t event, ProfWin* window, char* id, gchar* msg)
+{
+    HTTPTransferMsg* transfer = g_new(HTTPTransferMsg, 1);
+    transfer->event = event;
+    transfer->window = window;
+    transfer->id = g_strdup(id);
+    transfer->msg = msg;
+
+    run_on_main_thread(_transfer_msg_cb, transfer, _transfer_msg_free);
+}
 
 void
 http_print_transfer_update(ProfWin* window, char* id, const char* fmt, ...)
@@ -50,17 +269,10 @@ http_print_transfer_update(ProfWin* window, char* id, const char* fmt, ...)
     va_list args;
 
     va_start(args, fmt);
-    GString* msg = g_string_new(FALLBACK_MSG);
-    g_string_vprintf(msg, fmt, args);
+    gchar* msg = g_strdup_vprintf(fmt, args);
     va_end(args);
 
-    if (window->type != WIN_CONSOLE) {
-        win_update_entry_message(window, id, msg->str);
-    } else {
-        cons_show("%s", msg->str);
-    }
-
-    g_string_free(msg, TRUE);
+    _transfer_msg_post(HTTP_TRANSFER_UPDATE, window, id, msg);
 }
 
 void
@@ -69,11 +281,14 @@ http_print_transfer(ProfWin* window, char* id, const char* fmt, ...)
     va_list args;
 
     va_start(args, fmt);
-    GString* msg = g_string_new(FALLBACK_MSG);
-    g_string_vprintf(msg, fmt, args);
+    gchar* msg = g_strdup_vprintf(fmt, args);
     va_end(args);
 
-    win_print_http_transfer(window, msg->str, id);
+    _transfer_msg_post(HTTP_TRANSFER_PRINT, window, id, msg);
+}
 
-    g_string_free(msg, TRUE);
+void
+http_mark_transfer_done(ProfWin* window, char* id)
+{
+    _transfer_msg_post(HTTP_TRANSFER_DONE, window, id, NULL);
 }
@@ -36,9 +36,35 @@
 #ifndef TOOLS_HTTP_COMMON_H
 #define TOOLS_HTTP_COMMON_H
 
+#include <curl/curl.h>
+
 #include "ui/window.h"
 
+// TLS settings of the account a transfer runs for, read on the main thread
+// before the transfer's thread starts
+typedef struct http_tls_t
+{
+    gchar* cafile;
+    gchar* cert_path;
+    gboolean insecure;
+} HTTPTls;
+
+void http_tls_load(HTTPTls* tls);
+void http_tls_apply(CURL* curl, const HTTPTls* tls);
+void http_tls_clear(HTTPTls* tls);
+
+// safe to call from transfer threads, the window is updated by the main thread
 void http_print_transfer(ProfWin* window, char* id, const char* fmt, ...);
 void http_print_transfer_update(ProfWin* window, char* id, const char* fmt, ...);
+void http_mark_transfer_done(ProfWin* window, char* id);
+
+/*
+ * Waits for a free transfer slot to the host of url, returns the host to be
+ * passed to http_transfer_end() once the transfer is over.
+ */
+char* http_transfer_begin(const char* const url);
+void http_transfer_setup(CURL* curl);
+void http_transfer_end(char* host);
+gboolean http_progress_due(gint64* last_update, curl_off_t now, curl_off_t total);
 
 #endif
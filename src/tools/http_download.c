@@ -47,33 +47,95 @@
 #include <pthread.h>
 #include <assert.h>
 #include <errno.h>
+#include <limits.h>
+#include <glib/gstdio.h>
 
 #include "profanity.h"
 #include "event/client_events.h"
 #include "tools/http_download.h"
 #include "config/cafile.h"
+#include "config/files.h"
 #include "config/preferences.h"
+#include "log.h"
 #include "ui/ui.h"
 #include "ui/window.h"
 #include "common.h"
 
+#ifdef HAVE_OMEMO
+#include "omemo/crypto.h"
+#endif
+
+#define DOWNLOAD_RESUME_ATTEMPTS 3
+#define DOWNLOAD_STALL_TIMEOUT    60L
+
+// downloaded files kept to be revalidated instead of fetched again, the least
+// recently used go once all of them take up more than this
+#define DOWNLOAD_CACHE_MAX_BYTES (256 * 1024 * 1024)
+#define DOWNLOAD_CACHE_META      "download"
+
 GSList* download_processes = NULL;
-gboolean silent = FALSE;
+
+// cache files are copied from worker threads
+G_LOCK_DEFINE_STATIC(download_cache);
+
+typedef struct download_cache_entry_t
+{
+    gchar* path;
+    goffset size;
+    gint64 mtime;
+} DownloadCacheEntry;
+
+static gboolean
+_download_resumable(CURLcode res)
+{
+    switch (res) {
+    case CURLE_PARTIAL_FILE:
+    case CURLE_RECV_ERROR:
+    case CURLE_OPERATION_TIMEDOUT:
+    case CURLE_GOT_NOTHING:
+    case CURLE_HTTP2_STREAM:
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
+
+// bandwidth cap in KiB/s, 0 when unlimited
+static int
+_download_limit(void)
+{
+    auto_gchar gchar* limit_str = prefs_get_string(PREF_URL_DOWNLOAD_LIMIT);
+    int limit = 0;
+    auto_char char* err_msg = NULL;
+
+    if (limit_str && !strtoi_range(limit_str, &limit, 0, INT_MAX, &err_msg)) {
+        return 0;
+    }
+
+    return limit;
+}
 
 static int
 _xferinfo(void* userdata, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow)
 {
     HTTPDownload* download = (HTTPDownload*)userdata;
 
-    pthread_mutex_lock(&lock);
+    // after a resume curl only reports the remainder of the body
+    dlnow += download->resume_from;
+    if (dltotal != 0) {
+        dltotal += download->resume_from;
+    }
 
-    if (download->cancel) {
-        pthread_mutex_unlock(&lock);
+    if (g_atomic_int_get(&download->cancel)) {
         return 1;
     }
 
+    // keep main loop wakeups and redraws down on fast transfers
+    if (!http_progress_due(&download->progress_time, dlnow, dltotal)) {
+        return 0;
+    }
+
     if (download->bytes_received == dlnow) {
-        pthread_mutex_unlock(&lock);
         return 0;
     } else {
         download->bytes_received = dlnow;
@@ -84,15 +146,86 @@ _xferinfo(void* userdata, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultot
         dlperc = (100 * dlnow) / dltotal;
     }
 
-    if (!silent)
+    if (!download->silent)
         http_print_transfer_update(download->window, download->url,
                                    "Downloading '%s': %d%%", download->url, dlperc);
 
-    pthread_mutex_unlock(&lock);
-
     return 0;
 }
 
+struct write_data_t
+{
+#ifdef HAVE_OMEMO
+    struct aes256gcm_stream_t* stream;
+#endif
+    FILE* outfh;
+    curl_off_t written;
+};
+
+static size_t
+_write_callback(char* ptr, size_t size, size_t nmemb, void* userdata)
+{
+    struct write_data_t* data = (struct write_data_t*)userdata;
+    size_t realsize = size * nmemb;
+
+#ifdef HAVE_OMEMO
+    if (data->stream) {
+        if (aes256gcm_stream_write(data->stream, data->outfh, (unsigned char*)ptr, realsize) != GPG_ERR_NO_ERROR) {
+            return 0;
+        }
+        data->written += realsize;
+        return realsize;
+    }
+#endif
+
+    size_t written = fwrite(ptr, 1, realsize, data->outfh);
+    data->written += written;
+
+    return written;
+}
+
+// validators of the last response, a redirect or resume starts a new one
+struct header_data_t
+{
+    char* etag;
+    char* last_modified;
+};
+
+static char*
+_header_value(const char* const line, size_t len, const char* const name)
+{
+    size_t name_len = strlen(name);
+    if (len <= name_len || g_ascii_strncasecmp(line, name, name_len) != 0) {
+        return NULL;
+    }
+    return g_strstrip(g_strndup(line + name_len, len - name_len));
+}
+
+static size_t
+_header_callback(char* buffer, size_t size, size_t nitems, void* userdata)
+{
+    struct header_data_t* data = (struct header_data_t*)userdata;
+    size_t len = size * nitems;
+
+    if (len > 5 && strncmp(buffer, "HTTP/", 5) == 0) {
+        g_free(data->etag);
+        g_free(data->last_modified);
+        data->etag = NULL;
+        data->last_modified = NULL;
+    } else {
+        char* value;
+        if ((value = _header_value(buffer, len, "ETag:"))) {
+            g_free(data->etag);
+            data->etag = value;
+        } else if ((value = _header_value(buffer, len, "Last-Modified:"))) {
+            g_free(data->last_modified);
+            data->last_modified = value;
+        }
+    }
+
+    return len;
+}
+
 #if LIBCURL_VERSION_NUM < 0x072000
 static int
 _older_progress(void* p, double dltotal, double dlnow, double ultotal, double ulnow)
@@ -101,6 +234,178 @@ _older_progress(void* p, double dltotal, double dlnow, double ultotal, double ul
 }
 #endif
 
+gchar*
+http_download_cache_key(const char* const url)
+{
+    return url ? g_compute_checksum_for_string(G_CHECKSUM_SHA256, url, -1) : NULL;
+}
+
+static gchar*
+_download_cache_file(const char* const key, const char* const suffix)
+{
+    auto_gchar gchar* dir = files_get_data_path(DIR_URLCACHE);
+    if (g_mkdir_with_parents(dir, S_IRWXU) != 0) {
+        log_warning("[HTTP] Unable to create download cache at %s: %s", dir, g_strerror(errno));
+        return NULL;
+    }
+    return g_strdup_printf("%s/%s%s", dir, key, suffix);
+}
+
+static gboolean
+_download_cache_copy(const char* const from, const char* const to)
+{
+    GFile* source = g_file_new_for_path(from);
+    GFile* dest = g_file_new_for_path(to);
+    GError* error = NULL;
+    gboolean copied = g_file_copy(source, dest, G_FILE_COPY_OVERWRITE, NULL, NULL, NULL, &error);
+    if (!copied) {
+        log_warning("[HTTP] Unable to copy %s to %s: %s", from, to, error->message);
+        g_error_free(error);
+    }
+    g_object_unref(source);
+    g_object_unref(dest);
+    return copied;
+}
+
+static gint
+_download_cache_cmp_mtime(gconstpointer a, gconstpointer b)
+{
+    const DownloadCacheEntry* entry_a = a;
+    const DownloadCacheEntry* entry_b = b;
+    return (entry_a->mtime > entry_b->mtime) - (entry_a->mtime < entry_b->mtime);
+}
+
+static void
+_download_cache_entry_free(DownloadCacheEntry* entry)
+{
+    g_free(entry->path);
+    g_free(entry);
+}
+
+// call with the cache locked
+static void
+_download_cache_prune(void)
+{
+    auto_gchar gchar* dir_path = files_get_data_path(DIR_URLCACHE);
+    GDir* dir = g_dir_open(dir_path, 0, NULL);
+    if (!dir) {
+        return;
+    }
+
+    GSList* entries = NULL;
+    goffset total = 0;
+    const gchar* name;
+    while ((name = g_dir_read_name(dir))) {
+        GStatBuf st;
+        gchar* path = g_build_filename(dir_path, name, NULL);
+        if (g_str_has_suffix(name, ".meta") || g_stat(path, &st) != 0) {
+            g_free(path);
+            continue;
+        }
+        DownloadCacheEntry* entry = g_new(DownloadCacheEntry, 1);
+        entry->path = path;
+        entry->size = st.st_size;
+        entry->mtime = st.st_mtime;
+        entries = g_slist_prepend(entries, entry);
+        total += st.st_size;
+    }
+    g_dir_close(dir);
+
+    entries = g_slist_sort(entries, _download_cache_cmp_mtime);
+    for (GSList* curr = entries; curr && total > DOWNLOAD_CACHE_MAX_BYTES; curr = g_slist_next(curr)) {
+        DownloadCacheEntry* entry = curr->data;
+        auto_gchar gchar* meta = g_strdup_printf("%s.meta", entry->path);
+        g_unlink(entry->path);
+        g_unlink(meta);
+        total -= entry->size;
+    }
+    g_slist_free_full(entries, (GDestroyNotify)_download_cache_entry_free);
+}
+
+// TRUE if the cache has the URL with something to revalidate it with
+static gboolean
+_download_cache_validators(const char* const key, gchar** etag, gchar** last_modified)
+{
+    auto_gchar gchar* body = _download_cache_file(key, "");
+    auto_gchar gchar* meta = _download_cache_file(key, ".meta");
+    if (!body || !meta) {
+        return FALSE;
+    }
+
+    G_LOCK(download_cache);
+    GKeyFile* keyfile = g_key_file_new();
+    if (g_file_test(body, G_FILE_TEST_EXISTS) && g_key_file_load_from_file(keyfile, meta, G_KEY_FILE_NONE, NULL)) {
+        *etag = g_key_file_get_string(keyfile, DOWNLOAD_CACHE_META, "etag", NULL);
+        *last_modified = g_key_file_get_string(keyfile, DOWNLOAD_CACHE_META, "last_modified", NULL);
+    }
+    g_key_file_free(keyfile);
+    G_UNLOCK(download_cache);
+
+    return *etag || *last_modified;
+}
+
+/*
+ * Copy the cached download of a URL to filename.
+ *
+ * @return TRUE if the cache had it.
+ */
+gboolean
+http_download_cache_restore(const char* const key, const char* const filename)
+{
+    auto_gchar gchar* body = key ? _download_cache_file(key, "") : NULL;
+    if (!body) {
+        return FALSE;
+    }
+
+    G_LOCK(download_cache);
+    gboolean restored = g_file_test(body, G_FILE_TEST_EXISTS) && _download_cache_copy(body, filename);
+    if (restored) {
+        // the oldest modification time goes first when the cache is full
+        g_utime(body, NULL);
+    }
+    G_UNLOCK(download_cache);
+
+    return restored;
+}
+
+/*
+ * Keep a copy of the download saved at filename, with the ETag and
+ * Last-Modified it came with, NULL if there are none.
+ */
+void
+http_download_cache_store(const char* const key, const char* const filename,
+                          const char* const etag, const char* const last_modified)
+{
+    GStatBuf st;
+    if (!key || g_stat(filename, &st) != 0 || st.st_size > DOWNLOAD_CACHE_MAX_BYTES / 4) {
+        return;
+    }
+    auto_gchar gchar* body = _download_cache_file(key, "");
+    auto_gchar gchar* meta = _download_cache_file(key, ".meta");
+    if (!body || !meta) {
+        return;
+    }
+
+    G_LOCK(download_cache);
+    if (_download_cache_copy(filename, body)) {
+        GKeyFile* keyfile = g_key_file_new();
+        if (etag) {
+            g_key_file_set_string(keyfile, DOWNLOAD_CACHE_META, "etag", etag);
+        }
+        if (last_modified) {
+            g_key_file_set_string(keyfile, DOWNLOAD_CACHE_META, "last_modified", last_modified);
+        }
+        GError* error = NULL;
+        if (!g_key_file_save_to_file(keyfile, meta, &error)) {
+            log_warning("[HTTP] Unable to save %s: %s", meta, error->message);
+            g_error_free(error);
+        }
+        g_key_file_free(keyfile);
+        _download_cache_prune();
+    }
+    G_UNLOCK(download_cache);
+}
+
 void*
 http_file_get(void* userdata)
 {
@@ -110,13 +415,13 @@ http_file_get(void* userdata)
 
     CURL* curl;
     CURLcode res;
-    silent = download->silent;
+    long http_code = 0;
+    struct curl_slist* headers = NULL;
+    struct header_data_t header_data = { NULL, NULL };
+    gchar* cache_etag = NULL;
+    gchar* cache_modified = NULL;
 
-    download->cancel = 0;
-    download->bytes_received = 0;
-
-    pthread_mutex_lock(&lock);
-    if (!silent) {
+    if (!download->silent) {
         http_print_transfer(download->window, download->id,
                             "Downloading '%s': 0%%", download->url);
     }
@@ -131,18 +436,9 @@ http_file_get(void* userdata)
         goto out;
     }
 
-    gchar* cert_path = prefs_get_string(PREF_TLS_CERTPATH);
-    gchar* cafile = cafile_get_name();
-    ProfAccount* account = accounts_get_account(session_get_account_name());
-    gboolean insecure = FALSE;
-    if (account) {
-        insecure = account->tls_policy && strcmp(account->tls_policy, "trust") == 0;
-    }
-    account_free(account);
-    pthread_mutex_unlock(&lock);
-
-    curl_global_init(CURL_GLOBAL_ALL);
+    char* host = http_transfer_begin(download->url);
     curl = curl_easy_init();
+    http_transfer_setup(curl);
 
     curl_easy_setopt(curl, CURLOPT_URL, download->url);
 
@@ -155,43 +451,96 @@ http_file_get(void* userdata)
 #endif
     curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
 
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void*)outfh);
+    struct write_data_t write_data = {
+#ifdef HAVE_OMEMO
+        .stream = download->decrypt_stream,
+#endif
+        .outfh = outfh,
+        .written = 0,
+    };
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, _write_callback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void*)&write_data);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, _header_callback);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, (void*)&header_data);
+
+    // a copy in the cache only needs the server to confirm it is current
+    gboolean cached = download->cache_key && _download_cache_validators(download->cache_key, &cache_etag, &cache_modified);
+    if (cached) {
+        if (cache_etag) {
+            auto_gchar gchar* header = g_strdup_printf("If-None-Match: %s", cache_etag);
+            headers = curl_slist_append(headers, header);
+        }
+        if (cache_modified) {
+            auto_gchar gchar* header = g_strdup_printf("If-Modified-Since: %s", cache_modified);
+            headers = curl_slist_append(headers, header);
+        }
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    }
+
+    if (download->limit > 0) {
+        curl_easy_setopt(curl, CURLOPT_MAX_RECV_SPEED_LARGE, (curl_off_t)download->limit * 1024);
+    }
+    // treat a stalled connection like a dropped one so it gets resumed
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, DOWNLOAD_STALL_TIMEOUT);
 
     curl_easy_setopt(curl, CURLOPT_USERAGENT, "profanity");
 
     curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
 
-    if (cafile) {
-        curl_easy_setopt(curl, CURLOPT_CAINFO, cafile);
-    }
-    if (cert_path) {
-        curl_easy_setopt(curl, CURLOPT_CAPATH, cert_path);
-    }
-    if (insecure) {
-        curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
-        curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
-    }
+    http_tls_apply(curl, &download->tls);
 
-    if ((res = curl_easy_perform(curl)) != CURLE_OK) {
+    // pick up where the body stopped after transient network errors, the
+    // decrypt stream only ever sees every byte once and in order
+    int attempt = 0;
+    while ((res = curl_easy_perform(curl)) != CURLE_OK) {
+        if (g_atomic_int_get(&download->cancel) || !_download_resumable(res) || attempt >= DOWNLOAD_RESUME_ATTEMPTS) {
+            break;
+        }
+        if (write_data.written == download->resume_from) {
+            // no progress since the last attempt
+            attempt++;
+        } else {
+            attempt = 0;
+        }
+        download->resume_from = write_data.written;
+        log_debug("[HTTP] Resuming download of %s at byte %" CURL_FORMAT_CURL_OFF_T ": %s",
+                  download->url, download->resume_from, curl_easy_strerror(res));
+        g_usleep((gulong)attempt * G_USEC_PER_SEC);
+        curl_easy_setopt(curl, CURLOPT_RESUME_FROM_LARGE, download->resume_from);
+    }
+    if (res != CURLE_OK) {
         err = strdup(curl_easy_strerror(res));
     }
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+    gboolean not_modified = !err && cached && http_code == 304;
 
-    if (ftell(outfh) == 0) {
+    if (!not_modified && ftell(outfh) == 0) {
         err = strdup("Output file is empty.");
     }
 
     curl_easy_cleanup(curl);
-    curl_global_cleanup();
+    http_transfer_end(host);
+    curl_slist_free_all(headers);
 
     if (fclose(outfh) == EOF) {
         err = strdup(g_strerror(errno));
     }
 
-    pthread_mutex_lock(&lock);
-    g_free(cafile);
-    g_free(cert_path);
+    if (!err && not_modified) {
+        log_debug("[HTTP] %s is not modified, using the cached copy", download->url);
+        if (!http_download_cache_restore(download->cache_key, download->filename)) {
+            err = strdup("Unable to copy the cached download.");
+        }
+    } else if (!err && download->cache_key && (http_code == 200 || http_code == 206)
+               && (header_data.etag || header_data.last_modified)
+               && !g_atomic_int_get(&download->cancel)) {
+        http_download_cache_store(download->cache_key, download->filename, header_data.etag, header_data.last_modified);
+    }
+
+    gboolean cancel = g_atomic_int_get(&download->cancel);
     if (err) {
-        if (download->cancel) {
+        if (cancel) {
             http_print_transfer_update(download->window, download->id,
                                        "Downloading '%s' failed: "
                                        "Download was canceled",
@@ -203,11 +552,11 @@ http_file_get(void* userdata)
         }
         free(err);
     } else {
-        if (!download->cancel && !silent) {
+        if (!cancel && !download->silent) {
             http_print_transfer_update(download->window, download->id,
                                        "Downloading '%s': done\nSaved to '%s'",
                                        download->url, download->filename);
-            win_mark_received(download->window, download->id);
+            http_mark_transfer_done(download->window, download->id);
         }
     }
 
@@ -232,16 +581,37 @@ http_file_get(void* userdata)
     }
 
 out:
+    g_free(header_data.etag);
+    g_free(header_data.last_modified);
+    g_free(cache_etag);
+    g_free(cache_modified);
+    http_download_done(download);
+
+    return NULL;
+}
+
+static gboolean
+_http_download_done_cb(gpointer data)
+{
+    HTTPDownload* download = data;
 
     download_processes = g_slist_remove(download_processes, download);
-    pthread_mutex_unlock(&lock);
 
     free(download->id);
     free(download->url);
     free(download->filename);
+    g_free(download->cache_key);
+    http_tls_clear(&download->tls);
     free(download);
 
-    return NULL;
+    return G_SOURCE_REMOVE;
+}
+
+// hands a download that is over back to the main thread, which frees it
+void
+http_download_done(HTTPDownload* download)
+{
+    run_on_main_thread(_http_download_done_cb, download, NULL);
 }
 
 void
@@ -251,15 +621,24 @@ http_download_cancel_processes(ProfWin* window)
     while (download_process) {
         HTTPDownload* download = download_process->data;
         if (download->window == window) {
-            download->cancel = 1;
+            g_atomic_int_set(&download->cancel, 1);
             break;
         }
         download_process = g_slist_next(download_process);
     }
 }
 
+// call before the download's thread is started
 void
 http_download_add_download(HTTPDownload* download)
 {
+    download->cancel = 0;
+    download->silent = FALSE;
+    download->bytes_received = 0;
+    download->progress_time = 0;
+    download->resume_from = 0;
+    download->limit = _download_limit();
+    download->cache_key = http_download_cache_key(download->url);
+    http_tls_load(&download->tls);
     download_processes = g_slist_append(download_processes, download);
 }
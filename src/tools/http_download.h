@@ -47,22 +47,41 @@
 #include "ui/win_types.h"
 #include "tools/http_common.h"
 
+struct aes256gcm_stream_t;
+
 typedef struct http_download_t
 {
     char* id;
     char* url;
     char* filename;
     char* cmd_template;
+    // Decrypts the body while it is downloaded, NULL for plain downloads
+    struct aes256gcm_stream_t* decrypt_stream;
     curl_off_t bytes_received;
+    // body offset the current request was resumed at
+    curl_off_t resume_from;
+    gint64 progress_time;
     ProfWin* window;
     pthread_t worker;
+    // set by the main thread, read with g_atomic_int_get() by the worker
     int cancel;
     gboolean silent;
+    HTTPTls tls;
+    // bandwidth cap in KiB/s, 0 when unlimited
+    int limit;
+    // name of the URL in the download cache, NULL to not use it
+    gchar* cache_key;
 } HTTPDownload;
 
 void* http_file_get(void* userdata);
 
 void http_download_cancel_processes(ProfWin* window);
 void http_download_add_download(HTTPDownload* download);
+void http_download_done(HTTPDownload* download);
+
+gchar* http_download_cache_key(const char* const url);
+gboolean http_download_cache_restore(const char* const key, const char* const filename);
+void http_download_cache_store(const char* const key, const char* const filename,
+                               const char* const etag, const char* const last_modified);
 
 #endif
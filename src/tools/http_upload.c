@@ -44,43 +44,97 @@
 #include <gio/gio.h>
 #include <pthread.h>
 #include <assert.h>
+#include <time.h>
 
 #include "profanity.h"
 #include "event/client_events.h"
 #include "tools/http_upload.h"
+#include "tools/http_common.h"
 #include "config/cafile.h"
 #include "config/preferences.h"
 #include "ui/ui.h"
 #include "ui/window.h"
+#include "xmpp/xmpp.h"
 #include "common.h"
+#include "log.h"
+
+#ifdef HAVE_OMEMO
+#include "omemo/crypto.h"
+#endif
+
+#ifdef HAVE_PIXBUF
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#endif
 
 #define FALLBACK_MIMETYPE           "application/octet-stream"
 #define FALLBACK_CONTENTTYPE_HEADER "Content-Type: application/octet-stream"
 #define FALLBACK_MSG                ""
 #define FILE_HEADER_BYTES           512
 
+// slot requests of a batch waiting for the server at the same time
+#define BATCH_SLOT_REQUESTS 4
+
+// how long an uploaded file's URL is sent again instead of uploading it once
+// more, unless the slot said when the server removes it
+#define UPLOAD_CACHE_TTL_SECONDS (24 * 60 * 60)
+
 struct curl_data_t
 {
     char* buffer;
     size_t size;
 };
 
+struct http_upload_batch_t
+{
+    ProfWin* window;
+    // uploads whose slot has not been requested yet
+    GQueue* queued;
+    int requested;
+    // one per upload in the order added, NULL while pending, "" when failed
+    GPtrArray* urls;
+    guint next_url;
+    gboolean cancelled;
+};
+
 GSList* upload_processes = NULL;
+static GSList* upload_batches = NULL;
+
+typedef struct upload_cache_entry_t
+{
+    char* url;
+    time_t expires;
+} UploadCacheEntry;
+
+// account, content hash and encryption of an upload to the URL it got
+static GHashTable* upload_cache = NULL;
+
+// what the thread of a finished upload hands back to the main thread
+typedef struct http_upload_result_t
+{
+    HTTPUpload* upload;
+    char* err;
+} HTTPUploadResult;
+
+static void _batch_upload_done(HTTPUpload* upload, const char* const url);
+static gboolean _batch_send_ready(HTTPUploadBatch* batch);
+static void _http_upload_free(HTTPUpload* upload);
+static gboolean _http_upload_finished_cb(gpointer data);
 
 static int
 _xferinfo(void* userdata, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow)
 {
     HTTPUpload* upload = (HTTPUpload*)userdata;
 
-    pthread_mutex_lock(&lock);
-
-    if (upload->cancel) {
-        pthread_mutex_unlock(&lock);
+    if (g_atomic_int_get(&upload->cancel)) {
         return 1;
     }
 
+    // keep main loop wakeups and redraws down on fast transfers
+    if (!http_progress_due(&upload->progress_time, ulnow, ultotal)) {
+        return 0;
+    }
+
     if (upload->bytes_sent == ulnow) {
-        pthread_mutex_unlock(&lock);
         return 0;
     } else {
         upload->bytes_sent = ulnow;
@@ -91,14 +145,7 @@ _xferinfo(void* userdata, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultot
         ulperc = (100 * ulnow) / ultotal;
     }
 
-    gchar* msg = g_strdup_printf("Uploading '%s': %d%%", upload->filename, ulperc);
-    if (!msg) {
-        msg = g_strdup(FALLBACK_MSG);
-    }
-    win_update_entry_message(upload->window, upload->put_url, msg);
-    g_free(msg);
-
-    pthread_mutex_unlock(&lock);
+    http_print_transfer_update(upload->window, upload->put_url, "Uploading '%s': %d%%", upload->filename, ulperc);
 
     return 0;
 }
@@ -127,6 +174,24 @@ _data_callback(void* ptr, size_t size, size_t nmemb, void* data)
     return realsize;
 }
 
+#ifdef HAVE_OMEMO
+static size_t
+_encrypt_read_callback(char* buffer, size_t size, size_t nitems, void* userdata)
+{
+    HTTPUpload* upload = (HTTPUpload*)userdata;
+    size_t read_len = 0;
+
+    gcry_error_t res = aes256gcm_stream_read(upload->encrypt_stream, upload->filehandle,
+                                             (unsigned char*)buffer, size * nitems, &read_len);
+    if (res != GPG_ERR_NO_ERROR) {
+        log_error("[HTTP upload] encrypting '%s' failed: %s", upload->filename, gcry_strerror(res));
+        return CURL_READFUNC_ABORT;
+    }
+
+    return read_len;
+}
+#endif
+
 int
 format_alt_url(char* original_url, char* new_scheme, char* new_fragment, char** new_url)
 {
@@ -163,7 +228,7 @@ http_file_put(void* userdata)
 
     FILE* fh = NULL;
 
-    auto_char char* err = NULL;
+    char* err = NULL;
     gchar* content_type_header;
     // Optional headers
     gchar* auth_header = NULL;
@@ -173,29 +238,11 @@ http_file_put(void* userdata)
     CURL* curl;
     CURLcode res;
 
-    upload->cancel = 0;
-    upload->bytes_sent = 0;
-
-    pthread_mutex_lock(&lock);
-    gchar* msg = g_strdup_printf("Uploading '%s': 0%%", upload->filename);
-    if (!msg) {
-        msg = g_strdup(FALLBACK_MSG);
-    }
-    win_print_http_transfer(upload->window, msg, upload->put_url);
-    g_free(msg);
-
-    auto_gchar gchar* cert_path = prefs_get_string(PREF_TLS_CERTPATH);
-    gchar* cafile = cafile_get_name();
-    gboolean insecure = FALSE;
-    ProfAccount* account = accounts_get_account(session_get_account_name());
-    if (account) {
-        insecure = account->tls_policy && strcmp(account->tls_policy, "trust") == 0;
-    }
-    account_free(account);
-    pthread_mutex_unlock(&lock);
+    http_print_transfer(upload->window, upload->put_url, "Uploading '%s': 0%%", upload->filename);
 
-    curl_global_init(CURL_GLOBAL_ALL);
+    char* host = http_transfer_begin(upload->put_url);
     curl = curl_easy_init();
+    http_transfer_setup(curl);
 
     curl_easy_setopt(curl, CURLOPT_URL, upload->put_url);
     curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "PUT");
@@ -252,18 +299,15 @@ http_file_put(void* userdata)
 
     fh = upload->filehandle;
 
-    if (cafile) {
-        curl_easy_setopt(curl, CURLOPT_CAINFO, cafile);
-    }
-    if (cert_path) {
-        curl_easy_setopt(curl, CURLOPT_CAPATH, cert_path);
-    }
-    if (insecure) {
-        curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
-        curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
-    }
+    http_tls_apply(curl, &upload->tls);
 
     curl_easy_setopt(curl, CURLOPT_READDATA, fh);
+#ifdef HAVE_OMEMO
+    if (upload->encrypt_stream) {
+        curl_easy_setopt(curl, CURLOPT_READFUNCTION, _encrypt_read_callback);
+        curl_easy_setopt(curl, CURLOPT_READDATA, upload);
+    }
+#endif
     curl_easy_setopt(curl, CURLOPT_INFILESIZE_LARGE, (curl_off_t)(upload->filesize));
     curl_easy_setopt(curl, CURLOPT_UPLOAD, 1L);
 
@@ -290,7 +334,7 @@ http_file_put(void* userdata)
     }
 
     curl_easy_cleanup(curl);
-    curl_global_cleanup();
+    http_transfer_end(host);
     curl_slist_free_all(headers);
 
     if (fh) {
@@ -302,78 +346,135 @@ http_file_put(void* userdata)
     g_free(cookie_header);
     g_free(expires_header);
 
-    pthread_mutex_lock(&lock);
-    g_free(cafile);
+    HTTPUploadResult* result = malloc(sizeof(HTTPUploadResult));
+    result->upload = upload;
+    result->err = err;
+    run_on_main_thread(_http_upload_finished_cb, result, NULL);
 
+    return NULL;
+}
+
+static gchar*
+_upload_cache_key(HTTPUpload* upload)
+{
+    const char* barejid = connection_get_barejid();
+    if (!barejid || !upload->content_hash) {
+        return NULL;
+    }
+    // encrypted uploads are sent as the aesgcm URL holding their key
+    return g_strdup_printf("%s %s %s", barejid, upload->content_hash, upload->encrypt_stream ? "aesgcm" : "plain");
+}
+
+static void
+_upload_cache_entry_free(UploadCacheEntry* entry)
+{
+    free(entry->url);
+    free(entry);
+}
+
+static void
+_upload_cache_add(HTTPUpload* upload, const char* const url)
+{
+    gchar* key = _upload_cache_key(upload);
+    if (!key) {
+        return;
+    }
+    if (!upload_cache) {
+        upload_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)_upload_cache_entry_free);
+    }
+
+    UploadCacheEntry* entry = malloc(sizeof(UploadCacheEntry));
+    entry->url = strdup(url);
+    entry->expires = time(NULL) + UPLOAD_CACHE_TTL_SECONDS;
+    if (upload->expires) {
+        time_t expires = curl_getdate(upload->expires, NULL);
+        if (expires > 0 && expires < entry->expires) {
+            entry->expires = expires;
+        }
+    }
+    g_hash_table_replace(upload_cache, key, entry);
+}
+
+static const char*
+_upload_cache_lookup(HTTPUpload* upload)
+{
+    if (!upload_cache) {
+        return NULL;
+    }
+    auto_gchar gchar* key = _upload_cache_key(upload);
+    if (!key) {
+        return NULL;
+    }
+    UploadCacheEntry* entry = g_hash_table_lookup(upload_cache, key);
+    if (entry && entry->expires <= time(NULL)) {
+        g_hash_table_remove(upload_cache, key);
+        return NULL;
+    }
+    return entry ? entry->url : NULL;
+}
+
+static gchar*
+_upload_content_hash(FILE* fh)
+{
+    GChecksum* checksum = g_checksum_new(G_CHECKSUM_SHA256);
+    guchar buf[8192];
+    size_t len;
+    while ((len = fread(buf, 1, sizeof(buf), fh)) > 0) {
+        g_checksum_update(checksum, buf, len);
+    }
+    gchar* hash = ferror(fh) ? NULL : g_strdup(g_checksum_get_string(checksum));
+    g_checksum_free(checksum);
+    rewind(fh);
+
+    return hash;
+}
+
+static gboolean
+_http_upload_finished_cb(gpointer data)
+{
+    HTTPUploadResult* result = data;
+    HTTPUpload* upload = result->upload;
+    auto_char char* err = result->err;
+    auto_gchar gchar* get_url = NULL;
+    free(result);
+
+    // a canceled upload belongs to a window that is gone
     if (err) {
-        gchar* msg;
         if (upload->cancel) {
-            msg = g_strdup_printf("Uploading '%s' failed: Upload was canceled", upload->filename);
-            if (!msg) {
-                msg = g_strdup(FALLBACK_MSG);
-            }
+            cons_show_error("Uploading '%s' failed: Upload was canceled", upload->filename);
         } else {
-            msg = g_strdup_printf("Uploading '%s' failed: %s", upload->filename, err);
-            if (!msg) {
-                msg = g_strdup(FALLBACK_MSG);
-            }
+            auto_gchar gchar* msg = g_strdup_printf("Uploading '%s' failed: %s", upload->filename, err);
             win_update_entry_message(upload->window, upload->put_url, msg);
+            cons_show_error("%s", msg);
         }
-        cons_show_error(msg);
-        g_free(msg);
-    } else {
-        if (!upload->cancel) {
-            msg = g_strdup_printf("Uploading '%s': 100%%", upload->filename);
-            if (!msg) {
-                msg = g_strdup(FALLBACK_MSG);
-            }
-            win_update_entry_message(upload->window, upload->put_url, msg);
-            win_mark_received(upload->window, upload->put_url);
-            g_free(msg);
-
-            char* url = NULL;
-            if (format_alt_url(upload->get_url, upload->alt_scheme, upload->alt_fragment, &url) != 0) {
-                gchar* msg = g_strdup_printf("Uploading '%s' failed: Bad URL ('%s')", upload->filename, upload->get_url);
-                if (!msg) {
-                    msg = g_strdup(FALLBACK_MSG);
-                }
-                cons_show_error(msg);
-                g_free(msg);
-            } else {
-                switch (upload->window->type) {
-                case WIN_CHAT:
-                {
-                    ProfChatWin* chatwin = (ProfChatWin*)(upload->window);
-                    assert(chatwin->memcheck == PROFCHATWIN_MEMCHECK);
-                    cl_ev_send_msg(chatwin, url, url);
-                    break;
-                }
-                case WIN_PRIVATE:
-                {
-                    ProfPrivateWin* privatewin = (ProfPrivateWin*)(upload->window);
-                    assert(privatewin->memcheck == PROFPRIVATEWIN_MEMCHECK);
-                    cl_ev_send_priv_msg(privatewin, url, url);
-                    break;
-                }
-                case WIN_MUC:
-                {
-                    ProfMucWin* mucwin = (ProfMucWin*)(upload->window);
-                    assert(mucwin->memcheck == PROFMUCWIN_MEMCHECK);
-                    cl_ev_send_muc_msg(mucwin, url, url);
-                    break;
-                }
-                default:
-                    break;
-                }
-
-                curl_free(url);
-            }
+    } else if (!upload->cancel) {
+        auto_gchar gchar* msg = g_strdup_printf("Uploading '%s': 100%%", upload->filename);
+        win_update_entry_message(upload->window, upload->put_url, msg);
+        win_mark_received(upload->window, upload->put_url);
+
+        char* url = NULL;
+        if (format_alt_url(upload->get_url, upload->alt_scheme, upload->alt_fragment, &url) != 0) {
+            cons_show_error("Uploading '%s' failed: Bad URL ('%s')", upload->filename, upload->get_url);
+        } else {
+            get_url = g_strdup(url);
+            curl_free(url);
+            _upload_cache_add(upload, get_url);
         }
     }
 
     upload_processes = g_slist_remove(upload_processes, upload);
-    pthread_mutex_unlock(&lock);
+    _batch_upload_done(upload, get_url);
+    _http_upload_free(upload);
+
+    return G_SOURCE_REMOVE;
+}
 
+static void
+_http_upload_free(HTTPUpload* upload)
+{
+#ifdef HAVE_OMEMO
+    aes256gcm_stream_free(upload->encrypt_stream);
+#endif
     free(upload->filename);
     free(upload->mime_type);
     free(upload->get_url);
@@ -383,9 +484,205 @@ http_file_put(void* userdata)
     free(upload->authorization);
     free(upload->cookie);
     free(upload->expires);
+    free(upload->content_hash);
+    http_tls_clear(&upload->tls);
     free(upload);
+}
 
-    return NULL;
+// the upload never started, its file is still open
+static void
+_http_upload_drop(HTTPUpload* upload)
+{
+    _batch_upload_done(upload, NULL);
+    if (upload->filehandle) {
+        fclose(upload->filehandle);
+    }
+    _http_upload_free(upload);
+}
+
+static void
+_http_upload_send_url(ProfWin* window, char* url)
+{
+    switch (window->type) {
+    case WIN_CHAT:
+    {
+        ProfChatWin* chatwin = (ProfChatWin*)window;
+        assert(chatwin->memcheck == PROFCHATWIN_MEMCHECK);
+        cl_ev_send_msg(chatwin, url, url);
+        break;
+    }
+    case WIN_PRIVATE:
+    {
+        ProfPrivateWin* privatewin = (ProfPrivateWin*)window;
+        assert(privatewin->memcheck == PROFPRIVATEWIN_MEMCHECK);
+        cl_ev_send_priv_msg(privatewin, url, url);
+        break;
+    }
+    case WIN_MUC:
+    {
+        ProfMucWin* mucwin = (ProfMucWin*)window;
+        assert(mucwin->memcheck == PROFMUCWIN_MEMCHECK);
+        cl_ev_send_muc_msg(mucwin, url, url);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+static void
+_batch_free(HTTPUploadBatch* batch)
+{
+    upload_batches = g_slist_remove(upload_batches, batch);
+    g_queue_free(batch->queued);
+    g_ptr_array_free(batch->urls, TRUE);
+    free(batch);
+}
+
+/*
+ * Record the URL of a finished upload, NULL if it failed, and send the URLs
+ * that are no longer waiting on an earlier upload. Runs on the main thread.
+ */
+static void
+_batch_upload_done(HTTPUpload* upload, const char* const url)
+{
+    HTTPUploadBatch* batch = upload->batch;
+    if (batch == NULL) {
+        return;
+    }
+    upload->batch = NULL;
+
+    g_ptr_array_index(batch->urls, upload->batch_index) = g_strdup(url ?: "");
+    _batch_send_ready(batch);
+}
+
+// send the URLs no longer waiting on an earlier upload, TRUE once the batch
+// is done and freed
+static gboolean
+_batch_send_ready(HTTPUploadBatch* batch)
+{
+    while (batch->next_url < batch->urls->len) {
+        char* next = g_ptr_array_index(batch->urls, batch->next_url);
+        if (next == NULL) {
+            return FALSE;
+        }
+        if (next[0] != '\0' && !batch->cancelled) {
+            _http_upload_send_url(batch->window, next);
+        }
+        batch->next_url++;
+    }
+
+    _batch_free(batch);
+    return TRUE;
+}
+
+// the batch may be freed, unless an upload of it is still pending
+static void
+_batch_cancel(HTTPUploadBatch* batch)
+{
+    batch->cancelled = TRUE;
+
+    guint queued = g_queue_get_length(batch->queued);
+    while (queued-- > 0) {
+        _http_upload_drop(g_queue_pop_head(batch->queued));
+    }
+}
+
+// the batch must not be used afterwards, see _batch_cancel()
+static void
+_batch_request_slots(HTTPUploadBatch* batch)
+{
+    while (batch->requested < BATCH_SLOT_REQUESTS && !g_queue_is_empty(batch->queued)) {
+        HTTPUpload* upload = g_queue_pop_head(batch->queued);
+        if (iq_http_upload_request(upload)) {
+            batch->requested++;
+        } else {
+            // no upload service, the rest would fail the same way
+            _batch_cancel(batch);
+            _http_upload_drop(upload);
+            return;
+        }
+    }
+}
+
+HTTPUploadBatch*
+http_upload_batch_new(ProfWin* window)
+{
+    HTTPUploadBatch* batch = malloc(sizeof(HTTPUploadBatch));
+    batch->window = window;
+    batch->queued = g_queue_new();
+    batch->requested = 0;
+    batch->urls = g_ptr_array_new_with_free_func(g_free);
+    batch->next_url = 0;
+    batch->cancelled = FALSE;
+
+    return batch;
+}
+
+/*
+ * Add an upload to the batch. A file that was uploaded not long ago is not
+ * uploaded again, the URL it got is sent once more.
+ */
+void
+http_upload_batch_add(HTTPUploadBatch* batch, HTTPUpload* upload)
+{
+    upload->content_hash = _upload_content_hash(upload->filehandle);
+
+    const char* url = _upload_cache_lookup(upload);
+    if (url) {
+        log_debug("[HTTP upload] '%s' was uploaded already, reusing %s", upload->filename, url);
+        win_println(batch->window, THEME_DEFAULT, "-", "Uploading '%s': already uploaded, sending its URL again.", upload->filename);
+        g_ptr_array_add(batch->urls, g_strdup(url));
+        fclose(upload->filehandle);
+        _http_upload_free(upload);
+        return;
+    }
+
+    upload->batch = batch;
+    upload->batch_index = batch->urls->len;
+    g_ptr_array_add(batch->urls, NULL);
+    g_queue_push_tail(batch->queued, upload);
+}
+
+/*
+ * Request upload slots for the files of the batch, a few at a time. Each
+ * upload starts as soon as its slot arrives, while the next slots are
+ * requested. URLs of files uploaded before go out as soon as the ones ahead
+ * of them.
+ */
+void
+http_upload_batch_start(HTTPUploadBatch* batch)
+{
+    if (batch->urls->len == 0) {
+        _batch_free(batch);
+        return;
+    }
+
+    upload_batches = g_slist_prepend(upload_batches, batch);
+    if (!_batch_send_ready(batch)) {
+        _batch_request_slots(batch);
+    }
+}
+
+/*
+ * Called with the response to a slot request.
+ *
+ * @return TRUE if the upload should be started, otherwise it has been freed.
+ */
+gboolean
+http_upload_slot_received(HTTPUpload* upload, gboolean success)
+{
+    HTTPUploadBatch* batch = upload->batch;
+    batch->requested--;
+
+    if (!success || batch->cancelled) {
+        _http_upload_drop(upload);
+        return FALSE;
+    }
+
+    _batch_request_slots(batch);
+
+    return TRUE;
 }
 
 char*
@@ -410,6 +707,79 @@ file_mime_type(const char* const filename)
     return out_mime_type;
 }
 
+#ifdef HAVE_PIXBUF
+/*
+ * Downscale a JPEG or PNG image so that no side exceeds max_pixels. It is
+ * re-encoded in its own format into an anonymous temporary file, which
+ * drops the metadata of the original. EXIF orientation is applied first.
+ *
+ * @return The file to upload instead, or NULL to upload the original.
+ */
+FILE*
+http_upload_downscale_image(const char* const filename, const char* const mime_type, int max_pixels)
+{
+    const char* format = NULL;
+    if (g_strcmp0(mime_type, "image/jpeg") == 0) {
+        format = "jpeg";
+    } else if (g_strcmp0(mime_type, "image/png") == 0) {
+        format = "png";
+    } else {
+        return NULL;
+    }
+
+    int width, height;
+    if (!gdk_pixbuf_get_file_info(filename, &width, &height)) {
+        return NULL;
+    }
+    if (width <= max_pixels && height <= max_pixels) {
+        return NULL;
+    }
+
+    // the loader scales while decoding and keeps the aspect ratio
+    GError* err = NULL;
+    GdkPixbuf* loaded = gdk_pixbuf_new_from_file_at_size(filename, max_pixels, max_pixels, &err);
+    if (!loaded) {
+        log_warning("[HTTP upload] unable to downscale '%s': %s", filename, err->message);
+        g_error_free(err);
+        return NULL;
+    }
+    GdkPixbuf* pixbuf = gdk_pixbuf_apply_embedded_orientation(loaded);
+    g_object_unref(loaded);
+
+    gchar* data = NULL;
+    gsize len = 0;
+    gboolean saved;
+    if (g_strcmp0(format, "jpeg") == 0) {
+        saved = gdk_pixbuf_save_to_buffer(pixbuf, &data, &len, format, &err, "quality", "85", NULL);
+    } else {
+        saved = gdk_pixbuf_save_to_buffer(pixbuf, &data, &len, format, &err, NULL);
+    }
+    g_object_unref(pixbuf);
+
+    if (!saved) {
+        log_warning("[HTTP upload] unable to encode downscaled '%s': %s", filename, err->message);
+        g_error_free(err);
+        return NULL;
+    }
+
+    FILE* fh = tmpfile();
+    if (!fh || fwrite(data, 1, len, fh) != len || fflush(fh) != 0) {
+        log_warning("[HTTP upload] unable to store downscaled '%s'", filename);
+        if (fh) {
+            fclose(fh);
+        }
+        g_free(data);
+        return NULL;
+    }
+    g_free(data);
+    rewind(fh);
+
+    log_debug("[HTTP upload] downscaled '%s' from %dx%d", filename, width, height);
+
+    return fh;
+}
+#endif
+
 off_t
 file_size(int filedes)
 {
@@ -425,15 +795,28 @@ http_upload_cancel_processes(ProfWin* window)
     while (upload_process) {
         HTTPUpload* upload = upload_process->data;
         if (upload->window == window) {
-            upload->cancel = 1;
-            break;
+            g_atomic_int_set(&upload->cancel, 1);
         }
         upload_process = g_slist_next(upload_process);
     }
+
+    GSList* batch = upload_batches;
+    while (batch) {
+        GSList* next = g_slist_next(batch);
+        if (((HTTPUploadBatch*)batch->data)->window == window) {
+            _batch_cancel(batch->data);
+        }
+        batch = next;
+    }
 }
 
+// call before the upload's thread is started
 void
 http_upload_add_upload(HTTPUpload* upload)
 {
+    upload->cancel = 0;
+    upload->bytes_sent = 0;
+    upload->progress_time = 0;
+    http_tls_load(&upload->tls);
     upload_processes = g_slist_append(upload_processes, upload);
 }
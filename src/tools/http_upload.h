@@ -44,13 +44,22 @@
 #include <curl/curl.h>
 
 #include "ui/win_types.h"
+#include "tools/http_common.h"
+
+struct aes256gcm_stream_t;
+
+// Files sent by one /sendfile, their URLs are sent in the order given
+typedef struct http_upload_batch_t HTTPUploadBatch;
 
 typedef struct http_upload_t
 {
     char* filename;
     FILE* filehandle;
     off_t filesize;
+    // Encrypts filehandle while it is uploaded, NULL for plain uploads
+    struct aes256gcm_stream_t* encrypt_stream;
     curl_off_t bytes_sent;
+    gint64 progress_time;
     char* mime_type;
     char* get_url;
     char* put_url;
@@ -58,20 +67,34 @@ typedef struct http_upload_t
     char* alt_fragment;
     ProfWin* window;
     pthread_t worker;
+    // set by the main thread, read with g_atomic_int_get() by the worker
     int cancel;
+    HTTPTls tls;
     // Additional headers
     // (NULL if they shouldn't be send in the PUT)
     char* authorization;
     char* cookie;
     char* expires;
+    HTTPUploadBatch* batch;
+    guint batch_index;
+    // SHA-256 of what is uploaded before encryption, NULL if it can't be read
+    char* content_hash;
 } HTTPUpload;
 
 void* http_file_put(void* userdata);
 
 char* file_mime_type(const char* const filename);
+#ifdef HAVE_PIXBUF
+FILE* http_upload_downscale_image(const char* const filename, const char* const mime_type, int max_pixels);
+#endif
 off_t file_size(int filedes);
 
 void http_upload_cancel_processes(ProfWin* window);
 void http_upload_add_upload(HTTPUpload* upload);
 
+HTTPUploadBatch* http_upload_batch_new(ProfWin* window);
+void http_upload_batch_add(HTTPUploadBatch* batch, HTTPUpload* upload);
+void http_upload_batch_start(HTTPUploadBatch* batch);
+gboolean http_upload_slot_received(HTTPUpload* upload, gboolean success);
+
 #endif
@@ -0,0 +1,235 @@
+/*
+ * matcher.c
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2024 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <glib.h>
+
+#include "tools/matcher.h"
+
+typedef struct matcher_edge_t
+{
+    guchar byte;
+    gint node;
+} MatcherEdge;
+
+typedef struct matcher_node_t
+{
+    GArray* edges;
+    gint fail;
+    // pattern ending at this node, -1 if none
+    gint pattern;
+    // next node on the fail chain that ends a pattern, -1 if none
+    gint next_output;
+} MatcherNode;
+
+typedef struct matcher_pattern_t
+{
+    gsize len;
+    int id;
+    // another pattern with the same text, -1 if none
+    gint next;
+} MatcherPattern;
+
+struct matcher_t
+{
+    GArray* nodes;
+    GArray* patterns;
+    // fail links are computed on the first scan after a pattern is added
+    gboolean compiled;
+};
+
+static gint _matcher_node_new(Matcher matcher);
+static gint _matcher_child(Matcher matcher, gint node, guchar byte);
+static void _matcher_compile(Matcher matcher);
+
+Matcher
+matcher_new(void)
+{
+    Matcher matcher = g_new0(struct matcher_t, 1);
+    matcher->nodes = g_array_new(FALSE, FALSE, sizeof(MatcherNode));
+    matcher->patterns = g_array_new(FALSE, FALSE, sizeof(MatcherPattern));
+    matcher->compiled = TRUE;
+
+    // root
+    _matcher_node_new(matcher);
+
+    return matcher;
+}
+
+void
+matcher_free(Matcher matcher)
+{
+    if (matcher == NULL) {
+        return;
+    }
+
+    for (guint i = 0; i < matcher->nodes->len; i++) {
+        g_array_free(g_array_index(matcher->nodes, MatcherNode, i).edges, TRUE);
+    }
+    g_array_free(matcher->nodes, TRUE);
+    g_array_free(matcher->patterns, TRUE);
+    g_free(matcher);
+}
+
+void
+matcher_add(Matcher matcher, const char* const pattern, int id)
+{
+    if (pattern == NULL || pattern[0] == '\0') {
+        return;
+    }
+
+    gint node = 0;
+    for (const guchar* curr = (const guchar*)pattern; *curr; curr++) {
+        gint child = _matcher_child(matcher, node, *curr);
+        if (child < 0) {
+            child = _matcher_node_new(matcher);
+            MatcherEdge edge = { *curr, child };
+            g_array_append_val(g_array_index(matcher->nodes, MatcherNode, node).edges, edge);
+        }
+        node = child;
+    }
+
+    // the same pattern added twice is reported once per id
+    MatcherNode* end = &g_array_index(matcher->nodes, MatcherNode, node);
+    MatcherPattern new_pattern = { strlen(pattern), id, end->pattern };
+    g_array_append_val(matcher->patterns, new_pattern);
+    end->pattern = matcher->patterns->len - 1;
+
+    matcher->compiled = FALSE;
+}
+
+void
+matcher_scan(Matcher matcher, const char* const text, matcher_hit_func func, void* userdata)
+{
+    if (text == NULL || matcher->patterns->len == 0) {
+        return;
+    }
+
+    if (!matcher->compiled) {
+        _matcher_compile(matcher);
+    }
+
+    gint node = 0;
+    for (gsize pos = 0; text[pos]; pos++) {
+        guchar byte = text[pos];
+        gint child;
+        while ((child = _matcher_child(matcher, node, byte)) < 0 && node != 0) {
+            node = g_array_index(matcher->nodes, MatcherNode, node).fail;
+        }
+        node = child < 0 ? 0 : child;
+
+        MatcherNode* curr = &g_array_index(matcher->nodes, MatcherNode, node);
+        gint output = curr->pattern >= 0 ? node : curr->next_output;
+        while (output >= 0) {
+            MatcherNode* out = &g_array_index(matcher->nodes, MatcherNode, output);
+            for (gint i = out->pattern; i >= 0;) {
+                MatcherPattern* pattern = &g_array_index(matcher->patterns, MatcherPattern, i);
+                func(pattern->id, pos + 1 - pattern->len, pos + 1, userdata);
+                i = pattern->next;
+            }
+            output = out->next_output;
+        }
+    }
+}
+
+static gint
+_matcher_node_new(Matcher matcher)
+{
+    MatcherNode node = { g_array_new(FALSE, FALSE, sizeof(MatcherEdge)), 0, -1, -1 };
+    g_array_append_val(matcher->nodes, node);
+
+    return matcher->nodes->len - 1;
+}
+
+static gint
+_matcher_child(Matcher matcher, gint node, guchar byte)
+{
+    GArray* edges = g_array_index(matcher->nodes, MatcherNode, node).edges;
+    for (guint i = 0; i < edges->len; i++) {
+        MatcherEdge* edge = &g_array_index(edges, MatcherEdge, i);
+        if (edge->byte == byte) {
+            return edge->node;
+        }
+    }
+
+    return -1;
+}
+
+// set fail links breadth first, so a node's fail target is always done before it
+static void
+_matcher_compile(Matcher matcher)
+{
+    GQueue queue = G_QUEUE_INIT;
+
+    GArray* root_edges = g_array_index(matcher->nodes, MatcherNode, 0).edges;
+    for (guint i = 0; i < root_edges->len; i++) {
+        gint child = g_array_index(root_edges, MatcherEdge, i).node;
+        MatcherNode* node = &g_array_index(matcher->nodes, MatcherNode, child);
+        node->fail = 0;
+        node->next_output = -1;
+        g_queue_push_tail(&queue, GINT_TO_POINTER(child));
+    }
+
+    while (!g_queue_is_empty(&queue)) {
+        gint parent = GPOINTER_TO_INT(g_queue_pop_head(&queue));
+        GArray* edges = g_array_index(matcher->nodes, MatcherNode, parent).edges;
+
+        for (guint i = 0; i < edges->len; i++) {
+            MatcherEdge edge = g_array_index(edges, MatcherEdge, i);
+
+            gint fail = g_array_index(matcher->nodes, MatcherNode, parent).fail;
+            gint target;
+            while ((target = _matcher_child(matcher, fail, edge.byte)) < 0 && fail != 0) {
+                fail = g_array_index(matcher->nodes, MatcherNode, fail).fail;
+            }
+            if (target < 0) {
+                target = 0;
+            }
+
+            MatcherNode* fail_node = &g_array_index(matcher->nodes, MatcherNode, target);
+            gint next_output = fail_node->pattern >= 0 ? target : fail_node->next_output;
+
+            MatcherNode* node = &g_array_index(matcher->nodes, MatcherNode, edge.node);
+            node->fail = target;
+            node->next_output = next_output;
+
+            g_queue_push_tail(&queue, GINT_TO_POINTER(edge.node));
+        }
+    }
+
+    matcher->compiled = TRUE;
+}
@@ -0,0 +1,60 @@
+/*
+ * matcher.h
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2019 - 2024 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+#ifndef TOOLS_MATCHER_H
+#define TOOLS_MATCHER_H
+
+#include <glib.h>
+
+/*
+ * Finds several patterns in a text in a single pass (Aho-Corasick).
+ * Matching is byte wise, fold patterns and text the same way beforehand
+ * for case insensitive matching.
+ */
+typedef struct matcher_t* Matcher;
+
+// called for each occurrence, offsets are in bytes, end is exclusive
+typedef void (*matcher_hit_func)(int id, gsize start, gsize end, void* userdata);
+
+Matcher matcher_new(void);
+void matcher_free(Matcher matcher);
+
+// add a pattern reported with id, empty patterns are ignored
+void matcher_add(Matcher matcher, const char* const pattern, int id);
+
+// report every occurrence of every pattern, ordered by end offset
+void matcher_scan(Matcher matcher, const char* const text, matcher_hit_func func, void* userdata);
+
+#endif
@@ -42,132 +42,115 @@
 
 #include "common.h"
 
-static gchar**
-_parse_args_helper(const char* const inp, int min, int max, gboolean* result, gboolean with_freetext)
+/*
+ * Split a line of input into tokens without copying it. Each span gives the
+ * byte offset and length of a token in inp, without its surrounding quotes.
+ * Leading and trailing whitespace is ignored.
+ *
+ * inp - The line of input
+ * freetext_from - Index of the token (the command is token 0) that takes the
+ * rest of the line as it is, -1 for none
+ *
+ * Returns - A GArray of ProfSpan, the command included. Use parse_span_dup()
+ * for the tokens that need to be kept as strings.
+ *
+ * Spaces and quotes are ASCII and never part of a multibyte UTF-8 sequence,
+ * so the input is scanned byte by byte.
+ */
+GArray*
+parse_spans(const char* const inp, int freetext_from)
 {
-    if (inp == NULL) {
-        *result = FALSE;
-        return NULL;
-    }
+    GArray* spans = g_array_new(FALSE, FALSE, sizeof(ProfSpan));
 
-    // copy and strip input of leading/trailing whitespace
-    auto_char char* copy = strdup(inp);
-    g_strstrip(copy);
+    int start = 0;
+    int end = strlen(inp);
+    while (start < end && g_ascii_isspace(inp[start])) {
+        start++;
+    }
+    while (end > start && g_ascii_isspace(inp[end - 1])) {
+        end--;
+    }
 
-    int inp_size = g_utf8_strlen(copy, -1);
     gboolean in_token = FALSE;
-    gboolean in_freetext = FALSE;
     gboolean in_quotes = FALSE;
-    char* token_start = &copy[0];
-    int token_size = 0;
-    int num_tokens = 0;
-    GSList* tokens = NULL;
+    ProfSpan span = { 0, 0, FALSE };
 
-    // add tokens to GSList
-    for (int i = 0; i < inp_size; i++) {
-        gchar* curr_ch = g_utf8_offset_to_pointer(copy, i);
-        gunichar curr_uni = g_utf8_get_char(curr_ch);
+    for (int i = start; i < end; i++) {
+        char ch = inp[i];
 
         if (!in_token) {
-            if (curr_uni == ' ') {
+            if (ch == ' ') {
                 continue;
-            } else {
-                in_token = TRUE;
-                if (with_freetext) {
-                    num_tokens++;
-                }
-                if (with_freetext && (num_tokens == max + 1) && (curr_uni != '"')) {
-                    in_freetext = TRUE;
-                } else if (curr_uni == '"') {
-                    in_quotes = TRUE;
-                    i++;
-                    gchar* next_ch = g_utf8_next_char(curr_ch);
-                    gunichar next_uni = g_utf8_get_char(next_ch);
-
-                    if (next_uni == '"') {
-                        tokens = g_slist_append(tokens, g_strndup(curr_ch,
-                                                                  0));
-                        token_size = 0;
-                        in_token = FALSE;
-                        in_quotes = FALSE;
-                    } else {
-                        token_start = next_ch;
-                        token_size += g_unichar_to_utf8(next_uni, NULL);
-                    }
-                }
-                if (curr_uni == '"') {
-                    gchar* next_ch = g_utf8_next_char(curr_ch);
-                    token_start = next_ch;
-                } else {
-                    token_start = curr_ch;
-                    token_size += g_unichar_to_utf8(curr_uni, NULL);
-                }
             }
-        } else {
-            if (in_quotes) {
-                if (curr_uni == '"') {
-                    tokens = g_slist_append(tokens, g_strndup(token_start,
-                                                              token_size));
-                    token_size = 0;
-                    in_token = FALSE;
-                    in_quotes = FALSE;
-                } else {
-                    if (curr_uni != '"') {
-                        token_size += g_unichar_to_utf8(curr_uni, NULL);
-                    }
-                }
+            in_token = TRUE;
+            if ((int)spans->len == freetext_from && ch != '"') {
+                // the rest of the line is a single token
+                span.start = i;
+                span.len = end - i;
+                span.quoted = FALSE;
+                g_array_append_val(spans, span);
+                return spans;
+            }
+            if (ch == '"') {
+                in_quotes = TRUE;
+                span.start = i + 1;
+                span.quoted = TRUE;
             } else {
-                if (with_freetext && in_freetext) {
-                    token_size += g_unichar_to_utf8(curr_uni, NULL);
-                } else if (curr_uni == ' ') {
-                    tokens = g_slist_append(tokens, g_strndup(token_start,
-                                                              token_size));
-                    token_size = 0;
-                    in_token = FALSE;
-                } else {
-                    token_size += g_unichar_to_utf8(curr_uni, NULL);
-                }
+                span.start = i;
+                span.quoted = FALSE;
             }
+        } else if (in_quotes ? ch == '"' : ch == ' ') {
+            span.len = i - span.start;
+            g_array_append_val(spans, span);
+            in_token = FALSE;
+            in_quotes = FALSE;
         }
     }
 
     if (in_token) {
-        tokens = g_slist_append(tokens, g_strndup(token_start, token_size));
+        // a quote left open runs to the end of the line
+        span.len = MAX(end - span.start, 0);
+        g_array_append_val(spans, span);
     }
 
-    int num = g_slist_length(tokens) - 1;
+    return spans;
+}
 
-    // if num args not valid return NULL
-    if ((num < min) || (num > max)) {
-        g_slist_free_full(tokens, free);
+gchar*
+parse_span_dup(const char* const inp, const ProfSpan* const span)
+{
+    return g_strndup(inp + span->start, span->len);
+}
+
+static gchar**
+_parse_args_helper(const char* const inp, int min, int max, gboolean* result, gboolean with_freetext)
+{
+    if (inp == NULL) {
         *result = FALSE;
         return NULL;
+    }
 
-        // if min allowed is 0 and 0 found, return empty char* array
-    } else if (min == 0 && num == 0) {
-        g_slist_free_full(tokens, free);
-        gchar** args = g_malloc((num + 1) * sizeof(*args));
-        args[0] = NULL;
-        *result = TRUE;
-        return args;
+    GArray* spans = parse_spans(inp, with_freetext ? max : -1);
+    int num = (int)spans->len - 1;
 
-        // otherwise return args array
-    } else {
-        gchar** args = g_malloc((num + 1) * sizeof(*args));
-        GSList* token = tokens;
-        token = g_slist_next(token);
-        int arg_count = 0;
-
-        while (token) {
-            args[arg_count++] = strdup(token->data);
-            token = g_slist_next(token);
-        }
+    // if num args not valid return NULL
+    if ((num < min) || (num > max)) {
+        g_array_free(spans, TRUE);
+        *result = FALSE;
+        return NULL;
+    }
 
-        args[arg_count] = NULL;
-        g_slist_free_full(tokens, free);
-        *result = TRUE;
-        return args;
+    // only the arguments are copied, not the command
+    gchar** args = g_malloc((MAX(num, 0) + 1) * sizeof(*args));
+    int arg_count = 0;
+    for (guint i = 1; i < spans->len; i++) {
+        args[arg_count++] = parse_span_dup(inp, &g_array_index(spans, ProfSpan, i));
     }
+    args[arg_count] = NULL;
+
+    g_array_free(spans, TRUE);
+    *result = TRUE;
+    return args;
 }
 
 /*
@@ -260,68 +243,57 @@ parse_args_as_one(const char* const inp, int min, int max, gboolean* result)
 int
 count_tokens(const char* const string)
 {
-    int length = g_utf8_strlen(string, -1);
     gboolean in_quotes = FALSE;
-    int num_tokens = 0;
 
     // include first token
-    num_tokens++;
-
-    for (int i = 0; i < length; i++) {
-        gchar* curr_ch = g_utf8_offset_to_pointer(string, i);
-        gunichar curr_uni = g_utf8_get_char(curr_ch);
+    int num_tokens = 1;
 
-        if (curr_uni == ' ') {
+    for (const char* c = string; *c; c++) {
+        if (*c == ' ') {
             if (!in_quotes) {
                 num_tokens++;
             }
-        } else if (curr_uni == '"') {
-            if (in_quotes) {
-                in_quotes = FALSE;
-            } else {
-                in_quotes = TRUE;
-            }
+        } else if (*c == '"') {
+            in_quotes = !in_quotes;
         }
     }
 
     return num_tokens;
 }
 
-char*
-get_start(const char* const string, int tokens)
+// Length in bytes of the part of string before its token number tokens
+// (counted from 1), the space in front of that token included.
+int
+get_start_len(const char* const string, int tokens)
 {
-    GString* result = g_string_new("");
-    int length = g_utf8_strlen(string, -1);
     gboolean in_quotes = FALSE;
-    int num_tokens = 0;
 
     // include first token
-    num_tokens++;
-
-    for (int i = 0; i < length; i++) {
-        gchar* curr_ch = g_utf8_offset_to_pointer(string, i);
-        gunichar curr_uni = g_utf8_get_char(curr_ch);
+    int num_tokens = 1;
+    if (num_tokens >= tokens) {
+        return 0;
+    }
 
-        if (num_tokens < tokens) {
-            auto_gchar gchar* uni_char = g_malloc(7);
-            int len = g_unichar_to_utf8(curr_uni, uni_char);
-            uni_char[len] = '\0';
-            g_string_append(result, uni_char);
-        }
-        if (curr_uni == ' ') {
+    for (const char* c = string; *c; c++) {
+        if (*c == ' ') {
             if (!in_quotes) {
                 num_tokens++;
+                if (num_tokens == tokens) {
+                    return c - string + 1;
+                }
             }
-        } else if (curr_uni == '"') {
-            if (in_quotes) {
-                in_quotes = FALSE;
-            } else {
-                in_quotes = TRUE;
-            }
+        } else if (*c == '"') {
+            in_quotes = !in_quotes;
         }
     }
 
-    return g_string_free(result, FALSE);
+    return strlen(string);
+}
+
+char*
+get_start(const char* const string, int tokens)
+{
+    return g_strndup(string, get_start_len(string, tokens));
 }
 
 GHashTable*
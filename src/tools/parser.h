@@ -38,10 +38,20 @@
 
 #include <glib.h>
 
+typedef struct prof_span_t
+{
+    int start; // byte offset into the input
+    int len;   // in bytes, without quotes
+    gboolean quoted;
+} ProfSpan;
+
+GArray* parse_spans(const char* const inp, int freetext_from);
+gchar* parse_span_dup(const char* const inp, const ProfSpan* const span);
 gchar** parse_args(const char* const inp, int min, int max, gboolean* result);
 gchar** parse_args_with_freetext(const char* const inp, int min, int max, gboolean* result);
 gchar** parse_args_as_one(const char* const inp, int min, int max, gboolean* result);
 int count_tokens(const char* const string);
+int get_start_len(const char* const string, int tokens);
 char* get_start(const char* const string, int tokens);
 GHashTable* parse_options(gchar** args, gchar** keys, gboolean* res);
 void options_destroy(GHashTable* options);
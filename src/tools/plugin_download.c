@@ -57,23 +57,23 @@
 #include "ui/window.h"
 #include "common.h"
 
-#define FALLBACK_MSG ""
-
-void*
-plugin_download_install(void* userdata)
+typedef struct plugin_install_t
 {
-    HTTPDownload* plugin_dl = (HTTPDownload*)userdata;
-
-    auto_char char* path = strdup(plugin_dl->filename);
-    auto_char char* https_url = strdup(plugin_dl->url);
-    plugin_dl->silent = TRUE;
+    char* path;
+    char* url;
+} PluginInstall;
 
-    http_file_get(plugin_dl);
+// loading a plugin touches the plugin list and the UI, so it happens on the
+// main thread once the download is over
+static gboolean
+_plugin_install_cb(gpointer data)
+{
+    PluginInstall* install = data;
 
-    if (is_regular_file(path)) {
+    if (is_regular_file(install->path)) {
         GString* error_message = g_string_new(NULL);
-        auto_char char* plugin_name = basename_from_url(https_url);
-        gboolean result = plugins_install(plugin_name, path, error_message);
+        auto_char char* plugin_name = basename_from_url(install->url);
+        gboolean result = plugins_install(plugin_name, install->path, error_message);
         if (result) {
             cons_show("Plugin installed and loaded: %s", plugin_name);
         } else {
@@ -84,7 +84,33 @@ plugin_download_install(void* userdata)
         cons_show_error("Downloaded file is not a file (?)");
     }
 
-    remove(path);
+    remove(install->path);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+_plugin_install_free(gpointer data)
+{
+    PluginInstall* install = data;
+    free(install->path);
+    free(install->url);
+    free(install);
+}
+
+void*
+plugin_download_install(void* userdata)
+{
+    HTTPDownload* plugin_dl = (HTTPDownload*)userdata;
+
+    PluginInstall* install = malloc(sizeof(PluginInstall));
+    install->path = strdup(plugin_dl->filename);
+    install->url = strdup(plugin_dl->url);
+    plugin_dl->silent = TRUE;
+
+    http_file_get(plugin_dl);
+
+    run_on_main_thread(_plugin_install_cb, install, _plugin_install_free);
 
     return NULL;
 }
@@ -50,118 +50,207 @@
 #include <curses.h>
 #endif
 
+#include "common.h"
 #include "log.h"
 #include "ui/window.h"
 #include "ui/buffer.h"
 
-#define MAX_BUFFER_SIZE     200
-#define STRDUP_OR_NULL(str) ((str) ? strdup(str) : NULL)
+#define BUFFER_INITIAL_CAPACITY 32
 
+// Entries are kept in a ring of slots that grows on demand up to max_size,
+// so idle windows stay small while busy ones can keep deep scrollback.
+// Logical index i lives at slot (head + i) % capacity.
+//
+// ids maps a message id to the oldest entry carrying it, further entries with
+// the same id (e.g. the last read marker) are chained through _next_with_id.
+// Each entry's _seq minus first_seq is its logical index.
+//
+// Deep scrollback would otherwise be millions of small allocations: the
+// text of an entry lives in a single block, its receipt inline, and the few
+// distinct senders of a window are interned in names (string -> refcount).
 struct prof_buff_t
 {
-    GSList* entries;
+    ProfBuffEntry** entries;
+    int capacity;
+    int head;
+    int size;
+    int max_size;
     int lines;
+    gint64 first_seq;
+    GHashTable* ids;
+    GHashTable* names;
 };
 
-static void _free_entry(ProfBuffEntry* entry);
-static ProfBuffEntry* _create_entry(const char* show_char, int pad_indent, GDateTime* time, int flags, theme_item_t theme_item, const char* const display_from, const char* const from_jid, const char* const message, DeliveryReceipt* receipt, const char* const id, int y_start_pos, int y_end_pos);
-static void _buffer_add(ProfBuff buffer, const char* show_char, int pad_indent, GDateTime* time, int flags, theme_item_t theme_item, const char* const display_from, const char* const from_jid, const char* const message, DeliveryReceipt* receipt, const char* const id, int y_start_pos, int y_end_pos, gboolean append);
+static void _free_entry(ProfBuff buffer, ProfBuffEntry* entry);
+static ProfBuffEntry* _create_entry(ProfBuff buffer, const char* show_char, int pad_indent, GDateTime* time, int flags, theme_item_t theme_item, const char* const display_from, const char* const from_jid, const char* const message, const DeliveryReceipt* receipt, const char* const id, int y_start_pos, int y_end_pos);
+static void _buffer_add(ProfBuff buffer, const char* show_char, int pad_indent, GDateTime* time, int flags, theme_item_t theme_item, const char* const display_from, const char* const from_jid, const char* const message, const DeliveryReceipt* receipt, const char* const id, int y_start_pos, int y_end_pos, gboolean append);
+static int _slot(ProfBuff buffer, int entry);
+static void _grow(ProfBuff buffer);
+static void _remove_first(ProfBuff buffer);
+static void _remove_last(ProfBuff buffer);
+static void _index_add(ProfBuff buffer, ProfBuffEntry* e, gboolean append);
+static void _index_remove(ProfBuff buffer, ProfBuffEntry* e);
+static const char* _name_ref(ProfBuff buffer, const char* const name);
+static void _name_unref(ProfBuff buffer, const char* const name);
+static char* _pack_text(const char* show_char, const char* const message, const char* const id, const char** show_char_out, const char** message_out, const char** id_out);
 
 ProfBuff
-buffer_create(void)
+buffer_create(int max_size)
 {
     ProfBuff new_buff = malloc(sizeof(struct prof_buff_t));
-    new_buff->entries = NULL;
+    new_buff->max_size = max_size > 0 ? max_size : 1;
+    new_buff->capacity = MIN(BUFFER_INITIAL_CAPACITY, new_buff->max_size);
+    new_buff->entries = malloc(sizeof(ProfBuffEntry*) * new_buff->capacity);
+    new_buff->head = 0;
+    new_buff->size = 0;
     new_buff->lines = 0;
+    new_buff->first_seq = 0;
+    new_buff->ids = g_hash_table_new(g_str_hash, g_str_equal);
+    new_buff->names = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
     return new_buff;
 }
 
 int
 buffer_size(ProfBuff buffer)
 {
-    return g_slist_length(buffer->entries);
+    return buffer->size;
+}
+
+int
+buffer_max_size(ProfBuff buffer)
+{
+    return buffer->max_size;
+}
+
+int
+buffer_set_max_size(ProfBuff buffer, int max_size)
+{
+    if (max_size < 1) {
+        max_size = 1;
+    }
+
+    int removed = 0;
+    while (buffer->size > max_size) {
+        _remove_first(buffer);
+        removed++;
+    }
+    buffer->max_size = max_size;
+
+    return removed;
 }
 
 void
 buffer_free(ProfBuff buffer)
 {
-    g_slist_free_full(buffer->entries, (GDestroyNotify)_free_entry);
+    for (int i = 0; i < buffer->size; i++) {
+        _free_entry(buffer, buffer->entries[_slot(buffer, i)]);
+    }
+    free(buffer->entries);
+    g_hash_table_destroy(buffer->ids);
+    g_hash_table_destroy(buffer->names);
     free(buffer);
 }
 
 void
-buffer_append(ProfBuff buffer, const char* show_char, int pad_indent, GDateTime* time, int flags, theme_item_t theme_item, const char* const display_from, const char* const from_jid, const char* const message, DeliveryReceipt* receipt, const char* const id, int y_start_pos, int y_end_pos)
+buffer_append(ProfBuff buffer, const char* show_char, int pad_indent, GDateTime* time, int flags, theme_item_t theme_item, const char* const display_from, const char* const from_jid, const char* const message, const DeliveryReceipt* receipt, const char* const id, int y_start_pos, int y_end_pos)
 {
     _buffer_add(buffer, show_char, pad_indent, time, flags, theme_item, display_from, from_jid, message, receipt, id, y_start_pos, y_end_pos, TRUE);
 }
 
 void
-buffer_prepend(ProfBuff buffer, const char* show_char, int pad_indent, GDateTime* time, int flags, theme_item_t theme_item, const char* const display_from, const char* const from_jid, const char* const message, DeliveryReceipt* receipt, const char* const id, int y_start_pos, int y_end_pos)
+buffer_prepend(ProfBuff buffer, const char* show_char, int pad_indent, GDateTime* time, int flags, theme_item_t theme_item, const char* const display_from, const char* const from_jid, const char* const message, const DeliveryReceipt* receipt, const char* const id, int y_start_pos, int y_end_pos)
 {
     _buffer_add(buffer, show_char, pad_indent, time, flags, theme_item, display_from, from_jid, message, receipt, id, y_start_pos, y_end_pos, FALSE);
 }
 
 static void
-_buffer_add(ProfBuff buffer, const char* show_char, int pad_indent, GDateTime* time, int flags, theme_item_t theme_item, const char* const display_from, const char* const from_jid, const char* const message, DeliveryReceipt* receipt, const char* const id, int y_start_pos, int y_end_pos, gboolean append)
+_buffer_add(ProfBuff buffer, const char* show_char, int pad_indent, GDateTime* time, int flags, theme_item_t theme_item, const char* const display_from, const char* const from_jid, const char* const message, const DeliveryReceipt* receipt, const char* const id, int y_start_pos, int y_end_pos, gboolean append)
 {
-    ProfBuffEntry* e = _create_entry(show_char, pad_indent, time, flags, theme_item, display_from, from_jid, message, receipt, id, y_start_pos, y_end_pos);
+    ProfBuffEntry* e = _create_entry(buffer, show_char, pad_indent, time, flags, theme_item, display_from, from_jid, message, receipt, id, y_start_pos, y_end_pos);
 
     buffer->lines += e->_lines;
 
-    while (g_slist_length(buffer->entries) >= MAX_BUFFER_SIZE) {
-        GSList* buffer_entry_to_delete = append ? buffer->entries : g_slist_last(buffer->entries);
-        ProfBuffEntry* entry_to_delete = (ProfBuffEntry*)buffer_entry_to_delete->data;
-        buffer->lines -= entry_to_delete->_lines;
-        _free_entry(entry_to_delete);
-        buffer->entries = g_slist_delete_link(buffer->entries, buffer_entry_to_delete);
+    // evict from the opposite end to the one we are adding to
+    while (buffer->size >= buffer->max_size) {
+        if (append) {
+            _remove_first(buffer);
+        } else {
+            _remove_last(buffer);
+        }
     }
 
-    if (from_jid && y_end_pos == y_start_pos) {
+    if (from_jid && y_start_pos >= 0 && y_end_pos == y_start_pos) {
         log_warning("Ncurses Overflow! From: %s, pos: %d, ID: %s, message: %s", from_jid, y_end_pos, id, message);
     }
 
-    buffer->entries = append ? g_slist_append(buffer->entries, e) : g_slist_prepend(buffer->entries, e);
+    if (buffer->size == buffer->capacity) {
+        _grow(buffer);
+    }
+
+    if (append) {
+        e->_seq = buffer->first_seq + buffer->size;
+        buffer->entries[_slot(buffer, buffer->size)] = e;
+    } else {
+        buffer->first_seq--;
+        e->_seq = buffer->first_seq;
+        buffer->head = (buffer->head + buffer->capacity - 1) % buffer->capacity;
+        buffer->entries[buffer->head] = e;
+    }
+    buffer->size++;
+
+    _index_add(buffer, e, append);
 }
 
 void
 buffer_remove_entry_by_id(ProfBuff buffer, const char* const id)
 {
-    GSList* entries = buffer->entries;
-    while (entries) {
-        ProfBuffEntry* entry = entries->data;
-        if (entry->id && (g_strcmp0(entry->id, id) == 0)) {
-            buffer->lines -= entry->_lines;
-            _free_entry(entry);
-            buffer->entries = g_slist_delete_link(buffer->entries, entries);
-            break;
-        }
-        entries = g_slist_next(entries);
+    ProfBuffEntry* e = buffer_get_entry_by_id(buffer, id);
+    if (e) {
+        buffer_remove_entry(buffer, e->_seq - buffer->first_seq);
     }
 }
 
 void
 buffer_remove_entry(ProfBuff buffer, int entry)
 {
-    GSList* node = g_slist_nth(buffer->entries, entry);
-    ProfBuffEntry* e = node->data;
+    if (entry < 0 || entry >= buffer->size) {
+        return;
+    }
+
+    ProfBuffEntry* e = buffer->entries[_slot(buffer, entry)];
     buffer->lines -= e->_lines;
-    _free_entry(node->data);
-    buffer->entries = g_slist_delete_link(buffer->entries, node);
+    _index_remove(buffer, e);
+    _free_entry(buffer, e);
+
+    // close the gap by shifting whichever side is shorter
+    if (entry < buffer->size / 2) {
+        for (int i = entry; i > 0; i--) {
+            ProfBuffEntry* moved = buffer->entries[_slot(buffer, i - 1)];
+            moved->_seq++;
+            buffer->entries[_slot(buffer, i)] = moved;
+        }
+        buffer->head = (buffer->head + 1) % buffer->capacity;
+        buffer->first_seq++;
+    } else {
+        for (int i = entry; i < buffer->size - 1; i++) {
+            ProfBuffEntry* moved = buffer->entries[_slot(buffer, i + 1)];
+            moved->_seq--;
+            buffer->entries[_slot(buffer, i)] = moved;
+        }
+    }
+    buffer->size--;
 }
 
 gboolean
 buffer_mark_received(ProfBuff buffer, const char* const id)
 {
-    GSList* entries = buffer->entries;
-    while (entries) {
-        ProfBuffEntry* entry = entries->data;
-        if (entry->receipt && g_strcmp0(entry->id, id) == 0) {
-            if (!entry->receipt->received) {
-                entry->receipt->received = TRUE;
-                return TRUE;
-            }
+    ProfBuffEntry* entry = buffer_get_entry_by_id(buffer, id);
+    while (entry) {
+        if (entry->receipt && !entry->receipt->received) {
+            entry->receipt->received = TRUE;
+            return TRUE;
         }
-        entries = g_slist_next(entries);
+        entry = entry->_next_with_id;
     }
 
     return FALSE;
@@ -170,55 +259,268 @@ buffer_mark_received(ProfBuff buffer, const char* const id)
 ProfBuffEntry*
 buffer_get_entry(ProfBuff buffer, int entry)
 {
-    GSList* node = g_slist_nth(buffer->entries, entry);
-    return node->data;
+    if (entry < 0 || entry >= buffer->size) {
+        return NULL;
+    }
+
+    return buffer->entries[_slot(buffer, entry)];
 }
 
 ProfBuffEntry*
 buffer_get_entry_by_id(ProfBuff buffer, const char* const id)
 {
-    GSList* entries = buffer->entries;
-    while (entries) {
-        ProfBuffEntry* entry = entries->data;
-        if (g_strcmp0(entry->id, id) == 0) {
-            return entry;
+    if (id == NULL) {
+        return NULL;
+    }
+
+    return g_hash_table_lookup(buffer->ids, id);
+}
+
+#define STRLEN_OR_ZERO(str) ((str) ? strlen(str) + 1 : 0)
+
+// approximate heap use of the entries, walks the whole buffer
+gsize
+buffer_memory(ProfBuff buffer)
+{
+    gsize total = sizeof(struct prof_buff_t) + sizeof(ProfBuffEntry*) * buffer->capacity;
+    for (int i = 0; i < buffer->size; i++) {
+        ProfBuffEntry* e = buffer->entries[_slot(buffer, i)];
+        total += sizeof(ProfBuffEntry);
+        total += STRLEN_OR_ZERO(e->show_char) + STRLEN_OR_ZERO(e->message) + STRLEN_OR_ZERO(e->id);
+        if (e->_wrap) {
+            total += sizeof(ProfWrap) + sizeof(ProfWrapSeg) * e->_wrap->count;
+        }
+    }
+
+    GHashTableIter iter;
+    gpointer name;
+    g_hash_table_iter_init(&iter, buffer->names);
+    while (g_hash_table_iter_next(&iter, &name, NULL)) {
+        total += strlen(name) + 1;
+    }
+
+    return total;
+}
+
+// replaces the text of an entry in place, its id and position in the buffer stay
+void
+buffer_set_entry_message(ProfBuff buffer, ProfBuffEntry* entry, const char* show_char, const char* const message)
+{
+    // show_char may point into the old block, which also holds the id key
+    char* text = _pack_text(show_char, message, entry->id, &entry->show_char, &entry->message, &entry->id);
+    if (entry->id && g_hash_table_lookup(buffer->ids, entry->id) == entry) {
+        g_hash_table_replace(buffer->ids, (gpointer)entry->id, entry);
+    }
+    free(entry->_text);
+    entry->_text = text;
+    wrap_free(entry->_wrap);
+    entry->_wrap = NULL;
+}
+
+// a new reference in local time, or NULL when the entry has none
+GDateTime*
+buffer_entry_time(const ProfBuffEntry* entry)
+{
+    if (entry->time == 0) {
+        return NULL;
+    }
+
+    GDateTime* secs = g_date_time_new_from_unix_local(entry->time / G_USEC_PER_SEC);
+    GDateTime* time = g_date_time_add(secs, entry->time % G_USEC_PER_SEC);
+    g_date_time_unref(secs);
+
+    return time;
+}
+
+static void
+_index_add(ProfBuff buffer, ProfBuffEntry* e, gboolean append)
+{
+    if (e->id == NULL) {
+        return;
+    }
+
+    ProfBuffEntry* first = g_hash_table_lookup(buffer->ids, e->id);
+    if (first == NULL) {
+        g_hash_table_insert(buffer->ids, (gpointer)e->id, e);
+    } else if (append) {
+        while (first->_next_with_id) {
+            first = first->_next_with_id;
+        }
+        first->_next_with_id = e;
+    } else {
+        e->_next_with_id = first;
+        g_hash_table_replace(buffer->ids, (gpointer)e->id, e);
+    }
+}
+
+static void
+_index_remove(ProfBuff buffer, ProfBuffEntry* e)
+{
+    if (e->id == NULL) {
+        return;
+    }
+
+    ProfBuffEntry* first = g_hash_table_lookup(buffer->ids, e->id);
+    if (first == e) {
+        if (e->_next_with_id) {
+            g_hash_table_replace(buffer->ids, (gpointer)e->_next_with_id->id, e->_next_with_id);
+        } else {
+            g_hash_table_remove(buffer->ids, e->id);
         }
-        entries = g_slist_next(entries);
+        return;
+    }
+
+    while (first && first->_next_with_id != e) {
+        first = first->_next_with_id;
+    }
+    if (first) {
+        first->_next_with_id = e->_next_with_id;
+    }
+}
+
+static const char*
+_name_ref(ProfBuff buffer, const char* const name)
+{
+    if (name == NULL) {
+        return NULL;
+    }
+
+    gpointer key;
+    gpointer refs;
+    if (g_hash_table_lookup_extended(buffer->names, name, &key, &refs)) {
+        g_hash_table_insert(buffer->names, key, GUINT_TO_POINTER(GPOINTER_TO_UINT(refs) + 1));
+        return key;
+    }
+
+    key = g_strdup(name);
+    g_hash_table_insert(buffer->names, key, GUINT_TO_POINTER(1));
+    return key;
+}
+
+static void
+_name_unref(ProfBuff buffer, const char* const name)
+{
+    gpointer key;
+    gpointer refs;
+    if (name == NULL || !g_hash_table_lookup_extended(buffer->names, name, &key, &refs)) {
+        return;
     }
 
-    return NULL;
+    if (GPOINTER_TO_UINT(refs) > 1) {
+        g_hash_table_insert(buffer->names, key, GUINT_TO_POINTER(GPOINTER_TO_UINT(refs) - 1));
+    } else {
+        g_hash_table_remove(buffer->names, key);
+    }
+}
+
+// copies the strings into one block and points the outputs into it,
+// reads all inputs before writing any output so they may alias the outputs
+static char*
+_pack_text(const char* show_char, const char* const message, const char* const id, const char** show_char_out, const char** message_out, const char** id_out)
+{
+    const char* strs[] = { show_char, message, id };
+    gsize lens[ARRAY_SIZE(strs)];
+    gsize total = 0;
+    for (int i = 0; i < ARRAY_SIZE(strs); i++) {
+        lens[i] = strs[i] ? strlen(strs[i]) + 1 : 0;
+        total += lens[i];
+    }
+
+    char* text = total ? malloc(total) : NULL;
+    const char* packed[ARRAY_SIZE(strs)];
+    char* pos = text;
+    for (int i = 0; i < ARRAY_SIZE(strs); i++) {
+        packed[i] = strs[i] ? memcpy(pos, strs[i], lens[i]) : NULL;
+        pos += lens[i];
+    }
+
+    *show_char_out = packed[0];
+    *message_out = packed[1];
+    *id_out = packed[2];
+
+    return text;
+}
+
+static int
+_slot(ProfBuff buffer, int entry)
+{
+    return (buffer->head + entry) % buffer->capacity;
+}
+
+static void
+_grow(ProfBuff buffer)
+{
+    int new_capacity = MIN(buffer->capacity * 2, buffer->max_size);
+    if (new_capacity <= buffer->capacity) {
+        new_capacity = buffer->capacity + 1;
+    }
+
+    ProfBuffEntry** entries = malloc(sizeof(ProfBuffEntry*) * new_capacity);
+    for (int i = 0; i < buffer->size; i++) {
+        entries[i] = buffer->entries[_slot(buffer, i)];
+    }
+
+    free(buffer->entries);
+    buffer->entries = entries;
+    buffer->capacity = new_capacity;
+    buffer->head = 0;
+}
+
+static void
+_remove_first(ProfBuff buffer)
+{
+    ProfBuffEntry* e = buffer->entries[buffer->head];
+    buffer->lines -= e->_lines;
+    _index_remove(buffer, e);
+    _free_entry(buffer, e);
+    buffer->head = (buffer->head + 1) % buffer->capacity;
+    buffer->first_seq++;
+    buffer->size--;
+}
+
+static void
+_remove_last(ProfBuff buffer)
+{
+    ProfBuffEntry* e = buffer->entries[_slot(buffer, buffer->size - 1)];
+    buffer->lines -= e->_lines;
+    _index_remove(buffer, e);
+    _free_entry(buffer, e);
+    buffer->size--;
 }
 
 static ProfBuffEntry*
-_create_entry(const char* show_char, int pad_indent, GDateTime* time, int flags, theme_item_t theme_item, const char* const display_from, const char* const from_jid, const char* const message, DeliveryReceipt* receipt, const char* const id, int y_start_pos, int y_end_pos)
+_create_entry(ProfBuff buffer, const char* show_char, int pad_indent, GDateTime* time, int flags, theme_item_t theme_item, const char* const display_from, const char* const from_jid, const char* const message, const DeliveryReceipt* receipt, const char* const id, int y_start_pos, int y_end_pos)
 {
     ProfBuffEntry* e = malloc(sizeof(struct prof_buff_entry_t));
-    e->show_char = STRDUP_OR_NULL(show_char);
+    e->_text = _pack_text(show_char, message, id, &e->show_char, &e->message, &e->id);
     e->pad_indent = pad_indent;
     e->flags = flags;
     e->theme_item = theme_item;
-    e->time = g_date_time_ref(time);
-    e->display_from = STRDUP_OR_NULL(display_from);
-    e->from_jid = STRDUP_OR_NULL(from_jid);
-    e->message = STRDUP_OR_NULL(message);
-    e->receipt = receipt;
-    e->id = STRDUP_OR_NULL(id);
+    e->time = time ? g_date_time_to_unix(time) * G_USEC_PER_SEC + g_date_time_get_microsecond(time) : 0;
+    e->display_from = _name_ref(buffer, display_from);
+    e->from_jid = _name_ref(buffer, from_jid);
+    if (receipt) {
+        e->_receipt = *receipt;
+        e->receipt = &e->_receipt;
+    } else {
+        e->receipt = NULL;
+    }
     e->y_start_pos = y_start_pos;
     e->y_end_pos = y_end_pos;
     e->_lines = e->y_end_pos - e->y_start_pos;
+    e->_seq = 0;
+    e->_next_with_id = NULL;
+    e->_wrap = NULL;
 
     return e;
 }
 
 static void
-_free_entry(ProfBuffEntry* entry)
-{
-    free(entry->show_char);
-    free(entry->message);
-    free(entry->display_from);
-    free(entry->from_jid);
-    free(entry->id);
-    free(entry->receipt);
-    g_date_time_unref(entry->time);
+_free_entry(ProfBuff buffer, ProfBuffEntry* entry)
+{
+    _name_unref(buffer, entry->display_from);
+    _name_unref(buffer, entry->from_jid);
+    free(entry->_text);
+    wrap_free(entry->_wrap);
     free(entry);
 }
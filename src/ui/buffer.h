@@ -41,6 +41,7 @@
 
 #include "config.h"
 #include "config/theme.h"
+#include "ui/wrap.h"
 
 typedef struct delivery_receipt_t
 {
@@ -50,35 +51,52 @@ typedef struct delivery_receipt_t
 typedef struct prof_buff_entry_t
 {
     // pointer because it could be a unicode symbol as well
-    gchar* show_char;
+    const char* show_char;
     int pad_indent;
+    // -1 until the entry has been laid out in the window's pad
     int y_start_pos;
     int y_end_pos;
     int _lines;
-    GDateTime* time;
+    // microseconds since the epoch, 0 when the entry has no time
+    gint64 time;
     int flags;
     theme_item_t theme_item;
     // from as it is displayed
     // might be nick, jid..
-    char* display_from;
-    char* from_jid;
-    char* message;
+    // both are interned per buffer
+    const char* display_from;
+    const char* from_jid;
+    const char* message;
+    // points at _receipt, NULL when no receipt was requested
     DeliveryReceipt* receipt;
     // message id, in case we have it
-    char* id;
+    const char* id;
+    // line breaks from the last redraw, to be dropped when message changes
+    ProfWrap* _wrap;
+    // bookkeeping for the buffer's id index, owned by buffer.c
+    gint64 _seq;
+    struct prof_buff_entry_t* _next_with_id;
+    DeliveryReceipt _receipt;
+    // show_char, message and id packed in one allocation
+    char* _text;
 } ProfBuffEntry;
 
 typedef struct prof_buff_t* ProfBuff;
 
-ProfBuff buffer_create();
+ProfBuff buffer_create(int max_size);
 void buffer_free(ProfBuff buffer);
-void buffer_append(ProfBuff buffer, const char* show_char, int pad_indent, GDateTime* time, int flags, theme_item_t theme_item, const char* const display_from, const char* const barejid, const char* const message, DeliveryReceipt* receipt, const char* const id, int y_start_pos, int y_end_pos);
-void buffer_prepend(ProfBuff buffer, const char* show_char, int pad_indent, GDateTime* time, int flags, theme_item_t theme_item, const char* const display_from, const char* const barejid, const char* const message, DeliveryReceipt* receipt, const char* const id, int y_start_pos, int y_end_pos);
+int buffer_max_size(ProfBuff buffer);
+int buffer_set_max_size(ProfBuff buffer, int max_size);
+void buffer_append(ProfBuff buffer, const char* show_char, int pad_indent, GDateTime* time, int flags, theme_item_t theme_item, const char* const display_from, const char* const barejid, const char* const message, const DeliveryReceipt* receipt, const char* const id, int y_start_pos, int y_end_pos);
+void buffer_prepend(ProfBuff buffer, const char* show_char, int pad_indent, GDateTime* time, int flags, theme_item_t theme_item, const char* const display_from, const char* const barejid, const char* const message, const DeliveryReceipt* receipt, const char* const id, int y_start_pos, int y_end_pos);
 void buffer_remove_entry_by_id(ProfBuff buffer, const char* const id);
 void buffer_remove_entry(ProfBuff buffer, int entry);
 int buffer_size(ProfBuff buffer);
 ProfBuffEntry* buffer_get_entry(ProfBuff buffer, int entry);
 ProfBuffEntry* buffer_get_entry_by_id(ProfBuff buffer, const char* const id);
 gboolean buffer_mark_received(ProfBuff buffer, const char* const id);
+gsize buffer_memory(ProfBuff buffer);
+void buffer_set_entry_message(ProfBuff buffer, ProfBuffEntry* entry, const char* show_char, const char* const message);
+GDateTime* buffer_entry_time(const ProfBuffEntry* entry);
 
 #endif
@@ -60,7 +60,14 @@
 #include "omemo/omemo.h"
 #endif
 
+// Scrolled back into the database a window keeps only this many entries,
+// the lines dropped at the other end are paged back in from the database.
+#define CHATWIN_HISTORY_VIEW_SIZE (10 * MESSAGES_TO_RETRIEVE)
+
 static void _chatwin_history(ProfChatWin* chatwin, const char* const contact_barejid);
+static gboolean _chatwin_db_history_prev(ProfChatWin* chatwin);
+static void _chatwin_history_view_trim(ProfChatWin* chatwin, gboolean drop_newest);
+static void _chatwin_history_view_leave(ProfChatWin* chatwin);
 static void _chatwin_set_last_message(ProfChatWin* chatwin, const char* const id, const char* const message);
 
 gboolean
@@ -68,13 +75,12 @@ _pgp_automatic_start(const char* const recipient)
 {
     gboolean result = FALSE;
     char* account_name = session_get_account_name();
-    ProfAccount* account = accounts_get_account(account_name);
+    const ProfAccount* account = accounts_peek_account(account_name);
 
-    if (g_list_find_custom(account->pgp_enabled, recipient, (GCompareFunc)g_strcmp0)) {
+    if (account && g_list_find_custom(account->pgp_enabled, recipient, (GCompareFunc)g_strcmp0)) {
         result = TRUE;
     }
 
-    account_free(account);
     return result;
 }
 
@@ -83,13 +89,12 @@ _ox_automatic_start(const char* const recipient)
 {
     gboolean result = FALSE;
     char* account_name = session_get_account_name();
-    ProfAccount* account = accounts_get_account(account_name);
+    const ProfAccount* account = accounts_peek_account(account_name);
 
-    if (g_list_find_custom(account->ox_enabled, recipient, (GCompareFunc)g_strcmp0)) {
+    if (account && g_list_find_custom(account->ox_enabled, recipient, (GCompareFunc)g_strcmp0)) {
         result = TRUE;
     }
 
-    account_free(account);
     return result;
 }
 
@@ -99,9 +104,10 @@ chatwin_new(const char* const barejid)
     ProfWin* window = wins_new_chat(barejid);
     ProfChatWin* chatwin = (ProfChatWin*)window;
 
-    if (!prefs_get_boolean(PREF_MAM) && (prefs_get_boolean(PREF_CHLOG) && prefs_get_boolean(PREF_HISTORY))) {
-        _chatwin_history(chatwin, barejid);
-    }
+    // history is loaded on first focus, windows opened by incoming
+    // messages only keep their unread count until then, unless the
+    // scrollback kept from closing the window is still current
+    chatwin->history_pending = !wins_reopen_closed_chat(chatwin);
 
     // if the contact is offline, show a message
     PContact contact = roster_get_contact(barejid);
@@ -148,12 +154,35 @@ chatwin_new(const char* const barejid)
         chatwin->is_ox = TRUE;
     }
 
+    return chatwin;
+}
+
+void
+chatwin_history_load(ProfChatWin* chatwin)
+{
+    assert(chatwin != NULL);
+
+    if (!chatwin->history_pending) {
+        return;
+    }
+    chatwin->history_pending = FALSE;
+
+    ProfWin* window = (ProfWin*)chatwin;
     if (prefs_get_boolean(PREF_MAM)) {
-        iq_mam_request(chatwin, NULL);
+        // catch up to the oldest line already shown
+        ProfBuffEntry* first = buffer_get_entry(window->layout->buffer, 0);
+        GDateTime* enddate = first ? buffer_entry_time(first) : NULL;
         win_print_loading_history(window);
+        iq_mam_request(chatwin, enddate);
+    } else if (prefs_get_boolean(PREF_CHLOG) && prefs_get_boolean(PREF_HISTORY)) {
+        if (buffer_size(window->layout->buffer) == 0) {
+            _chatwin_history(chatwin, chatwin->barejid);
+        } else {
+            // messages arrived while in the background, put the history above them
+            _chatwin_db_history_prev(chatwin);
+            chatwin->history_shown = TRUE;
+        }
     }
-
-    return chatwin;
 }
 
 void
@@ -310,8 +339,10 @@ chatwin_incoming_msg(ProfChatWin* chatwin, ProfMessage* message, gboolean win_cr
 
     char* old_plain = message->plain;
 
-    auto_char char* new_plain = plugins_pre_chat_message_display(message->from_jid->barejid, message->from_jid->resourcepart, strdup(message->plain));
-    message->plain = new_plain;
+    auto_char char* new_plain = plugins_pre_chat_message_display(message->from_jid->barejid, message->from_jid->resourcepart, message->plain);
+    if (new_plain) {
+        message->plain = new_plain;
+    }
 
     gboolean show_message = true;
 
@@ -338,6 +369,10 @@ chatwin_incoming_msg(ProfChatWin* chatwin, ProfMessage* message, gboolean win_cr
     gboolean is_current = wins_is_current(window);
     gboolean notify = prefs_do_chat_notify(is_current) && !message->is_mam;
 
+    if (show_message) {
+        _chatwin_history_view_leave(chatwin);
+    }
+
     // currently viewing chat window with sender
     if (wins_is_current(window)) {
         if (show_message) {
@@ -358,18 +393,13 @@ chatwin_incoming_msg(ProfChatWin* chatwin, ProfMessage* message, gboolean win_cr
             }
 
             chatwin->unread++;
+            wins_unread_changed((ProfWin*)chatwin);
         }
 
-        // TODO: so far we don't ask for MAM when incoming message occurs.
-        // Need to figure out:
-        // 1) only send IQ once
-        // 2) sort incoming messages on timestamp
-        // for now if experimental MAM is enabled we dont show no history from sql either
-
         // MUCPMs also get printed here. In their case we don't save any logs (because nick owners can change) and thus we shouldn't read logs
         // (and if we do we need to check the resourcepart)
-        if (!prefs_get_boolean(PREF_MAM) && prefs_get_boolean(PREF_CHLOG) && prefs_get_boolean(PREF_HISTORY) && message->type == PROF_MSG_TYPE_CHAT) {
-            _chatwin_history(chatwin, chatwin->barejid);
+        if (message->type != PROF_MSG_TYPE_CHAT) {
+            chatwin->history_pending = FALSE;
         }
 
         // show users status first, when receiving message via delayed delivery
@@ -416,7 +446,10 @@ chatwin_outgoing_msg(ProfChatWin* chatwin, const char* const message, char* id,
     auto_char char* enc_char = get_enc_char(enc_mode, chatwin->outgoing_char);
 
     const Jid* myjid = connection_get_jid();
-    auto_char char* display_message = plugins_pre_chat_message_display(myjid->barejid, myjid->resourcepart, strdup(message));
+    auto_char char* plugin_message = plugins_pre_chat_message_display(myjid->barejid, myjid->resourcepart, message);
+    const char* display_message = plugin_message ? plugin_message : message;
+
+    _chatwin_history_view_leave(chatwin);
 
     if (request_receipt && id) {
         win_print_outgoing_with_receipt((ProfWin*)chatwin, enc_char, "me", display_message, id, replace_id);
@@ -448,6 +481,7 @@ chatwin_outgoing_carbon(ProfChatWin* chatwin, ProfMessage* message)
 
     ProfWin* window = (ProfWin*)chatwin;
 
+    _chatwin_history_view_leave(chatwin);
     win_print_outgoing(window, enc_char, message->id, message->replace_id, message->plain);
     int num = wins_get_num(window);
     status_bar_active(num, WIN_CHAT, chatwin->barejid);
@@ -558,6 +592,17 @@ chatwin_unset_outgoing_char(ProfChatWin* chatwin)
     }
 }
 
+// history entries are ours to change, plugins' version replaces the text
+static void
+_chatwin_history_display(ProfMessage* msg)
+{
+    char* display_plain = plugins_pre_chat_message_display(msg->from_jid->barejid, msg->from_jid->resourcepart, msg->plain);
+    if (display_plain) {
+        free(msg->plain);
+        msg->plain = display_plain;
+    }
+}
+
 static void
 _chatwin_history(ProfChatWin* chatwin, const char* const contact_barejid)
 {
@@ -567,7 +612,7 @@ _chatwin_history(ProfChatWin* chatwin, const char* const contact_barejid)
 
         while (curr) {
             ProfMessage* msg = curr->data;
-            msg->plain = plugins_pre_chat_message_display(msg->from_jid->barejid, msg->from_jid->resourcepart, msg->plain);
+            _chatwin_history_display(msg);
             win_print_history((ProfWin*)chatwin, msg);
             curr = g_slist_next(curr);
         }
@@ -577,14 +622,117 @@ _chatwin_history(ProfChatWin* chatwin, const char* const contact_barejid)
     }
 }
 
+static gboolean
+_chatwin_db_history_prev(ProfChatWin* chatwin)
+{
+    ProfBuff buffer = ((ProfWin*)chatwin)->layout->buffer;
+
+    if (!chatwin->history_cursor) {
+        // a page never outgrows what trimming the view keeps of it
+        chatwin->history_cursor = log_database_history_cursor_new(chatwin->barejid, CHATWIN_HISTORY_VIEW_SIZE / 2);
+    }
+    ProfBuffEntry* first = buffer_get_entry(buffer, 0);
+    GDateTime* oldest_shown = first ? buffer_entry_time(first) : NULL;
+    GSList* history = log_database_history_cursor_prev(chatwin->history_cursor, oldest_shown);
+    if (oldest_shown) {
+        g_date_time_unref(oldest_shown);
+    }
+    gboolean has_items = history != NULL;
+
+    // the page is oldest first, prepend newest first to keep the order
+    history = g_slist_reverse(history);
+    for (GSList* curr = history; curr; curr = g_slist_next(curr)) {
+        ProfMessage* msg = curr->data;
+        _chatwin_history_display(msg);
+        win_print_old_history((ProfWin*)chatwin, msg);
+    }
+
+    g_slist_free_full(history, (GDestroyNotify)message_free);
+    if (has_items) {
+        _chatwin_history_view_trim(chatwin, TRUE);
+    }
+    win_redraw((ProfWin*)chatwin);
+
+    return has_items;
+}
+
+// Keeps memory flat however far back the user scrolls: lines at the end
+// away from the reader are dropped, they are still in the database.
+static void
+_chatwin_history_view_trim(ProfChatWin* chatwin, gboolean drop_newest)
+{
+    ProfBuff buffer = ((ProfWin*)chatwin)->layout->buffer;
+    if (buffer_size(buffer) <= CHATWIN_HISTORY_VIEW_SIZE) {
+        return;
+    }
+
+    // dropped lines must come back from the database as they were shown
+    auto_gchar gchar* pref_dblog = prefs_get_string(PREF_DBLOG);
+    if (g_strcmp0(pref_dblog, "on") != 0) {
+        return;
+    }
+
+    while (buffer_size(buffer) > CHATWIN_HISTORY_VIEW_SIZE) {
+        buffer_remove_entry(buffer, drop_newest ? buffer_size(buffer) - 1 : 0);
+    }
+
+    if (drop_newest) {
+        if (chatwin->history_view_end) {
+            g_date_time_unref(chatwin->history_view_end);
+        }
+        chatwin->history_view_end = buffer_entry_time(buffer_get_entry(buffer, buffer_size(buffer) - 1));
+    }
+}
+
+// A live line goes below the newest messages, so the dropped lines have to
+// be back first. Reading history is left for the newest page.
+static void
+_chatwin_history_view_leave(ProfChatWin* chatwin)
+{
+    if (!chatwin->history_view_end) {
+        return;
+    }
+
+    g_date_time_unref(chatwin->history_view_end);
+    chatwin->history_view_end = NULL;
+
+    ProfWin* window = (ProfWin*)chatwin;
+    ProfBuff buffer = window->layout->buffer;
+    while (buffer_size(buffer) > 0) {
+        buffer_remove_entry(buffer, buffer_size(buffer) - 1);
+    }
+    window->layout->paged = 0;
+    window->scroll_state = WIN_SCROLL_INNER;
+
+    _chatwin_db_history_prev(chatwin);
+}
+
 // Print history starting from start_time to end_time if end_time is null the
 // first entry's timestamp in the buffer is used. Flip true to prepend to buffer.
 // Timestamps should be in iso8601
 gboolean
 chatwin_db_history(ProfChatWin* chatwin, const char* start_time, char* end_time, gboolean flip)
 {
+    // plain scrolling up pages through the database with a cursor
+    if (flip && !start_time && !end_time) {
+        return _chatwin_db_history_prev(chatwin);
+    }
+
+    // paging down in the history view continues after the newest row shown,
+    // not after lines printed since
+    auto_gchar gchar* view_start = NULL;
+    if (!flip && chatwin->history_view_end) {
+        view_start = g_date_time_format_iso8601(chatwin->history_view_end);
+        start_time = view_start;
+    }
+
     if (!end_time) {
-        end_time = buffer_size(((ProfWin*)chatwin)->layout->buffer) == 0 ? NULL : g_date_time_format_iso8601(buffer_get_entry(((ProfWin*)chatwin)->layout->buffer, 0)->time);
+        ProfBuffEntry* first = buffer_get_entry(((ProfWin*)chatwin)->layout->buffer, 0);
+        GDateTime* first_time = first ? buffer_entry_time(first) : NULL;
+        if (first_time) {
+            end_time = g_date_time_format_iso8601(first_time);
+            g_date_time_unref(first_time);
+        }
     }
 
     GSList* history = log_database_get_previous_chat(chatwin->barejid, start_time, end_time, !flip, flip);
@@ -593,7 +741,7 @@ chatwin_db_history(ProfChatWin* chatwin, const char* start_time, char* end_time,
 
     while (curr) {
         ProfMessage* msg = curr->data;
-        msg->plain = plugins_pre_chat_message_display(msg->from_jid->barejid, msg->from_jid->resourcepart, msg->plain);
+        _chatwin_history_display(msg);
         if (flip) {
             win_print_old_history((ProfWin*)chatwin, msg);
         } else {
@@ -602,6 +750,16 @@ chatwin_db_history(ProfChatWin* chatwin, const char* start_time, char* end_time,
         curr = g_slist_next(curr);
     }
 
+    if (!flip && chatwin->history_view_end) {
+        g_date_time_unref(chatwin->history_view_end);
+        chatwin->history_view_end = NULL;
+        if (has_items) {
+            GDateTime* newest = ((ProfMessage*)g_slist_last(history)->data)->timestamp;
+            chatwin->history_view_end = newest ? g_date_time_ref(newest) : NULL;
+            _chatwin_history_view_trim(chatwin, FALSE);
+        }
+    }
+
     g_slist_free_full(history, (GDestroyNotify)message_free);
     win_redraw((ProfWin*)chatwin);
 
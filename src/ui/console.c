@@ -68,8 +68,29 @@
 
 static void _cons_splash_logo(void);
 static void _show_roster_contacts(GSList* list, gboolean show_groups);
+static void _cons_show_view(const char* const name, void (*render)(void));
+static void _cons_render_ui_prefs(void);
+static void _cons_render_desktop_prefs(void);
+static void _cons_render_chat_prefs(void);
+static void _cons_render_log_prefs(void);
+static void _cons_render_presence_prefs(void);
+static void _cons_render_connection_prefs(void);
+static void _cons_render_otr_prefs(void);
+static void _cons_render_pgp_prefs(void);
+static void _cons_render_omemo_prefs(void);
+static void _cons_render_ox_prefs(void);
 static GList* alert_list;
 
+// rendered preference listings, replayed as long as the preferences don't change
+typedef struct cons_view_t
+{
+    guint fingerprint;
+    GPtrArray* lines;
+} ConsView;
+
+static GHashTable* cons_views;
+static GPtrArray* cons_capture;
+
 void
 cons_debug(const char* const msg, ...)
 {
@@ -86,7 +107,11 @@ cons_show(const char* const msg, ...)
 {
     va_list arg;
     va_start(arg, msg);
-    win_println_va(wins_get_console(), THEME_DEFAULT, "-", msg, arg);
+    if (cons_capture) {
+        g_ptr_array_add(cons_capture, g_strdup_vprintf(msg, arg));
+    } else {
+        win_println_va(wins_get_console(), THEME_DEFAULT, "-", msg, arg);
+    }
     va_end(arg);
 }
 
@@ -408,6 +433,7 @@ cons_about(void)
     _cons_welcome_first_start();
 
     pnoutrefresh(console->layout->win, 0, 0, 1, 0, rows - 3, cols - 1);
+    win_invalidate_virtual();
 
     cons_alert(NULL);
 }
@@ -1224,6 +1250,16 @@ cons_wrap_setting(void)
         cons_show("Word wrap (/wrap)                   : OFF");
 }
 
+void
+cons_redraw_setting(void)
+{
+    gint rate = prefs_get_redraw_rate();
+    if (rate > 0)
+        cons_show("Screen updates (/redraw rate)       : %d per second", rate);
+    else
+        cons_show("Screen updates (/redraw rate)       : unlimited");
+}
+
 void
 cons_titlebar_setting(void)
 {
@@ -1380,6 +1416,24 @@ cons_rooms_cache_setting(void)
     }
 }
 
+void
+cons_url_setting(void)
+{
+    auto_gchar gchar* limit = prefs_get_string(PREF_URL_DOWNLOAD_LIMIT);
+    if (limit) {
+        cons_show("Download limit (/url limit)     : %s KiB/s", limit);
+    } else {
+        cons_show("Download limit (/url limit)     : OFF");
+    }
+
+    auto_gchar gchar* resize = prefs_get_string(PREF_URL_UPLOAD_RESIZE);
+    if (resize) {
+        cons_show("Resize images (/url resize)     : %s pixels", resize);
+    } else {
+        cons_show("Resize images (/url resize)     : OFF");
+    }
+}
+
 void
 cons_autoconnect_setting(void)
 {
@@ -1636,8 +1690,8 @@ cons_roster_setting(void)
         cons_show("Roster wrap (/roster)               : OFF");
 }
 
-void
-cons_show_ui_prefs(void)
+static void
+_cons_render_ui_prefs(void)
 {
     cons_show("UI preferences:");
     cons_show("");
@@ -1647,6 +1701,7 @@ cons_show_ui_prefs(void)
     cons_splash_setting();
     cons_winpos_setting();
     cons_wrap_setting();
+    cons_redraw_setting();
     cons_time_setting();
     cons_resource_setting();
     cons_vercheck_setting();
@@ -1657,6 +1712,8 @@ cons_show_ui_prefs(void)
     cons_wintitle_setting();
     cons_presence_setting();
     cons_inpblock_setting();
+    cons_fuzzy_setting();
+    cons_scrollback_setting();
     cons_titlebar_setting();
     cons_statusbar_setting();
     cons_mood_setting();
@@ -1747,6 +1804,13 @@ cons_notify_setting(void)
     else
         cons_show("Subscription requests (/notify sub) : OFF");
 
+    gint flood_rate = prefs_get_notify_room_flood();
+    if (flood_rate <= 0) {
+        cons_show("Room flood (/notify room)           : OFF");
+    } else {
+        cons_show("Room flood (/notify room)           : %d messages per second", flood_rate);
+    }
+
     gint remind_period = prefs_get_notify_remind();
     if (remind_period == 0) {
         cons_show("Reminder period (/notify remind)    : OFF");
@@ -1757,8 +1821,8 @@ cons_notify_setting(void)
     }
 }
 
-void
-cons_show_desktop_prefs(void)
+static void
+_cons_render_desktop_prefs(void)
 {
     cons_show("Desktop notification preferences:");
     cons_show("");
@@ -1820,6 +1884,21 @@ cons_history_setting(void)
         cons_show("Chat history (/history)       : ON");
     else
         cons_show("Chat history (/history)       : OFF");
+
+    auto_gchar gchar* retention = prefs_get_db_retention(NULL);
+    cons_show("Chat log retention            : %s", retention ? retention : "OFF");
+    GList* jids = prefs_get_db_retention_jids();
+    for (GList* curr = jids; curr; curr = g_list_next(curr)) {
+        auto_gchar gchar* policy = prefs_get_db_retention(curr->data);
+        cons_show("  %s : %s", (char*)curr->data, policy);
+    }
+    g_list_free_full(jids, g_free);
+
+    int archive = prefs_get_db_archive();
+    if (archive > 0)
+        cons_show("Chat log archive after        : %d days", archive);
+    else
+        cons_show("Chat log archive after        : OFF");
 }
 
 void
@@ -1831,6 +1910,15 @@ cons_carbons_setting(void)
         cons_show("Message carbons (/carbons)    : OFF");
 }
 
+void
+cons_csi_setting(void)
+{
+    if (prefs_get_boolean(PREF_CSI))
+        cons_show("Client state indication (/csi)            : ON");
+    else
+        cons_show("Client state indication (/csi)            : OFF");
+}
+
 void
 cons_receipts_setting(void)
 {
@@ -1845,8 +1933,8 @@ cons_receipts_setting(void)
         cons_show("Send receipts (/receipts)     : OFF");
 }
 
-void
-cons_show_chat_prefs(void)
+static void
+_cons_render_chat_prefs(void)
 {
     cons_show("Chat preferences:");
     cons_show("");
@@ -1872,6 +1960,17 @@ cons_inpblock_setting(void)
     }
 }
 
+void
+cons_scrollback_setting(void)
+{
+    cons_show("Scrollback console (/scrollback)    : %d lines", prefs_get_scrollback("console"));
+    cons_show("Scrollback chat (/scrollback)       : %d lines", prefs_get_scrollback("chat"));
+    cons_show("Scrollback muc (/scrollback)        : %d lines", prefs_get_scrollback("muc"));
+    cons_show("Scrollback config (/scrollback)     : %d lines", prefs_get_scrollback("config"));
+    cons_show("Scrollback private (/scrollback)    : %d lines", prefs_get_scrollback("private"));
+    cons_show("Scrollback xml (/scrollback)        : %d lines", prefs_get_scrollback("xml"));
+}
+
 void
 cons_statusbar_setting(void)
 {
@@ -1927,6 +2026,11 @@ cons_winpos_setting(void)
     cons_show("Status bar position (/statusbar)     : %d", placement->statusbar_pos);
     cons_show("Input window position (/inputwin)    : %d", placement->inputwin_pos);
     prefs_free_win_placement(placement);
+
+    if (prefs_get_boolean(PREF_MAINWIN_SCROLL))
+        cons_show("Main window scrolling (/mainwin)     : ON");
+    else
+        cons_show("Main window scrolling (/mainwin)     : OFF");
 }
 
 void
@@ -1945,6 +2049,11 @@ cons_log_setting(void)
     else
         cons_show("Shared log (/log shared)    : OFF");
 
+    if (prefs_get_boolean(PREF_LOG_COMPRESS))
+        cons_show("Compression (/log compress) : ON");
+    else
+        cons_show("Compression (/log compress) : OFF");
+
     log_level_t filter = log_get_filter();
     const gchar* level = log_string_from_level(filter);
     cons_show("Log level (/log level)      : %s", level);
@@ -1964,8 +2073,8 @@ cons_logging_setting(void)
         cons_show("Groupchat logging (/logging group)          : OFF");
 }
 
-void
-cons_show_log_prefs(void)
+static void
+_cons_render_log_prefs(void)
 {
     cons_show("Logging preferences:");
     cons_show("");
@@ -2022,8 +2131,8 @@ cons_autoaway_setting(void)
     }
 }
 
-void
-cons_show_presence_prefs(void)
+static void
+_cons_render_presence_prefs(void)
 {
     cons_show("Presence preferences:");
     cons_show("");
@@ -2035,6 +2144,8 @@ cons_show_presence_prefs(void)
         cons_show("Send last activity (/lastactivity)        : OFF");
     }
 
+    cons_csi_setting();
+
     cons_alert(NULL);
 }
 
@@ -2149,6 +2260,16 @@ cons_executable_setting(void)
     cons_show("Default '/vcard photo open' command (/executable vcard_photo)            : %s", vcard_cmd);
 }
 
+void
+cons_fuzzy_setting(void)
+{
+    if (prefs_get_boolean(PREF_COMPLETION_FUZZY)) {
+        cons_show("Fuzzy completion (/fuzzy)      : ON");
+    } else {
+        cons_show("Fuzzy completion (/fuzzy)      : OFF");
+    }
+}
+
 void
 cons_slashguard_setting(void)
 {
@@ -2167,6 +2288,7 @@ cons_mam_setting(void)
     } else {
         cons_show("Message Archive Management (XEP-0313) (/mam)    : OFF");
     }
+    cons_show("MAM page size (/mam pagesize)                   : %d", prefs_get_mam_pagesize());
 }
 
 void
@@ -2177,10 +2299,15 @@ cons_silence_setting(void)
     } else {
         cons_show("Block all messages from JIDs that are not in the roster (/silence)    : OFF");
     }
+    if (prefs_get_boolean(PREF_SILENCE_QUARANTINE)) {
+        cons_show("Hold back messages from JIDs that are not in the roster (/silence quarantine) : ON");
+    } else {
+        cons_show("Hold back messages from JIDs that are not in the roster (/silence quarantine) : OFF");
+    }
 }
 
-void
-cons_show_connection_prefs(void)
+static void
+_cons_render_connection_prefs(void)
 {
     cons_show("Connection preferences:");
     cons_show("");
@@ -2189,12 +2316,13 @@ cons_show_connection_prefs(void)
     cons_autoconnect_setting();
     cons_rooms_cache_setting();
     cons_strophe_setting();
+    cons_url_setting();
 
     cons_alert(NULL);
 }
 
-void
-cons_show_otr_prefs(void)
+static void
+_cons_render_otr_prefs(void)
 {
     cons_show("OTR preferences:");
     cons_show("");
@@ -2223,8 +2351,8 @@ cons_show_otr_prefs(void)
     cons_alert(NULL);
 }
 
-void
-cons_show_pgp_prefs(void)
+static void
+_cons_render_pgp_prefs(void)
 {
     cons_show("PGP preferences:");
     cons_show("");
@@ -2250,8 +2378,8 @@ cons_show_pgp_prefs(void)
     cons_alert(NULL);
 }
 
-void
-cons_show_omemo_prefs(void)
+static void
+_cons_render_omemo_prefs(void)
 {
     cons_show("OMEMO preferences:");
     cons_show("");
@@ -2274,8 +2402,8 @@ cons_show_omemo_prefs(void)
     cons_alert(NULL);
 }
 
-void
-cons_show_ox_prefs(void)
+static void
+_cons_render_ox_prefs(void)
 {
     cons_show("OX preferences:");
     cons_show("");
@@ -2349,6 +2477,66 @@ cons_show_script(const char* const script, GSList* commands)
     cons_alert(NULL);
 }
 
+void
+cons_show_ui_prefs(void)
+{
+    _cons_show_view("ui", _cons_render_ui_prefs);
+}
+
+void
+cons_show_desktop_prefs(void)
+{
+    _cons_show_view("desktop", _cons_render_desktop_prefs);
+}
+
+void
+cons_show_chat_prefs(void)
+{
+    _cons_show_view("chat", _cons_render_chat_prefs);
+}
+
+void
+cons_show_log_prefs(void)
+{
+    _cons_show_view("log", _cons_render_log_prefs);
+}
+
+void
+cons_show_presence_prefs(void)
+{
+    _cons_show_view("presence", _cons_render_presence_prefs);
+}
+
+void
+cons_show_connection_prefs(void)
+{
+    _cons_show_view("connection", _cons_render_connection_prefs);
+}
+
+void
+cons_show_otr_prefs(void)
+{
+    _cons_show_view("otr", _cons_render_otr_prefs);
+}
+
+void
+cons_show_pgp_prefs(void)
+{
+    _cons_show_view("pgp", _cons_render_pgp_prefs);
+}
+
+void
+cons_show_omemo_prefs(void)
+{
+    _cons_show_view("omemo", _cons_render_omemo_prefs);
+}
+
+void
+cons_show_ox_prefs(void)
+{
+    _cons_show_view("ox", _cons_render_ox_prefs);
+}
+
 void
 cons_prefs(void)
 {
@@ -2826,6 +3014,50 @@ cons_clear_alerts(void)
     alert_list = NULL;
 }
 
+void
+cons_clear_views(void)
+{
+    if (cons_views) {
+        g_hash_table_destroy(cons_views);
+        cons_views = NULL;
+    }
+}
+
+static void
+_cons_view_free(ConsView* view)
+{
+    g_ptr_array_free(view->lines, TRUE);
+    g_free(view);
+}
+
+static void
+_cons_show_view(const char* const name, void (*render)(void))
+{
+    guint fingerprint = prefs_fingerprint();
+
+    if (!cons_views) {
+        cons_views = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, (GDestroyNotify)_cons_view_free);
+    }
+
+    ConsView* view = g_hash_table_lookup(cons_views, name);
+    if (!view || view->fingerprint != fingerprint) {
+        view = g_new0(ConsView, 1);
+        view->fingerprint = fingerprint;
+        view->lines = g_ptr_array_new_with_free_func(g_free);
+        cons_capture = view->lines;
+        render();
+        cons_capture = NULL;
+        g_hash_table_replace(cons_views, (gpointer)name, view);
+    }
+
+    ProfWin* console = wins_get_console();
+    for (guint i = 0; i < view->lines->len; i++) {
+        win_println(console, THEME_DEFAULT, "-", "%s", (char*)g_ptr_array_index(view->lines, i));
+    }
+
+    cons_alert(NULL);
+}
+
 void
 cons_remove_alert(ProfWin* window)
 {
@@ -2858,6 +3090,12 @@ cons_strophe_setting(void)
     }
     cons_show("XEP-0198 Stream-Management                : %s", sm_setting);
     cons_show("libstrophe Verbosity                      : %s", prefs_get_string(PREF_STROPHE_VERBOSITY));
+    gint iq_inflight = prefs_get_iq_inflight();
+    if (iq_inflight == 0) {
+        cons_show("In-flight requests per domain             : unlimited");
+    } else {
+        cons_show("In-flight requests per domain             : %d", iq_inflight);
+    }
 }
 
 void
@@ -57,8 +57,10 @@
 
 #include "log.h"
 #include "common.h"
+#include "stats.h"
 #include "command/cmd_defs.h"
 #include "command/cmd_ac.h"
+#include "config/color.h"
 #include "config/preferences.h"
 #include "config/theme.h"
 #include "ui/ui.h"
@@ -80,19 +82,39 @@
 
 static int inp_size;
 static gboolean perform_resize = FALSE;
+static guint ui_update_source = 0;
+static guint ui_dirty = 0;
+static gint64 ui_last_draw = 0;
+static gchar* term_title = NULL;
 static GTimer* ui_idle_time;
+static gboolean headless = FALSE;
+// set while closing several windows, the bars go back to the console once at the end
+static gboolean closing_many = FALSE;
 
 #ifdef HAVE_LIBXSS
 static Display* display;
 #endif
 
 static void _ui_draw_term_title(void);
+static gboolean _ui_update_cb(gpointer data);
+static void _ui_draw(guint parts);
+static void _ui_show_console_bars(void);
 
 void
 ui_init(void)
 {
     log_info("Initialising UI");
-    initscr();
+    if (headless) {
+        // windows keep working as buffers, curses only ever draws to /dev/null
+        FILE* null_out = fopen("/dev/null", "w");
+        FILE* null_in = fopen("/dev/null", "r");
+        if (!null_out || !null_in || !newterm("vt100", null_out, null_in)) {
+            log_error("Unable to set up headless screen");
+            exit(EXIT_FAILURE);
+        }
+    } else {
+        initscr();
+    }
     nonl();
     cbreak();
     noecho();
@@ -119,34 +141,129 @@ ui_init(void)
     win_update_virtual(window);
 }
 
+// --headless, no terminal is used and nothing is drawn
+void
+ui_set_headless(void)
+{
+    headless = TRUE;
+}
+
 void
 ui_sigwinch_handler(int sig)
 {
     perform_resize = TRUE;
 }
 
+// request a screen update, all requests made while handling one main loop
+// iteration are served by a single update once the loop goes idle, or once
+// the interval of /redraw rate has passed since the last update
+void
+ui_mark_dirty(void)
+{
+    ui_mark_dirty_part(UI_DIRTY_ALL);
+}
+
+// like ui_mark_dirty() for changes that can only affect some parts, the
+// update then leaves the others alone
+void
+ui_mark_dirty_part(ui_dirty_t parts)
+{
+    ui_dirty |= parts;
+    if (ui_update_source != 0) {
+        return;
+    }
+
+    gint rate = prefs_get_redraw_rate();
+    gint64 wait = 0;
+    if (rate > 0) {
+        wait = ui_last_draw + G_USEC_PER_SEC / rate - g_get_monotonic_time();
+    }
+    if (wait > 0) {
+        ui_update_source = g_timeout_add(wait / 1000 + 1, _ui_update_cb, NULL);
+    } else {
+        ui_update_source = g_idle_add(_ui_update_cb, NULL);
+    }
+}
+
+// once a second, catch the changes nobody reports: the status bar clock and
+// an expired typing notification. With a /redraw rate the clock isn't worth
+// the output on its own and follows along with the next other update.
+void
+ui_tick(void)
+{
+    if (prefs_get_redraw_rate() == 0 && status_bar_time_changed()) {
+        ui_mark_dirty_part(UI_DIRTY_STATUSBAR);
+    }
+    if (title_bar_typing_shown()) {
+        ui_mark_dirty_part(UI_DIRTY_TITLEBAR);
+    }
+}
+
+static gboolean
+_ui_update_cb(gpointer data)
+{
+    ui_update_source = 0;
+    guint parts = ui_dirty;
+    ui_dirty = 0;
+    _ui_draw(parts);
+
+    return FALSE;
+}
+
 void
 ui_update(void)
 {
-    ProfWin* current = wins_get_current();
-    if (current->layout->paged == 0) {
-        win_move_to_end(current);
+    ui_dirty = 0;
+    _ui_draw(UI_DIRTY_ALL);
+}
+
+static void
+_ui_draw(guint parts)
+{
+    if (parts == 0 || headless) {
+        return;
     }
 
-    win_update_virtual(current);
+    gint64 start = g_get_monotonic_time();
+    ui_last_draw = start;
 
-    if (prefs_get_boolean(PREF_WINTITLE_SHOW)) {
+    if (parts & UI_DIRTY_WINDOW) {
+        ProfWin* current = wins_get_current();
+        if (current->type == WIN_XML) {
+            xmlwin_render((ProfXMLWin*)current);
+        }
+        if (current->layout->paged == 0) {
+            win_move_to_end(current);
+        }
+
+        rosterwin_roster_flush();
+        occupantswin_occupants_flush();
+        win_update_virtual(current);
+    }
+
+    if ((parts & (UI_DIRTY_WINDOW | UI_DIRTY_TITLEBAR)) && prefs_get_boolean(PREF_WINTITLE_SHOW)) {
         _ui_draw_term_title();
     }
-    title_bar_update_virtual();
-    status_bar_draw();
+    if (parts & UI_DIRTY_TITLEBAR) {
+        title_bar_update_virtual();
+    }
+    if (parts & UI_DIRTY_STATUSBAR) {
+        status_bar_draw();
+    }
     inp_put_back();
+
+    gint64 draw_start = g_get_monotonic_time();
     doupdate();
+    stats_time(STATS_TIMER_DOUPDATE, draw_start);
+    stats_latency_end();
+    color_pair_cache_screen_updated();
 
     if (perform_resize) {
         perform_resize = FALSE;
         ui_resize();
     }
+
+    stats_time(STATS_TIMER_UI_UPDATE, start);
 }
 
 unsigned long
@@ -184,6 +301,7 @@ ui_close(void)
 {
     notifier_uninit();
     cons_clear_alerts();
+    cons_clear_views();
     wins_destroy();
     inp_close();
     status_bar_close();
@@ -198,6 +316,7 @@ ui_resize(void)
     erase();
     resizeterm(w.ws_row, w.ws_col);
     refresh();
+    win_invalidate_virtual();
 
     log_debug("Resizing UI");
     title_bar_resize();
@@ -509,17 +628,25 @@ ui_close_all_wins(void)
     GList* win_nums = wins_get_nums();
     GList* curr = win_nums;
 
+    closing_many = TRUE;
     while (curr) {
         int num = GPOINTER_TO_INT(curr->data);
         if ((num != 1) && (!ui_win_has_unsaved_form(num))) {
             if (conn_status == JABBER_CONNECTED) {
                 ui_close_connected_win(num);
             }
-            ui_close_win(num);
+            // rooms are closed when they are left
+            if (wins_get_by_num(num)) {
+                ui_close_win(num);
+            }
             count++;
         }
         curr = g_list_next(curr);
     }
+    closing_many = FALSE;
+    if (count > 0) {
+        _ui_show_console_bars();
+    }
 
     g_list_free(curr);
     g_list_free(win_nums);
@@ -536,17 +663,25 @@ ui_close_read_wins(void)
     GList* win_nums = wins_get_nums();
     GList* curr = win_nums;
 
+    closing_many = TRUE;
     while (curr) {
         int num = GPOINTER_TO_INT(curr->data);
         if ((num != 1) && (ui_win_unread(num) == 0) && (!ui_win_has_unsaved_form(num))) {
             if (conn_status == JABBER_CONNECTED) {
                 ui_close_connected_win(num);
             }
-            ui_close_win(num);
+            // rooms are closed when they are left
+            if (wins_get_by_num(num)) {
+                ui_close_win(num);
+            }
             count++;
         }
         curr = g_list_next(curr);
     }
+    closing_many = FALSE;
+    if (count > 0) {
+        _ui_show_console_bars();
+    }
 
     g_list_free(curr);
     g_list_free(win_nums);
@@ -704,6 +839,14 @@ ui_close_win(int index)
     // remove the IQ handlers
     iq_handlers_remove_win(window);
     wins_close_by_num(index);
+    if (!closing_many) {
+        _ui_show_console_bars();
+    }
+}
+
+static void
+_ui_show_console_bars(void)
+{
     title_bar_console();
     status_bar_current(1);
     status_bar_active(1, WIN_CONSOLE, "console");
@@ -1079,6 +1222,8 @@ ui_clear_win_title(void)
 {
     fputs("\e]0;\a", stdout);
     fflush(stdout);
+    g_free(term_title);
+    term_title = NULL;
 }
 
 void
@@ -1086,11 +1231,15 @@ ui_goodbye_title(void)
 {
     fputs("\e]0;Thanks for using Profanity\a", stdout);
     fflush(stdout);
+    g_free(term_title);
+    term_title = NULL;
 }
 
+// the terminal title is only written when its text changes
 static void
 _ui_draw_term_title(void)
 {
+    gchar* title;
     jabber_conn_status_t status = connection_get_status();
 
     if (status == JABBER_CONNECTED) {
@@ -1098,13 +1247,22 @@ _ui_draw_term_title(void)
         gint unread = wins_get_total_unread();
 
         if (unread != 0) {
-            fprintf(stdout, "\e]0;Profanity (%d) - %s\a", unread, jid);
+            title = g_strdup_printf("Profanity (%d) - %s", unread, jid);
         } else {
-            fprintf(stdout, "\e]0;Profanity - %s\a", jid);
+            title = g_strdup_printf("Profanity - %s", jid);
         }
     } else {
-        fputs("\e]0;Profanity\a", stdout);
+        title = g_strdup("Profanity");
     }
+
+    if (g_strcmp0(title, term_title) == 0) {
+        g_free(title);
+        return;
+    }
+    g_free(term_title);
+    term_title = title;
+
+    fprintf(stdout, "\e]0;%s\a", term_title);
     fflush(stdout);
 }
 
@@ -43,12 +43,16 @@
 #include <string.h>
 #include <wchar.h>
 #include <sys/time.h>
+#include <unistd.h>
 #include <errno.h>
 #include <pthread.h>
+#include <sys/stat.h>
 
 #include <readline/readline.h>
 #include <readline/history.h>
 
+#include <glib/gstdio.h>
+
 #ifdef HAVE_NCURSESW_NCURSES_H
 #include <ncursesw/ncurses.h>
 #elif HAVE_NCURSES_H
@@ -60,6 +64,7 @@
 #include "profanity.h"
 #include "log.h"
 #include "common.h"
+#include "stats.h"
 #include "command/cmd_ac.h"
 #include "config/files.h"
 #include "config/accounts.h"
@@ -72,6 +77,7 @@
 #include "ui/window.h"
 #include "ui/window_list.h"
 #include "xmpp/xmpp.h"
+#include "xmpp/session.h"
 #include "xmpp/muc.h"
 #include "xmpp/roster_list.h"
 #include "xmpp/chat_state.h"
@@ -90,14 +96,38 @@ static fd_set fds;
 static int r;
 static char* inp_line = NULL;
 static gboolean get_password = FALSE;
+static gboolean terminal_focused = TRUE;
+
+// what _inp_write() last put in the pad, so the next write only redraws from
+// the first byte that changed. inp_shown_cols holds the column each byte of
+// the line starts at, plus one for the end of the line.
+static gboolean inp_shown_valid = FALSE;
+static char* inp_shown_prompt = NULL;
+static GString* inp_shown_line = NULL;
+static GArray* inp_shown_cols = NULL;
+
+// a paste arrives as a burst of input, readline is fed all of it that is
+// already waiting before the line is redisplayed once
+#define INP_BURST_MAX 4096
+// input history, at most this many lines for up-arrow and Ctrl-R, each once.
+// Sent lines are also appended to FILE_INPUT_HISTORY, which is read back on
+// start and rewritten then when it holds twice as many lines as are kept.
+#define INP_HISTORY_MAX 1000
+static FILE* history_file = NULL;
+
+static gboolean inp_burst = FALSE;
+static gboolean inp_burst_redisplay = FALSE;
 
 static void _inp_win_update_virtual(void);
 static int _inp_edited(const wint_t ch);
 static void _inp_win_handle_scroll(void);
-static int _inp_offset_to_col(char* str, int offset);
 static void _inp_write(char* line, int offset);
+static void _inp_write_from(const char* const line, size_t from);
+static gboolean _inp_pending(void);
 static void _inp_redisplay(void);
 
+static void _inp_history_load(void);
+static void _inp_history_add(const char* const line);
 static void _inp_rl_addfuncs(void);
 static int _inp_rl_getc(FILE* stream);
 static void _inp_rl_linehandler(char* line);
@@ -138,6 +168,11 @@ static int _inp_rl_startup_hook(void);
 static int _inp_rl_down_arrow_handler(int count, int key);
 static int _inp_rl_scroll_handler(int count, int key);
 static int _inp_rl_send_to_editor(int count, int key);
+static int _inp_rl_focus_in_handler(int count, int key);
+static int _inp_rl_focus_out_handler(int count, int key);
+static int _inp_rl_paste_handler(int count, int key);
+static void _inp_set_bracketed_paste(gboolean enabled);
+static void _inp_reset_completion(void);
 static int _inp_rl_print_newline_symbol(int count, int key);
 
 void
@@ -161,6 +196,15 @@ create_input_window(void)
     rl_redisplay_function = _inp_redisplay;
     rl_startup_hook = _inp_rl_startup_hook;
     rl_callback_handler_install(NULL, _inp_rl_linehandler);
+    _inp_history_load();
+
+    if (prefs_get_boolean(PREF_CSI)) {
+        inp_set_focus_reporting(TRUE);
+    }
+    _inp_set_bracketed_paste(TRUE);
+
+    inp_shown_line = g_string_new(NULL);
+    inp_shown_cols = g_array_new(FALSE, FALSE, sizeof(int));
 
     inp_win = newpad(1, INP_WIN_MAX);
     wbkgd(inp_win, theme_attrs(THEME_INPUT_TEXT));
@@ -174,13 +218,24 @@ create_input_window(void)
 static gboolean
 _inp_callback(GIOChannel* source, GIOCondition condition, gpointer data)
 {
+    gint64 start = stats_trace_begin();
+    inp_burst = TRUE;
     rl_callback_read_char();
+    for (int i = 1; i < INP_BURST_MAX && !inp_line && _inp_pending(); i++) {
+        rl_callback_read_char();
+    }
+    inp_burst = FALSE;
+    if (inp_burst_redisplay) {
+        inp_burst_redisplay = FALSE;
+        _inp_redisplay();
+    }
 
     if (rl_line_buffer && rl_line_buffer[0] != '/' && rl_line_buffer[0] != '\0' && rl_line_buffer[0] != '\n') {
         chat_state_activity();
     }
 
     ui_reset_idle_time();
+    ui_mark_dirty();
 
     if (inp_line) {
         ProfWin* window = wins_get_current();
@@ -191,6 +246,7 @@ _inp_callback(GIOChannel* source, GIOCondition condition, gpointer data)
         free(inp_line);
         inp_line = NULL;
     }
+    stats_span("input", start);
 
     return TRUE;
 }
@@ -216,9 +272,7 @@ inp_readline(void)
     FD_ZERO(&fds);
     FD_SET(fileno(rl_instream), &fds);
     errno = 0;
-    pthread_mutex_unlock(&lock);
     r = select(FD_SETSIZE, &fds, NULL, NULL, &p_rl_timeout);
-    pthread_mutex_lock(&lock);
     if (r < 0) {
         if (errno != EINTR) {
             const char* err_msg = strerror(errno);
@@ -307,8 +361,49 @@ inp_nonblocking(gboolean reset)
 void
 inp_close(void)
 {
+    inp_set_focus_reporting(FALSE);
+    _inp_set_bracketed_paste(FALSE);
     rl_callback_handler_remove();
     fclose(discard);
+    if (history_file) {
+        fclose(history_file);
+        history_file = NULL;
+    }
+    clear_history();
+
+    free(inp_shown_prompt);
+    inp_shown_prompt = NULL;
+    g_string_free(inp_shown_line, TRUE);
+    inp_shown_line = NULL;
+    g_array_free(inp_shown_cols, TRUE);
+    inp_shown_cols = NULL;
+    inp_shown_valid = FALSE;
+}
+
+void
+inp_set_focus_reporting(gboolean enabled)
+{
+    // xterm focus events, the terminal then sends \e[I and \e[O on focus changes
+    fputs(enabled ? "\033[?1004h" : "\033[?1004l", stdout);
+    fflush(stdout);
+
+    if (!enabled) {
+        terminal_focused = TRUE;
+    }
+}
+
+static void
+_inp_set_bracketed_paste(gboolean enabled)
+{
+    // the terminal then wraps pasted text in \e[200~ and \e[201~
+    fputs(enabled ? "\033[?2004h" : "\033[?2004l", stdout);
+    fflush(stdout);
+}
+
+gboolean
+inp_terminal_focused(void)
+{
+    return terminal_focused;
 }
 
 char*
@@ -316,6 +411,7 @@ inp_get_line(void)
 {
     werase(inp_win);
     wmove(inp_win, 0, 0);
+    inp_shown_valid = FALSE;
     _inp_win_update_virtual();
     doupdate();
     char* line = NULL;
@@ -332,6 +428,7 @@ inp_get_password(void)
 {
     werase(inp_win);
     wmove(inp_win, 0, 0);
+    inp_shown_valid = FALSE;
     _inp_win_update_virtual();
     doupdate();
     char* password = NULL;
@@ -364,44 +461,102 @@ _inp_win_update_virtual(void)
 static void
 _inp_write(char* line, int offset)
 {
-    int x;
-    int y __attribute__((unused));
-    int col = _inp_offset_to_col(line, offset);
-    werase(inp_win);
+    size_t from = 0;
+    if (!inp_shown_valid || g_strcmp0(inp_shown_prompt, rl_display_prompt) != 0) {
+        werase(inp_win);
+        waddstr(inp_win, rl_display_prompt);
+        free(inp_shown_prompt);
+        inp_shown_prompt = strdup(rl_display_prompt);
+        _inp_write_from(line, 0);
+        inp_shown_valid = TRUE;
+    } else {
+        // redraw from the start of the first character that differs
+        while (inp_shown_line->str[from] != '\0' && inp_shown_line->str[from] == line[from]) {
+            from++;
+        }
+        while (from > 0 && ((line[from] & 0xC0) == 0x80 || (inp_shown_line->str[from] & 0xC0) == 0x80)) {
+            from--;
+        }
+        if (inp_shown_line->str[from] != '\0' || line[from] != '\0') {
+            wmove(inp_win, 0, g_array_index(inp_shown_cols, int, from));
+            wclrtoeol(inp_win);
+            _inp_write_from(line, from);
+        }
+    }
+    g_string_truncate(inp_shown_line, from);
+    g_string_append(inp_shown_line, line + from);
 
-    waddstr(inp_win, rl_display_prompt);
-    getyx(inp_win, y, x);
-    col += x;
+    wmove(inp_win, 0, g_array_index(inp_shown_cols, int, MIN((gsize)offset, inp_shown_line->len)));
+    _inp_win_handle_scroll();
 
-    for (size_t i = 0; line[i] != '\0'; i++) {
-        char* c = &line[i];
-        char retc[PROF_MB_CUR_MAX] = { 0 };
+    _inp_win_update_virtual();
+    doupdate();
+}
 
-        size_t ch_len = mbrlen(c, MB_CUR_MAX, NULL);
-        if ((ch_len == (size_t)-2) || (ch_len == (size_t)-1)) {
-            waddch(inp_win, ' ');
+// write line from byte from to the end at the cursor, noting where each
+// byte's character starts
+static void
+_inp_write_from(const char* const line, size_t from)
+{
+    g_array_set_size(inp_shown_cols, from);
+
+    size_t i = from;
+    while (line[i] != '\0') {
+        int x = getcurx(inp_win);
+
+        // printable ASCII takes a column per byte, write it as one run
+        size_t run = i;
+        while ((unsigned char)line[run] >= 0x20 && (unsigned char)line[run] < 0x7f) {
+            int col = x + (run - i);
+            g_array_append_val(inp_shown_cols, col);
+            run++;
+        }
+        if (run > i) {
+            waddnstr(inp_win, &line[i], run - i);
+            i = run;
             continue;
         }
 
-        if (line[i] == '\n') {
+        const char* c = &line[i];
+        char retc[PROF_MB_CUR_MAX] = { 0 };
+        size_t ch_len = mbrlen(c, MB_CUR_MAX, NULL);
+        size_t consumed = ch_len;
+
+        if ((ch_len == (size_t)-2) || (ch_len == (size_t)-1)) {
+            c = " ";
+            ch_len = 1;
+            consumed = 1;
+        } else if (line[i] == '\n') {
             c = retc;
+            consumed = 1;
             ch_len = wctomb(retc, L'\u23ce'); /* return symbol */
             if (ch_len == -1) {               /* not representable */
                 retc[0] = '\\';
                 ch_len = 1;
             }
-        } else {
-            i += ch_len - 1;
         }
 
+        for (size_t j = 0; j < consumed; j++) {
+            g_array_append_val(inp_shown_cols, x);
+        }
         waddnstr(inp_win, c, ch_len);
+        i += consumed;
     }
 
-    wmove(inp_win, 0, col);
-    _inp_win_handle_scroll();
+    int end = getcurx(inp_win);
+    g_array_append_val(inp_shown_cols, end);
+}
 
-    _inp_win_update_virtual();
-    doupdate();
+// input that is already waiting to be read
+static gboolean
+_inp_pending(void)
+{
+    fd_set pending;
+    FD_ZERO(&pending);
+    FD_SET(fileno(rl_instream), &pending);
+    struct timeval no_wait = { 0, 0 };
+
+    return select(fileno(rl_instream) + 1, &pending, NULL, NULL, &no_wait) > 0;
 }
 
 static int
@@ -438,29 +593,6 @@ _inp_edited(const wint_t ch)
     return g_unichar_isprint(unichar);
 }
 
-static int
-_inp_offset_to_col(char* str, int offset)
-{
-    int i = 0;
-    int col = 0;
-
-    while (i < offset && str[i] != '\0') {
-        gunichar uni = g_utf8_get_char(&str[i]);
-        size_t ch_len = mbrlen(&str[i], MB_CUR_MAX, NULL);
-        if ((ch_len == (size_t)-2) || (ch_len == (size_t)-1)) {
-            i++;
-            continue;
-        }
-        i += ch_len;
-        col++;
-        if (g_unichar_iswide(uni)) {
-            col++;
-        }
-    }
-
-    return col;
-}
-
 static void
 _inp_win_handle_scroll(void)
 {
@@ -598,6 +730,11 @@ _inp_rl_startup_hook(void)
 
     rl_bind_keyseq("\\e\\C-\r", _inp_rl_print_newline_symbol); // alt+enter
 
+    rl_bind_keyseq("\\e[I", _inp_rl_focus_in_handler);
+    rl_bind_keyseq("\\e[O", _inp_rl_focus_out_handler);
+
+    rl_bind_keyseq("\\e[200~", _inp_rl_paste_handler);
+
     // unbind unwanted mappings
     rl_bind_keyseq("\\e=", NULL);
 
@@ -620,12 +757,104 @@ _inp_rl_linehandler(char* line)
     if (!line || !*line || get_password) {
         return;
     }
-    HISTORY_STATE* history = history_get_history_state();
-    HIST_ENTRY* last = history->length > 0 ? history->entries[history->length - 1] : NULL;
-    if (last == NULL || strcmp(last->line, line) != 0) {
-        add_history(line);
+    _inp_history_add(line);
+}
+
+// lines that can carry passwords or secrets stay out of the history file
+static gboolean
+_inp_history_private(const char* const line)
+{
+    static const char* const private_prefixes[] = {
+        "/account", "/connect", "/register", "/changepassword", "/otr secret", "/otr question"
+    };
+
+    if (line[0] != '/') {
+        // messages are only kept on disk by those who keep chat logs
+        return !prefs_get_boolean(PREF_CHLOG);
+    }
+    for (int i = 0; i < ARRAY_SIZE(private_prefixes); i++) {
+        if (g_str_has_prefix(line, private_prefixes[i])) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+// moves line to the end when it is there already, drops the oldest when full
+static void
+_inp_history_remember(const char* const line)
+{
+    for (int i = history_length - 1; i >= 0; i--) {
+        HIST_ENTRY* entry = history_get(history_base + i);
+        if (entry && strcmp(entry->line, line) == 0) {
+            if (i == history_length - 1) {
+                return;
+            }
+            free_history_entry(remove_history(i));
+            break;
+        }
+    }
+    if (history_length >= INP_HISTORY_MAX) {
+        free_history_entry(remove_history(0));
+    }
+    add_history(line);
+}
+
+static void
+_inp_history_add(const char* const line)
+{
+    _inp_history_remember(line);
+
+    if (history_file && !_inp_history_private(line)) {
+        auto_gchar gchar* escaped = g_strescape(line, NULL);
+        fprintf(history_file, "%s\n", escaped);
+        fflush(history_file);
+    }
+}
+
+static void
+_inp_history_load(void)
+{
+    auto_gchar gchar* path = files_get_data_path(FILE_INPUT_HISTORY);
+    auto_gchar gchar* contents = NULL;
+    int file_lines = 0;
+
+    if (g_file_get_contents(path, &contents, NULL, NULL)) {
+        auto_gcharv gchar** lines = g_strsplit(contents, "\n", -1);
+        for (int i = 0; lines[i] != NULL; i++) {
+            if (lines[i][0] == '\0') {
+                continue;
+            }
+            auto_gchar gchar* line = g_strcompress(lines[i]);
+            _inp_history_remember(line);
+            file_lines++;
+        }
+    }
+
+    // compact to what is kept, mostly duplicates and old lines go
+    if (file_lines > INP_HISTORY_MAX * 2) {
+        GString* compacted = g_string_new(NULL);
+        for (int i = 0; i < history_length; i++) {
+            HIST_ENTRY* entry = history_get(history_base + i);
+            if (entry) {
+                auto_gchar gchar* escaped = g_strescape(entry->line, NULL);
+                g_string_append_printf(compacted, "%s\n", escaped);
+            }
+        }
+        GError* error = NULL;
+        if (!g_file_set_contents(path, compacted->str, compacted->len, &error)) {
+            log_warning("Could not compact input history %s: %s", path, error->message);
+            g_error_free(error);
+        }
+        g_string_free(compacted, TRUE);
+    }
+
+    history_file = fopen(path, "a");
+    if (history_file) {
+        g_chmod(path, S_IRUSR | S_IWUSR);
+    } else {
+        log_warning("Could not open input history %s, it is not saved.", path);
     }
-    free(history);
 }
 
 static gboolean shift_tab = FALSE;
@@ -634,6 +863,7 @@ static int
 _inp_rl_getc(FILE* stream)
 {
     int ch = rl_getc(stream);
+    stats_latency_begin(STATS_TIMER_KEY_TO_SCREEN);
 
     // 27, 91, 90 = Shift tab
     if (ch == 27) {
@@ -650,19 +880,30 @@ _inp_rl_getc(FILE* stream)
     shift_tab = FALSE;
 
     if (_inp_edited(ch)) {
-        ProfWin* window = wins_get_current();
-        cmd_ac_reset(window);
-
-        if ((window->type == WIN_CHAT || window->type == WIN_MUC || window->type == WIN_PRIVATE) && window->quotes_ac != NULL) {
-            autocomplete_reset(window->quotes_ac);
-        }
+        _inp_reset_completion();
     }
     return ch;
 }
 
+static void
+_inp_reset_completion(void)
+{
+    ProfWin* window = wins_get_current();
+    cmd_ac_reset(window);
+
+    if ((window->type == WIN_CHAT || window->type == WIN_MUC || window->type == WIN_PRIVATE) && window->quotes_ac != NULL) {
+        autocomplete_reset(window->quotes_ac);
+    }
+}
+
 static void
 _inp_redisplay(void)
 {
+    if (inp_burst) {
+        inp_burst_redisplay = TRUE;
+        return;
+    }
+
     if (!get_password) {
         _inp_write(rl_line_buffer, rl_point);
     }
@@ -991,7 +1232,9 @@ _inp_rl_scroll_handler(int count, int key)
 static int
 _inp_rl_down_arrow_handler(int count, int key)
 {
-    add_history(rl_line_buffer);
+    if (rl_line_buffer[0] != '\0') {
+        _inp_history_remember(rl_line_buffer);
+    }
     using_history();
     rl_replace_line("", 0);
     rl_redisplay();
@@ -1025,3 +1268,84 @@ _inp_rl_print_newline_symbol(int count, int key)
     rl_insert_text("\n");
     return 0;
 }
+
+// Reads a bracketed paste straight from the terminal up to the end marker
+// and inserts it in one go, rather than feeding every byte through the
+// keymap and redisplaying after each one.
+static int
+_inp_rl_paste_handler(int count, int key)
+{
+    static const char paste_end[] = "\033[201~";
+    const size_t paste_end_len = sizeof(paste_end) - 1;
+    int fd = fileno(rl_instream);
+    GString* paste = g_string_new(NULL);
+    char* end = NULL;
+
+    while (!end) {
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(fd, &readable);
+        // give up on the end marker if the terminal goes quiet
+        struct timeval wait = { 1, 0 };
+        if (select(fd + 1, &readable, NULL, NULL, &wait) <= 0) {
+            break;
+        }
+
+        char chunk[4096];
+        ssize_t len = read(fd, chunk, sizeof(chunk));
+        if (len <= 0) {
+            break;
+        }
+
+        // only the tail can hold a marker split across reads
+        size_t search_from = paste->len > paste_end_len ? paste->len - paste_end_len : 0;
+        g_string_append_len(paste, chunk, len);
+        end = g_strstr_len(paste->str + search_from, paste->len - search_from, paste_end);
+    }
+
+    if (end) {
+        // whatever followed the paste is typed input, hand it back to readline
+        for (const char* c = end + paste_end_len; c < paste->str + paste->len; c++) {
+            rl_stuff_char((unsigned char)*c);
+        }
+        g_string_truncate(paste, end - paste->str);
+    }
+
+    // terminals send line breaks in pastes as carriage returns
+    GString* text = g_string_sized_new(paste->len);
+    for (gsize i = 0; i < paste->len; i++) {
+        if (paste->str[i] == '\r') {
+            g_string_append_c(text, '\n');
+            if (i + 1 < paste->len && paste->str[i + 1] == '\n') {
+                i++;
+            }
+        } else if (paste->str[i] != '\0') {
+            g_string_append_c(text, paste->str[i]);
+        }
+    }
+    g_string_free(paste, TRUE);
+
+    if (text->len > 0) {
+        _inp_reset_completion();
+        rl_insert_text(text->str);
+    }
+    g_string_free(text, TRUE);
+
+    return 0;
+}
+
+static int
+_inp_rl_focus_in_handler(int count, int key)
+{
+    terminal_focused = TRUE;
+    session_check_csi();
+    return 0;
+}
+
+static int
+_inp_rl_focus_out_handler(int count, int key)
+{
+    terminal_focused = FALSE;
+    session_check_csi();
+    return 0;
+}
@@ -52,7 +52,34 @@
 #include "omemo/omemo.h"
 #endif
 
+// Occupant listings of /who are printed a page per main loop iteration so a
+// room with thousands of occupants doesn't stall the UI. Each page resumes
+// after the last nick shown, roster changes in between are fine.
+#define MUCWIN_LIST_PAGE 200
+
+typedef enum {
+    MUCWIN_LIST_PRESENCE,
+    MUCWIN_LIST_ROLE,
+    MUCWIN_LIST_AFFILIATION
+} mucwin_list_t;
+
+typedef struct mucwin_listing_t
+{
+    char* roomjid;
+    mucwin_list_t type;
+    // NULL for all occupants
+    char* presence;
+    muc_role_t role;
+    muc_affiliation_t affiliation;
+    // nick collation key of the last occupant shown
+    gchar* last_key;
+    guint source;
+} MucwinListing;
+
+static GList* listings = NULL;
+
 static void _mucwin_set_last_message(ProfMucWin* mucwin, const char* const id, const char* const message);
+static void _mucwin_list(ProfMucWin* mucwin, MucwinListing* listing);
 
 ProfMucWin*
 mucwin_new(const char* const barejid)
@@ -226,40 +253,14 @@ mucwin_room_disco_info(ProfMucWin* mucwin, GSList* identities, GSList* features)
 }
 
 void
-mucwin_roster(ProfMucWin* mucwin, GList* roster, const char* const presence)
+mucwin_roster(ProfMucWin* mucwin, const char* const presence)
 {
     assert(mucwin != NULL);
 
-    ProfWin* window = (ProfWin*)mucwin;
-    if ((roster == NULL) || (g_list_length(roster) == 0)) {
-        if (presence == NULL) {
-            win_println(window, THEME_ROOMINFO, "!", "Room is empty.");
-        } else {
-            win_println(window, THEME_ROOMINFO, "!", "No occupants %s.", presence);
-        }
-    } else {
-        int length = g_list_length(roster);
-        if (presence == NULL) {
-            win_print(window, THEME_ROOMINFO, "!", "%d occupants: ", length);
-        } else {
-            win_print(window, THEME_ROOMINFO, "!", "%d %s: ", length, presence);
-        }
-
-        while (roster) {
-            Occupant* occupant = roster->data;
-            const char* presence_str = string_from_resource_presence(occupant->presence);
-
-            theme_item_t presence_colour = theme_main_presence_attrs(presence_str);
-            win_append(window, presence_colour, "%s", occupant->nick);
-
-            if (roster->next) {
-                win_append(window, THEME_DEFAULT, ", ");
-            }
-
-            roster = g_list_next(roster);
-        }
-        win_appendln(window, THEME_ONLINE, "");
-    }
+    MucwinListing* listing = calloc(1, sizeof(MucwinListing));
+    listing->type = MUCWIN_LIST_PRESENCE;
+    listing->presence = presence ? strdup(presence) : NULL;
+    _mucwin_list(mucwin, listing);
 }
 
 void
@@ -368,9 +369,9 @@ mucwin_history(ProfMucWin* mucwin, const ProfMessage* const message)
     assert(mucwin != NULL);
 
     char* nick = message->from_jid->resourcepart;
-    char* mynick = muc_nick(mucwin->roomjid);
-    GSList* mentions = get_mentions(prefs_get_boolean(PREF_NOTIFY_MENTION_WHOLE_WORD), prefs_get_boolean(PREF_NOTIFY_MENTION_CASE_SENSITIVE), message->plain, mynick);
-    GList* triggers = prefs_message_get_triggers(message->plain);
+    GSList* mentions = NULL;
+    GList* triggers = NULL;
+    muc_message_highlights(mucwin->roomjid, message->plain, &mentions, &triggers);
 
     mucwin_incoming_msg(mucwin, message, mentions, triggers, FALSE);
 
@@ -680,67 +681,10 @@ mucwin_show_affiliation_list(ProfMucWin* mucwin, muc_affiliation_t affiliation)
 {
     assert(mucwin != NULL);
 
-    ProfWin* window = (ProfWin*)mucwin;
-    GSList* occupants = muc_occupants_by_affiliation(mucwin->roomjid, affiliation);
-
-    if (!occupants) {
-        switch (affiliation) {
-        case MUC_AFFILIATION_OWNER:
-            win_println(window, THEME_DEFAULT, "!", "No owners found.");
-            break;
-        case MUC_AFFILIATION_ADMIN:
-            win_println(window, THEME_DEFAULT, "!", "No admins found.");
-            break;
-        case MUC_AFFILIATION_MEMBER:
-            win_println(window, THEME_DEFAULT, "!", "No members found.");
-            break;
-        case MUC_AFFILIATION_OUTCAST:
-            win_println(window, THEME_DEFAULT, "!", "No outcasts found.");
-            break;
-        case MUC_AFFILIATION_NONE:
-            win_println(window, THEME_DEFAULT, "!", "No nones found.");
-            break;
-        default:
-            break;
-        }
-        win_println(window, THEME_DEFAULT, "-", "");
-    } else {
-        switch (affiliation) {
-        case MUC_AFFILIATION_OWNER:
-            win_println(window, THEME_DEFAULT, "!", "Owners:");
-            break;
-        case MUC_AFFILIATION_ADMIN:
-            win_println(window, THEME_DEFAULT, "!", "Admins:");
-            break;
-        case MUC_AFFILIATION_MEMBER:
-            win_println(window, THEME_DEFAULT, "!", "Members:");
-            break;
-        case MUC_AFFILIATION_OUTCAST:
-            win_println(window, THEME_DEFAULT, "!", "Outcasts:");
-            break;
-        case MUC_AFFILIATION_NONE:
-            win_println(window, THEME_DEFAULT, "!", "Nones:");
-            break;
-        default:
-            break;
-        }
-
-        GSList* curr_occupant = occupants;
-        while (curr_occupant) {
-            Occupant* occupant = curr_occupant->data;
-            if (occupant->affiliation == affiliation) {
-                if (occupant->jid) {
-                    win_println(window, THEME_DEFAULT, "!", "  %s (%s)", occupant->nick, occupant->jid);
-                } else {
-                    win_println(window, THEME_DEFAULT, "!", "  %s", occupant->nick);
-                }
-            }
-
-            curr_occupant = g_slist_next(curr_occupant);
-        }
-
-        win_println(window, THEME_DEFAULT, "-", "");
-    }
+    MucwinListing* listing = calloc(1, sizeof(MucwinListing));
+    listing->type = MUCWIN_LIST_AFFILIATION;
+    listing->affiliation = affiliation;
+    _mucwin_list(mucwin, listing);
 }
 
 void
@@ -787,55 +731,10 @@ mucwin_show_role_list(ProfMucWin* mucwin, muc_role_t role)
 {
     assert(mucwin != NULL);
 
-    ProfWin* window = (ProfWin*)mucwin;
-    GSList* occupants = muc_occupants_by_role(mucwin->roomjid, role);
-
-    if (!occupants) {
-        switch (role) {
-        case MUC_ROLE_MODERATOR:
-            win_println(window, THEME_DEFAULT, "!", "No moderators found.");
-            break;
-        case MUC_ROLE_PARTICIPANT:
-            win_println(window, THEME_DEFAULT, "!", "No participants found.");
-            break;
-        case MUC_ROLE_VISITOR:
-            win_println(window, THEME_DEFAULT, "!", "No visitors found.");
-            break;
-        default:
-            break;
-        }
-        win_println(window, THEME_DEFAULT, "-", "");
-    } else {
-        switch (role) {
-        case MUC_ROLE_MODERATOR:
-            win_println(window, THEME_DEFAULT, "!", "Moderators:");
-            break;
-        case MUC_ROLE_PARTICIPANT:
-            win_println(window, THEME_DEFAULT, "!", "Participants:");
-            break;
-        case MUC_ROLE_VISITOR:
-            win_println(window, THEME_DEFAULT, "!", "Visitors:");
-            break;
-        default:
-            break;
-        }
-
-        GSList* curr_occupant = occupants;
-        while (curr_occupant) {
-            Occupant* occupant = curr_occupant->data;
-            if (occupant->role == role) {
-                if (occupant->jid) {
-                    win_println(window, THEME_DEFAULT, "!", "  %s (%s)", occupant->nick, occupant->jid);
-                } else {
-                    win_println(window, THEME_DEFAULT, "!", "  %s", occupant->nick);
-                }
-            }
-
-            curr_occupant = g_slist_next(curr_occupant);
-        }
-
-        win_println(window, THEME_DEFAULT, "-", "");
-    }
+    MucwinListing* listing = calloc(1, sizeof(MucwinListing));
+    listing->type = MUCWIN_LIST_ROLE;
+    listing->role = role;
+    _mucwin_list(mucwin, listing);
 }
 
 void
@@ -1007,5 +906,308 @@ mucwin_set_room_name(const gchar* const muc_jid, const gchar* const new_room_nam
     } else {
         mucwin->room_name = NULL;
     }
+    status_bar_names_changed();
     return TRUE;
 }
+
+static void
+_mucwin_flood_end(ProfMucWin* mucwin)
+{
+    mucwin->flooding = FALSE;
+    log_info("Room %s is back under the flood rate, %d messages held back", mucwin->roomjid, mucwin->flood_held);
+
+    if (mucwin->flood_held > 0) {
+        ProfWin* window = (ProfWin*)mucwin;
+        int num = wins_get_num(window);
+        int ui_index = num == 10 ? 0 : num;
+
+        theme_item_t theme_item = mucwin->flood_held_mention ? THEME_MENTION : THEME_INCOMING;
+        win_println(wins_get_console(), theme_item, "-", "<< room flood: %d messages in %s (win %d)", mucwin->flood_held, mucwin->roomjid, ui_index);
+        if (!wins_is_current(window)) {
+            cons_alert(window);
+        }
+        if (mucwin->flood_held_notify) {
+            notify_room_flood(mucwin->roomjid, num, mucwin->flood_held);
+        }
+    }
+
+    mucwin->flood_held = 0;
+    mucwin->flood_held_mention = FALSE;
+    mucwin->flood_held_notify = FALSE;
+}
+
+static void
+_mucwin_flood_roll(ProfMucWin* mucwin, gint limit, gint64 now)
+{
+    if (now - mucwin->flood_start < G_USEC_PER_SEC) {
+        return;
+    }
+
+    if (mucwin->flooding && mucwin->flood_count <= limit) {
+        _mucwin_flood_end(mucwin);
+    }
+    mucwin->flood_start = now;
+    mucwin->flood_count = 0;
+}
+
+// counts an incoming message against /notify room flood, returns TRUE while
+// the room is over the rate and per-message alerts should be held back
+gboolean
+mucwin_flood_count(ProfMucWin* mucwin)
+{
+    gint limit = prefs_get_notify_room_flood();
+    if (limit <= 0) {
+        if (mucwin->flooding) {
+            _mucwin_flood_end(mucwin);
+        }
+        return FALSE;
+    }
+
+    _mucwin_flood_roll(mucwin, limit, g_get_monotonic_time());
+    mucwin->flood_count++;
+    if (!mucwin->flooding && mucwin->flood_count > limit) {
+        mucwin->flooding = TRUE;
+        log_info("Room %s is over %d messages per second, holding back alerts", mucwin->roomjid, limit);
+    }
+
+    return mucwin->flooding;
+}
+
+// an alert held back while flooding, summarised once the room calms down
+void
+mucwin_flood_hold(ProfMucWin* mucwin, gboolean mention, gboolean notify_wanted)
+{
+    mucwin->flood_held++;
+    if (mention) {
+        mucwin->flood_held_mention = TRUE;
+    }
+    if (notify_wanted) {
+        mucwin->flood_held_notify = TRUE;
+    }
+}
+
+// ends floods in rooms that went quiet without another message arriving
+void
+mucwin_flood_check(void)
+{
+    gint limit = prefs_get_notify_room_flood();
+    gint64 now = g_get_monotonic_time();
+
+    GList* nums = wins_get_nums();
+    for (GList* curr = nums; curr; curr = g_list_next(curr)) {
+        ProfWin* window = wins_get_by_num(GPOINTER_TO_INT(curr->data));
+        if (window && window->type == WIN_MUC) {
+            ProfMucWin* mucwin = (ProfMucWin*)window;
+            if (mucwin->flooding && limit <= 0) {
+                _mucwin_flood_end(mucwin);
+            } else if (mucwin->flooding) {
+                _mucwin_flood_roll(mucwin, limit, now);
+            }
+        }
+    }
+    g_list_free(nums);
+}
+
+static void
+_mucwin_listing_free(MucwinListing* listing)
+{
+    if (listing->source) {
+        g_source_remove(listing->source);
+    }
+    free(listing->roomjid);
+    free(listing->presence);
+    g_free(listing->last_key);
+    free(listing);
+}
+
+static GSequenceIter*
+_mucwin_listing_iter(MucwinListing* listing)
+{
+    if (listing->type == MUCWIN_LIST_ROLE) {
+        return muc_roster_iter_role_after(listing->roomjid, listing->role, listing->last_key);
+    }
+
+    return muc_roster_iter_after(listing->roomjid, listing->last_key);
+}
+
+static gboolean
+_mucwin_listing_matches(MucwinListing* listing, Occupant* occupant)
+{
+    switch (listing->type) {
+    case MUCWIN_LIST_AFFILIATION:
+        return occupant->affiliation == listing->affiliation;
+    case MUCWIN_LIST_ROLE:
+        return TRUE;
+    default:
+        break;
+    }
+
+    const char* presence = listing->presence;
+    if (presence == NULL) {
+        return TRUE;
+    } else if (strcmp("available", presence) == 0) {
+        return muc_occupant_available(occupant);
+    } else if (strcmp("unavailable", presence) == 0) {
+        return !muc_occupant_available(occupant);
+    } else {
+        return strcmp(string_from_resource_presence(occupant->presence), presence) == 0;
+    }
+}
+
+static const char*
+_mucwin_listing_title(MucwinListing* listing)
+{
+    if (listing->type == MUCWIN_LIST_ROLE) {
+        switch (listing->role) {
+        case MUC_ROLE_MODERATOR:
+            return "moderators";
+        case MUC_ROLE_PARTICIPANT:
+            return "participants";
+        case MUC_ROLE_VISITOR:
+            return "visitors";
+        default:
+            return "occupants";
+        }
+    }
+
+    switch (listing->affiliation) {
+    case MUC_AFFILIATION_OWNER:
+        return "owners";
+    case MUC_AFFILIATION_ADMIN:
+        return "admins";
+    case MUC_AFFILIATION_MEMBER:
+        return "members";
+    case MUC_AFFILIATION_OUTCAST:
+        return "outcasts";
+    default:
+        return "nones";
+    }
+}
+
+// Print the next page of the listing, the first one starts with the count.
+// Returns TRUE while more pages may follow.
+static gboolean
+_mucwin_listing_page(ProfMucWin* mucwin, MucwinListing* listing)
+{
+    ProfWin* window = (ProfWin*)mucwin;
+    GSequenceIter* iter;
+    Occupant* occupant;
+    gboolean presence_list = listing->type == MUCWIN_LIST_PRESENCE;
+
+    if (listing->last_key == NULL) {
+        int count = 0;
+        iter = _mucwin_listing_iter(listing);
+        while ((occupant = muc_roster_iter_next(&iter))) {
+            if (_mucwin_listing_matches(listing, occupant)) {
+                count++;
+            }
+        }
+
+        const char* title = _mucwin_listing_title(listing);
+        if (count == 0) {
+            if (!presence_list) {
+                win_println(window, THEME_DEFAULT, "!", "No %s found.", title);
+                win_println(window, THEME_DEFAULT, "-", "");
+            } else if (listing->presence == NULL) {
+                win_println(window, THEME_ROOMINFO, "!", "Room is empty.");
+            } else {
+                win_println(window, THEME_ROOMINFO, "!", "No occupants %s.", listing->presence);
+            }
+            return FALSE;
+        }
+
+        if (!presence_list) {
+            auto_gchar gchar* heading = g_strdup_printf("%c%s (%d):", g_ascii_toupper(title[0]), title + 1, count);
+            win_println(window, THEME_DEFAULT, "!", "%s", heading);
+        } else if (listing->presence == NULL) {
+            win_print(window, THEME_ROOMINFO, "!", "%d occupants: ", count);
+        } else {
+            win_print(window, THEME_ROOMINFO, "!", "%d %s: ", count, listing->presence);
+        }
+    }
+
+    // presence listings print a line of nicks per page
+    gboolean line_open = presence_list && listing->last_key == NULL;
+    int shown = 0;
+    iter = _mucwin_listing_iter(listing);
+    while (shown < MUCWIN_LIST_PAGE && (occupant = muc_roster_iter_next(&iter))) {
+        if (!_mucwin_listing_matches(listing, occupant)) {
+            continue;
+        }
+
+        if (presence_list) {
+            const char* presence_str = string_from_resource_presence(occupant->presence);
+            theme_item_t presence_colour = theme_main_presence_attrs(presence_str);
+            if (!line_open) {
+                win_print(window, THEME_ROOMINFO, "!", "");
+                line_open = TRUE;
+            } else if (shown > 0) {
+                win_append(window, THEME_DEFAULT, ", ");
+            }
+            win_append(window, presence_colour, "%s", occupant->nick);
+        } else if (occupant->jid) {
+            win_println(window, THEME_DEFAULT, "!", "  %s (%s)", occupant->nick, occupant->jid);
+        } else {
+            win_println(window, THEME_DEFAULT, "!", "  %s", occupant->nick);
+        }
+
+        g_free(listing->last_key);
+        listing->last_key = g_strdup(occupant->nick_collate_key);
+        shown++;
+    }
+
+    if (line_open) {
+        win_appendln(window, THEME_ONLINE, "");
+    }
+
+    if (shown == MUCWIN_LIST_PAGE) {
+        return TRUE;
+    }
+
+    if (!presence_list) {
+        win_println(window, THEME_DEFAULT, "-", "");
+    }
+
+    return FALSE;
+}
+
+static gboolean
+_mucwin_listing_cb(gpointer data)
+{
+    MucwinListing* listing = data;
+    ProfMucWin* mucwin = wins_get_muc(listing->roomjid);
+    if (mucwin && muc_active(listing->roomjid) && _mucwin_listing_page(mucwin, listing)) {
+        return TRUE;
+    }
+
+    listing->source = 0;
+    listings = g_list_remove(listings, listing);
+    _mucwin_listing_free(listing);
+
+    return FALSE;
+}
+
+// print the first page now and the rest from the main loop, replacing a
+// listing still in progress in the same room
+static void
+_mucwin_list(ProfMucWin* mucwin, MucwinListing* listing)
+{
+    listing->roomjid = strdup(mucwin->roomjid);
+
+    for (GList* curr = listings; curr; curr = g_list_next(curr)) {
+        MucwinListing* previous = curr->data;
+        if (g_strcmp0(previous->roomjid, listing->roomjid) == 0) {
+            listings = g_list_delete_link(listings, curr);
+            _mucwin_listing_free(previous);
+            break;
+        }
+    }
+
+    if (!_mucwin_listing_page(mucwin, listing)) {
+        _mucwin_listing_free(listing);
+        return;
+    }
+
+    listing->source = g_idle_add(_mucwin_listing_cb, listing);
+    listings = g_list_prepend(listings, listing);
+}
@@ -55,17 +55,97 @@
 #include "xmpp/xmpp.h"
 #include "xmpp/muc.h"
 
+// further messages for a window within this long of its last notification
+// are summed up instead of each getting a popup
+#define NOTIFY_COALESCE_MS 5000
+// at most NOTIFY_RATE_MAX notifications every NOTIFY_RATE_PERIOD seconds
+#define NOTIFY_RATE_PERIOD 10
+#define NOTIFY_RATE_MAX    5
+
+typedef struct notify_request_t
+{
+    char* message; // NULL stops the worker
+    int timeout;
+    char* category;
+} NotifyRequest;
+
+typedef struct notify_batch_t
+{
+    int win;
+    char* label;
+    int held;
+    guint source;
+} NotifyBatch;
+
 static GTimer* remind_timer;
 
+// notifications go out from their own thread, a slow or missing
+// notification daemon must not hold up the UI
+static GThread* notify_thread = NULL;
+static GAsyncQueue* notify_queue = NULL;
+static GHashTable* notify_batches = NULL;
+static gint64 rate_start = 0;
+static int rate_count = 0;
+
+static void _notify_send(const char* const message, int timeout, const char* const category);
+
+static void
+_notify_request_free(NotifyRequest* request)
+{
+    free(request->message);
+    free(request->category);
+    free(request);
+}
+
+static gpointer
+_notify_worker(gpointer data)
+{
+    while (TRUE) {
+        NotifyRequest* request = g_async_queue_pop(notify_queue);
+        if (!request->message) {
+            _notify_request_free(request);
+            break;
+        }
+        _notify_send(request->message, request->timeout, request->category);
+        _notify_request_free(request);
+    }
+
+    return NULL;
+}
+
+static void
+_notify_batch_free(NotifyBatch* batch)
+{
+    if (batch->source) {
+        g_source_remove(batch->source);
+    }
+    free(batch->label);
+    free(batch);
+}
+
 void
 notifier_initialise(void)
 {
     remind_timer = g_timer_new();
+    notify_queue = g_async_queue_new_full((GDestroyNotify)_notify_request_free);
+    notify_batches = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)_notify_batch_free);
 }
 
 void
 notifier_uninit(void)
 {
+    g_hash_table_destroy(notify_batches);
+    notify_batches = NULL;
+
+    if (notify_thread) {
+        NotifyRequest* stop = calloc(1, sizeof(NotifyRequest));
+        g_async_queue_push(notify_queue, stop);
+        g_thread_join(notify_thread);
+        notify_thread = NULL;
+    }
+    g_async_queue_unref(notify_queue);
+    notify_queue = NULL;
+
 #ifdef HAVE_LIBNOTIFY
     if (notify_is_initted()) {
         notify_uninit();
@@ -74,6 +154,52 @@ notifier_uninit(void)
     g_timer_destroy(remind_timer);
 }
 
+static gboolean
+_notify_batch_end(gpointer data)
+{
+    NotifyBatch* batch = data;
+    if (batch->held == 0) {
+        batch->source = 0;
+        g_hash_table_remove(notify_batches, GINT_TO_POINTER(batch->win));
+        return G_SOURCE_REMOVE;
+    }
+
+    int ui_index = batch->win == 10 ? 0 : batch->win;
+    auto_gchar gchar* message = batch->held == 1
+                                    ? g_strdup_printf("1 more message %s (win %d)", batch->label, ui_index)
+                                    : g_strdup_printf("%d more messages %s (win %d)", batch->held, batch->label, ui_index);
+    batch->held = 0;
+    notify(message, 10000, "incoming message");
+
+    // keep summing up while messages keep coming
+    return G_SOURCE_CONTINUE;
+}
+
+// TRUE when win had a notification moments ago, the message is then only
+// counted towards the summary sent at the end of the batch
+static gboolean
+_notify_batch_hold(int win)
+{
+    NotifyBatch* batch = g_hash_table_lookup(notify_batches, GINT_TO_POINTER(win));
+    if (batch) {
+        batch->held++;
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+static void
+_notify_batch_start(int win, char* label)
+{
+    NotifyBatch* batch = malloc(sizeof(NotifyBatch));
+    batch->win = win;
+    batch->label = label;
+    batch->held = 0;
+    batch->source = g_timeout_add(NOTIFY_COALESCE_MS, _notify_batch_end, batch);
+    g_hash_table_replace(notify_batches, GINT_TO_POINTER(win), batch);
+}
+
 void
 notify_typing(const char* const name)
 {
@@ -100,6 +226,10 @@ notify_invite(const char* const from, const char* const room, const char* const
 void
 notify_message(const char* const name, int num, const char* const text)
 {
+    if (_notify_batch_hold(num)) {
+        return;
+    }
+
     int ui_index = num;
     if (ui_index == 10) {
         ui_index = 0;
@@ -113,11 +243,17 @@ notify_message(const char* const name, int num, const char* const text)
 
     notify(message->str, 10000, "incoming message");
     g_string_free(message, TRUE);
+
+    _notify_batch_start(num, g_strdup_printf("from %s", name));
 }
 
 void
 notify_room_message(const char* const nick, const char* const room, int num, const char* const text)
 {
+    if (_notify_batch_hold(num)) {
+        return;
+    }
+
     int ui_index = num;
     if (ui_index == 10) {
         ui_index = 0;
@@ -132,6 +268,20 @@ notify_room_message(const char* const nick, const char* const room, int num, con
     notify(message->str, 10000, "incoming message");
 
     g_string_free(message, TRUE);
+
+    _notify_batch_start(num, g_strdup_printf("in %s", room));
+}
+
+void
+notify_room_flood(const char* const room, int num, int count)
+{
+    int ui_index = num;
+    if (ui_index == 10) {
+        ui_index = 0;
+    }
+
+    auto_gchar gchar* message = g_strdup_printf("%d messages in %s (win %d)", count, room, ui_index);
+    notify(message, 10000, "incoming message");
 }
 
 void
@@ -196,6 +346,35 @@ notify_remind(void)
 
 void
 notify(const char* const message, int timeout, const char* const category)
+{
+    if (!notify_queue) {
+        return;
+    }
+
+    gint64 now = g_get_monotonic_time();
+    if (now - rate_start >= NOTIFY_RATE_PERIOD * G_USEC_PER_SEC) {
+        rate_start = now;
+        rate_count = 0;
+    }
+    if (rate_count >= NOTIFY_RATE_MAX) {
+        log_debug("Notification rate exceeded, dropping: %s", message);
+        return;
+    }
+    rate_count++;
+
+    if (!notify_thread) {
+        notify_thread = g_thread_new("notify", _notify_worker, NULL);
+    }
+
+    NotifyRequest* request = malloc(sizeof(NotifyRequest));
+    request->message = strdup(message);
+    request->timeout = timeout;
+    request->category = strdup(category);
+    g_async_queue_push(notify_queue, request);
+}
+
+static void
+_notify_send(const char* const message, int timeout, const char* const category)
 {
 #ifdef HAVE_LIBNOTIFY
     log_debug("Attempting notification: %s", message);
@@ -43,6 +43,16 @@
 #include "ui/window.h"
 #include "ui/window_list.h"
 
+// redraw a room's occupants at most this often while a join floods in
+#define OCCUPANTS_FRAME_USEC (G_USEC_PER_SEC / 30)
+
+// rooms whose occupants need a redraw
+static GHashTable* dirty_rooms = NULL;
+static gint64 occupants_drawn = 0;
+static guint occupants_frame_source = 0;
+
+static gboolean _occupantswin_frame_cb(gpointer data);
+
 static void
 _occuptantswin_occupant(ProfLayoutSplit* layout, GList* item, gboolean showjid, gboolean isoffline)
 {
@@ -115,13 +125,46 @@ _occuptantswin_occupant(ProfLayoutSplit* layout, GList* item, gboolean showjid,
     }
 }
 
-void
-occupantswin_occupants(const char* const roomjid)
+static void
+_occupantswin_header(ProfLayoutSplit* layout, const char* const prefix, const char* const title)
+{
+    GString* header = g_string_new(prefix);
+    g_string_append(header, title);
+
+    wattron(layout->subwin, theme_attrs(THEME_OCCUPANTS_HEADER));
+    win_sub_newline_lazy(layout->subwin);
+    win_sub_print(layout->subwin, header->str, TRUE, FALSE, 0);
+    wattroff(layout->subwin, theme_attrs(THEME_OCCUPANTS_HEADER));
+    g_string_free(header, TRUE);
+}
+
+static void
+_occupantswin_role(ProfLayoutSplit* layout, ProfMucWin* mucwin, const char* const prefix, const char* const title,
+                   muc_role_t role, GHashTable* online_jids)
+{
+    _occupantswin_header(layout, prefix, title);
+
+    GSequenceIter* iter = muc_roster_iter_role(mucwin->roomjid, role);
+    Occupant* occupant;
+    while ((occupant = muc_roster_iter_next(&iter))) {
+        GList item = { occupant, NULL, NULL };
+        _occuptantswin_occupant(layout, &item, mucwin->showjid, false);
+        if (occupant->jid) {
+            auto_jid Jid* jid = jid_create(occupant->jid);
+            if (jid) {
+                g_hash_table_add(online_jids, g_strdup(jid->barejid));
+            }
+        }
+    }
+}
+
+static void
+_occupantswin_draw(const char* const roomjid)
 {
     ProfMucWin* mucwin = wins_get_muc(roomjid);
     if (mucwin) {
-        GList* occupants = muc_roster(roomjid);
-        if (occupants) {
+        GSequenceIter* iter = muc_roster_iter(roomjid);
+        if (iter && !g_sequence_iter_is_end(iter)) {
             ProfLayoutSplit* layout = (ProfLayoutSplit*)mucwin->window.layout;
             assert(layout->memcheck == LAYOUT_SPLIT_MEMCHECK);
 
@@ -136,121 +179,104 @@ occupantswin_occupants(const char* const roomjid)
 
             if (prefs_get_boolean(PREF_MUC_PRIVILEGES)) {
 
-                GList* online_occupants = { NULL };
-
-                GString* role = g_string_new(prefix->str);
-                g_string_append(role, "Moderators");
-
-                wattron(layout->subwin, theme_attrs(THEME_OCCUPANTS_HEADER));
-                win_sub_newline_lazy(layout->subwin);
-                win_sub_print(layout->subwin, role->str, TRUE, FALSE, 0);
-                wattroff(layout->subwin, theme_attrs(THEME_OCCUPANTS_HEADER));
-                g_string_free(role, TRUE);
-                GList* roster_curr = occupants;
-                while (roster_curr) {
-                    Occupant* occupant = roster_curr->data;
-                    if (occupant->role == MUC_ROLE_MODERATOR) {
-                        _occuptantswin_occupant(layout, roster_curr, mucwin->showjid, false);
-                    }
-                    roster_curr = g_list_next(roster_curr);
-                    online_occupants = g_list_append(online_occupants, occupant->jid);
-                }
-
-                role = g_string_new(prefix->str);
-                g_string_append(role, "Participants");
-
-                wattron(layout->subwin, theme_attrs(THEME_OCCUPANTS_HEADER));
-                win_sub_newline_lazy(layout->subwin);
-                win_sub_print(layout->subwin, role->str, TRUE, FALSE, 0);
-                wattroff(layout->subwin, theme_attrs(THEME_OCCUPANTS_HEADER));
-                g_string_free(role, TRUE);
-                roster_curr = occupants;
-                while (roster_curr) {
-                    Occupant* occupant = roster_curr->data;
-                    if (occupant->role == MUC_ROLE_PARTICIPANT) {
-                        _occuptantswin_occupant(layout, roster_curr, mucwin->showjid, false);
-                    }
-                    roster_curr = g_list_next(roster_curr);
-                    online_occupants = g_list_append(online_occupants, occupant->jid);
-                }
+                // bare JIDs of online occupants, to hide them from the offline members
+                GHashTable* online_jids = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
 
-                role = g_string_new(prefix->str);
-                g_string_append(role, "Visitors");
-
-                wattron(layout->subwin, theme_attrs(THEME_OCCUPANTS_HEADER));
-                win_sub_newline_lazy(layout->subwin);
-                win_sub_print(layout->subwin, role->str, TRUE, FALSE, 0);
-                wattroff(layout->subwin, theme_attrs(THEME_OCCUPANTS_HEADER));
-                g_string_free(role, TRUE);
-                roster_curr = occupants;
-                while (roster_curr) {
-                    Occupant* occupant = roster_curr->data;
-                    if (occupant->role == MUC_ROLE_VISITOR) {
-                        _occuptantswin_occupant(layout, roster_curr, mucwin->showjid, false);
-                    }
-                    roster_curr = g_list_next(roster_curr);
-                    online_occupants = g_list_append(online_occupants, occupant->jid);
-                }
+                _occupantswin_role(layout, mucwin, prefix->str, "Moderators", MUC_ROLE_MODERATOR, online_jids);
+                _occupantswin_role(layout, mucwin, prefix->str, "Participants", MUC_ROLE_PARTICIPANT, online_jids);
+                _occupantswin_role(layout, mucwin, prefix->str, "Visitors", MUC_ROLE_VISITOR, online_jids);
 
                 if (mucwin->showoffline) {
                     GList* members = muc_members(roomjid);
-                    // offline_occupants is used to display the same account on multiple devices once
-                    GList* offline_occupants = { NULL };
-
-                    role = g_string_new(prefix->str);
-                    g_string_append(role, "Offline");
-
-                    wattron(layout->subwin, theme_attrs(THEME_OCCUPANTS_HEADER));
-                    win_sub_newline_lazy(layout->subwin);
-                    win_sub_print(layout->subwin, role->str, TRUE, FALSE, 0);
-                    wattroff(layout->subwin, theme_attrs(THEME_OCCUPANTS_HEADER));
-                    g_string_free(role, TRUE);
-                    roster_curr = members;
+                    // offline_jids is used to display the same account on multiple devices once
+                    GHashTable* offline_jids = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+                    _occupantswin_header(layout, prefix->str, "Offline");
+                    GList* roster_curr = members;
                     while (roster_curr) {
                         auto_jid Jid* jid = jid_create(roster_curr->data);
-                        gboolean found = false;
-                        GList* iter = online_occupants;
-                        for (; iter != NULL; iter = iter->next) {
-                            if (strstr(iter->data, jid->barejid)) {
-                                found = true;
-                                break;
-                            }
-                        }
 
-                        if (!found && g_list_index(offline_occupants, jid->barejid) == -1) {
+                        if (jid && !g_hash_table_contains(online_jids, jid->barejid)
+                            && !g_hash_table_contains(offline_jids, jid->barejid)) {
                             _occuptantswin_occupant(layout, roster_curr, mucwin->showjid, true);
-                            offline_occupants = g_list_append(offline_occupants, jid->barejid);
+                            g_hash_table_add(offline_jids, g_strdup(jid->barejid));
                         }
 
                         roster_curr = g_list_next(roster_curr);
                     }
                     g_list_free(members);
-                    g_list_free(offline_occupants);
+                    g_hash_table_destroy(offline_jids);
                 }
-                g_list_free(online_occupants);
+                g_hash_table_destroy(online_jids);
 
             } else {
-                GString* role = g_string_new(prefix->str);
-                g_string_append(role, "Occupants\n");
-
-                wattron(layout->subwin, theme_attrs(THEME_OCCUPANTS_HEADER));
-                win_sub_newline_lazy(layout->subwin);
-                win_sub_print(layout->subwin, role->str, TRUE, FALSE, 0);
-                wattroff(layout->subwin, theme_attrs(THEME_OCCUPANTS_HEADER));
-                g_string_free(role, TRUE);
-
-                GList* roster_curr = occupants;
-                while (roster_curr) {
-                    _occuptantswin_occupant(layout, roster_curr, mucwin->showjid, false);
-                    roster_curr = g_list_next(roster_curr);
+                _occupantswin_header(layout, prefix->str, "Occupants\n");
+
+                Occupant* occupant;
+                while ((occupant = muc_roster_iter_next(&iter))) {
+                    GList item = { occupant, NULL, NULL };
+                    _occuptantswin_occupant(layout, &item, mucwin->showjid, false);
                 }
             }
 
             g_string_free(prefix, TRUE);
         }
+    }
+}
+
+// request a redraw of the room's occupants, it is drawn by the next ui_update()
+// that finds the room on screen
+void
+occupantswin_occupants(const char* const roomjid)
+{
+    if (dirty_rooms == NULL) {
+        dirty_rooms = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    }
+
+    g_hash_table_add(dirty_rooms, g_strdup(roomjid));
+    ui_mark_dirty_part(UI_DIRTY_WINDOW);
+}
+
+void
+occupantswin_occupants_flush(void)
+{
+    if (dirty_rooms == NULL || g_hash_table_size(dirty_rooms) == 0) {
+        return;
+    }
 
-        g_list_free(occupants);
+    // only the room on screen is drawn, the others stay dirty until shown
+    ProfWin* current = wins_get_current();
+    if (current == NULL || current->type != WIN_MUC) {
+        return;
+    }
+    const char* roomjid = ((ProfMucWin*)current)->roomjid;
+    if (!g_hash_table_contains(dirty_rooms, roomjid)) {
+        return;
+    }
+
+    gint64 now = g_get_monotonic_time();
+    gint64 elapsed = now - occupants_drawn;
+    if (elapsed >= 0 && elapsed < OCCUPANTS_FRAME_USEC) {
+        if (occupants_frame_source == 0) {
+            guint delay_ms = (OCCUPANTS_FRAME_USEC - elapsed) / 1000 + 1;
+            occupants_frame_source = g_timeout_add(delay_ms, _occupantswin_frame_cb, NULL);
+        }
+        return;
     }
+
+    occupants_drawn = now;
+
+    _occupantswin_draw(roomjid);
+    g_hash_table_remove(dirty_rooms, roomjid);
+}
+
+static gboolean
+_occupantswin_frame_cb(gpointer data)
+{
+    occupants_frame_source = 0;
+    ui_mark_dirty_part(UI_DIRTY_WINDOW);
+
+    return FALSE;
 }
 
 void
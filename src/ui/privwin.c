@@ -81,6 +81,7 @@ privwin_incoming_msg(ProfPrivateWin* privatewin, ProfMessage* message)
         win_print_incoming(window, jidp->resourcepart, message);
 
         privatewin->unread++;
+        wins_unread_changed((ProfWin*)privatewin);
 
         if (prefs_get_boolean(PREF_FLASH)) {
             flash();
@@ -76,14 +76,62 @@ static void _rosterwin_print_rooms(ProfLayoutSplit* layout);
 static void _rosterwin_private_chats(ProfLayoutSplit* layout, GList* orphaned_privchats);
 static void _rosterwin_private_header(ProfLayoutSplit* layout, GList* privs);
 
-static GSList* _filter_contacts(GSList* contacts);
-static GSList* _filter_contacts_with_presence(GSList* contacts, const char* const presence);
+static GSList* _filter_contacts(GSequenceIter* contacts);
+static GSList* _filter_contacts_with_presence(const char* const presence);
 static theme_item_t _get_roster_theme(roster_contact_theme_t theme_type, const char* presence);
 static int _compare_rooms_name(ProfMucWin* a, ProfMucWin* b);
 static int _compare_rooms_unread(ProfMucWin* a, ProfMucWin* b);
+static void _rosterwin_draw(void);
+static gboolean _rosterwin_frame_cb(gpointer data);
 
+// redraw the roster at most this often while presences pour in
+#define ROSTER_FRAME_USEC (G_USEC_PER_SEC / 30)
+
+static gboolean roster_dirty = FALSE;
+static gint64 roster_drawn = 0;
+static guint roster_frame_source = 0;
+
+// request a roster redraw, it is drawn by the next ui_update()
 void
 rosterwin_roster(void)
+{
+    roster_dirty = TRUE;
+    ui_mark_dirty_part(UI_DIRTY_WINDOW);
+}
+
+void
+rosterwin_roster_flush(void)
+{
+    if (!roster_dirty) {
+        return;
+    }
+
+    gint64 now = g_get_monotonic_time();
+    gint64 elapsed = now - roster_drawn;
+    if (elapsed >= 0 && elapsed < ROSTER_FRAME_USEC) {
+        if (roster_frame_source == 0) {
+            guint delay_ms = (ROSTER_FRAME_USEC - elapsed) / 1000 + 1;
+            roster_frame_source = g_timeout_add(delay_ms, _rosterwin_frame_cb, NULL);
+        }
+        return;
+    }
+
+    roster_dirty = FALSE;
+    roster_drawn = now;
+    _rosterwin_draw();
+}
+
+static gboolean
+_rosterwin_frame_cb(gpointer data)
+{
+    roster_frame_source = 0;
+    ui_mark_dirty_part(UI_DIRTY_WINDOW);
+
+    return FALSE;
+}
+
+static void
+_rosterwin_draw(void)
 {
     ProfWin* console = wins_get_console();
     if (!console) {
@@ -102,7 +150,8 @@ rosterwin_roster(void)
         return;
     }
 
-    werase(layout->subwin);
+    // only the rows on screen are drawn, the rest is just measured
+    win_sub_clip_begin(layout);
 
     auto_gchar gchar* roomspos = prefs_get_string(PREF_ROSTER_ROOMS_POS);
     if (prefs_get_boolean(PREF_ROSTER_ROOMS) && (g_strcmp0(roomspos, "first") == 0)) {
@@ -176,22 +225,23 @@ rosterwin_roster(void)
         g_list_free(privchats);
         g_list_free(orphaned_privchats);
     }
+
+    win_sub_clip_end(layout);
 }
 
 static void
 _rosterwin_contacts_all(ProfLayoutSplit* layout)
 {
-    GSList* contacts = NULL;
+    GSequenceIter* contacts = NULL;
 
     auto_gchar gchar* order = prefs_get_string(PREF_ROSTER_ORDER);
     if (g_strcmp0(order, "presence") == 0) {
-        contacts = roster_get_contacts(ROSTER_ORD_PRESENCE);
+        contacts = roster_iter_contacts(ROSTER_ORD_PRESENCE);
     } else {
-        contacts = roster_get_contacts(ROSTER_ORD_NAME);
+        contacts = roster_iter_contacts(ROSTER_ORD_NAME);
     }
 
     GSList* filtered_contacts = _filter_contacts(contacts);
-    g_slist_free(contacts);
 
     _rosterwin_contacts_header(layout, "Roster", filtered_contacts);
 
@@ -227,9 +277,7 @@ _rosteriwin_unsubscribed(ProfLayoutSplit* layout)
 static void
 _rosterwin_contacts_by_presence(ProfLayoutSplit* layout, const char* const presence, char* title)
 {
-    GSList* contacts = roster_get_contacts_by_presence(presence);
-    GSList* filtered_contacts = _filter_contacts_with_presence(contacts, presence);
-    g_slist_free(contacts);
+    GSList* filtered_contacts = _filter_contacts_with_presence(presence);
 
     // if this group has contacts, or if we want to show empty groups
     if (filtered_contacts || prefs_get_boolean(PREF_ROSTER_EMPTY)) {
@@ -250,17 +298,16 @@ _rosterwin_contacts_by_presence(ProfLayoutSplit* layout, const char* const prese
 static void
 _rosterwin_contacts_by_group(ProfLayoutSplit* layout, char* group)
 {
-    GSList* contacts = NULL;
+    GSequenceIter* contacts = NULL;
 
     auto_gchar gchar* order = prefs_get_string(PREF_ROSTER_ORDER);
     if (g_strcmp0(order, "presence") == 0) {
-        contacts = roster_get_group(group, ROSTER_ORD_PRESENCE);
+        contacts = roster_iter_group(group, ROSTER_ORD_PRESENCE);
     } else {
-        contacts = roster_get_group(group, ROSTER_ORD_NAME);
+        contacts = roster_iter_group(group, ROSTER_ORD_NAME);
     }
 
     GSList* filtered_contacts = _filter_contacts(contacts);
-    g_slist_free(contacts);
 
     if (filtered_contacts || prefs_get_boolean(PREF_ROSTER_EMPTY)) {
         if (group) {
@@ -1166,79 +1213,55 @@ _rosterwin_private_header(ProfLayoutSplit* layout, GList* privs)
 }
 
 static GSList*
-_filter_contacts(GSList* contacts)
+_filter_contacts(GSequenceIter* contacts)
 {
     GSList* filtered_contacts = NULL;
+    gboolean show_offline = prefs_get_boolean(PREF_ROSTER_OFFLINE);
+    PContact contact;
 
-    // if show offline, include all contacts
-    if (prefs_get_boolean(PREF_ROSTER_OFFLINE)) {
-        GSList* curr = contacts;
-        while (curr) {
-            filtered_contacts = g_slist_append(filtered_contacts, curr->data);
-            curr = g_slist_next(curr);
-        }
-        // if dont show offline
-    } else {
-        GSList* curr = contacts;
-        while (curr) {
-            PContact contact = curr->data;
-            const char* presence = p_contact_presence(contact);
+    while ((contact = roster_iter_next(&contacts))) {
+        // if show offline, include all contacts
+        if (show_offline) {
+            filtered_contacts = g_slist_prepend(filtered_contacts, contact);
 
             // include if offline and unread messages
-            if (g_strcmp0(presence, "offline") == 0) {
-                ProfChatWin* chatwin = wins_get_chat(p_contact_barejid(contact));
-                if (chatwin && chatwin->unread > 0) {
-                    filtered_contacts = g_slist_append(filtered_contacts, contact);
-                }
-
-                // include if not offline
-            } else {
-                filtered_contacts = g_slist_append(filtered_contacts, contact);
+        } else if (g_strcmp0(p_contact_presence(contact), "offline") == 0) {
+            ProfChatWin* chatwin = wins_get_chat(p_contact_barejid(contact));
+            if (chatwin && chatwin->unread > 0) {
+                filtered_contacts = g_slist_prepend(filtered_contacts, contact);
             }
-            curr = g_slist_next(curr);
+
+            // include if not offline
+        } else {
+            filtered_contacts = g_slist_prepend(filtered_contacts, contact);
         }
     }
 
-    return filtered_contacts;
+    return g_slist_reverse(filtered_contacts);
 }
 
 static GSList*
-_filter_contacts_with_presence(GSList* contacts, const char* const presence)
+_filter_contacts_with_presence(const char* const presence)
 {
+    GSequenceIter* contacts = roster_iter_presence(presence);
     GSList* filtered_contacts = NULL;
-
-    // handling offline contacts
-    if (g_strcmp0(presence, "offline") == 0) {
-
-        // if show offline, include all contacts
-        if (prefs_get_boolean(PREF_ROSTER_OFFLINE)) {
-            GSList* curr = contacts;
-            while (curr) {
-                filtered_contacts = g_slist_append(filtered_contacts, curr->data);
-                curr = g_slist_next(curr);
+    gboolean offline = g_strcmp0(presence, "offline") == 0;
+    gboolean show_offline = prefs_get_boolean(PREF_ROSTER_OFFLINE);
+    PContact contact;
+
+    while ((contact = roster_iter_next(&contacts))) {
+        // offline contacts are only shown with unread messages, unless show offline
+        if (offline && !show_offline) {
+            ProfChatWin* chatwin = wins_get_chat(p_contact_barejid(contact));
+            if (chatwin && chatwin->unread > 0) {
+                filtered_contacts = g_slist_prepend(filtered_contacts, contact);
             }
 
-            // otherwise show if unread messages
+            // any other presence, include all
         } else {
-            GSList* curr = contacts;
-            while (curr) {
-                PContact contact = curr->data;
-                ProfChatWin* chatwin = wins_get_chat(p_contact_barejid(contact));
-                if (chatwin && chatwin->unread > 0) {
-                    filtered_contacts = g_slist_append(filtered_contacts, contact);
-                }
-                curr = g_slist_next(curr);
-            }
-        }
-
-        // any other presence, include all
-    } else {
-        GSList* curr = contacts;
-        while (curr) {
-            filtered_contacts = g_slist_append(filtered_contacts, curr->data);
-            curr = g_slist_next(curr);
+            filtered_contacts = g_slist_prepend(filtered_contacts, contact);
         }
     }
 
-    return filtered_contacts;
+    return g_slist_reverse(filtered_contacts);
 }
@@ -62,16 +62,33 @@ typedef struct _status_bar_tab_t
     win_type_t window_type;
     char* identifier;
     gboolean highlight;
-    char* display_name;
+    // label as drawn and its width in columns, NULL until first needed
+    char* label;
+    int label_width;
 } StatusBarTab;
 
 typedef struct _status_bar_t
 {
+    // clock text, the format it was made with and when it can next change
     gchar* time;
+    gchar* time_format;
+    gint64 time_until;
     char* prompt;
     char* fulljid;
     GHashTable* tabs;
     int current_tab;
+    // preferences read once per resize, all statusbar settings go through it
+    gboolean show_number;
+    gboolean show_name;
+    gboolean show_read;
+    gint max_tabs;
+    gboolean actlist;
+    gboolean is_static;
+    // visible tab range and its width, recomputed after the tabs change
+    gboolean layout_stale;
+    int range_start;
+    int range_end;
+    int tabs_width;
 } StatusBar;
 
 static GTimeZone* tz;
@@ -90,7 +107,10 @@ static int _tabs_width(int start, int end);
 static unsigned int _count_digits(int number);
 static unsigned int _count_digits_in_range(int start, int end);
 static char* _display_name(StatusBarTab* tab);
-static gboolean _tabmode_is_actlist(void);
+static const char* _tab_label(StatusBarTab* tab);
+static void _status_bar_load_prefs(void);
+static void _status_bar_layout_changed(void);
+static gboolean _status_bar_time_update(const char* const format);
 
 void
 status_bar_init(void)
@@ -99,15 +119,17 @@ status_bar_init(void)
 
     statusbar = malloc(sizeof(StatusBar));
     statusbar->time = NULL;
+    statusbar->time_format = NULL;
+    statusbar->time_until = 0;
     statusbar->prompt = NULL;
     statusbar->fulljid = NULL;
     statusbar->tabs = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)_destroy_tab);
     StatusBarTab* console = calloc(1, sizeof(StatusBarTab));
     console->window_type = WIN_CONSOLE;
     console->identifier = strdup("console");
-    console->display_name = NULL;
     g_hash_table_insert(statusbar->tabs, GINT_TO_POINTER(1), console);
     statusbar->current_tab = 1;
+    _status_bar_load_prefs();
 
     int row = screen_statusbar_row();
     int cols = getmaxx(stdscr);
@@ -123,9 +145,8 @@ status_bar_close(void)
         g_time_zone_unref(tz);
     }
     if (statusbar) {
-        if (statusbar->time) {
-            g_free(statusbar->time);
-        }
+        g_free(statusbar->time);
+        g_free(statusbar->time_format);
         if (statusbar->prompt) {
             free(statusbar->prompt);
         }
@@ -148,25 +169,70 @@ status_bar_resize(void)
     wresize(statusbar_win, 1, cols);
     mvwin(statusbar_win, row, 0);
 
+    // preferences change through ui_resize()
+    _status_bar_load_prefs();
+    status_bar_names_changed();
     status_bar_draw();
 }
 
+// a room or contact was renamed or naming preferences changed, labels are
+// built again on the next draw
+void
+status_bar_names_changed(void)
+{
+    if (!statusbar) {
+        return;
+    }
+
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, statusbar->tabs);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        StatusBarTab* tab = value;
+        free(tab->label);
+        tab->label = NULL;
+    }
+    _status_bar_layout_changed();
+}
+
+static void
+_status_bar_layout_changed(void)
+{
+    statusbar->layout_stale = TRUE;
+    ui_mark_dirty_part(UI_DIRTY_STATUSBAR);
+}
+
+static void
+_status_bar_load_prefs(void)
+{
+    statusbar->show_number = prefs_get_boolean(PREF_STATUSBAR_SHOW_NUMBER);
+    statusbar->show_name = prefs_get_boolean(PREF_STATUSBAR_SHOW_NAME);
+    statusbar->show_read = prefs_get_boolean(PREF_STATUSBAR_SHOW_READ);
+    statusbar->max_tabs = prefs_get_statusbartabs();
+
+    auto_gchar gchar* tabmode = prefs_get_string(PREF_STATUSBAR_TABMODE);
+    statusbar->actlist = g_strcmp0(tabmode, "actlist") == 0;
+    statusbar->is_static = g_strcmp0(tabmode, "dynamic") != 0;
+    statusbar->layout_stale = TRUE;
+}
+
 void
 status_bar_set_all_inactive(void)
 {
     g_hash_table_remove_all(statusbar->tabs);
+    _status_bar_layout_changed();
 }
 
 void
 status_bar_current(int i)
 {
-    if (i == 0) {
-        statusbar->current_tab = 10;
-    } else {
-        statusbar->current_tab = i;
+    int true_win = i == 0 ? 10 : i;
+    if (statusbar->current_tab == true_win) {
+        return;
     }
 
-    status_bar_draw();
+    statusbar->current_tab = true_win;
+    _status_bar_layout_changed();
 }
 
 void
@@ -177,9 +243,9 @@ status_bar_inactive(const int win)
         true_win = 10;
     }
 
-    g_hash_table_remove(statusbar->tabs, GINT_TO_POINTER(true_win));
-
-    status_bar_draw();
+    if (g_hash_table_remove(statusbar->tabs, GINT_TO_POINTER(true_win))) {
+        _status_bar_layout_changed();
+    }
 }
 
 void
@@ -187,38 +253,26 @@ _create_tab(const int win, win_type_t wintype, char* identifier, gboolean highli
 {
     int true_win = win == 0 ? 10 : win;
 
+    // messages to an open window only flip the highlight
+    StatusBarTab* existing = g_hash_table_lookup(statusbar->tabs, GINT_TO_POINTER(true_win));
+    if (existing && existing->window_type == wintype && g_strcmp0(existing->identifier, identifier) == 0) {
+        if (existing->highlight != highlight) {
+            existing->highlight = highlight;
+            _status_bar_layout_changed();
+        }
+        return;
+    }
+
     StatusBarTab* tab = malloc(sizeof(StatusBarTab));
     tab->identifier = strdup(identifier);
     tab->highlight = highlight;
     tab->window_type = wintype;
-    tab->display_name = NULL;
-
-    if (tab->window_type == WIN_CHAT) {
-        PContact contact = NULL;
-        if (roster_exists()) {
-            contact = roster_get_contact(tab->identifier);
-        }
-        const char* pcontact_name = contact ? p_contact_name(contact) : NULL;
-        auto_gchar gchar* pref = prefs_get_string(PREF_STATUSBAR_CHAT);
-        if (g_strcmp0("user", pref) == 0) {
-            if (pcontact_name) {
-                tab->display_name = strdup(pcontact_name);
-            } else {
-                auto_jid Jid* jidp = jid_create(tab->identifier);
-                if (jidp) {
-                    tab->display_name = jidp->localpart != NULL ? strdup(jidp->localpart) : strdup(jidp->barejid);
-                } else {
-                    tab->display_name = strdup(tab->identifier);
-                }
-            }
-        } else {
-            tab->display_name = strdup(tab->identifier);
-        }
-    }
+    tab->label = NULL;
+    tab->label_width = 0;
 
     g_hash_table_replace(statusbar->tabs, GINT_TO_POINTER(true_win), tab);
 
-    status_bar_draw();
+    _status_bar_layout_changed();
 }
 
 void
@@ -265,7 +319,7 @@ status_bar_set_fulljid(const char* const fulljid)
     }
     statusbar->fulljid = strdup(fulljid);
 
-    status_bar_draw();
+    ui_mark_dirty_part(UI_DIRTY_STATUSBAR);
 }
 
 void
@@ -276,7 +330,52 @@ status_bar_clear_fulljid(void)
         statusbar->fulljid = NULL;
     }
 
-    status_bar_draw();
+    ui_mark_dirty_part(UI_DIRTY_STATUSBAR);
+}
+
+// the clock is the only part that changes on its own
+gboolean
+status_bar_time_changed(void)
+{
+    const gchar* time_pref = prefs_peek_string(PREF_TIME_STATUSBAR);
+    if (g_strcmp0(time_pref, "off") == 0) {
+        return FALSE;
+    }
+
+    return _status_bar_time_update(time_pref);
+}
+
+// formats the clock again only once the shown text can have changed: on the
+// next second for formats that show seconds, on the next minute otherwise
+static gboolean
+_status_bar_time_update(const char* const format)
+{
+    if (statusbar->time && g_get_real_time() < statusbar->time_until && g_strcmp0(format, statusbar->time_format) == 0) {
+        return FALSE;
+    }
+
+    GDateTime* datetime = g_date_time_new_now(tz);
+    gint64 now = g_date_time_to_unix(datetime) * G_USEC_PER_SEC + g_date_time_get_microsecond(datetime);
+
+    gint64 unit = G_USEC_PER_SEC;
+    if (!strstr(format, "%S") && !strstr(format, "%s") && !strstr(format, "%T") && !strstr(format, "%r")
+        && !strstr(format, "%X") && !strstr(format, "%c") && !strstr(format, "%f")) {
+        unit *= 60;
+    }
+    statusbar->time_until = (now / unit + 1) * unit;
+
+    gchar* time = g_date_time_format(datetime, format);
+    g_date_time_unref(datetime);
+
+    gboolean changed = g_strcmp0(time, statusbar->time) != 0;
+    g_free(statusbar->time);
+    statusbar->time = time;
+    if (g_strcmp0(format, statusbar->time_format) != 0) {
+        g_free(statusbar->time_format);
+        statusbar->time_format = g_strdup(format);
+    }
+
+    return changed;
 }
 
 void
@@ -285,12 +384,11 @@ status_bar_draw(void)
     werase(statusbar_win);
     wbkgd(statusbar_win, theme_attrs(THEME_STATUS_TEXT));
 
-    gint max_tabs = prefs_get_statusbartabs();
     int pos = 1;
 
     pos = _status_bar_draw_time(pos);
     pos = _status_bar_draw_maintext(pos);
-    if (max_tabs != 0)
+    if (statusbar->max_tabs != 0)
         pos = _status_bar_draw_tabs(pos);
 
     wnoutrefresh(statusbar_win);
@@ -300,14 +398,17 @@ status_bar_draw(void)
 static int
 _status_bar_draw_tabs(int pos)
 {
-    auto_gchar gchar* tabmode = prefs_get_string(PREF_STATUSBAR_TABMODE);
-
-    if (g_strcmp0(tabmode, "actlist") != 0) {
-        int start, end;
-        gboolean is_static = g_strcmp0(tabmode, "dynamic") != 0;
-        _get_range_bounds(&start, &end, is_static);
+    if (!statusbar->actlist) {
+        if (statusbar->layout_stale) {
+            _get_range_bounds(&statusbar->range_start, &statusbar->range_end, statusbar->is_static);
+            statusbar->tabs_width = _tabs_width(statusbar->range_start, statusbar->range_end);
+            statusbar->layout_stale = FALSE;
+        }
+        int start = statusbar->range_start;
+        int end = statusbar->range_end;
+        gboolean is_static = statusbar->is_static;
 
-        pos = getmaxx(stdscr) - _tabs_width(start, end);
+        pos = getmaxx(stdscr) - statusbar->tabs_width;
         if (pos < 0) {
             pos = 0;
         }
@@ -367,7 +468,7 @@ _status_bar_draw_tabs(int pos)
 static gboolean
 _has_new_msgs_beyond_range_on_side(gboolean left_side, int display_tabs_start, int display_tabs_end)
 {
-    gint max_tabs = prefs_get_statusbartabs();
+    gint max_tabs = statusbar->max_tabs;
     int tabs_count = g_hash_table_size(statusbar->tabs);
     if (tabs_count <= max_tabs) {
         return FALSE;
@@ -389,7 +490,7 @@ _has_new_msgs_beyond_range_on_side(gboolean left_side, int display_tabs_start, i
 static int
 _status_bar_draw_extended_tabs(int pos, gboolean prefix, int start, int end, gboolean is_static)
 {
-    gint max_tabs = prefs_get_statusbartabs();
+    gint max_tabs = statusbar->max_tabs;
     if (max_tabs == 0) {
         return pos;
     }
@@ -433,9 +534,9 @@ _status_bar_draw_tab(StatusBarTab* tab, int pos, int num)
 {
     gboolean is_current = num == statusbar->current_tab;
 
-    gboolean show_number = prefs_get_boolean(PREF_STATUSBAR_SHOW_NUMBER);
-    gboolean show_name = prefs_get_boolean(PREF_STATUSBAR_SHOW_NAME);
-    gboolean show_read = prefs_get_boolean(PREF_STATUSBAR_SHOW_READ);
+    gboolean show_number = statusbar->show_number;
+    gboolean show_name = statusbar->show_name;
+    gboolean show_read = statusbar->show_read;
 
     // dont show this
     if (!show_read && !is_current && !tab->highlight)
@@ -462,9 +563,8 @@ _status_bar_draw_tab(StatusBarTab* tab, int pos, int num)
         pos++;
     }
     if (show_name) {
-        auto_char char* display_name = _display_name(tab);
-        mvwprintw(statusbar_win, 0, pos, "%s", display_name);
-        pos += utf8_display_len(display_name);
+        mvwprintw(statusbar_win, 0, pos, "%s", _tab_label(tab));
+        pos += tab->label_width;
     }
     wattroff(statusbar_win, status_attrs);
 
@@ -492,20 +592,13 @@ _status_bar_draw_bracket(gboolean current, int pos, const char* ch)
 static int
 _status_bar_draw_time(int pos)
 {
-    auto_gchar gchar* time_pref = prefs_get_string(PREF_TIME_STATUSBAR);
+    const gchar* time_pref = prefs_peek_string(PREF_TIME_STATUSBAR);
     if (g_strcmp0(time_pref, "off") == 0) {
         return pos;
     }
 
-    if (statusbar->time) {
-        g_free(statusbar->time);
-        statusbar->time = NULL;
-    }
-
-    GDateTime* datetime = g_date_time_new_now(tz);
-    statusbar->time = g_date_time_format(datetime, time_pref);
+    _status_bar_time_update(time_pref);
     assert(statusbar->time != NULL);
-    g_date_time_unref(datetime);
 
     int bracket_attrs = theme_attrs(THEME_STATUS_BRACKET);
     int time_attrs = theme_attrs(THEME_STATUS_TIME);
@@ -527,13 +620,6 @@ _status_bar_draw_time(int pos)
     return pos;
 }
 
-static gboolean
-_tabmode_is_actlist(void)
-{
-    auto_gchar gchar* tabmode = prefs_get_string(PREF_STATUSBAR_TABMODE);
-    return g_strcmp0(tabmode, "actlist") == 0;
-}
-
 static int
 _status_bar_draw_maintext(int pos)
 {
@@ -585,7 +671,7 @@ _status_bar_draw_maintext(int pos)
         mvwprintw(statusbar_win, 0, pos, "%s", statusbar->fulljid);
     }
 
-    gboolean actlist_tabmode = _tabmode_is_actlist();
+    gboolean actlist_tabmode = statusbar->actlist;
     auto_gchar gchar* maintext_ = NULL;
     if (actlist_tabmode) {
         pos = _status_bar_draw_bracket(FALSE, pos, "[");
@@ -607,9 +693,7 @@ _destroy_tab(StatusBarTab* tab)
         if (tab->identifier) {
             free(tab->identifier);
         }
-        if (tab->display_name) {
-            free(tab->display_name);
-        }
+        free(tab->label);
         free(tab);
     }
 }
@@ -617,10 +701,10 @@ _destroy_tab(StatusBarTab* tab)
 static int
 _tabs_width(int start, int end)
 {
-    gboolean show_number = prefs_get_boolean(PREF_STATUSBAR_SHOW_NUMBER);
-    gboolean show_name = prefs_get_boolean(PREF_STATUSBAR_SHOW_NAME);
-    gboolean show_read = prefs_get_boolean(PREF_STATUSBAR_SHOW_READ);
-    gint max_tabs = prefs_get_statusbartabs();
+    gboolean show_number = statusbar->show_number;
+    gboolean show_name = statusbar->show_name;
+    gboolean show_read = statusbar->show_read;
+    gint max_tabs = statusbar->max_tabs;
     guint opened_tabs = g_hash_table_size(statusbar->tabs);
 
     int width = start < 2 ? 1 : 4;
@@ -635,8 +719,8 @@ _tabs_width(int start, int end)
                 if (!show_read && !is_current && !tab->highlight)
                     continue;
 
-                auto_char char* display_name = _display_name(tab);
-                width += utf8_display_len(display_name);
+                _tab_label(tab);
+                width += tab->label_width;
                 width += 3 + _count_digits(i);
             }
         }
@@ -652,8 +736,8 @@ _tabs_width(int start, int end)
                 if (!show_read && !is_current && !tab->highlight)
                     continue;
 
-                auto_char char* display_name = _display_name(tab);
-                width += utf8_display_len(display_name);
+                _tab_label(tab);
+                width += tab->label_width;
                 width += 2;
             }
         }
@@ -680,8 +764,25 @@ _display_name(StatusBarTab* tab)
     } else if (tab->window_type == WIN_PLUGIN) {
         fullname = strdup(tab->identifier);
     } else if (tab->window_type == WIN_CHAT) {
-        if (tab && tab->display_name) {
-            fullname = strdup(tab->display_name);
+        PContact contact = NULL;
+        if (roster_exists()) {
+            contact = roster_get_contact(tab->identifier);
+        }
+        const char* pcontact_name = contact ? p_contact_name(contact) : NULL;
+        auto_gchar gchar* pref = prefs_get_string(PREF_STATUSBAR_CHAT);
+        if (g_strcmp0("user", pref) == 0) {
+            if (pcontact_name) {
+                fullname = strdup(pcontact_name);
+            } else {
+                auto_jid Jid* jidp = jid_create(tab->identifier);
+                if (jidp) {
+                    fullname = jidp->localpart != NULL ? strdup(jidp->localpart) : strdup(jidp->barejid);
+                } else {
+                    fullname = strdup(tab->identifier);
+                }
+            }
+        } else {
+            fullname = strdup(tab->identifier);
         }
     } else if (tab->window_type == WIN_MUC) {
         auto_gchar gchar* mucwin_title = mucwin_generate_title(tab->identifier, PREF_STATUSBAR_ROOM_TITLE);
@@ -714,11 +815,22 @@ _display_name(StatusBarTab* tab)
     return trimmedname;
 }
 
+static const char*
+_tab_label(StatusBarTab* tab)
+{
+    if (!tab->label) {
+        tab->label = _display_name(tab);
+        tab->label_width = utf8_display_len(tab->label);
+    }
+
+    return tab->label;
+}
+
 void
 _get_range_bounds(int* start, int* end, gboolean is_static)
 {
     int current_tab = statusbar->current_tab;
-    gint display_range = prefs_get_statusbartabs();
+    gint display_range = statusbar->max_tabs;
     int total_tabs = g_hash_table_size(statusbar->tabs);
     int side_range = display_range / 2;
 
@@ -104,6 +104,14 @@ title_bar_update_virtual(void)
     _title_bar_draw();
 }
 
+// while a typing notification is shown the title bar has to be redrawn to
+// drop it once it expires
+gboolean
+title_bar_typing_shown(void)
+{
+    return typing_elapsed != NULL;
+}
+
 void
 title_bar_resize(void)
 {
@@ -124,35 +132,34 @@ title_bar_resize(void)
 void
 title_bar_console(void)
 {
-    werase(win);
     if (typing_elapsed) {
         g_timer_destroy(typing_elapsed);
     }
     typing_elapsed = NULL;
     typing = FALSE;
 
-    _title_bar_draw();
+    ui_mark_dirty_part(UI_DIRTY_TITLEBAR);
 }
 
 void
 title_bar_set_presence(contact_presence_t presence)
 {
     current_presence = presence;
-    _title_bar_draw();
+    ui_mark_dirty_part(UI_DIRTY_TITLEBAR);
 }
 
 void
 title_bar_set_connected(gboolean connected)
 {
     is_connected = connected;
-    _title_bar_draw();
+    ui_mark_dirty_part(UI_DIRTY_TITLEBAR);
 }
 
 void
 title_bar_set_tls(gboolean secured)
 {
     tls_secured = secured;
-    _title_bar_draw();
+    ui_mark_dirty_part(UI_DIRTY_TITLEBAR);
 }
 
 void
@@ -164,7 +171,7 @@ title_bar_switch(void)
         typing = FALSE;
     }
 
-    _title_bar_draw();
+    ui_mark_dirty_part(UI_DIRTY_TITLEBAR);
 }
 
 void
@@ -179,7 +186,7 @@ title_bar_set_typing(gboolean is_typing)
     }
 
     typing = is_typing;
-    _title_bar_draw();
+    ui_mark_dirty_part(UI_DIRTY_TITLEBAR);
 }
 
 static void
@@ -38,6 +38,7 @@
 
 void create_title_bar(void);
 void title_bar_update_virtual(void);
+gboolean title_bar_typing_shown(void);
 void title_bar_resize(void);
 void title_bar_console(void);
 void title_bar_set_connected(gboolean connected);
@@ -52,6 +52,8 @@ static GtkStatusIcon* prof_tray = NULL;
 static GString* icon_filename = NULL;
 static GString* icon_msg_filename = NULL;
 static gint unread_messages;
+// icon file currently shown, NULL when hidden, so the timer only touches GTK on change
+static const char* shown_icon = NULL;
 static gboolean shutting_down;
 static guint timer;
 
@@ -131,24 +133,28 @@ _tray_change_icon(gpointer data)
 
     unread_messages = wins_get_total_unread();
 
+    const char* icon = NULL;
     if (unread_messages) {
+        icon = icon_msg_filename->str;
+    } else if (prefs_get_boolean(PREF_TRAY_READ)) {
+        icon = icon_filename->str;
+    }
+
+    if (prof_tray && icon == shown_icon) {
+        return TRUE;
+    }
+
+    if (icon) {
         if (!prof_tray) {
-            prof_tray = gtk_status_icon_new_from_file(icon_msg_filename->str);
-        } else {
-            gtk_status_icon_set_from_file(prof_tray, icon_msg_filename->str);
-        }
-    } else {
-        if (prefs_get_boolean(PREF_TRAY_READ)) {
-            if (!prof_tray) {
-                prof_tray = gtk_status_icon_new_from_file(icon_filename->str);
-            } else {
-                gtk_status_icon_set_from_file(prof_tray, icon_filename->str);
-            }
+            prof_tray = gtk_status_icon_new_from_file(icon);
         } else {
-            g_clear_object(&prof_tray);
-            prof_tray = NULL;
+            gtk_status_icon_set_from_file(prof_tray, icon);
         }
+    } else if (prof_tray) {
+        g_clear_object(&prof_tray);
+        prof_tray = NULL;
     }
+    shown_icon = icon;
 
     return TRUE;
 }
@@ -167,16 +173,6 @@ tray_init(void)
         log_debug("Building GTK icon");
         tray_enable();
     }
-
-    gtk_main_iteration_do(FALSE);
-}
-
-void
-tray_update(void)
-{
-    if (gtk_ready) {
-        gtk_main_iteration_do(FALSE);
-    }
 }
 
 void
@@ -207,6 +203,7 @@ void
 tray_enable(void)
 {
     prof_tray = gtk_status_icon_new_from_file(icon_filename->str);
+    shown_icon = icon_filename->str;
     shutting_down = FALSE;
     _tray_change_icon(NULL);
     int interval = prefs_get_tray_timer() * 1000;
@@ -222,6 +219,7 @@ tray_disable(void)
         g_clear_object(&prof_tray);
         prof_tray = NULL;
     }
+    shown_icon = NULL;
 }
 
 #endif
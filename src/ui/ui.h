@@ -58,8 +58,18 @@
 #define NO_COLOUR_DATE 16
 #define UNTRUSTED      32
 
+// parts of the screen that need drawing on the next update
+typedef enum {
+    UI_DIRTY_WINDOW = 1 << 0, // current window with its roster or occupants panel
+    UI_DIRTY_TITLEBAR = 1 << 1,
+    UI_DIRTY_STATUSBAR = 1 << 2,
+} ui_dirty_t;
+
+#define UI_DIRTY_ALL (UI_DIRTY_WINDOW | UI_DIRTY_TITLEBAR | UI_DIRTY_STATUSBAR)
+
 // core UI
 void ui_init(void);
+void ui_set_headless(void);
 void ui_load_colours(void);
 void ui_update(void);
 void ui_close(void);
@@ -67,6 +77,9 @@ void ui_redraw(void);
 void ui_resize(void);
 void ui_focus_win(ProfWin* window);
 void ui_sigwinch_handler(int sig);
+void ui_mark_dirty(void);
+void ui_mark_dirty_part(ui_dirty_t parts);
+void ui_tick(void);
 void ui_handle_otr_error(const char* const barejid, const char* const message);
 unsigned long ui_get_idle_time(void);
 void ui_reset_idle_time(void);
@@ -125,6 +138,7 @@ gboolean ui_win_has_unsaved_form(int num);
 
 // Chat window
 ProfChatWin* chatwin_new(const char* const barejid);
+void chatwin_history_load(ProfChatWin* chatwin);
 void chatwin_incoming_msg(ProfChatWin* chatwin, ProfMessage* message, gboolean win_created);
 void chatwin_receipt_received(ProfChatWin* chatwin, const char* const id);
 void chatwin_recipient_gone(ProfChatWin* chatwin);
@@ -161,7 +175,7 @@ void mucwin_occupant_affiliation_change(ProfMucWin* mucwin, const char* const ni
                                         const char* const affiliation, const char* const actor, const char* const reason);
 void mucwin_occupant_role_and_affiliation_change(ProfMucWin* mucwin, const char* const nick,
                                                  const char* const role, const char* const affiliation, const char* const actor, const char* const reason);
-void mucwin_roster(ProfMucWin* mucwin, GList* occupants, const char* const presence);
+void mucwin_roster(ProfMucWin* mucwin, const char* const presence);
 void mucwin_history(ProfMucWin* mucwin, const ProfMessage* const message);
 void mucwin_outgoing_msg(ProfMucWin* mucwin, const char* const message, const char* const id, prof_enc_t enc_mode, const char* const replace_id);
 void mucwin_incoming_msg(ProfMucWin* mucwin, const ProfMessage* const message, GSList* mentions, GList* triggers, gboolean filter_reflection);
@@ -199,6 +213,9 @@ gchar* mucwin_get_string(ProfMucWin* mucwin);
 void mucwin_set_enctext(ProfMucWin* mucwin, const char* const enctext);
 void mucwin_unset_enctext(ProfMucWin* mucwin);
 void mucwin_set_message_char(ProfMucWin* mucwin, const char* const ch);
+gboolean mucwin_flood_count(ProfMucWin* mucwin);
+void mucwin_flood_hold(ProfMucWin* mucwin, gboolean mention, gboolean notify_wanted);
+void mucwin_flood_check(void);
 void mucwin_unset_message_char(ProfMucWin* mucwin);
 gchar* mucwin_generate_title(const gchar* const muc_jid, const preference_t pref);
 gboolean mucwin_set_room_name(const gchar* const muc_jid, const gchar* const new_room_name);
@@ -231,7 +248,10 @@ void confwin_field_help(ProfConfWin* confwin, char* tag);
 gchar* confwin_get_string(ProfConfWin* confwin);
 
 // xml console
-void xmlwin_show(ProfXMLWin* xmlwin, const char* const msg);
+void xmlwin_capture(ProfXMLWin* xmlwin, const char* const msg);
+void xmlwin_render(ProfXMLWin* xmlwin);
+gboolean xmlwin_set_filter(ProfXMLWin* xmlwin, const char* const type, const char* const value);
+void xmlwin_show_filters(ProfXMLWin* xmlwin);
 gchar* xmlwin_get_string(ProfXMLWin* xmlwin);
 
 // vCard window
@@ -242,6 +262,8 @@ void vcardwin_update(void);
 // Input window
 char* inp_readline(void);
 void inp_nonblocking(gboolean reset);
+void inp_set_focus_reporting(gboolean enabled);
+gboolean inp_terminal_focused(void);
 
 // Console window
 void cons_show(const char* const msg, ...);
@@ -315,6 +337,7 @@ void cons_occupants_setting(void);
 void cons_roster_setting(void);
 void cons_presence_setting(void);
 void cons_wrap_setting(void);
+void cons_redraw_setting(void);
 void cons_time_setting(void);
 void cons_wintitle_setting(void);
 void cons_notify_setting(void);
@@ -325,6 +348,7 @@ void cons_intype_setting(void);
 void cons_gone_setting(void);
 void cons_history_setting(void);
 void cons_carbons_setting(void);
+void cons_csi_setting(void);
 void cons_receipts_setting(void);
 void cons_log_setting(void);
 void cons_logging_setting(void);
@@ -334,16 +358,19 @@ void cons_autoping_setting(void);
 void cons_autoconnect_setting(void);
 void cons_room_cache_setting(void);
 void cons_inpblock_setting(void);
+void cons_scrollback_setting(void);
 void cons_statusbar_setting(void);
 void cons_winpos_setting(void);
 void cons_color_setting(void);
 void cons_correction_setting(void);
 void cons_executable_setting(void);
 void cons_slashguard_setting(void);
+void cons_fuzzy_setting(void);
 void cons_mam_setting(void);
 void cons_silence_setting(void);
 void cons_mood_setting(void);
 void cons_strophe_setting(void);
+void cons_url_setting(void);
 void cons_privacy_setting(void);
 void cons_show_contact_online(PContact contact, Resource* resource, GDateTime* last_activity);
 void cons_show_contact_offline(PContact contact, char* resource, char* status);
@@ -355,6 +382,7 @@ void cons_show_tlscert_summary(const TLSCertificate* cert);
 void cons_alert(ProfWin* alert_origin_window);
 void cons_remove_alert(ProfWin* window);
 void cons_clear_alerts(void);
+void cons_clear_views(void);
 gboolean cons_has_alerts(void);
 
 // title bar
@@ -365,12 +393,15 @@ void status_bar_inactive(const int win);
 void status_bar_active(const int win, win_type_t wintype, char* identifier);
 void status_bar_new(const int win, win_type_t wintype, char* identifier);
 void status_bar_set_all_inactive(void);
+void status_bar_names_changed(void);
 
 // roster window
 void rosterwin_roster(void);
+void rosterwin_roster_flush(void);
 
 // occupants window
 void occupantswin_occupants(const char* const room);
+void occupantswin_occupants_flush(void);
 void occupantswin_occupants_all(void);
 
 // window interface
@@ -383,10 +414,16 @@ ProfWin* win_create_private(const char* const fulljid);
 ProfWin* win_create_plugin(const char* const plugin_name, const char* const tag);
 ProfWin* win_create_vcard(vCard* vcard);
 void win_update_virtual(ProfWin* window);
+void win_invalidate_virtual(void);
 void win_free(ProfWin* window);
+void win_layout_free(ProfLayout* layout);
+ProfLayout* win_layout_detach(ProfWin* window);
 gboolean win_notify_remind(ProfWin* window);
 int win_unread(ProfWin* window);
 void win_resize(ProfWin* window);
+void win_resize_lazy(ProfWin* window);
+void win_resize_if_stale(ProfWin* window);
+void win_apply_scrollback(ProfWin* window);
 void win_hide_subwin(ProfWin* window);
 void win_show_subwin(ProfWin* window);
 void win_refresh_without_subwin(ProfWin* window);
@@ -394,6 +431,7 @@ void win_refresh_with_subwin(ProfWin* window);
 
 void win_print(ProfWin* window, theme_item_t theme_item, const char* show_char, const char* const message, ...);
 void win_println(ProfWin* window, theme_item_t theme_item, const char* show_char, const char* const message, ...);
+void win_println_at(ProfWin* window, GDateTime* timestamp, theme_item_t theme_item, const char* show_char, const char* const message);
 void win_println_indent(ProfWin* window, int pad, const char* const message, ...);
 
 void win_println_va(ProfWin* window, theme_item_t theme_item, const char* show_char, const char* const message, va_list arg);
@@ -414,6 +452,7 @@ void win_show_vcard(ProfWin* window, vCard* vcard);
 void win_clear(ProfWin* window);
 char* win_get_tab_identifier(ProfWin* window);
 gchar* win_to_string(ProfWin* window);
+void win_buffer_stats(ProfWin* window, int* entries, gsize* bytes);
 void win_command_list_error(ProfWin* window, const char* const error);
 void win_command_exec_error(ProfWin* window, const char* const command, const char* const error, ...);
 void win_handle_command_list(ProfWin* window, GSList* cmds);
@@ -427,6 +466,7 @@ void notifier_uninit(void);
 void notify_typing(const char* const name);
 void notify_message(const char* const name, int win, const char* const text);
 void notify_room_message(const char* const nick, const char* const room, int win, const char* const text);
+void notify_room_flood(const char* const room, int win, int count);
 void notify_remind(void);
 void notify_invite(const char* const from, const char* const room, const char* const reason);
 void notify(const char* const message, int timeout, const char* const category);
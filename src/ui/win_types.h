@@ -93,6 +93,7 @@ typedef struct form_field_t
     gboolean required;
     GSList* values;
     GSList* options;
+    GHashTable* option_values; // option value -> FormOption, NULL without options
     Autocomplete value_ac;
 } FormField;
 
@@ -104,6 +105,7 @@ typedef struct data_form_t
     GSList* fields;
     GHashTable* var_to_tag;
     GHashTable* tag_to_var;
+    GHashTable* var_to_field; // first field with each var, see form.c
     Autocomplete tag_ac;
     gboolean modified;
 } DataForm;
@@ -120,6 +122,8 @@ typedef struct prof_layout_t
     ProfBuff buffer;
     int y_pos;
     int paged;
+    gboolean stale; // resized while hidden, needs re-wrapping before shown
+    gboolean deferred; // printed to while hidden, pad not laid out yet
 } ProfLayout;
 
 typedef struct prof_layout_simple_t
@@ -132,6 +136,10 @@ typedef struct prof_layout_split_t
     ProfLayout base;
     WINDOW* subwin;
     int sub_y_pos;
+    // a clipped subwin only holds the rows from sub_offset on, sub_rows is
+    // how far its content goes, 0 when the pad holds all of it
+    int sub_offset;
+    int sub_rows;
     unsigned long memcheck;
 } ProfLayoutSplit;
 
@@ -180,6 +188,7 @@ typedef struct prof_chat_win_t
     gboolean is_ox; // XEP-0373: OpenPGP for XMPP
     char* resource_override;
     gboolean history_shown;
+    gboolean history_pending; // db history and MAM catch-up wait for the first focus
     unsigned long memcheck;
     char* enctext;
     char* incoming_char;
@@ -188,6 +197,8 @@ typedef struct prof_chat_win_t
     char* last_message;
     char* last_msg_id;
     gboolean has_attention;
+    struct prof_history_cursor_t* history_cursor; // db paging state for scrolling up
+    GDateTime* history_view_end; // newest db row shown once newer lines were dropped, NULL when following live
 } ProfChatWin;
 
 typedef struct prof_muc_win_t
@@ -209,6 +220,13 @@ typedef struct prof_muc_win_t
     char* last_message;
     char* last_msg_id;
     gboolean has_attention;
+    // flood governor, see mucwin_flood_count()
+    gint64 flood_start;
+    int flood_count;
+    gboolean flooding;
+    int flood_held;
+    gboolean flood_held_mention;
+    gboolean flood_held_notify;
 } ProfMucWin;
 
 typedef struct prof_conf_win_t ProfConfWin;
@@ -235,9 +253,25 @@ typedef struct prof_private_win_t
     gboolean room_left;
 } ProfPrivateWin;
 
+// Stanzas the XML console keeps until they are rendered, older ones are dropped
+#define XMLWIN_RING_SIZE 512
+
+typedef struct prof_xml_stanza_t
+{
+    gint64 time;
+    gboolean sent;
+    char* text;
+} ProfXMLStanza;
+
 typedef struct prof_xml_win_t
 {
     ProfWin window;
+    ProfXMLStanza ring[XMLWIN_RING_SIZE];
+    guint64 captured;
+    guint64 rendered;
+    char* filter_element;
+    char* filter_ns;
+    char* filter_jid;
     unsigned long memcheck;
 } ProfXMLWin;
 
@@ -59,6 +59,7 @@
 #include "ui/ui.h"
 #include "ui/window.h"
 #include "ui/screen.h"
+#include "ui/wrap.h"
 #include "xmpp/xmpp.h"
 #include "xmpp/roster_list.h"
 #include "xmpp/connection.h"
@@ -72,8 +73,15 @@
 static void
 _win_printf(ProfWin* window, const char* show_char, int pad_indent, GDateTime* timestamp, int flags, theme_item_t theme_item, const char* const display_from, const char* const from_jid, const char* const message_id, const char* const message, ...);
 static void _win_print_internal(ProfWin* window, const char* show_char, int pad_indent, GDateTime* time,
-                                int flags, theme_item_t theme_item, const char* const from, const char* const message, DeliveryReceipt* receipt);
-static void _win_print_wrapped(WINDOW* win, const char* const message, size_t indent, int pad_indent);
+                                int flags, theme_item_t theme_item, const char* const from, const char* const message, DeliveryReceipt* receipt, ProfWrap** wrap);
+static void _win_print_wrapped(WINDOW* win, const char* const message, size_t indent, int pad_indent, ProfWrap** wrap);
+static int _win_pad_initial_rows(void);
+static WINDOW* _win_pad_create(int cols);
+static void _win_pad_reserve(WINDOW* pad, int rows);
+static void _win_pad_cover(WINDOW* pad, int y_pos, int rows);
+static gboolean _win_defer(ProfWin* window);
+static void _win_redraw(ProfWin* window);
+static void _win_redraw_entry(ProfWin* window, ProfBuffEntry* entry);
 
 int
 win_roster_cols(void)
@@ -91,38 +99,124 @@ win_occpuants_cols(void)
     return CEILING((((double)cols) / 100) * occupants_win_percent);
 }
 
+// Pads grow as content is printed, so memory follows what a window actually
+// holds rather than reserving PAD_SIZE rows for every window. They are shrunk
+// back down to one screen on redraw.
+static int
+_win_pad_initial_rows(void)
+{
+    return MAX(getmaxy(stdscr), 1);
+}
+
+// new pads start with a single row, windows created in the background (e.g.
+// autojoined rooms) only lay out their pad once they are first shown
+static WINDOW*
+_win_pad_create(int cols)
+{
+    return newpad(1, cols);
+}
+
+// make sure at least rows more lines fit below the cursor
+static void
+_win_pad_reserve(WINDOW* pad, int rows)
+{
+    int maxy = getmaxy(pad);
+    int needed = getcury(pad) + rows + 1;
+    if (needed <= maxy || maxy >= PAD_SIZE) {
+        return;
+    }
+
+    int new_rows = MIN(MAX(maxy * 2, needed), PAD_SIZE);
+    wresize(pad, new_rows, getmaxx(pad));
+}
+
+// pnoutrefresh only copies rows that exist in the pad, make sure the whole
+// viewport is backed so nothing stale shows through below the content
+static void
+_win_pad_cover(WINDOW* pad, int y_pos, int rows)
+{
+    int needed = y_pos + rows;
+    if (needed > getmaxy(pad) && needed <= PAD_SIZE) {
+        wresize(pad, needed, getmaxx(pad));
+    }
+}
+
+// entries printed to a hidden window only go to the buffer, the pad is
+// laid out from it in one pass when the window is next shown
+static gboolean
+_win_defer(ProfWin* window)
+{
+    if (wins_is_current(window)) {
+        return FALSE;
+    }
+
+    window->layout->deferred = TRUE;
+    return TRUE;
+}
+
+static const char*
+_win_scrollback_type(win_type_t type)
+{
+    switch (type) {
+    case WIN_CHAT:
+        return "chat";
+    case WIN_MUC:
+        return "muc";
+    case WIN_PRIVATE:
+        return "private";
+    case WIN_CONFIG:
+        return "config";
+    case WIN_XML:
+        return "xml";
+    default:
+        return "console";
+    }
+}
+
+static int
+_win_scrollback_size(win_type_t type)
+{
+    return prefs_get_scrollback(_win_scrollback_type(type));
+}
+
 static ProfLayout*
-_win_create_simple_layout(void)
+_win_create_simple_layout(win_type_t type)
 {
     int cols = getmaxx(stdscr);
 
     ProfLayoutSimple* layout = malloc(sizeof(ProfLayoutSimple));
     layout->base.type = LAYOUT_SIMPLE;
-    layout->base.win = newpad(PAD_SIZE, cols);
+    layout->base.win = _win_pad_create(cols);
     wbkgd(layout->base.win, theme_attrs(THEME_TEXT));
-    layout->base.buffer = buffer_create();
+    layout->base.buffer = buffer_create(_win_scrollback_size(type));
     layout->base.y_pos = 0;
     layout->base.paged = 0;
+    layout->base.stale = FALSE;
+    layout->base.deferred = FALSE;
     scrollok(layout->base.win, TRUE);
 
     return &layout->base;
 }
 
 static ProfLayout*
-_win_create_split_layout(void)
+_win_create_split_layout(win_type_t type)
 {
     int cols = getmaxx(stdscr);
 
     ProfLayoutSplit* layout = malloc(sizeof(ProfLayoutSplit));
     layout->base.type = LAYOUT_SPLIT;
-    layout->base.win = newpad(PAD_SIZE, cols);
+    layout->base.win = _win_pad_create(cols);
     wbkgd(layout->base.win, theme_attrs(THEME_TEXT));
-    layout->base.buffer = buffer_create();
+    layout->base.buffer = buffer_create(_win_scrollback_size(type));
     layout->base.y_pos = 0;
     layout->base.paged = 0;
+    layout->base.stale = FALSE;
+    layout->base.deferred = FALSE;
     scrollok(layout->base.win, TRUE);
     layout->subwin = NULL;
     layout->sub_y_pos = 0;
+    layout->sub_offset = 0;
+    layout->sub_rows = 0;
     layout->memcheck = LAYOUT_SPLIT_MEMCHECK;
 
     return &layout->base;
@@ -134,7 +228,7 @@ win_create_console(void)
     ProfConsoleWin* new_win = malloc(sizeof(ProfConsoleWin));
     new_win->window.type = WIN_CONSOLE;
     new_win->window.scroll_state = WIN_SCROLL_INNER;
-    new_win->window.layout = _win_create_split_layout();
+    new_win->window.layout = _win_create_split_layout(WIN_CONSOLE);
 
     return &new_win->window;
 }
@@ -145,7 +239,7 @@ win_create_chat(const char* const barejid)
     ProfChatWin* new_win = malloc(sizeof(ProfChatWin));
     new_win->window.type = WIN_CHAT;
     new_win->window.scroll_state = WIN_SCROLL_INNER;
-    new_win->window.layout = _win_create_simple_layout();
+    new_win->window.layout = _win_create_simple_layout(WIN_CHAT);
 
     new_win->barejid = strdup(barejid);
     new_win->resource_override = NULL;
@@ -156,6 +250,7 @@ win_create_chat(const char* const barejid)
     new_win->is_omemo = FALSE;
     new_win->is_ox = FALSE;
     new_win->history_shown = FALSE;
+    new_win->history_pending = FALSE;
     new_win->unread = 0;
     new_win->state = chat_state_new();
     new_win->enctext = NULL;
@@ -164,6 +259,8 @@ win_create_chat(const char* const barejid)
     new_win->last_message = NULL;
     new_win->last_msg_id = NULL;
     new_win->has_attention = FALSE;
+    new_win->history_cursor = NULL;
+    new_win->history_view_end = NULL;
     new_win->memcheck = PROFCHATWIN_MEMCHECK;
 
     return &new_win->window;
@@ -182,20 +279,24 @@ win_create_muc(const char* const roomjid)
 
     if (prefs_get_boolean(PREF_OCCUPANTS)) {
         int subwin_cols = win_occpuants_cols();
-        layout->base.win = newpad(PAD_SIZE, cols - subwin_cols);
+        layout->base.win = _win_pad_create(cols - subwin_cols);
         wbkgd(layout->base.win, theme_attrs(THEME_TEXT));
-        layout->subwin = newpad(PAD_SIZE, subwin_cols);
+        layout->subwin = _win_pad_create(subwin_cols);
         wbkgd(layout->subwin, theme_attrs(THEME_TEXT));
     } else {
-        layout->base.win = newpad(PAD_SIZE, (cols));
+        layout->base.win = _win_pad_create((cols));
         wbkgd(layout->base.win, theme_attrs(THEME_TEXT));
         layout->subwin = NULL;
     }
     layout->sub_y_pos = 0;
+    layout->sub_offset = 0;
+    layout->sub_rows = 0;
     layout->memcheck = LAYOUT_SPLIT_MEMCHECK;
-    layout->base.buffer = buffer_create();
+    layout->base.buffer = buffer_create(_win_scrollback_size(WIN_MUC));
     layout->base.y_pos = 0;
     layout->base.paged = 0;
+    layout->base.stale = FALSE;
+    layout->base.deferred = FALSE;
     scrollok(layout->base.win, TRUE);
     new_win->window.layout = (ProfLayout*)layout;
 
@@ -220,6 +321,12 @@ win_create_muc(const char* const roomjid)
     new_win->last_message = NULL;
     new_win->last_msg_id = NULL;
     new_win->has_attention = FALSE;
+    new_win->flood_start = 0;
+    new_win->flood_count = 0;
+    new_win->flooding = FALSE;
+    new_win->flood_held = 0;
+    new_win->flood_held_mention = FALSE;
+    new_win->flood_held_notify = FALSE;
 
     new_win->memcheck = PROFMUCWIN_MEMCHECK;
 
@@ -232,7 +339,7 @@ win_create_config(const char* const roomjid, DataForm* form, ProfConfWinCallback
     ProfConfWin* new_win = malloc(sizeof(ProfConfWin));
     new_win->window.type = WIN_CONFIG;
     new_win->window.scroll_state = WIN_SCROLL_INNER;
-    new_win->window.layout = _win_create_simple_layout();
+    new_win->window.layout = _win_create_simple_layout(WIN_CONFIG);
     new_win->roomjid = strdup(roomjid);
     new_win->form = form;
     new_win->submit = submit;
@@ -250,7 +357,7 @@ win_create_private(const char* const fulljid)
     ProfPrivateWin* new_win = malloc(sizeof(ProfPrivateWin));
     new_win->window.type = WIN_PRIVATE;
     new_win->window.scroll_state = WIN_SCROLL_INNER;
-    new_win->window.layout = _win_create_simple_layout();
+    new_win->window.layout = _win_create_simple_layout(WIN_PRIVATE);
     new_win->fulljid = strdup(fulljid);
     new_win->unread = 0;
     new_win->occupant_offline = FALSE;
@@ -267,7 +374,13 @@ win_create_xmlconsole(void)
     ProfXMLWin* new_win = malloc(sizeof(ProfXMLWin));
     new_win->window.type = WIN_XML;
     new_win->window.scroll_state = WIN_SCROLL_INNER;
-    new_win->window.layout = _win_create_simple_layout();
+    new_win->window.layout = _win_create_simple_layout(WIN_XML);
+    memset(new_win->ring, 0, sizeof(new_win->ring));
+    new_win->captured = 0;
+    new_win->rendered = 0;
+    new_win->filter_element = NULL;
+    new_win->filter_ns = NULL;
+    new_win->filter_jid = NULL;
 
     new_win->memcheck = PROFXMLWIN_MEMCHECK;
 
@@ -280,7 +393,7 @@ win_create_plugin(const char* const plugin_name, const char* const tag)
     ProfPluginWin* new_win = malloc(sizeof(ProfPluginWin));
     new_win->window.type = WIN_PLUGIN;
     new_win->window.scroll_state = WIN_SCROLL_INNER;
-    new_win->window.layout = _win_create_simple_layout();
+    new_win->window.layout = _win_create_simple_layout(WIN_PLUGIN);
 
     new_win->tag = strdup(tag);
     new_win->plugin_name = strdup(plugin_name);
@@ -296,7 +409,7 @@ win_create_vcard(vCard* vcard)
     ProfVcardWin* new_win = malloc(sizeof(ProfVcardWin));
     new_win->window.type = WIN_VCARD;
     new_win->window.scroll_state = WIN_SCROLL_INNER;
-    new_win->window.layout = _win_create_simple_layout();
+    new_win->window.layout = _win_create_simple_layout(WIN_VCARD);
 
     new_win->vcard = vcard;
     new_win->memcheck = PROFVCARDWIN_MEMCHECK;
@@ -515,6 +628,13 @@ win_to_string(ProfWin* window)
     assert(FALSE);
 }
 
+void
+win_buffer_stats(ProfWin* window, int* entries, gsize* bytes)
+{
+    *entries = buffer_size(window->layout->buffer);
+    *bytes = buffer_memory(window->layout->buffer);
+}
+
 void
 win_hide_subwin(ProfWin* window)
 {
@@ -525,12 +645,14 @@ win_hide_subwin(ProfWin* window)
         }
         layout->subwin = NULL;
         layout->sub_y_pos = 0;
+        layout->sub_offset = 0;
+        layout->sub_rows = 0;
         int cols = getmaxx(stdscr);
-        wresize(layout->base.win, PAD_SIZE, cols);
+        wresize(layout->base.win, getmaxy(layout->base.win), cols);
         win_redraw(window);
     } else {
         int cols = getmaxx(stdscr);
-        wresize(window->layout->win, PAD_SIZE, cols);
+        wresize(window->layout->win, getmaxy(window->layout->win), cols);
         win_redraw(window);
     }
 }
@@ -552,27 +674,53 @@ win_show_subwin(ProfWin* window)
     }
 
     ProfLayoutSplit* layout = (ProfLayoutSplit*)window->layout;
-    layout->subwin = newpad(PAD_SIZE, subwin_cols);
+    layout->subwin = _win_pad_create(subwin_cols);
+    layout->sub_offset = 0;
+    layout->sub_rows = 0;
     wbkgd(layout->subwin, theme_attrs(THEME_TEXT));
-    wresize(layout->base.win, PAD_SIZE, cols - subwin_cols);
+    wresize(layout->base.win, getmaxy(layout->base.win), cols - subwin_cols);
     win_redraw(window);
 }
 
 void
-win_free(ProfWin* window)
+win_layout_free(ProfLayout* layout)
 {
-    if (window->layout->type == LAYOUT_SPLIT) {
-        ProfLayoutSplit* layout = (ProfLayoutSplit*)window->layout;
-        if (layout->subwin) {
-            delwin(layout->subwin);
+    if (!layout) {
+        return;
+    }
+
+    if (layout->type == LAYOUT_SPLIT) {
+        ProfLayoutSplit* split = (ProfLayoutSplit*)layout;
+        if (split->subwin) {
+            delwin(split->subwin);
         }
-        buffer_free(layout->base.buffer);
-        delwin(layout->base.win);
-    } else {
-        buffer_free(window->layout->buffer);
-        delwin(window->layout->win);
     }
-    free(window->layout);
+    buffer_free(layout->buffer);
+    delwin(layout->win);
+    free(layout);
+}
+
+ProfLayout*
+win_layout_detach(ProfWin* window)
+{
+    ProfLayout* layout = window->layout;
+    window->layout = NULL;
+
+    // the buffer keeps the wrapped lines, the pad is repainted from them on reuse
+    wresize(layout->win, 1, getmaxx(layout->win));
+    werase(layout->win);
+    layout->y_pos = 0;
+    layout->paged = 0;
+    layout->stale = TRUE;
+
+    return layout;
+}
+
+void
+win_free(ProfWin* window)
+{
+    // NULL when the layout was kept for reopening the window later
+    win_layout_free(window->layout);
 
     switch (window->type) {
     case WIN_CHAT:
@@ -585,6 +733,10 @@ win_free(ProfWin* window)
         free(chatwin->outgoing_char);
         free(chatwin->last_message);
         free(chatwin->last_msg_id);
+        log_database_history_cursor_free(chatwin->history_cursor);
+        if (chatwin->history_view_end) {
+            g_date_time_unref(chatwin->history_view_end);
+        }
         chat_state_free(chatwin->state);
         break;
     }
@@ -619,6 +771,17 @@ win_free(ProfWin* window)
         free(pluginwin->plugin_name);
         break;
     }
+    case WIN_XML:
+    {
+        ProfXMLWin* xmlwin = (ProfXMLWin*)window;
+        for (int i = 0; i < XMLWIN_RING_SIZE; i++) {
+            free(xmlwin->ring[i].text);
+        }
+        free(xmlwin->filter_element);
+        free(xmlwin->filter_ns);
+        free(xmlwin->filter_jid);
+        break;
+    }
     default:
         break;
     }
@@ -639,12 +802,16 @@ win_page_up(ProfWin* window, int scroll_size)
     *scroll_state = (*scroll_state == WIN_SCROLL_REACHED_BOTTOM) ? WIN_SCROLL_INNER : *scroll_state;
     *page_start -= scroll_size;
 
-    if (*page_start == -scroll_size && window->type == WIN_CHAT) {
+    // load older history while a screen of it is still left above, so the
+    // next page is there before the reader gets to the top
+    if (*page_start < page_space && window->type == WIN_CHAT) {
         ProfChatWin* chatwin = (ProfChatWin*)window;
         ProfBuffEntry* first_entry = buffer_size(window->layout->buffer) != 0 ? buffer_get_entry(window->layout->buffer, 0) : NULL;
 
         // Don't do anything if still fetching mam messages
         if (first_entry && !(first_entry->theme_item == THEME_ROOMINFO && g_strcmp0(first_entry->message, LOADING_MESSAGE) == 0)) {
+            int anchor = first_entry->y_start_pos;
+
             if (*scroll_state != WIN_SCROLL_REACHED_TOP) {
                 *scroll_state = !chatwin_db_history(chatwin, NULL, NULL, TRUE) ? WIN_SCROLL_REACHED_TOP : WIN_SCROLL_INNER;
             }
@@ -654,10 +821,9 @@ win_page_up(ProfWin* window, int scroll_size)
                 iq_mam_request_older(chatwin);
             }
 
-            int buff_size = buffer_size(window->layout->buffer);
-            int offset_entry_id = buff_size > 10 ? 10 : buff_size - 1;
-            int offset = buffer_get_entry(window->layout->buffer, offset_entry_id)->y_end_pos;
-            *page_start = offset - page_space;
+            // the prepended lines push the ones in view down
+            *page_start += first_entry->y_start_pos - anchor;
+            total_rows = getcury(window->layout->win);
         }
     }
 
@@ -698,7 +864,11 @@ win_page_down(ProfWin* window, int scroll_size)
         int bf_size = buffer_size(window->layout->buffer);
         if (bf_size > 0) {
             ProfBuffEntry* last_entry = buffer_get_entry(window->layout->buffer, bf_size - 1);
-            auto_gchar gchar* start = g_date_time_format_iso8601(last_entry->time);
+            GDateTime* last_time = buffer_entry_time(last_entry);
+            auto_gchar gchar* start = last_time ? g_date_time_format_iso8601(last_time) : NULL;
+            if (last_time) {
+                g_date_time_unref(last_time);
+            }
             GDateTime* now = g_date_time_new_now_local();
             gchar* end_date = g_date_time_format_iso8601(now);
             if (*scroll_state != WIN_SCROLL_REACHED_BOTTOM && !chatwin_db_history((ProfChatWin*)window, start, end_date, FALSE)) {
@@ -742,7 +912,7 @@ win_sub_page_down(ProfWin* window)
         int rows = getmaxy(stdscr);
         int page_space = rows - 4;
         ProfLayoutSplit* split_layout = (ProfLayoutSplit*)window->layout;
-        int sub_y = getcury(split_layout->subwin);
+        int sub_y = split_layout->sub_rows > 0 ? split_layout->sub_rows : getcury(split_layout->subwin);
         int* sub_y_pos = &(split_layout->sub_y_pos);
 
         *sub_y_pos += page_space;
@@ -755,7 +925,16 @@ win_sub_page_down(ProfWin* window)
         else if (*sub_y_pos >= sub_y)
             *sub_y_pos = sub_y - page_space - 1;
 
-        win_update_virtual(window);
+        if (*sub_y_pos < 0)
+            *sub_y_pos = 0;
+
+        // the roster pad only holds the rows that were on screen, it is
+        // shown once the new slice has been drawn
+        if (window->type == WIN_CONSOLE) {
+            rosterwin_roster();
+        } else {
+            win_update_virtual(window);
+        }
     }
 }
 
@@ -774,7 +953,11 @@ win_sub_page_up(ProfWin* window)
         if (*sub_y_pos < 0)
             *sub_y_pos = 0;
 
-        win_update_virtual(window);
+        if (window->type == WIN_CONSOLE) {
+            rosterwin_roster();
+        } else {
+            win_update_virtual(window);
+        }
     }
 }
 
@@ -784,7 +967,7 @@ win_clear(ProfWin* window)
     if (!prefs_get_boolean(PREF_CLEAR_PERSIST_HISTORY)) {
         werase(window->layout->win);
         buffer_free(window->layout->buffer);
-        window->layout->buffer = buffer_create();
+        window->layout->buffer = buffer_create(_win_scrollback_size(window->type));
         return;
     }
 
@@ -810,9 +993,9 @@ win_resize(ProfWin* window)
                 subwin_cols = win_occpuants_cols();
             }
             wbkgd(layout->base.win, theme_attrs(THEME_TEXT));
-            wresize(layout->base.win, PAD_SIZE, cols - subwin_cols);
+            wresize(layout->base.win, getmaxy(layout->base.win), cols - subwin_cols);
             wbkgd(layout->subwin, theme_attrs(THEME_TEXT));
-            wresize(layout->subwin, PAD_SIZE, subwin_cols);
+            wresize(layout->subwin, getmaxy(layout->subwin), subwin_cols);
             if (window->type == WIN_CONSOLE) {
                 rosterwin_roster();
             } else if (window->type == WIN_MUC) {
@@ -822,14 +1005,89 @@ win_resize(ProfWin* window)
             }
         } else {
             wbkgd(layout->base.win, theme_attrs(THEME_TEXT));
-            wresize(layout->base.win, PAD_SIZE, cols);
+            wresize(layout->base.win, getmaxy(layout->base.win), cols);
         }
     } else {
         wbkgd(window->layout->win, theme_attrs(THEME_TEXT));
-        wresize(window->layout->win, PAD_SIZE, cols);
+        wresize(window->layout->win, getmaxy(window->layout->win), cols);
     }
 
-    win_redraw(window);
+    window->layout->stale = FALSE;
+    _win_redraw(window);
+}
+
+void
+win_resize_lazy(ProfWin* window)
+{
+    window->layout->stale = TRUE;
+}
+
+void
+win_resize_if_stale(ProfWin* window)
+{
+    if (window->layout->stale) {
+        win_resize(window);
+    } else if (window->layout->deferred) {
+        _win_redraw(window);
+    }
+}
+
+void
+win_apply_scrollback(ProfWin* window)
+{
+    if (buffer_set_max_size(window->layout->buffer, _win_scrollback_size(window->type)) > 0) {
+        win_redraw(window);
+    }
+}
+
+// the pads and positions the last win_update_virtual copied to the virtual
+// screen, with the same view in place only rows written since need copying
+static struct
+{
+    WINDOW* win;
+    int y_pos;
+    WINDOW* subwin;
+    int sub_y_pos;
+    int row_start;
+    int row_end;
+    int cols;
+    int subwin_cols;
+} virtual_view;
+
+void
+win_invalidate_virtual(void)
+{
+    memset(&virtual_view, 0, sizeof(virtual_view));
+}
+
+static void
+_win_pad_refresh(WINDOW* pad, int y_pos, gboolean same_view, int row_start, int row_end, int col_start, int col_end)
+{
+    int rows = row_end - row_start + 1;
+    _win_pad_cover(pad, y_pos, rows);
+
+    if (!same_view) {
+        // with insert/delete line allowed curses sends a scroll and the new
+        // rows when the view moved down, not a repaint of every row
+        idlok(pad, prefs_get_boolean(PREF_MAINWIN_SCROLL));
+        pnoutrefresh(pad, y_pos, 0, row_start, col_start, row_end, col_end);
+        return;
+    }
+
+    int first = -1;
+    int last = -1;
+    int pad_rows = getmaxy(pad);
+    for (int i = 0; i < rows && y_pos + i < pad_rows; i++) {
+        if (is_linetouched(pad, y_pos + i) == TRUE) {
+            if (first < 0) {
+                first = i;
+            }
+            last = i;
+        }
+    }
+    if (first >= 0) {
+        pnoutrefresh(pad, y_pos + first, 0, row_start + first, col_start, row_start + last, col_end);
+    }
 }
 
 void
@@ -839,23 +1097,45 @@ win_update_virtual(ProfWin* window)
 
     int row_start = screen_mainwin_row_start();
     int row_end = screen_mainwin_row_end();
+
+    WINDOW* subwin = NULL;
+    int sub_y_pos = 0;
+    int subwin_cols = 0;
     if (window->layout->type == LAYOUT_SPLIT) {
         ProfLayoutSplit* layout = (ProfLayoutSplit*)window->layout;
         if (layout->subwin) {
-            int subwin_cols = 0;
+            subwin = layout->subwin;
+            sub_y_pos = layout->sub_y_pos - layout->sub_offset;
             if (window->type == WIN_MUC) {
                 subwin_cols = win_occpuants_cols();
             } else {
                 subwin_cols = win_roster_cols();
             }
-            pnoutrefresh(layout->base.win, layout->base.y_pos, 0, row_start, 0, row_end, (cols - subwin_cols) - 1);
-            pnoutrefresh(layout->subwin, layout->sub_y_pos, 0, row_start, (cols - subwin_cols), row_end, cols - 1);
-        } else {
-            pnoutrefresh(layout->base.win, layout->base.y_pos, 0, row_start, 0, row_end, cols - 1);
         }
-    } else {
-        pnoutrefresh(window->layout->win, window->layout->y_pos, 0, row_start, 0, row_end, cols - 1);
     }
+
+    gboolean same_view = virtual_view.win == window->layout->win
+                         && virtual_view.y_pos == window->layout->y_pos
+                         && virtual_view.subwin == subwin
+                         && virtual_view.sub_y_pos == sub_y_pos
+                         && virtual_view.row_start == row_start
+                         && virtual_view.row_end == row_end
+                         && virtual_view.cols == cols
+                         && virtual_view.subwin_cols == subwin_cols;
+
+    _win_pad_refresh(window->layout->win, window->layout->y_pos, same_view, row_start, row_end, 0, (cols - subwin_cols) - 1);
+    if (subwin) {
+        _win_pad_refresh(subwin, sub_y_pos, same_view, row_start, row_end, (cols - subwin_cols), cols - 1);
+    }
+
+    virtual_view.win = window->layout->win;
+    virtual_view.y_pos = window->layout->y_pos;
+    virtual_view.subwin = subwin;
+    virtual_view.sub_y_pos = sub_y_pos;
+    virtual_view.row_start = row_start;
+    virtual_view.row_end = row_end;
+    virtual_view.cols = cols;
+    virtual_view.subwin_cols = subwin_cols;
 }
 
 void
@@ -863,9 +1143,12 @@ win_refresh_without_subwin(ProfWin* window)
 {
     int cols = getmaxx(stdscr);
 
+    win_invalidate_virtual();
+
     if ((window->type == WIN_MUC) || (window->type == WIN_CONSOLE)) {
         int row_start = screen_mainwin_row_start();
         int row_end = screen_mainwin_row_end();
+        _win_pad_cover(window->layout->win, window->layout->y_pos, row_end - row_start + 1);
         pnoutrefresh(window->layout->win, window->layout->y_pos, 0, row_start, 0, row_end, cols - 1);
     }
 }
@@ -888,8 +1171,13 @@ win_refresh_with_subwin(ProfWin* window)
         return;
     }
 
+    win_invalidate_virtual();
+
+    _win_pad_cover(layout->base.win, layout->base.y_pos, row_end - row_start + 1);
     pnoutrefresh(layout->base.win, layout->base.y_pos, 0, row_start, 0, row_end, (cols - subwin_cols) - 1);
-    pnoutrefresh(layout->subwin, layout->sub_y_pos, 0, row_start, (cols - subwin_cols), row_end, cols - 1);
+    int sub_y_pos = layout->sub_y_pos - layout->sub_offset;
+    _win_pad_cover(layout->subwin, sub_y_pos, row_end - row_start + 1);
+    pnoutrefresh(layout->subwin, sub_y_pos, 0, row_start, (cols - subwin_cols), row_end, cols - 1);
 }
 
 void
@@ -1397,17 +1685,12 @@ _win_correct(ProfWin* window, const char* const message, const char* const id, c
     entry->date = buffer_date_new_now();
     */
 
-    g_free(entry->show_char);
-    entry->show_char = prefs_get_correction_char();
-
-    if (entry->message) {
-        free(entry->message);
-    }
-    entry->message = strdup(message);
+    auto_gchar gchar* correction_char = prefs_get_correction_char();
+    buffer_set_entry_message(window->layout->buffer, entry, correction_char, message);
 
     // LMC requires original message ID, hence ID remains the same
 
-    win_redraw(window);
+    _win_redraw_entry(window, entry);
     return TRUE;
 }
 
@@ -1498,9 +1781,14 @@ win_print_history(ProfWin* window, const ProfMessage* const message)
 
     wins_add_urls_ac(window, message, FALSE);
     wins_add_quotes_ac(window, message->plain, FALSE);
-    int y_start_pos = getcury(window->layout->win);
-    _win_print_internal(window, ch, 0, message->timestamp, flags, THEME_TEXT_HISTORY, display_name, message->plain, NULL);
-    buffer_append(window->layout->buffer, ch, 0, message->timestamp, flags, THEME_TEXT_HISTORY, display_name, message->from_jid->barejid, message->plain, NULL, message->id, y_start_pos, getcury(window->layout->win));
+    int y_start_pos = -1;
+    int y_end_pos = -1;
+    if (!_win_defer(window)) {
+        y_start_pos = getcury(window->layout->win);
+        _win_print_internal(window, ch, 0, message->timestamp, flags, THEME_TEXT_HISTORY, display_name, message->plain, NULL, NULL);
+        y_end_pos = getcury(window->layout->win);
+    }
+    buffer_append(window->layout->buffer, ch, 0, message->timestamp, flags, THEME_TEXT_HISTORY, display_name, message->from_jid->barejid, message->plain, NULL, message->id, y_start_pos, y_end_pos);
 
     inp_nonblocking(TRUE);
     g_date_time_unref(message->timestamp);
@@ -1516,11 +1804,16 @@ win_print_old_history(ProfWin* window, const ProfMessage* const message)
 
     auto_char char* ch = get_show_char(message->enc);
 
-    int y_start_pos = getcury(window->layout->win);
     wins_add_urls_ac(window, message, TRUE);
     wins_add_quotes_ac(window, message->plain, TRUE);
-    _win_print_internal(window, ch, 0, message->timestamp, flags, THEME_TEXT_HISTORY, display_name, message->plain, NULL);
-    buffer_prepend(window->layout->buffer, ch, 0, message->timestamp, flags, THEME_TEXT_HISTORY, display_name, message->from_jid->barejid, message->plain, NULL, message->id, y_start_pos, getcury(window->layout->win));
+    int y_start_pos = -1;
+    int y_end_pos = -1;
+    if (!_win_defer(window)) {
+        y_start_pos = getcury(window->layout->win);
+        _win_print_internal(window, ch, 0, message->timestamp, flags, THEME_TEXT_HISTORY, display_name, message->plain, NULL, NULL);
+        y_end_pos = getcury(window->layout->win);
+    }
+    buffer_prepend(window->layout->buffer, ch, 0, message->timestamp, flags, THEME_TEXT_HISTORY, display_name, message->from_jid->barejid, message->plain, NULL, message->id, y_start_pos, y_end_pos);
 
     inp_nonblocking(TRUE);
     g_date_time_unref(message->timestamp);
@@ -1533,9 +1826,14 @@ win_println_va_internal(ProfWin* window, theme_item_t theme_item, int pad, int f
 
     auto_gchar gchar* msg = g_strdup_vprintf(message, arg);
 
-    int y_start_pos = getcury(window->layout->win);
-    _win_print_internal(window, show_char, pad, timestamp, flags, theme_item, "", msg, NULL);
-    buffer_append(window->layout->buffer, show_char, pad, timestamp, flags, theme_item, "", NULL, msg, NULL, NULL, y_start_pos, getcury(window->layout->win));
+    int y_start_pos = -1;
+    int y_end_pos = -1;
+    if (!_win_defer(window)) {
+        y_start_pos = getcury(window->layout->win);
+        _win_print_internal(window, show_char, pad, timestamp, flags, theme_item, "", msg, NULL, NULL);
+        y_end_pos = getcury(window->layout->win);
+    }
+    buffer_append(window->layout->buffer, show_char, pad, timestamp, flags, theme_item, "", NULL, msg, NULL, NULL, y_start_pos, y_end_pos);
 
     inp_nonblocking(TRUE);
     g_date_time_unref(timestamp);
@@ -1565,6 +1863,12 @@ win_println(ProfWin* window, theme_item_t theme_item, const char* show_char, con
     va_end(arg);
 }
 
+void
+win_println_at(ProfWin* window, GDateTime* timestamp, theme_item_t theme_item, const char* show_char, const char* const message)
+{
+    _win_printf(window, show_char, 0, timestamp, 0, theme_item, "", NULL, NULL, "%s", message);
+}
+
 void
 win_println_indent(ProfWin* window, int pad, const char* const message, ...)
 {
@@ -1621,16 +1925,18 @@ win_print_outgoing_with_receipt(ProfWin* window, const char* show_char, const ch
 {
     GDateTime* time = g_date_time_new_now_local();
 
-    DeliveryReceipt* receipt = malloc(sizeof(struct delivery_receipt_t));
-    receipt->received = FALSE;
+    DeliveryReceipt receipt = { .received = FALSE };
 
     const char* myjid = connection_get_fulljid();
-    if (_win_correct(window, message, id, replace_id, myjid)) {
-        free(receipt); // TODO: probably we should use this in _win_correct()
-    } else {
-        int y_start_pos = getcury(window->layout->win);
-        _win_print_internal(window, show_char, 0, time, 0, THEME_TEXT_ME, from, message, receipt);
-        buffer_append(window->layout->buffer, show_char, 0, time, 0, THEME_TEXT_ME, from, myjid, message, receipt, id, y_start_pos, getcury(window->layout->win));
+    if (!_win_correct(window, message, id, replace_id, myjid)) {
+        int y_start_pos = -1;
+        int y_end_pos = -1;
+        if (!_win_defer(window)) {
+            y_start_pos = getcury(window->layout->win);
+            _win_print_internal(window, show_char, 0, time, 0, THEME_TEXT_ME, from, message, &receipt, NULL);
+            y_end_pos = getcury(window->layout->win);
+        }
+        buffer_append(window->layout->buffer, show_char, 0, time, 0, THEME_TEXT_ME, from, myjid, message, &receipt, id, y_start_pos, y_end_pos);
     }
 
     // TODO: cross-reference.. this should be replaced by a real event-based system
@@ -1656,9 +1962,8 @@ win_update_entry_message(ProfWin* window, const char* const id, const char* cons
         return;
     ProfBuffEntry* entry = buffer_get_entry_by_id(window->layout->buffer, id);
     if (entry) {
-        free(entry->message);
-        entry->message = strdup(message);
-        win_redraw(window);
+        buffer_set_entry_message(window->layout->buffer, entry, entry->show_char, message);
+        _win_redraw_entry(window, entry);
     }
 }
 
@@ -1689,9 +1994,14 @@ _win_printf(ProfWin* window, const char* show_char, int pad_indent, GDateTime* t
 
     auto_gchar gchar* msg = g_strdup_vprintf(message, arg);
 
-    int y_start_pos = getcury(window->layout->win);
-    _win_print_internal(window, show_char, pad_indent, timestamp, flags, theme_item, display_from, msg, NULL);
-    buffer_append(window->layout->buffer, show_char, pad_indent, timestamp, flags, theme_item, display_from, from_jid, msg, NULL, message_id, y_start_pos, getcury(window->layout->win));
+    int y_start_pos = -1;
+    int y_end_pos = -1;
+    if (!_win_defer(window)) {
+        y_start_pos = getcury(window->layout->win);
+        _win_print_internal(window, show_char, pad_indent, timestamp, flags, theme_item, display_from, msg, NULL, NULL);
+        y_end_pos = getcury(window->layout->win);
+    }
+    buffer_append(window->layout->buffer, show_char, pad_indent, timestamp, flags, theme_item, display_from, from_jid, msg, NULL, message_id, y_start_pos, y_end_pos);
 
     inp_nonblocking(TRUE);
     g_date_time_unref(timestamp);
@@ -1699,9 +2009,54 @@ _win_printf(ProfWin* window, const char* show_char, int pad_indent, GDateTime* t
     va_end(arg);
 }
 
+// the last timestamp formatted for a line, lines printed or redrawn one after
+// another mostly fall into the same second or minute and share it
+static struct
+{
+    gchar* format;
+    // length of the time span one text covers in seconds, 0 when not reused
+    gint64 unit;
+    gint64 key;
+    GTimeSpan utc_offset;
+    gchar* text;
+} time_stamp;
+
+static const char*
+_win_time_stamp(const gchar* const format, GDateTime* time)
+{
+    if (g_strcmp0(format, time_stamp.format) != 0) {
+        g_free(time_stamp.format);
+        time_stamp.format = g_strdup(format);
+        g_free(time_stamp.text);
+        time_stamp.text = NULL;
+
+        if (strstr(format, "%f")) {
+            time_stamp.unit = 0;
+        } else if (strstr(format, "%S") || strstr(format, "%s") || strstr(format, "%T") || strstr(format, "%r")
+                   || strstr(format, "%X") || strstr(format, "%c")) {
+            time_stamp.unit = 1;
+        } else {
+            time_stamp.unit = 60;
+        }
+    }
+
+    gint64 seconds = g_date_time_to_unix(time);
+    GTimeSpan utc_offset = g_date_time_get_utc_offset(time);
+    if (time_stamp.text && time_stamp.unit > 0 && seconds / time_stamp.unit == time_stamp.key && utc_offset == time_stamp.utc_offset) {
+        return time_stamp.text;
+    }
+
+    g_free(time_stamp.text);
+    time_stamp.text = g_date_time_format(time, format);
+    time_stamp.key = time_stamp.unit > 0 ? seconds / time_stamp.unit : 0;
+    time_stamp.utc_offset = utc_offset;
+
+    return time_stamp.text;
+}
+
 static void
 _win_print_internal(ProfWin* window, const char* show_char, int pad_indent, GDateTime* time,
-                    int flags, theme_item_t theme_item, const char* const from, const char* const message, DeliveryReceipt* receipt)
+                    int flags, theme_item_t theme_item, const char* const from, const char* const message, DeliveryReceipt* receipt, ProfWrap** wrap)
 {
     // flags : 1st bit =  0/1 - me/not me. define: NO_ME
     //         2nd bit =  0/1 - date/no date. define: NO_DATE
@@ -1714,33 +2069,31 @@ _win_print_internal(ProfWin* window, const char* show_char, int pad_indent, GDat
     int colour = theme_attrs(THEME_ME);
     size_t indent = 0;
 
-    auto_gchar gchar* time_pref = NULL;
+    const gchar* time_pref = NULL;
     switch (window->type) {
     case WIN_CHAT:
-        time_pref = prefs_get_string(PREF_TIME_CHAT);
+        time_pref = prefs_peek_string(PREF_TIME_CHAT);
         break;
     case WIN_MUC:
-        time_pref = prefs_get_string(PREF_TIME_MUC);
+        time_pref = prefs_peek_string(PREF_TIME_MUC);
         break;
     case WIN_CONFIG:
-        time_pref = prefs_get_string(PREF_TIME_CONFIG);
+        time_pref = prefs_peek_string(PREF_TIME_CONFIG);
         break;
     case WIN_PRIVATE:
-        time_pref = prefs_get_string(PREF_TIME_PRIVATE);
+        time_pref = prefs_peek_string(PREF_TIME_PRIVATE);
         break;
     case WIN_XML:
-        time_pref = prefs_get_string(PREF_TIME_XMLCONSOLE);
+        time_pref = prefs_peek_string(PREF_TIME_XMLCONSOLE);
         break;
     default:
-        time_pref = prefs_get_string(PREF_TIME_CONSOLE);
+        time_pref = prefs_peek_string(PREF_TIME_CONSOLE);
         break;
     }
 
-    auto_gchar gchar* date_fmt = NULL;
-    if (g_strcmp0(time_pref, "off") == 0 || time == NULL) {
-        date_fmt = g_strdup("");
-    } else {
-        date_fmt = g_date_time_format(time, time_pref);
+    const char* date_fmt = "";
+    if (g_strcmp0(time_pref, "off") != 0 && time != NULL) {
+        date_fmt = _win_time_stamp(time_pref, time);
     }
     assert(date_fmt != NULL);
 
@@ -1748,6 +2101,16 @@ _win_print_internal(ProfWin* window, const char* show_char, int pad_indent, GDat
         indent = 3 + strlen(date_fmt);
     }
 
+    // upper bound of the rows this entry can take once wrapped
+    int width = MAX(getmaxx(window->layout->win) - (int)indent - pad_indent, 1);
+    size_t text_len = strlen(message) + (from ? strlen(from) : 0) + indent + 2;
+    int newlines = 0;
+    for (const char* c = strchr(message, '\n'); c; c = strchr(c + 1, '\n')) {
+        newlines++;
+    }
+    _win_pad_reserve(window->layout->win, text_len / width + newlines + 2);
+    ui_mark_dirty_part(UI_DIRTY_WINDOW);
+
     if ((flags & NO_DATE) == 0) {
         if (date_fmt && strlen(date_fmt)) {
             if ((flags & NO_COLOUR_DATE) == 0) {
@@ -1766,7 +2129,7 @@ _win_print_internal(ProfWin* window, const char* show_char, int pad_indent, GDat
             colour = theme_attrs(THEME_THEM);
         }
 
-        auto_gchar gchar* color_pref = prefs_get_string(PREF_COLOR_NICK);
+        const gchar* color_pref = prefs_peek_string(PREF_COLOR_NICK);
         if (color_pref != NULL && (strcmp(color_pref, "false") != 0)) {
             if ((flags & NO_ME) || (!(flags & NO_ME) && prefs_get_boolean(PREF_COLOR_NICK_OWN))) {
                 colour = theme_hash_attrs(from);
@@ -1807,7 +2170,7 @@ _win_print_internal(ProfWin* window, const char* show_char, int pad_indent, GDat
     }
 
     if (prefs_get_boolean(PREF_WRAP)) {
-        _win_print_wrapped(window->layout->win, message + offset, indent, pad_indent);
+        _win_print_wrapped(window->layout->win, message + offset, indent, pad_indent, wrap);
     } else {
         wprintw(window->layout->win, "%s", message + offset);
     }
@@ -1838,118 +2201,47 @@ _win_indent(WINDOW* win, int size)
     }
 }
 
+// wrap is the entry's cached layout, reused while the pad width and prefix
+// stay the same, NULL for text that isn't kept in the buffer
 static void
-_win_print_wrapped(WINDOW* win, const char* const message, size_t indent, int pad_indent)
+_win_print_wrapped(WINDOW* win, const char* const message, size_t indent, int pad_indent, ProfWrap** wrap)
 {
-    int starty = getcury(win);
-    int wordi = 0;
-    auto_char char* word = malloc(strlen(message) + 1);
-
-    gchar* curr_ch = g_utf8_offset_to_pointer(message, 0);
-
-    while (*curr_ch != '\0') {
+    int startx = getcurx(win);
+    int width = getmaxx(win);
 
-        // handle space
-        if (*curr_ch == ' ') {
-            waddch(win, ' ');
-            curr_ch = g_utf8_next_char(curr_ch);
+    ProfWrap* layout = wrap ? *wrap : NULL;
+    if (!wrap_matches(layout, startx, width, indent, pad_indent)) {
+        wrap_free(layout);
+        layout = wrap_layout(message, startx, width, indent, pad_indent);
+        if (wrap) {
+            *wrap = layout;
+        }
+    }
 
-            // handle newline
-        } else if (*curr_ch == '\n') {
+    int line = 0;
+    for (int i = 0; i < layout->count; i++) {
+        ProfWrapSeg* seg = &layout->segs[i];
+        while (line < seg->line) {
             waddch(win, '\n');
-            _win_indent(win, indent + pad_indent);
-            curr_ch = g_utf8_next_char(curr_ch);
-
-            // handle word
-        } else {
-            wordi = 0;
-            int wordlen = 0;
-            while (*curr_ch != ' ' && *curr_ch != '\n' && *curr_ch != '\0') {
-                size_t ch_len = mbrlen(curr_ch, MB_CUR_MAX, NULL);
-                if ((ch_len == (size_t)-2) || (ch_len == (size_t)-1)) {
-                    curr_ch++;
-                    continue;
-                }
-                int offset = 0;
-                while (offset < ch_len) {
-                    word[wordi++] = curr_ch[offset++];
-                }
-                curr_ch = g_utf8_next_char(curr_ch);
-            }
-            word[wordi] = '\0';
-            wordlen = utf8_display_len(word);
-
-            int curx = getcurx(win);
-            int cury;
-            int maxx = getmaxx(win);
-
-            // wrap required
-            if (curx + wordlen > maxx) {
-                int linelen = maxx - (indent + pad_indent);
-
-                // word larger than line
-                if (wordlen > linelen) {
-                    gchar* word_ch = g_utf8_offset_to_pointer(word, 0);
-                    while (*word_ch != '\0') {
-                        curx = getcurx(win);
-                        cury = getcury(win);
-                        gboolean firstline = cury == starty;
-
-                        if (firstline && curx < indent) {
-                            _win_indent(win, indent);
-                        }
-                        if (!firstline && curx < (indent + pad_indent)) {
-                            _win_indent(win, indent + pad_indent);
-                        }
-
-                        gchar copy[wordi + 1];
-                        g_utf8_strncpy(copy, word_ch, 1);
-                        waddstr(win, copy);
-
-                        word_ch = g_utf8_next_char(word_ch);
-                    }
-
-                    // newline and print word
-                } else {
-                    waddch(win, '\n');
-                    curx = getcurx(win);
-                    cury = getcury(win);
-                    gboolean firstline = cury == starty;
-
-                    if (firstline && curx < indent) {
-                        _win_indent(win, indent);
-                    }
-                    if (!firstline && curx < (indent + pad_indent)) {
-                        _win_indent(win, indent + pad_indent);
-                    }
-                    waddstr(win, word);
-                }
-
-                // no wrap required
-            } else {
-                curx = getcurx(win);
-                cury = getcury(win);
-                gboolean firstline = cury == starty;
-
-                if (firstline && curx < indent) {
-                    _win_indent(win, indent);
-                }
-                if (!firstline && curx < (indent + pad_indent)) {
-                    _win_indent(win, indent + pad_indent);
-                }
-                waddstr(win, word);
-            }
+            line++;
         }
 
-        // consume first space of next line
         int curx = getcurx(win);
-        int cury = getcury(win);
-        gboolean firstline = (cury == starty);
-
-        if (!firstline && curx == 0 && *curr_ch == ' ') {
-            curr_ch = g_utf8_next_char(curr_ch);
+        if (curx < seg->col) {
+            _win_indent(win, seg->col - curx);
+        }
+        if (seg->len > 0) {
+            waddnstr(win, message + seg->start, seg->len);
+            // ncurses has already moved on if the segment ran up to the margin
+            if (getcurx(win) == 0) {
+                line++;
+            }
         }
     }
+
+    if (!wrap) {
+        wrap_free(layout);
+    }
 }
 
 void
@@ -1957,6 +2249,7 @@ win_print_trackbar(ProfWin* window)
 {
     int cols = getmaxx(window->layout->win);
 
+    _win_pad_reserve(window->layout->win, 2);
     wbkgdset(window->layout->win, theme_attrs(THEME_TRACKBAR));
     wattron(window->layout->win, theme_attrs(THEME_TRACKBAR));
 
@@ -1970,7 +2263,20 @@ win_print_trackbar(ProfWin* window)
 void
 win_redraw(ProfWin* window)
 {
+    if (_win_defer(window)) {
+        return;
+    }
+
+    _win_redraw(window);
+}
+
+static void
+_win_redraw(ProfWin* window)
+{
+    window->layout->deferred = FALSE;
+
     int size = buffer_size(window->layout->buffer);
+    wresize(window->layout->win, _win_pad_initial_rows(), getmaxx(window->layout->win));
     werase(window->layout->win);
 
     for (int i = 0; i < size; i++) {
@@ -1982,29 +2288,108 @@ win_redraw(ProfWin* window)
             win_print_trackbar(window);
         } else {
             // regular thing to print
-            _win_print_internal(window, e->show_char, e->pad_indent, e->time, e->flags, e->theme_item, e->display_from, e->message, e->receipt);
+            GDateTime* time = buffer_entry_time(e);
+            _win_print_internal(window, e->show_char, e->pad_indent, time, e->flags, e->theme_item, e->display_from, e->message, e->receipt, &e->_wrap);
+            if (time) {
+                g_date_time_unref(time);
+            }
         }
         e->y_end_pos = getcury(window->layout->win);
     }
 }
 
+// Lays out one changed entry again instead of the whole buffer. The entry's
+// rows are patched in place and the rows below only move when its wrapped
+// height changed. Positions that don't line up with the pad fall back to a
+// full redraw.
+static void
+_win_redraw_entry(ProfWin* window, ProfBuffEntry* entry)
+{
+    if (_win_defer(window)) {
+        return;
+    }
+
+    WINDOW* pad = window->layout->win;
+    ProfBuff buffer = window->layout->buffer;
+    int size = buffer_size(buffer);
+
+    // entries from here to the end must tile the pad up to the cursor
+    int index = -1;
+    int next_start = getcury(pad);
+    for (int i = size - 1; i >= 0; i--) {
+        ProfBuffEntry* e = buffer_get_entry(buffer, i);
+        if (e->y_start_pos < 0 || e->y_end_pos != next_start) {
+            break;
+        }
+        if (e == entry) {
+            index = i;
+            break;
+        }
+        next_start = e->y_start_pos;
+    }
+
+    gboolean trackbar = entry->display_from == NULL && entry->message && entry->message[0] == '-';
+    if (index < 0 || trackbar || (entry->flags & NO_EOL)) {
+        _win_redraw(window);
+        return;
+    }
+
+    int cols = getmaxx(pad);
+    WINDOW* scratch = newpad(1, cols);
+    window->layout->win = scratch;
+    GDateTime* time = buffer_entry_time(entry);
+    _win_print_internal(window, entry->show_char, entry->pad_indent, time, entry->flags, entry->theme_item, entry->display_from, entry->message, entry->receipt, &entry->_wrap);
+    if (time) {
+        g_date_time_unref(time);
+    }
+    window->layout->win = pad;
+
+    int old_rows = entry->y_end_pos - entry->y_start_pos;
+    int new_rows = getcury(scratch);
+    int delta = new_rows - old_rows;
+    int cury = getcury(pad);
+    int curx = getcurx(pad);
+
+    if (delta > 0) {
+        _win_pad_reserve(pad, delta);
+        if (cury + delta >= getmaxy(pad)) {
+            delwin(scratch);
+            _win_redraw(window);
+            return;
+        }
+    }
+
+    if (delta != 0) {
+        wmove(pad, entry->y_start_pos + MIN(old_rows, new_rows), 0);
+        winsdelln(pad, delta);
+        entry->y_end_pos += delta;
+        for (int i = index + 1; i < size; i++) {
+            ProfBuffEntry* e = buffer_get_entry(buffer, i);
+            e->y_start_pos += delta;
+            e->y_end_pos += delta;
+        }
+    }
+
+    if (new_rows > 0) {
+        copywin(scratch, pad, 0, 0, entry->y_start_pos, 0, entry->y_start_pos + new_rows - 1, cols - 1, FALSE);
+    }
+    delwin(scratch);
+    wmove(pad, cury + delta, curx);
+}
+
 void
 win_print_loading_history(ProfWin* window)
 {
-    GDateTime* timestamp;
-    gboolean is_buffer_empty = buffer_size(window->layout->buffer) == 0;
-
-    if (!is_buffer_empty) {
-        timestamp = buffer_get_entry(window->layout->buffer, 0)->time;
-    } else {
+    ProfBuffEntry* first = buffer_get_entry(window->layout->buffer, 0);
+    GDateTime* timestamp = first ? buffer_entry_time(first) : NULL;
+    if (!timestamp) {
         timestamp = g_date_time_new_now_local();
     }
 
     int cur_y = getcury(window->layout->win);
     buffer_prepend(window->layout->buffer, "-", 0, timestamp, NO_DATE, THEME_ROOMINFO, NULL, NULL, LOADING_MESSAGE, NULL, NULL, cur_y, cur_y + 1);
 
-    if (is_buffer_empty)
-        g_date_time_unref(timestamp);
+    g_date_time_unref(timestamp);
 
     win_redraw(window);
 }
@@ -2100,30 +2485,181 @@ win_toggle_attention(ProfWin* window)
         ProfChatWin* chatwin = (ProfChatWin*)window;
         assert(chatwin->memcheck == PROFCHATWIN_MEMCHECK);
         chatwin->has_attention = !chatwin->has_attention;
+        wins_attention_changed(window);
         return chatwin->has_attention;
     } else if (window->type == WIN_MUC) {
         ProfMucWin* mucwin = (ProfMucWin*)window;
         assert(mucwin->memcheck == PROFMUCWIN_MEMCHECK);
         mucwin->has_attention = !mucwin->has_attention;
+        wins_attention_changed(window);
         return mucwin->has_attention;
     }
     return FALSE;
 }
 
+// While a subwin is clipped only the rows from first up to last go into its
+// pad, everything around them is laid out on the cursor kept here without
+// writing anything, so the cost of a draw follows the screen height rather
+// than how much content there is.
+static struct
+{
+    WINDOW* win;
+    int first;
+    int last;
+    int y;
+    int x;
+} sub_clip;
+
 void
-win_sub_print(WINDOW* win, char* msg, gboolean newline, gboolean wrap, int indent)
+win_sub_clip_begin(ProfLayoutSplit* layout)
 {
-    int maxx = getmaxx(win);
-    int curx = getcurx(win);
-    int cury = getcury(win);
+    int rows = _win_pad_initial_rows();
+    int cols = getmaxx(layout->subwin);
+
+    sub_clip.win = layout->subwin;
+    sub_clip.first = MAX(layout->sub_y_pos, 0);
+    sub_clip.last = sub_clip.first + rows;
+    sub_clip.y = 0;
+    sub_clip.x = 0;
 
+    if (getmaxy(layout->subwin) != rows) {
+        wresize(layout->subwin, rows, cols);
+    }
+    werase(layout->subwin);
+    wmove(layout->subwin, 0, 0);
+    layout->sub_offset = sub_clip.first;
+}
+
+void
+win_sub_clip_end(ProfLayoutSplit* layout)
+{
+    layout->sub_rows = sub_clip.y + (sub_clip.x > 0 ? 1 : 0);
+    sub_clip.win = NULL;
+}
+
+// where the cursor of win_sub_print() ends up, without writing anything
+static void
+_win_sub_advance(const char* const msg, gboolean wrap, int indent, int maxx, int* y, int* x)
+{
     if (wrap) {
-        _win_print_wrapped(win, msg, 1, indent);
+        ProfWrap* layout = wrap_layout(msg, *x, maxx, 1, indent);
+        int line = 0;
+        for (int i = 0; i < layout->count; i++) {
+            ProfWrapSeg* seg = &layout->segs[i];
+            while (line < seg->line) {
+                (*y)++;
+                *x = 0;
+                line++;
+            }
+            if (*x < seg->col) {
+                *x = seg->col;
+            }
+            if (seg->len > 0) {
+                *x += seg->width;
+                if (*x >= maxx) {
+                    (*y)++;
+                    *x = 0;
+                    line++;
+                }
+            }
+        }
+        wrap_free(layout);
+        return;
+    }
+
+    // waddnstr() is limited to the bytes that could fit on the line
+    int limit = maxx - *x;
+    int bytes = 0;
+    const char* curr = msg;
+    while (*curr && bytes < limit) {
+        int len = g_utf8_skip[*(const guchar*)curr];
+        if (bytes + len > limit) {
+            break;
+        }
+        if (*curr == '\n') {
+            (*y)++;
+            *x = 0;
+        } else {
+            gunichar ch = g_utf8_get_char_validated(curr, len);
+            *x += (ch != (gunichar)-1 && ch != (gunichar)-2 && g_unichar_iswide(ch)) ? 2 : 1;
+            if (*x >= maxx) {
+                (*y)++;
+                *x = 0;
+            }
+        }
+        bytes += len;
+        curr += len;
+    }
+}
+
+static void
+_win_sub_write(WINDOW* win, char* msg, gboolean wrap, int indent)
+{
+    if (wrap) {
+        _win_pad_reserve(win, strlen(msg) / MAX(getmaxx(win) - indent - 1, 1) + 2);
+        _win_print_wrapped(win, msg, 1, indent, NULL);
     } else {
-        waddnstr(win, msg, maxx - curx);
+        waddnstr(win, msg, getmaxx(win) - getcurx(win));
     }
+}
+
+// text that starts above the clipped rows and runs into them is written to
+// a scratch pad, only the rows that belong in the pad are copied over
+static void
+_win_sub_clip_write(WINDOW* win, char* msg, gboolean wrap, int indent, int end_y)
+{
+    int maxx = getmaxx(win);
+    int rows = end_y - sub_clip.y + 2;
+    WINDOW* scratch = newpad(rows, maxx);
+    wbkgdset(scratch, getbkgd(win));
+    wattrset(scratch, getattrs(win));
+    wmove(scratch, 0, sub_clip.x);
+    _win_sub_write(scratch, msg, wrap, indent);
+
+    int from = MAX(sub_clip.y, sub_clip.first);
+    int to = MIN(end_y, sub_clip.last - 1);
+    for (int row = from; row <= to; row++) {
+        int col = row == sub_clip.y ? sub_clip.x : 0;
+        if (col < maxx) {
+            copywin(scratch, win, row - sub_clip.y, col, row - sub_clip.first, col, row - sub_clip.first, maxx - 1, FALSE);
+        }
+    }
+    delwin(scratch);
+}
+
+void
+win_sub_print(WINDOW* win, char* msg, gboolean newline, gboolean wrap, int indent)
+{
+    if (sub_clip.win && sub_clip.win == win) {
+        int start_y = sub_clip.y;
+        int y = sub_clip.y;
+        int x = sub_clip.x;
+        _win_sub_advance(msg, wrap, indent, getmaxx(win), &y, &x);
+
+        if (sub_clip.y >= sub_clip.first && y < sub_clip.last) {
+            wmove(win, sub_clip.y - sub_clip.first, sub_clip.x);
+            _win_sub_write(win, msg, wrap, indent);
+            y = getcury(win) + sub_clip.first;
+            x = getcurx(win);
+        } else if (y >= sub_clip.first && sub_clip.y < sub_clip.last) {
+            _win_sub_clip_write(win, msg, wrap, indent, y);
+        }
+
+        sub_clip.y = y;
+        sub_clip.x = x;
+        if (newline) {
+            sub_clip.y = start_y + 1;
+            sub_clip.x = 0;
+        }
+        return;
+    }
+
+    int cury = getcury(win);
+
+    _win_sub_write(win, msg, wrap, indent);
 
     if (newline) {
+        _win_pad_reserve(win, 1);
         wmove(win, cury + 1, 0);
     }
 }
@@ -2136,9 +2672,19 @@ win_sub_newline_lazy(WINDOW* win)
     if (win == NULL) {
         return;
     }
+
+    if (sub_clip.win && sub_clip.win == win) {
+        if (sub_clip.x > 0) {
+            sub_clip.y++;
+            sub_clip.x = 0;
+        }
+        return;
+    }
+
     curx = getcurx(win);
     if (curx > 0) {
         int cury = getcury(win);
+        _win_pad_reserve(win, 1);
         wmove(win, cury + 1, 0);
     }
 }
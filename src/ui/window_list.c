@@ -43,12 +43,14 @@
 #include <glib.h>
 
 #include "common.h"
+#include "database.h"
 #include "config/preferences.h"
 #include "config/theme.h"
 #include "plugins/plugins.h"
 #include "ui/ui.h"
 #include "ui/window_list.h"
 #include "xmpp/xmpp.h"
+#include "xmpp/message.h"
 #include "xmpp/roster_list.h"
 #include "tools/http_upload.h"
 
@@ -61,13 +63,67 @@ static int current;
 static Autocomplete wins_ac;
 static Autocomplete wins_close_ac;
 
+// windows by barejid, roomjid, fulljid or plugin tag, one table per window type
+static GHashTable* chat_index;
+static GHashTable* muc_index;
+static GHashTable* conf_index;
+static GHashTable* private_index;
+static GHashTable* plugin_index;
+// looked up for every stanza, so not found by walking all windows
+static ProfXMLWin* xmlconsole = NULL;
+// windows with unread messages (window -> unread count) and windows flagged for
+// attention, kept up to date by the writers so readers need not walk every window
+static GHashTable* unread_wins = NULL;
+static GHashTable* attention_wins = NULL;
+static int total_unread = 0;
+
+// URLs and quotes offered for completion per window, for people who run
+// profanity a long time we don't want to waste a lot of memory
+#define WINS_RECENT_MAX 20
+// compiled on first use and shared by all windows
+static GRegex* url_regex = NULL;
+
+// Scrollback of recently closed chat windows, so reopening one shows it again
+// without going to the database or the server. Least recently closed are
+// dropped first once they use more than this.
+#define CLOSED_CHATS_MAX_BYTES (8 * 1024 * 1024)
+
+typedef struct closed_chat_t
+{
+    char* account;
+    char* barejid;
+    ProfLayout* layout;
+    struct prof_history_cursor_t* history_cursor;
+    GDateTime* history_view_end;
+    GDateTime* last_logged; // newest logged message when closed, NULL if none
+    gsize bytes;
+} ClosedChat;
+
+// most recently closed first
+static GQueue* closed_chats = NULL;
+static gsize closed_chats_bytes = 0;
+
 static int _wins_cmp_num(gconstpointer a, gconstpointer b);
 static int _wins_get_next_available_num(GList* used);
+static void _wins_index_add(ProfWin* window);
+static void _wins_index_remove(ProfWin* window);
+static void _wins_unread_forget(ProfWin* window);
+static ProfWin* _wins_first_in(GHashTable* set, int after);
+static void _wins_closed_chat_keep(ProfChatWin* chatwin);
+static void _wins_closed_chat_free(ClosedChat* closed);
 
 void
 wins_init(void)
 {
     windows = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)win_free);
+    chat_index = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    muc_index = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    conf_index = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    private_index = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    plugin_index = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    unread_wins = g_hash_table_new(g_direct_hash, g_direct_equal);
+    attention_wins = g_hash_table_new(g_direct_hash, g_direct_equal);
+    total_unread = 0;
 
     ProfWin* console = win_create_console();
     g_hash_table_insert(windows, GINT_TO_POINTER(1), console);
@@ -98,23 +154,11 @@ wins_chat_exists(const char* const barejid)
 ProfChatWin*
 wins_get_chat(const char* const barejid)
 {
-    GList* values = g_hash_table_get_values(windows);
-    GList* curr = values;
-
-    while (curr) {
-        ProfWin* window = curr->data;
-        if (window->type == WIN_CHAT) {
-            ProfChatWin* chatwin = (ProfChatWin*)window;
-            if (g_strcmp0(chatwin->barejid, barejid) == 0) {
-                g_list_free(values);
-                return chatwin;
-            }
-        }
-        curr = g_list_next(curr);
+    if (barejid == NULL) {
+        return NULL;
     }
 
-    g_list_free(values);
-    return NULL;
+    return g_hash_table_lookup(chat_index, barejid);
 }
 
 static gint
@@ -149,89 +193,41 @@ wins_get_chat_unsubscribed(void)
 ProfConfWin*
 wins_get_conf(const char* const roomjid)
 {
-    GList* values = g_hash_table_get_values(windows);
-    GList* curr = values;
-
-    while (curr) {
-        ProfWin* window = curr->data;
-        if (window->type == WIN_CONFIG) {
-            ProfConfWin* confwin = (ProfConfWin*)window;
-            if (g_strcmp0(confwin->roomjid, roomjid) == 0) {
-                g_list_free(values);
-                return confwin;
-            }
-        }
-        curr = g_list_next(curr);
+    if (roomjid == NULL) {
+        return NULL;
     }
 
-    g_list_free(values);
-    return NULL;
+    return g_hash_table_lookup(conf_index, roomjid);
 }
 
 ProfMucWin*
 wins_get_muc(const char* const roomjid)
 {
-    GList* values = g_hash_table_get_values(windows);
-    GList* curr = values;
-
-    while (curr) {
-        ProfWin* window = curr->data;
-        if (window->type == WIN_MUC) {
-            ProfMucWin* mucwin = (ProfMucWin*)window;
-            if (g_strcmp0(mucwin->roomjid, roomjid) == 0) {
-                g_list_free(values);
-                return mucwin;
-            }
-        }
-        curr = g_list_next(curr);
+    if (roomjid == NULL) {
+        return NULL;
     }
 
-    g_list_free(values);
-    return NULL;
+    return g_hash_table_lookup(muc_index, roomjid);
 }
 
 ProfPrivateWin*
 wins_get_private(const char* const fulljid)
 {
-    GList* values = g_hash_table_get_values(windows);
-    GList* curr = values;
-
-    while (curr) {
-        ProfWin* window = curr->data;
-        if (window->type == WIN_PRIVATE) {
-            ProfPrivateWin* privatewin = (ProfPrivateWin*)window;
-            if (g_strcmp0(privatewin->fulljid, fulljid) == 0) {
-                g_list_free(values);
-                return privatewin;
-            }
-        }
-        curr = g_list_next(curr);
+    if (fulljid == NULL) {
+        return NULL;
     }
 
-    g_list_free(values);
-    return NULL;
+    return g_hash_table_lookup(private_index, fulljid);
 }
 
 ProfPluginWin*
 wins_get_plugin(const char* const tag)
 {
-    GList* values = g_hash_table_get_values(windows);
-    GList* curr = values;
-
-    while (curr) {
-        ProfWin* window = curr->data;
-        if (window->type == WIN_PLUGIN) {
-            ProfPluginWin* pluginwin = (ProfPluginWin*)window;
-            if (g_strcmp0(pluginwin->tag, tag) == 0) {
-                g_list_free(values);
-                return pluginwin;
-            }
-        }
-        curr = g_list_next(curr);
+    if (tag == NULL) {
+        return NULL;
     }
 
-    g_list_free(values);
-    return NULL;
+    return g_hash_table_lookup(plugin_index, tag);
 }
 
 void
@@ -280,10 +276,12 @@ wins_private_nick_change(const char* const roomjid, const char* const oldnick, c
 
     ProfPrivateWin* privwin = wins_get_private(oldjid->fulljid);
     if (privwin) {
+        _wins_index_remove((ProfWin*)privwin);
         free(privwin->fulljid);
 
         auto_jid Jid* newjid = jid_create_from_bare_and_resource(roomjid, newnick);
         privwin->fulljid = strdup(newjid->fulljid);
+        _wins_index_add((ProfWin*)privwin);
         win_println((ProfWin*)privwin, THEME_THEM, "!", "** %s is now known as %s.", oldjid->resourcepart, newjid->resourcepart);
 
         autocomplete_remove(wins_ac, oldjid->fulljid);
@@ -335,16 +333,25 @@ wins_get_nums(void)
     return g_hash_table_get_keys(windows);
 }
 
+// in the order the windows are listed, 10 (stored as 0) after 9
+GList*
+wins_get_nums_sorted(void)
+{
+    return g_list_sort(g_hash_table_get_keys(windows), _wins_cmp_num);
+}
+
 void
 wins_set_current_by_num(int i)
 {
     ProfWin* window = g_hash_table_lookup(windows, GINT_TO_POINTER(i));
     if (window) {
         current = i;
+        win_resize_if_stale(window);
         if (window->type == WIN_CHAT) {
             ProfChatWin* chatwin = (ProfChatWin*)window;
             assert(chatwin->memcheck == PROFCHATWIN_MEMCHECK);
             chatwin->unread = 0;
+            chatwin_history_load(chatwin);
             plugins_on_chat_win_focus(chatwin->barejid);
         } else if (window->type == WIN_MUC) {
             ProfMucWin* mucwin = (ProfMucWin*)window;
@@ -357,6 +364,7 @@ wins_set_current_by_num(int i)
             ProfPrivateWin* privatewin = (ProfPrivateWin*)window;
             privatewin->unread = 0;
         }
+        wins_unread_changed(window);
 
         // if we switched to console
         if (current == 0) {
@@ -523,11 +531,15 @@ wins_close_by_num(int i)
         if (i == current) {
             current = 1;
             ProfWin* window = wins_get_current();
+            win_resize_if_stale(window);
             win_update_virtual(window);
         }
 
         ProfWin* window = wins_get_by_num(i);
         if (window) {
+            _wins_index_remove(window);
+            _wins_unread_forget(window);
+
             // cancel upload processes of this window
             http_upload_cancel_processes(window);
 
@@ -535,6 +547,7 @@ wins_close_by_num(int i)
             case WIN_CHAT:
             {
                 ProfChatWin* chatwin = (ProfChatWin*)window;
+                _wins_closed_chat_keep(chatwin);
                 autocomplete_remove(wins_ac, chatwin->barejid);
                 autocomplete_remove(wins_close_ac, chatwin->barejid);
 
@@ -577,6 +590,7 @@ wins_close_by_num(int i)
             }
             case WIN_XML:
             {
+                xmlconsole = NULL;
                 autocomplete_remove(wins_ac, "xmlconsole");
                 autocomplete_remove(wins_close_ac, "xmlconsole");
                 break;
@@ -620,11 +634,60 @@ wins_new_xmlconsole(void)
     g_list_free(keys);
     ProfWin* newwin = win_create_xmlconsole();
     g_hash_table_insert(windows, GINT_TO_POINTER(result), newwin);
+    xmlconsole = (ProfXMLWin*)newwin;
     autocomplete_add(wins_ac, "xmlconsole");
     autocomplete_add(wins_close_ac, "xmlconsole");
     return newwin;
 }
 
+gboolean
+wins_reopen_closed_chat(ProfChatWin* chatwin)
+{
+    if (connection_get_status() != JABBER_CONNECTED) {
+        return FALSE;
+    }
+
+    ClosedChat* closed = _wins_closed_chat_take(connection_get_barejid(), chatwin->barejid);
+    if (!closed) {
+        return FALSE;
+    }
+
+    // something was logged since, e.g. by a MAM catch-up, so build it again
+    GDateTime* last_logged = _wins_closed_chat_last_logged(chatwin->barejid);
+    gboolean unchanged = (last_logged == NULL && closed->last_logged == NULL)
+                         || (last_logged && closed->last_logged && g_date_time_equal(last_logged, closed->last_logged));
+    if (last_logged) {
+        g_date_time_unref(last_logged);
+    }
+
+    ProfWin* window = &chatwin->window;
+    int entries;
+    gsize bytes;
+    win_buffer_stats(window, &entries, &bytes);
+    if (!unchanged || entries > 0) {
+        _wins_closed_chat_free(closed);
+        return FALSE;
+    }
+
+    win_layout_free(window->layout);
+    window->layout = closed->layout;
+    closed->layout = NULL;
+
+    log_database_history_cursor_free(chatwin->history_cursor);
+    chatwin->history_cursor = closed->history_cursor;
+    closed->history_cursor = NULL;
+    if (chatwin->history_view_end) {
+        g_date_time_unref(chatwin->history_view_end);
+    }
+    chatwin->history_view_end = closed->history_view_end;
+    closed->history_view_end = NULL;
+    chatwin->history_shown = TRUE;
+
+    _wins_closed_chat_free(closed);
+
+    return TRUE;
+}
+
 ProfWin*
 wins_new_chat(const char* const barejid)
 {
@@ -633,6 +696,7 @@ wins_new_chat(const char* const barejid)
     g_list_free(keys);
     ProfWin* newwin = win_create_chat(barejid);
     g_hash_table_insert(windows, GINT_TO_POINTER(result), newwin);
+    _wins_index_add(newwin);
 
     autocomplete_add(wins_ac, barejid);
     autocomplete_add(wins_close_ac, barejid);
@@ -658,6 +722,7 @@ wins_new_muc(const char* const roomjid)
     g_list_free(keys);
     ProfWin* newwin = win_create_muc(roomjid);
     g_hash_table_insert(windows, GINT_TO_POINTER(result), newwin);
+    _wins_index_add(newwin);
     autocomplete_add(wins_ac, roomjid);
     autocomplete_add(wins_close_ac, roomjid);
     newwin->urls_ac = autocomplete_new();
@@ -674,6 +739,7 @@ wins_new_config(const char* const roomjid, DataForm* form, ProfConfWinCallback s
     g_list_free(keys);
     ProfWin* newwin = win_create_config(roomjid, form, submit, cancel, userdata);
     g_hash_table_insert(windows, GINT_TO_POINTER(result), newwin);
+    _wins_index_add(newwin);
 
     return newwin;
 }
@@ -686,6 +752,7 @@ wins_new_private(const char* const fulljid)
     g_list_free(keys);
     ProfWin* newwin = win_create_private(fulljid);
     g_hash_table_insert(windows, GINT_TO_POINTER(result), newwin);
+    _wins_index_add(newwin);
     autocomplete_add(wins_ac, fulljid);
     autocomplete_add(wins_close_ac, fulljid);
     newwin->urls_ac = autocomplete_new();
@@ -702,6 +769,7 @@ wins_new_plugin(const char* const plugin_name, const char* const tag)
     g_list_free(keys);
     ProfWin* newwin = win_create_plugin(plugin_name, tag);
     g_hash_table_insert(windows, GINT_TO_POINTER(result), newwin);
+    _wins_index_add(newwin);
     autocomplete_add(wins_ac, tag);
     autocomplete_add(wins_close_ac, tag);
     return newwin;
@@ -722,45 +790,102 @@ wins_new_vcard(vCard* vcard)
 gboolean
 wins_do_notify_remind(void)
 {
-    GList* values = g_hash_table_get_values(windows);
-    GList* curr = values;
+    if (unread_wins == NULL) {
+        return FALSE;
+    }
 
-    while (curr) {
-        ProfWin* window = curr->data;
-        if (win_notify_remind(window)) {
-            g_list_free(values);
+    // only windows with unread messages can remind
+    GHashTableIter iter;
+    gpointer key;
+    g_hash_table_iter_init(&iter, unread_wins);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        if (win_notify_remind(key)) {
             return TRUE;
         }
-        curr = g_list_next(curr);
     }
-    g_list_free(values);
     return FALSE;
 }
 
 int
 wins_get_total_unread(void)
 {
-    int result = 0;
+    return total_unread;
+}
+
+void
+wins_unread_changed(ProfWin* window)
+{
+    if (unread_wins == NULL) {
+        return;
+    }
+
+    int old_unread = GPOINTER_TO_INT(g_hash_table_lookup(unread_wins, window));
+    int unread = win_unread(window);
+    total_unread += unread - old_unread;
+
+    if (unread > 0) {
+        g_hash_table_insert(unread_wins, window, GINT_TO_POINTER(unread));
+    } else {
+        g_hash_table_remove(unread_wins, window);
+    }
+}
+
+void
+wins_attention_changed(ProfWin* window)
+{
+    if (attention_wins == NULL) {
+        return;
+    }
+
+    if (win_has_attention(window)) {
+        g_hash_table_add(attention_wins, window);
+    } else {
+        g_hash_table_remove(attention_wins, window);
+    }
+}
+
+static void
+_wins_unread_forget(ProfWin* window)
+{
+    if (unread_wins == NULL) {
+        return;
+    }
+
+    total_unread -= GPOINTER_TO_INT(g_hash_table_lookup(unread_wins, window));
+    g_hash_table_remove(unread_wins, window);
+    g_hash_table_remove(attention_wins, window);
+}
+
+void
+wins_resize_all(void)
+{
+    ProfWin* current_win = wins_get_current();
+
+    // only the current window is re-wrapped now, the others when next shown
     GList* values = g_hash_table_get_values(windows);
     GList* curr = values;
-
     while (curr) {
         ProfWin* window = curr->data;
-        result += win_unread(window);
+        if (window == current_win) {
+            win_resize(window);
+        } else {
+            win_resize_lazy(window);
+        }
         curr = g_list_next(curr);
     }
     g_list_free(values);
-    return result;
+
+    win_update_virtual(current_win);
 }
 
 void
-wins_resize_all(void)
+wins_apply_scrollback(void)
 {
     GList* values = g_hash_table_get_values(windows);
     GList* curr = values;
     while (curr) {
         ProfWin* window = curr->data;
-        win_resize(window);
+        win_apply_scrollback(window);
         curr = g_list_next(curr);
     }
     g_list_free(values);
@@ -795,22 +920,10 @@ wins_show_subwin(ProfWin* window)
 ProfXMLWin*
 wins_get_xmlconsole(void)
 {
-    GList* values = g_hash_table_get_values(windows);
-    GList* curr = values;
-
-    while (curr) {
-        ProfWin* window = curr->data;
-        if (window->type == WIN_XML) {
-            ProfXMLWin* xmlwin = (ProfXMLWin*)window;
-            assert(xmlwin->memcheck == PROFXMLWIN_MEMCHECK);
-            g_list_free(values);
-            return xmlwin;
-        }
-        curr = g_list_next(curr);
+    if (xmlconsole) {
+        assert(xmlconsole->memcheck == PROFXMLWIN_MEMCHECK);
     }
-
-    g_list_free(values);
-    return NULL;
+    return xmlconsole;
 }
 
 ProfVcardWin*
@@ -981,6 +1094,64 @@ wins_swap(int source_win, int target_win)
     }
 }
 
+static GHashTable*
+_wins_index_for(ProfWin* window, const char** key)
+{
+    switch (window->type) {
+    case WIN_CHAT:
+        *key = ((ProfChatWin*)window)->barejid;
+        return chat_index;
+    case WIN_MUC:
+        *key = ((ProfMucWin*)window)->roomjid;
+        return muc_index;
+    case WIN_CONFIG:
+        *key = ((ProfConfWin*)window)->roomjid;
+        return conf_index;
+    case WIN_PRIVATE:
+        *key = ((ProfPrivateWin*)window)->fulljid;
+        return private_index;
+    case WIN_PLUGIN:
+        *key = ((ProfPluginWin*)window)->tag;
+        return plugin_index;
+    default:
+        *key = NULL;
+        return NULL;
+    }
+}
+
+static void
+_wins_index_add(ProfWin* window)
+{
+    const char* key = NULL;
+    GHashTable* index = _wins_index_for(window, &key);
+    if (index && key) {
+        g_hash_table_insert(index, g_strdup(key), window);
+    }
+}
+
+static void
+_wins_index_remove(ProfWin* window)
+{
+    const char* key = NULL;
+    GHashTable* index = _wins_index_for(window, &key);
+    // only drop the entry if it still refers to this window
+    if (index && key && g_hash_table_lookup(index, key) == window) {
+        g_hash_table_remove(index, key);
+
+        // fall back to another window for the same jid, if any
+        GHashTableIter iter;
+        gpointer value;
+        g_hash_table_iter_init(&iter, windows);
+        while (g_hash_table_iter_next(&iter, NULL, &value)) {
+            const char* other_key = NULL;
+            if (value != window && _wins_index_for(value, &other_key) == index && g_strcmp0(other_key, key) == 0) {
+                g_hash_table_insert(index, g_strdup(key), value);
+                break;
+            }
+        }
+    }
+}
+
 static int
 _wins_cmp_num(gconstpointer a, gconstpointer b)
 {
@@ -1225,94 +1396,195 @@ win_close_reset_search_attempts(void)
 void
 wins_destroy(void)
 {
+    xmlconsole = NULL;
     g_hash_table_destroy(windows);
+    g_hash_table_destroy(chat_index);
+    g_hash_table_destroy(muc_index);
+    g_hash_table_destroy(conf_index);
+    g_hash_table_destroy(private_index);
+    g_hash_table_destroy(plugin_index);
+    g_hash_table_destroy(unread_wins);
+    unread_wins = NULL;
+    g_hash_table_destroy(attention_wins);
+    attention_wins = NULL;
+    total_unread = 0;
     autocomplete_free(wins_ac);
     autocomplete_free(wins_close_ac);
+    if (closed_chats) {
+        g_queue_free_full(closed_chats, (GDestroyNotify)_wins_closed_chat_free);
+        closed_chats = NULL;
+        closed_chats_bytes = 0;
+    }
+    if (url_regex) {
+        g_regex_unref(url_regex);
+        url_regex = NULL;
+    }
 }
 
 ProfWin*
 wins_get_next_unread(void)
 {
-    // get and sort win nums
-    GList* values = g_hash_table_get_keys(windows);
-    values = g_list_sort(values, _wins_cmp_num);
-    GList* curr = values;
+    return _wins_first_in(unread_wins, -1);
+}
 
-    while (curr) {
-        int curr_win_num = GPOINTER_TO_INT(curr->data);
-        ProfWin* window = wins_get_by_num(curr_win_num);
+ProfWin*
+wins_get_next_attention(void)
+{
+    // next flagged window after the current one, wrapping around
+    ProfWin* window = _wins_first_in(attention_wins, current);
+    if (window == NULL) {
+        window = _wins_first_in(attention_wins, -1);
+    }
+    if (window == wins_get_current()) {
+        return NULL;
+    }
+    return window;
+}
 
-        // test if window has unread messages
-        if (win_unread(window) > 0) {
-            g_list_free(values);
-            return window;
-        }
+// lowest numbered window in set, or the lowest numbered after window num after
+// when it is not -1, window numbers change on swap and tidy so they are looked
+// up when asked rather than kept in order
+static ProfWin*
+_wins_first_in(GHashTable* set, int after)
+{
+    if (set == NULL || g_hash_table_size(set) == 0) {
+        return NULL;
+    }
 
-        curr = g_list_next(curr);
+    ProfWin* result = NULL;
+    int result_num = -1;
+
+    GHashTableIter iter;
+    gpointer key;
+    gpointer value;
+    g_hash_table_iter_init(&iter, windows);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        if (!g_hash_table_contains(set, value)) {
+            continue;
+        }
+        if (after != -1 && _wins_cmp_num(key, GINT_TO_POINTER(after)) <= 0) {
+            continue;
+        }
+        if (result == NULL || _wins_cmp_num(key, GINT_TO_POINTER(result_num)) < 0) {
+            result = value;
+            result_num = GPOINTER_TO_INT(key);
+        }
     }
 
-    g_list_free(values);
-    return NULL;
+    return result;
 }
 
-ProfWin*
-wins_get_next_attention(void)
+// newest logged message with the contact, to tell whether a kept scrollback
+// still shows everything the database has
+static GDateTime*
+_wins_closed_chat_last_logged(const char* const barejid)
 {
-    // get and sort win nums
-    GList* values = g_hash_table_get_values(windows);
-    values = g_list_sort(values, _wins_cmp_num);
-    GList* curr = values;
+    ProfMessage* last = log_database_get_limits_info(barejid, TRUE);
+    if (!last) {
+        return NULL;
+    }
 
-    ProfWin* current_window = wins_get_by_num(current);
+    GDateTime* timestamp = last->timestamp ? g_date_time_ref(last->timestamp) : NULL;
+    message_free(last);
 
-    // search the current window
-    while (curr) {
-        ProfWin* window = curr->data;
-        if (current_window == window) {
-            current_window = window;
-            curr = g_list_next(curr);
-            break;
-        }
-        curr = g_list_next(curr);
+    return timestamp;
+}
+
+static void
+_wins_closed_chat_free(ClosedChat* closed)
+{
+    free(closed->account);
+    free(closed->barejid);
+    win_layout_free(closed->layout);
+    log_database_history_cursor_free(closed->history_cursor);
+    if (closed->history_view_end) {
+        g_date_time_unref(closed->history_view_end);
     }
+    if (closed->last_logged) {
+        g_date_time_unref(closed->last_logged);
+    }
+    free(closed);
+}
 
-    // Start from current window
-    while (current_window && curr) {
-        ProfWin* window = curr->data;
-        if (win_has_attention(window)) {
-            g_list_free(values);
-            return window;
-        }
-        curr = g_list_next(curr);
+static ClosedChat*
+_wins_closed_chat_take(const char* const account, const char* const barejid)
+{
+    if (!closed_chats) {
+        return NULL;
     }
-    // Start from begin
-    curr = values;
-    while (current_window && curr) {
-        ProfWin* window = curr->data;
-        if (current_window == window) {
-            // we are at current again
-            break;
-        }
-        if (win_has_attention(window)) {
-            g_list_free(values);
-            return window;
+
+    for (GList* curr = closed_chats->head; curr; curr = g_list_next(curr)) {
+        ClosedChat* closed = curr->data;
+        if (g_strcmp0(closed->barejid, barejid) == 0 && g_strcmp0(closed->account, account) == 0) {
+            g_queue_delete_link(closed_chats, curr);
+            closed_chats_bytes -= closed->bytes;
+            return closed;
         }
-        curr = g_list_next(curr);
     }
 
-    g_list_free(values);
     return NULL;
 }
 
+// windows whose history was never loaded have nothing worth keeping
+static void
+_wins_closed_chat_keep(ProfChatWin* chatwin)
+{
+    ProfWin* window = &chatwin->window;
+    int entries;
+    gsize bytes;
+    win_buffer_stats(window, &entries, &bytes);
+    if (entries == 0 || bytes > CLOSED_CHATS_MAX_BYTES || chatwin->history_pending) {
+        return;
+    }
+    if (connection_get_status() != JABBER_CONNECTED) {
+        return;
+    }
+
+    const char* account = connection_get_barejid();
+    ClosedChat* stale = _wins_closed_chat_take(account, chatwin->barejid);
+    if (stale) {
+        _wins_closed_chat_free(stale);
+    }
+
+    ClosedChat* closed = malloc(sizeof(ClosedChat));
+    closed->account = strdup(account);
+    closed->barejid = strdup(chatwin->barejid);
+    closed->layout = win_layout_detach(window);
+    closed->history_cursor = chatwin->history_cursor;
+    chatwin->history_cursor = NULL;
+    closed->history_view_end = chatwin->history_view_end;
+    chatwin->history_view_end = NULL;
+    closed->last_logged = _wins_closed_chat_last_logged(chatwin->barejid);
+    closed->bytes = bytes;
+
+    if (!closed_chats) {
+        closed_chats = g_queue_new();
+    }
+    g_queue_push_head(closed_chats, closed);
+    closed_chats_bytes += bytes;
+
+    while (closed_chats_bytes > CLOSED_CHATS_MAX_BYTES) {
+        ClosedChat* oldest = g_queue_pop_tail(closed_chats);
+        closed_chats_bytes -= oldest->bytes;
+        _wins_closed_chat_free(oldest);
+    }
+}
+
 void
 wins_add_urls_ac(const ProfWin* const win, const ProfMessage* const message, const gboolean flip)
 {
-    GRegex* regex;
     GMatchInfo* match_info;
 
-    // https://stackoverflow.com/questions/43588699/regex-for-matching-any-url-character
-    regex = g_regex_new("(https?|aesgcm)://[\\w\\-.~:/?#\\[\\]@!$&'()*+,;=%]+", 0, 0, NULL);
-    g_regex_match(regex, message->plain, 0, &match_info);
+    // every URL the pattern matches has a scheme separator, most messages don't
+    if (message->plain == NULL || strstr(message->plain, "://") == NULL) {
+        return;
+    }
+
+    if (url_regex == NULL) {
+        // https://stackoverflow.com/questions/43588699/regex-for-matching-any-url-character
+        url_regex = g_regex_new("(https?|aesgcm)://[\\w\\-.~:/?#\\[\\]@!$&'()*+,;=%]+", G_REGEX_OPTIMIZE, 0, NULL);
+    }
+    g_regex_match(url_regex, message->plain, 0, &match_info);
 
     while (g_match_info_matches(match_info)) {
         auto_gchar gchar* word = g_match_info_fetch(match_info, 0);
@@ -1322,14 +1594,12 @@ wins_add_urls_ac(const ProfWin* const win, const ProfMessage* const message, con
         } else {
             autocomplete_add_unsorted(win->urls_ac, word, TRUE);
         }
-        // for people who run profanity a long time, we don't want to waste a lot of memory
-        autocomplete_remove_older_than_max_reverse(win->urls_ac, 20);
+        autocomplete_remove_older_than_max_reverse(win->urls_ac, WINS_RECENT_MAX);
 
         g_match_info_next(match_info, NULL);
     }
 
     g_match_info_free(match_info);
-    g_regex_unref(regex);
 }
 
 void
@@ -1341,8 +1611,7 @@ wins_add_quotes_ac(const ProfWin* const win, const char* const message, const gb
         autocomplete_add_unsorted(win->quotes_ac, message, TRUE);
     }
 
-    // for people who run profanity a long time, we don't want to waste a lot of memory
-    autocomplete_remove_older_than_max_reverse(win->quotes_ac, 20);
+    autocomplete_remove_older_than_max_reverse(win->quotes_ac, WINS_RECENT_MAX);
 }
 
 char*
@@ -42,6 +42,7 @@ void wins_init(void);
 
 ProfWin* wins_new_xmlconsole(void);
 ProfWin* wins_new_chat(const char* const barejid);
+gboolean wins_reopen_closed_chat(ProfChatWin* chatwin);
 ProfWin* wins_new_muc(const char* const roomjid);
 ProfWin* wins_new_config(const char* const roomjid, DataForm* form, ProfConfWinCallback submit, ProfConfWinCallback cancel, const void* userdata);
 ProfWin* wins_new_private(const char* const fulljid);
@@ -83,7 +84,10 @@ void wins_close_by_num(int i);
 gboolean wins_is_current(ProfWin* window);
 gboolean wins_do_notify_remind(void);
 int wins_get_total_unread(void);
+void wins_unread_changed(ProfWin* window);
+void wins_attention_changed(ProfWin* window);
 void wins_resize_all(void);
+void wins_apply_scrollback(void);
 GSList* wins_get_chat_recipients(void);
 GSList* wins_get_prune_wins(void);
 void wins_lost_connection(void);
@@ -93,6 +97,7 @@ GSList* wins_create_summary(gboolean unread);
 GSList* wins_create_summary_attention();
 void wins_destroy(void);
 GList* wins_get_nums(void);
+GList* wins_get_nums_sorted(void);
 void wins_swap(int source_win, int target_win);
 void wins_hide_subwin(ProfWin* window);
 void wins_show_subwin(ProfWin* window);
@@ -0,0 +1,195 @@
+/*
+ * wrap.c
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2012 - 2019 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "ui/wrap.h"
+
+// display columns of the character at message[i], -1 if it isn't valid UTF-8
+static int
+_wrap_char_width(const char* const message, int i, int len, int* char_len)
+{
+    unsigned char c = message[i];
+    if (c < 0x80) {
+        *char_len = 1;
+        return 1;
+    }
+
+    gunichar u = g_utf8_get_char_validated(message + i, len - i);
+    if (u == (gunichar)-1 || u == (gunichar)-2) {
+        *char_len = 1;
+        return -1;
+    }
+
+    *char_len = g_utf8_skip[c];
+    return g_unichar_iswide(u) ? 2 : 1;
+}
+
+static void
+_wrap_line(GArray* segs, int line, int col, int start)
+{
+    ProfWrapSeg seg = { line, col, start, 0, 0 };
+    g_array_append_val(segs, seg);
+}
+
+// extends the last segment when the bytes follow on from it, on screen and
+// in the message, otherwise starts a new one
+static void
+_wrap_put(GArray* segs, int line, int col, int start, int len, int width)
+{
+    ProfWrapSeg* last = &g_array_index(segs, ProfWrapSeg, segs->len - 1);
+    if (last->line == line && last->len == 0 && last->col == col) {
+        last->start = start;
+    } else if (last->line != line || last->col + last->width != col || last->start + last->len != start) {
+        _wrap_line(segs, line, col, start);
+        last = &g_array_index(segs, ProfWrapSeg, segs->len - 1);
+    }
+
+    last->len += len;
+    last->width += width;
+}
+
+ProfWrap*
+wrap_layout(const char* const message, int startx, int width, int indent, int pad_indent)
+{
+    int cont = indent + pad_indent;
+    if (cont >= width) {
+        cont = 0;
+    }
+
+    GArray* segs = g_array_new(FALSE, FALSE, sizeof(ProfWrapSeg));
+    int line = 0;
+    int col = MAX(startx, indent);
+    _wrap_line(segs, line, col, 0);
+
+    int len = strlen(message);
+    int i = 0;
+    while (i < len) {
+        if (message[i] == '\n') {
+            line++;
+            col = cont;
+            _wrap_line(segs, line, col, i + 1);
+            i++;
+
+        } else if (message[i] == ' ') {
+            // a space that would start a wrapped line is dropped
+            if (col >= width) {
+                line++;
+                col = cont;
+                _wrap_line(segs, line, col, i + 1);
+            } else {
+                _wrap_put(segs, line, col, i, 1, 1);
+                col++;
+            }
+            i++;
+
+        } else {
+            // measure the word, noting whether it can be written in one go
+            int end = i;
+            int word_width = 0;
+            gboolean valid = TRUE;
+            while (end < len && message[end] != ' ' && message[end] != '\n') {
+                int char_len;
+                int char_width = _wrap_char_width(message, end, len, &char_len);
+                if (char_width < 0) {
+                    valid = FALSE;
+                } else {
+                    word_width += char_width;
+                }
+                end += char_len;
+            }
+
+            gboolean fits = col + word_width <= width;
+            if (!fits && word_width <= width - cont) {
+                line++;
+                col = cont;
+                _wrap_line(segs, line, col, i);
+                fits = TRUE;
+            }
+
+            if (fits && valid) {
+                _wrap_put(segs, line, col, i, end - i, word_width);
+                col += word_width;
+            } else {
+                // longer than a line, or with bytes to skip: place each character
+                while (i < end) {
+                    int char_len;
+                    int char_width = _wrap_char_width(message, i, len, &char_len);
+                    if (char_width >= 0) {
+                        if (col + char_width > width && col > cont) {
+                            line++;
+                            col = cont;
+                            _wrap_line(segs, line, col, i);
+                        }
+                        _wrap_put(segs, line, col, i, char_len, char_width);
+                        col += char_width;
+                    }
+                    i += char_len;
+                }
+            }
+            i = end;
+        }
+    }
+
+    ProfWrap* wrap = g_new(ProfWrap, 1);
+    wrap->startx = startx;
+    wrap->width = width;
+    wrap->indent = indent;
+    wrap->pad_indent = pad_indent;
+    wrap->lines = line + 1;
+    wrap->count = segs->len;
+    wrap->segs = (ProfWrapSeg*)g_array_free(segs, FALSE);
+
+    return wrap;
+}
+
+gboolean
+wrap_matches(const ProfWrap* const wrap, int startx, int width, int indent, int pad_indent)
+{
+    return wrap && wrap->startx == startx && wrap->width == width && wrap->indent == indent && wrap->pad_indent == pad_indent;
+}
+
+void
+wrap_free(ProfWrap* wrap)
+{
+    if (wrap) {
+        g_free(wrap->segs);
+        g_free(wrap);
+    }
+}
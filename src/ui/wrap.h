@@ -0,0 +1,68 @@
+/*
+ * wrap.h
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2012 - 2019 James Booth <boothj5@gmail.com>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+#ifndef UI_WRAP_H
+#define UI_WRAP_H
+
+#include <glib.h>
+
+// A run of message bytes written on one line of the pad, starting at col.
+typedef struct prof_wrap_seg_t
+{
+    int line;  // 0 is the line the timestamp and nick are on
+    int col;   // column to indent to before writing
+    int start; // byte offset into the message
+    int len;   // bytes to write, 0 for a line with nothing but indentation
+    int width; // display columns the bytes take
+} ProfWrapSeg;
+
+// Line breaks of a message for a given pad width, computed once so redraws
+// at the same width only have to copy segments into the pad.
+typedef struct prof_wrap_t
+{
+    int startx;
+    int width;
+    int indent;
+    int pad_indent;
+    int lines;
+    int count;
+    ProfWrapSeg* segs;
+} ProfWrap;
+
+ProfWrap* wrap_layout(const char* const message, int startx, int width, int indent, int pad_indent);
+gboolean wrap_matches(const ProfWrap* const wrap, int startx, int width, int indent, int pad_indent);
+void wrap_free(ProfWrap* wrap);
+
+#endif
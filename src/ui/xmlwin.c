@@ -36,25 +36,207 @@
 #include "config.h"
 
 #include <assert.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include "ui/ui.h"
 #include "ui/win_types.h"
 #include "ui/window_list.h"
 
+// Filters only look at the raw text so a stanza that does not match costs
+// a few string compares and is never copied or formatted.
+
+static gboolean
+_xmlwin_match_element(const char* text, const char* const element)
+{
+    while (*text == ' ' || *text == '\n' || *text == '\t') {
+        text++;
+    }
+    if (*text != '<') {
+        return FALSE;
+    }
+    text++;
+
+    size_t len = strcspn(text, " \t\n/>");
+    return strlen(element) == len && strncmp(text, element, len) == 0;
+}
+
+static gboolean
+_xmlwin_match_ns(const char* text, const char* const ns)
+{
+    size_t len = strlen(ns);
+    while ((text = strstr(text, "xmlns"))) {
+        text += strlen("xmlns");
+        // also xmlns:prefix='...'
+        if (*text == ':') {
+            text += strcspn(text, "=");
+        }
+        if (text[0] == '=' && (text[1] == '\'' || text[1] == '"')) {
+            char quote = text[1];
+            text += 2;
+            if (strncmp(text, ns, len) == 0 && text[len] == quote) {
+                return TRUE;
+            }
+        }
+    }
+
+    return FALSE;
+}
+
+// to or from of the top level element, a bare jid also matches its full jids
+static gboolean
+_xmlwin_match_jid(const char* const text, const char* const jid)
+{
+    const char* end = strchr(text, '>');
+    size_t len = strlen(jid);
+    const char* attrs[] = { " to=", " from=" };
+
+    for (int i = 0; i < 2; i++) {
+        const char* attr = strstr(text, attrs[i]);
+        if (!attr || (end && attr > end)) {
+            continue;
+        }
+        const char* value = attr + strlen(attrs[i]);
+        if (*value != '\'' && *value != '"') {
+            continue;
+        }
+        char quote = *value++;
+        if (strncmp(value, jid, len) == 0 && (value[len] == quote || value[len] == '/')) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static gboolean
+_xmlwin_filter_match(ProfXMLWin* xmlwin, const char* const text)
+{
+    if (xmlwin->filter_element && !_xmlwin_match_element(text, xmlwin->filter_element)) {
+        return FALSE;
+    }
+    if (xmlwin->filter_ns && !_xmlwin_match_ns(text, xmlwin->filter_ns)) {
+        return FALSE;
+    }
+    if (xmlwin->filter_jid && !_xmlwin_match_jid(text, xmlwin->filter_jid)) {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
 void
-xmlwin_show(ProfXMLWin* xmlwin, const char* const msg)
+xmlwin_capture(ProfXMLWin* xmlwin, const char* const msg)
 {
     assert(xmlwin != NULL);
 
-    ProfWin* window = (ProfWin*)xmlwin;
+    gboolean sent;
     if (g_str_has_prefix(msg, "SENT:")) {
-        win_println(window, THEME_DEFAULT, "-", "SENT:");
-        win_println(window, THEME_ONLINE, "-", "%s", &msg[6]);
-        win_println(window, THEME_ONLINE, "-", "");
+        sent = TRUE;
     } else if (g_str_has_prefix(msg, "RECV:")) {
-        win_println(window, THEME_DEFAULT, "-", "RECV:");
-        win_println(window, THEME_AWAY, "-", "%s", &msg[6]);
-        win_println(window, THEME_AWAY, "-", "");
+        sent = FALSE;
+    } else {
+        return;
+    }
+
+    const char* text = msg[5] == ' ' ? &msg[6] : &msg[5];
+    if (!_xmlwin_filter_match(xmlwin, text)) {
+        return;
+    }
+
+    ProfXMLStanza* slot = &xmlwin->ring[xmlwin->captured % XMLWIN_RING_SIZE];
+    free(slot->text);
+    slot->text = strdup(text);
+    slot->sent = sent;
+    slot->time = g_get_real_time();
+    xmlwin->captured++;
+
+    // rendering waits until the console is looked at
+    if (wins_is_current((ProfWin*)xmlwin)) {
+        ui_mark_dirty_part(UI_DIRTY_WINDOW);
+    }
+}
+
+void
+xmlwin_render(ProfXMLWin* xmlwin)
+{
+    assert(xmlwin != NULL);
+
+    ProfWin* window = (ProfWin*)xmlwin;
+    guint64 first = xmlwin->rendered;
+    if (xmlwin->captured - first > XMLWIN_RING_SIZE) {
+        first = xmlwin->captured - XMLWIN_RING_SIZE;
+        win_println(window, THEME_DEFAULT, "-", "%" G_GUINT64_FORMAT " stanzas dropped while the console was not shown.", first - xmlwin->rendered);
+        win_println(window, THEME_DEFAULT, "-", "");
+    }
+
+    for (guint64 n = first; n < xmlwin->captured; n++) {
+        ProfXMLStanza* stanza = &xmlwin->ring[n % XMLWIN_RING_SIZE];
+        GDateTime* secs = g_date_time_new_from_unix_local(stanza->time / G_USEC_PER_SEC);
+        GDateTime* time = g_date_time_add(secs, stanza->time % G_USEC_PER_SEC);
+        g_date_time_unref(secs);
+
+        theme_item_t theme = stanza->sent ? THEME_ONLINE : THEME_AWAY;
+        win_println_at(window, time, THEME_DEFAULT, "-", stanza->sent ? "SENT:" : "RECV:");
+        win_println_at(window, time, theme, "-", stanza->text);
+        win_println_at(window, time, theme, "-", "");
+        g_date_time_unref(time);
+
+        free(stanza->text);
+        stanza->text = NULL;
+    }
+    xmlwin->rendered = xmlwin->captured;
+}
+
+gboolean
+xmlwin_set_filter(ProfXMLWin* xmlwin, const char* const type, const char* const value)
+{
+    assert(xmlwin != NULL);
+
+    char** filter = NULL;
+    if (g_strcmp0(type, "element") == 0) {
+        filter = &xmlwin->filter_element;
+    } else if (g_strcmp0(type, "ns") == 0) {
+        filter = &xmlwin->filter_ns;
+    } else if (g_strcmp0(type, "jid") == 0) {
+        filter = &xmlwin->filter_jid;
+    } else if (g_strcmp0(type, "clear") == 0) {
+        free(xmlwin->filter_element);
+        free(xmlwin->filter_ns);
+        free(xmlwin->filter_jid);
+        xmlwin->filter_element = NULL;
+        xmlwin->filter_ns = NULL;
+        xmlwin->filter_jid = NULL;
+        return TRUE;
+    } else {
+        return FALSE;
+    }
+
+    free(*filter);
+    *filter = value ? strdup(value) : NULL;
+    return TRUE;
+}
+
+void
+xmlwin_show_filters(ProfXMLWin* xmlwin)
+{
+    assert(xmlwin != NULL);
+
+    ProfWin* window = (ProfWin*)xmlwin;
+    if (!xmlwin->filter_element && !xmlwin->filter_ns && !xmlwin->filter_jid) {
+        win_println(window, THEME_DEFAULT, "-", "No filters, showing all stanzas.");
+        return;
+    }
+
+    win_println(window, THEME_DEFAULT, "-", "Showing stanzas matching:");
+    if (xmlwin->filter_element) {
+        win_println(window, THEME_DEFAULT, "-", "  element : %s", xmlwin->filter_element);
+    }
+    if (xmlwin->filter_ns) {
+        win_println(window, THEME_DEFAULT, "-", "  ns      : %s", xmlwin->filter_ns);
+    }
+    if (xmlwin->filter_jid) {
+        win_println(window, THEME_DEFAULT, "-", "  jid     : %s", xmlwin->filter_jid);
     }
 }
 
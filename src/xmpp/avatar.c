@@ -46,6 +46,7 @@
 #include <sys/stat.h>
 
 #include "log.h"
+#include "tools/base64.h"
 #include "xmpp/connection.h"
 #include "xmpp/iq.h"
 #include "xmpp/message.h"
@@ -62,9 +63,12 @@ typedef struct avatar_metadata
 
 static GHashTable* looking_for = NULL; // contains nicks/barejids from who we want to get the avatar
 static GHashTable* shall_open = NULL;  // contains a list of nicks that shall not just downloaded but also opened
+static GHashTable* in_flight = NULL;   // avatar ids being fetched, to the jids waiting for them
 const int MAX_PIXEL = 192;             // max pixel width/height for an avatar
 
+static void _avatar_get_by_id(const char* jid, const char* id, const char* type);
 static void _avatar_request_item_by_id(const char* jid, avatar_metadata* data);
+static void _avatar_save(const char* jid, const char* type, const gchar* de, gsize size);
 static int _avatar_metadata_handler(xmpp_stanza_t* const stanza, void* const userdata);
 static int _avatar_request_item_result_handler(xmpp_stanza_t* const stanza, void* const userdata);
 
@@ -72,11 +76,77 @@ static void
 _free_avatar_data(avatar_metadata* data)
 {
     if (data) {
+        if (in_flight) {
+            g_hash_table_remove(in_flight, data->id);
+        }
         free(data->type);
+        free(data->id);
         free(data);
     }
 }
 
+// XEP-0084 ids are the hex SHA-1 of the image, which makes them safe to use
+// as file names in the on-disk cache
+static gboolean
+_avatar_id_valid(const char* id)
+{
+    if (strlen(id) != 40) {
+        return FALSE;
+    }
+    for (const char* c = id; *c; c++) {
+        if (!g_ascii_isxdigit(*c)) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static gchar*
+_avatar_cache_path(const char* id)
+{
+    auto_gchar gchar* path = files_get_data_path("");
+    auto_gchar gchar* lower = g_ascii_strdown(id, -1);
+
+    return g_build_filename(path, "avatars", "cache", lower, NULL);
+}
+
+static void
+_avatar_cache_store(const char* id, const gchar* de, gsize size)
+{
+    if (!_avatar_id_valid(id)) {
+        return;
+    }
+
+    auto_gchar gchar* sha1 = g_compute_checksum_for_data(G_CHECKSUM_SHA1, (const guchar*)de, size);
+    if (g_ascii_strcasecmp(sha1, id) != 0) {
+        log_debug("Avatar: data does not match id %s, not caching", id);
+        return;
+    }
+
+    auto_gchar gchar* cache_path = _avatar_cache_path(id);
+    auto_gchar gchar* cache_dir = g_path_get_dirname(cache_path);
+    if (g_mkdir_with_parents(cache_dir, S_IRWXU) == -1) {
+        log_error("Avatar: error creating directory: %s, %s", cache_dir, strerror(errno));
+        return;
+    }
+
+    GError* err = NULL;
+    if (!g_file_set_contents(cache_path, de, size, &err)) {
+        log_error("Avatar: unable to cache %s: %s", id, err->message);
+        g_error_free(err);
+    }
+}
+
+// image bytes obtained elsewhere, e.g. a vCard photo, returns their id
+gchar*
+avatar_cache_add(const guchar* data, gsize size)
+{
+    gchar* id = g_compute_checksum_for_data(G_CHECKSUM_SHA1, data, size);
+    _avatar_cache_store(id, (const gchar*)data, size);
+    return id;
+}
+
 void
 avatar_pep_subscribe(void)
 {
@@ -94,6 +164,11 @@ avatar_pep_subscribe(void)
         g_hash_table_destroy(shall_open);
     }
     shall_open = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+    if (in_flight) {
+        g_hash_table_destroy(in_flight);
+    }
+    in_flight = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_ptr_array_unref);
 }
 
 #ifdef HAVE_PIXBUF
@@ -223,15 +298,7 @@ _avatar_metadata_handler(xmpp_stanza_t* const stanza, void* const userdata)
 
                 if (id && type) {
                     log_debug("Avatar ID for %s is: %s", from, id);
-
-                    avatar_metadata* data = malloc(sizeof(avatar_metadata));
-                    if (data) {
-                        data->type = strdup(type);
-                        data->id = strdup(id);
-
-                        // request the actual (image) data
-                        _avatar_request_item_by_id(from, data);
-                    }
+                    _avatar_get_by_id(from, id, type);
                 }
             } else {
                 cons_show("We couldn't get the user's avatar, possibly because they haven't set one or have disabled avatar publishing. "
@@ -243,6 +310,49 @@ _avatar_metadata_handler(xmpp_stanza_t* const stanza, void* const userdata)
     return 1;
 }
 
+// use the cached image for id if there is one, otherwise fetch it, joining
+// a request already in flight for the same id
+static void
+_avatar_get_by_id(const char* jid, const char* id, const char* type)
+{
+    if (_avatar_id_valid(id)) {
+        auto_gchar gchar* cache_path = _avatar_cache_path(id);
+        auto_gchar gchar* de = NULL;
+        gsize size = 0;
+        if (g_file_get_contents(cache_path, &de, &size, NULL)) {
+            log_debug("Avatar %s for %s found in cache", id, jid);
+            caps_remove_feature(XMPP_FEATURE_USER_AVATAR_METADATA_NOTIFY);
+            g_hash_table_remove(looking_for, jid);
+            _avatar_save(jid, type, de, size);
+            return;
+        }
+    }
+
+    GPtrArray* waiting = g_hash_table_lookup(in_flight, id);
+    if (waiting) {
+        for (guint i = 0; i < waiting->len; i++) {
+            if (g_strcmp0(g_ptr_array_index(waiting, i), jid) == 0) {
+                return;
+            }
+        }
+        g_ptr_array_add(waiting, g_strdup(jid));
+        return;
+    }
+
+    waiting = g_ptr_array_new_with_free_func(g_free);
+    g_ptr_array_add(waiting, g_strdup(jid));
+    g_hash_table_insert(in_flight, g_strdup(id), waiting);
+
+    avatar_metadata* data = malloc(sizeof(avatar_metadata));
+    if (data) {
+        data->type = strdup(type);
+        data->id = strdup(id);
+
+        // request the actual (image) data
+        _avatar_request_item_by_id(jid, data);
+    }
+}
+
 static void
 _avatar_request_item_by_id(const char* jid, avatar_metadata* data)
 {
@@ -268,11 +378,6 @@ _avatar_request_item_result_handler(xmpp_stanza_t* const stanza, void* const use
         return 1;
     }
 
-    if (!g_hash_table_contains(looking_for, from_attr)) {
-        return 1;
-    }
-    g_hash_table_remove(looking_for, from_attr);
-
     xmpp_stanza_t* pubsub = xmpp_stanza_get_child_by_ns(stanza, STANZA_NS_PUBSUB);
     if (!pubsub) {
         return 1;
@@ -299,8 +404,30 @@ _avatar_request_item_result_handler(xmpp_stanza_t* const stanza, void* const use
     }
 
     gsize size;
-    auto_gchar gchar* de = (gchar*)g_base64_decode(buf, &size);
+    auto_gchar gchar* de = (gchar*)base64_decode(buf, &size);
+
+    avatar_metadata* data = (avatar_metadata*)userdata;
+    _avatar_cache_store(data->id, de, size);
+
+    // everyone who asked for this id while the request was in flight
+    GPtrArray* waiting = g_hash_table_lookup(in_flight, data->id);
+    if (waiting) {
+        for (guint i = 0; i < waiting->len; i++) {
+            const char* jid = g_ptr_array_index(waiting, i);
+            if (g_hash_table_remove(looking_for, jid)) {
+                _avatar_save(jid, data->type, de, size);
+            }
+        }
+    } else if (g_hash_table_remove(looking_for, from_attr)) {
+        _avatar_save(from_attr, data->type, de, size);
+    }
+
+    return 1;
+}
 
+static void
+_avatar_save(const char* jid, const char* type, const gchar* de, gsize size)
+{
     auto_gchar gchar* path = files_get_data_path("");
     GString* filename = g_string_new(path);
 
@@ -317,20 +444,18 @@ _avatar_request_item_result_handler(xmpp_stanza_t* const stanza, void* const use
         }
     }
 
-    auto_char char* from = str_replace(from_attr, "@", "_at_");
+    auto_char char* from = str_replace(jid, "@", "_at_");
     g_string_append(filename, from);
 
-    avatar_metadata* data = (avatar_metadata*)userdata;
-
     // check a few image types ourselves
     // if none matches we won't add an extension but linux will
     // be able to open it anyways
     // TODO: we could use /etc/mime-types
-    if (g_strcmp0(data->type, "image/png") == 0) {
+    if (g_strcmp0(type, "image/png") == 0) {
         g_string_append(filename, ".png");
-    } else if (g_strcmp0(data->type, "image/jpeg") == 0) {
+    } else if (g_strcmp0(type, "image/jpeg") == 0) {
         g_string_append(filename, ".jpeg");
-    } else if (g_strcmp0(data->type, "image/webp") == 0) {
+    } else if (g_strcmp0(type, "image/webp") == 0) {
         g_string_append(filename, ".webp");
     }
 
@@ -344,7 +469,7 @@ _avatar_request_item_result_handler(xmpp_stanza_t* const stanza, void* const use
     }
 
     // if we shall open it
-    if (g_hash_table_contains(shall_open, from_attr)) {
+    if (g_hash_table_contains(shall_open, jid)) {
         auto_gchar gchar* cmdtemplate = prefs_get_string(PREF_AVATAR_CMD);
 
         if (cmdtemplate == NULL) {
@@ -357,10 +482,8 @@ _avatar_request_item_result_handler(xmpp_stanza_t* const stanza, void* const use
             }
         }
 
-        g_hash_table_remove(shall_open, from_attr);
+        g_hash_table_remove(shall_open, jid);
     }
 
     g_string_free(filename, TRUE);
-
-    return 1;
 }
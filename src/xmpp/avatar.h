@@ -40,6 +40,7 @@
 
 void avatar_pep_subscribe(void);
 gboolean avatar_get_by_nick(const char* nick, gboolean open);
+gchar* avatar_cache_add(const guchar* data, gsize size);
 #ifdef HAVE_PIXBUF
 gboolean avatar_set(const char* path);
 #endif
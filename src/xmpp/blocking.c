@@ -56,19 +56,48 @@ static int _block_remove_result_handler(xmpp_stanza_t* const stanza, void* const
 
 static GList* blocked;
 static Autocomplete blocked_ac;
+// the same jids as `blocked`, for lookups on every incoming stanza
+static GHashTable* blocked_set;
 
-void
-blocking_request(void)
+static void _blocked_clear(void);
+
+static void
+_blocked_insert(const char* const jid)
+{
+    if (!blocked_set) {
+        _blocked_clear();
+    }
+    if (!g_hash_table_contains(blocked_set, jid)) {
+        g_hash_table_add(blocked_set, strdup(jid));
+        blocked = g_list_append(blocked, strdup(jid));
+        autocomplete_add(blocked_ac, jid);
+    }
+}
+
+static void
+_blocked_clear(void)
 {
     if (blocked) {
         g_list_free_full(blocked, free);
         blocked = NULL;
     }
-
+    if (blocked_set) {
+        g_hash_table_remove_all(blocked_set);
+    } else {
+        blocked_set = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+    }
     if (blocked_ac) {
-        autocomplete_free(blocked_ac);
+        autocomplete_clear(blocked_ac);
+    }
+}
+
+void
+blocking_request(void)
+{
+    if (blocked_ac == NULL) {
+        blocked_ac = autocomplete_new();
     }
-    blocked_ac = autocomplete_new();
+    _blocked_clear();
 
     auto_char char* id = connection_create_stanza_id();
     iq_id_handler_add(id, _blocklist_result_handler, NULL, NULL);
@@ -87,6 +116,32 @@ blocked_list(void)
     return blocked;
 }
 
+/**
+ * Whether stanzas from `from` fall under a block, by its full jid, bare
+ * jid or domain as described in XEP-0191.
+ */
+gboolean
+blocked_contains(const char* const from)
+{
+    if (!from || !blocked_set || g_hash_table_size(blocked_set) == 0) {
+        return FALSE;
+    }
+
+    if (g_hash_table_contains(blocked_set, from)) {
+        return TRUE;
+    }
+
+    const char* slash = strchr(from, '/');
+    auto_gchar gchar* bare = slash ? g_strndup(from, slash - from) : NULL;
+    const char* barejid = bare ? bare : from;
+    if (bare && g_hash_table_contains(blocked_set, bare)) {
+        return TRUE;
+    }
+
+    const char* at = strchr(barejid, '@');
+    return at && g_hash_table_contains(blocked_set, at + 1);
+}
+
 char*
 blocked_ac_find(const char* const search_str, gboolean previous, void* context)
 {
@@ -104,8 +159,7 @@ blocked_ac_reset(void)
 gboolean
 blocked_add(char* jid, blocked_report reportkind, const char* const message)
 {
-    GList* found = g_list_find_custom(blocked, jid, (GCompareFunc)g_strcmp0);
-    if (found) {
+    if (blocked_set && g_hash_table_contains(blocked_set, jid)) {
         return FALSE;
     }
 
@@ -165,8 +219,7 @@ blocked_add(char* jid, blocked_report reportkind, const char* const message)
 gboolean
 blocked_remove(char* jid)
 {
-    GList* found = g_list_find_custom(blocked, jid, (GCompareFunc)g_strcmp0);
-    if (!found) {
+    if (!blocked_set || !g_hash_table_contains(blocked_set, jid)) {
         return FALSE;
     }
 
@@ -207,8 +260,7 @@ blocked_set_handler(xmpp_stanza_t* stanza)
             if (g_strcmp0(xmpp_stanza_get_name(child), STANZA_NAME_ITEM) == 0) {
                 const char* jid = xmpp_stanza_get_attribute(child, STANZA_ATTR_JID);
                 if (jid) {
-                    blocked = g_list_append(blocked, strdup(jid));
-                    autocomplete_add(blocked_ac, jid);
+                    _blocked_insert(jid);
                 }
             }
 
@@ -220,20 +272,16 @@ blocked_set_handler(xmpp_stanza_t* stanza)
     if (unblock) {
         xmpp_stanza_t* child = xmpp_stanza_get_children(unblock);
         if (!child) {
-            g_list_free_full(blocked, free);
-            blocked = NULL;
-            autocomplete_clear(blocked_ac);
+            _blocked_clear();
         } else {
             while (child) {
                 if (g_strcmp0(xmpp_stanza_get_name(child), STANZA_NAME_ITEM) == 0) {
                     const char* jid = xmpp_stanza_get_attribute(child, STANZA_ATTR_JID);
-                    if (jid) {
+                    if (jid && blocked_set && g_hash_table_remove(blocked_set, jid)) {
                         GList* found = g_list_find_custom(blocked, jid, (GCompareFunc)g_strcmp0);
-                        if (found) {
-                            blocked = g_list_remove_link(blocked, found);
-                            g_list_free_full(found, free);
-                            autocomplete_remove(blocked_ac, jid);
-                        }
+                        blocked = g_list_remove_link(blocked, found);
+                        g_list_free_full(found, free);
+                        autocomplete_remove(blocked_ac, jid);
                     }
                 }
 
@@ -304,10 +352,7 @@ _blocklist_result_handler(xmpp_stanza_t* const stanza, void* const userdata)
         return 0;
     }
 
-    if (blocked) {
-        g_list_free_full(blocked, free);
-        blocked = NULL;
-    }
+    _blocked_clear();
 
     xmpp_stanza_t* items = xmpp_stanza_get_children(blocklist);
     if (!items) {
@@ -321,8 +366,7 @@ _blocklist_result_handler(xmpp_stanza_t* const stanza, void* const userdata)
         if (g_strcmp0(name, "item") == 0) {
             const char* jid = xmpp_stanza_get_attribute(curr, STANZA_ATTR_JID);
             if (jid) {
-                blocked = g_list_append(blocked, strdup(jid));
-                autocomplete_add(blocked_ac, jid);
+                _blocked_insert(jid);
             }
         }
         curr = xmpp_stanza_get_next(curr);
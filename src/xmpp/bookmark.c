@@ -66,16 +66,17 @@ static int _bookmark_result_id_handler(xmpp_stanza_t* const stanza, void* const
 static void _bookmark_destroy(Bookmark* bookmark);
 static void _send_bookmarks(void);
 
+// the bookmarks of the last session are kept, the result only applies
+// what changed since then
 void
 bookmark_request(void)
 {
-    if (bookmarks) {
-        g_hash_table_destroy(bookmarks);
+    if (bookmarks == NULL) {
+        bookmarks = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)_bookmark_destroy);
+    }
+    if (bookmark_ac == NULL) {
+        bookmark_ac = autocomplete_new();
     }
-    bookmarks = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)_bookmark_destroy);
-
-    autocomplete_free(bookmark_ac);
-    bookmark_ac = autocomplete_new();
 
     char* id = "bookmark_init_request";
     iq_id_handler_add(id, _bookmark_result_id_handler, free, NULL);
@@ -156,6 +157,7 @@ bookmark_update(const char* jid, const char* nick, const char* password, const c
     if (name) {
         free(bookmark->name);
         bookmark->name = strdup(name);
+        status_bar_names_changed();
     }
     if (autojoin_str) {
         if (g_strcmp0(autojoin_str, "on") == 0) {
@@ -272,6 +274,7 @@ _bookmark_result_id_handler(xmpp_stanza_t* const stanza, void* const userdata)
         bookmark_ac = autocomplete_new();
     }
 
+    GHashTable* seen = g_hash_table_new(g_str_hash, g_str_equal);
     xmpp_stanza_t* child = xmpp_stanza_get_children(storage);
     while (child) {
         name = xmpp_stanza_get_name(child);
@@ -319,15 +322,23 @@ _bookmark_result_id_handler(xmpp_stanza_t* const stanza, void* const userdata)
             }
         }
 
-        autocomplete_add(bookmark_ac, barejid);
-        Bookmark* bookmark = malloc(sizeof(Bookmark));
-        bookmark->barejid = strdup(barejid);
+        Bookmark* bookmark = g_hash_table_lookup(bookmarks, barejid);
+        if (bookmark) {
+            free(bookmark->nick);
+            free(bookmark->password);
+            free(bookmark->name);
+        } else {
+            bookmark = malloc(sizeof(Bookmark));
+            bookmark->barejid = strdup(barejid);
+            g_hash_table_insert(bookmarks, strdup(barejid), bookmark);
+            autocomplete_add(bookmark_ac, barejid);
+        }
         bookmark->nick = nick;
         bookmark->password = password;
         bookmark->name = room_name ? strdup(room_name) : NULL;
         bookmark->autojoin = autojoin_val;
         bookmark->ext_gajim_minimize = minimize;
-        g_hash_table_insert(bookmarks, strdup(barejid), bookmark);
+        g_hash_table_add(seen, bookmark->barejid);
 
         if (autojoin_val) {
             sv_ev_bookmark_autojoin(bookmark);
@@ -341,6 +352,20 @@ _bookmark_result_id_handler(xmpp_stanza_t* const stanza, void* const userdata)
         child = xmpp_stanza_get_next(child);
     }
 
+    // drop bookmarks removed by other clients meanwhile
+    GHashTableIter iter;
+    gpointer key;
+    g_hash_table_iter_init(&iter, bookmarks);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        if (!g_hash_table_contains(seen, key)) {
+            autocomplete_remove(bookmark_ac, key);
+            g_hash_table_iter_remove(&iter);
+        }
+    }
+    g_hash_table_destroy(seen);
+
+    status_bar_names_changed();
+
     return 0;
 }
 
@@ -57,27 +57,55 @@
 static gchar* cache_loc;
 static prof_keyfile_t caps_prof_keyfile;
 static GKeyFile* cache;
+// modification time of the cache file when this process last read it
+static gint64 cache_mtime;
 
 static GHashTable* jid_to_ver;
 static GHashTable* jid_to_caps;
 
+// disco#info requests in flight by ver, each with the jids waiting on its answer
+static GHashTable* ver_pending;
+// vers that failed verification or went unanswered, by monotonic expiry time,
+// so clients advertising broken caps are not queried on every presence
+static GHashTable* ver_failed;
+#define CAPS_FAILED_TTL_SECONDS (10 * 60)
+
+// decoded cache entries, parsed from the keyfile on first lookup of a ver
+typedef struct caps_entry_t
+{
+    EntityCapabilities* caps;
+    // membership of each interned feature id
+    guint32* features;
+    guint features_words;
+} CapsEntry;
+
+static GHashTable* ver_to_entry;
+
+// every feature string seen in an entry, mapped to its id + 1
+static GHashTable* feature_ids;
+
 static GHashTable* prof_features;
 static gchar* my_sha1;
 
 static void _save_cache(void);
+static void _load_cache(void);
+static gboolean _cache_has(const char* const ver);
 static EntityCapabilities* _caps_by_ver(const char* const ver);
-static EntityCapabilities* _caps_by_jid(const char* const jid);
+static CapsEntry* _caps_entry_by_ver(const char* const ver);
+static CapsEntry* _caps_entry_new(EntityCapabilities* caps);
+static void _caps_entry_free(CapsEntry* entry);
+static gboolean _caps_entry_has_feature(CapsEntry* entry, const char* const feature);
 static EntityCapabilities* _caps_copy(EntityCapabilities* caps);
 
 void
 caps_init(void)
 {
-    log_info("Loading capabilities cache");
-    load_data_keyfile(&caps_prof_keyfile, FILE_CAPSCACHE);
-    cache = caps_prof_keyfile.keyfile;
-
     jid_to_ver = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
-    jid_to_caps = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)caps_destroy);
+    jid_to_caps = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)_caps_entry_free);
+    ver_to_entry = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)_caps_entry_free);
+    feature_ids = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+    ver_pending = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_ptr_array_unref);
+    ver_failed = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
 
     prof_features = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
     g_hash_table_add(prof_features, strdup(STANZA_NS_CAPS));
@@ -212,7 +240,7 @@ caps_add_by_ver(const char* const ver, EntityCapabilities* caps)
         return;
     }
 
-    gboolean cached = g_key_file_has_group(cache, ver);
+    gboolean cached = _cache_has(ver);
     if (cached) {
         return;
     }
@@ -264,7 +292,7 @@ caps_add_by_ver(const char* const ver, EntityCapabilities* caps)
 void
 caps_add_by_jid(const char* const jid, EntityCapabilities* caps)
 {
-    g_hash_table_insert(jid_to_caps, strdup(jid), caps);
+    g_hash_table_insert(jid_to_caps, strdup(jid), _caps_entry_new(caps));
 }
 
 void
@@ -273,10 +301,72 @@ caps_map_jid_to_ver(const char* const jid, const char* const ver)
     g_hash_table_insert(jid_to_ver, strdup(jid), strdup(ver));
 }
 
+// TRUE when the caller should send the disco#info request for ver, FALSE
+// when jid was queued behind one already in flight or ver failed recently
+gboolean
+caps_ver_request_start(const char* const ver, const char* const jid)
+{
+    gint64* expires = g_hash_table_lookup(ver_failed, ver);
+    if (expires) {
+        if (g_get_monotonic_time() < *expires) {
+            log_debug("Capabilities %s failed recently, not querying %s", ver, jid);
+            return FALSE;
+        }
+        g_hash_table_remove(ver_failed, ver);
+    }
+
+    GPtrArray* waiting = g_hash_table_lookup(ver_pending, ver);
+    if (waiting) {
+        log_debug("Capabilities request for %s already sent, %s waiting on it", ver, jid);
+        g_ptr_array_add(waiting, g_strdup(jid));
+        return FALSE;
+    }
+
+    waiting = g_ptr_array_new_with_free_func(g_free);
+    g_ptr_array_add(waiting, g_strdup(jid));
+    g_hash_table_insert(ver_pending, g_strdup(ver), waiting);
+    return TRUE;
+}
+
+void
+caps_ver_request_done(const char* const ver, gboolean verified)
+{
+    if (!ver_pending) {
+        return;
+    }
+
+    GPtrArray* waiting = g_hash_table_lookup(ver_pending, ver);
+    if (waiting && verified) {
+        for (guint i = 0; i < waiting->len; i++) {
+            caps_map_jid_to_ver(g_ptr_array_index(waiting, i), ver);
+        }
+    } else if (!verified) {
+        gint64* expires = g_new(gint64, 1);
+        *expires = g_get_monotonic_time() + CAPS_FAILED_TTL_SECONDS * G_USEC_PER_SEC;
+        g_hash_table_insert(ver_failed, g_strdup(ver), expires);
+    }
+    g_hash_table_remove(ver_pending, ver);
+}
+
+// request dropped without an answer, e.g. on disconnect
+void
+caps_ver_request_cancel(const char* const ver)
+{
+    if (ver_pending) {
+        g_hash_table_remove(ver_pending, ver);
+    }
+}
+
+const char*
+caps_jid_ver(const char* const jid)
+{
+    return g_hash_table_lookup(jid_to_ver, jid);
+}
+
 gboolean
 caps_cache_contains(const char* const ver)
 {
-    return (g_key_file_has_group(cache, ver));
+    return _cache_has(ver);
 }
 
 EntityCapabilities*
@@ -284,16 +374,16 @@ caps_lookup(const char* const jid)
 {
     char* ver = g_hash_table_lookup(jid_to_ver, jid);
     if (ver) {
-        EntityCapabilities* caps = _caps_by_ver(ver);
-        if (caps) {
+        CapsEntry* entry = _caps_entry_by_ver(ver);
+        if (entry) {
             log_debug("Capabilities lookup %s, found by verification string %s.", jid, ver);
-            return caps;
+            return _caps_copy(entry->caps);
         }
     } else {
-        EntityCapabilities* caps = _caps_by_jid(jid);
-        if (caps) {
+        CapsEntry* entry = g_hash_table_lookup(jid_to_caps, jid);
+        if (entry) {
             log_debug("Capabilities lookup %s, found by JID.", jid);
-            return _caps_copy(caps);
+            return _caps_copy(entry->caps);
         }
     }
 
@@ -304,18 +394,19 @@ caps_lookup(const char* const jid)
 gboolean
 caps_jid_has_feature(const char* const jid, const char* const feature)
 {
-    EntityCapabilities* caps = caps_lookup(jid);
+    CapsEntry* entry = NULL;
+    char* ver = g_hash_table_lookup(jid_to_ver, jid);
+    if (ver) {
+        entry = _caps_entry_by_ver(ver);
+    } else {
+        entry = g_hash_table_lookup(jid_to_caps, jid);
+    }
 
-    if (caps == NULL) {
+    if (entry == NULL) {
         return FALSE;
     }
 
-    GSList* found = g_slist_find_custom(caps->features, feature, (GCompareFunc)g_strcmp0);
-    gboolean result = found != NULL;
-
-    caps_destroy(caps);
-
-    return result;
+    return _caps_entry_has_feature(entry, feature);
 }
 
 char*
@@ -344,8 +435,15 @@ caps_close(void)
 {
     free_keyfile(&caps_prof_keyfile);
     cache = NULL;
+    cache_mtime = 0;
     g_hash_table_destroy(jid_to_ver);
     g_hash_table_destroy(jid_to_caps);
+    g_hash_table_destroy(ver_to_entry);
+    g_hash_table_destroy(feature_ids);
+    g_hash_table_destroy(ver_pending);
+    ver_pending = NULL;
+    g_hash_table_destroy(ver_failed);
+    ver_failed = NULL;
     g_free(cache_loc);
     cache_loc = NULL;
     g_hash_table_destroy(prof_features);
@@ -355,7 +453,7 @@ caps_close(void)
 static EntityCapabilities*
 _caps_by_ver(const char* const ver)
 {
-    if (!g_key_file_has_group(cache, ver)) {
+    if (!_cache_has(ver)) {
         return NULL;
     }
 
@@ -387,10 +485,79 @@ _caps_by_ver(const char* const ver)
     return result;
 }
 
-static EntityCapabilities*
-_caps_by_jid(const char* const jid)
+static CapsEntry*
+_caps_entry_by_ver(const char* const ver)
 {
-    return g_hash_table_lookup(jid_to_caps, jid);
+    CapsEntry* entry = g_hash_table_lookup(ver_to_entry, ver);
+    if (entry) {
+        return entry;
+    }
+
+    EntityCapabilities* caps = _caps_by_ver(ver);
+    if (caps == NULL) {
+        return NULL;
+    }
+
+    entry = _caps_entry_new(caps);
+    g_hash_table_insert(ver_to_entry, strdup(ver), entry);
+
+    return entry;
+}
+
+// takes ownership of caps
+static CapsEntry*
+_caps_entry_new(EntityCapabilities* caps)
+{
+    CapsEntry* entry = malloc(sizeof(CapsEntry));
+    entry->caps = caps;
+
+    GArray* ids = g_array_new(FALSE, FALSE, sizeof(guint));
+    for (GSList* curr = caps ? caps->features : NULL; curr; curr = g_slist_next(curr)) {
+        guint id = GPOINTER_TO_UINT(g_hash_table_lookup(feature_ids, curr->data));
+        if (id == 0) {
+            id = g_hash_table_size(feature_ids) + 1;
+            g_hash_table_insert(feature_ids, strdup(curr->data), GUINT_TO_POINTER(id));
+        }
+        id--;
+        g_array_append_val(ids, id);
+    }
+
+    entry->features_words = g_hash_table_size(feature_ids) / 32 + 1;
+    entry->features = g_new0(guint32, entry->features_words);
+    for (guint i = 0; i < ids->len; i++) {
+        guint id = g_array_index(ids, guint, i);
+        entry->features[id / 32] |= 1u << (id % 32);
+    }
+    g_array_free(ids, TRUE);
+
+    return entry;
+}
+
+static void
+_caps_entry_free(CapsEntry* entry)
+{
+    if (entry) {
+        caps_destroy(entry->caps);
+        g_free(entry->features);
+        free(entry);
+    }
+}
+
+static gboolean
+_caps_entry_has_feature(CapsEntry* entry, const char* const feature)
+{
+    guint id = GPOINTER_TO_UINT(g_hash_table_lookup(feature_ids, feature));
+    if (id == 0) {
+        return FALSE;
+    }
+    id--;
+
+    // features interned after the entry was built are not in it
+    if (id / 32 >= entry->features_words) {
+        return FALSE;
+    }
+
+    return (entry->features[id / 32] & (1u << (id % 32))) != 0;
 }
 
 static EntityCapabilities*
@@ -448,8 +615,67 @@ caps_destroy(EntityCapabilities* caps)
     }
 }
 
+// the cache file is parsed on first use rather than at startup
+static void
+_load_cache(void)
+{
+    if (cache) {
+        return;
+    }
+
+    log_info("Loading capabilities cache");
+    load_data_keyfile(&caps_prof_keyfile, FILE_CAPSCACHE);
+    cache = caps_prof_keyfile.keyfile;
+
+    GStatBuf st;
+    cache_mtime = g_stat(caps_prof_keyfile.filename, &st) == 0 ? st.st_mtime : 0;
+}
+
+// other profanity instances (one per account) share the cache file, pick up
+// the entries they wrote since we last read it so neither side overwrites
+// the other's discoveries or repeats their disco#info queries
+static void
+_merge_cache(void)
+{
+    GStatBuf st;
+    if (!caps_prof_keyfile.filename || g_stat(caps_prof_keyfile.filename, &st) != 0 || st.st_mtime == cache_mtime) {
+        return;
+    }
+    cache_mtime = st.st_mtime;
+
+    GKeyFile* disk = g_key_file_new();
+    if (g_key_file_load_from_file(disk, caps_prof_keyfile.filename, G_KEY_FILE_KEEP_COMMENTS, NULL)) {
+        auto_gcharv gchar** groups = g_key_file_get_groups(disk, NULL);
+        for (int i = 0; groups[i]; i++) {
+            if (g_key_file_has_group(cache, groups[i])) {
+                continue;
+            }
+            auto_gcharv gchar** keys = g_key_file_get_keys(disk, groups[i], NULL, NULL);
+            for (int j = 0; keys && keys[j]; j++) {
+                auto_gchar gchar* value = g_key_file_get_value(disk, groups[i], keys[j], NULL);
+                if (value) {
+                    g_key_file_set_value(cache, groups[i], keys[j], value);
+                }
+            }
+        }
+    }
+    g_key_file_free(disk);
+}
+
+static gboolean
+_cache_has(const char* const ver)
+{
+    _load_cache();
+    if (g_key_file_has_group(cache, ver)) {
+        return TRUE;
+    }
+    _merge_cache();
+    return g_key_file_has_group(cache, ver);
+}
+
 static void
 _save_cache(void)
 {
+    _merge_cache();
     save_keyfile(&caps_prof_keyfile);
 }
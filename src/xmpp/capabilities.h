@@ -51,6 +51,10 @@ EntityCapabilities* caps_create(const char* const category, const char* const ty
 void caps_add_by_ver(const char* const ver, EntityCapabilities* caps);
 void caps_add_by_jid(const char* const jid, EntityCapabilities* caps);
 void caps_map_jid_to_ver(const char* const jid, const char* const ver);
+const char* caps_jid_ver(const char* const jid);
+gboolean caps_ver_request_start(const char* const ver, const char* const jid);
+void caps_ver_request_done(const char* const ver, gboolean verified);
+void caps_ver_request_cancel(const char* const ver);
 gboolean caps_cache_contains(const char* const ver);
 GList* caps_get_features(void);
 char* caps_get_my_sha1(xmpp_ctx_t* const ctx);
@@ -0,0 +1,251 @@
+/*
+ * capture.c
+ * vim: expandtab:ts=4:sts=4:sw=4
+ *
+ * Copyright (C) 2024 Michael Vetter <jubalh@iodoru.org>
+ *
+ * This file is part of Profanity.
+ *
+ * Profanity is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Profanity is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Profanity.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give permission to
+ * link the code of portions of this program with the OpenSSL library under
+ * certain conditions as described in each individual source file, and
+ * distribute linked combinations including the two.
+ *
+ * You must obey the GNU General Public License in all respects for all of the
+ * code used other than OpenSSL. If you modify file(s) with this exception, you
+ * may extend this exception to your version of the file(s), but you are not
+ * obligated to do so. If you do not wish to do so, delete this exception
+ * statement from your version. If you delete this exception statement from all
+ * source files in the program, then also delete it here.
+ *
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "common.h"
+#include "log.h"
+#include "config/files.h"
+#include "xmpp/capture.h"
+
+/*
+ * Raw stanza traffic is written to a capture file by a thread of its own, so
+ * capturing for hours doesn't slow down the client. The file starts with
+ * CAPTURE_MAGIC and then holds one frame per chunk of traffic:
+ *
+ *   8 bytes  microseconds since the epoch, big endian
+ *   1 byte   direction, CAPTURE_RECV or CAPTURE_SENT
+ *   4 bytes  payload length, big endian
+ *   payload  the XML as sent or received
+ *
+ * A file grown past CAPTURE_FILE_MAX is moved to <file>.1, replacing the
+ * previous one, and a new file is started.
+ */
+#define CAPTURE_MAGIC     "PRCAP\0\0\1"
+#define CAPTURE_MAGIC_LEN 8
+#define CAPTURE_RECV      0
+#define CAPTURE_SENT      1
+
+#define CAPTURE_FILE_MAX  (64 * 1024 * 1024)
+// frames queued beyond this are dropped rather than held in memory
+#define CAPTURE_QUEUE_MAX 10000
+
+typedef struct capture_frame_t
+{
+    gint64 time;
+    guint8 direction;
+    guint32 len;
+    char data[];
+} CaptureFrame;
+
+static GThread* capture_thread;
+static GAsyncQueue* capture_queue;
+static CaptureFrame capture_stop_frame;
+static gchar* capture_path;
+// only touched by the capture thread while it runs
+static FILE* capture_file;
+static gint64 capture_size;
+static guint64 capture_dropped;
+
+static gboolean
+_capture_open(void)
+{
+    capture_file = g_fopen(capture_path, "wb");
+    if (!capture_file) {
+        return FALSE;
+    }
+    capture_size = fwrite(CAPTURE_MAGIC, 1, CAPTURE_MAGIC_LEN, capture_file);
+    return TRUE;
+}
+
+static void
+_capture_rotate(void)
+{
+    fclose(capture_file);
+    capture_file = NULL;
+
+    auto_gchar gchar* previous = g_strdup_printf("%s.1", capture_path);
+    if (g_rename(capture_path, previous) != 0) {
+        log_warning("Stanza capture: could not rotate %s", capture_path);
+    }
+    if (!_capture_open()) {
+        log_error("Stanza capture: could not reopen %s", capture_path);
+    }
+}
+
+static void
+_capture_write(CaptureFrame* frame)
+{
+    guint8 header[13];
+    guint64 time = GUINT64_TO_BE((guint64)frame->time);
+    guint32 len = GUINT32_TO_BE(frame->len);
+    memcpy(header, &time, 8);
+    header[8] = frame->direction;
+    memcpy(header + 9, &len, 4);
+
+    fwrite(header, 1, sizeof(header), capture_file);
+    fwrite(frame->data, 1, frame->len, capture_file);
+    capture_size += sizeof(header) + frame->len;
+}
+
+static gpointer
+_capture_run(gpointer data)
+{
+    while (TRUE) {
+        CaptureFrame* frame = g_async_queue_pop(capture_queue);
+        if (frame == &capture_stop_frame) {
+            break;
+        }
+        if (capture_file) {
+            _capture_write(frame);
+            if (capture_size >= CAPTURE_FILE_MAX) {
+                _capture_rotate();
+            }
+        }
+        g_free(frame);
+
+        // flush once the queue has drained, not for every frame
+        if (capture_file && g_async_queue_length(capture_queue) == 0) {
+            fflush(capture_file);
+        }
+    }
+
+    if (capture_file) {
+        fclose(capture_file);
+        capture_file = NULL;
+    }
+
+    return NULL;
+}
+
+gboolean
+capture_start(void)
+{
+    if (capture_thread) {
+        return TRUE;
+    }
+
+    auto_gchar gchar* logs_dir = files_get_data_path("logs");
+    if (!create_dir(logs_dir)) {
+        return FALSE;
+    }
+    g_free(capture_path);
+    capture_path = g_strdup_printf("%s/stanzas%d.cap", logs_dir, getpid());
+
+    if (!_capture_open()) {
+        log_error("Stanza capture: could not open %s", capture_path);
+        return FALSE;
+    }
+
+    capture_dropped = 0;
+    capture_queue = g_async_queue_new();
+    capture_thread = g_thread_new("stanza-capture", _capture_run, NULL);
+    log_info("Stanza capture started: %s", capture_path);
+
+    return TRUE;
+}
+
+// writes out everything still queued before returning
+void
+capture_stop(void)
+{
+    if (!capture_thread) {
+        return;
+    }
+
+    g_async_queue_push(capture_queue, &capture_stop_frame);
+    g_thread_join(capture_thread);
+    capture_thread = NULL;
+
+    g_async_queue_unref(capture_queue);
+    capture_queue = NULL;
+
+    if (capture_dropped > 0) {
+        log_warning("Stanza capture: %" G_GUINT64_FORMAT " chunks dropped, the writer couldn't keep up", capture_dropped);
+    }
+    log_info("Stanza capture stopped: %s", capture_path);
+}
+
+gboolean
+capture_active(void)
+{
+    return capture_thread != NULL;
+}
+
+const char*
+capture_get_path(void)
+{
+    return capture_path;
+}
+
+// called with every libstrophe log line, picks out the raw traffic
+void
+capture_log(const char* const msg)
+{
+    if (!capture_thread || !msg) {
+        return;
+    }
+
+    guint8 direction;
+    if (g_str_has_prefix(msg, "RECV: ")) {
+        direction = CAPTURE_RECV;
+    } else if (g_str_has_prefix(msg, "SENT: ")) {
+        direction = CAPTURE_SENT;
+    } else {
+        return;
+    }
+
+    if (g_async_queue_length(capture_queue) >= CAPTURE_QUEUE_MAX) {
+        capture_dropped++;
+        return;
+    }
+
+    const char* payload = msg + strlen("RECV: ");
+    size_t len = strlen(payload);
+
+    CaptureFrame* frame = g_malloc(sizeof(CaptureFrame) + len);
+    frame->time = g_get_real_time();
+    frame->direction = direction;
+    frame->len = len;
+    memcpy(frame->data, payload, len);
+    g_async_queue_push(capture_queue, frame);
+}
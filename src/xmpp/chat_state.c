@@ -51,6 +51,14 @@
 #define INACTIVE_TIMEOUT 30.0
 
 static void _send_if_supported(const char* const barejid, void (*send_func)(const char* const));
+static void _chat_state_transition(const char* const barejid, ChatState* state);
+static void _chat_state_schedule(const char* const barejid, ChatState* state);
+
+// Only states with a transition ahead of them are tracked, each with the time
+// it is next due. chat_state_idle() returns straight away until the earliest
+// one is reached, and then only touches the states that are due.
+static GHashTable* pending = NULL; // ChatState* to its barejid
+static gint64 next_deadline = 0;
 
 ChatState*
 chat_state_new(void)
@@ -58,6 +66,7 @@ chat_state_new(void)
     ChatState* new_state = malloc(sizeof(struct prof_chat_state_t));
     new_state->type = CHAT_STATE_GONE;
     new_state->timer = g_timer_new();
+    new_state->deadline = 0;
 
     return new_state;
 }
@@ -65,6 +74,9 @@ chat_state_new(void)
 void
 chat_state_free(ChatState* state)
 {
+    if (pending && state) {
+        g_hash_table_remove(pending, state);
+    }
     if (state && state->timer != NULL) {
         g_timer_destroy(state->timer);
     }
@@ -73,6 +85,13 @@ chat_state_free(ChatState* state)
 
 void
 chat_state_handle_idle(const char* const barejid, ChatState* state)
+{
+    _chat_state_transition(barejid, state);
+    _chat_state_schedule(barejid, state);
+}
+
+static void
+_chat_state_transition(const char* const barejid, ChatState* state)
 {
     gdouble elapsed = g_timer_elapsed(state->timer, NULL);
 
@@ -132,14 +151,16 @@ chat_state_handle_typing(const char* const barejid, ChatState* state)
         if (prefs_get_boolean(PREF_STATES) && prefs_get_boolean(PREF_OUTTYPE)) {
             _send_if_supported(barejid, message_send_composing);
         }
+        _chat_state_schedule(barejid, state);
     }
 }
 
 void
-chat_state_active(ChatState* state)
+chat_state_active(const char* const barejid, ChatState* state)
 {
     state->type = CHAT_STATE_ACTIVE;
     g_timer_start(state->timer);
+    _chat_state_schedule(barejid, state);
 }
 
 void
@@ -151,6 +172,7 @@ chat_state_gone(const char* const barejid, ChatState* state)
         }
         state->type = CHAT_STATE_GONE;
         g_timer_start(state->timer);
+        _chat_state_schedule(barejid, state);
     }
 }
 
@@ -158,21 +180,80 @@ void
 chat_state_idle(void)
 {
     jabber_conn_status_t status = connection_get_status();
-    if (status == JABBER_CONNECTED) {
-        GSList* recipients = wins_get_chat_recipients();
-        GSList* curr = recipients;
-
-        while (curr) {
-            char* barejid = curr->data;
-            ProfChatWin* chatwin = wins_get_chat(barejid);
-            chat_state_handle_idle(chatwin->barejid, chatwin->state);
-            curr = g_slist_next(curr);
+    if (status != JABBER_CONNECTED || pending == NULL) {
+        return;
+    }
+
+    gint64 now = g_get_monotonic_time();
+    if (now < next_deadline) {
+        return;
+    }
+
+    // collect first, handling a state reschedules it in pending
+    GSList* due = NULL;
+    next_deadline = G_MAXINT64;
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, pending);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        ChatState* state = key;
+        if (state->deadline <= now) {
+            due = g_slist_prepend(due, state);
+        } else {
+            next_deadline = MIN(next_deadline, state->deadline);
         }
+    }
 
-        if (recipients) {
-            g_slist_free(recipients);
+    for (GSList* curr = due; curr; curr = g_slist_next(curr)) {
+        ChatState* state = curr->data;
+        auto_gchar gchar* barejid = g_strdup(g_hash_table_lookup(pending, state));
+        if (barejid) {
+            chat_state_handle_idle(barejid, state);
+        }
+    }
+    g_slist_free(due);
+}
+
+// work out when the state's next idle transition is due
+static void
+_chat_state_schedule(const char* const barejid, ChatState* state)
+{
+    gdouble timeout;
+    switch (state->type) {
+    case CHAT_STATE_COMPOSING:
+        timeout = PAUSED_TIMEOUT;
+        break;
+    case CHAT_STATE_PAUSED:
+    case CHAT_STATE_ACTIVE:
+        timeout = INACTIVE_TIMEOUT;
+        break;
+    case CHAT_STATE_INACTIVE:
+        // with gone disabled, look again now and then in case it gets set
+        timeout = prefs_get_gone() != 0 ? prefs_get_gone() * 60.0 : INACTIVE_TIMEOUT;
+        break;
+    default:
+        if (pending) {
+            g_hash_table_remove(pending, state);
         }
+        state->deadline = 0;
+        return;
+    }
+
+    gint64 now = g_get_monotonic_time();
+    gdouble remaining = timeout - g_timer_elapsed(state->timer, NULL);
+    if (remaining <= 0) {
+        // due but held back, e.g. by a resource override
+        remaining = INACTIVE_TIMEOUT;
+    }
+    state->deadline = now + (gint64)(remaining * G_USEC_PER_SEC) + 1;
+
+    if (pending == NULL) {
+        pending = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+    }
+    if (!g_hash_table_contains(pending, state)) {
+        g_hash_table_insert(pending, state, g_strdup(barejid));
     }
+    next_deadline = MIN(next_deadline, state->deadline);
 }
 
 void
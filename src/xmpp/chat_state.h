@@ -50,6 +50,7 @@ typedef struct prof_chat_state_t
 {
     chat_state_type_t type;
     GTimer* timer;
+    gint64 deadline; // monotonic time the next idle transition is due, 0 when none
 } ChatState;
 
 ChatState* chat_state_new(void);
@@ -60,7 +61,7 @@ void chat_state_activity(void);
 
 void chat_state_handle_idle(const char* const barejid, ChatState* state);
 void chat_state_handle_typing(const char* const barejid, ChatState* state);
-void chat_state_active(ChatState* state);
+void chat_state_active(const char* const barejid, ChatState* state);
 void chat_state_gone(const char* const barejid, ChatState* state);
 
 #endif
@@ -39,6 +39,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <sys/socket.h>
+#include <netdb.h>
 
 #include <glib.h>
 #include <glib/gstdio.h>
@@ -47,9 +49,11 @@
 
 #include "common.h"
 #include "log.h"
+#include "stats.h"
 #include "config/files.h"
 #include "config/preferences.h"
 #include "event/server_events.h"
+#include "xmpp/capture.h"
 #include "xmpp/connection.h"
 #include "xmpp/session.h"
 #include "xmpp/stanza.h"
@@ -61,6 +65,11 @@ typedef struct prof_conn_t
     xmpp_ctx_t* xmpp_ctx;
     xmpp_conn_t* xmpp_conn;
     xmpp_sm_state_t* sm_state;
+    gboolean sm_resuming;
+    gboolean sm_resumed;
+    gboolean sm_enabled;
+    gboolean sm_known;
+    gboolean csi_inactive;
     char** queued_messages;
     gboolean xmpp_in_event_loop;
     jabber_conn_status_t conn_status;
@@ -71,6 +80,9 @@ typedef struct prof_conn_t
     Jid* jid;
     GHashTable* available_resources;
     GHashTable* features_by_jid;
+    // feature to the first jid that offers it, so lookups don't go through
+    // every service
+    GHashTable* feature_jids;
     GHashTable* requested_features;
 } ProfConnection;
 
@@ -80,7 +92,29 @@ typedef struct
     const char* password;
 } prof_reg_t;
 
+// stanzas collected in one main loop iteration are handed to libstrophe as a
+// single write once they reach this size, even before the loop goes idle
+#define SEND_BATCH_MAX (64 * 1024)
+
+// how long the address of the last successful connection is tried before
+// resolving the server again
+#define ENDPOINT_CACHE_TTL (60 * 60 * G_USEC_PER_SEC)
+
+typedef struct
+{
+    gchar* barejid;
+    gchar* host;
+    int port;
+    gint64 expires;
+} ProfEndpoint;
+
 static ProfConnection conn;
+static ProfEndpoint endpoint;
+static gboolean endpoint_used = FALSE;
+static int conn_sock = -1;
+static guint socket_watch = 0;
+static guint flush_source = 0;
+static GString* send_batch = NULL;
 static gchar* profanity_instance_id = NULL;
 static gchar* prof_identifier = NULL;
 
@@ -91,10 +125,22 @@ static void _connection_handler(xmpp_conn_t* const xmpp_conn, const xmpp_conn_ev
 
 static TLSCertificate* _xmppcert_to_profcert(const xmpp_tlscert_t* xmpptlscert);
 static int _connection_certfail_cb(const xmpp_tlscert_t* xmpptlscert, const char* errormsg);
+static int _connection_sockopt_cb(xmpp_conn_t* xmpp_conn, void* sock);
+static gboolean _connection_socket_cb(GIOChannel* source, GIOCondition condition, gpointer data);
+static void _connection_unwatch_socket(void);
+static void _connection_run_events(unsigned long timeout);
+static gboolean _connection_flush_cb(gpointer data);
+static int _connection_sm_resumed_cb(xmpp_conn_t* const xmpp_conn, xmpp_stanza_t* const stanza, void* const userdata);
+static int _connection_sm_enabled_cb(xmpp_conn_t* const xmpp_conn, xmpp_stanza_t* const stanza, void* const userdata);
+static int _connection_sm_known_cb(xmpp_conn_t* const xmpp_conn, xmpp_stanza_t* const stanza, void* const userdata);
+static void _connection_send_batch_flush(void);
+static gboolean _connection_sm_settle_cb(gpointer data);
 
 static void _random_bytes_init(void);
 static void _random_bytes_close(void);
 static void _compute_identifier(const char* barejid);
+static void _endpoint_save(void);
+static void _endpoint_clear(void);
 
 static void*
 _xmalloc(size_t size, void* userdata)
@@ -130,6 +176,11 @@ connection_init(void)
 {
     xmpp_initialize();
     conn.sm_state = NULL;
+    conn.sm_resuming = FALSE;
+    conn.sm_resumed = FALSE;
+    conn.sm_enabled = FALSE;
+    conn.sm_known = FALSE;
+    conn.csi_inactive = FALSE;
     conn.queued_messages = NULL;
     conn.xmpp_in_event_loop = FALSE;
     conn.conn_status = JABBER_DISCONNECTED;
@@ -139,6 +190,7 @@ connection_init(void)
     conn.jid = NULL;
     conn.features_by_jid = NULL;
     conn.available_resources = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)resource_destroy);
+    conn.feature_jids = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
     conn.requested_features = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
 
     conn.xmpp_ctx = xmpp_ctx_new(&prof_mem, &prof_log);
@@ -155,17 +207,146 @@ connection_init(void)
     _random_bytes_init();
 }
 
-void
-connection_check_events(void)
+static void
+_connection_run_events(unsigned long timeout)
 {
+    _connection_send_batch_flush();
     conn.xmpp_in_event_loop = TRUE;
-    xmpp_run_once(conn.xmpp_ctx, 10);
+    xmpp_run_once(conn.xmpp_ctx, timeout);
     conn.xmpp_in_event_loop = FALSE;
 }
 
+// Incoming data is handled from the socket watch as soon as it arrives, the
+// main loop tick only needs to flush the send queue and run libstrophe's
+// timed handlers, so never block in here.
+void
+connection_check_events(void)
+{
+    _connection_run_events(0);
+}
+
+// libstrophe only writes out its send queue from xmpp_run_once(), so after
+// queueing a stanza ask for one non-blocking run once the main loop is idle.
+// Several stanzas sent in the same iteration share that run.
+void
+connection_schedule_flush(void)
+{
+    if (flush_source == 0) {
+        flush_source = g_idle_add(_connection_flush_cb, NULL);
+    }
+}
+
+static gboolean
+_connection_flush_cb(gpointer data)
+{
+    flush_source = 0;
+    if (!conn.xmpp_in_event_loop) {
+        _connection_run_events(0);
+    } else {
+        _connection_send_batch_flush();
+    }
+
+    return FALSE;
+}
+
+// XEP-0198 acks count the elements in libstrophe's send queue, so stanzas may
+// only share a queue element when stream management is known to be off
+static gboolean
+_connection_can_batch(void)
+{
+    return conn.conn_status == JABBER_CONNECTED && conn.sm_known && !conn.sm_enabled;
+}
+
+static void
+_connection_send_batch_flush(void)
+{
+    if (send_batch && send_batch->len > 0) {
+        xmpp_send_raw(conn.xmpp_conn, send_batch->str, send_batch->len);
+        g_string_truncate(send_batch, 0);
+    }
+}
+
+static void
+_connection_send_batch_drop(void)
+{
+    if (send_batch) {
+        g_string_free(send_batch, TRUE);
+        send_batch = NULL;
+    }
+}
+
+// Serialised stanzas sent during one main loop iteration are collected and
+// written out together when the loop goes idle, a burst of presences or
+// message receipts then costs one TLS record and one write instead of one each.
+void
+connection_send_raw(const char* const text)
+{
+    if (_connection_can_batch()) {
+        if (!send_batch) {
+            send_batch = g_string_sized_new(4096);
+        }
+        g_string_append(send_batch, text);
+        if (send_batch->len >= SEND_BATCH_MAX) {
+            _connection_send_batch_flush();
+        }
+    } else {
+        _connection_send_batch_flush();
+        xmpp_send_raw(conn.xmpp_conn, text, strlen(text));
+    }
+    connection_schedule_flush();
+}
+
+static int
+_connection_sockopt_cb(xmpp_conn_t* xmpp_conn, void* sock)
+{
+    _connection_unwatch_socket();
+
+    conn_sock = *(int*)sock;
+    GIOChannel* channel = g_io_channel_unix_new(conn_sock);
+    socket_watch = g_io_add_watch(channel, G_IO_IN | G_IO_PRI | G_IO_ERR | G_IO_HUP | G_IO_NVAL, _connection_socket_cb, NULL);
+    g_io_channel_unref(channel);
+
+    return xmpp_sockopt_cb_keepalive(xmpp_conn, sock);
+}
+
+static gboolean
+_connection_socket_cb(GIOChannel* source, GIOCondition condition, gpointer data)
+{
+    if (!conn.xmpp_in_event_loop) {
+        stats_latency_begin(STATS_TIMER_STANZA_TO_SCREEN);
+        gint64 start = stats_trace_begin();
+        _connection_run_events(0);
+        stats_span("xmpp_socket", start);
+        ui_mark_dirty();
+    }
+
+    if (condition & (G_IO_ERR | G_IO_HUP | G_IO_NVAL)) {
+        socket_watch = 0;
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static void
+_connection_unwatch_socket(void)
+{
+    if (socket_watch) {
+        g_source_remove(socket_watch);
+        socket_watch = 0;
+    }
+    conn_sock = -1;
+}
+
 void
 connection_shutdown(void)
 {
+    _connection_unwatch_socket();
+    if (flush_source) {
+        g_source_remove(flush_source);
+        flush_source = 0;
+    }
+    _connection_send_batch_drop();
     connection_clear_data();
     if (conn.xmpp_conn) {
         xmpp_conn_release(conn.xmpp_conn);
@@ -176,7 +357,9 @@ connection_shutdown(void)
         conn.xmpp_ctx = NULL;
     }
     xmpp_shutdown();
+    capture_stop();
 
+    _endpoint_clear();
     _random_bytes_close();
 }
 
@@ -244,10 +427,22 @@ _conn_apply_settings(const char* const jid, const char* const passwd, const char
     }
 
     xmpp_conn_set_certfail_handler(conn.xmpp_conn, _connection_certfail_cb);
+    xmpp_conn_set_sockopt_callback(conn.xmpp_conn, _connection_sockopt_cb);
+    conn.sm_resuming = FALSE;
+    conn.sm_resumed = FALSE;
+    conn.sm_enabled = FALSE;
+    conn.sm_known = FALSE;
+    xmpp_handler_delete(conn.xmpp_conn, _connection_sm_enabled_cb);
+    xmpp_handler_delete(conn.xmpp_conn, _connection_sm_known_cb);
+    xmpp_handler_add(conn.xmpp_conn, _connection_sm_enabled_cb, STANZA_NS_STREAM_MANAGEMENT, STANZA_NAME_ENABLED, NULL, NULL);
+    xmpp_handler_add(conn.xmpp_conn, _connection_sm_known_cb, NULL, STANZA_NAME_IQ, NULL, NULL);
     if (conn.sm_state) {
         if (xmpp_conn_set_sm_state(conn.xmpp_conn, conn.sm_state)) {
             log_warning("Had Stream Management state, but libstrophe didn't accept it");
             xmpp_free_sm_state(conn.sm_state);
+        } else {
+            conn.sm_resuming = TRUE;
+            xmpp_handler_add(conn.xmpp_conn, _connection_sm_resumed_cb, STANZA_NS_STREAM_MANAGEMENT, STANZA_NAME_RESUMED, NULL, NULL);
         }
         conn.sm_state = NULL;
     }
@@ -265,9 +460,24 @@ connection_connect(const char* const jid, const char* const passwd, const char*
 
     _conn_apply_settings(jid, passwd, tls_policy, auth_policy);
 
+    // skip SRV and address lookups when reconnecting to the server we were
+    // just talking to, libstrophe still verifies the certificate against
+    // the JID's domain
+    const char* host = altdomain;
+    endpoint_used = FALSE;
+    if (!altdomain && endpoint.host) {
+        auto_jid Jid* jidp = jid_create(jid);
+        if (jidp && g_strcmp0(jidp->barejid, endpoint.barejid) == 0 && g_get_monotonic_time() < endpoint.expires) {
+            log_debug("Connecting to last known address %s:%d", endpoint.host, endpoint.port);
+            host = endpoint.host;
+            port = endpoint.port;
+            endpoint_used = TRUE;
+        }
+    }
+
     int connect_status = xmpp_connect_client(
         conn.xmpp_conn,
-        altdomain,
+        host,
         port,
         _connection_handler,
         conn.xmpp_ctx);
@@ -545,15 +755,18 @@ connection_disconnect(void)
     // or we get infinite loop otherwise
     if (conn.conn_last_event == XMPP_CONN_CONNECT) {
         conn.conn_status = JABBER_DISCONNECTING;
+        _connection_send_batch_flush();
         xmpp_disconnect(conn.xmpp_conn);
 
         while (conn.conn_status == JABBER_DISCONNECTING) {
-            session_process_events();
+            _connection_run_events(10);
         }
     } else {
         conn.conn_status = JABBER_DISCONNECTED;
     }
 
+    _connection_unwatch_socket();
+
     // can't free libstrophe objects while we're in the event loop
     if (!conn.xmpp_in_event_loop) {
         if (conn.xmpp_conn) {
@@ -569,6 +782,70 @@ connection_disconnect(void)
     conn.jid = NULL;
 }
 
+gboolean
+connection_sm_resumable(void)
+{
+    return conn.sm_state != NULL;
+}
+
+static int
+_connection_sm_resumed_cb(xmpp_conn_t* const xmpp_conn, xmpp_stanza_t* const stanza, void* const userdata)
+{
+    log_debug("Connection handler: Stream Management session resumed");
+    conn.sm_resumed = TRUE;
+    conn.sm_enabled = TRUE;
+
+    return 0;
+}
+
+static int
+_connection_sm_enabled_cb(xmpp_conn_t* const xmpp_conn, xmpp_stanza_t* const stanza, void* const userdata)
+{
+    log_debug("Connection handler: Stream Management enabled, sending stanzas unbatched");
+    conn.sm_enabled = TRUE;
+
+    return 0;
+}
+
+// <enable/> goes out before any of our own requests and the server answers in
+// order, so once the first of our iqs is answered an <enabled/> would have
+// arrived already
+static int
+_connection_sm_known_cb(xmpp_conn_t* const xmpp_conn, xmpp_stanza_t* const stanza, void* const userdata)
+{
+    const char* type = xmpp_stanza_get_type(stanza);
+    if (g_strcmp0(type, STANZA_TYPE_RESULT) != 0 && g_strcmp0(type, STANZA_TYPE_ERROR) != 0) {
+        return 1;
+    }
+
+    conn.sm_known = TRUE;
+
+    return 0;
+}
+
+// libstrophe raises XMPP_CONN_CONNECT from within its own handling of
+// <resumed/>, so whether the old session survived is only known once that
+// read has been processed completely
+static gboolean
+_connection_sm_settle_cb(gpointer data)
+{
+    if (conn.conn_status != JABBER_CONNECTED || !conn.sm_resuming) {
+        return FALSE;
+    }
+
+    conn.sm_resuming = FALSE;
+    xmpp_handler_delete(conn.xmpp_conn, _connection_sm_resumed_cb);
+
+    if (conn.sm_resumed) {
+        session_login_resumed(connection_is_secured());
+    } else {
+        log_debug("Connection handler: Stream Management session could not be resumed");
+        session_login_sync(connection_is_secured());
+    }
+
+    return FALSE;
+}
+
 void
 connection_set_disconnected(void)
 {
@@ -589,6 +866,10 @@ connection_clear_data(void)
         g_hash_table_remove_all(conn.available_resources);
     }
 
+    if (conn.feature_jids) {
+        g_hash_table_remove_all(conn.feature_jids);
+    }
+
     if (conn.requested_features) {
         g_hash_table_remove_all(conn.requested_features);
     }
@@ -620,58 +901,40 @@ connection_send_stanza(const char* const stanza)
     if (conn.conn_status != JABBER_CONNECTED) {
         return FALSE;
     } else {
-        xmpp_send_raw_string(conn.xmpp_conn, "%s", stanza);
+        connection_send_raw(stanza);
         return TRUE;
     }
 }
 
-gboolean
-connection_supports(const char* const feature)
+// XEP-0352, tell the server whether the user is looking so it can hold back
+// presence and chat state updates while they are not
+void
+connection_set_csi(gboolean active)
 {
-    gboolean ret = FALSE;
-    GList* jids = g_hash_table_get_keys(conn.features_by_jid);
-
-    GList* curr = jids;
-    while (curr) {
-        char* jid = curr->data;
-        GHashTable* features = g_hash_table_lookup(conn.features_by_jid, jid);
-        if (features && g_hash_table_lookup(features, feature)) {
-            ret = TRUE;
-            break;
-        }
-
-        curr = g_list_next(curr);
+    if (conn.conn_status != JABBER_CONNECTED || conn.csi_inactive == !active) {
+        return;
     }
 
-    g_list_free(jids);
+    log_debug("Client state indication: %s", active ? STANZA_NAME_ACTIVE : STANZA_NAME_INACTIVE);
+    conn.csi_inactive = !active;
 
-    return ret;
+    xmpp_stanza_t* csi = stanza_create_csi(conn.xmpp_ctx, active);
+    _connection_send_batch_flush();
+    xmpp_send(conn.xmpp_conn, csi);
+    xmpp_stanza_release(csi);
+    connection_schedule_flush();
+}
+
+gboolean
+connection_supports(const char* const feature)
+{
+    return g_hash_table_contains(conn.feature_jids, feature);
 }
 
 const char*
 connection_jid_for_feature(const char* const feature)
 {
-    if (conn.features_by_jid == NULL) {
-        return NULL;
-    }
-
-    GList* jids = g_hash_table_get_keys(conn.features_by_jid);
-
-    GList* curr = jids;
-    while (curr) {
-        char* jid = curr->data;
-        GHashTable* features = g_hash_table_lookup(conn.features_by_jid, jid);
-        if (features && g_hash_table_lookup(features, feature)) {
-            g_list_free(jids);
-            return jid;
-        }
-
-        curr = g_list_next(curr);
-    }
-
-    g_list_free(jids);
-
-    return NULL;
+    return g_hash_table_lookup(conn.feature_jids, feature);
 }
 
 void
@@ -775,6 +1038,19 @@ void
 connection_features_received(const char* const jid)
 {
     log_info("[CONNECTION] connection_features_received %s", jid);
+
+    GHashTable* features = connection_get_features(jid);
+    if (features) {
+        GHashTableIter iter;
+        gpointer feature;
+        g_hash_table_iter_init(&iter, features);
+        while (g_hash_table_iter_next(&iter, &feature, NULL)) {
+            if (!g_hash_table_contains(conn.feature_jids, feature)) {
+                g_hash_table_insert(conn.feature_jids, strdup(feature), strdup(jid));
+            }
+        }
+    }
+
     if (g_hash_table_remove(conn.requested_features, jid) && g_hash_table_size(conn.requested_features) == 0) {
         sv_ev_connection_features_received();
     }
@@ -973,12 +1249,21 @@ _connection_handler(xmpp_conn_t* const xmpp_conn, const xmpp_conn_event_t status
 
         connection_get_jid();
         conn.domain = strdup(conn.jid->domainpart);
+        _endpoint_save();
 
         connection_clear_data();
         conn.features_by_jid = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)g_hash_table_destroy);
         g_hash_table_insert(conn.features_by_jid, strdup(conn.domain), g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL));
 
-        session_login_success(connection_is_secured());
+        if (conn.sm_resuming) {
+            // handlers must be in place before the server replays what we missed
+            session_login_handlers();
+            g_idle_add(_connection_sm_settle_cb, NULL);
+        } else {
+            // a resumed stream keeps its client state, a new one starts active
+            conn.csi_inactive = FALSE;
+            session_login_success(connection_is_secured());
+        }
 
         if (conn.queued_messages) {
             for (size_t n = 0; conn.queued_messages[n] != NULL; ++n) {
@@ -1012,6 +1297,10 @@ _connection_handler(xmpp_conn_t* const xmpp_conn, const xmpp_conn_event_t status
     // disconnected
     case XMPP_CONN_DISCONNECT:
         log_debug("Connection handler: XMPP_CONN_DISCONNECT");
+        conn.sm_known = FALSE;
+        if (send_batch) {
+            g_string_truncate(send_batch, 0);
+        }
 
         // lost connection for unknown reason
         if (conn.conn_status == JABBER_CONNECTED || conn.conn_status == JABBER_DISCONNECTING) {
@@ -1021,7 +1310,7 @@ _connection_handler(xmpp_conn_t* const xmpp_conn, const xmpp_conn_event_t status
                 conn.sm_state = xmpp_conn_get_sm_state(conn.xmpp_conn);
                 if (send_queue_len > 0 && prefs_get_boolean(PREF_STROPHE_SM_RESEND)) {
                     conn.queued_messages = calloc(send_queue_len + 1, sizeof(*conn.queued_messages));
-                    for (int n = 0; n < send_queue_len && conn.queued_messages[n]; ++n) {
+                    for (int n = 0; n < send_queue_len; ++n) {
                         conn.queued_messages[n] = xmpp_conn_send_queue_drop_element(conn.xmpp_conn, XMPP_QUEUE_OLDEST);
                     }
                 } else if (send_queue_len > 0) {
@@ -1041,7 +1330,15 @@ _connection_handler(xmpp_conn_t* const xmpp_conn, const xmpp_conn_event_t status
                 conn.conn_status = JABBER_RECONNECT;
                 return;
             }
+            if (endpoint_used && session_get_account_name()) {
+                // the server may have moved, retry with a fresh lookup
+                log_debug("Connection handler: Last known address failed, resolving again");
+                _endpoint_clear();
+                conn.conn_status = JABBER_RECONNECT;
+                return;
+            }
             log_debug("Connection handler: Login failed");
+            _endpoint_clear();
             session_login_failed();
         }
 
@@ -1111,6 +1408,7 @@ _xmpp_file_logger(void* const userdata, const xmpp_log_level_t xmpp_level, const
         break;
     }
 
+    capture_log(msg);
     log_msg(prof_level, area, msg);
 
     if ((g_strcmp0(area, "xmpp") == 0) || (g_strcmp0(area, "conn")) == 0) {
@@ -1152,6 +1450,34 @@ _compute_identifier(const char* barejid)
                                                 barejid, strlen(barejid));
 }
 
+static void
+_endpoint_save(void)
+{
+    struct sockaddr_storage addr;
+    socklen_t len = sizeof(addr);
+    char host[NI_MAXHOST];
+    char port[NI_MAXSERV];
+
+    _endpoint_clear();
+    if (conn_sock < 0 || getpeername(conn_sock, (struct sockaddr*)&addr, &len) != 0
+        || getnameinfo((struct sockaddr*)&addr, len, host, sizeof(host), port, sizeof(port), NI_NUMERICHOST | NI_NUMERICSERV) != 0) {
+        return;
+    }
+
+    endpoint.barejid = g_strdup(conn.jid->barejid);
+    endpoint.host = g_strdup(host);
+    endpoint.port = atoi(port);
+    endpoint.expires = g_get_monotonic_time() + ENDPOINT_CACHE_TTL;
+}
+
+static void
+_endpoint_clear(void)
+{
+    g_free(endpoint.barejid);
+    g_free(endpoint.host);
+    memset(&endpoint, 0, sizeof(endpoint));
+}
+
 const char*
 connection_get_profanity_identifier(void)
 {
@@ -43,6 +43,8 @@
 void connection_init(void);
 void connection_shutdown(void);
 void connection_check_events(void);
+void connection_schedule_flush(void);
+void connection_send_raw(const char* const text);
 
 jabber_conn_status_t connection_connect(const char* const fulljid, const char* const passwd, const char* const altdomain, int port,
                                         const char* const tls_policy, const char* const auth_policy);
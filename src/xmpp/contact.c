@@ -52,15 +52,21 @@ struct p_contact_t
     gchar* barejid_collate_key;
     char* name;
     gchar* name_collate_key;
+    const char* sort_key; // name_collate_key, or barejid_collate_key when unnamed
     GSList* groups;
     char* subscription;
     char* offline_message;
     gboolean pending_out;
     GDateTime* last_activity;
     GHashTable* available_resources;
+    Resource* best_resource; // most available resource, NULL when offline
+    int presence_weight;     // roster ordering of best_resource, lowest first
     Autocomplete resource_ac;
 };
 
+static void _update_best_resource(PContact contact);
+static int _presence_weight(Resource* resource);
+
 PContact
 p_contact_new(const char* const barejid, const char* const name,
               GSList* groups, const char* const subscription,
@@ -77,6 +83,7 @@ p_contact_new(const char* const barejid, const char* const name,
         contact->name = NULL;
         contact->name_collate_key = NULL;
     }
+    contact->sort_key = contact->name_collate_key ? contact->name_collate_key : contact->barejid_collate_key;
 
     contact->groups = groups;
 
@@ -95,6 +102,8 @@ p_contact_new(const char* const barejid, const char* const name,
 
     contact->available_resources = g_hash_table_new_full(g_str_hash, g_str_equal, free,
                                                          (GDestroyNotify)resource_destroy);
+    contact->best_resource = NULL;
+    contact->presence_weight = _presence_weight(NULL);
 
     contact->resource_ac = autocomplete_new();
 
@@ -110,6 +119,7 @@ p_contact_set_name(const PContact contact, const char* const name)
         contact->name = strdup(name);
         contact->name_collate_key = g_utf8_collate_key(contact->name, -1);
     }
+    contact->sort_key = contact->name_collate_key ? contact->name_collate_key : contact->barejid_collate_key;
 }
 
 void
@@ -148,6 +158,9 @@ p_contact_remove_resource(PContact contact, const char* const resource)
 {
     gboolean result = g_hash_table_remove(contact->available_resources, resource);
     autocomplete_remove(contact->resource_ac, resource);
+    if (result) {
+        _update_best_resource(contact);
+    }
 
     return result;
 }
@@ -203,6 +216,18 @@ p_contact_name_collate_key(const PContact contact)
     return contact->name_collate_key;
 }
 
+const char*
+p_contact_sort_key(const PContact contact)
+{
+    return contact->sort_key;
+}
+
+int
+p_contact_presence_weight(const PContact contact)
+{
+    return contact->presence_weight;
+}
+
 const char*
 p_contact_name_or_jid(const PContact contact)
 {
@@ -289,19 +314,53 @@ _get_most_available_resource(PContact contact)
     return highest;
 }
 
+// resources only change through p_contact_set_presence and
+// p_contact_remove_resource, the roster sorts and draws from this
+static void
+_update_best_resource(PContact contact)
+{
+    if (g_hash_table_size(contact->available_resources) == 0) {
+        contact->best_resource = NULL;
+    } else {
+        contact->best_resource = _get_most_available_resource(contact);
+    }
+    contact->presence_weight = _presence_weight(contact->best_resource);
+}
+
+static int
+_presence_weight(Resource* resource)
+{
+    if (!resource) {
+        return 5;
+    }
+
+    switch (resource->presence) {
+    case RESOURCE_CHAT:
+        return 0;
+    case RESOURCE_ONLINE:
+        return 1;
+    case RESOURCE_AWAY:
+        return 2;
+    case RESOURCE_XA:
+        return 3;
+    case RESOURCE_DND:
+        return 4;
+    default:
+        return 5;
+    }
+}
+
 const char*
 p_contact_presence(const PContact contact)
 {
     assert(contact != NULL);
 
     // no available resources, offline
-    if (g_hash_table_size(contact->available_resources) == 0) {
+    if (!contact->best_resource) {
         return "offline";
     }
 
-    Resource* resource = _get_most_available_resource(contact);
-
-    return string_from_resource_presence(resource->presence);
+    return string_from_resource_presence(contact->best_resource->presence);
 }
 
 const char*
@@ -310,13 +369,11 @@ p_contact_status(const PContact contact)
     assert(contact != NULL);
 
     // no available resources, use offline message
-    if (g_hash_table_size(contact->available_resources) == 0) {
+    if (!contact->best_resource) {
         return contact->offline_message;
     }
 
-    Resource* resource = _get_most_available_resource(contact);
-
-    return resource->status;
+    return contact->best_resource->status;
 }
 
 const char*
@@ -380,12 +437,12 @@ gboolean
 p_contact_is_available(const PContact contact)
 {
     // no available resources, unavailable
-    if (g_hash_table_size(contact->available_resources) == 0) {
+    Resource* most_available = contact->best_resource;
+    if (!most_available) {
         return FALSE;
     }
 
     // if most available resource is CHAT or ONLINE, available
-    Resource* most_available = _get_most_available_resource(contact);
     if ((most_available->presence == RESOURCE_ONLINE) || (most_available->presence == RESOURCE_CHAT)) {
         return TRUE;
     } else {
@@ -404,6 +461,7 @@ p_contact_set_presence(const PContact contact, Resource* resource)
 {
     g_hash_table_replace(contact->available_resources, strdup(resource->name), resource);
     autocomplete_add(contact->resource_ac, resource->name);
+    _update_best_resource(contact);
 }
 
 void
@@ -50,6 +50,8 @@ const char* p_contact_barejid(PContact contact);
 const char* p_contact_barejid_collate_key(PContact contact);
 const char* p_contact_name(PContact contact);
 const char* p_contact_name_collate_key(PContact contact);
+const char* p_contact_sort_key(PContact contact);
+int p_contact_presence_weight(PContact contact);
 const char* p_contact_name_or_jid(const PContact contact);
 const char* p_contact_presence(PContact contact);
 const char* p_contact_status(PContact contact);
@@ -163,6 +163,45 @@ _get_field_type(const char* const type)
     return FIELD_UNKNOWN;
 }
 
+static void
+_field_index_option(FormField* field, FormOption* option)
+{
+    if (option->value == NULL) {
+        return;
+    }
+    if (field->option_values == NULL) {
+        field->option_values = g_hash_table_new(g_str_hash, g_str_equal);
+    }
+    if (!g_hash_table_contains(field->option_values, option->value)) {
+        g_hash_table_insert(field->option_values, option->value, option);
+    }
+}
+
+/*
+ * Find the field a tag refers to. The var index is built by form_create(),
+ * forms put together by hand get it on their first lookup.
+ */
+static FormField*
+_form_get_field(DataForm* form, const char* const tag)
+{
+    char* var = g_hash_table_lookup(form->tag_to_var, tag);
+    if (var == NULL) {
+        return NULL;
+    }
+
+    if (form->var_to_field == NULL) {
+        form->var_to_field = g_hash_table_new(g_str_hash, g_str_equal);
+        for (GSList* curr = form->fields; curr; curr = g_slist_next(curr)) {
+            FormField* field = curr->data;
+            if (field->var && !g_hash_table_contains(form->var_to_field, field->var)) {
+                g_hash_table_insert(form->var_to_field, field->var, field);
+            }
+        }
+    }
+
+    return g_hash_table_lookup(form->var_to_field, var);
+}
+
 DataForm*
 form_create(xmpp_stanza_t* const form_stanza)
 {
@@ -178,6 +217,7 @@ form_create(xmpp_stanza_t* const form_stanza)
     form->instructions = _get_property(form_stanza, "instructions");
     form->var_to_tag = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
     form->tag_to_var = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
+    form->var_to_field = g_hash_table_new(g_str_hash, g_str_equal);
     form->tag_ac = autocomplete_new();
     form->modified = FALSE;
 
@@ -246,12 +286,16 @@ form_create(xmpp_stanza_t* const form_stanza)
                     }
 
                     field->options = g_slist_append(field->options, option);
+                    _field_index_option(field, option);
                 }
 
                 field_child = xmpp_stanza_get_next(field_child);
             }
 
             form->fields = g_slist_append(form->fields, field);
+            if (field->var && !g_hash_table_contains(form->var_to_field, field->var)) {
+                g_hash_table_insert(form->var_to_field, field->var, field);
+            }
         }
 
         form_child = xmpp_stanza_get_next(form_child);
@@ -360,6 +404,9 @@ _free_field(FormField* field)
         free(field->var);
         free(field->description);
         g_slist_free_full(field->values, free);
+        if (field->option_values) {
+            g_hash_table_destroy(field->option_values);
+        }
         g_slist_free_full(field->options, (GDestroyNotify)_free_option);
         autocomplete_free(field->value_ac);
         free(field);
@@ -376,6 +423,9 @@ form_destroy(DataForm* form)
         g_slist_free_full(form->fields, (GDestroyNotify)_free_field);
         g_hash_table_destroy(form->var_to_tag);
         g_hash_table_destroy(form->tag_to_var);
+        if (form->var_to_field) {
+            g_hash_table_destroy(form->var_to_field);
+        }
         autocomplete_free(form->tag_ac);
         free(form);
     }
@@ -437,33 +487,15 @@ form_get_form_type_field(DataForm* form)
 gboolean
 form_tag_exists(DataForm* form, const char* const tag)
 {
-    GList* tags = g_hash_table_get_keys(form->tag_to_var);
-    GList* curr = tags;
-    while (curr) {
-        if (g_strcmp0(curr->data, tag) == 0) {
-            g_list_free(tags);
-            return TRUE;
-        }
-        curr = g_list_next(curr);
-    }
-
-    g_list_free(tags);
-    return FALSE;
+    return g_hash_table_contains(form->tag_to_var, tag);
 }
 
 form_field_type_t
 form_get_field_type(DataForm* form, const char* const tag)
 {
-    char* var = g_hash_table_lookup(form->tag_to_var, tag);
-    if (var) {
-        GSList* curr = form->fields;
-        while (curr) {
-            FormField* field = curr->data;
-            if (g_strcmp0(field->var, var) == 0) {
-                return field->type_t;
-            }
-            curr = g_slist_next(curr);
-        }
+    FormField* field = _form_get_field(form, tag);
+    if (field) {
+        return field->type_t;
     }
     return FIELD_UNKNOWN;
 }
@@ -471,24 +503,15 @@ form_get_field_type(DataForm* form, const char* const tag)
 void
 form_set_value(DataForm* form, const char* const tag, char* value)
 {
-    char* var = g_hash_table_lookup(form->tag_to_var, tag);
-    if (var) {
-        GSList* curr = form->fields;
-        while (curr) {
-            FormField* field = curr->data;
-            if (g_strcmp0(field->var, var) == 0) {
-                if (g_slist_length(field->values) == 0) {
-                    field->values = g_slist_append(field->values, strdup(value));
-                    form->modified = TRUE;
-                    return;
-                } else if (g_slist_length(field->values) == 1) {
-                    free(field->values->data);
-                    field->values->data = strdup(value);
-                    form->modified = TRUE;
-                    return;
-                }
-            }
-            curr = g_slist_next(curr);
+    FormField* field = _form_get_field(form, tag);
+    if (field) {
+        if (g_slist_length(field->values) == 0) {
+            field->values = g_slist_append(field->values, strdup(value));
+            form->modified = TRUE;
+        } else if (g_slist_length(field->values) == 1) {
+            free(field->values->data);
+            field->values->data = strdup(value);
+            form->modified = TRUE;
         }
     }
 }
@@ -496,54 +519,39 @@ form_set_value(DataForm* form, const char* const tag, char* value)
 void
 form_add_value(DataForm* form, const char* const tag, char* value)
 {
-    char* var = g_hash_table_lookup(form->tag_to_var, tag);
-    if (var) {
-        GSList* curr = form->fields;
-        while (curr) {
-            FormField* field = curr->data;
-            if (g_strcmp0(field->var, var) == 0) {
-                field->values = g_slist_append(field->values, strdup(value));
-                if (field->type_t == FIELD_TEXT_MULTI) {
-                    int total = g_slist_length(field->values);
-                    GString* value_index = g_string_new("");
-                    g_string_printf(value_index, "val%d", total);
-                    autocomplete_add(field->value_ac, value_index->str);
-                    g_string_free(value_index, TRUE);
-                }
-                form->modified = TRUE;
-                return;
-            }
-            curr = g_slist_next(curr);
+    FormField* field = _form_get_field(form, tag);
+    if (field) {
+        field->values = g_slist_append(field->values, strdup(value));
+        if (field->type_t == FIELD_TEXT_MULTI) {
+            int total = g_slist_length(field->values);
+            GString* value_index = g_string_new("");
+            g_string_printf(value_index, "val%d", total);
+            autocomplete_add(field->value_ac, value_index->str);
+            g_string_free(value_index, TRUE);
         }
+        form->modified = TRUE;
     }
 }
 
 gboolean
 form_add_unique_value(DataForm* form, const char* const tag, char* value)
 {
-    char* var = g_hash_table_lookup(form->tag_to_var, tag);
-    if (var) {
-        GSList* curr = form->fields;
-        while (curr) {
-            FormField* field = curr->data;
-            if (g_strcmp0(field->var, var) == 0) {
-                GSList* curr_value = field->values;
-                while (curr_value) {
-                    if (g_strcmp0(curr_value->data, value) == 0) {
-                        return FALSE;
-                    }
-                    curr_value = g_slist_next(curr_value);
-                }
-
-                field->values = g_slist_append(field->values, strdup(value));
-                if (field->type_t == FIELD_JID_MULTI) {
-                    autocomplete_add(field->value_ac, value);
-                }
-                form->modified = TRUE;
-                return TRUE;
+    FormField* field = _form_get_field(form, tag);
+    if (field) {
+        GSList* curr_value = field->values;
+        while (curr_value) {
+            if (g_strcmp0(curr_value->data, value) == 0) {
+                return FALSE;
             }
-            curr = g_slist_next(curr);
+            curr_value = g_slist_next(curr_value);
         }
+
+        field->values = g_slist_append(field->values, strdup(value));
+        if (field->type_t == FIELD_JID_MULTI) {
+            autocomplete_add(field->value_ac, value);
+        }
+        form->modified = TRUE;
+        return TRUE;
     }
 
     return FALSE;
@@ -552,27 +560,18 @@ form_add_unique_value(DataForm* form, const char* const tag, char* value)
 gboolean
 form_remove_value(DataForm* form, const char* const tag, char* value)
 {
-    char* var = g_hash_table_lookup(form->tag_to_var, tag);
-    if (var) {
-        GSList* curr = form->fields;
-        while (curr) {
-            FormField* field = curr->data;
-            if (g_strcmp0(field->var, var) == 0) {
-                GSList* found = g_slist_find_custom(field->values, value, (GCompareFunc)g_strcmp0);
-                if (found) {
-                    free(found->data);
-                    found->data = NULL;
-                    field->values = g_slist_delete_link(field->values, found);
-                    if (field->type_t == FIELD_JID_MULTI) {
-                        autocomplete_remove(field->value_ac, value);
-                    }
-                    form->modified = TRUE;
-                    return TRUE;
-                } else {
-                    return FALSE;
-                }
+    FormField* field = _form_get_field(form, tag);
+    if (field) {
+        GSList* found = g_slist_find_custom(field->values, value, (GCompareFunc)g_strcmp0);
+        if (found) {
+            free(found->data);
+            found->data = NULL;
+            field->values = g_slist_delete_link(field->values, found);
+            if (field->type_t == FIELD_JID_MULTI) {
+                autocomplete_remove(field->value_ac, value);
             }
-            curr = g_slist_next(curr);
+            form->modified = TRUE;
+            return TRUE;
         }
     }
 
@@ -583,28 +582,19 @@ gboolean
 form_remove_text_multi_value(DataForm* form, const char* const tag, int index)
 {
     index--;
-    char* var = g_hash_table_lookup(form->tag_to_var, tag);
-    if (var) {
-        GSList* curr = form->fields;
-        while (curr) {
-            FormField* field = curr->data;
-            if (g_strcmp0(field->var, var) == 0) {
-                GSList* item = g_slist_nth(field->values, index);
-                if (item) {
-                    free(item->data);
-                    item->data = NULL;
-                    field->values = g_slist_delete_link(field->values, item);
-                    GString* value_index = g_string_new("");
-                    g_string_printf(value_index, "val%d", index + 1);
-                    autocomplete_remove(field->value_ac, value_index->str);
-                    g_string_free(value_index, TRUE);
-                    form->modified = TRUE;
-                    return TRUE;
-                } else {
-                    return FALSE;
-                }
-            }
-            curr = g_slist_next(curr);
+    FormField* field = _form_get_field(form, tag);
+    if (field) {
+        GSList* item = g_slist_nth(field->values, index);
+        if (item) {
+            free(item->data);
+            item->data = NULL;
+            field->values = g_slist_delete_link(field->values, item);
+            GString* value_index = g_string_new("");
+            g_string_printf(value_index, "val%d", index + 1);
+            autocomplete_remove(field->value_ac, value_index->str);
+            g_string_free(value_index, TRUE);
+            form->modified = TRUE;
+            return TRUE;
         }
     }
 
@@ -614,19 +604,12 @@ form_remove_text_multi_value(DataForm* form, const char* const tag, int index)
 int
 form_get_value_count(DataForm* form, const char* const tag)
 {
-    char* var = g_hash_table_lookup(form->tag_to_var, tag);
-    if (var) {
-        GSList* curr = form->fields;
-        while (curr) {
-            FormField* field = curr->data;
-            if (g_strcmp0(field->var, var) == 0) {
-                if ((g_slist_length(field->values) == 1) && (field->values->data == NULL)) {
-                    return 0;
-                } else {
-                    return g_slist_length(field->values);
-                }
-            }
-            curr = g_slist_next(curr);
+    FormField* field = _form_get_field(form, tag);
+    if (field) {
+        if ((g_slist_length(field->values) == 1) && (field->values->data == NULL)) {
+            return 0;
+        } else {
+            return g_slist_length(field->values);
         }
     }
 
@@ -636,23 +619,23 @@ form_get_value_count(DataForm* form, const char* const tag)
 gboolean
 form_field_contains_option(DataForm* form, const char* const tag, char* value)
 {
-    char* var = g_hash_table_lookup(form->tag_to_var, tag);
-    if (var) {
-        GSList* curr = form->fields;
-        while (curr) {
-            FormField* field = curr->data;
-            if (g_strcmp0(field->var, var) == 0) {
-                GSList* curr_option = field->options;
-                while (curr_option) {
-                    FormOption* option = curr_option->data;
-                    if (g_strcmp0(option->value, value) == 0) {
-                        return TRUE;
-                    }
-                    curr_option = g_slist_next(curr_option);
-                }
-            }
-            curr = g_slist_next(curr);
+    FormField* field = _form_get_field(form, tag);
+    if (field == NULL) {
+        return FALSE;
+    }
+
+    if (field->option_values) {
+        return value && g_hash_table_contains(field->option_values, value);
+    }
+
+    // options added by hand, not indexed
+    GSList* curr_option = field->options;
+    while (curr_option) {
+        FormOption* option = curr_option->data;
+        if (g_strcmp0(option->value, value) == 0) {
+            return TRUE;
         }
+        curr_option = g_slist_next(curr_option);
     }
 
     return FALSE;
@@ -661,33 +644,15 @@ form_field_contains_option(DataForm* form, const char* const tag, char* value)
 FormField*
 form_get_field_by_tag(DataForm* form, const char* const tag)
 {
-    char* var = g_hash_table_lookup(form->tag_to_var, tag);
-    if (var) {
-        GSList* curr = form->fields;
-        while (curr) {
-            FormField* field = curr->data;
-            if (g_strcmp0(field->var, var) == 0) {
-                return field;
-            }
-            curr = g_slist_next(curr);
-        }
-    }
-    return NULL;
+    return _form_get_field(form, tag);
 }
 
 Autocomplete
 form_get_value_ac(DataForm* form, const char* const tag)
 {
-    char* var = g_hash_table_lookup(form->tag_to_var, tag);
-    if (var) {
-        GSList* curr = form->fields;
-        while (curr) {
-            FormField* field = curr->data;
-            if (g_strcmp0(field->var, var) == 0) {
-                return field->value_ac;
-            }
-            curr = g_slist_next(curr);
-        }
+    FormField* field = _form_get_field(form, tag);
+    if (field) {
+        return field->value_ac;
     }
     return NULL;
 }
@@ -44,6 +44,7 @@
 
 #include "profanity.h"
 #include "log.h"
+#include "stats.h"
 #include "config/preferences.h"
 #include "event/server_events.h"
 #include "plugins/plugins.h"
@@ -77,11 +78,28 @@ typedef struct p_room_info_data_t
 
 typedef struct p_iq_handle_t
 {
+    char* id;
     ProfIqCallback func;
     ProfIqFreeCallback free_func;
+    ProfIqTimeoutCallback timeout_func;
     void* userdata;
+    guint timeout;
+    gint64 deadline;
+    guint slot;
+    GList* slot_link;
+    ProfWin* win;
+    char* to;
+    char* domain;
+    xmpp_stanza_t* queued;
 } ProfIqHandler;
 
+// Requests in flight to one domain, the ones beyond the limit wait in pending
+typedef struct p_iq_domain_t
+{
+    guint in_flight;
+    GQueue pending;
+} ProfIqDomain;
+
 typedef struct privilege_set_t
 {
     char* item;
@@ -106,6 +124,10 @@ typedef struct mam_rsm_userdata
     char* start_datestr;
     char* end_datestr;
     gboolean fetch_next;
+    gboolean continued;
+    int page_size;   // <max> of this page
+    int first_index; // RSM index of the page's first item, -1 if unknown
+    int server_max;  // largest page the server answered with, 0 if unknown
     ProfChatWin* win;
 } MamRsmUserdata;
 
@@ -117,6 +139,7 @@ typedef struct late_delivery_userdata
 } LateDeliveryUserdata;
 
 static int _iq_handler(xmpp_conn_t* const conn, xmpp_stanza_t* const stanza, void* const userdata);
+static int _iq_handler_traced(xmpp_conn_t* const conn, xmpp_stanza_t* const stanza, void* const userdata);
 
 static void _error_handler(xmpp_stanza_t* const stanza);
 static void _disco_info_get_handler(xmpp_stanza_t* const stanza);
@@ -142,48 +165,127 @@ static int _room_role_list_result_id_handler(xmpp_stanza_t* const stanza, void*
 static int _room_kick_result_id_handler(xmpp_stanza_t* const stanza, void* const userdata);
 static int _enable_carbons_id_handler(xmpp_stanza_t* const stanza, void* const userdata);
 static int _disable_carbons_id_handler(xmpp_stanza_t* const stanza, void* const userdata);
+static void _manual_pong_timeout(const char* const to, void* const userdata);
 static int _manual_pong_id_handler(xmpp_stanza_t* const stanza, void* const userdata);
 static int _caps_response_id_handler(xmpp_stanza_t* const stanza, void* const userdata);
 static int _caps_response_for_jid_id_handler(xmpp_stanza_t* const stanza, void* const userdata);
 static int _caps_response_legacy_id_handler(xmpp_stanza_t* const stanza, void* const userdata);
+static void _caps_response_timeout(const char* const to, void* const userdata);
+static void _caps_response_free(char* ver);
 static int _auto_pong_id_handler(xmpp_stanza_t* const stanza, void* const userdata);
 static int _room_list_id_handler(xmpp_stanza_t* const stanza, void* const userdata);
+static void _room_list_request_free(RoomListRequest* request);
+static void _room_list_send(RoomListRequest* request, const char* const after);
+static void _room_list_free(RoomList* list);
 static int _command_list_result_handler(xmpp_stanza_t* const stanza, void* const userdata);
 static int _command_exec_response_handler(xmpp_stanza_t* const stanza, void* const userdata);
 static int _mam_rsm_id_handler(xmpp_stanza_t* const stanza, void* const userdata);
+static int _mam_room_id_handler(xmpp_stanza_t* const stanza, void* const userdata);
+static int _mam_first_index(xmpp_stanza_t* first);
+static int _mam_next_page_size(MamRsmUserdata* data, int first_index);
 static int _register_change_password_result_id_handler(xmpp_stanza_t* const stanza, void* const userdata);
 
 static void _iq_mam_request(ProfChatWin* win, GDateTime* startdate, GDateTime* enddate);
+static void _iq_mam_send(ProfChatWin* win, GDateTime* startdate, GDateTime* enddate);
+static void _iq_mam_sync_finished(void);
 static void _iq_free_room_data(ProfRoomInfoData* roominfo);
 static void _iq_free_affiliation_set(ProfPrivilegeSet* affiliation_set);
 static void _iq_free_affiliation_list(ProfAffiliationList* affiliation_list);
 static void _iq_id_handler_free(ProfIqHandler* handler);
+static void _iq_id_handler_set_win(const char* const id, ProfWin* window);
+static void _iq_domain_free(ProfIqDomain* domain);
+static void _iq_wheel_arm(ProfIqHandler* handler);
+static void _iq_wheel_unlink(ProfIqHandler* handler);
+static gboolean _iq_domain_pump_cb(gpointer data);
 
 // scheduled
 static int _autoping_timed_send(xmpp_conn_t* const conn, void* const userdata);
+static gboolean _autoping_timeout_cb(gpointer data);
 
 static void _identity_destroy(DiscoIdentity* identity);
 static void _item_destroy(DiscoItem* item);
 
 static gboolean autoping_wait = FALSE;
-static GTimer* autoping_time = NULL;
+static guint autoping_timeout = 0;
+static gint64 autoping_sent = 0;
+static gint64 autoping_last_inbound = 0;
 static GHashTable* id_handlers;
+static GHashTable* win_handlers = NULL;
+static GHashTable* domain_requests = NULL;
+static guint domain_pump_source = 0;
+static gboolean handlers_clearing = FALSE;
+
+// Unanswered requests expire on a timer wheel of one second slots, a
+// deadline further out than one turn waits in its slot for later turns.
+#define IQ_WHEEL_SLOTS 64
+static GList* iq_wheel[IQ_WHEEL_SLOTS];
+static gint64 iq_wheel_time = 0;
+
+// Room lists are fetched a page of disco#items at a time and printed as the
+// pages arrive. Complete lists are kept per service for ROOM_LIST_CACHE_TTL
+// seconds when the rooms cache is enabled, and printed from there a page per
+// main loop iteration.
+#define ROOM_LIST_PAGE      250
+#define ROOM_LIST_CACHE_TTL (10 * 60)
+
+typedef struct room_list_item_t
+{
+    char* jid;
+    char* name;
+    // lower case room localpart and name, what /rooms filter matches
+    gchar* jid_key;
+    gchar* name_key;
+} RoomListItem;
+
+typedef struct room_list_t
+{
+    GPtrArray* items;
+    gint64 fetched;
+} RoomList;
+
+typedef struct room_list_request_t
+{
+    char* service;
+    char* filter;
+    GPatternSpec* glob;
+    GPtrArray* items;
+    // next item to print
+    guint next;
+    guint matched;
+    // handed over to the query for the next page
+    gboolean continued;
+    guint source;
+} RoomListRequest;
+
 static GHashTable* rooms_cache = NULL;
 static GSList* late_delivery_windows = NULL;
 static gboolean received_disco_items = FALSE;
 
+// Number of MAM syncs (one RSM page chain per contact) that may run at the
+// same time, the rest wait in mam_pending_syncs.
+#define MAM_MAX_IN_FLIGHT 4
+static GQueue mam_pending_syncs = G_QUEUE_INIT;
+static guint mam_syncs_in_flight = 0;
+
+// the span covers everything the stanza sets off, sv_ev_* handlers included
+static int
+_iq_handler_traced(xmpp_conn_t* const conn, xmpp_stanza_t* const stanza, void* const userdata)
+{
+    gint64 start = stats_trace_begin();
+    int res = _iq_handler(conn, stanza, userdata);
+    stats_span("iq_handler", start);
+
+    return res;
+}
+
 static int
 _iq_handler(xmpp_conn_t* const conn, xmpp_stanza_t* const stanza, void* const userdata)
 {
     log_debug("iq stanza handler fired");
     autoping_timer_extend();
+    stats_stanza_received(STATS_STANZA_IQ);
 
-    char* text;
-    size_t text_size;
-    xmpp_stanza_to_text(stanza, &text, &text_size);
-    gboolean cont = plugins_on_iq_stanza_receive(text);
-    xmpp_free(connection_get_ctx(), text);
-    if (!cont) {
+    if (!plugins_on_iq_stanza_receive(stanza)) {
         return 1;
     }
 
@@ -225,7 +327,8 @@ _iq_handler(xmpp_conn_t* const conn, xmpp_stanza_t* const stanza, void* const us
     if (roster && (g_strcmp0(type, STANZA_TYPE_SET) == 0)) {
         roster_set_handler(stanza);
     }
-    if (roster && (g_strcmp0(type, STANZA_TYPE_RESULT) == 0)) {
+    // an up to date versioned roster is answered with an empty result
+    if ((roster || g_strcmp0(xmpp_stanza_get_id(stanza), "roster") == 0) && (g_strcmp0(type, STANZA_TYPE_RESULT) == 0)) {
         roster_result_handler(stanza);
     }
 
@@ -241,6 +344,8 @@ _iq_handler(xmpp_conn_t* const conn, xmpp_stanza_t* const stanza, void* const us
             int keep = handler->func(stanza, handler->userdata);
             if (!keep) {
                 g_hash_table_remove(id_handlers, id);
+            } else if ((handler = g_hash_table_lookup(id_handlers, id))) {
+                _iq_wheel_arm(handler);
             }
         }
     }
@@ -253,7 +358,7 @@ iq_handlers_init(void)
 {
     xmpp_conn_t* const conn = connection_get_conn();
     xmpp_ctx_t* const ctx = connection_get_ctx();
-    xmpp_handler_add(conn, _iq_handler, NULL, STANZA_NAME_IQ, NULL, ctx);
+    xmpp_handler_add(conn, _iq_handler_traced, NULL, STANZA_NAME_IQ, NULL, ctx);
 
     if (prefs_get_autoping() != 0) {
         int millis = prefs_get_autoping() * 1000;
@@ -264,28 +369,10 @@ iq_handlers_init(void)
     iq_rooms_cache_clear();
     iq_handlers_clear();
 
-    id_handlers = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)_iq_id_handler_free);
-    rooms_cache = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)xmpp_stanza_release);
-}
-
-struct iq_win_finder
-{
-    gsize max, cur;
-    char** to_be_removed;
-};
-
-static void
-_win_find(char* key,
-          ProfIqHandler* handler,
-          struct iq_win_finder* finder)
-{
-    if (handler->func == _mam_rsm_id_handler) {
-        if (finder->cur >= finder->max) {
-            finder->max *= 2;
-            finder->to_be_removed = g_realloc_n(finder->to_be_removed, finder->max, sizeof(char*));
-        }
-        finder->to_be_removed[finder->cur++] = g_strdup(key);
-    }
+    id_handlers = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, (GDestroyNotify)_iq_id_handler_free);
+    win_handlers = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)g_hash_table_destroy);
+    domain_requests = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)_iq_domain_free);
+    iq_wheel_time = g_get_monotonic_time() / G_USEC_PER_SEC;
 }
 
 void
@@ -303,27 +390,92 @@ iq_handlers_remove_win(ProfWin* window)
                                                         cur);
         cur = next;
     }
-    struct iq_win_finder st = { 0 };
-    st.max = g_hash_table_size(id_handlers);
-    if (st.max == 0)
+    GList* pending = mam_pending_syncs.head;
+    while (pending) {
+        GList* pending_next = pending->next;
+        LateDeliveryUserdata* sync = pending->data;
+        if (sync->win == (void*)window) {
+            if (sync->startdate)
+                g_date_time_unref(sync->startdate);
+            if (sync->enddate)
+                g_date_time_unref(sync->enddate);
+            free(sync);
+            g_queue_delete_link(&mam_pending_syncs, pending);
+        }
+        pending = pending_next;
+    }
+    if (!win_handlers)
         return;
-    st.to_be_removed = g_new(char*, st.max);
-    g_hash_table_foreach(id_handlers, (GHFunc)_win_find, &st);
-    for (gsize n = 0; n < st.cur; ++n) {
-        g_hash_table_remove(id_handlers, st.to_be_removed[n]);
-        g_free(st.to_be_removed[n]);
+    GHashTable* ids = g_hash_table_lookup(win_handlers, window);
+    if (!ids)
+        return;
+    // removing a handler takes it out of the index, so work on a copy
+    GList* keys = g_hash_table_get_keys(ids);
+    for (GList* key = keys; key; key = key->next) {
+        g_hash_table_remove(id_handlers, key->data);
     }
-    g_free(st.to_be_removed);
+    g_list_free(keys);
 }
 
 void
 iq_handlers_clear(void)
 {
+    LateDeliveryUserdata* sync;
+    while ((sync = g_queue_pop_head(&mam_pending_syncs))) {
+        if (sync->startdate)
+            g_date_time_unref(sync->startdate);
+        if (sync->enddate)
+            g_date_time_unref(sync->enddate);
+        free(sync);
+    }
+    handlers_clearing = TRUE;
     if (id_handlers) {
         g_hash_table_remove_all(id_handlers);
         g_hash_table_destroy(id_handlers);
         id_handlers = NULL;
     }
+    handlers_clearing = FALSE;
+    if (win_handlers) {
+        g_hash_table_destroy(win_handlers);
+        win_handlers = NULL;
+    }
+    if (domain_requests) {
+        g_hash_table_destroy(domain_requests);
+        domain_requests = NULL;
+    }
+    if (domain_pump_source) {
+        g_source_remove(domain_pump_source);
+        domain_pump_source = 0;
+    }
+}
+
+static void
+_iq_domain_free(ProfIqDomain* domain)
+{
+    xmpp_stanza_t* stanza;
+    while ((stanza = g_queue_pop_head(&domain->pending))) {
+        xmpp_stanza_release(stanza);
+    }
+    free(domain);
+}
+
+static void
+_iq_wheel_unlink(ProfIqHandler* handler)
+{
+    if (handler->slot_link) {
+        iq_wheel[handler->slot] = g_list_delete_link(iq_wheel[handler->slot], handler->slot_link);
+        handler->slot_link = NULL;
+    }
+}
+
+static void
+_iq_wheel_arm(ProfIqHandler* handler)
+{
+    _iq_wheel_unlink(handler);
+    handler->deadline = g_get_monotonic_time() / G_USEC_PER_SEC + handler->timeout;
+    handler->slot = handler->deadline % IQ_WHEEL_SLOTS;
+    iq_wheel[handler->slot] = g_list_prepend(iq_wheel[handler->slot], handler);
+    handler->slot_link = iq_wheel[handler->slot];
 }
 
 static void
@@ -332,59 +484,162 @@ _iq_id_handler_free(ProfIqHandler* handler)
     if (handler == NULL) {
         return;
     }
+    _iq_wheel_unlink(handler);
+    if (handler->win && win_handlers) {
+        GHashTable* ids = g_hash_table_lookup(win_handlers, handler->win);
+        if (ids) {
+            g_hash_table_remove(ids, handler->id);
+            if (g_hash_table_size(ids) == 0) {
+                g_hash_table_remove(win_handlers, handler->win);
+            }
+        }
+    }
+    if (handler->domain && domain_requests) {
+        ProfIqDomain* domain = g_hash_table_lookup(domain_requests, handler->domain);
+        if (domain) {
+            if (handler->queued) {
+                g_queue_remove(&domain->pending, handler->queued);
+                xmpp_stanza_release(handler->queued);
+            } else if (domain->in_flight > 0) {
+                domain->in_flight--;
+            }
+            // not from here, a destroy notify must not send stanzas
+            if (!g_queue_is_empty(&domain->pending) && !handlers_clearing && !domain_pump_source) {
+                domain_pump_source = g_idle_add(_iq_domain_pump_cb, NULL);
+            }
+        }
+    }
     if (handler->free_func && handler->userdata) {
         handler->free_func(handler->userdata);
     }
+    free(handler->domain);
+    free(handler->to);
+    free(handler->id);
     free(handler);
 }
 
 void
 iq_id_handler_add(const char* const id, ProfIqCallback func, ProfIqFreeCallback free_func, void* userdata)
 {
-    ProfIqHandler* handler = malloc(sizeof(ProfIqHandler));
+    iq_id_handler_add_timeout(id, func, free_func, userdata, NULL, IQ_TIMEOUT_DEFAULT);
+}
+
+void
+iq_id_handler_add_timeout(const char* const id, ProfIqCallback func, ProfIqFreeCallback free_func, void* userdata,
+                          ProfIqTimeoutCallback timeout_func, guint timeout)
+{
+    ProfIqHandler* handler = calloc(1, sizeof(ProfIqHandler));
     if (handler) {
+        handler->id = strdup(id);
         handler->func = func;
         handler->free_func = free_func;
+        handler->timeout_func = timeout_func;
         handler->userdata = userdata;
+        handler->timeout = timeout;
+        _iq_wheel_arm(handler);
 
-        g_hash_table_insert(id_handlers, strdup(id), handler);
+        g_hash_table_replace(id_handlers, handler->id, handler);
     }
 }
 
-void
-iq_autoping_timer_cancel(void)
+// Ties a handler to a window, closing the window drops it
+static void
+_iq_id_handler_set_win(const char* const id, ProfWin* window)
 {
-    autoping_wait = FALSE;
-    if (autoping_time) {
-        g_timer_destroy(autoping_time);
-        autoping_time = NULL;
+    ProfIqHandler* handler = g_hash_table_lookup(id_handlers, id);
+    if (!handler || !window) {
+        return;
+    }
+
+    GHashTable* ids = g_hash_table_lookup(win_handlers, window);
+    if (!ids) {
+        ids = g_hash_table_new(g_str_hash, g_str_equal);
+        g_hash_table_insert(win_handlers, window, ids);
     }
+    handler->win = window;
+    g_hash_table_add(ids, handler->id);
+}
+
+guint
+iq_id_handlers_count(void)
+{
+    return id_handlers ? g_hash_table_size(id_handlers) : 0;
 }
 
 void
-iq_autoping_check(void)
+iq_timeouts_check(void)
 {
-    if (connection_get_status() != JABBER_CONNECTED) {
+    if (!id_handlers) {
         return;
     }
 
-    if (autoping_wait == FALSE) {
-        return;
+    gint64 now = g_get_monotonic_time() / G_USEC_PER_SEC;
+    if (now - iq_wheel_time > IQ_WHEEL_SLOTS) {
+        iq_wheel_time = now - IQ_WHEEL_SLOTS;
     }
 
-    if (autoping_time == NULL) {
-        return;
+    GSList* expired = NULL;
+    while (iq_wheel_time < now) {
+        iq_wheel_time++;
+        for (GList* curr = iq_wheel[iq_wheel_time % IQ_WHEEL_SLOTS]; curr; curr = curr->next) {
+            ProfIqHandler* handler = curr->data;
+            if (handler->deadline <= now) {
+                expired = g_slist_prepend(expired, strdup(handler->id));
+            }
+        }
     }
 
-    gdouble elapsed = g_timer_elapsed(autoping_time, NULL);
-    unsigned long seconds_elapsed = elapsed * 1.0;
+    // callbacks may add or remove handlers, so look each one up again
+    for (GSList* curr = expired; curr; curr = curr->next) {
+        ProfIqHandler* handler = g_hash_table_lookup(id_handlers, curr->data);
+        if (!handler) {
+            continue;
+        }
+        log_debug("IQ %s to %s timed out after %us", handler->id, handler->to ? handler->to : "server", handler->timeout);
+        if (handler->timeout_func) {
+            handler->timeout_func(handler->to, handler->userdata);
+        }
+        g_hash_table_remove(id_handlers, curr->data);
+    }
+    g_slist_free_full(expired, free);
+}
+
+void
+iq_autoping_timer_cancel(void)
+{
+    autoping_wait = FALSE;
+    if (autoping_timeout) {
+        g_source_remove(autoping_timeout);
+        autoping_timeout = 0;
+    }
+}
+
+// armed when a ping goes out, so nothing runs while no reply is pending
+static gboolean
+_autoping_timeout_cb(gpointer data)
+{
+    autoping_timeout = 0;
+
     gint timeout = prefs_get_autoping_timeout();
-    if (timeout > 0 && seconds_elapsed >= timeout) {
-        cons_show("Autoping response timed out after %u seconds.", timeout);
-        log_debug("Autoping check: timed out after %u seconds, disconnecting", timeout);
-        iq_autoping_timer_cancel();
-        session_autoping_fail();
+    if (connection_get_status() != JABBER_CONNECTED || !autoping_wait || timeout <= 0) {
+        return G_SOURCE_REMOVE;
     }
+
+    // anything received meanwhile shows the server is still there, the
+    // reply gets the full timeout counted from the last stanza
+    gint64 since = MAX(autoping_sent, autoping_last_inbound);
+    gint64 remaining = since + timeout * G_USEC_PER_SEC - g_get_monotonic_time();
+    if (remaining > 0) {
+        autoping_timeout = g_timeout_add_seconds(remaining / G_USEC_PER_SEC + 1, _autoping_timeout_cb, NULL);
+        return G_SOURCE_REMOVE;
+    }
+
+    cons_show("Autoping response timed out after %u seconds.", timeout);
+    log_debug("Autoping check: timed out after %u seconds, disconnecting", timeout);
+    iq_autoping_timer_cancel();
+    session_autoping_fail();
+
+    return G_SOURCE_REMOVE;
 }
 
 void
@@ -416,22 +671,141 @@ iq_rooms_cache_clear(void)
     }
 }
 
+static void
+_room_list_item_free(RoomListItem* item)
+{
+    free(item->jid);
+    free(item->name);
+    g_free(item->jid_key);
+    g_free(item->name_key);
+    free(item);
+}
+
+static void
+_room_list_free(RoomList* list)
+{
+    g_ptr_array_unref(list->items);
+    free(list);
+}
+
+static void
+_room_list_request_free(RoomListRequest* request)
+{
+    if (request->continued) {
+        request->continued = FALSE;
+        return;
+    }
+
+    if (request->source) {
+        g_source_remove(request->source);
+    }
+    free(request->service);
+    free(request->filter);
+    if (request->glob) {
+        g_pattern_spec_free(request->glob);
+    }
+    g_ptr_array_unref(request->items);
+    free(request);
+}
+
+static void
+_room_list_print_header(RoomListRequest* request)
+{
+    cons_show("");
+    if (request->filter) {
+        cons_show("Rooms list response received: %s, filter: %s", request->service, request->filter);
+    } else {
+        cons_show("Rooms list response received: %s", request->service);
+    }
+}
+
+// print the items received or cached up to until
+static void
+_room_list_print(RoomListRequest* request, guint until)
+{
+    for (; request->next < until; request->next++) {
+        RoomListItem* item = g_ptr_array_index(request->items, request->next);
+        if (request->glob
+            && !g_pattern_match_string(request->glob, item->jid_key)
+            && !(item->name_key && g_pattern_match_string(request->glob, item->name_key))) {
+            continue;
+        }
+
+        request->matched++;
+        if (item->name) {
+            cons_show("  %s (%s)", item->jid, item->name);
+        } else {
+            cons_show("  %s", item->jid);
+        }
+    }
+}
+
+static void
+_room_list_print_end(RoomListRequest* request)
+{
+    if (request->items->len == 0) {
+        cons_show("  No rooms found.");
+    } else if (request->glob && request->matched == 0) {
+        cons_show("  No rooms found matching filter: %s", request->filter);
+    }
+}
+
+static gboolean
+_room_list_print_cb(gpointer data)
+{
+    RoomListRequest* request = data;
+    _room_list_print(request, MIN(request->next + ROOM_LIST_PAGE, request->items->len));
+    if (request->next < request->items->len) {
+        return TRUE;
+    }
+
+    _room_list_print_end(request);
+    request->source = 0;
+    _room_list_request_free(request);
+
+    return FALSE;
+}
+
 void
 iq_room_list_request(const char* conferencejid, char* filter)
 {
-    if (g_hash_table_contains(rooms_cache, conferencejid)) {
+    RoomListRequest* request = calloc(1, sizeof(RoomListRequest));
+    request->service = strdup(conferencejid);
+    if (filter) {
+        request->filter = strdup(filter);
+        auto_gchar gchar* filter_lower = g_utf8_strdown(filter, -1);
+        auto_gchar gchar* glob_str = g_strdup_printf("*%s*", filter_lower);
+        request->glob = g_pattern_spec_new(glob_str);
+    }
+
+    if (rooms_cache == NULL) {
+        rooms_cache = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)_room_list_free);
+    }
+
+    RoomList* cached = g_hash_table_lookup(rooms_cache, conferencejid);
+    if (cached && (g_get_monotonic_time() - cached->fetched) / G_USEC_PER_SEC < ROOM_LIST_CACHE_TTL) {
         log_debug("Rooms request cached for: %s", conferencejid);
-        _room_list_id_handler(g_hash_table_lookup(rooms_cache, conferencejid), filter);
+        request->items = g_ptr_array_ref(cached->items);
+        _room_list_print_header(request);
+        request->source = g_idle_add(_room_list_print_cb, request);
         return;
     }
+    g_hash_table_remove(rooms_cache, conferencejid);
 
     log_debug("Rooms request not cached for: %s", conferencejid);
 
+    request->items = g_ptr_array_new_with_free_func((GDestroyNotify)_room_list_item_free);
+    _room_list_send(request, NULL);
+}
+
+static void
+_room_list_send(RoomListRequest* request, const char* const after)
+{
     xmpp_ctx_t* const ctx = connection_get_ctx();
-    char* id = connection_create_stanza_id();
-    xmpp_stanza_t* iq = stanza_create_disco_items_iq(ctx, id, conferencejid, NULL);
+    auto_char char* id = connection_create_stanza_id();
+    xmpp_stanza_t* iq = stanza_create_disco_items_page_iq(ctx, id, request->service, ROOM_LIST_PAGE, after);
 
-    iq_id_handler_add(id, _room_list_id_handler, NULL, filter);
+    iq_id_handler_add(id, _room_list_id_handler, (ProfIqFreeCallback)_room_list_request_free, request);
 
     iq_send_stanza(iq);
     xmpp_stanza_release(iq);
@@ -463,13 +837,13 @@ iq_disable_carbons(void)
     xmpp_stanza_release(iq);
 }
 
-void
+gboolean
 iq_http_upload_request(HTTPUpload* upload)
 {
     const char* jid = connection_jid_for_feature(STANZA_NS_HTTP_UPLOAD);
     if (jid == NULL) {
         cons_show_error("XEP-0363 HTTP File Upload is not supported by the server");
-        return;
+        return FALSE;
     }
 
     xmpp_ctx_t* const ctx = connection_get_ctx();
@@ -480,7 +854,7 @@ iq_http_upload_request(HTTPUpload* upload)
     iq_send_stanza(iq);
     xmpp_stanza_release(iq);
 
-    return;
+    return TRUE;
 }
 
 void
@@ -587,7 +961,8 @@ iq_send_caps_request(const char* const to, const char* const id,
     xmpp_stanza_t* iq = stanza_create_disco_info_iq(ctx, id, to, node_str->str);
     g_string_free(node_str, TRUE);
 
-    iq_id_handler_add(id, _caps_response_id_handler, NULL, NULL);
+    iq_id_handler_add_timeout(id, _caps_response_id_handler, (ProfIqFreeCallback)_caps_response_free, strdup(ver),
+                              _caps_response_timeout, IQ_TIMEOUT_DEFAULT);
 
     iq_send_stanza(iq);
     xmpp_stanza_release(iq);
@@ -801,7 +1176,9 @@ iq_send_ping(const char* const target)
     const char* id = xmpp_stanza_get_id(iq);
 
     GDateTime* now = g_date_time_new_now_local();
-    iq_id_handler_add(id, _manual_pong_id_handler, (ProfIqFreeCallback)g_date_time_unref, now);
+    gint timeout = prefs_get_autoping_timeout();
+    iq_id_handler_add_timeout(id, _manual_pong_id_handler, (ProfIqFreeCallback)g_date_time_unref, now,
+                              _manual_pong_timeout, timeout > 0 ? timeout : IQ_TIMEOUT_DEFAULT);
 
     iq_send_stanza(iq);
     xmpp_stanza_release(iq);
@@ -881,6 +1258,7 @@ _error_handler(xmpp_stanza_t* const stanza)
 static int
 _caps_response_id_handler(xmpp_stanza_t* const stanza, void* const userdata)
 {
+    const char* ver = userdata;
     const char* id = xmpp_stanza_get_id(stanza);
     xmpp_stanza_t* query = xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_QUERY);
 
@@ -899,6 +1277,7 @@ _caps_response_id_handler(xmpp_stanza_t* const stanza, void* const userdata)
     const char* from = xmpp_stanza_get_from(stanza);
     if (!from) {
         log_info("_caps_response_id_handler(): No from attribute");
+        caps_ver_request_done(ver, FALSE);
         return 0;
     }
 
@@ -906,17 +1285,20 @@ _caps_response_id_handler(xmpp_stanza_t* const stanza, void* const userdata)
     if (g_strcmp0(type, STANZA_TYPE_ERROR) == 0) {
         auto_char char* error_message = stanza_get_error_message(stanza);
         log_warning("Error received for capabilities response from %s: ", from, error_message);
+        caps_ver_request_done(ver, FALSE);
         return 0;
     }
 
     if (query == NULL) {
         log_info("_caps_response_id_handler(): No query element found.");
+        caps_ver_request_done(ver, FALSE);
         return 0;
     }
 
     const char* node = xmpp_stanza_get_attribute(query, STANZA_ATTR_NODE);
     if (node == NULL) {
         log_info("_caps_response_id_handler(): No node attribute found");
+        caps_ver_request_done(ver, FALSE);
         return 0;
     }
 
@@ -945,9 +1327,24 @@ _caps_response_id_handler(xmpp_stanza_t* const stanza, void* const userdata)
         caps_map_jid_to_ver(from, given_sha1);
     }
 
+    caps_ver_request_done(ver, g_strcmp0(ver, generated_sha1) == 0 && g_strcmp0(given_sha1, generated_sha1) == 0);
+
     return 0;
 }
 
+static void
+_caps_response_timeout(const char* const to, void* const userdata)
+{
+    caps_ver_request_done(userdata, FALSE);
+}
+
+static void
+_caps_response_free(char* ver)
+{
+    caps_ver_request_cancel(ver);
+    free(ver);
+}
+
 static int
 _caps_response_for_jid_id_handler(xmpp_stanza_t* const stanza, void* const userdata)
 {
@@ -1078,84 +1475,69 @@ _caps_response_legacy_id_handler(xmpp_stanza_t* const stanza, void* const userda
 static int
 _room_list_id_handler(xmpp_stanza_t* const stanza, void* const userdata)
 {
-    const char* filter = userdata;
+    RoomListRequest* request = userdata;
     const char* id = xmpp_stanza_get_id(stanza);
-    const char* from = xmpp_stanza_get_from(stanza);
-
-    if (prefs_get_boolean(PREF_ROOM_LIST_CACHE) && !g_hash_table_contains(rooms_cache, from)) {
-        g_hash_table_insert(rooms_cache, strdup(from), xmpp_stanza_copy(stanza));
-    }
+    const char* type = xmpp_stanza_get_type(stanza);
 
     log_debug("Response to query: %s", id);
 
-    xmpp_stanza_t* query = xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_QUERY);
-    if (query == NULL) {
+    if (g_strcmp0(type, STANZA_TYPE_ERROR) == 0) {
+        auto_char char* error_message = stanza_get_error_message(stanza);
+        cons_show_error("Error retrieving rooms list from %s: %s", request->service, error_message);
         return 0;
     }
 
-    cons_show("");
-    if (filter) {
-        cons_show("Rooms list response received: %s, filter: %s", from, filter);
-    } else {
-        cons_show("Rooms list response received: %s", from);
-    }
-    xmpp_stanza_t* child = xmpp_stanza_get_children(query);
-    if (child == NULL) {
-        cons_show("  No rooms found.");
+    xmpp_stanza_t* query = xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_QUERY);
+    if (query == NULL) {
         return 0;
     }
 
-    GPatternSpec* glob = NULL;
-    if (filter != NULL) {
-        gchar* filter_lower = g_utf8_strdown(filter, -1);
-        GString* glob_str = g_string_new("*");
-        g_string_append(glob_str, filter_lower);
-        g_string_append(glob_str, "*");
-        glob = g_pattern_spec_new(glob_str->str);
-        g_string_free(glob_str, TRUE);
-    }
-
-    gboolean matched = FALSE;
+    gboolean first_page = request->items->len == 0;
+    guint received = 0;
+    xmpp_stanza_t* child = xmpp_stanza_get_children(query);
     while (child) {
         const char* stanza_name = xmpp_stanza_get_name(child);
-        if (stanza_name && (g_strcmp0(stanza_name, STANZA_NAME_ITEM) == 0)) {
-            const char* item_jid = xmpp_stanza_get_attribute(child, STANZA_ATTR_JID);
-            auto_gchar gchar* item_jid_lower = NULL;
-            if (item_jid) {
-                auto_jid Jid* jidp = jid_create(item_jid);
-                if (jidp && jidp->localpart) {
-                    item_jid_lower = g_utf8_strdown(jidp->localpart, -1);
-                }
-            }
-            const char* item_name = xmpp_stanza_get_attribute(child, STANZA_ATTR_NAME);
-            auto_gchar gchar* item_name_lower = NULL;
-            if (item_name) {
-                item_name_lower = g_utf8_strdown(item_name, -1);
-            }
-            if ((item_jid_lower) && ((glob == NULL) || ((g_pattern_match(glob, strlen(item_jid_lower), item_jid_lower, NULL)) || (item_name_lower && g_pattern_match(glob, strlen(item_name_lower), item_name_lower, NULL))))) {
-
-                if (glob) {
-                    matched = TRUE;
-                }
-                GString* item = g_string_new(item_jid);
+        const char* item_jid = xmpp_stanza_get_attribute(child, STANZA_ATTR_JID);
+        if (item_jid && (g_strcmp0(stanza_name, STANZA_NAME_ITEM) == 0)) {
+            auto_jid Jid* jidp = jid_create(item_jid);
+            if (jidp && jidp->localpart) {
+                RoomListItem* item = calloc(1, sizeof(RoomListItem));
+                item->jid = strdup(item_jid);
+                item->jid_key = g_utf8_strdown(jidp->localpart, -1);
+                const char* item_name = xmpp_stanza_get_attribute(child, STANZA_ATTR_NAME);
                 if (item_name) {
-                    g_string_append(item, " (");
-                    g_string_append(item, item_name);
-                    g_string_append(item, ")");
+                    item->name = strdup(item_name);
+                    item->name_key = g_utf8_strdown(item_name, -1);
                 }
-                cons_show("  %s", item->str);
-                g_string_free(item, TRUE);
+                g_ptr_array_add(request->items, item);
+                received++;
             }
         }
         child = xmpp_stanza_get_next(child);
     }
 
-    if (glob && matched == FALSE) {
-        cons_show("  No rooms found matching filter: %s", filter);
+    if (first_page) {
+        _room_list_print_header(request);
     }
+    _room_list_print(request, request->items->len);
 
-    if (glob) {
-        g_pattern_spec_free(glob);
+    // XEP-0059, servers without it answer with everything at once
+    xmpp_stanza_t* set = xmpp_stanza_get_child_by_name_and_ns(query, STANZA_TYPE_SET, STANZA_NS_RSM);
+    xmpp_stanza_t* last = set ? xmpp_stanza_get_child_by_name(set, STANZA_NAME_LAST) : NULL;
+    auto_char char* lastid = last ? xmpp_stanza_get_text(last) : NULL;
+    if (lastid && received > 0) {
+        request->continued = TRUE;
+        _room_list_send(request, lastid);
+        return 0;
+    }
+
+    _room_list_print_end(request);
+
+    if (rooms_cache && prefs_get_boolean(PREF_ROOM_LIST_CACHE)) {
+        RoomList* list = malloc(sizeof(RoomList));
+        list->items = g_ptr_array_ref(request->items);
+        list->fetched = g_get_monotonic_time();
+        g_hash_table_replace(rooms_cache, strdup(request->service), list);
     }
 
     return 0;
@@ -1401,6 +1783,16 @@ _manual_pong_id_handler(xmpp_stanza_t* const stanza, void* const userdata)
     return 0;
 }
 
+static void
+_manual_pong_timeout(const char* const to, void* const userdata)
+{
+    if (to == NULL) {
+        cons_show_error("No ping response from server.");
+    } else {
+        cons_show_error("No ping response from %s.", to);
+    }
+}
+
 static int
 _autoping_timed_send(xmpp_conn_t* const conn, void* const userdata)
 {
@@ -1420,6 +1812,13 @@ _autoping_timed_send(xmpp_conn_t* const conn, void* const userdata)
         return 1;
     }
 
+    // traffic from the server within the last interval already proves
+    // the connection is alive
+    if (g_get_monotonic_time() - autoping_last_inbound < prefs_get_autoping() * G_USEC_PER_SEC) {
+        log_debug("Autoping: Recent traffic from server, skipping ping");
+        return 1;
+    }
+
     xmpp_ctx_t* ctx = (xmpp_ctx_t*)userdata;
     xmpp_stanza_t* iq = stanza_create_ping_iq(ctx, NULL);
     const char* id = xmpp_stanza_get_id(iq);
@@ -1431,10 +1830,11 @@ _autoping_timed_send(xmpp_conn_t* const conn, void* const userdata)
     iq_send_stanza(iq);
     xmpp_stanza_release(iq);
     autoping_wait = TRUE;
-    if (autoping_time) {
-        g_timer_destroy(autoping_time);
+    autoping_sent = g_get_monotonic_time();
+    gint timeout = prefs_get_autoping_timeout();
+    if (timeout > 0 && autoping_timeout == 0) {
+        autoping_timeout = g_timeout_add_seconds(timeout, _autoping_timeout_cb, NULL);
     }
-    autoping_time = g_timer_new();
 
     return 1;
 }
@@ -1442,8 +1842,7 @@ _autoping_timed_send(xmpp_conn_t* const conn, void* const userdata)
 void
 autoping_timer_extend(void)
 {
-    if (autoping_time)
-        g_timer_start(autoping_time);
+    autoping_last_inbound = g_get_monotonic_time();
 }
 
 static int
@@ -1633,9 +2032,8 @@ _version_get_handler(xmpp_stanza_t* const stanza)
     xmpp_ctx_t* const ctx = connection_get_ctx();
     const char* id = xmpp_stanza_get_id(stanza);
     const char* from = xmpp_stanza_get_from(stanza);
-    ProfAccount* account = accounts_get_account(session_get_account_name());
-    auto_char char* client = account->client != NULL ? strdup(account->client) : NULL;
-    account_free(account);
+    const ProfAccount* account = accounts_peek_account(session_get_account_name());
+    auto_char char* client = account && account->client ? strdup(account->client) : NULL;
     bool is_custom_client = client != NULL;
     gchar* custom_version_str = NULL;
     if (is_custom_client) {
@@ -2446,6 +2844,7 @@ _http_upload_response_id_handler(xmpp_stanza_t* const stanza, void* const userda
         } else {
             cons_show_error("Uploading '%s' failed: %s", upload->filename, error_message);
         }
+        http_upload_slot_received(upload, FALSE);
         return 0;
     }
 
@@ -2479,14 +2878,18 @@ _http_upload_response_id_handler(xmpp_stanza_t* const stanza, void* const userda
                 }
             }
 
-            pthread_create(&(upload->worker), NULL, &http_file_put, upload);
-            http_upload_add_upload(upload);
+            if (http_upload_slot_received(upload, TRUE)) {
+                http_upload_add_upload(upload);
+                pthread_create(&(upload->worker), NULL, &http_file_put, upload);
+            }
+            return 0;
         } else {
             log_error("Invalid XML in HTTP Upload slot");
-            return 1;
         }
     }
 
+    cons_show_error("Uploading '%s' failed: No upload slot received", upload->filename);
+    http_upload_slot_received(upload, FALSE);
     return 0;
 }
 
@@ -2559,23 +2962,98 @@ iq_feature_retrieval_complete_handler(void)
     received_disco_items = TRUE;
 }
 
-void
-iq_send_stanza(xmpp_stanza_t* const stanza)
+static void
+_iq_send_raw(xmpp_stanza_t* const stanza)
 {
     char* text;
     size_t text_size;
     xmpp_stanza_to_text(stanza, &text, &text_size);
 
-    xmpp_conn_t* conn = connection_get_conn();
+    stats_stanza_sent(STATS_STANZA_IQ);
     auto_char char* plugin_text = plugins_on_iq_stanza_send(text);
     if (plugin_text) {
-        xmpp_send_raw_string(conn, "%s", plugin_text);
+        connection_send_raw(plugin_text);
     } else {
-        xmpp_send_raw_string(conn, "%s", text);
+        connection_send_raw(text);
     }
     xmpp_free(connection_get_ctx(), text);
 }
 
+static gboolean
+_iq_domain_pump_cb(gpointer data)
+{
+    domain_pump_source = 0;
+    if (!domain_requests || connection_get_status() != JABBER_CONNECTED) {
+        return G_SOURCE_REMOVE;
+    }
+
+    guint limit = prefs_get_iq_inflight();
+    GSList* ready = NULL;
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, domain_requests);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        ProfIqDomain* domain = value;
+        xmpp_stanza_t* stanza;
+        while ((limit == 0 || domain->in_flight < limit) && (stanza = g_queue_pop_head(&domain->pending))) {
+            ProfIqHandler* handler = g_hash_table_lookup(id_handlers, xmpp_stanza_get_id(stanza));
+            if (handler) {
+                handler->queued = NULL;
+                _iq_wheel_arm(handler);
+            }
+            domain->in_flight++;
+            ready = g_slist_prepend(ready, stanza);
+        }
+    }
+
+    // plugins see every send and may send more, so not while iterating
+    ready = g_slist_reverse(ready);
+    for (GSList* curr = ready; curr; curr = curr->next) {
+        _iq_send_raw(curr->data);
+    }
+    g_slist_free_full(ready, (GDestroyNotify)xmpp_stanza_release);
+
+    return G_SOURCE_REMOVE;
+}
+
+void
+iq_send_stanza(xmpp_stanza_t* const stanza)
+{
+    const char* id = xmpp_stanza_get_id(stanza);
+    ProfIqHandler* handler = (id && id_handlers) ? g_hash_table_lookup(id_handlers, id) : NULL;
+
+    // only requests waiting for an answer count against the domain limit
+    if (handler && !handler->domain && domain_requests) {
+        const char* to = xmpp_stanza_get_to(stanza);
+        auto_jid Jid* jid = to ? jid_create(to) : NULL;
+        const char* domainpart = jid ? jid->domainpart : connection_get_domain();
+        if (domainpart) {
+            handler->to = to ? strdup(to) : NULL;
+            handler->domain = strdup(domainpart);
+
+            ProfIqDomain* domain = g_hash_table_lookup(domain_requests, domainpart);
+            if (!domain) {
+                domain = calloc(1, sizeof(ProfIqDomain));
+                g_queue_init(&domain->pending);
+                g_hash_table_insert(domain_requests, strdup(domainpart), domain);
+            }
+
+            guint limit = prefs_get_iq_inflight();
+            if (limit > 0 && domain->in_flight >= limit) {
+                log_debug("Queue IQ %s, %u requests to %s in flight", id, domain->in_flight, domainpart);
+                // its deadline starts once it is actually sent
+                _iq_wheel_unlink(handler);
+                handler->queued = xmpp_stanza_clone(stanza);
+                g_queue_push_tail(&domain->pending, handler->queued);
+                return;
+            }
+            domain->in_flight++;
+        }
+    }
+
+    _iq_send_raw(stanza);
+}
+
 static void
 _iq_free_room_data(ProfRoomInfoData* roominfo)
 {
@@ -2638,8 +3116,9 @@ iq_mam_request_older(ProfChatWin* win)
     }
 
     xmpp_ctx_t* const ctx = connection_get_ctx();
-    xmpp_stanza_t* iq = stanza_create_mam_iq(ctx, win->barejid, NULL, enddate, firstid, NULL);
+    xmpp_stanza_t* iq = stanza_create_mam_iq(ctx, win->barejid, NULL, enddate, firstid, NULL, MESSAGES_TO_RETRIEVE);
     iq_id_handler_add(xmpp_stanza_get_id(iq), _mam_buffer_commit_handler, NULL, win);
+    _iq_id_handler_set_win(xmpp_stanza_get_id(iq), (ProfWin*)win);
 
     message_free(first_msg);
 
@@ -2658,11 +3137,49 @@ _mam_userdata_free(MamRsmUserdata* data)
     data->start_datestr = NULL;
     free(data->barejid);
     data->barejid = NULL;
+    // a page handed over to its follow-up query keeps the sync running
+    if (!data->continued) {
+        _iq_mam_sync_finished();
+    }
     free(data);
 }
 
-void
+static void
+_iq_mam_sync_finished(void)
+{
+    if (mam_syncs_in_flight > 0) {
+        mam_syncs_in_flight--;
+    }
+    if (connection_get_status() != JABBER_CONNECTED) {
+        return;
+    }
+
+    LateDeliveryUserdata* sync;
+    while (mam_syncs_in_flight < MAM_MAX_IN_FLIGHT && (sync = g_queue_pop_head(&mam_pending_syncs))) {
+        log_debug("Start queued MAM sync of %s", sync->win->barejid);
+        _iq_mam_send(sync->win, sync->startdate, sync->enddate);
+        free(sync);
+    }
+}
+
+static void
 _iq_mam_request(ProfChatWin* win, GDateTime* startdate, GDateTime* enddate)
+{
+    if (mam_syncs_in_flight >= MAM_MAX_IN_FLIGHT) {
+        LateDeliveryUserdata* sync = malloc(sizeof(LateDeliveryUserdata));
+        sync->win = win;
+        sync->startdate = startdate;
+        sync->enddate = enddate;
+        g_queue_push_tail(&mam_pending_syncs, sync);
+        log_debug("Queue MAM sync of %s, %u already running", win->barejid, mam_syncs_in_flight);
+        return;
+    }
+
+    _iq_mam_send(win, startdate, enddate);
+}
+
+static void
+_iq_mam_send(ProfChatWin* win, GDateTime* startdate, GDateTime* enddate)
 {
     if (connection_supports(XMPP_FEATURE_MAM2) == FALSE) {
         log_warning("Server doesn't advertise %s feature.", XMPP_FEATURE_MAM2);
@@ -2694,7 +3211,8 @@ _iq_mam_request(ProfChatWin* win, GDateTime* startdate, GDateTime* enddate)
 
     xmpp_ctx_t* const ctx = connection_get_ctx();
 
-    xmpp_stanza_t* iq = stanza_create_mam_iq(ctx, win->barejid, startdate_str, enddate_str, firstid, NULL);
+    // the first page only fills the screen, catching up grows the pages
+    xmpp_stanza_t* iq = stanza_create_mam_iq(ctx, win->barejid, startdate_str, enddate_str, firstid, NULL, MESSAGES_TO_RETRIEVE);
 
     MamRsmUserdata* data = malloc(sizeof(MamRsmUserdata));
     if (data) {
@@ -2702,9 +3220,15 @@ _iq_mam_request(ProfChatWin* win, GDateTime* startdate, GDateTime* enddate)
         data->end_datestr = enddate_str;
         data->barejid = strdup(win->barejid);
         data->fetch_next = fetch_next;
+        data->continued = FALSE;
+        data->page_size = MESSAGES_TO_RETRIEVE;
+        data->first_index = -1;
+        data->server_max = 0;
         data->win = win;
 
+        mam_syncs_in_flight++;
         iq_id_handler_add(xmpp_stanza_get_id(iq), _mam_rsm_id_handler, (ProfIqFreeCallback)_mam_userdata_free, data);
+        _iq_id_handler_set_win(xmpp_stanza_get_id(iq), (ProfWin*)win);
     }
 
     iq_send_stanza(iq);
@@ -2736,6 +3260,98 @@ iq_mam_request(ProfChatWin* win, GDateTime* enddate)
     return;
 }
 
+static void
+_iq_mam_room_send(const char* const room, const char* const startdate, const char* const lastid)
+{
+    xmpp_ctx_t* const ctx = connection_get_ctx();
+    xmpp_stanza_t* iq = stanza_create_room_mam_iq(ctx, room, startdate, lastid, prefs_get_mam_pagesize());
+    iq_id_handler_add(xmpp_stanza_get_id(iq), _mam_room_id_handler, (ProfIqFreeCallback)free, strdup(room));
+
+    iq_send_stanza(iq);
+    xmpp_stanza_release(iq);
+}
+
+// Fetch what a room saw since we last received a message in it from the
+// room's own archive, the results arrive as history of the room
+void
+iq_mam_room_request(ProfMucWin* mucwin)
+{
+    auto_gchar gchar* startdate = g_date_time_format(mucwin->last_msg_timestamp, mam_timestamp_format_string);
+    log_debug("Catch up on %s from its archive since %s", mucwin->roomjid, startdate);
+    _iq_mam_room_send(mucwin->roomjid, startdate, NULL);
+}
+
+static int
+_mam_room_id_handler(xmpp_stanza_t* const stanza, void* const userdata)
+{
+    const char* room = (const char*)userdata;
+    const char* type = xmpp_stanza_get_type(stanza);
+    if (g_strcmp0(type, STANZA_TYPE_ERROR) == 0) {
+        auto_char char* error_message = stanza_get_error_message(stanza);
+        log_warning("MAM catch up of %s failed: %s", room, error_message);
+        return 0;
+    }
+
+    xmpp_stanza_t* fin = xmpp_stanza_get_child_by_name_and_ns(stanza, STANZA_NAME_FIN, STANZA_NS_MAM2);
+    if (!fin || g_strcmp0(xmpp_stanza_get_attribute(fin, "complete"), "true") == 0 || !muc_active(room)) {
+        return 0;
+    }
+
+    // pages go forwards in time, ask for what follows the last one
+    xmpp_stanza_t* set = xmpp_stanza_get_child_by_name_and_ns(fin, STANZA_TYPE_SET, STANZA_NS_RSM);
+    xmpp_stanza_t* last = set ? xmpp_stanza_get_child_by_name(set, STANZA_NAME_LAST) : NULL;
+    if (last) {
+        auto_char char* lastid = xmpp_stanza_get_text(last);
+        if (lastid) {
+            _iq_mam_room_send(room, NULL, lastid);
+        }
+    }
+
+    return 0;
+}
+
+// index attribute of an RSM <first/>, -1 if the server leaves it out
+static int
+_mam_first_index(xmpp_stanza_t* first)
+{
+    const char* index = xmpp_stanza_get_attribute(first, "index");
+    if (!index) {
+        return -1;
+    }
+
+    int result;
+    if (!strtoi_range(index, &result, 0, G_MAXINT, NULL)) {
+        return -1;
+    }
+
+    return result;
+}
+
+// Pages double up to /mam pagesize. Going backwards the index of a page's
+// first item is the number of items left before it, and the distance to the
+// previous page's index is what the server actually returned, a server that
+// caps <max> below what was asked keeps getting asked for its own limit.
+static int
+_mam_next_page_size(MamRsmUserdata* data, int first_index)
+{
+    if (first_index >= 0 && data->first_index > first_index) {
+        int returned = data->first_index - first_index;
+        if (returned < data->page_size) {
+            data->server_max = returned;
+        }
+    }
+
+    int page_size = MIN(data->page_size * 2, prefs_get_mam_pagesize());
+    if (data->server_max > 0) {
+        page_size = MIN(page_size, data->server_max);
+    }
+    if (first_index > 0) {
+        page_size = MIN(page_size, first_index);
+    }
+
+    return MAX(page_size, 1);
+}
+
 static int
 _mam_rsm_id_handler(xmpp_stanza_t* const stanza, void* const userdata)
 {
@@ -2775,7 +3391,11 @@ _mam_rsm_id_handler(xmpp_stanza_t* const stanza, void* const userdata)
                 return 0;
             }
 
-            chatwin_db_history(data->win, start_str, end_str, TRUE);
+            // Messages of intermediate pages are already in the database, a
+            // window in the background picks them up with the last page.
+            if (wins_is_current(window)) {
+                chatwin_db_history(data->win, start_str, end_str, TRUE);
+            }
 
             xmpp_stanza_t* set = xmpp_stanza_get_child_by_name_and_ns(fin, STANZA_TYPE_SET, STANZA_NS_RSM);
             if (set) {
@@ -2785,6 +3405,8 @@ _mam_rsm_id_handler(xmpp_stanza_t* const stanza, void* const userdata)
                 xmpp_stanza_t* first = xmpp_stanza_get_child_by_name(set, STANZA_NAME_FIRST);
                 if (first) {
                     firstid = xmpp_stanza_get_text(first);
+                    int first_index = _mam_first_index(first);
+                    int page_size = _mam_next_page_size(data, first_index);
 
                     // 4.3.2. send same stanza with set,max stanza
                     xmpp_ctx_t* const ctx = connection_get_ctx();
@@ -2793,17 +3415,21 @@ _mam_rsm_id_handler(xmpp_stanza_t* const stanza, void* const userdata)
                         free(data->end_datestr);
                         data->end_datestr = NULL;
                     }
-                    xmpp_stanza_t* iq = stanza_create_mam_iq(ctx, data->barejid, data->start_datestr, NULL, firstid, NULL);
+                    xmpp_stanza_t* iq = stanza_create_mam_iq(ctx, data->barejid, data->start_datestr, NULL, firstid, NULL, page_size);
 
                     MamRsmUserdata* ndata = malloc(sizeof(*ndata));
                     *ndata = *data;
+                    ndata->page_size = page_size;
+                    ndata->first_index = first_index;
                     if (data->end_datestr)
                         ndata->end_datestr = strdup(data->end_datestr);
                     if (data->start_datestr)
                         ndata->start_datestr = strdup(data->start_datestr);
                     if (data->barejid)
                         ndata->barejid = strdup(data->barejid);
+                    data->continued = TRUE;
                     iq_id_handler_add(xmpp_stanza_get_id(iq), _mam_rsm_id_handler, (ProfIqFreeCallback)_mam_userdata_free, ndata);
+                    _iq_id_handler_set_win(xmpp_stanza_get_id(iq), (ProfWin*)ndata->win);
 
                     iq_send_stanza(iq);
                     xmpp_stanza_release(iq);
@@ -38,11 +38,17 @@
 
 typedef int (*ProfIqCallback)(xmpp_stanza_t* const stanza, void* const userdata);
 typedef void (*ProfIqFreeCallback)(void* userdata);
+typedef void (*ProfIqTimeoutCallback)(const char* const to, void* const userdata);
+
+// seconds an IQ may go unanswered before its handler is dropped
+#define IQ_TIMEOUT_DEFAULT 120
 
 void iq_handlers_init(void);
 void iq_feature_retrieval_complete_handler(void);
 void iq_send_stanza(xmpp_stanza_t* const stanza);
 void iq_id_handler_add(const char* const id, ProfIqCallback func, ProfIqFreeCallback free_func, void* userdata);
+void iq_id_handler_add_timeout(const char* const id, ProfIqCallback func, ProfIqFreeCallback free_func, void* userdata,
+                               ProfIqTimeoutCallback timeout_func, guint timeout);
 void iq_disco_info_request_onconnect(const char* jid);
 void iq_disco_items_request_onconnect(const char* jid);
 void iq_send_caps_request(const char* const to, const char* const id, const char* const node, const char* const ver);
@@ -43,16 +43,56 @@
 #include "common.h"
 #include "xmpp/jid.h"
 
+// released JIDs kept for reuse, the least recently released is freed first
+#define JID_POOL_IDLE_MAX 256
+
+// every live or idle Jid by its source string
+static GHashTable* jid_pool = NULL;
+// Jids nobody references any more, most recently released first
+static GQueue jid_idle = G_QUEUE_INIT;
+
+static Jid* _jid_parse(const gchar* const str);
+static void _jid_free(Jid* jid);
+
+/*
+ * Returns the Jid for str, shared with every other holder of the same JID.
+ * The result must not be modified and is released with jid_destroy().
+ */
 Jid*
 jid_create(const gchar* const str)
+{
+    if (str == NULL) {
+        return NULL;
+    }
+
+    if (jid_pool) {
+        Jid* pooled = g_hash_table_lookup(jid_pool, str);
+        if (pooled) {
+            if (pooled->refcnt == 0) {
+                g_queue_delete_link(&jid_idle, pooled->idle_link);
+                pooled->idle_link = NULL;
+            }
+            pooled->refcnt++;
+            return pooled;
+        }
+    } else {
+        jid_pool = g_hash_table_new(g_str_hash, g_str_equal);
+    }
+
+    Jid* result = _jid_parse(str);
+    if (result) {
+        g_hash_table_insert(jid_pool, result->str, result);
+    }
+
+    return result;
+}
+
+static Jid*
+_jid_parse(const gchar* const str)
 {
     Jid* result = NULL;
 
-    /* if str is NULL g_strdup returns NULL */
     gchar* trimmed = g_strdup(str);
-    if (trimmed == NULL) {
-        return NULL;
-    }
 
     if (strlen(trimmed) == 0) {
         g_free(trimmed);
@@ -70,13 +110,14 @@ jid_create(const gchar* const str)
     }
 
     result = malloc(sizeof(struct jid_t));
-    result->str = NULL;
+    result->str = trimmed;
     result->localpart = NULL;
     result->domainpart = NULL;
     result->resourcepart = NULL;
     result->barejid = NULL;
     result->fulljid = NULL;
     result->refcnt = 1;
+    result->idle_link = NULL;
 
     gchar* atp = g_utf8_strchr(trimmed, -1, '@');
     gchar* slashp = g_utf8_strchr(trimmed, -1, '/');
@@ -92,19 +133,23 @@ jid_create(const gchar* const str)
         result->domainpart = g_utf8_substring(domain_start, 0, g_utf8_pointer_to_offset(domain_start, slashp));
         auto_gchar gchar* barejidraw = g_utf8_substring(trimmed, 0, g_utf8_pointer_to_offset(trimmed, slashp));
         result->barejid = g_utf8_strdown(barejidraw, -1);
-        result->fulljid = g_strdup(trimmed);
+        // the full JID is the source string
+        result->fulljid = trimmed;
     } else {
         result->domainpart = g_strdup(domain_start);
         result->barejid = g_utf8_strdown(trimmed, -1);
+        // share the source string when it is already lower case
+        if (g_strcmp0(result->barejid, trimmed) == 0) {
+            g_free(result->barejid);
+            result->barejid = trimmed;
+        }
     }
 
     if (result->domainpart == NULL) {
-        jid_destroy(result);
+        _jid_free(result);
         return NULL;
     }
 
-    result->str = trimmed;
-
     return result;
 }
 
@@ -140,12 +185,41 @@ jid_destroy(Jid* jid)
         return;
     }
 
+    // keep it for the next jid_create() of the same string
+    jid->refcnt = 0;
+    g_queue_push_head(&jid_idle, jid);
+    jid->idle_link = jid_idle.head;
+
+    if (jid_idle.length > JID_POOL_IDLE_MAX) {
+        Jid* oldest = g_queue_pop_tail(&jid_idle);
+        g_hash_table_remove(jid_pool, oldest->str);
+        _jid_free(oldest);
+    }
+}
+
+/*
+ * Free the JIDs kept for reuse, JIDs still referenced stay valid
+ */
+void
+jid_pool_clear(void)
+{
+    Jid* jid;
+    while ((jid = g_queue_pop_head(&jid_idle))) {
+        g_hash_table_remove(jid_pool, jid->str);
+        _jid_free(jid);
+    }
+}
+
+static void
+_jid_free(Jid* jid)
+{
+    if (jid->barejid != jid->str) {
+        g_free(jid->barejid);
+    }
     g_free(jid->str);
     g_free(jid->localpart);
     g_free(jid->domainpart);
     g_free(jid->resourcepart);
-    g_free(jid->barejid);
-    g_free(jid->fulljid);
     free(jid);
 }
 
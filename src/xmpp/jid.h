@@ -47,6 +47,8 @@ struct jid_t
     char* resourcepart;
     char* barejid;
     char* fulljid;
+    // position in the idle pool when refcnt is 0, owned by jid.c
+    GList* idle_link;
 };
 
 typedef struct jid_t Jid;
@@ -55,6 +57,7 @@ Jid* jid_create(const gchar* const str);
 Jid* jid_create_from_bare_and_resource(const char* const barejid, const char* const resource);
 void jid_destroy(Jid* jid);
 void jid_ref(Jid* jid);
+void jid_pool_clear(void);
 
 void jid_auto_destroy(Jid** str);
 #define auto_jid __attribute__((__cleanup__(jid_auto_destroy)))
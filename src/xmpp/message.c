@@ -43,11 +43,13 @@
 
 #include "profanity.h"
 #include "log.h"
+#include "stats.h"
 #include "config/preferences.h"
 #include "event/server_events.h"
 #include "pgp/gpg.h"
 #include "pgp/ox.h"
 #include "plugins/plugins.h"
+#include "tools/base64.h"
 #include "ui/ui.h"
 #include "ui/window_list.h"
 #include "xmpp/chat_session.h"
@@ -74,22 +76,44 @@ typedef struct p_message_handle_t
     void* userdata;
 } ProfMessageHandler;
 
+// children of a <message> that decide how it is handled, found in one pass
+typedef struct p_message_children_t
+{
+    xmpp_stanza_t* propose;
+    xmpp_stanza_t* form;
+    xmpp_stanza_t* mam_result;
+    xmpp_stanza_t* muc_user;
+    xmpp_stanza_t* conference;
+    xmpp_stanza_t* captcha;
+    xmpp_stanza_t* receipt;
+    xmpp_stanza_t* pubsub_event;
+    xmpp_stanza_t* carbon_sent;
+    xmpp_stanza_t* carbon_received;
+} ProfMessageChildren;
+
 static int _message_handler(xmpp_conn_t* const conn, xmpp_stanza_t* const stanza, void* const userdata);
+static int _message_handler_traced(xmpp_conn_t* const conn, xmpp_stanza_t* const stanza, void* const userdata);
 static void _handle_error(xmpp_stanza_t* const stanza);
 static void _handle_groupchat(xmpp_stanza_t* const stanza);
-static void _handle_muc_user(xmpp_stanza_t* const stanza);
+static ProfMessage* _muc_message_new(xmpp_stanza_t* const stanza, Jid* from_jid);
+static void _handle_groupchat_mam(xmpp_stanza_t* const stanza, xmpp_stanza_t* const message_stanza, const char* const result_id, GDateTime* timestamp);
+static void _handle_muc_user(xmpp_stanza_t* const stanza, xmpp_stanza_t* const xns_muc_user);
 static void _handle_muc_private_message(xmpp_stanza_t* const stanza);
-static void _handle_conference(xmpp_stanza_t* const stanza);
+static void _handle_conference(xmpp_stanza_t* const stanza, xmpp_stanza_t* const xns_conference);
 static void _handle_captcha(xmpp_stanza_t* const stanza);
-static void _handle_receipt_received(xmpp_stanza_t* const stanza);
+static void _handle_receipt_received(xmpp_stanza_t* const stanza, xmpp_stanza_t* const receipt);
 static void _handle_chat(xmpp_stanza_t* const stanza, gboolean is_mam, gboolean is_carbon, const char* result_id, GDateTime* timestamp);
 static void _handle_ox_chat(xmpp_stanza_t* const stanza, ProfMessage* message, gboolean is_mam);
 static xmpp_stanza_t* _handle_carbons(xmpp_stanza_t* const stanza);
 static void _send_message_stanza(xmpp_stanza_t* const stanza);
-static gboolean _handle_mam(xmpp_stanza_t* const stanza);
+static void _send_message_text(const char* const text);
+static gboolean _handle_mam(xmpp_stanza_t* const stanza, xmpp_stanza_t* const result);
 static void _handle_pubsub(xmpp_stanza_t* const stanza, xmpp_stanza_t* const event);
-static gboolean _handle_form(xmpp_stanza_t* const stanza);
-static gboolean _handle_jingle_message(xmpp_stanza_t* const stanza);
+static gboolean _handle_form(xmpp_stanza_t* const stanza, xmpp_stanza_t* const result);
+static gboolean _handle_jingle_message(xmpp_stanza_t* const stanza, xmpp_stanza_t* const propose);
+static void _message_children(xmpp_stanza_t* const stanza, ProfMessageChildren* children);
+static void _pending_receipts_clear(void);
+static gboolean _message_id_seen(const char* const kind, const char* const scope, const char* const id);
 static gboolean _should_ignore_based_on_silence(xmpp_stanza_t* const stanza);
 
 #ifdef HAVE_LIBGPGME
@@ -98,6 +122,36 @@ static xmpp_stanza_t* _ox_openpgp_signcrypt(xmpp_ctx_t* ctx, const char* const t
 
 static GHashTable* pubsub_event_handlers;
 
+// receipts for delayed (offline) messages, sent a few at a time so a catch-up
+// burst doesn't put hundreds of stanzas in front of the incoming traffic
+typedef struct p_pending_receipt_t
+{
+    char* fulljid;
+    char* id;
+} ProfPendingReceipt;
+
+#define RECEIPT_BATCH_SIZE        10
+#define RECEIPT_BATCH_INTERVAL_MS 200
+
+static GQueue pending_receipts = G_QUEUE_INIT;
+static guint pending_receipts_timer = 0;
+
+// stanza-ids and origin-ids of recent chat messages, oldest first, so a message
+// arriving by both carbons and MAM is dropped before decryption and logging
+#define SEEN_IDS_MAX 1024
+
+static GHashTable* seen_ids = NULL;
+static GQueue seen_ids_order = G_QUEUE_INIT;
+
+// messages from unknown senders held back by /silence quarantine, one entry
+// per sender so a spam wave costs a counter increment per message
+#define MESSAGE_REQUESTS_MAX 500
+
+static GHashTable* message_requests = NULL;
+static GHashTable* accepted_senders = NULL;
+static guint message_requests_overflow = 0;
+static gboolean message_requests_notified = FALSE;
+
 gchar*
 get_display_name(const ProfMessage* const message, int* flags)
 {
@@ -113,14 +167,7 @@ get_display_name(const ProfMessage* const message, int* flags)
 static gboolean
 _handled_by_plugin(xmpp_stanza_t* const stanza)
 {
-    char* text;
-    size_t text_size;
-
-    xmpp_stanza_to_text(stanza, &text, &text_size);
-    gboolean cont = plugins_on_message_stanza_receive(text);
-    xmpp_free(connection_get_ctx(), text);
-
-    return !cont;
+    return !plugins_on_message_stanza_receive(stanza);
 }
 
 static void
@@ -161,18 +208,42 @@ _handle_chat_states(xmpp_stanza_t* const stanza, Jid* const jid)
     }
 }
 
+// the span covers everything the stanza sets off, sv_ev_* handlers included
+static int
+_message_handler_traced(xmpp_conn_t* const conn, xmpp_stanza_t* const stanza, void* const userdata)
+{
+    gint64 start = stats_trace_begin();
+    int res = _message_handler(conn, stanza, userdata);
+    stats_span("message_handler", start);
+
+    return res;
+}
+
 static int
 _message_handler(xmpp_conn_t* const conn, xmpp_stanza_t* const stanza, void* const userdata)
 {
-    log_debug("Message stanza handler fired");
     autoping_timer_extend();
+    stats_stanza_received(STATS_STANZA_MESSAGE);
 
-    if (_handled_by_plugin(stanza)) {
+    // reject floods before plugins, parsing or logging get to see them
+    if (blocked_contains(xmpp_stanza_get_from(stanza))) {
         return 1;
     }
 
     // type according to RFC 6121
     const char* type = xmpp_stanza_get_type(stanza);
+    gboolean is_chat = type == NULL || g_strcmp0(type, STANZA_TYPE_CHAT) == 0 || g_strcmp0(type, STANZA_TYPE_NORMAL) == 0;
+
+    // ignore all messages from JIDs that are not in roster, if 'silence' is set
+    if (is_chat && _should_ignore_based_on_silence(stanza)) {
+        return 1;
+    }
+
+    log_debug("Message stanza handler fired");
+
+    if (_handled_by_plugin(stanza)) {
+        return 1;
+    }
 
     if (type && g_strcmp0(type, STANZA_TYPE_ERROR) == 0) {
         _handle_error(stanza);
@@ -181,67 +252,60 @@ _message_handler(xmpp_conn_t* const conn, xmpp_stanza_t* const stanza, void* con
         _handle_groupchat(stanza);
 
     } else if (type && g_strcmp0(type, STANZA_TYPE_HEADLINE) == 0) {
-        xmpp_stanza_t* event = xmpp_stanza_get_child_by_ns(stanza, STANZA_NS_PUBSUB_EVENT);
+        ProfMessageChildren children;
+        _message_children(stanza, &children);
         // TODO: do we want to handle all pubsub here or should additionally check for STANZA_NS_MOOD?
-        if (event) {
-            _handle_pubsub(stanza, event);
+        if (children.pubsub_event) {
+            _handle_pubsub(stanza, children.pubsub_event);
             return 1;
         } else {
             _handle_headline(stanza);
         }
-    } else if (type == NULL || g_strcmp0(type, STANZA_TYPE_CHAT) == 0 || g_strcmp0(type, STANZA_TYPE_NORMAL) == 0) {
+    } else if (is_chat) {
         // type: chat, normal (==NULL)
-
-        // ignore all messages from JIDs that are not in roster, if 'silence' is set
-        if (_should_ignore_based_on_silence(stanza)) {
-            return 1;
-        }
+        ProfMessageChildren children;
+        _message_children(stanza, &children);
 
         // XEP-0353: Jingle Message Initiation
-        if (_handle_jingle_message(stanza)) {
+        if (children.propose && _handle_jingle_message(stanza, children.propose)) {
             return 1;
         }
 
         // XEP-0045: Multi-User Chat 8.6 Voice Requests
-        if (_handle_form(stanza)) {
+        if (children.form && _handle_form(stanza, children.form)) {
             return 1;
         }
 
         // XEP-0313: Message Archive Management
-        if (_handle_mam(stanza)) {
+        if (children.mam_result && _handle_mam(stanza, children.mam_result)) {
             return 1;
         }
 
         // XEP-0045: Multi-User Chat - invites - presence
-        xmpp_stanza_t* mucuser = xmpp_stanza_get_child_by_ns(stanza, STANZA_NS_MUC_USER);
-        if (mucuser) {
-            _handle_muc_user(stanza);
+        if (children.muc_user) {
+            _handle_muc_user(stanza, children.muc_user);
         }
 
         // XEP-0249: Direct MUC Invitations
-        xmpp_stanza_t* conference = xmpp_stanza_get_child_by_ns(stanza, STANZA_NS_CONFERENCE);
-        if (conference) {
-            _handle_conference(stanza);
+        if (children.conference) {
+            _handle_conference(stanza, children.conference);
             return 1;
         }
 
         // XEP-0158: CAPTCHA Forms
-        xmpp_stanza_t* captcha = xmpp_stanza_get_child_by_ns(stanza, STANZA_NS_CAPTCHA);
-        if (captcha) {
+        if (children.captcha) {
             _handle_captcha(stanza);
             return 1;
         }
 
         // XEP-0184: Message Delivery Receipts
-        xmpp_stanza_t* receipts = xmpp_stanza_get_child_by_ns(stanza, STANZA_NS_RECEIPTS);
-        if (receipts) {
-            _handle_receipt_received(stanza);
+        if (children.receipt) {
+            _handle_receipt_received(stanza, children.receipt);
         }
 
         // XEP-0060: Publish-Subscribe
-        xmpp_stanza_t* event = xmpp_stanza_get_child_by_ns(stanza, STANZA_NS_PUBSUB_EVENT);
-        if (event) {
-            _handle_pubsub(stanza, event);
+        if (children.pubsub_event) {
+            _handle_pubsub(stanza, children.pubsub_event);
             return 1;
         }
 
@@ -251,10 +315,7 @@ _message_handler(xmpp_conn_t* const conn, xmpp_stanza_t* const stanza, void* con
         // XEP-0280: Message Carbons
         // Only allow `<sent xmlns='urn:xmpp:carbons:2'>` and `<received xmlns='urn:xmpp:carbons:2'>` carbons
         // Thus ignoring `<private xmlns="urn:xmpp:carbons:2"/>`
-        xmpp_stanza_t* carbons = xmpp_stanza_get_child_by_name_and_ns(stanza, STANZA_NAME_SENT, STANZA_NS_CARBONS);
-        if (!carbons) {
-            carbons = xmpp_stanza_get_child_by_name_and_ns(stanza, STANZA_NAME_RECEIVED, STANZA_NS_CARBONS);
-        }
+        xmpp_stanza_t* carbons = children.carbon_sent ? children.carbon_sent : children.carbon_received;
 
         if (carbons) {
 
@@ -290,6 +351,62 @@ _message_handler(xmpp_conn_t* const conn, xmpp_stanza_t* const stanza, void* con
     return 1;
 }
 
+// Same matches as the xmpp_stanza_get_child_by_ns() and
+// xmpp_stanza_get_child_by_name_and_ns() lookups they replace, first child wins
+static void
+_message_children(xmpp_stanza_t* const stanza, ProfMessageChildren* children)
+{
+    memset(children, 0, sizeof(ProfMessageChildren));
+
+    for (xmpp_stanza_t* child = xmpp_stanza_get_children(stanza); child; child = xmpp_stanza_get_next(child)) {
+        const char* ns = xmpp_stanza_get_ns(child);
+        if (!ns) {
+            continue;
+        }
+        const char* name = xmpp_stanza_get_name(child);
+
+        if (g_strcmp0(ns, STANZA_NS_MUC_USER) == 0) {
+            if (!children->muc_user) {
+                children->muc_user = child;
+            }
+        } else if (g_strcmp0(ns, STANZA_NS_CONFERENCE) == 0) {
+            if (!children->conference) {
+                children->conference = child;
+            }
+        } else if (g_strcmp0(ns, STANZA_NS_CAPTCHA) == 0) {
+            if (!children->captcha) {
+                children->captcha = child;
+            }
+        } else if (g_strcmp0(ns, STANZA_NS_RECEIPTS) == 0) {
+            if (!children->receipt) {
+                children->receipt = child;
+            }
+        } else if (g_strcmp0(ns, STANZA_NS_PUBSUB_EVENT) == 0) {
+            if (!children->pubsub_event) {
+                children->pubsub_event = child;
+            }
+        } else if (g_strcmp0(ns, STANZA_NS_CARBONS) == 0) {
+            if (!children->carbon_sent && g_strcmp0(name, STANZA_NAME_SENT) == 0) {
+                children->carbon_sent = child;
+            } else if (!children->carbon_received && g_strcmp0(name, STANZA_NAME_RECEIVED) == 0) {
+                children->carbon_received = child;
+            }
+        } else if (g_strcmp0(ns, STANZA_NS_MAM2) == 0) {
+            if (!children->mam_result && g_strcmp0(name, STANZA_NAME_RESULT) == 0) {
+                children->mam_result = child;
+            }
+        } else if (g_strcmp0(ns, STANZA_NS_DATA) == 0) {
+            if (!children->form && g_strcmp0(name, STANZA_NAME_X) == 0) {
+                children->form = child;
+            }
+        } else if (g_strcmp0(ns, STANZA_NS_JINGLE_MESSAGE) == 0) {
+            if (!children->propose && g_strcmp0(name, STANZA_NAME_PROPOSE) == 0) {
+                children->propose = child;
+            }
+        }
+    }
+}
+
 void
 message_muc_submit_voice_approve(ProfConfWin* confwin)
 {
@@ -301,13 +418,8 @@ message_muc_submit_voice_approve(ProfConfWin* confwin)
 }
 
 static gboolean
-_handle_form(xmpp_stanza_t* const stanza)
+_handle_form(xmpp_stanza_t* const stanza, xmpp_stanza_t* const result)
 {
-    xmpp_stanza_t* result = xmpp_stanza_get_child_by_name_and_ns(stanza, STANZA_NAME_X, STANZA_NS_DATA);
-    if (!result) {
-        return FALSE;
-    }
-
     const char* const stanza_from = xmpp_stanza_get_from(stanza);
     if (!stanza_from) {
         return FALSE;
@@ -325,7 +437,7 @@ message_handlers_init(void)
 {
     xmpp_conn_t* const conn = connection_get_conn();
     xmpp_ctx_t* const ctx = connection_get_ctx();
-    xmpp_handler_add(conn, _message_handler, NULL, STANZA_NAME_MESSAGE, NULL, ctx);
+    xmpp_handler_add(conn, _message_handler_traced, NULL, STANZA_NAME_MESSAGE, NULL, ctx);
 
     if (pubsub_event_handlers) {
         GList* keys = g_hash_table_get_keys(pubsub_event_handlers);
@@ -419,6 +531,7 @@ message_handlers_clear(void)
     if (pubsub_event_handlers) {
         g_hash_table_remove_all(pubsub_event_handlers);
     }
+    _pending_receipts_clear();
 }
 
 void
@@ -478,8 +591,8 @@ message_send_chat_pgp(const char* const barejid, const char* const msg, gboolean
     xmpp_stanza_t* message = NULL;
 #ifdef HAVE_LIBGPGME
     char* account_name = session_get_account_name();
-    ProfAccount* account = accounts_get_account(account_name);
-    if (account->pgp_keyid) {
+    const ProfAccount* account = accounts_peek_account(account_name);
+    if (account && account->pgp_keyid) {
         auto_jid Jid* jidp = jid_create(jid);
         auto_char char* encrypted = p_gpg_encrypt(jidp->barejid, msg, account->pgp_keyid);
         if (encrypted) {
@@ -502,7 +615,6 @@ message_send_chat_pgp(const char* const barejid, const char* const msg, gboolean
         message = xmpp_message_new(ctx, STANZA_TYPE_CHAT, jid, id);
         xmpp_message_set_body(message, msg);
     }
-    account_free(account);
 #else
     // ?
     message = xmpp_message_new(ctx, STANZA_TYPE_CHAT, jid, id);
@@ -541,7 +653,7 @@ message_send_chat_ox(const char* const barejid, const char* const msg, gboolean
     xmpp_stanza_t* message = NULL;
 
     char* account_name = session_get_account_name();
-    ProfAccount* account = accounts_get_account(account_name);
+    const ProfAccount* account = accounts_peek_account(account_name);
 
     message = xmpp_message_new(ctx, STANZA_TYPE_CHAT, jid, id);
     xmpp_message_set_body(message, "This message is encrypted (XEP-0373: OpenPGP for XMPP).");
@@ -568,8 +680,6 @@ message_send_chat_ox(const char* const barejid, const char* const msg, gboolean
 
     xmpp_stanza_to_text(message, &c, &s);
 
-    account_free(account);
-
     if (state) {
         stanza_attach_state(ctx, message, state);
     }
@@ -662,7 +772,7 @@ message_send_chat_omemo(const char* const jid, uint32_t sid, GList* keys,
             xmpp_stanza_set_attribute(key_stanza, "prekey", "true");
         }
 
-        auto_gchar gchar* key_raw = g_base64_encode(key->data, key->length);
+        auto_gchar gchar* key_raw = base64_encode(key->data, key->length);
         xmpp_stanza_t* key_text = xmpp_stanza_new(ctx);
         xmpp_stanza_set_text(key_text, key_raw);
 
@@ -675,7 +785,7 @@ message_send_chat_omemo(const char* const jid, uint32_t sid, GList* keys,
     xmpp_stanza_t* iv_stanza = xmpp_stanza_new(ctx);
     xmpp_stanza_set_name(iv_stanza, "iv");
 
-    auto_gchar gchar* iv_raw = g_base64_encode(iv, iv_len);
+    auto_gchar gchar* iv_raw = base64_encode(iv, iv_len);
     xmpp_stanza_t* iv_text = xmpp_stanza_new(ctx);
     xmpp_stanza_set_text(iv_text, iv_raw);
 
@@ -690,7 +800,7 @@ message_send_chat_omemo(const char* const jid, uint32_t sid, GList* keys,
     xmpp_stanza_t* payload = xmpp_stanza_new(ctx);
     xmpp_stanza_set_name(payload, "payload");
 
-    auto_gchar gchar* ciphertext_raw = g_base64_encode(ciphertext, ciphertext_len);
+    auto_gchar gchar* ciphertext_raw = base64_encode(ciphertext, ciphertext_len);
     xmpp_stanza_t* payload_text = xmpp_stanza_new(ctx);
     xmpp_stanza_set_text(payload_text, ciphertext_raw);
 
@@ -809,39 +919,29 @@ message_send_invite(const char* const roomjid, const char* const contact,
 void
 message_send_composing(const char* const jid)
 {
-    xmpp_ctx_t* const ctx = connection_get_ctx();
-
-    xmpp_stanza_t* stanza = stanza_create_chat_state(ctx, jid, STANZA_NAME_COMPOSING);
-    _send_message_stanza(stanza);
-    xmpp_stanza_release(stanza);
+    auto_gchar gchar* text = stanza_text_chat_state(jid, STANZA_NAME_COMPOSING);
+    _send_message_text(text);
 }
 
 void
 message_send_paused(const char* const jid)
 {
-    xmpp_ctx_t* const ctx = connection_get_ctx();
-    xmpp_stanza_t* stanza = stanza_create_chat_state(ctx, jid, STANZA_NAME_PAUSED);
-    _send_message_stanza(stanza);
-    xmpp_stanza_release(stanza);
+    auto_gchar gchar* text = stanza_text_chat_state(jid, STANZA_NAME_PAUSED);
+    _send_message_text(text);
 }
 
 void
 message_send_inactive(const char* const jid)
 {
-    xmpp_ctx_t* const ctx = connection_get_ctx();
-    xmpp_stanza_t* stanza = stanza_create_chat_state(ctx, jid, STANZA_NAME_INACTIVE);
-
-    _send_message_stanza(stanza);
-    xmpp_stanza_release(stanza);
+    auto_gchar gchar* text = stanza_text_chat_state(jid, STANZA_NAME_INACTIVE);
+    _send_message_text(text);
 }
 
 void
 message_send_gone(const char* const jid)
 {
-    xmpp_ctx_t* const ctx = connection_get_ctx();
-    xmpp_stanza_t* stanza = stanza_create_chat_state(ctx, jid, STANZA_NAME_GONE);
-    _send_message_stanza(stanza);
-    xmpp_stanza_release(stanza);
+    auto_gchar gchar* text = stanza_text_chat_state(jid, STANZA_NAME_GONE);
+    _send_message_text(text);
 }
 
 static void
@@ -892,16 +992,11 @@ _handle_error(xmpp_stanza_t* const stanza)
 }
 
 static void
-_handle_muc_user(xmpp_stanza_t* const stanza)
+_handle_muc_user(xmpp_stanza_t* const stanza, xmpp_stanza_t* const xns_muc_user)
 {
     xmpp_ctx_t* ctx = connection_get_ctx();
-    xmpp_stanza_t* xns_muc_user = xmpp_stanza_get_child_by_ns(stanza, STANZA_NS_MUC_USER);
     const char* room = xmpp_stanza_get_from(stanza);
 
-    if (!xns_muc_user) {
-        return;
-    }
-
     if (!room) {
         log_warning("Message received with no from attribute, ignoring");
         return;
@@ -947,10 +1042,8 @@ _handle_muc_user(xmpp_stanza_t* const stanza)
 }
 
 static void
-_handle_conference(xmpp_stanza_t* const stanza)
+_handle_conference(xmpp_stanza_t* const stanza, xmpp_stanza_t* const xns_conference)
 {
-    xmpp_stanza_t* xns_conference = xmpp_stanza_get_child_by_ns(stanza, STANZA_NS_CONFERENCE);
-
     if (xns_conference) {
         // XEP-0249
         const char* room = xmpp_stanza_get_attribute(xns_conference, STANZA_ATTR_JID);
@@ -1085,6 +1178,56 @@ _handle_groupchat(xmpp_stanza_t* const stanza)
         return;
     }
 
+    ProfMessage* message = _muc_message_new(stanza, from_jid);
+    if (!message) {
+        return;
+    }
+
+    // determine if the notifications happened whilst offline (MUC history)
+    message->timestamp = stanza_get_delay_from(stanza, from_jid->barejid);
+    if (message->timestamp == NULL) {
+        // checking the domainpart is a workaround for some prosody versions (gh#1190)
+        message->timestamp = stanza_get_delay_from(stanza, from_jid->domainpart);
+    }
+
+    bool is_muc_history = FALSE;
+    if (message->timestamp != NULL) {
+        is_muc_history = TRUE;
+        g_date_time_unref(message->timestamp);
+        message->timestamp = NULL;
+    }
+
+    // we want to display the oldest delay
+    message->timestamp = stanza_get_oldest_delay(stanza);
+
+    // now this has nothing to do with MUC history
+    // it's just setting the time to the received time so upon displaying we can use this time
+    // for example in win_println_incoming_muc_msg()
+    if (!message->timestamp) {
+        message->timestamp = g_date_time_new_now_local();
+    }
+
+    if (is_muc_history) {
+        sv_ev_room_history(message);
+    } else {
+        // XEP-0308 states: `corrections must not be allowed (by the receiver) for messages received before the sender joined the room`
+        xmpp_stanza_t* replace_id_stanza = xmpp_stanza_get_child_by_ns(stanza, STANZA_NS_LAST_MESSAGE_CORRECTION);
+        if (replace_id_stanza) {
+            const char* replace_id = xmpp_stanza_get_id(replace_id_stanza);
+            if (replace_id) {
+                message->replace_id = strdup(replace_id);
+            }
+        }
+        sv_ev_room_message(message);
+    }
+
+    message_free(message);
+}
+
+// NULL for room messages that carry nothing to show
+static ProfMessage*
+_muc_message_new(xmpp_stanza_t* const stanza, Jid* from_jid)
+{
     ProfMessage* message = message_init();
     jid_ref(from_jid);
     message->from_jid = from_jid;
@@ -1124,77 +1267,61 @@ _handle_groupchat(xmpp_stanza_t* const stanza)
 
     if (!message->plain && !message->body) {
         log_info("Message received without body for room: %s", from_jid->str);
-        goto out;
+        message_free(message);
+        return NULL;
     } else if (!message->plain) {
         message->plain = strdup(message->body);
     }
 
-    // determine if the notifications happened whilst offline (MUC history)
-    message->timestamp = stanza_get_delay_from(stanza, from_jid->barejid);
-    if (message->timestamp == NULL) {
-        // checking the domainpart is a workaround for some prosody versions (gh#1190)
-        message->timestamp = stanza_get_delay_from(stanza, from_jid->domainpart);
-    }
+    return message;
+}
 
-    bool is_muc_history = FALSE;
-    if (message->timestamp != NULL) {
-        is_muc_history = TRUE;
-        g_date_time_unref(message->timestamp);
-        message->timestamp = NULL;
+// A page of a room's archive requested by iq_mam_room_request(), shown and
+// logged like the discussion history it replaces
+static void
+_handle_groupchat_mam(xmpp_stanza_t* const stanza, xmpp_stanza_t* const message_stanza, const char* const result_id, GDateTime* timestamp)
+{
+    const char* from = xmpp_stanza_get_from(message_stanza);
+    auto_jid Jid* from_jid = from ? jid_create(from) : NULL;
+
+    // only the room itself may answer for its archive
+    if (!from_jid || !from_jid->resourcepart || g_strcmp0(xmpp_stanza_get_from(stanza), from_jid->barejid) != 0 || !muc_active(from_jid->barejid)) {
+        log_warning("Dropping archived room message not from the room archive: %s", from ? from : "");
+        if (timestamp) {
+            g_date_time_unref(timestamp);
+        }
+        return;
     }
 
-    // we want to display the oldest delay
-    message->timestamp = stanza_get_oldest_delay(stanza);
-
-    // now this has nothing to do with MUC history
-    // it's just setting the time to the received time so upon displaying we can use this time
-    // for example in win_println_incoming_muc_msg()
-    if (!message->timestamp) {
-        message->timestamp = g_date_time_new_now_local();
+    ProfMessage* message = _muc_message_new(message_stanza, from_jid);
+    if (!message) {
+        if (timestamp) {
+            g_date_time_unref(timestamp);
+        }
+        return;
     }
 
-    if (is_muc_history) {
-        sv_ev_room_history(message);
-    } else {
-        // XEP-0308 states: `corrections must not be allowed (by the receiver) for messages received before the sender joined the room`
-        xmpp_stanza_t* replace_id_stanza = xmpp_stanza_get_child_by_ns(stanza, STANZA_NS_LAST_MESSAGE_CORRECTION);
-        if (replace_id_stanza) {
-            const char* replace_id = xmpp_stanza_get_id(replace_id_stanza);
-            if (replace_id) {
-                message->replace_id = strdup(replace_id);
-            }
-        }
-        sv_ev_room_message(message);
+    message->is_mam = TRUE;
+    if (result_id) {
+        free(message->stanzaid);
+        message->stanzaid = strdup(result_id);
     }
+    message->timestamp = timestamp ? timestamp : g_date_time_new_now_local();
 
-out:
+    sv_ev_room_history(message);
     message_free(message);
 }
 
 static void
 _message_send_receipt(const char* const fulljid, const char* const message_id)
 {
-    xmpp_ctx_t* const ctx = connection_get_ctx();
-
-    auto_char char* id = connection_create_stanza_id();
-    xmpp_stanza_t* message = xmpp_message_new(ctx, NULL, fulljid, id);
-
-    xmpp_stanza_t* receipt = xmpp_stanza_new(ctx);
-    xmpp_stanza_set_name(receipt, "received");
-    xmpp_stanza_set_ns(receipt, STANZA_NS_RECEIPTS);
-    xmpp_stanza_set_id(receipt, message_id);
-
-    xmpp_stanza_add_child(message, receipt);
-    xmpp_stanza_release(receipt);
-
-    _send_message_stanza(message);
-    xmpp_stanza_release(message);
+    auto_gchar gchar* text = stanza_text_receipt(fulljid, message_id);
+    _send_message_text(text);
 }
 
 static void
-_handle_receipt_received(xmpp_stanza_t* const stanza)
+_handle_receipt_received(xmpp_stanza_t* const stanza, xmpp_stanza_t* const receipt)
 {
-    xmpp_stanza_t* receipt = xmpp_stanza_get_child_by_ns(stanza, STANZA_NS_RECEIPTS);
     if (receipt) {
         const char* name = xmpp_stanza_get_name(receipt);
         if ((name == NULL) || (g_strcmp0(name, "received") != 0)) {
@@ -1221,12 +1348,51 @@ _handle_receipt_received(xmpp_stanza_t* const stanza)
 }
 
 static void
-_receipt_request_handler(xmpp_stanza_t* const stanza)
+_pending_receipt_free(ProfPendingReceipt* receipt)
+{
+    free(receipt->fulljid);
+    free(receipt->id);
+    free(receipt);
+}
+
+static void
+_pending_receipts_clear(void)
+{
+    if (pending_receipts_timer) {
+        g_source_remove(pending_receipts_timer);
+        pending_receipts_timer = 0;
+    }
+    g_queue_clear_full(&pending_receipts, (GDestroyNotify)_pending_receipt_free);
+}
+
+static gboolean
+_pending_receipts_send(gpointer data)
+{
+    for (int i = 0; i < RECEIPT_BATCH_SIZE && !g_queue_is_empty(&pending_receipts); i++) {
+        ProfPendingReceipt* receipt = g_queue_pop_head(&pending_receipts);
+        _message_send_receipt(receipt->fulljid, receipt->id);
+        _pending_receipt_free(receipt);
+    }
+
+    if (g_queue_is_empty(&pending_receipts)) {
+        pending_receipts_timer = 0;
+        return G_SOURCE_REMOVE;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+static void
+_receipt_request_handler(xmpp_stanza_t* const stanza, gboolean is_mam, gboolean delayed)
 {
     if (!prefs_get_boolean(PREF_RECEIPTS_SEND)) {
         return;
     }
 
+    // archived messages were delivered when they were first received
+    if (is_mam) {
+        return;
+    }
+
     const char* id = xmpp_stanza_get_id(stanza);
     if (!id) {
         return;
@@ -1245,8 +1411,21 @@ _receipt_request_handler(xmpp_stanza_t* const stanza)
     const gchar* from = xmpp_stanza_get_from(stanza);
     if (from) {
         auto_jid Jid* jid = jid_create(from);
-        if (jid) {
+        if (!jid) {
+            return;
+        }
+
+        if (!delayed) {
             _message_send_receipt(jid->fulljid, id);
+            return;
+        }
+
+        ProfPendingReceipt* receipt = malloc(sizeof(ProfPendingReceipt));
+        receipt->fulljid = strdup(jid->fulljid);
+        receipt->id = strdup(id);
+        g_queue_push_tail(&pending_receipts, receipt);
+        if (!pending_receipts_timer) {
+            pending_receipts_timer = g_timeout_add(RECEIPT_BATCH_INTERVAL_MS, _pending_receipts_send, NULL);
         }
     }
 }
@@ -1345,6 +1524,46 @@ _handle_carbons(xmpp_stanza_t* const stanza)
     return message_stanza;
 }
 
+// a <stanza-id> only identifies a message when our own server added it
+static gboolean
+_stanza_id_by_us(xmpp_stanza_t* const stanza)
+{
+    xmpp_stanza_t* stanzaidst = xmpp_stanza_get_child_by_name_and_ns(stanza, STANZA_NAME_STANZA_ID, STANZA_NS_STABLE_ID);
+    if (!stanzaidst) {
+        return FALSE;
+    }
+    const char* by = xmpp_stanza_get_attribute(stanzaidst, "by");
+    return by && equals_our_barejid(by);
+}
+
+// TRUE when id was seen before for kind and scope, remembers it otherwise,
+// the oldest id is forgotten once SEEN_IDS_MAX are held
+static gboolean
+_message_id_seen(const char* const kind, const char* const scope, const char* const id)
+{
+    if (!id) {
+        return FALSE;
+    }
+
+    if (!seen_ids) {
+        seen_ids = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    }
+
+    gchar* key = g_strdup_printf("%s:%s:%s", kind, scope ?: "", id);
+    if (g_hash_table_contains(seen_ids, key)) {
+        g_free(key);
+        return TRUE;
+    }
+
+    g_hash_table_add(seen_ids, key);
+    g_queue_push_tail(&seen_ids_order, key);
+    if (g_queue_get_length(&seen_ids_order) > SEEN_IDS_MAX) {
+        g_hash_table_remove(seen_ids, g_queue_pop_head(&seen_ids_order));
+    }
+
+    return FALSE;
+}
+
 static void
 _handle_chat(xmpp_stanza_t* const stanza, gboolean is_mam, gboolean is_carbon, const char* result_id, GDateTime* timestamp)
 {
@@ -1375,6 +1594,7 @@ _handle_chat(xmpp_stanza_t* const stanza, gboolean is_mam, gboolean is_carbon, c
     // standard chat message, use jid without resource
     ProfMessage* message = message_init();
     message->is_mam = is_mam;
+    gboolean delayed = FALSE;
     jid_ref(jid);
     message->from_jid = jid;
     const gchar* to = xmpp_stanza_get_to(stanza);
@@ -1417,6 +1637,24 @@ _handle_chat(xmpp_stanza_t* const stanza, gboolean is_mam, gboolean is_carbon, c
         }
     }
 
+    // stanza-ids are assigned by our server to both the live copy and the
+    // archived one, origin-ids by the sender to every copy
+    const char* originid = NULL;
+    xmpp_stanza_t* origin = xmpp_stanza_get_child_by_name_and_ns(stanza, STANZA_NAME_ORIGIN_ID, STANZA_NS_STABLE_ID);
+    if (origin) {
+        originid = xmpp_stanza_get_attribute(origin, STANZA_ATTR_ID);
+    }
+    gboolean stanzaid_ours = is_mam || _stanza_id_by_us(stanza);
+    if ((stanzaid_ours && _message_id_seen("s", NULL, message->stanzaid))
+        || _message_id_seen("o", jid->barejid, originid)) {
+        log_debug("Duplicate message from %s dropped", jid->fulljid);
+        if (timestamp) {
+            g_date_time_unref(timestamp);
+        }
+        message_free(message);
+        return;
+    }
+
     // replace id for XEP-0308: Last Message Correction
     xmpp_stanza_t* replace_id_stanza = xmpp_stanza_get_child_by_ns(stanza, STANZA_NS_LAST_MESSAGE_CORRECTION);
     if (replace_id_stanza) {
@@ -1432,6 +1670,7 @@ _handle_chat(xmpp_stanza_t* const stanza, gboolean is_mam, gboolean is_carbon, c
     } else {
         // timestamp in the message stanza or use time of receival (now)
         message->timestamp = stanza_get_delay(stanza);
+        delayed = message->timestamp != NULL;
         if (!message->timestamp) {
             message->timestamp = g_date_time_new_now_local();
         }
@@ -1470,7 +1709,7 @@ _handle_chat(xmpp_stanza_t* const stanza, gboolean is_mam, gboolean is_carbon, c
             }
         } else {
             sv_ev_incoming_message(message);
-            _receipt_request_handler(stanza);
+            _receipt_request_handler(stanza, is_mam, delayed);
         }
     }
 
@@ -1525,13 +1764,8 @@ _handle_ox_chat(xmpp_stanza_t* const stanza, ProfMessage* message, gboolean is_m
 }
 
 static gboolean
-_handle_mam(xmpp_stanza_t* const stanza)
+_handle_mam(xmpp_stanza_t* const stanza, xmpp_stanza_t* const result)
 {
-    xmpp_stanza_t* result = xmpp_stanza_get_child_by_name_and_ns(stanza, STANZA_NAME_RESULT, STANZA_NS_MAM2);
-    if (!result) {
-        return FALSE;
-    }
-
     xmpp_stanza_t* forwarded = xmpp_stanza_get_child_by_ns(result, STANZA_NS_FORWARD);
     if (!forwarded) {
         log_warning("MAM received with no forwarded element");
@@ -1546,6 +1780,11 @@ _handle_mam(xmpp_stanza_t* const stanza)
 
     xmpp_stanza_t* message_stanza = xmpp_stanza_get_child_by_ns(forwarded, "jabber:client");
 
+    if (message_stanza && g_strcmp0(xmpp_stanza_get_type(message_stanza), STANZA_TYPE_GROUPCHAT) == 0) {
+        _handle_groupchat_mam(stanza, message_stanza, result_id, timestamp);
+        return TRUE;
+    }
+
     _handle_chat(message_stanza, TRUE, FALSE, result_id, timestamp);
 
     return TRUE;
@@ -1576,14 +1815,20 @@ _send_message_stanza(xmpp_stanza_t* const stanza)
     size_t text_size;
     xmpp_stanza_to_text(stanza, &text, &text_size);
 
-    xmpp_conn_t* conn = connection_get_conn();
+    _send_message_text(text);
+    xmpp_free(connection_get_ctx(), text);
+}
+
+static void
+_send_message_text(const char* const text)
+{
+    stats_stanza_sent(STATS_STANZA_MESSAGE);
     auto_char char* plugin_text = plugins_on_message_stanza_send(text);
     if (plugin_text) {
-        xmpp_send_raw_string(conn, "%s", plugin_text);
+        connection_send_raw(plugin_text);
     } else {
-        xmpp_send_raw_string(conn, "%s", text);
+        connection_send_raw(text);
     }
-    xmpp_free(connection_get_ctx(), text);
 }
 
 /* ckeckOID = true: check origin-id
@@ -1705,33 +1950,130 @@ message_request_voice(const char* const roomjid)
 }
 
 static gboolean
-_handle_jingle_message(xmpp_stanza_t* const stanza)
+_handle_jingle_message(xmpp_stanza_t* const stanza, xmpp_stanza_t* const propose)
 {
-    xmpp_stanza_t* propose = xmpp_stanza_get_child_by_name_and_ns(stanza, STANZA_NAME_PROPOSE, STANZA_NS_JINGLE_MESSAGE);
+    xmpp_stanza_t* description = xmpp_stanza_get_child_by_ns(propose, STANZA_NS_JINGLE_RTP);
+    if (description) {
+        const char* const from = xmpp_stanza_get_from(stanza);
+        cons_show("Ring ring: %s is trying to call you", from);
+        cons_alert(NULL);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+static void
+_message_request_free(ProfMessageRequest* request)
+{
+    if (request) {
+        g_free(request->barejid);
+        g_free(request->sample);
+        g_free(request);
+    }
+}
+
+static void
+_message_request_hold(const char* const barejid, xmpp_stanza_t* const stanza)
+{
+    // typing notifications and receipts from strangers aren't worth keeping
+    char* body = xmpp_message_get_body(stanza);
+    if (!body) {
+        return;
+    }
 
-    if (propose) {
-        xmpp_stanza_t* description = xmpp_stanza_get_child_by_ns(propose, STANZA_NS_JINGLE_RTP);
-        if (description) {
-            const char* const from = xmpp_stanza_get_from(stanza);
-            cons_show("Ring ring: %s is trying to call you", from);
-            cons_alert(NULL);
-            return TRUE;
+    if (!message_requests) {
+        message_requests = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, (GDestroyNotify)_message_request_free);
+    }
+
+    ProfMessageRequest* request = g_hash_table_lookup(message_requests, barejid);
+    if (!request && g_hash_table_size(message_requests) >= MESSAGE_REQUESTS_MAX) {
+        message_requests_overflow++;
+    } else {
+        if (!request) {
+            request = g_new0(ProfMessageRequest, 1);
+            request->barejid = g_strdup(barejid);
+            request->sample = g_utf8_substring(body, 0, MIN(g_utf8_strlen(body, -1), 200));
+            g_hash_table_insert(message_requests, request->barejid, request);
         }
+        request->count++;
+    }
+    xmpp_free(connection_get_ctx(), body);
+
+    log_debug("[Silence] Quarantined message from: %s", barejid);
+    if (!message_requests_notified) {
+        message_requests_notified = TRUE;
+        cons_show("Messages from senders not in your roster are held back, see /silence requests.");
     }
-    return FALSE;
 }
 
 static gboolean
 _should_ignore_based_on_silence(xmpp_stanza_t* const stanza)
 {
-    if (prefs_get_boolean(PREF_SILENCE_NON_ROSTER)) {
-        const char* const from = xmpp_stanza_get_from(stanza);
-        auto_jid Jid* from_jid = jid_create(from);
-        PContact contact = roster_get_contact(from_jid->barejid);
-        if (!contact) {
-            log_debug("[Silence] Ignoring message from: %s", from);
-            return TRUE;
-        }
+    gboolean silence = prefs_get_boolean(PREF_SILENCE_NON_ROSTER);
+    if (!silence && !prefs_get_boolean(PREF_SILENCE_QUARANTINE)) {
+        return FALSE;
     }
-    return FALSE;
+
+    const char* const from = xmpp_stanza_get_from(stanza);
+    auto_jid Jid* from_jid = jid_create(from);
+    if (!from_jid) {
+        return FALSE;
+    }
+    PContact contact = roster_get_contact(from_jid->barejid);
+    if (contact) {
+        return FALSE;
+    }
+    if (silence) {
+        return TRUE;
+    }
+
+    // carbons of our own messages, private messages in rooms we're in and
+    // the server itself are no message requests
+    if (!from_jid->localpart || equals_our_barejid(from_jid->barejid) || muc_active(from_jid->barejid)) {
+        return FALSE;
+    }
+    if (accepted_senders && g_hash_table_contains(accepted_senders, from_jid->barejid)) {
+        return FALSE;
+    }
+
+    _message_request_hold(from_jid->barejid, stanza);
+    return TRUE;
+}
+
+GList*
+message_requests_list(void)
+{
+    message_requests_notified = FALSE;
+    return message_requests ? g_hash_table_get_values(message_requests) : NULL;
+}
+
+guint
+message_requests_overflow_count(void)
+{
+    return message_requests_overflow;
+}
+
+/**
+ * Lets messages from `barejid` through for the rest of the session and
+ * forgets its held messages. Returns FALSE if none were held.
+ */
+gboolean
+message_request_accept(const char* const barejid)
+{
+    if (!accepted_senders) {
+        accepted_senders = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    }
+    g_hash_table_add(accepted_senders, g_strdup(barejid));
+
+    return message_requests && g_hash_table_remove(message_requests, barejid);
+}
+
+void
+message_requests_clear(void)
+{
+    if (message_requests) {
+        g_hash_table_remove_all(message_requests);
+    }
+    message_requests_overflow = 0;
+    message_requests_notified = FALSE;
 }
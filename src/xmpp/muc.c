@@ -42,7 +42,9 @@
 #include <glib.h>
 
 #include "common.h"
+#include "config/preferences.h"
 #include "tools/autocomplete.h"
+#include "tools/matcher.h"
 #include "ui/ui.h"
 #include "ui/window_list.h"
 #include "xmpp/jid.h"
@@ -62,20 +64,47 @@ typedef struct _muc_room_t
     char* password;
     char* subject;
     char* autocomplete_prefix;
+    // what is being completed, and the first nick offered by the current pass
+    // over speaker_ac or nick_ac so a pass that went all the way round is noticed
+    char* autocomplete_search;
+    char* autocomplete_first;
+    gboolean autocomplete_speakers;
     gboolean pending_config;
     GList* pending_broadcasts;
     gboolean autojoin;
     gboolean pending_nick_change;
     GHashTable* roster;
+    // roster ordered by nick, overall and per role
+    GSequence* occupants_by_nick;
+    GSequence* occupants_by_role[MUC_ROLE_MODERATOR + 1];
+    // occupants appended during the join burst, sorted on first use
+    gboolean occupants_unsorted;
     GHashTable* members;
+    // bare JIDs of members, each once, built on demand and dropped on change
+    GList* member_barejids;
     Autocomplete nick_ac;
+    // occupants who spoke lately, most recent first, offered before nick_ac
+    Autocomplete speaker_ac;
     Autocomplete jid_ac;
     GHashTable* nick_changes;
+    // nick and triggers compiled for muc_message_highlights(), rebuilt when they change
+    Matcher highlights;
+    char* highlights_nick;
+    gboolean highlights_case_sensitive;
+    guint highlights_serial;
+    GPtrArray* highlight_triggers;
     gboolean roster_received;
     muc_member_type_t member_type;
     muc_anonymity_type_t anonymity_type;
+    // room keeps a XEP-0313 archive, learned from disco#info on an earlier join
+    gboolean mam;
+    // rejoined without discussion history, what was missed comes from the archive
+    gboolean mam_catchup;
 } ChatRoom;
 
+// recent speakers offered first on nick completion, per room
+#define MUC_RECENT_SPEAKERS_MAX 50
+
 GHashTable* rooms = NULL;
 GHashTable* invite_passwords = NULL;
 Autocomplete invite_ac = NULL;
@@ -90,6 +119,10 @@ static char* _affiliation_to_string(muc_affiliation_t affiliation);
 static Occupant* _muc_occupant_new(const char* const nick, const char* const jid, muc_role_t role,
                                    muc_affiliation_t affiliation, resource_presence_t presence, const char* const status);
 static void _occupant_free(Occupant* occupant);
+static gint _index_cmp_occupants(gconstpointer a, gconstpointer b, gpointer data);
+static void _sort_occupants(ChatRoom* chat_room);
+static GSequenceIter* _occupants_iter_after(GSequence* occupants, const char* const after_key);
+static void _highlights_update(ChatRoom* chat_room, gboolean case_sensitive);
 
 void
 muc_init(void)
@@ -219,6 +252,9 @@ muc_join(const char* const room, const char* const nick, const char* const passw
     new_room->role = MUC_ROLE_NONE;
     new_room->affiliation = MUC_AFFILIATION_NONE;
     new_room->autocomplete_prefix = NULL;
+    new_room->autocomplete_search = NULL;
+    new_room->autocomplete_first = NULL;
+    new_room->autocomplete_speakers = FALSE;
     if (password) {
         new_room->password = strdup(password);
     } else {
@@ -228,15 +264,32 @@ muc_join(const char* const room, const char* const nick, const char* const passw
     new_room->pending_broadcasts = NULL;
     new_room->pending_config = FALSE;
     new_room->roster = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)_occupant_free);
+    new_room->occupants_by_nick = g_sequence_new(NULL);
+    for (int i = 0; i < ARRAY_SIZE(new_room->occupants_by_role); i++) {
+        new_room->occupants_by_role[i] = g_sequence_new(NULL);
+    }
+    new_room->occupants_unsorted = FALSE;
+    new_room->highlights = NULL;
+    new_room->highlights_nick = NULL;
+    new_room->highlights_case_sensitive = FALSE;
+    new_room->highlights_serial = 0;
+    new_room->highlight_triggers = NULL;
     new_room->members = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    new_room->member_barejids = NULL;
     new_room->nick_ac = autocomplete_new();
+    new_room->speaker_ac = autocomplete_new();
     new_room->jid_ac = autocomplete_new();
+    // occupants arrive before our own presence, sort them once when it does
+    autocomplete_bulk_begin(new_room->nick_ac);
+    autocomplete_bulk_begin(new_room->jid_ac);
     new_room->nick_changes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
     new_room->roster_received = FALSE;
     new_room->pending_nick_change = FALSE;
     new_room->autojoin = autojoin;
     new_room->member_type = MUC_MEMBER_TYPE_UNKNOWN;
     new_room->anonymity_type = MUC_ANONYMITY_TYPE_UNKNOWN;
+    new_room->mam = FALSE;
+    new_room->mam_catchup = FALSE;
 
     g_hash_table_insert(rooms, strdup(room), new_room);
 }
@@ -284,6 +337,47 @@ muc_set_features(const char* const room, GSList* features)
         } else {
             chat_room->anonymity_type = MUC_ANONYMITY_TYPE_UNKNOWN;
         }
+        chat_room->mam = g_slist_find_custom(features, XMPP_FEATURE_MAM2, (GCompareFunc)g_strcmp0) != NULL;
+    }
+}
+
+gboolean
+muc_supports_mam(const char* const room)
+{
+    ChatRoom* chat_room = g_hash_table_lookup(rooms, room);
+    if (chat_room) {
+        return chat_room->mam;
+    } else {
+        return FALSE;
+    }
+}
+
+void
+muc_set_supports_mam(const char* const room, gboolean val)
+{
+    ChatRoom* chat_room = g_hash_table_lookup(rooms, room);
+    if (chat_room) {
+        chat_room->mam = val;
+    }
+}
+
+gboolean
+muc_mam_catchup(const char* const room)
+{
+    ChatRoom* chat_room = g_hash_table_lookup(rooms, room);
+    if (chat_room) {
+        return chat_room->mam_catchup;
+    } else {
+        return FALSE;
+    }
+}
+
+void
+muc_set_mam_catchup(const char* const room, gboolean val)
+{
+    ChatRoom* chat_room = g_hash_table_lookup(rooms, room);
+    if (chat_room) {
+        chat_room->mam_catchup = val;
     }
 }
 
@@ -492,7 +586,17 @@ muc_roster_add(const char* const room, const char* const nick, const char* const
         muc_role_t role_t = _role_from_string(role);
         muc_affiliation_t affiliation_t = _affiliation_from_string(affiliation);
         Occupant* occupant = _muc_occupant_new(nick, jid, role_t, affiliation_t, presence, status);
+        // freeing a replaced occupant takes it out of the indexes
         g_hash_table_replace(chat_room->roster, strdup(nick), occupant);
+        if (chat_room->roster_received) {
+            occupant->by_nick = g_sequence_insert_sorted(chat_room->occupants_by_nick, occupant, _index_cmp_occupants, NULL);
+            occupant->by_role = g_sequence_insert_sorted(chat_room->occupants_by_role[role_t], occupant, _index_cmp_occupants, NULL);
+        } else {
+            // join burst, sort once when the roster is complete
+            occupant->by_nick = g_sequence_append(chat_room->occupants_by_nick, occupant);
+            occupant->by_role = g_sequence_append(chat_room->occupants_by_role[role_t], occupant);
+            chat_room->occupants_unsorted = TRUE;
+        }
 
         if (jid) {
             auto_jid Jid* jidp = jid_create(jid);
@@ -515,6 +619,7 @@ muc_roster_remove(const char* const room, const char* const nick)
     if (chat_room) {
         g_hash_table_remove(chat_room->roster, nick);
         autocomplete_remove(chat_room->nick_ac, nick);
+        autocomplete_remove(chat_room->speaker_ac, nick);
     }
 }
 
@@ -530,29 +635,232 @@ muc_roster_item(const char* const room, const char* const nick)
     }
 }
 
+/*
+ * Number of occupants in the room's roster
+ */
+int
+muc_roster_size(const char* const room)
+{
+    ChatRoom* chat_room = g_hash_table_lookup(rooms, room);
+    if (chat_room) {
+        return g_hash_table_size(chat_room->roster);
+    } else {
+        return 0;
+    }
+}
+
 /*
  * Return a list of PContacts representing the room members in the room's roster
  */
 GList*
 muc_roster(const char* const room)
+{
+    GList* result = NULL;
+    GSequenceIter* iter = muc_roster_iter(room);
+    Occupant* occupant;
+
+    while ((occupant = muc_roster_iter_next(&iter))) {
+        result = g_list_prepend(result, occupant);
+    }
+
+    return g_list_reverse(result);
+}
+
+/*
+ * Iterate over the room's occupants ordered by nick without copying them,
+ * the iterator is invalidated by any change to the roster
+ */
+GSequenceIter*
+muc_roster_iter(const char* const room)
 {
     ChatRoom* chat_room = g_hash_table_lookup(rooms, room);
     if (chat_room) {
-        GList* result = NULL;
-        GList* occupants = g_hash_table_get_values(chat_room->roster);
+        _sort_occupants(chat_room);
+        return g_sequence_get_begin_iter(chat_room->occupants_by_nick);
+    } else {
+        return NULL;
+    }
+}
 
-        GList* curr = occupants;
-        while (curr) {
-            result = g_list_insert_sorted(result, curr->data, (GCompareFunc)_compare_occupants);
-            curr = g_list_next(curr);
+/*
+ * Iterate over the room's occupants with the given role ordered by nick
+ */
+GSequenceIter*
+muc_roster_iter_role(const char* const room, muc_role_t role)
+{
+    ChatRoom* chat_room = g_hash_table_lookup(rooms, room);
+    if (chat_room) {
+        _sort_occupants(chat_room);
+        return g_sequence_get_begin_iter(chat_room->occupants_by_role[role]);
+    } else {
+        return NULL;
+    }
+}
+
+/*
+ * Like muc_roster_iter() and muc_roster_iter_role() but starting after the
+ * occupants whose nick collation key is not greater than after_key, to resume
+ * an iteration across roster changes. NULL after_key starts at the beginning.
+ */
+GSequenceIter*
+muc_roster_iter_after(const char* const room, const char* const after_key)
+{
+    ChatRoom* chat_room = g_hash_table_lookup(rooms, room);
+    if (!chat_room) {
+        return NULL;
+    }
+
+    _sort_occupants(chat_room);
+    return _occupants_iter_after(chat_room->occupants_by_nick, after_key);
+}
+
+GSequenceIter*
+muc_roster_iter_role_after(const char* const room, muc_role_t role, const char* const after_key)
+{
+    ChatRoom* chat_room = g_hash_table_lookup(rooms, room);
+    if (!chat_room) {
+        return NULL;
+    }
+
+    _sort_occupants(chat_room);
+    return _occupants_iter_after(chat_room->occupants_by_role[role], after_key);
+}
+
+/*
+ * Return the occupant at iter and advance iter, NULL when there are no more
+ */
+Occupant*
+muc_roster_iter_next(GSequenceIter** iter)
+{
+    if (*iter == NULL || g_sequence_iter_is_end(*iter)) {
+        return NULL;
+    }
+
+    Occupant* occupant = g_sequence_get(*iter);
+    *iter = g_sequence_iter_next(*iter);
+
+    return occupant;
+}
+
+typedef struct highlights_scan_t
+{
+    const char* text;
+    gboolean whole_word;
+    // char offset of text[counted], mentions are found in increasing order
+    gsize counted;
+    glong chars;
+    GSList* mentions;
+    gboolean* triggers_found;
+} HighlightsScan;
+
+static void
+_highlights_hit(int id, gsize start, gsize end, void* userdata)
+{
+    HighlightsScan* scan = userdata;
+
+    if (id > 0) {
+        scan->triggers_found[id - 1] = TRUE;
+        return;
+    }
+
+    if (scan->whole_word) {
+        gunichar before = 0;
+        if (start > 0) {
+            before = g_utf8_get_char(g_utf8_find_prev_char(scan->text, scan->text + start));
+        }
+        gunichar after = 0;
+        if (scan->text[end] != '\0') {
+            after = g_utf8_get_char(scan->text + end);
+        }
+        if (g_unichar_isalnum(before) || g_unichar_isalnum(after)) {
+            return;
         }
+    }
+
+    scan->chars += g_utf8_strlen(scan->text + scan->counted, start - scan->counted);
+    scan->counted = start;
+    scan->mentions = g_slist_prepend(scan->mentions, GINT_TO_POINTER(scan->chars));
+}
 
-        g_list_free(occupants);
+/*
+ * Find mentions of our nick and the room notify triggers in a message in one pass.
+ * mentions gets the char offsets of our nick as get_mentions() does,
+ * triggers the matching triggers as prefs_message_get_triggers() does.
+ */
+void
+muc_message_highlights(const char* const room, const char* const message, GSList** mentions, GList** triggers)
+{
+    *mentions = NULL;
+    *triggers = NULL;
+
+    ChatRoom* chat_room = g_hash_table_lookup(rooms, room);
+    if (chat_room == NULL || message == NULL) {
+        return;
+    }
 
-        return result;
+    gboolean whole_word = prefs_get_boolean(PREF_NOTIFY_MENTION_WHOLE_WORD);
+    gboolean case_sensitive = prefs_get_boolean(PREF_NOTIFY_MENTION_CASE_SENSITIVE);
+    _highlights_update(chat_room, case_sensitive);
+
+    auto_gchar gchar* message_lower = g_utf8_strdown(message, -1);
+    guint triggers_len = chat_room->highlight_triggers->len;
+    gboolean triggers_found[triggers_len + 1];
+    memset(triggers_found, 0, sizeof(triggers_found));
+
+    HighlightsScan scan = { message_lower, whole_word, 0, 0, NULL, triggers_found };
+    matcher_scan(chat_room->highlights, message_lower, _highlights_hit, &scan);
+
+    if (case_sensitive) {
+        // our nick is not in the folded matcher, search the message as it is
+        *mentions = get_mentions(whole_word, TRUE, message, chat_room->nick);
     } else {
-        return NULL;
+        *mentions = g_slist_reverse(scan.mentions);
+    }
+
+    for (guint i = 0; i < triggers_len; i++) {
+        if (triggers_found[i]) {
+            *triggers = g_list_prepend(*triggers, strdup(g_ptr_array_index(chat_room->highlight_triggers, i)));
+        }
     }
+    *triggers = g_list_reverse(*triggers);
+}
+
+static void
+_highlights_update(ChatRoom* chat_room, gboolean case_sensitive)
+{
+    guint serial = prefs_get_room_notify_triggers_serial();
+    if (chat_room->highlights
+        && g_strcmp0(chat_room->highlights_nick, chat_room->nick) == 0
+        && chat_room->highlights_case_sensitive == case_sensitive
+        && chat_room->highlights_serial == serial) {
+        return;
+    }
+
+    matcher_free(chat_room->highlights);
+    free(chat_room->highlights_nick);
+    if (chat_room->highlight_triggers) {
+        g_ptr_array_free(chat_room->highlight_triggers, TRUE);
+    }
+
+    chat_room->highlights = matcher_new();
+    chat_room->highlights_nick = chat_room->nick ? strdup(chat_room->nick) : NULL;
+    chat_room->highlights_case_sensitive = case_sensitive;
+    chat_room->highlights_serial = serial;
+    chat_room->highlight_triggers = g_ptr_array_new_with_free_func(free);
+
+    if (!case_sensitive && chat_room->nick) {
+        auto_gchar gchar* nick_lower = g_utf8_strdown(chat_room->nick, -1);
+        matcher_add(chat_room->highlights, nick_lower, 0);
+    }
+
+    GList* room_triggers = prefs_get_room_notify_triggers();
+    for (GList* curr = room_triggers; curr; curr = g_list_next(curr)) {
+        auto_gchar gchar* trigger_lower = g_utf8_strdown(curr->data, -1);
+        g_ptr_array_add(chat_room->highlight_triggers, curr->data);
+        matcher_add(chat_room->highlights, trigger_lower, chat_room->highlight_triggers->len);
+    }
+    // the strings are now owned by highlight_triggers
+    g_list_free(room_triggers);
 }
 
 /*
@@ -589,6 +897,9 @@ muc_roster_set_complete(const char* const room)
     ChatRoom* chat_room = g_hash_table_lookup(rooms, room);
     if (chat_room) {
         chat_room->roster_received = TRUE;
+        _sort_occupants(chat_room);
+        autocomplete_bulk_end(chat_room->nick_ac);
+        autocomplete_bulk_end(chat_room->jid_ac);
     }
 }
 
@@ -627,47 +938,31 @@ muc_occupant_role_str(Occupant* occupant)
 GSList*
 muc_occupants_by_role(const char* const room, muc_role_t role)
 {
-    ChatRoom* chat_room = g_hash_table_lookup(rooms, room);
-    if (chat_room) {
-        GSList* result = NULL;
-        GHashTableIter iter;
-        gpointer key;
-        gpointer value;
-
-        g_hash_table_iter_init(&iter, chat_room->roster);
-        while (g_hash_table_iter_next(&iter, &key, &value)) {
-            Occupant* occupant = (Occupant*)value;
-            if (occupant->role == role) {
-                result = g_slist_insert_sorted(result, value, (GCompareFunc)_compare_occupants);
-            }
-        }
-        return result;
-    } else {
-        return NULL;
+    GSList* result = NULL;
+    GSequenceIter* iter = muc_roster_iter_role(room, role);
+    Occupant* occupant;
+
+    while ((occupant = muc_roster_iter_next(&iter))) {
+        result = g_slist_prepend(result, occupant);
     }
+
+    return g_slist_reverse(result);
 }
 
 GSList*
 muc_occupants_by_affiliation(const char* const room, muc_affiliation_t affiliation)
 {
-    ChatRoom* chat_room = g_hash_table_lookup(rooms, room);
-    if (chat_room) {
-        GSList* result = NULL;
-        GHashTableIter iter;
-        gpointer key;
-        gpointer value;
-
-        g_hash_table_iter_init(&iter, chat_room->roster);
-        while (g_hash_table_iter_next(&iter, &key, &value)) {
-            Occupant* occupant = (Occupant*)value;
-            if (occupant->affiliation == affiliation) {
-                result = g_slist_insert_sorted(result, value, (GCompareFunc)_compare_occupants);
-            }
+    GSList* result = NULL;
+    GSequenceIter* iter = muc_roster_iter(room);
+    Occupant* occupant;
+
+    while ((occupant = muc_roster_iter_next(&iter))) {
+        if (occupant->affiliation == affiliation) {
+            result = g_slist_prepend(result, occupant);
         }
-        return result;
-    } else {
-        return NULL;
     }
+
+    return g_slist_reverse(result);
 }
 
 /*
@@ -707,6 +1002,58 @@ muc_roster_nick_change_complete(const char* const room, const char* const nick)
     return NULL;
 }
 
+void
+muc_speaker_add(const char* const room, const char* const nick)
+{
+    ChatRoom* chat_room = g_hash_table_lookup(rooms, room);
+    if (chat_room == NULL || nick == NULL || g_strcmp0(nick, chat_room->nick) == 0) {
+        return;
+    }
+
+    // history can name occupants who left long ago
+    if (!g_hash_table_contains(chat_room->roster, nick)) {
+        return;
+    }
+
+    autocomplete_remove(chat_room->speaker_ac, nick);
+    autocomplete_add_unsorted(chat_room->speaker_ac, nick, TRUE);
+    autocomplete_remove_older_than_max_reverse(chat_room->speaker_ac, MUC_RECENT_SPEAKERS_MAX);
+}
+
+// next match of the current pass, over the recent speakers or over the other
+// occupants, NULL when the pass has nothing more to offer
+static gchar*
+_muc_autocomplete_next(ChatRoom* chat_room, gboolean previous)
+{
+    Autocomplete ac = chat_room->autocomplete_speakers ? chat_room->speaker_ac : chat_room->nick_ac;
+    auto_gchar gchar* skipped = NULL;
+
+    gchar* result;
+    while ((result = autocomplete_complete(ac, chat_room->autocomplete_search, FALSE, previous))) {
+        if (g_strcmp0(result, chat_room->autocomplete_first) == 0 || g_strcmp0(result, skipped) == 0) {
+            // went all the way round
+            g_free(result);
+            return NULL;
+        }
+        if (chat_room->autocomplete_speakers || !autocomplete_contains(chat_room->speaker_ac, result)) {
+            break;
+        }
+
+        // offered with the speakers already
+        if (skipped) {
+            g_free(result);
+        } else {
+            skipped = result;
+        }
+    }
+
+    if (result && !chat_room->autocomplete_first) {
+        chat_room->autocomplete_first = strdup(result);
+    }
+
+    return result;
+}
+
 char*
 muc_autocomplete(ProfWin* window, const char* const input, gboolean previous)
 {
@@ -736,7 +1083,19 @@ muc_autocomplete(ProfWin* window, const char* const input, gboolean previous)
         }
     }
 
-    auto_gchar gchar* result = autocomplete_complete(chat_room->nick_ac, search_str, FALSE, previous);
+    if (!chat_room->autocomplete_search) {
+        chat_room->autocomplete_search = strdup(search_str);
+        chat_room->autocomplete_speakers = TRUE;
+    }
+
+    // recent speakers first, then everyone else, then round again
+    auto_gchar gchar* result = _muc_autocomplete_next(chat_room, previous);
+    for (int i = 0; result == NULL && i < 2; i++) {
+        chat_room->autocomplete_speakers = !chat_room->autocomplete_speakers;
+        autocomplete_reset(chat_room->autocomplete_speakers ? chat_room->speaker_ac : chat_room->nick_ac);
+        FREE_SET_NULL(chat_room->autocomplete_first);
+        result = _muc_autocomplete_next(chat_room, previous);
+    }
     if (result == NULL) {
         return NULL;
     }
@@ -790,11 +1149,15 @@ muc_autocomplete_reset(const char* const room)
         if (chat_room->nick_ac) {
             autocomplete_reset(chat_room->nick_ac);
         }
+        autocomplete_reset(chat_room->speaker_ac);
 
         if (chat_room->autocomplete_prefix) {
             free(chat_room->autocomplete_prefix);
             chat_room->autocomplete_prefix = NULL;
         }
+        FREE_SET_NULL(chat_room->autocomplete_search);
+        FREE_SET_NULL(chat_room->autocomplete_first);
+        chat_room->autocomplete_speakers = FALSE;
     }
 }
 
@@ -874,12 +1237,52 @@ muc_members(const char* const room)
     }
 }
 
+/*
+ * Return the bare JIDs of the room members, each once, e.g. to encrypt for
+ * them. The list belongs to the room and is valid until its members change.
+ */
+const GList*
+muc_member_barejids(const char* const room)
+{
+    ChatRoom* chat_room = g_hash_table_lookup(rooms, room);
+    if (!chat_room) {
+        return NULL;
+    }
+
+    if (chat_room->member_barejids == NULL) {
+        GHashTable* seen = g_hash_table_new(g_str_hash, g_str_equal);
+        GHashTableIter iter;
+        gpointer member;
+        g_hash_table_iter_init(&iter, chat_room->members);
+        while (g_hash_table_iter_next(&iter, &member, NULL)) {
+            auto_jid Jid* jidp = jid_create(member);
+            if (!jidp || g_hash_table_contains(seen, jidp->barejid)) {
+                continue;
+            }
+            gchar* barejid = g_strdup(jidp->barejid);
+            g_hash_table_add(seen, barejid);
+            chat_room->member_barejids = g_list_prepend(chat_room->member_barejids, barejid);
+        }
+        g_hash_table_destroy(seen);
+    }
+
+    return chat_room->member_barejids;
+}
+
+static void
+_members_changed(ChatRoom* chat_room)
+{
+    g_list_free_full(chat_room->member_barejids, g_free);
+    chat_room->member_barejids = NULL;
+}
+
 void
 muc_members_add(const char* const room, const char* const jid)
 {
     ChatRoom* chat_room = g_hash_table_lookup(rooms, room);
     if (chat_room) {
         if (g_hash_table_insert(chat_room->members, strdup(jid), NULL)) {
+            _members_changed(chat_room);
 #ifdef HAVE_OMEMO
             if (chat_room->anonymity_type == MUC_ANONYMITY_TYPE_NONANONYMOUS) {
                 if (!equals_our_barejid(jid)) {
@@ -895,8 +1298,8 @@ void
 muc_members_remove(const char* const room, const char* const jid)
 {
     ChatRoom* chat_room = g_hash_table_lookup(rooms, room);
-    if (chat_room) {
-        g_hash_table_remove(chat_room->members, jid);
+    if (chat_room && g_hash_table_remove(chat_room->members, jid)) {
+        _members_changed(chat_room);
     }
 }
 
@@ -919,13 +1322,26 @@ _free_room(ChatRoom* room)
         free(room->subject);
         free(room->password);
         free(room->autocomplete_prefix);
+        free(room->autocomplete_search);
+        free(room->autocomplete_first);
         if (room->roster) {
             g_hash_table_destroy(room->roster);
         }
+        g_sequence_free(room->occupants_by_nick);
+        matcher_free(room->highlights);
+        free(room->highlights_nick);
+        if (room->highlight_triggers) {
+            g_ptr_array_free(room->highlight_triggers, TRUE);
+        }
+        for (int i = 0; i < ARRAY_SIZE(room->occupants_by_role); i++) {
+            g_sequence_free(room->occupants_by_role[i]);
+        }
         if (room->members) {
             g_hash_table_destroy(room->members);
         }
+        g_list_free_full(room->member_barejids, g_free);
         autocomplete_free(room->nick_ac);
+        autocomplete_free(room->speaker_ac);
         autocomplete_free(room->jid_ac);
         if (room->nick_changes) {
             g_hash_table_destroy(room->nick_changes);
@@ -948,6 +1364,37 @@ _compare_occupants(Occupant* a, Occupant* b)
     return result;
 }
 
+static gint
+_index_cmp_occupants(gconstpointer a, gconstpointer b, gpointer data)
+{
+    return _compare_occupants((Occupant*)a, (Occupant*)b);
+}
+
+static GSequenceIter*
+_occupants_iter_after(GSequence* occupants, const char* const after_key)
+{
+    if (!after_key) {
+        return g_sequence_get_begin_iter(occupants);
+    }
+
+    Occupant key = { .nick_collate_key = (gchar*)after_key };
+    return g_sequence_search(occupants, &key, _index_cmp_occupants, NULL);
+}
+
+static void
+_sort_occupants(ChatRoom* chat_room)
+{
+    if (!chat_room->occupants_unsorted) {
+        return;
+    }
+
+    g_sequence_sort(chat_room->occupants_by_nick, _index_cmp_occupants, NULL);
+    for (int i = 0; i < ARRAY_SIZE(chat_room->occupants_by_role); i++) {
+        g_sequence_sort(chat_room->occupants_by_role[i], _index_cmp_occupants, NULL);
+    }
+    chat_room->occupants_unsorted = FALSE;
+}
+
 static muc_role_t
 _role_from_string(const char* const role)
 {
@@ -1071,6 +1518,8 @@ _muc_occupant_new(const char* const nick, const char* const jid, muc_role_t role
 
     occupant->role = role;
     occupant->affiliation = affiliation;
+    occupant->by_nick = NULL;
+    occupant->by_role = NULL;
 
     return occupant;
 }
@@ -1079,6 +1528,12 @@ static void
 _occupant_free(Occupant* occupant)
 {
     if (occupant) {
+        if (occupant->by_nick) {
+            g_sequence_remove(occupant->by_nick);
+        }
+        if (occupant->by_role) {
+            g_sequence_remove(occupant->by_role);
+        }
         free(occupant->nick);
         free(occupant->nick_collate_key);
         free(occupant->jid);
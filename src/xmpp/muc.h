@@ -79,6 +79,9 @@ typedef struct _muc_occupant_t
     muc_affiliation_t affiliation;
     resource_presence_t presence;
     char* status;
+    // position in the room's ordered occupant indexes, owned by muc.c
+    GSequenceIter* by_nick;
+    GSequenceIter* by_role;
 } Occupant;
 
 void muc_init(void);
@@ -93,6 +96,10 @@ gboolean muc_autojoin(const char* const room);
 GList* muc_rooms(void);
 
 void muc_set_features(const char* const room, GSList* features);
+gboolean muc_supports_mam(const char* const room);
+void muc_set_supports_mam(const char* const room, gboolean val);
+gboolean muc_mam_catchup(const char* const room);
+void muc_set_mam_catchup(const char* const room, gboolean val);
 
 char* muc_nick(const char* const room);
 char* muc_password(const char* const room);
@@ -109,6 +116,13 @@ gboolean muc_roster_add(const char* const room, const char* const nick, const ch
 void muc_roster_remove(const char* const room, const char* const nick);
 void muc_roster_set_complete(const char* const room);
 GList* muc_roster(const char* const room);
+int muc_roster_size(const char* const room);
+GSequenceIter* muc_roster_iter(const char* const room);
+GSequenceIter* muc_roster_iter_role(const char* const room, muc_role_t role);
+GSequenceIter* muc_roster_iter_after(const char* const room, const char* const after_key);
+GSequenceIter* muc_roster_iter_role_after(const char* const room, muc_role_t role, const char* const after_key);
+Occupant* muc_roster_iter_next(GSequenceIter** iter);
+void muc_message_highlights(const char* const room, const char* const message, GSList** mentions, GList** triggers);
 Autocomplete muc_roster_ac(const char* const room);
 Autocomplete muc_roster_jid_ac(const char* const room);
 void muc_jid_autocomplete_reset(const char* const room);
@@ -147,6 +161,7 @@ void muc_pending_broadcasts_add(const char* const room, const char* const messag
 GList* muc_pending_broadcasts(const char* const room);
 
 char* muc_autocomplete(ProfWin* window, const char* const input, gboolean previous);
+void muc_speaker_add(const char* const room, const char* const nick);
 void muc_autocomplete_reset(const char* const room);
 
 gboolean muc_requires_config(const char* const room);
@@ -161,6 +176,7 @@ muc_member_type_t muc_member_type(const char* const room);
 muc_anonymity_type_t muc_anonymity_type(const char* const room);
 
 GList* muc_members(const char* const room);
+const GList* muc_member_barejids(const char* const room);
 void muc_members_add(const char* const room, const char* const jid);
 void muc_members_remove(const char* const room, const char* const jid);
 void muc_members_update(const char* const room, const char* const jid, const char* const affiliation);
@@ -38,6 +38,7 @@
 #include <glib.h>
 
 #include "log.h"
+#include "tools/base64.h"
 #include "xmpp/connection.h"
 #include "xmpp/form.h"
 #include "xmpp/iq.h"
@@ -54,6 +55,37 @@ static int _omemo_bundle_publish_result(xmpp_stanza_t* const stanza, void* const
 static int _omemo_bundle_publish_configure(xmpp_stanza_t* const stanza, void* const userdata);
 static int _omemo_bundle_publish_configure_result(xmpp_stanza_t* const stanza, void* const userdata);
 
+// Device list and bundle requests go through a bounded pipeline, so joining a
+// large room doesn't put hundreds of IQs on the wire at once. Requests that
+// are already queued or in flight are not sent twice, transient errors are
+// retried and devices without a bundle are not asked again for a while.
+#define OMEMO_REQUESTS_IN_FLIGHT_MAX 16
+#define OMEMO_REQUEST_RETRIES        2
+#define OMEMO_REQUEST_RETRY_SECS     5
+#define OMEMO_BUNDLE_MISSING_SECS    (10 * 60)
+
+typedef enum {
+    OMEMO_REQUEST_DEVICELIST,
+    OMEMO_REQUEST_BUNDLE
+} omemo_request_type_t;
+
+typedef struct omemo_request_t
+{
+    omemo_request_type_t type;
+    char* jid;
+    uint32_t device_id;
+    int attempts;
+    gboolean retry;
+} OmemoRequest;
+
+static GQueue omemo_requests_pending = G_QUEUE_INIT;
+static guint omemo_requests_in_flight = 0;
+static GHashTable* omemo_requests_known = NULL;
+static GHashTable* omemo_bundles_missing = NULL;
+
+static void _omemo_request_add(omemo_request_type_t type, const char* const jid, uint32_t device_id);
+static void _omemo_requests_pump(void);
+
 void
 omemo_devicelist_subscribe(void)
 {
@@ -99,20 +131,187 @@ omemo_devicelist_configure(void)
 
 void
 omemo_devicelist_request(const char* const jid)
+{
+    _omemo_request_add(OMEMO_REQUEST_DEVICELIST, jid, 0);
+}
+
+void
+omemo_session_bundle_request(const char* const jid, uint32_t device_id)
+{
+    _omemo_request_add(OMEMO_REQUEST_BUNDLE, jid, device_id);
+}
+
+void
+omemo_requests_clear(void)
+{
+    OmemoRequest* request;
+    while ((request = g_queue_pop_head(&omemo_requests_pending))) {
+        free(request->jid);
+        free(request);
+    }
+    if (omemo_requests_known) {
+        g_hash_table_destroy(omemo_requests_known);
+        omemo_requests_known = NULL;
+    }
+    if (omemo_bundles_missing) {
+        g_hash_table_destroy(omemo_bundles_missing);
+        omemo_bundles_missing = NULL;
+    }
+}
+
+static char*
+_omemo_request_key(omemo_request_type_t type, const char* const jid, uint32_t device_id)
+{
+    if (type == OMEMO_REQUEST_DEVICELIST) {
+        return g_strdup(jid);
+    }
+    return g_strdup_printf("%s:%u", jid, device_id);
+}
+
+static void
+_omemo_request_add(omemo_request_type_t type, const char* const jid, uint32_t device_id)
+{
+    if (!omemo_requests_known) {
+        omemo_requests_known = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+        omemo_bundles_missing = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    }
+
+    char* key = _omemo_request_key(type, jid, device_id);
+    if (g_hash_table_contains(omemo_requests_known, key)) {
+        g_free(key);
+        return;
+    }
+    if (type == OMEMO_REQUEST_BUNDLE) {
+        gint64* missing_until = g_hash_table_lookup(omemo_bundles_missing, key);
+        if (missing_until && *missing_until > g_get_monotonic_time()) {
+            log_debug("[OMEMO] skip bundle request of %s, no bundle published", key);
+            g_free(key);
+            return;
+        }
+    }
+    g_hash_table_add(omemo_requests_known, key);
+
+    OmemoRequest* request = malloc(sizeof(OmemoRequest));
+    request->type = type;
+    request->jid = strdup(jid);
+    request->device_id = device_id;
+    request->attempts = 0;
+    request->retry = FALSE;
+    g_queue_push_tail(&omemo_requests_pending, request);
+
+    _omemo_requests_pump();
+}
+
+static void
+_omemo_request_forget(OmemoRequest* request)
+{
+    if (omemo_requests_known) {
+        auto_gchar gchar* key = _omemo_request_key(request->type, request->jid, request->device_id);
+        g_hash_table_remove(omemo_requests_known, key);
+    }
+    free(request->jid);
+    free(request);
+}
+
+static int
+_omemo_request_handler(xmpp_stanza_t* const stanza, void* const userdata)
+{
+    OmemoRequest* request = userdata;
+
+    if (g_strcmp0(xmpp_stanza_get_type(stanza), STANZA_TYPE_ERROR) == 0) {
+        xmpp_stanza_t* error = xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_ERROR);
+        const char* errtype = error ? xmpp_stanza_get_type(error) : NULL;
+        if (g_strcmp0(errtype, STANZA_TYPE_CANCEL) == 0 || g_strcmp0(errtype, STANZA_TYPE_AUTH) == 0) {
+            if (request->type == OMEMO_REQUEST_BUNDLE && omemo_bundles_missing) {
+                gint64* missing_until = g_new(gint64, 1);
+                *missing_until = g_get_monotonic_time() + (gint64)OMEMO_BUNDLE_MISSING_SECS * G_USEC_PER_SEC;
+                g_hash_table_replace(omemo_bundles_missing, _omemo_request_key(request->type, request->jid, request->device_id), missing_until);
+            }
+        } else if (request->attempts < OMEMO_REQUEST_RETRIES) {
+            log_debug("[OMEMO] retry request for %s (device %u)", request->jid, request->device_id);
+            request->retry = TRUE;
+            return 0;
+        }
+    }
+
+    if (request->type == OMEMO_REQUEST_DEVICELIST) {
+        _omemo_receive_devicelist(stanza, NULL);
+    } else {
+        omemo_start_device_session_handle_bundle(stanza, request->jid);
+    }
+
+    // the reply to an IQ comes only once, always drop the handler
+    return 0;
+}
+
+static gboolean
+_omemo_request_retry_cb(gpointer userdata)
+{
+    OmemoRequest* request = userdata;
+    if (connection_get_status() != JABBER_CONNECTED || !omemo_requests_known) {
+        free(request->jid);
+        free(request);
+        return G_SOURCE_REMOVE;
+    }
+    g_queue_push_tail(&omemo_requests_pending, request);
+    _omemo_requests_pump();
+    return G_SOURCE_REMOVE;
+}
+
+static void
+_omemo_request_done(OmemoRequest* request)
+{
+    if (omemo_requests_in_flight > 0) {
+        omemo_requests_in_flight--;
+    }
+
+    if (request->retry && connection_get_status() == JABBER_CONNECTED) {
+        request->retry = FALSE;
+        request->attempts++;
+        g_timeout_add_seconds(OMEMO_REQUEST_RETRY_SECS * request->attempts, _omemo_request_retry_cb, request);
+    } else {
+        _omemo_request_forget(request);
+    }
+
+    _omemo_requests_pump();
+}
+
+static void
+_omemo_request_send(OmemoRequest* request)
 {
     xmpp_ctx_t* const ctx = connection_get_ctx();
     auto_char char* id = connection_create_stanza_id();
+    xmpp_stanza_t* iq;
 
-    log_debug("[OMEMO] request device list for jid: %s", jid);
+    if (request->type == OMEMO_REQUEST_DEVICELIST) {
+        log_debug("[OMEMO] request device list for jid: %s", request->jid);
+        iq = stanza_create_omemo_devicelist_request(ctx, id, request->jid);
+    } else {
+        log_debug("[OMEMO] request omemo bundle (jid: %s, device: %d)", request->jid, request->device_id);
+        iq = stanza_create_omemo_bundle_request(ctx, id, request->jid, request->device_id);
+    }
 
-    xmpp_stanza_t* iq = stanza_create_omemo_devicelist_request(ctx, id, jid);
-    iq_id_handler_add(id, _omemo_receive_devicelist, NULL, NULL);
+    omemo_requests_in_flight++;
+    iq_id_handler_add(id, _omemo_request_handler, (ProfIqFreeCallback)_omemo_request_done, request);
 
     iq_send_stanza(iq);
 
     xmpp_stanza_release(iq);
 }
 
+static void
+_omemo_requests_pump(void)
+{
+    if (connection_get_status() != JABBER_CONNECTED) {
+        return;
+    }
+
+    OmemoRequest* request;
+    while (omemo_requests_in_flight < OMEMO_REQUESTS_IN_FLIGHT_MAX && (request = g_queue_pop_head(&omemo_requests_pending))) {
+        _omemo_request_send(request);
+    }
+}
+
 void
 omemo_bundle_publish(gboolean first)
 {
@@ -261,7 +460,7 @@ omemo_start_device_session_handle_bundle(xmpp_stanza_t* const stanza, void* cons
         }
 
         char* prekey_b64 = xmpp_stanza_get_text(prekey_text);
-        key->data = g_base64_decode(prekey_b64, &key->length);
+        key->data = base64_decode(prekey_b64, &key->length);
         free(prekey_b64);
         if (!key->data) {
             omemo_key_free(key);
@@ -290,7 +489,7 @@ omemo_start_device_session_handle_bundle(xmpp_stanza_t* const stanza, void* cons
 
     size_t signed_prekey_len;
     char* signed_prekey_b64 = xmpp_stanza_get_text(signed_prekey_text);
-    signed_prekey_raw = g_base64_decode(signed_prekey_b64, &signed_prekey_len);
+    signed_prekey_raw = base64_decode(signed_prekey_b64, &signed_prekey_len);
     free(signed_prekey_b64);
     if (!signed_prekey_raw) {
         goto out;
@@ -306,7 +505,7 @@ omemo_start_device_session_handle_bundle(xmpp_stanza_t* const stanza, void* cons
     }
     size_t signed_prekey_signature_len;
     char* signed_prekey_signature_b64 = xmpp_stanza_get_text(signed_prekey_signature_text);
-    signed_prekey_signature_raw = g_base64_decode(signed_prekey_signature_b64, &signed_prekey_signature_len);
+    signed_prekey_signature_raw = base64_decode(signed_prekey_signature_b64, &signed_prekey_signature_len);
     free(signed_prekey_signature_b64);
     if (!signed_prekey_signature_raw) {
         goto out;
@@ -322,7 +521,7 @@ omemo_start_device_session_handle_bundle(xmpp_stanza_t* const stanza, void* cons
     }
     size_t identity_key_len;
     char* identity_key_b64 = xmpp_stanza_get_text(identity_key_text);
-    unsigned char* identity_key_raw = g_base64_decode(identity_key_b64, &identity_key_len);
+    unsigned char* identity_key_raw = base64_decode(identity_key_b64, &identity_key_len);
     free(identity_key_b64);
     if (!identity_key_raw) {
         goto out;
@@ -384,7 +583,7 @@ omemo_receive_message(xmpp_stanza_t* const stanza, gboolean* trusted)
         return NULL;
     }
     size_t iv_len;
-    iv_raw = g_base64_decode(iv_text, &iv_len);
+    iv_raw = base64_decode(iv_text, &iv_len);
     if (!iv_raw) {
         return NULL;
     }
@@ -398,7 +597,7 @@ omemo_receive_message(xmpp_stanza_t* const stanza, gboolean* trusted)
         return NULL;
     }
     size_t payload_len;
-    payload_raw = g_base64_decode(payload_text, &payload_len);
+    payload_raw = base64_decode(payload_text, &payload_len);
     if (!payload_raw) {
         return NULL;
     }
@@ -423,7 +622,7 @@ omemo_receive_message(xmpp_stanza_t* const stanza, gboolean* trusted)
             continue;
         }
 
-        key->data = g_base64_decode(key_text, &key->length);
+        key->data = base64_decode(key_text, &key->length);
         free(key_text);
         if (!key->data) {
             free(key);
@@ -46,6 +46,7 @@
 
 #include "profanity.h"
 #include "log.h"
+#include "stats.h"
 #include "common.h"
 #include "config/preferences.h"
 #include "event/server_events.h"
@@ -60,10 +61,13 @@
 #include "xmpp/iq.h"
 #include "xmpp/xmpp.h"
 #include "xmpp/muc.h"
+#include "xmpp/roster_list.h"
+#include "xmpp/vcard_funcs.h"
 
 static Autocomplete sub_requests_ac;
 
 static int _presence_handler(xmpp_conn_t* const conn, xmpp_stanza_t* const stanza, void* const userdata);
+static int _presence_handler_traced(xmpp_conn_t* const conn, xmpp_stanza_t* const stanza, void* const userdata);
 
 static void _presence_error_handler(xmpp_stanza_t* const stanza);
 static void _unavailable_handler(xmpp_stanza_t* const stanza);
@@ -72,6 +76,8 @@ static void _subscribed_handler(xmpp_stanza_t* const stanza);
 static void _unsubscribed_handler(xmpp_stanza_t* const stanza);
 static void _muc_user_handler(xmpp_stanza_t* const stanza);
 static void _available_handler(xmpp_stanza_t* const stanza);
+static gboolean _presence_unchanged(xmpp_stanza_t* const stanza);
+static void _presence_vcard_update(xmpp_stanza_t* const stanza);
 
 void _send_caps_request(char* node, char* caps_key, char* id, char* from);
 static void _send_room_presence(xmpp_stanza_t* presence);
@@ -88,7 +94,7 @@ presence_handlers_init(void)
 {
     xmpp_conn_t* const conn = connection_get_conn();
     xmpp_ctx_t* const ctx = connection_get_ctx();
-    xmpp_handler_add(conn, _presence_handler, NULL, STANZA_NAME_PRESENCE, NULL, ctx);
+    xmpp_handler_add(conn, _presence_handler_traced, NULL, STANZA_NAME_PRESENCE, NULL, ctx);
 }
 
 void
@@ -286,7 +292,8 @@ presence_join_room(const char* const room, const char* const nick, const char* c
     int pri = accounts_get_priority_for_presence_type(session_get_account_name(), presence_type);
 
     xmpp_ctx_t* ctx = connection_get_ctx();
-    xmpp_stanza_t* presence = stanza_create_room_join_presence(ctx, jid->fulljid, passwd);
+    // a room whose archive we catch up from doesn't need to replay its history
+    xmpp_stanza_t* presence = stanza_create_room_join_presence(ctx, jid->fulljid, passwd, muc_mam_catchup(room));
     stanza_attach_show(ctx, presence, show);
     stanza_attach_status(ctx, presence, status);
     stanza_attach_priority(ctx, presence, pri);
@@ -343,19 +350,30 @@ presence_leave_chat_room(const char* const room_jid)
     xmpp_stanza_release(presence);
 }
 
+// the span covers everything the stanza sets off, sv_ev_* handlers included
+static int
+_presence_handler_traced(xmpp_conn_t* const conn, xmpp_stanza_t* const stanza, void* const userdata)
+{
+    gint64 start = stats_trace_begin();
+    int res = _presence_handler(conn, stanza, userdata);
+    stats_span("presence_handler", start);
+
+    return res;
+}
+
 static int
 _presence_handler(xmpp_conn_t* const conn, xmpp_stanza_t* const stanza, void* const userdata)
 {
     log_debug("Presence stanza handler fired");
     autoping_timer_extend();
+    stats_stanza_received(STATS_STANZA_PRESENCE);
 
-    char* text = NULL;
-    size_t text_size;
-    xmpp_stanza_to_text(stanza, &text, &text_size);
+    if (blocked_contains(xmpp_stanza_get_from(stanza))) {
+        log_debug("Presence from blocked jid dropped");
+        return 1;
+    }
 
-    gboolean cont = plugins_on_presence_stanza_receive(text);
-    xmpp_free(connection_get_ctx(), text);
-    if (!cont) {
+    if (!plugins_on_presence_stanza_receive(stanza)) {
         return 1;
     }
 
@@ -554,9 +572,11 @@ _handle_caps(const char* const jid, XMPPCaps* caps)
                 log_debug("Capabilities cache hit: %s, for %s.", caps->ver, jid);
                 caps_map_jid_to_ver(jid, caps->ver);
             } else {
-                log_debug("Capabilities cache miss: %s, for %s, sending service discovery request", caps->ver, jid);
-                auto_char char* id = connection_create_stanza_id();
-                iq_send_caps_request(jid, id, caps->node, caps->ver);
+                if (caps_ver_request_start(caps->ver, jid)) {
+                    log_debug("Capabilities cache miss: %s, for %s, sending service discovery request", caps->ver, jid);
+                    auto_char char* id = connection_create_stanza_id();
+                    iq_send_caps_request(jid, id, caps->node, caps->ver);
+                }
             }
         }
 
@@ -596,6 +616,14 @@ _available_handler(xmpp_stanza_t* const stanza)
         return;
     }
 
+    _presence_vcard_update(stanza);
+
+    // servers re-broadcast presences on priority churn or other clients reconnecting
+    if (_presence_unchanged(stanza)) {
+        stats_count(STATS_COUNTER_PRESENCE_UNCHANGED);
+        return;
+    }
+
     int err = 0;
     XMPPPresence* xmpp_presence = stanza_parse_presence(stanza, &err);
 
@@ -711,6 +739,117 @@ _available_handler(xmpp_stanza_t* const stanza)
     stanza_free_presence(xmpp_presence);
 }
 
+// XEP-0153: the advertised photo hash tells whether a cached vCard is stale
+static void
+_presence_vcard_update(xmpp_stanza_t* const stanza)
+{
+    xmpp_stanza_t* update = xmpp_stanza_get_child_by_name_and_ns(stanza, STANZA_NAME_X, STANZA_NS_VCARD_UPDATE);
+    xmpp_stanza_t* photo = update ? xmpp_stanza_get_child_by_name(update, "photo") : NULL;
+    if (!photo) {
+        return;
+    }
+
+    const char* from = xmpp_stanza_get_from(stanza);
+    auto_jid Jid* jid = from ? jid_create(from) : NULL;
+    if (!jid) {
+        return;
+    }
+
+    // empty <photo/> advertises no photo
+    char* hash = xmpp_stanza_get_text(photo);
+    vcard_cache_validate(jid->barejid, hash ?: "");
+    xmpp_free(connection_get_ctx(), hash);
+}
+
+// text of a child which holds nothing but text, FALSE when it holds more
+static gboolean
+_presence_child_text(xmpp_stanza_t* const child, const char** text)
+{
+    *text = NULL;
+    if (!child) {
+        return TRUE;
+    }
+
+    xmpp_stanza_t* content = xmpp_stanza_get_children(child);
+    if (!content) {
+        return TRUE;
+    }
+    if (!xmpp_stanza_is_text(content) || xmpp_stanza_get_next(content)) {
+        return FALSE;
+    }
+
+    *text = xmpp_stanza_get_text_ptr(content);
+    return TRUE;
+}
+
+// TRUE when a contact's resource sends the show, status, priority and caps
+// we already hold for it, anything we can't compare takes the full path
+static gboolean
+_presence_unchanged(xmpp_stanza_t* const stanza)
+{
+    if (!roster_exists()) {
+        return FALSE;
+    }
+
+    const char* from = xmpp_stanza_get_from(stanza);
+    const char* slash = from ? strchr(from, '/') : NULL;
+    if (!slash || slash[1] == '\0') {
+        return FALSE;
+    }
+
+    xmpp_stanza_t* show = NULL;
+    xmpp_stanza_t* status = NULL;
+    xmpp_stanza_t* priority = NULL;
+    const char* ver = NULL;
+
+    for (xmpp_stanza_t* child = xmpp_stanza_get_children(stanza); child; child = xmpp_stanza_get_next(child)) {
+        const char* name = xmpp_stanza_get_name(child);
+        if (!name) {
+            continue;
+        }
+        const char* ns = xmpp_stanza_get_ns(child);
+
+        if (g_strcmp0(name, STANZA_NAME_SHOW) == 0) {
+            show = show ?: child;
+        } else if (g_strcmp0(name, STANZA_NAME_STATUS) == 0) {
+            status = status ?: child;
+        } else if (g_strcmp0(name, STANZA_NAME_PRIORITY) == 0) {
+            priority = priority ?: child;
+        } else if (g_strcmp0(ns, STANZA_NS_CAPS) == 0) {
+            ver = ver ?: xmpp_stanza_get_attribute(child, STANZA_ATTR_VER);
+        } else if (g_strcmp0(ns, STANZA_NS_LASTACTIVITY) == 0) {
+            // idle time changes between otherwise identical presences
+            return FALSE;
+        }
+    }
+
+    const char* show_str;
+    const char* status_str;
+    const char* priority_str;
+    if (!_presence_child_text(show, &show_str) || !_presence_child_text(status, &status_str) || !_presence_child_text(priority, &priority_str)) {
+        return FALSE;
+    }
+
+    auto_gchar gchar* barejid = g_strndup(from, slash - from);
+    if (equals_our_barejid(barejid)) {
+        return FALSE;
+    }
+
+    PContact contact = roster_get_contact(barejid);
+    if (!contact || p_contact_last_activity(contact)) {
+        return FALSE;
+    }
+    Resource* resource = p_contact_get_resource(contact, slash + 1);
+    if (!resource) {
+        return FALSE;
+    }
+
+    return resource->presence == resource_presence_from_string(show_str)
+           && g_strcmp0(resource->status, status_str) == 0
+           && resource->priority == (priority_str ? atoi(priority_str) : 0)
+           && g_strcmp0(caps_jid_ver(from), ver) == 0;
+}
+
 void
 _send_caps_request(char* node, char* caps_key, char* id, char* from)
 {
@@ -925,12 +1064,12 @@ _send_presence_stanza(xmpp_stanza_t* const stanza)
     size_t text_size;
     xmpp_stanza_to_text(stanza, &text, &text_size);
 
-    xmpp_conn_t* conn = connection_get_conn();
+    stats_stanza_sent(STATS_STANZA_PRESENCE);
     auto_char char* plugin_text = plugins_on_presence_stanza_send(text);
     if (plugin_text) {
-        xmpp_send_raw_string(conn, "%s", plugin_text);
+        connection_send_raw(plugin_text);
     } else {
-        xmpp_send_raw_string(conn, "%s", text);
+        connection_send_raw(text);
     }
     xmpp_free(connection_get_ctx(), text);
 }
@@ -45,6 +45,8 @@
 
 #include "profanity.h"
 #include "log.h"
+#include "common.h"
+#include "config/files.h"
 #include "config/preferences.h"
 #include "plugins/plugins.h"
 #include "event/server_events.h"
@@ -71,11 +73,129 @@ static int _group_add_id_handler(xmpp_stanza_t* const stanza, void* const userda
 static int _group_remove_id_handler(xmpp_stanza_t* const stanza, void* const userdata);
 static void _free_group_data(GroupData* data);
 
+// local copy of the roster and its XEP-0237 version, one group per contact
+#define ROSTER_CACHE_FILE "roster"
+#define ROSTER_CACHE_META "roster"
+
+static prof_keyfile_t roster_cache;
+static gchar* roster_cache_jid = NULL;
+
+static GKeyFile*
+_roster_cache(void)
+{
+    const char* barejid = connection_get_barejid();
+    if (!barejid) {
+        return NULL;
+    }
+    if (roster_cache.keyfile && g_strcmp0(roster_cache_jid, barejid) == 0) {
+        return roster_cache.keyfile;
+    }
+
+    roster_cache_close();
+    gchar* filename = files_file_in_account_data_path(DIR_ROSTER, barejid, ROSTER_CACHE_FILE);
+    if (!filename) {
+        return NULL;
+    }
+    load_custom_keyfile(&roster_cache, filename);
+    roster_cache_jid = g_strdup(barejid);
+
+    return roster_cache.keyfile;
+}
+
+void
+roster_cache_close(void)
+{
+    free_keyfile(&roster_cache);
+    g_free(roster_cache_jid);
+    roster_cache_jid = NULL;
+}
+
+static void
+_roster_cache_set_ver(GKeyFile* cache, const char* const ver)
+{
+    if (ver) {
+        g_key_file_set_string(cache, ROSTER_CACHE_META, STANZA_ATTR_VER, ver);
+    } else {
+        g_key_file_remove_key(cache, ROSTER_CACHE_META, STANZA_ATTR_VER, NULL);
+    }
+}
+
+static void
+_roster_cache_set(GKeyFile* cache, const char* const barejid, const char* const name, GSList* groups,
+                  const char* const sub, gboolean pending_out)
+{
+    g_key_file_remove_group(cache, barejid, NULL);
+    if (name) {
+        g_key_file_set_string(cache, barejid, STANZA_ATTR_NAME, name);
+    }
+    g_key_file_set_string(cache, barejid, STANZA_ATTR_SUBSCRIPTION, sub ? sub : "none");
+    g_key_file_set_boolean(cache, barejid, STANZA_ATTR_ASK, pending_out);
+
+    guint len = g_slist_length(groups);
+    if (len > 0) {
+        const gchar* list[len];
+        int i = 0;
+        for (GSList* curr = groups; curr; curr = g_slist_next(curr)) {
+            list[i++] = curr->data;
+        }
+        g_key_file_set_string_list(cache, barejid, STANZA_NAME_GROUP, list, len);
+    }
+}
+
+// fill the roster from the local copy, so it is usable before the server answers,
+// returns the roster version to ask the server for changes since
+static gchar*
+_roster_cache_load(void)
+{
+    GKeyFile* cache = _roster_cache();
+    if (!cache) {
+        return NULL;
+    }
+
+    gsize len = 0;
+    auto_gcharv gchar** jids = g_key_file_get_groups(cache, &len);
+    if (len == 0) {
+        return NULL;
+    }
+
+    roster_add_begin();
+    for (gsize i = 0; i < len; i++) {
+        if (g_strcmp0(jids[i], ROSTER_CACHE_META) == 0) {
+            continue;
+        }
+        auto_gchar gchar* name = g_key_file_get_string(cache, jids[i], STANZA_ATTR_NAME, NULL);
+        auto_gchar gchar* sub = g_key_file_get_string(cache, jids[i], STANZA_ATTR_SUBSCRIPTION, NULL);
+        gboolean pending_out = g_key_file_get_boolean(cache, jids[i], STANZA_ATTR_ASK, NULL);
+
+        GSList* groups = NULL;
+        auto_gcharv gchar** group_list = g_key_file_get_string_list(cache, jids[i], STANZA_NAME_GROUP, NULL, NULL);
+        for (int g = 0; group_list && group_list[g]; g++) {
+            groups = g_slist_append(groups, strdup(group_list[g]));
+        }
+
+        if (!roster_add(jids[i], name, groups, sub, pending_out)) {
+            g_slist_free_full(groups, free);
+        }
+    }
+    roster_add_end();
+
+    if (prefs_get_boolean(PREF_ROSTER)) {
+        ui_show_roster();
+    }
+
+    return g_key_file_get_string(cache, ROSTER_CACHE_META, STANZA_ATTR_VER, NULL);
+}
+
 void
 roster_request(void)
 {
+    auto_gchar gchar* ver = _roster_cache_load();
+    if (ver) {
+        log_debug("Requesting roster changes since version %s", ver);
+    }
+
     xmpp_ctx_t* const ctx = connection_get_ctx();
-    xmpp_stanza_t* iq = stanza_create_roster_iq(ctx);
+    xmpp_stanza_t* iq = stanza_create_roster_iq(ctx, ver);
     iq_send_stanza(iq);
     xmpp_stanza_release(iq);
 }
@@ -217,8 +337,18 @@ roster_set_handler(xmpp_stanza_t* const stanza)
         name = NULL;
     }
 
+    GKeyFile* cache = _roster_cache();
+    if (cache) {
+        _roster_cache_set_ver(cache, xmpp_stanza_get_attribute(query, STANZA_ATTR_VER));
+    }
+
     // remove from roster
     if (g_strcmp0(sub, "remove") == 0) {
+        if (cache) {
+            g_key_file_remove_group(cache, barejid_lower, NULL);
+            save_keyfile(&roster_cache);
+        }
+
         // remove barejid and name
         if (name == NULL) {
             name = barejid_lower;
@@ -236,6 +366,10 @@ roster_set_handler(xmpp_stanza_t* const stanza)
         }
 
         GSList* groups = roster_get_groups_from_item(item);
+        if (cache) {
+            _roster_cache_set(cache, barejid_lower, name, groups, sub, pending_out);
+            save_keyfile(&roster_cache);
+        }
 
         // update the local roster
         PContact contact = roster_get_contact(barejid_lower);
@@ -261,10 +395,26 @@ roster_result_handler(xmpp_stanza_t* const stanza)
         return;
     }
 
-    // handle initial roster response
+    // no query, the cached roster is current and changes arrive as pushes (XEP-0237)
     xmpp_stanza_t* query = xmpp_stanza_get_child_by_name(stanza, STANZA_NAME_QUERY);
+    if (query == NULL) {
+        log_debug("Roster unchanged since cached version");
+        sv_ev_roster_received();
+        return;
+    }
+
+    // handle initial roster response, it replaces whatever the cache held
+    GKeyFile* cache = _roster_cache();
+    if (cache) {
+        g_key_file_free(roster_cache.keyfile);
+        roster_cache.keyfile = g_key_file_new();
+        cache = roster_cache.keyfile;
+        _roster_cache_set_ver(cache, xmpp_stanza_get_attribute(query, STANZA_ATTR_VER));
+    }
+    GHashTable* received = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
     xmpp_stanza_t* item = xmpp_stanza_get_children(query);
 
+    roster_add_begin();
     while (item) {
         const char* barejid = xmpp_stanza_get_attribute(item, STANZA_ATTR_JID);
         auto_gchar gchar* barejid_lower = g_utf8_strdown(barejid, -1);
@@ -282,15 +432,41 @@ roster_result_handler(xmpp_stanza_t* const stanza)
         }
 
         GSList* groups = roster_get_groups_from_item(item);
+        if (cache) {
+            _roster_cache_set(cache, barejid_lower, name, groups, sub, pending_out);
+        }
 
-        gboolean added = roster_add(barejid_lower, name, groups, sub, pending_out);
-        if (!added) {
+        if (g_hash_table_contains(received, barejid_lower)) {
             log_warning("Attempt to add contact twice: %s", barejid_lower);
+            g_slist_free_full(groups, free);
+        } else if (roster_get_contact(barejid_lower)) {
+            roster_update(barejid_lower, name, groups, sub, pending_out);
+        } else {
+            roster_add(barejid_lower, name, groups, sub, pending_out);
         }
+        g_hash_table_add(received, g_strdup(barejid_lower));
 
         item = xmpp_stanza_get_next(item);
     }
 
+    // drop cached contacts the server no longer has
+    GSList* contacts = roster_get_contacts(ROSTER_ORD_NAME);
+    for (GSList* curr = contacts; curr; curr = g_slist_next(curr)) {
+        PContact contact = curr->data;
+        if (!g_hash_table_contains(received, p_contact_barejid(contact))) {
+            auto_gchar gchar* barejid = g_strdup(p_contact_barejid(contact));
+            auto_gchar gchar* name = g_strdup(p_contact_name(contact) ? p_contact_name(contact) : barejid);
+            roster_remove(name, barejid);
+        }
+    }
+    g_slist_free(contacts);
+    g_hash_table_destroy(received);
+    roster_add_end();
+
+    if (cache) {
+        save_keyfile(&roster_cache);
+    }
+
     sv_ev_roster_received();
 
     return;
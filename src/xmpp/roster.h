@@ -37,6 +37,7 @@
 #define XMPP_ROSTER_H
 
 void roster_request(void);
+void roster_cache_close(void);
 void roster_set_handler(xmpp_stanza_t* const stanza);
 void roster_result_handler(xmpp_stanza_t* const stanza);
 GSList* roster_get_groups_from_item(xmpp_stanza_t* const item);
@@ -48,6 +48,10 @@
 #include "xmpp/contact.h"
 #include "xmpp/jid.h"
 
+// one bucket per p_contact_presence_weight(), offline is the last
+#define ROSTER_PRESENCE_BUCKETS 6
+#define ROSTER_PRESENCE_OFFLINE (ROSTER_PRESENCE_BUCKETS - 1)
+
 typedef struct prof_roster_t
 {
     // contacts, indexed on barejid
@@ -67,9 +71,36 @@ typedef struct prof_roster_t
 
     // groups
     Autocomplete groups_ac;
-    GHashTable* group_count;
+
+    // ordered contacts, all of them, those without a group and per group,
+    // a group exists while its index has members
+    struct roster_index_t* all;
+    struct roster_index_t* ungrouped;
+    GHashTable* group_index;
+
+    // ordered contacts by effective presence, any but offline and per presence
+    struct roster_index_t* online;
+    struct roster_index_t* presence[ROSTER_PRESENCE_BUCKETS];
+
+    // PContact -> GSList of RosterIndexEntry, the contact's place in each index
+    GHashTable* index_entries;
 } ProfRoster;
 
+typedef struct roster_index_t
+{
+    // NULL for the all and ungrouped indexes
+    gchar* group;
+    GSequence* by_name;
+    GSequence* by_presence;
+} RosterIndex;
+
+typedef struct roster_index_entry_t
+{
+    RosterIndex* index;
+    GSequenceIter* by_name;
+    GSequenceIter* by_presence;
+} RosterIndexEntry;
+
 typedef struct pending_presence
 {
     char* barejid;
@@ -85,6 +116,12 @@ static gboolean _key_equals(void* key1, void* key2);
 static gboolean _datetimes_equal(GDateTime* dt1, GDateTime* dt2);
 static void _replace_name(const char* const current_name, const char* const new_name, const char* const barejid);
 static void _add_name_and_barejid(const char* const name, const char* const barejid);
+static void _change_name(PContact contact, const char* const new_name);
+static RosterIndex* _index_new(const char* const group);
+static void _index_free(RosterIndex* index);
+static GSequenceIter* _index_begin(RosterIndex* index, roster_ord_t order);
+static void _index_add(PContact contact);
+static void _index_remove(PContact contact);
 
 void
 roster_create(void)
@@ -98,7 +135,14 @@ roster_create(void)
     roster->fulljid_ac = autocomplete_new();
     roster->name_to_barejid = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
     roster->groups_ac = autocomplete_new();
-    roster->group_count = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    roster->all = _index_new(NULL);
+    roster->ungrouped = _index_new(NULL);
+    roster->group_index = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, (GDestroyNotify)_index_free);
+    roster->online = _index_new(NULL);
+    for (int i = 0; i < ROSTER_PRESENCE_BUCKETS; i++) {
+        roster->presence[i] = _index_new(NULL);
+    }
+    roster->index_entries = g_hash_table_new(g_direct_hash, g_direct_equal);
 
     roster_received = FALSE;
     roster_pending_presence = NULL;
@@ -120,13 +164,27 @@ roster_destroy(void)
 {
     assert(roster != NULL);
 
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, roster->index_entries);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        g_slist_free_full(value, g_free);
+    }
+    g_hash_table_destroy(roster->index_entries);
+    g_hash_table_destroy(roster->group_index);
+    _index_free(roster->all);
+    _index_free(roster->ungrouped);
+    _index_free(roster->online);
+    for (int i = 0; i < ROSTER_PRESENCE_BUCKETS; i++) {
+        _index_free(roster->presence[i]);
+    }
+
     g_hash_table_destroy(roster->contacts);
     autocomplete_free(roster->name_ac);
     autocomplete_free(roster->barejid_ac);
     autocomplete_free(roster->fulljid_ac);
     g_hash_table_destroy(roster->name_to_barejid);
     autocomplete_free(roster->groups_ac);
-    g_hash_table_destroy(roster->group_count);
 
     free(roster);
     roster = NULL;
@@ -165,7 +223,9 @@ roster_update_presence(const char* const barejid, Resource* resource, GDateTime*
     if (!_datetimes_equal(p_contact_last_activity(contact), last_activity)) {
         p_contact_set_last_activity(contact, last_activity);
     }
+    _index_remove(contact);
     p_contact_set_presence(contact, resource);
+    _index_add(contact);
     auto_jid Jid* jid = jid_create_from_bare_and_resource(barejid, resource->name);
     autocomplete_add(roster->fulljid_ac, jid->fulljid);
 
@@ -223,7 +283,9 @@ roster_contact_offline(const char* const barejid, const char* const resource, co
     if (resource == NULL) {
         return TRUE;
     } else {
+        _index_remove(contact);
         gboolean result = p_contact_remove_resource(contact, resource);
+        _index_add(contact);
         if (result == TRUE) {
             auto_jid Jid* jid = jid_create_from_bare_and_resource(barejid, resource);
             autocomplete_remove(roster->fulljid_ac, jid->fulljid);
@@ -250,6 +312,14 @@ roster_change_name(PContact contact, const char* const new_name)
     assert(roster != NULL);
     assert(contact != NULL);
 
+    _index_remove(contact);
+    _change_name(contact, new_name);
+    _index_add(contact);
+}
+
+static void
+_change_name(PContact contact, const char* const new_name)
+{
     auto_char char* current_name = NULL;
     const char* barejid = p_contact_barejid(contact);
 
@@ -283,26 +353,12 @@ roster_remove(const char* const name, const char* const barejid)
             resources = g_list_next(resources);
         }
         g_list_free(resources);
-
-        GSList* groups = p_contact_groups(contact);
-        GSList* curr = groups;
-        while (curr) {
-            gchar* group = curr->data;
-            if (g_hash_table_contains(roster->group_count, group)) {
-                int count = GPOINTER_TO_INT(g_hash_table_lookup(roster->group_count, group));
-                count--;
-                if (count < 1) {
-                    g_hash_table_remove(roster->group_count, group);
-                    autocomplete_remove(roster->groups_ac, group);
-                } else {
-                    g_hash_table_insert(roster->group_count, strdup(group), GINT_TO_POINTER(count));
-                }
-            }
-            curr = g_slist_next(curr);
-        }
     }
 
     // remove the contact
+    if (contact) {
+        _index_remove(contact);
+    }
     g_hash_table_remove(roster->contacts, barejid);
 }
 
@@ -318,51 +374,11 @@ roster_update(const char* const barejid, const char* const name, GSList* groups,
     p_contact_set_subscription(contact, subscription);
     p_contact_set_pending_out(contact, pending_out);
 
-    roster_change_name(contact, name);
-
-    GSList* curr_new_group = groups;
-    while (curr_new_group) {
-        char* new_group = curr_new_group->data;
-
-        // contact added to group
-        if (!p_contact_in_group(contact, new_group)) {
-
-            // group doesn't yet exist
-            if (!g_hash_table_contains(roster->group_count, new_group)) {
-                g_hash_table_insert(roster->group_count, strdup(new_group), GINT_TO_POINTER(1));
-                autocomplete_add(roster->groups_ac, curr_new_group->data);
-
-                // increment count
-            } else {
-                int count = GPOINTER_TO_INT(g_hash_table_lookup(roster->group_count, new_group));
-                g_hash_table_insert(roster->group_count, strdup(new_group), GINT_TO_POINTER(count + 1));
-            }
-        }
-        curr_new_group = g_slist_next(curr_new_group);
-    }
-
-    GSList* old_groups = p_contact_groups(contact);
-    GSList* curr_old_group = old_groups;
-    while (curr_old_group) {
-        char* old_group = curr_old_group->data;
-        // removed from group
-        if (!g_slist_find_custom(groups, old_group, (GCompareFunc)g_strcmp0)) {
-            if (g_hash_table_contains(roster->group_count, old_group)) {
-                int count = GPOINTER_TO_INT(g_hash_table_lookup(roster->group_count, old_group));
-                count--;
-                if (count < 1) {
-                    g_hash_table_remove(roster->group_count, old_group);
-                    autocomplete_remove(roster->groups_ac, old_group);
-                } else {
-                    g_hash_table_insert(roster->group_count, strdup(old_group), GINT_TO_POINTER(count));
-                }
-            }
-        }
-
-        curr_old_group = g_slist_next(curr_old_group);
-    }
+    _index_remove(contact);
+    _change_name(contact, name);
 
     p_contact_set_groups(contact, groups);
+    _index_add(contact);
 }
 
 gboolean
@@ -378,28 +394,40 @@ roster_add(const char* const barejid, const char* const name, GSList* groups, co
 
     contact = p_contact_new(barejid, name, groups, subscription, NULL, pending_out);
 
-    // add groups
-    GSList* curr_new_group = groups;
-    while (curr_new_group) {
-        char* new_group = curr_new_group->data;
-        if (g_hash_table_contains(roster->group_count, new_group)) {
-            int count = GPOINTER_TO_INT(g_hash_table_lookup(roster->group_count, new_group));
-            g_hash_table_insert(roster->group_count, strdup(new_group), GINT_TO_POINTER(count + 1));
-        } else {
-            g_hash_table_insert(roster->group_count, strdup(new_group), GINT_TO_POINTER(1));
-            autocomplete_add(roster->groups_ac, new_group);
-        }
-
-        curr_new_group = g_slist_next(curr_new_group);
-    }
-
     g_hash_table_insert(roster->contacts, strdup(barejid), contact);
+    _index_add(contact);
     autocomplete_add(roster->barejid_ac, barejid);
     _add_name_and_barejid(name, barejid);
 
     return TRUE;
 }
 
+/**
+ * Start adding a batch of contacts, e.g. the initial roster.
+ *
+ * The completion lists are sorted once in roster_add_end() instead of
+ * on every roster_add().
+ */
+void
+roster_add_begin(void)
+{
+    assert(roster != NULL);
+
+    autocomplete_bulk_begin(roster->name_ac);
+    autocomplete_bulk_begin(roster->barejid_ac);
+    autocomplete_bulk_begin(roster->groups_ac);
+}
+
+void
+roster_add_end(void)
+{
+    assert(roster != NULL);
+
+    autocomplete_bulk_end(roster->name_ac);
+    autocomplete_bulk_end(roster->barejid_ac);
+    autocomplete_bulk_end(roster->groups_ac);
+}
+
 /**
  * Retrieve the bare JID from the roster based on the name.
  *
@@ -427,20 +455,15 @@ roster_get_contacts_by_presence(const char* const presence)
     assert(roster != NULL);
 
     GSList* result = NULL;
-    GHashTableIter iter;
-    gpointer key;
-    gpointer value;
+    GSequenceIter* iter = roster_iter_presence(presence);
+    PContact contact;
 
-    g_hash_table_iter_init(&iter, roster->contacts);
-    while (g_hash_table_iter_next(&iter, &key, &value)) {
-        PContact contact = (PContact)value;
-        if (g_strcmp0(p_contact_presence(contact), presence) == 0) {
-            result = g_slist_insert_sorted(result, value, (GCompareFunc)roster_compare_name);
-        }
+    while ((contact = roster_iter_next(&iter))) {
+        result = g_slist_prepend(result, contact);
     }
 
     // return all contact structs
-    return result;
+    return g_slist_reverse(result);
 }
 
 GSList*
@@ -449,24 +472,15 @@ roster_get_contacts(roster_ord_t order)
     assert(roster != NULL);
 
     GSList* result = NULL;
-    GHashTableIter iter;
-    gpointer key;
-    gpointer value;
+    GSequenceIter* iter = roster_iter_contacts(order);
+    PContact contact;
 
-    GCompareFunc cmp_func;
-    if (order == ROSTER_ORD_PRESENCE) {
-        cmp_func = (GCompareFunc)roster_compare_presence;
-    } else {
-        cmp_func = (GCompareFunc)roster_compare_name;
-    }
-
-    g_hash_table_iter_init(&iter, roster->contacts);
-    while (g_hash_table_iter_next(&iter, &key, &value)) {
-        result = g_slist_insert_sorted(result, value, cmp_func);
+    while ((contact = roster_iter_next(&iter))) {
+        result = g_slist_prepend(result, contact);
     }
 
     // return all contact structs
-    return result;
+    return g_slist_reverse(result);
 }
 
 GSList*
@@ -475,18 +489,15 @@ roster_get_contacts_online(void)
     assert(roster != NULL);
 
     GSList* result = NULL;
-    GHashTableIter iter;
-    gpointer key;
-    gpointer value;
+    GSequenceIter* iter = _index_begin(roster->online, ROSTER_ORD_NAME);
+    PContact contact;
 
-    g_hash_table_iter_init(&iter, roster->contacts);
-    while (g_hash_table_iter_next(&iter, &key, &value)) {
-        if (strcmp(p_contact_presence(value), "offline"))
-            result = g_slist_insert_sorted(result, value, (GCompareFunc)roster_compare_name);
+    while ((contact = roster_iter_next(&iter))) {
+        result = g_slist_prepend(result, contact);
     }
 
     // return all contact structs
-    return result;
+    return g_slist_reverse(result);
 }
 
 gboolean
@@ -531,37 +542,214 @@ roster_get_group(const char* const group, roster_ord_t order)
     assert(roster != NULL);
 
     GSList* result = NULL;
-    GHashTableIter iter;
-    gpointer key;
-    gpointer value;
+    GSequenceIter* iter = roster_iter_group(group, order);
+    PContact contact;
+
+    while ((contact = roster_iter_next(&iter))) {
+        result = g_slist_prepend(result, contact);
+    }
+
+    // return all contact structs
+    return g_slist_reverse(result);
+}
+
+static GSequenceIter*
+_index_begin(RosterIndex* index, roster_ord_t order)
+{
+    if (index == NULL) {
+        return NULL;
+    }
 
-    GCompareFunc cmp_func;
     if (order == ROSTER_ORD_PRESENCE) {
-        cmp_func = (GCompareFunc)roster_compare_presence;
+        return g_sequence_get_begin_iter(index->by_presence);
     } else {
-        cmp_func = (GCompareFunc)roster_compare_name;
+        return g_sequence_get_begin_iter(index->by_name);
     }
+}
 
-    g_hash_table_iter_init(&iter, roster->contacts);
-    while (g_hash_table_iter_next(&iter, &key, &value)) {
-        GSList* groups = p_contact_groups(value);
-        if (group == NULL) {
-            if (groups == NULL) {
-                result = g_slist_insert_sorted(result, value, cmp_func);
-            }
-        } else {
-            while (groups) {
-                if (strcmp(groups->data, group) == 0) {
-                    result = g_slist_insert_sorted(result, value, cmp_func);
-                    break;
-                }
-                groups = g_slist_next(groups);
-            }
+/**
+ * Iterate over all contacts in the given order without copying them.
+ *
+ * @return An iterator to pass to roster_iter_next(). It is invalidated by
+ *         any change to the roster.
+ */
+GSequenceIter*
+roster_iter_contacts(roster_ord_t order)
+{
+    assert(roster != NULL);
+
+    return _index_begin(roster->all, order);
+}
+
+/**
+ * Iterate over the contacts of a group, or the contacts without a group if
+ * group is NULL, in the given order.
+ */
+GSequenceIter*
+roster_iter_group(const char* const group, roster_ord_t order)
+{
+    assert(roster != NULL);
+
+    if (group == NULL) {
+        return _index_begin(roster->ungrouped, order);
+    }
+
+    return _index_begin(g_hash_table_lookup(roster->group_index, group), order);
+}
+
+static int
+_presence_bucket(const char* const presence)
+{
+    if (g_strcmp0(presence, "chat") == 0) {
+        return 0;
+    } else if (g_strcmp0(presence, "online") == 0) {
+        return 1;
+    } else if (g_strcmp0(presence, "away") == 0) {
+        return 2;
+    } else if (g_strcmp0(presence, "xa") == 0) {
+        return 3;
+    } else if (g_strcmp0(presence, "dnd") == 0) {
+        return 4;
+    } else {
+        return ROSTER_PRESENCE_OFFLINE;
+    }
+}
+
+/**
+ * Iterate over the contacts whose effective presence is presence, e.g.
+ * "away" or "offline", ordered by name.
+ */
+GSequenceIter*
+roster_iter_presence(const char* const presence)
+{
+    assert(roster != NULL);
+
+    return _index_begin(roster->presence[_presence_bucket(presence)], ROSTER_ORD_NAME);
+}
+
+/**
+ * Return the contact at iter and advance iter, NULL when there are no more.
+ */
+PContact
+roster_iter_next(GSequenceIter** iter)
+{
+    if (*iter == NULL || g_sequence_iter_is_end(*iter)) {
+        return NULL;
+    }
+
+    PContact contact = g_sequence_get(*iter);
+    *iter = g_sequence_iter_next(*iter);
+
+    return contact;
+}
+
+static RosterIndex*
+_index_new(const char* const group)
+{
+    RosterIndex* index = g_new(RosterIndex, 1);
+    index->group = g_strdup(group);
+    index->by_name = g_sequence_new(NULL);
+    index->by_presence = g_sequence_new(NULL);
+
+    return index;
+}
+
+static void
+_index_free(RosterIndex* index)
+{
+    g_sequence_free(index->by_name);
+    g_sequence_free(index->by_presence);
+    g_free(index->group);
+    g_free(index);
+}
+
+static gint
+_index_cmp_name(gconstpointer a, gconstpointer b, gpointer data)
+{
+    return roster_compare_name((PContact)a, (PContact)b);
+}
+
+static gint
+_index_cmp_presence(gconstpointer a, gconstpointer b, gpointer data)
+{
+    return roster_compare_presence((PContact)a, (PContact)b);
+}
+
+static GSList*
+_index_insert(GSList* entries, RosterIndex* index, PContact contact)
+{
+    RosterIndexEntry* entry = g_new(RosterIndexEntry, 1);
+    entry->index = index;
+    entry->by_name = g_sequence_insert_sorted(index->by_name, contact, _index_cmp_name, NULL);
+    entry->by_presence = g_sequence_insert_sorted(index->by_presence, contact, _index_cmp_presence, NULL);
+
+    return g_slist_prepend(entries, entry);
+}
+
+static gint
+_entry_has_index(gconstpointer entry, gconstpointer index)
+{
+    return ((const RosterIndexEntry*)entry)->index == index ? 0 : 1;
+}
+
+/*
+ * Place the contact in the ordered indexes, it must be taken out with
+ * _index_remove() before anything its order depends on changes.
+ */
+static void
+_index_add(PContact contact)
+{
+    if (g_hash_table_contains(roster->index_entries, contact)) {
+        return;
+    }
+
+    GSList* entries = _index_insert(NULL, roster->all, contact);
+
+    int bucket = p_contact_presence_weight(contact);
+    entries = _index_insert(entries, roster->presence[bucket], contact);
+    if (bucket != ROSTER_PRESENCE_OFFLINE) {
+        entries = _index_insert(entries, roster->online, contact);
+    }
+
+    GSList* groups = p_contact_groups(contact);
+    if (groups == NULL) {
+        entries = _index_insert(entries, roster->ungrouped, contact);
+    }
+    for (GSList* curr = groups; curr; curr = g_slist_next(curr)) {
+        RosterIndex* index = g_hash_table_lookup(roster->group_index, curr->data);
+        if (index == NULL) {
+            index = _index_new(curr->data);
+            g_hash_table_insert(roster->group_index, index->group, index);
+            autocomplete_add(roster->groups_ac, index->group);
+        } else if (g_slist_find_custom(entries, index, _entry_has_index)) {
+            // group listed twice
+            continue;
         }
+        entries = _index_insert(entries, index, contact);
     }
 
-    // return all contact structs
-    return result;
+    g_hash_table_insert(roster->index_entries, contact, entries);
+}
+
+static void
+_index_remove(PContact contact)
+{
+    GSList* entries = g_hash_table_lookup(roster->index_entries, contact);
+
+    for (GSList* curr = entries; curr; curr = g_slist_next(curr)) {
+        RosterIndexEntry* entry = curr->data;
+        g_sequence_remove(entry->by_name);
+        g_sequence_remove(entry->by_presence);
+
+        // drop indexes of groups that became empty
+        if (entry->index->group && g_sequence_is_empty(entry->index->by_name)) {
+            autocomplete_remove(roster->groups_ac, entry->index->group);
+            g_hash_table_remove(roster->group_index, entry->index->group);
+        }
+    }
+
+    g_slist_free_full(entries, g_free);
+    g_hash_table_remove(roster->index_entries, contact);
 }
 
 GList*
@@ -646,63 +834,22 @@ _add_name_and_barejid(const char* const name, const char* const barejid)
 gint
 roster_compare_name(PContact a, PContact b)
 {
-    const char* utf8_str_a = NULL;
-    const char* utf8_str_b = NULL;
-
-    if (p_contact_name_collate_key(a)) {
-        utf8_str_a = p_contact_name_collate_key(a);
-    } else {
-        utf8_str_a = p_contact_barejid_collate_key(a);
-    }
-    if (p_contact_name_collate_key(b)) {
-        utf8_str_b = p_contact_name_collate_key(b);
-    } else {
-        utf8_str_b = p_contact_barejid_collate_key(b);
-    }
-
-    gint result = g_strcmp0(utf8_str_a, utf8_str_b);
-
-    return result;
-}
-
-static gint
-_get_presence_weight(const char* presence)
-{
-    if (g_strcmp0(presence, "chat") == 0) {
-        return 0;
-    } else if (g_strcmp0(presence, "online") == 0) {
-        return 1;
-    } else if (g_strcmp0(presence, "away") == 0) {
-        return 2;
-    } else if (g_strcmp0(presence, "xa") == 0) {
-        return 3;
-    } else if (g_strcmp0(presence, "dnd") == 0) {
-        return 4;
-    } else { // offline
-        return 5;
-    }
+    return g_strcmp0(p_contact_sort_key(a), p_contact_sort_key(b));
 }
 
 gint
 roster_compare_presence(PContact a, PContact b)
 {
-    const char* presence_a = p_contact_presence(a);
-    const char* presence_b = p_contact_presence(b);
+    int weight_a = p_contact_presence_weight(a);
+    int weight_b = p_contact_presence_weight(b);
 
     // if presence different, order by presence
-    if (g_strcmp0(presence_a, presence_b) != 0) {
-        int weight_a = _get_presence_weight(presence_a);
-        int weight_b = _get_presence_weight(presence_b);
-        if (weight_a < weight_b) {
-            return -1;
-        } else {
-            return 1;
-        }
-
-        // otherwise order by name
-    } else {
-        return roster_compare_name(a, b);
+    if (weight_a != weight_b) {
+        return weight_a < weight_b ? -1 : 1;
     }
+
+    // otherwise order by name
+    return roster_compare_name(a, b);
 }
 
 void
@@ -59,6 +59,8 @@ void roster_update(const char* const barejid, const char* const name, GSList* gr
                    gboolean pending_out);
 gboolean roster_add(const char* const barejid, const char* const name, GSList* groups, const char* const subscription,
                     gboolean pending_out);
+void roster_add_begin(void);
+void roster_add_end(void);
 char* roster_barejid_from_name(const char* const name);
 GSList* roster_get_contacts(roster_ord_t order);
 GSList* roster_get_contacts_online(void);
@@ -66,6 +68,10 @@ gboolean roster_has_pending_subscriptions(void);
 char* roster_contact_autocomplete(const char* const search_str, gboolean previous, void* context);
 char* roster_fulljid_autocomplete(const char* const search_str, gboolean previous, void* context);
 GSList* roster_get_group(const char* const group, roster_ord_t order);
+GSequenceIter* roster_iter_contacts(roster_ord_t order);
+GSequenceIter* roster_iter_group(const char* const group, roster_ord_t order);
+GSequenceIter* roster_iter_presence(const char* const presence);
+PContact roster_iter_next(GSequenceIter** iter);
 GList* roster_get_groups(void);
 char* roster_group_autocomplete(const char* const search_str, gboolean previous, void* context);
 char* roster_barejid_autocomplete(const char* const search_str, gboolean previous, void* context);
@@ -46,6 +46,7 @@
 #include "plugins/plugins.h"
 #include "event/server_events.h"
 #include "event/client_events.h"
+#include "event/common.h"
 #include "xmpp/bookmark.h"
 #include "xmpp/blocking.h"
 #include "xmpp/connection.h"
@@ -66,6 +67,15 @@
 #include "xmpp/omemo.h"
 #endif
 
+// idle time after which the client reports itself inactive to the server
+#define CSI_INACTIVE_MS 60000
+
+// after a lost connection the first retry comes within a few seconds to ride
+// out short network blips, after that the wait doubles from /reconnect up to
+// RECONNECT_MAX_SEC
+#define RECONNECT_FIRST_SEC 2
+#define RECONNECT_MAX_SEC   600
+
 // for auto reconnect
 static struct
 {
@@ -92,11 +102,14 @@ typedef enum {
 } activity_state_t;
 
 static GTimer* reconnect_timer;
+static gdouble reconnect_delay;
+static guint reconnect_attempts;
 static activity_state_t activity_state;
 static resource_presence_t saved_presence;
 static char* saved_status;
 
 static void _session_free_internals(void);
+static void _session_reconnect_backoff(void);
 static void _session_free_saved_details(void);
 
 void
@@ -222,6 +235,7 @@ session_disconnect(void)
         connection_clear_data();
         chat_sessions_clear();
         presence_clear_sub_requests();
+        roster_cache_close();
     }
 
     connection_set_disconnected();
@@ -234,6 +248,7 @@ session_shutdown(void)
 
     chat_sessions_clear();
     presence_clear_sub_requests();
+    roster_cache_close();
 
     connection_shutdown();
     if (saved_status) {
@@ -244,8 +259,6 @@ session_shutdown(void)
 void
 session_process_events(void)
 {
-    int reconnect_sec;
-
     jabber_conn_status_t conn_status = connection_get_status();
     switch (conn_status) {
     case JABBER_CONNECTED:
@@ -256,10 +269,8 @@ session_process_events(void)
         connection_check_events();
         break;
     case JABBER_DISCONNECTED:
-        reconnect_sec = prefs_get_reconnect();
-        if ((reconnect_sec != 0) && reconnect_timer) {
-            int elapsed_sec = g_timer_elapsed(reconnect_timer, NULL);
-            if (elapsed_sec > reconnect_sec) {
+        if ((prefs_get_reconnect() != 0) && reconnect_timer) {
+            if (g_timer_elapsed(reconnect_timer, NULL) > reconnect_delay) {
                 session_reconnect_now();
             }
         }
@@ -312,8 +323,9 @@ _receive_mood(xmpp_stanza_t* const stanza, void* const userdata)
     return TRUE;
 }
 
+// stanza handlers for a new stream, needed whether or not the session was resumed
 void
-session_login_success(gboolean secured)
+session_login_handlers(void)
 {
     chat_sessions_init();
 
@@ -321,6 +333,23 @@ session_login_success(gboolean secured)
     presence_handlers_init();
     iq_handlers_init();
 
+    message_pubsub_event_handler_add(STANZA_NS_MOOD, _receive_mood, NULL, NULL);
+    if (prefs_get_boolean(PREF_MOOD)) {
+        caps_add_feature(STANZA_NS_MOOD_NOTIFY);
+    }
+}
+
+void
+session_login_success(gboolean secured)
+{
+    session_login_handlers();
+    session_login_sync(secured);
+}
+
+// fetch everything a new session starts without: roster, bookmarks, disco, carbons
+void
+session_login_sync(gboolean secured)
+{
     // logged in with account
     if (saved_account.name) {
         log_debug("Connection handler: logged in with account name: %s", saved_account.name);
@@ -356,10 +385,28 @@ session_login_success(gboolean secured)
         g_timer_destroy(reconnect_timer);
         reconnect_timer = NULL;
     }
+}
 
-    message_pubsub_event_handler_add(STANZA_NS_MOOD, _receive_mood, NULL, NULL);
-    if (prefs_get_boolean(PREF_MOOD)) {
-        caps_add_feature(STANZA_NS_MOOD_NOTIFY);
+// the server kept our session (XEP-0198), roster, rooms, presence and carbons
+// are still in place on both sides
+void
+session_login_resumed(gboolean secured)
+{
+    if (!saved_account.name || !ev_session_suspended()) {
+        session_login_sync(secured);
+        return;
+    }
+
+    log_debug("Connection handler: resumed session with account name: %s", saved_account.name);
+    sv_ev_login_account_resumed(saved_account.name, secured);
+
+    // only the disco caches went away with the old stream
+    connection_request_features();
+    iq_disco_items_request_onconnect(connection_get_domain());
+
+    if ((prefs_get_reconnect() != 0) && reconnect_timer) {
+        g_timer_destroy(reconnect_timer);
+        reconnect_timer = NULL;
     }
 }
 
@@ -373,6 +420,7 @@ session_login_failed(void)
     } else {
         log_debug("Connection handler: Restarting reconnect timer");
         if (prefs_get_reconnect() != 0) {
+            _session_reconnect_backoff();
             g_timer_start(reconnect_timer);
         }
     }
@@ -389,6 +437,8 @@ session_lost_connection(void)
     sv_ev_lost_connection();
     if (prefs_get_reconnect() != 0) {
         assert(reconnect_timer == NULL);
+        reconnect_attempts = 0;
+        _session_reconnect_backoff();
         reconnect_timer = g_timer_new();
     } else {
         _session_free_internals();
@@ -402,6 +452,17 @@ session_init_activity(void)
     saved_status = NULL;
 }
 
+void
+session_check_csi(void)
+{
+    gboolean active = TRUE;
+    if (prefs_get_boolean(PREF_CSI)) {
+        active = inp_terminal_focused() && ui_get_idle_time() < CSI_INACTIVE_MS;
+    }
+
+    connection_set_csi(active);
+}
+
 void
 session_check_autoaway(void)
 {
@@ -410,19 +471,40 @@ session_check_autoaway(void)
         return;
     }
 
-    auto_gchar gchar* mode = prefs_get_string(PREF_AUTOAWAY_MODE);
+    session_check_csi();
+
     gboolean check = prefs_get_boolean(PREF_AUTOAWAY_CHECK);
     gint away_time = prefs_get_autoaway_time();
     gint xa_time = prefs_get_autoxa_time();
     int away_time_ms = away_time * 60000;
     int xa_time_ms = xa_time * 60000;
 
+    unsigned long idle_ms = ui_get_idle_time();
+
+    // this runs every second but the state changes only a few times a day,
+    // so decide from the idle time alone whether a transition is due before
+    // looking up the mode and the account's presence
+    gboolean due;
+    switch (activity_state) {
+    case ACTIVITY_ST_ACTIVE:
+        due = idle_ms >= away_time_ms;
+        break;
+    case ACTIVITY_ST_AWAY:
+        due = (xa_time_ms > 0 && idle_ms >= xa_time_ms) || (check && idle_ms < away_time_ms);
+        break;
+    default:
+        due = check && idle_ms < away_time_ms;
+        break;
+    }
+    if (!due) {
+        return;
+    }
+
+    auto_gchar gchar* mode = prefs_get_string(PREF_AUTOAWAY_MODE);
     char* account = session_get_account_name();
     resource_presence_t curr_presence = accounts_get_last_presence(account);
     auto_char char* curr_status = accounts_get_last_status(account);
 
-    unsigned long idle_ms = ui_get_idle_time();
-
     switch (activity_state) {
     case ACTIVITY_ST_ACTIVE:
         if (idle_ms >= away_time_ms) {
@@ -577,6 +659,25 @@ session_reconnect_now(void)
         g_timer_start(reconnect_timer);
 }
 
+// Full jitter: the wait is random up to the backoff, so clients that lost the
+// same server at the same moment don't all come back at the same moment.
+static void
+_session_reconnect_backoff(void)
+{
+    gdouble interval = prefs_get_reconnect();
+    gdouble ceiling;
+    if (reconnect_attempts == 0) {
+        ceiling = MIN(RECONNECT_FIRST_SEC, interval);
+    } else {
+        ceiling = interval * (1 << MIN(reconnect_attempts - 1, 16));
+        ceiling = MIN(ceiling, MAX(RECONNECT_MAX_SEC, interval));
+    }
+    reconnect_attempts++;
+
+    reconnect_delay = g_random_double_range(0, ceiling);
+    log_debug("Reconnect attempt %u in %.1f seconds", reconnect_attempts, reconnect_delay);
+}
+
 static void
 _session_free_internals(void)
 {
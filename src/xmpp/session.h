@@ -38,13 +38,17 @@
 
 #include <glib.h>
 
+void session_login_handlers(void);
 void session_login_success(gboolean secured);
+void session_login_sync(gboolean secured);
+void session_login_resumed(gboolean secured);
 void session_login_failed(void);
 void session_lost_connection(void);
 void session_autoping_fail(void);
 
 void session_init_activity(void);
 void session_check_autoaway(void);
+void session_check_csi(void);
 
 void session_reconnect(gchar* altdomain, unsigned short altport);
 
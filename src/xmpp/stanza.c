@@ -274,19 +274,28 @@ stanza_disable_carbons(xmpp_ctx_t* ctx)
     return iq;
 }
 
-xmpp_stanza_t*
-stanza_create_chat_state(xmpp_ctx_t* ctx, const char* const fulljid, const char* const state)
+// Chat states and receipts are sent far more often than anything else, so
+// they are written straight from a template instead of building a stanza tree
+// and serialising it. Only attribute values vary and they are escaped.
+static const char* const chat_state_template = "<message type=\"" STANZA_TYPE_CHAT "\" to=\"%s\" id=\"%s\">"
+                                               "<%s xmlns=\"" STANZA_NS_CHATSTATES "\"/>"
+                                               "</message>";
+static const char* const receipt_template = "<message to=\"%s\" id=\"%s\">"
+                                            "<received xmlns=\"" STANZA_NS_RECEIPTS "\" id=\"%s\"/>"
+                                            "</message>";
+
+gchar*
+stanza_text_chat_state(const char* const fulljid, const char* const state)
 {
     auto_char char* id = connection_create_stanza_id();
-    xmpp_stanza_t* msg = xmpp_message_new(ctx, STANZA_TYPE_CHAT, fulljid, id);
-
-    xmpp_stanza_t* chat_state = xmpp_stanza_new(ctx);
-    xmpp_stanza_set_name(chat_state, state);
-    xmpp_stanza_set_ns(chat_state, STANZA_NS_CHATSTATES);
-    xmpp_stanza_add_child(msg, chat_state);
-    xmpp_stanza_release(chat_state);
+    return g_markup_printf_escaped(chat_state_template, fulljid, id, state);
+}
 
-    return msg;
+gchar*
+stanza_text_receipt(const char* const fulljid, const char* const message_id)
+{
+    auto_char char* id = connection_create_stanza_id();
+    return g_markup_printf_escaped(receipt_template, fulljid, id, message_id);
 }
 
 xmpp_stanza_t*
@@ -529,7 +538,7 @@ stanza_create_mediated_invite(xmpp_ctx_t* ctx, const char* const room,
 
 xmpp_stanza_t*
 stanza_create_room_join_presence(xmpp_ctx_t* const ctx,
-                                 const char* const full_room_jid, const char* const passwd)
+                                 const char* const full_room_jid, const char* const passwd, gboolean no_history)
 {
     xmpp_stanza_t* presence = xmpp_presence_new(ctx);
     xmpp_stanza_set_to(presence, full_room_jid);
@@ -550,6 +559,13 @@ stanza_create_room_join_presence(xmpp_ctx_t* const ctx,
         xmpp_stanza_release(pass);
     }
 
+    if (no_history) {
+        xmpp_stanza_t* history = xmpp_stanza_new(ctx);
+        xmpp_stanza_set_name(history, STANZA_NAME_HISTORY);
+        xmpp_stanza_set_attribute(history, "maxstanzas", "0");
+        xmpp_stanza_add_child_ex(x, history, 0);
+    }
+
     xmpp_stanza_add_child(presence, x);
     xmpp_stanza_release(x);
 
@@ -850,13 +866,16 @@ stanza_create_software_version_iq(xmpp_ctx_t* ctx, const char* const fulljid)
 }
 
 xmpp_stanza_t*
-stanza_create_roster_iq(xmpp_ctx_t* ctx)
+stanza_create_roster_iq(xmpp_ctx_t* ctx, const char* const ver)
 {
     xmpp_stanza_t* iq = xmpp_iq_new(ctx, STANZA_TYPE_GET, "roster");
 
     xmpp_stanza_t* query = xmpp_stanza_new(ctx);
     xmpp_stanza_set_name(query, STANZA_NAME_QUERY);
     xmpp_stanza_set_ns(query, XMPP_NS_ROSTER);
+    if (ver) {
+        xmpp_stanza_set_attribute(query, STANZA_ATTR_VER, ver);
+    }
 
     xmpp_stanza_add_child(iq, query);
     xmpp_stanza_release(query);
@@ -864,6 +883,16 @@ stanza_create_roster_iq(xmpp_ctx_t* ctx)
     return iq;
 }
 
+xmpp_stanza_t*
+stanza_create_csi(xmpp_ctx_t* ctx, gboolean active)
+{
+    xmpp_stanza_t* csi = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_name(csi, active ? STANZA_NAME_ACTIVE : STANZA_NAME_INACTIVE);
+    xmpp_stanza_set_ns(csi, STANZA_NS_CSI);
+
+    return csi;
+}
+
 xmpp_stanza_t*
 stanza_create_disco_info_iq(xmpp_ctx_t* ctx, const char* const id, const char* const to,
                             const char* const node)
@@ -952,8 +981,8 @@ stanza_create_caps_query_element(xmpp_ctx_t* ctx)
     xmpp_stanza_set_name(identity, "identity");
     xmpp_stanza_set_attribute(identity, "category", "client");
 
-    ProfAccount* account = accounts_get_account(session_get_account_name());
-    gchar* client = account->client;
+    const ProfAccount* account = accounts_peek_account(session_get_account_name());
+    const gchar* client = account ? account->client : NULL;
     bool is_custom_client = client != NULL;
 
     GString* name_str = g_string_new(is_custom_client ? client : "Profanity ");
@@ -963,8 +992,6 @@ stanza_create_caps_query_element(xmpp_ctx_t* ctx)
         g_string_append(name_str, prof_version);
     }
 
-    account_free(account);
-
     xmpp_stanza_set_attribute(identity, "name", name_str->str);
     g_string_free(name_str, TRUE);
     xmpp_stanza_add_child(query, identity);
@@ -2014,21 +2041,20 @@ stanza_attach_last_activity(xmpp_ctx_t* const ctx,
     xmpp_stanza_release(query);
 }
 
+// The ver hash is kept by caps_get_my_sha1() until the feature set changes,
+// only the three attribute <c/> element is built per presence.
 void
 stanza_attach_caps(xmpp_ctx_t* const ctx, xmpp_stanza_t* const presence)
 {
     xmpp_stanza_t* caps = xmpp_stanza_new(ctx);
     xmpp_stanza_set_name(caps, STANZA_NAME_C);
     xmpp_stanza_set_ns(caps, STANZA_NS_CAPS);
-    xmpp_stanza_t* query = stanza_create_caps_query_element(ctx);
 
     char* sha1 = caps_get_my_sha1(ctx);
     xmpp_stanza_set_attribute(caps, STANZA_ATTR_HASH, "sha-1");
     xmpp_stanza_set_attribute(caps, STANZA_ATTR_NODE, "http://profanity-im.github.io");
     xmpp_stanza_set_attribute(caps, STANZA_ATTR_VER, sha1);
-    xmpp_stanza_add_child(presence, caps);
-    xmpp_stanza_release(caps);
-    xmpp_stanza_release(query);
+    xmpp_stanza_add_child_ex(presence, caps, 0);
 }
 
 const char*
@@ -2715,12 +2741,38 @@ _text_stanza(xmpp_ctx_t* ctx, const char* name, const char* text)
     return res;
 }
 
+// disco#items asking for one XEP-0059 page of at most max items after the
+// item with the given RSM id, or the first page when after is NULL
 xmpp_stanza_t*
-stanza_create_mam_iq(xmpp_ctx_t* ctx, const char* const jid, const char* const startdate, const char* const enddate, const char* const firstid, const char* const lastid)
+stanza_create_disco_items_page_iq(xmpp_ctx_t* ctx, const char* const id, const char* const jid, int max, const char* const after)
+{
+    xmpp_stanza_t* iq = stanza_create_disco_items_iq(ctx, id, jid, NULL);
+    xmpp_stanza_t* query = xmpp_stanza_get_child_by_name(iq, STANZA_NAME_QUERY);
+
+    xmpp_stanza_t* set = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_name(set, STANZA_TYPE_SET);
+    xmpp_stanza_set_ns(set, STANZA_NS_RSM);
+
+    auto_gchar gchar* max_str = g_strdup_printf("%d", max);
+    xmpp_stanza_add_child_ex(set, _text_stanza(ctx, STANZA_NAME_MAX, max_str), 0);
+    if (after) {
+        xmpp_stanza_add_child_ex(set, _text_stanza(ctx, STANZA_NAME_AFTER, after), 0);
+    }
+    xmpp_stanza_add_child_ex(query, set, 0);
+
+    return iq;
+}
+
+// Queries our own archive filtered by 'with' when to is NULL, or the archive
+// of the entity at to, e.g. a room, when with is NULL
+static xmpp_stanza_t*
+_stanza_create_mam_query(xmpp_ctx_t* ctx, const char* const to, const char* const with, const char* const startdate, const char* const enddate, const char* const firstid, const char* const lastid, int max_results)
 {
     auto_char char* id = connection_create_stanza_id();
     xmpp_stanza_t* iq = xmpp_iq_new(ctx, STANZA_TYPE_SET, id);
-    // xmpp_stanza_set_to(iq, jid);
+    if (to) {
+        xmpp_stanza_set_to(iq, to);
+    }
 
     xmpp_stanza_t* query = xmpp_stanza_new(ctx);
     xmpp_stanza_set_name(query, STANZA_NAME_QUERY);
@@ -2741,21 +2793,14 @@ stanza_create_mam_iq(xmpp_ctx_t* ctx, const char* const jid, const char* const s
 
     xmpp_stanza_add_child_ex(field_form_type, value_mam, 0);
 
-    // field 'with'
-    xmpp_stanza_t* field_with = xmpp_stanza_new(ctx);
-    xmpp_stanza_set_name(field_with, STANZA_NAME_FIELD);
-    xmpp_stanza_set_attribute(field_with, STANZA_ATTR_VAR, "with");
-
-    xmpp_stanza_t* value_with = _text_stanza(ctx, STANZA_NAME_VALUE, jid);
-
-    xmpp_stanza_add_child_ex(field_with, value_with, 0);
-
     // 4.3.2 set/rsm
     xmpp_stanza_t* set = xmpp_stanza_new(ctx);
     xmpp_stanza_set_name(set, STANZA_TYPE_SET);
     xmpp_stanza_set_ns(set, STANZA_NS_RSM);
 
-    xmpp_stanza_t* max = _text_stanza(ctx, STANZA_NAME_MAX, PROF_STRINGIFY(MESSAGES_TO_RETRIEVE));
+    char max_str[16];
+    snprintf(max_str, sizeof(max_str), "%d", max_results);
+    xmpp_stanza_t* max = _text_stanza(ctx, STANZA_NAME_MAX, max_str);
     xmpp_stanza_add_child_ex(set, max, 0);
 
     if (lastid) {
@@ -2772,7 +2817,18 @@ stanza_create_mam_iq(xmpp_ctx_t* ctx, const char* const jid, const char* const s
     xmpp_stanza_add_child_ex(iq, query, 0);
     xmpp_stanza_add_child_ex(query, x, 0);
     xmpp_stanza_add_child_ex(x, field_form_type, 0);
-    xmpp_stanza_add_child_ex(x, field_with, 0);
+
+    // field 'with'
+    if (with) {
+        xmpp_stanza_t* field_with = xmpp_stanza_new(ctx);
+        xmpp_stanza_set_name(field_with, STANZA_NAME_FIELD);
+        xmpp_stanza_set_attribute(field_with, STANZA_ATTR_VAR, "with");
+
+        xmpp_stanza_t* value_with = _text_stanza(ctx, STANZA_NAME_VALUE, with);
+
+        xmpp_stanza_add_child_ex(field_with, value_with, 0);
+        xmpp_stanza_add_child_ex(x, field_with, 0);
+    }
 
     // field 'start'
     if (startdate) {
@@ -2802,6 +2858,18 @@ stanza_create_mam_iq(xmpp_ctx_t* ctx, const char* const jid, const char* const s
     return iq;
 }
 
+xmpp_stanza_t*
+stanza_create_mam_iq(xmpp_ctx_t* ctx, const char* const jid, const char* const startdate, const char* const enddate, const char* const firstid, const char* const lastid, int max_results)
+{
+    return _stanza_create_mam_query(ctx, NULL, jid, startdate, enddate, firstid, lastid, max_results);
+}
+
+xmpp_stanza_t*
+stanza_create_room_mam_iq(xmpp_ctx_t* ctx, const char* const room, const char* const startdate, const char* const lastid, int max_results)
+{
+    return _stanza_create_mam_query(ctx, room, NULL, startdate, NULL, NULL, lastid, max_results);
+}
+
 xmpp_stanza_t*
 stanza_change_password(xmpp_ctx_t* ctx, const char* const user, const char* const password)
 {
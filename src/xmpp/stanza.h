@@ -81,6 +81,7 @@
 #define STANZA_NAME_FEATURE          "feature"
 #define STANZA_NAME_INVITE           "invite"
 #define STANZA_NAME_REASON           "reason"
+#define STANZA_NAME_HISTORY          "history"
 #define STANZA_NAME_GROUP            "group"
 #define STANZA_NAME_PUBSUB           "pubsub"
 #define STANZA_NAME_PUBLISH          "publish"
@@ -125,6 +126,8 @@
 #define STANZA_NAME_EVENT            "event"
 #define STANZA_NAME_MOOD             "mood"
 #define STANZA_NAME_RECEIVED         "received"
+#define STANZA_NAME_ENABLED          "enabled"
+#define STANZA_NAME_RESUMED          "resumed"
 #define STANZA_NAME_SENT             "sent"
 #define STANZA_NAME_VCARD            "vCard"
 
@@ -167,6 +170,7 @@
 #define STANZA_TYPE_SUBMIT       "submit"
 #define STANZA_TYPE_CANCEL       "cancel"
 #define STANZA_TYPE_MODIFY       "modify"
+#define STANZA_TYPE_AUTH         "auth"
 #define STANZA_TYPE_LIST_MULTI   "list-multi"
 
 #define STANZA_ATTR_TO             "to"
@@ -206,6 +210,7 @@
 
 #define STANZA_NS_STANZAS      "urn:ietf:params:xml:ns:xmpp-stanzas"
 #define STANZA_NS_CHATSTATES   "http://jabber.org/protocol/chatstates"
+#define STANZA_NS_CSI          "urn:xmpp:csi:0"
 #define STANZA_NS_MUC          "http://jabber.org/protocol/muc"
 #define STANZA_NS_MUC_USER     "http://jabber.org/protocol/muc#user"
 #define STANZA_NS_MUC_OWNER    "http://jabber.org/protocol/muc#owner"
@@ -252,8 +257,10 @@
 #define STANZA_NS_MOOD                    "http://jabber.org/protocol/mood"
 #define STANZA_NS_MOOD_NOTIFY             "http://jabber.org/protocol/mood+notify"
 #define STANZA_NS_STREAMS                 "http://etherx.jabber.org/streams"
+#define STANZA_NS_STREAM_MANAGEMENT       "urn:xmpp:sm:3"
 #define STANZA_NS_XMPP_STREAMS            "urn:ietf:params:xml:ns:xmpp-streams"
 #define STANZA_NS_VCARD                   "vcard-temp"
+#define STANZA_NS_VCARD_UPDATE            "vcard-temp:x:update"
 
 #define STANZA_DATAFORM_SOFTWARE "urn:xmpp:dataforms:softwareinfo"
 
@@ -291,8 +298,8 @@ xmpp_stanza_t* stanza_enable_carbons(xmpp_ctx_t* ctx);
 
 xmpp_stanza_t* stanza_disable_carbons(xmpp_ctx_t* ctx);
 
-xmpp_stanza_t* stanza_create_chat_state(xmpp_ctx_t* ctx,
-                                        const char* const fulljid, const char* const state);
+gchar* stanza_text_chat_state(const char* const fulljid, const char* const state);
+gchar* stanza_text_receipt(const char* const fulljid, const char* const message_id);
 
 xmpp_stanza_t* stanza_attach_state(xmpp_ctx_t* ctx, xmpp_stanza_t* stanza, const char* const state);
 xmpp_stanza_t* stanza_attach_carbons_private(xmpp_ctx_t* ctx, xmpp_stanza_t* stanza);
@@ -305,7 +312,7 @@ xmpp_stanza_t* stanza_attach_origin_id(xmpp_ctx_t* ctx, xmpp_stanza_t* stanza, c
 xmpp_stanza_t* stanza_attach_correction(xmpp_ctx_t* ctx, xmpp_stanza_t* stanza, const char* const replace_id);
 
 xmpp_stanza_t* stanza_create_room_join_presence(xmpp_ctx_t* const ctx,
-                                                const char* const full_room_jid, const char* const passwd);
+                                                const char* const full_room_jid, const char* const passwd, gboolean no_history);
 
 xmpp_stanza_t* stanza_create_room_newnick_presence(xmpp_ctx_t* ctx,
                                                    const char* const full_room_jid);
@@ -313,7 +320,8 @@ xmpp_stanza_t* stanza_create_room_newnick_presence(xmpp_ctx_t* ctx,
 xmpp_stanza_t* stanza_create_room_leave_presence(xmpp_ctx_t* ctx,
                                                  const char* const room, const char* const nick);
 
-xmpp_stanza_t* stanza_create_roster_iq(xmpp_ctx_t* ctx);
+xmpp_stanza_t* stanza_create_roster_iq(xmpp_ctx_t* ctx, const char* const ver);
+xmpp_stanza_t* stanza_create_csi(xmpp_ctx_t* ctx, gboolean active);
 xmpp_stanza_t* stanza_create_ping_iq(xmpp_ctx_t* ctx, const char* const target);
 xmpp_stanza_t* stanza_create_disco_info_iq(xmpp_ctx_t* ctx, const char* const id,
                                            const char* const to, const char* const node);
@@ -386,6 +394,7 @@ EntityCapabilities* stanza_create_caps_from_query_element(xmpp_stanza_t* query);
 const char* stanza_get_presence_string_from_type(resource_presence_t presence_type);
 xmpp_stanza_t* stanza_create_software_version_iq(xmpp_ctx_t* ctx, const char* const fulljid);
 xmpp_stanza_t* stanza_create_disco_items_iq(xmpp_ctx_t* ctx, const char* const id, const char* const jid, const char* const node);
+xmpp_stanza_t* stanza_create_disco_items_page_iq(xmpp_ctx_t* ctx, const char* const id, const char* const jid, int max, const char* const after);
 
 char* stanza_get_status(xmpp_stanza_t* stanza, char* def);
 char* stanza_get_show(xmpp_stanza_t* stanza, char* def);
@@ -420,7 +429,8 @@ xmpp_stanza_t* stanza_create_avatar_data_publish_iq(xmpp_ctx_t* ctx, const char*
 xmpp_stanza_t* stanza_create_avatar_metadata_publish_iq(xmpp_ctx_t* ctx, const char* img_data, gsize len, int height, int width);
 xmpp_stanza_t* stanza_disable_avatar_publish_iq(xmpp_ctx_t* ctx);
 xmpp_stanza_t* stanza_create_vcard_request_iq(xmpp_ctx_t* ctx, const char* const jid, const char* const stanza_id);
-xmpp_stanza_t* stanza_create_mam_iq(xmpp_ctx_t* ctx, const char* const jid, const char* const startdate, const char* const enddate, const char* const firstid, const char* const lastid);
+xmpp_stanza_t* stanza_create_mam_iq(xmpp_ctx_t* ctx, const char* const jid, const char* const startdate, const char* const enddate, const char* const firstid, const char* const lastid, int max_results);
+xmpp_stanza_t* stanza_create_room_mam_iq(xmpp_ctx_t* ctx, const char* const room, const char* const startdate, const char* const lastid, int max_results);
 xmpp_stanza_t* stanza_change_password(xmpp_ctx_t* ctx, const char* const user, const char* const password);
 xmpp_stanza_t* stanza_register_new_account(xmpp_ctx_t* ctx, const char* const user, const char* const password);
 xmpp_stanza_t* stanza_request_voice(xmpp_ctx_t* ctx, const char* const room);
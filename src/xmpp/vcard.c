@@ -35,11 +35,16 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <string.h>
 #include <glib.h>
+#include <glib/gstdio.h>
 #include <strophe.h>
 #include <sys/stat.h>
 
+#include "log.h"
+#include "tools/base64.h"
 #include "xmpp/vcard.h"
+#include "xmpp/vcard_funcs.h"
 #include "config/files.h"
 #include "config/preferences.h"
 #include "ui/ui.h"
@@ -47,14 +52,31 @@
 #include "xmpp/connection.h"
 #include "xmpp/iq.h"
 #include "xmpp/stanza.h"
+#include "xmpp/avatar.h"
 
 // Connected account's vCard
 vCard* vcard_user = NULL;
 
+// vCard results of other entities by the jid they were requested for, in
+// memory and under the account's data dir, kept until VCARD_CACHE_TTL passed
+// or a presence advertises a different XEP-0153 photo hash
+typedef struct
+{
+    xmpp_stanza_t* result;
+    gchar* photo_hash;
+    gint64 fetched;
+} _cached_vcard;
+
+#define VCARD_CACHE_TTL (30 * 60)
+
+static GHashTable* vcard_cache = NULL;
+
 typedef struct
 {
     vCard* vcard;
     ProfWin* window;
+    char* jid;
+    gboolean cached;
 
     // for photo
     int photo_index;
@@ -240,10 +262,158 @@ _free_userdata(_userdata* data)
     if (data->filename) {
         free(data->filename);
     }
+    free(data->jid);
 
     free(data);
 }
 
+static void
+_cached_vcard_free(_cached_vcard* cached)
+{
+    xmpp_stanza_release(cached->result);
+    g_free(cached->photo_hash);
+    free(cached);
+}
+
+static gchar*
+_vcard_cache_path(const char* const jid)
+{
+    const char* barejid = connection_get_barejid();
+    if (!barejid) {
+        return NULL;
+    }
+
+    auto_gchar gchar* dir = files_get_account_data_path(DIR_VCARDS, barejid);
+    auto_char char* name = str_replace(jid, "/", "_slash_");
+    return g_build_filename(dir, name, NULL);
+}
+
+static xmpp_stanza_t*
+_vcard_cache_lookup(const char* const jid)
+{
+    if (!jid) {
+        return NULL;
+    }
+
+    if (!vcard_cache) {
+        vcard_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)_cached_vcard_free);
+    }
+
+    gint64 now = g_get_real_time() / G_USEC_PER_SEC;
+    _cached_vcard* cached = g_hash_table_lookup(vcard_cache, jid);
+    if (cached && now - cached->fetched < VCARD_CACHE_TTL) {
+        return cached->result;
+    }
+    g_hash_table_remove(vcard_cache, jid);
+
+    auto_gchar gchar* path = _vcard_cache_path(jid);
+    GStatBuf st;
+    if (!path || g_stat(path, &st) != 0 || now - st.st_mtime >= VCARD_CACHE_TTL) {
+        return NULL;
+    }
+
+    auto_gchar gchar* text = NULL;
+    if (!g_file_get_contents(path, &text, NULL, NULL)) {
+        return NULL;
+    }
+    xmpp_stanza_t* result = xmpp_stanza_new_from_string(connection_get_ctx(), text);
+    if (!result) {
+        return NULL;
+    }
+
+    cached = calloc(1, sizeof(_cached_vcard));
+    cached->result = result;
+    cached->fetched = st.st_mtime;
+
+    // photo hash is only needed to notice a changed photo, recompute it
+    vCard* vcard = vcard_new();
+    if (vcard && vcard_parse(xmpp_stanza_get_child_by_name(result, STANZA_NAME_VCARD), vcard)) {
+        for (GList* curr = g_queue_peek_head_link(vcard->elements); curr; curr = curr->next) {
+            vcard_element_t* element = curr->data;
+            if (element->type == VCARD_PHOTO && !element->photo.external) {
+                cached->photo_hash = g_compute_checksum_for_data(G_CHECKSUM_SHA1, element->photo.data, element->photo.length);
+                break;
+            }
+        }
+    }
+    vcard_free_full(vcard);
+    vcard_free(vcard);
+
+    g_hash_table_insert(vcard_cache, g_strdup(jid), cached);
+    return result;
+}
+
+// remember a result for jid, the photos it carries go to the avatar cache
+static void
+_vcard_cache_store(const char* const jid, xmpp_stanza_t* const stanza, vCard* vcard)
+{
+    if (!jid || g_strcmp0(xmpp_stanza_get_type(stanza), STANZA_TYPE_RESULT) != 0) {
+        return;
+    }
+
+    if (!vcard_cache) {
+        vcard_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)_cached_vcard_free);
+    }
+
+    _cached_vcard* cached = calloc(1, sizeof(_cached_vcard));
+    cached->result = xmpp_stanza_copy(stanza);
+    cached->fetched = g_get_real_time() / G_USEC_PER_SEC;
+
+    for (GList* curr = g_queue_peek_head_link(vcard->elements); curr; curr = curr->next) {
+        vcard_element_t* element = curr->data;
+        if (element->type != VCARD_PHOTO || element->photo.external || !element->photo.data) {
+            continue;
+        }
+        gchar* hash = avatar_cache_add(element->photo.data, element->photo.length);
+        if (!cached->photo_hash) {
+            cached->photo_hash = hash;
+        } else {
+            g_free(hash);
+        }
+    }
+
+    g_hash_table_insert(vcard_cache, g_strdup(jid), cached);
+
+    auto_gchar gchar* path = _vcard_cache_path(jid);
+    if (!path) {
+        return;
+    }
+    auto_gchar gchar* dir = g_path_get_dirname(path);
+    if (g_mkdir_with_parents(dir, S_IRWXU) != 0) {
+        log_error("vCard: error creating directory: %s, %s", dir, strerror(errno));
+        return;
+    }
+
+    char* text;
+    size_t text_size;
+    if (xmpp_stanza_to_text(stanza, &text, &text_size) == XMPP_EOK) {
+        GError* err = NULL;
+        if (!g_file_set_contents(path, text, text_size, &err)) {
+            log_error("vCard: unable to cache vCard for %s: %s", jid, err->message);
+            g_error_free(err);
+        }
+        xmpp_free(connection_get_ctx(), text);
+    }
+}
+
+void
+vcard_cache_validate(const char* const jid, const char* const photo_hash)
+{
+    if (!vcard_cache) {
+        return;
+    }
+
+    _cached_vcard* cached = g_hash_table_lookup(vcard_cache, jid);
+    if (cached && g_ascii_strcasecmp(cached->photo_hash ?: "", photo_hash) != 0) {
+        log_debug("vCard: photo of %s changed, dropping cached vCard", jid);
+        g_hash_table_remove(vcard_cache, jid);
+        auto_gchar gchar* path = _vcard_cache_path(jid);
+        if (path) {
+            g_unlink(path);
+        }
+    }
+}
+
 // Function must be called with <vCard> root element
 gboolean
 vcard_parse(xmpp_stanza_t* vcard_xml, vCard* vcard)
@@ -329,7 +499,7 @@ vcard_parse(xmpp_stanza_t* vcard_xml, vCard* vcard)
                     free(element);
                     continue;
                 }
-                element->photo.data = g_base64_decode(photo_base64, &element->photo.length);
+                element->photo.data = base64_decode(photo_base64, &element->photo.length);
                 xmpp_free(ctx, photo_base64);
 
                 child_pointer2 = xmpp_stanza_get_child_by_name(child_pointer, "TYPE");
@@ -757,7 +927,7 @@ vcard_to_xml(xmpp_ctx_t* const ctx, vCard* vcard)
                 xmpp_stanza_t* binval = xmpp_stanza_new(ctx);
                 xmpp_stanza_set_name(binval, "BINVAL");
 
-                auto_gchar gchar* base64 = g_base64_encode(element->photo.data, element->photo.length);
+                auto_gchar gchar* base64 = base64_encode(element->photo.data, element->photo.length);
                 xmpp_stanza_t* binval_text = xmpp_stanza_new(ctx);
                 xmpp_stanza_set_text(binval_text, base64);
                 xmpp_stanza_add_child(binval, binval_text);
@@ -1212,6 +1382,9 @@ _vcard_print_result(xmpp_stanza_t* const stanza, void* userdata)
     if (!vcard_parse(vcard_xml, data->vcard)) {
         return 1;
     }
+    if (!data->cached) {
+        _vcard_cache_store(data->jid, stanza, data->vcard);
+    }
 
     win_show_vcard(data->window, data->vcard);
 
@@ -1240,6 +1413,18 @@ vcard_print(xmpp_ctx_t* ctx, ProfWin* window, char* jid)
 
     data->window = window;
 
+    xmpp_stanza_t* cached = _vcard_cache_lookup(jid);
+    if (cached) {
+        data->jid = strdup(jid);
+        data->cached = TRUE;
+        _vcard_print_result(cached, data);
+        _free_userdata(data);
+        return;
+    }
+    if (jid) {
+        data->jid = strdup(jid);
+    }
+
     auto_char char* id = connection_create_stanza_id();
     xmpp_stanza_t* iq = stanza_create_vcard_request_iq(ctx, jid, id);
 
@@ -1264,6 +1449,9 @@ _vcard_photo_result(xmpp_stanza_t* const stanza, void* userdata)
     if (!vcard_parse(vcard_xml, data->vcard)) {
         return 1;
     }
+    if (!data->cached) {
+        _vcard_cache_store(data->jid, stanza, data->vcard);
+    }
 
     if (data->photo_index < 0) {
         GList* list_pointer;
@@ -1396,6 +1584,18 @@ vcard_photo(xmpp_ctx_t* ctx, char* jid, char* filename, int index, gboolean open
         data->filename = strdup(filename);
     }
 
+    xmpp_stanza_t* cached = _vcard_cache_lookup(jid);
+    if (cached) {
+        data->jid = strdup(jid);
+        data->cached = TRUE;
+        _vcard_photo_result(cached, data);
+        _free_userdata(data);
+        return;
+    }
+    if (jid) {
+        data->jid = strdup(jid);
+    }
+
     auto_char char* id = connection_create_stanza_id();
     xmpp_stanza_t* iq = stanza_create_vcard_request_iq(ctx, jid, id);
 
@@ -1597,4 +1797,9 @@ vcard_user_free(void)
         vcard_free(vcard_user);
     }
     vcard_user = NULL;
+
+    if (vcard_cache) {
+        g_hash_table_destroy(vcard_cache);
+        vcard_cache = NULL;
+    }
 }
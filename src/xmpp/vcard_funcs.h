@@ -63,4 +63,5 @@ vcard_element_t* vcard_user_get_element_index(unsigned int index);
 ProfWin* vcard_user_create_win();
 
 void vcard_user_free(void);
+void vcard_cache_validate(const char* const jid, const char* const photo_hash);
 #endif
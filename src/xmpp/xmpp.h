@@ -177,6 +177,16 @@ typedef struct prof_message_t
     prof_msg_type_t type;
 } ProfMessage;
 
+// a sender held back by /silence quarantine
+typedef struct prof_message_request_t
+{
+    char* barejid;
+    /* number of messages received so far */
+    guint count;
+    /* the start of the first message */
+    char* sample;
+} ProfMessageRequest;
+
 void session_init(void);
 jabber_conn_status_t session_connect_with_details(const char* const jid, const char* const passwd,
                                                   const char* const altdomain, const int port, const char* const tls_policy, const char* const auth_policy);
@@ -205,6 +215,8 @@ gboolean connection_send_stanza(const char* const stanza);
 GList* connection_get_available_resources(void);
 int connection_count_available_resources(void);
 gboolean connection_supports(const char* const feature);
+gboolean connection_sm_resumable(void);
+void connection_set_csi(gboolean active);
 const char* connection_jid_for_feature(const char* const feature);
 
 const char* connection_get_profanity_identifier(void);
@@ -226,6 +238,10 @@ void message_send_invite(const char* const room, const char* const contact, cons
 void message_request_voice(const char* const roomjid);
 
 bool message_is_sent_by_us(const ProfMessage* const message, bool checkOID);
+GList* message_requests_list(void);
+guint message_requests_overflow_count(void);
+gboolean message_request_accept(const char* const barejid);
+void message_requests_clear(void);
 
 void presence_subscription(const char* const jid, const jabber_subscr_t action);
 GList* presence_get_subscription_requests(void);
@@ -263,12 +279,14 @@ void iq_room_kick_occupant(const char* const room, const char* const nick, const
 void iq_room_role_set(const char* const room, const char* const nick, char* role, const char* const reason);
 void iq_room_role_list(const char* const room, char* role);
 void iq_autoping_timer_cancel(void);
-void iq_autoping_check(void);
-void iq_http_upload_request(HTTPUpload* upload);
+void iq_timeouts_check(void);
+guint iq_id_handlers_count(void);
+gboolean iq_http_upload_request(HTTPUpload* upload);
 void iq_command_list(const char* const target);
 void iq_command_exec(const char* const target, const char* const command);
 void iq_mam_request(ProfChatWin* win, GDateTime* enddate);
 void iq_mam_request_older(ProfChatWin* win);
+void iq_mam_room_request(ProfMucWin* mucwin);
 void iq_register_change_password(const char* const user, const char* const password);
 void iq_muc_register_nick(const char* const roomjid);
 
@@ -299,6 +317,7 @@ void roster_send_add_new(const char* const barejid, const char* const name);
 void roster_send_remove(const char* const barejid);
 
 GList* blocked_list(void);
+gboolean blocked_contains(const char* const from);
 gboolean blocked_add(char* jid, blocked_report reportkind, const char* const message);
 gboolean blocked_remove(char* jid);
 char* blocked_ac_find(const char* const search_str, gboolean previous, void* context);
@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <locale.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "config.h"
+#include "common.h"
+#include "config/preferences.h"
+#include "xmpp/connection.h"
+#include "bench.h"
+
+// shortest run that counts as a measurement
+#define BENCH_MIN_USEC (200 * 1000)
+
+static gboolean first_result = TRUE;
+
+void
+bench_run(const char* const name, int param, BenchFunc func, void* data)
+{
+    guint64 iterations = 1;
+    gint64 elapsed = 0;
+
+    while (TRUE) {
+        gint64 start = g_get_monotonic_time();
+        func(data, iterations);
+        elapsed = g_get_monotonic_time() - start;
+
+        if (elapsed >= BENCH_MIN_USEC || iterations >= G_MAXUINT32) {
+            break;
+        }
+        // aim a bit past the minimum instead of doubling blindly
+        guint64 next = elapsed > 0 ? iterations * BENCH_MIN_USEC * 12 / 10 / elapsed : iterations * 100;
+        iterations = CLAMP(next, iterations * 2, iterations * 100);
+    }
+
+    double ns_per_op = (double)elapsed * 1000.0 / (double)iterations;
+    printf("%s\n    { \"name\": \"%s\", \"param\": %d, \"iterations\": %" G_GUINT64_FORMAT ", \"ns_per_op\": %.1f }",
+           first_result ? "" : ",", name, param, iterations, ns_per_op);
+    fflush(stdout);
+    first_result = FALSE;
+}
+
+static void
+_bench_remove_dir(const char* const path)
+{
+    GDir* dir = g_dir_open(path, 0, NULL);
+    if (dir) {
+        const gchar* name;
+        while ((name = g_dir_read_name(dir))) {
+            auto_gchar gchar* child = g_build_filename(path, name, NULL);
+            if (g_file_test(child, G_FILE_TEST_IS_DIR)) {
+                _bench_remove_dir(child);
+            } else {
+                g_unlink(child);
+            }
+        }
+        g_dir_close(dir);
+    }
+    g_rmdir(path);
+}
+
+int
+main(int argc, char* argv[])
+{
+    setlocale(LC_ALL, "");
+
+    // never touch the user's configuration or data
+    auto_gchar gchar* home = g_dir_make_tmp("profanity-bench-XXXXXX", NULL);
+    if (!home) {
+        fprintf(stderr, "Could not create a temporary directory.\n");
+        return EXIT_FAILURE;
+    }
+    auto_gchar gchar* config_home = g_build_filename(home, "config", NULL);
+    auto_gchar gchar* data_home = g_build_filename(home, "data", NULL);
+    g_setenv("XDG_CONFIG_HOME", config_home, TRUE);
+    g_setenv("XDG_DATA_HOME", data_home, TRUE);
+
+    prefs_load(NULL);
+    connection_init();
+
+    printf("{\n  \"version\": \"%s\",\n  \"benchmarks\": [", PACKAGE_VERSION);
+    bench_data();
+    bench_database();
+    bench_ui();
+    printf("\n  ]\n}\n");
+
+    connection_shutdown();
+    prefs_close();
+
+    _bench_remove_dir(home);
+
+    return EXIT_SUCCESS;
+}
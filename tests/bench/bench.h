@@ -0,0 +1,11 @@
+#include <glib.h>
+
+// Runs func(data, n) with a growing n until one run takes long enough to be
+// measured, then prints the result as one JSON object.
+typedef void (*BenchFunc)(void* data, guint64 iterations);
+
+void bench_run(const char* const name, int param, BenchFunc func, void* data);
+
+void bench_ui(void);
+void bench_data(void);
+void bench_database(void);
@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <glib.h>
+
+#include "common.h"
+#include "tools/autocomplete.h"
+#include "xmpp/jid.h"
+#include "xmpp/roster_list.h"
+#include "bench.h"
+
+static void
+_bench_autocomplete(void* data, guint64 iterations)
+{
+    Autocomplete ac = data;
+    for (guint64 i = 0; i < iterations; i++) {
+        autocomplete_reset(ac);
+        g_free(autocomplete_complete(ac, "item-7", FALSE, FALSE));
+    }
+}
+
+static void
+_bench_roster_get_contacts(void* data, guint64 iterations)
+{
+    for (guint64 i = 0; i < iterations; i++) {
+        g_slist_free(roster_get_contacts(ROSTER_ORD_NAME));
+    }
+}
+
+static void
+_bench_jid_create(void* data, guint64 iterations)
+{
+    for (guint64 i = 0; i < iterations; i++) {
+        jid_destroy(jid_create("someone@conference.example.org/Some Resource"));
+    }
+}
+
+static void
+_bench_get_mentions(void* data, guint64 iterations)
+{
+    const char* message = data;
+    for (guint64 i = 0; i < iterations; i++) {
+        g_slist_free(get_mentions(TRUE, FALSE, message, "Bob"));
+    }
+}
+
+void
+bench_data(void)
+{
+    Autocomplete ac = autocomplete_new();
+    for (int i = 0; i < 10000; i++) {
+        auto_gchar gchar* item = g_strdup_printf("item-%05d", i);
+        autocomplete_add(ac, item);
+    }
+    bench_run("autocomplete_complete", 10000, _bench_autocomplete, ac);
+    autocomplete_free(ac);
+
+    int sizes[] = { 100, 1000, 5000 };
+    for (int s = 0; s < ARRAY_SIZE(sizes); s++) {
+        roster_create();
+        roster_add_begin();
+        for (int i = 0; i < sizes[s]; i++) {
+            auto_gchar gchar* barejid = g_strdup_printf("contact%d@example.org", i);
+            auto_gchar gchar* name = g_strdup_printf("Contact %d", sizes[s] - i);
+            roster_add(barejid, name, NULL, "both", FALSE);
+        }
+        roster_add_end();
+        bench_run("roster_get_contacts", sizes[s], _bench_roster_get_contacts, NULL);
+        roster_destroy();
+    }
+
+    bench_run("jid_create", 0, _bench_jid_create, NULL);
+
+    GString* message = g_string_new(NULL);
+    for (int i = 0; i < 20; i++) {
+        g_string_append(message, "so I asked bob whether the build was green, bob said BOB's branch was fine. ");
+    }
+    bench_run("get_mentions", (int)message->len, _bench_get_mentions, message->str);
+    g_string_free(message, TRUE);
+}
@@ -0,0 +1,55 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include "database.h"
+#include "config/account.h"
+#include "xmpp/jid.h"
+#include "xmpp/xmpp.h"
+#include "xmpp/message.h"
+#include "bench.h"
+
+static void
+_bench_insert(void* data, guint64 iterations)
+{
+    for (guint64 i = 0; i < iterations; i++) {
+        ProfMessage* message = message_init();
+        message->from_jid = jid_create("friend@example.org/phone");
+        message->to_jid = jid_create("bench@example.org/bench");
+        message->plain = strdup("did the build go green on the release branch after the last fix?");
+        message->type = PROF_MSG_TYPE_CHAT;
+        log_database_add_incoming(message);
+        message_free(message);
+    }
+
+    // inserts are handed to the writer thread, count them once they are written
+    while (log_database_queue_depth() > 0) {
+        g_usleep(1000);
+    }
+}
+
+static void
+_bench_search(void* data, guint64 iterations)
+{
+    for (guint64 i = 0; i < iterations; i++) {
+        g_slist_free_full(log_database_search("release branch", MESSAGES_TO_SEARCH), (GDestroyNotify)message_free);
+    }
+}
+
+void
+bench_database(void)
+{
+    ProfAccount account = { 0 };
+    account.jid = "bench@example.org";
+
+    if (!log_database_init(&account)) {
+        fprintf(stderr, "Could not open the benchmark database.\n");
+        return;
+    }
+
+    bench_run("log_database_add_incoming", 0, _bench_insert, NULL);
+    bench_run("log_database_search", MESSAGES_TO_SEARCH, _bench_search, NULL);
+
+    log_database_close();
+}
@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <glib.h>
+
+#include "config.h"
+
+#ifdef HAVE_NCURSESW_NCURSES_H
+#include <ncursesw/ncurses.h>
+#elif HAVE_NCURSES_H
+#include <ncurses.h>
+#elif HAVE_CURSES_H
+#include <curses.h>
+#endif
+
+#include "common.h"
+#include "config/theme.h"
+#include "ui/ui.h"
+#include "ui/buffer.h"
+#include "ui/win_types.h"
+#include "ui/wrap.h"
+#include "bench.h"
+
+static void
+_bench_buffer_append(void* data, guint64 iterations)
+{
+    ProfBuff buffer = data;
+    GDateTime* now = g_date_time_new_now_local();
+    for (guint64 i = 0; i < iterations; i++) {
+        buffer_append(buffer, "-", 0, now, 0, THEME_TEXT, "someone", "someone@example.org",
+                      "a line of chat that is about as long as a typical message", NULL, NULL, 0, 1);
+    }
+    g_date_time_unref(now);
+}
+
+static void
+_bench_win_redraw(void* data, guint64 iterations)
+{
+    ProfWin* window = data;
+    for (guint64 i = 0; i < iterations; i++) {
+        win_redraw(window);
+    }
+}
+
+static void
+_bench_wrap_layout(void* data, guint64 iterations)
+{
+    const char* message = data;
+    for (guint64 i = 0; i < iterations; i++) {
+        wrap_free(wrap_layout(message, 20, 120, 11, 0));
+    }
+}
+
+static void
+_bench_theme_attrs(void* data, guint64 iterations)
+{
+    volatile int attrs = 0;
+    for (guint64 i = 0; i < iterations; i++) {
+        attrs += theme_attrs(THEME_TEXT_ME + (i % 8));
+    }
+}
+
+void
+bench_ui(void)
+{
+    int sizes[] = { 100, 1000, 5000 };
+
+    for (int s = 0; s < ARRAY_SIZE(sizes); s++) {
+        ProfBuff buffer = buffer_create(sizes[s]);
+        _bench_buffer_append(buffer, sizes[s]);
+        bench_run("buffer_append", sizes[s], _bench_buffer_append, buffer);
+        buffer_free(buffer);
+    }
+
+    // a pasted stack trace, long lines with a few very long words
+    GString* paste = g_string_new(NULL);
+    for (int i = 0; i < 200; i++) {
+        g_string_append_printf(paste, "    at org.example.service.handler.RequestDispatcher.dispatch(RequestDispatcher.java:%d) caused by ünïcödé\n", i);
+    }
+    bench_run("wrap_layout", paste->len, _bench_wrap_layout, paste->str);
+    g_string_free(paste, TRUE);
+
+    // drawing needs a terminal, give it one that goes nowhere
+    FILE* term_out = fopen("/dev/null", "w");
+    FILE* term_in = fopen("/dev/null", "r");
+    SCREEN* screen = term_out && term_in ? newterm("xterm-256color", term_out, term_in) : NULL;
+    if (!screen) {
+        fprintf(stderr, "Could not create a terminal, skipping drawing benchmarks.\n");
+    } else {
+        theme_init("default");
+        ui_load_colours();
+
+        bench_run("theme_attrs", 0, _bench_theme_attrs, NULL);
+
+        for (int s = 0; s < ARRAY_SIZE(sizes); s++) {
+            ProfWin* window = win_create_xmlconsole();
+            buffer_set_max_size(window->layout->buffer, sizes[s]);
+            for (int i = 0; i < sizes[s]; i++) {
+                win_println(window, THEME_TEXT, "-", "line %d of a window that is exactly as full as its scrollback allows", i);
+            }
+            bench_run("win_redraw", sizes[s], _bench_win_redraw, window);
+            win_free(window);
+        }
+
+        theme_close();
+        endwin();
+        delscreen(screen);
+    }
+
+    if (term_out) {
+        fclose(term_out);
+    }
+    if (term_in) {
+        fclose(term_in);
+    }
+}
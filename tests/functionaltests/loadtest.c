@@ -0,0 +1,375 @@
+#include <glib.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <stabber.h>
+#include <expect.h>
+
+#include "proftest.h"
+
+// Drives a running profanity with synthetic traffic from stabber and reports
+// the end to end latency of chat messages (stanza sent until its body shows
+// up on the terminal) plus CPU and RSS of the profanity process over time.
+//
+// Only the chat window with Buddy1 is on screen, so chat messages are what
+// gets timed. MUC messages, presence churn, carbons and MAM pages land in
+// background windows and are there to load the client.
+
+#define LOAD_TICK_USEC     (5 * 1000)
+#define LOAD_SAMPLE_USEC   (1000 * 1000)
+#define LOAD_DRAIN_USEC    (5 * 1000 * 1000)
+
+static gint duration = 30;
+static gint chat_rate = 20;
+static gint muc_rate = 50;
+static gint presence_rate = 20;
+static gint carbons_rate = 10;
+static gint mam_rate = 1;
+static gint mam_page = 50;
+
+static GOptionEntry entries[] = {
+    { "duration", 'd', 0, G_OPTION_ARG_INT, &duration, "Seconds of load to generate", "SECS" },
+    { "chat", 0, 0, G_OPTION_ARG_INT, &chat_rate, "Chat messages per second (timed)", "N" },
+    { "muc", 0, 0, G_OPTION_ARG_INT, &muc_rate, "MUC messages per second", "N" },
+    { "presence", 0, 0, G_OPTION_ARG_INT, &presence_rate, "Presence updates per second", "N" },
+    { "carbons", 0, 0, G_OPTION_ARG_INT, &carbons_rate, "Message carbons per second", "N" },
+    { "mam", 0, 0, G_OPTION_ARG_INT, &mam_rate, "MAM pages per second", "N" },
+    { "mam-page", 0, 0, G_OPTION_ARG_INT, &mam_page, "Messages per MAM page", "N" },
+    { NULL }
+};
+
+typedef struct load_stream_t
+{
+    const char *name;
+    gint rate;
+    guint64 sent;
+    void (*send)(guint64 seq);
+} LoadStream;
+
+typedef struct load_sample_t
+{
+    double elapsed;
+    double cpu;
+    long rss_kb;
+} LoadSample;
+
+// send time of each timed chat message, indexed by sequence number
+static GArray *chat_sent_at;
+static GArray *latencies;
+static GArray *samples;
+static guint64 chat_lost = 0;
+
+static void
+_send_chat(guint64 seq)
+{
+    gint64 now = g_get_monotonic_time();
+    g_array_append_val(chat_sent_at, now);
+
+    char *stanza = g_strdup_printf(
+        "<message id='load_chat_%" G_GUINT64_FORMAT "' type='chat' to='stabber@localhost/profanity' from='buddy1@localhost/mobile'>"
+            "<body>load-%" G_GUINT64_FORMAT ".</body>"
+        "</message>",
+        seq, seq);
+    stbbr_send(stanza);
+    g_free(stanza);
+}
+
+static void
+_send_muc(guint64 seq)
+{
+    char *stanza = g_strdup_printf(
+        "<message type='groupchat' to='stabber@localhost/profanity' from='testroom@conference.localhost/nick%" G_GUINT64_FORMAT "'>"
+            "<body>room traffic %" G_GUINT64_FORMAT "</body>"
+        "</message>",
+        seq % 20, seq);
+    stbbr_send(stanza);
+    g_free(stanza);
+}
+
+static void
+_send_presence(guint64 seq)
+{
+    static const char *shows[] = { "away", "xa", "dnd", "chat" };
+
+    char *stanza = g_strdup_printf(
+        "<presence to='stabber@localhost' from='buddy2@localhost/res%" G_GUINT64_FORMAT "'>"
+            "<show>%s</show>"
+            "<status>churn %" G_GUINT64_FORMAT "</status>"
+        "</presence>",
+        seq % 8, shows[seq % G_N_ELEMENTS(shows)], seq);
+    stbbr_send(stanza);
+    g_free(stanza);
+}
+
+static void
+_send_carbon(guint64 seq)
+{
+    char *stanza = g_strdup_printf(
+        "<message type='chat' to='stabber@localhost/profanity' from='stabber@localhost'>"
+            "<received xmlns='urn:xmpp:carbons:2'>"
+                "<forwarded xmlns='urn:xmpp:forward:0'>"
+                    "<message id='load_carbon_%" G_GUINT64_FORMAT "' xmlns='jabber:client' type='chat' to='stabber@localhost/profanity' from='buddy2@localhost/mobile'>"
+                        "<body>carbon %" G_GUINT64_FORMAT "</body>"
+                    "</message>"
+                "</forwarded>"
+            "</received>"
+        "</message>",
+        seq, seq);
+    stbbr_send(stanza);
+    g_free(stanza);
+}
+
+static void
+_send_mam_page(guint64 seq)
+{
+    for (int i = 0; i < mam_page; i++) {
+        char *stanza = g_strdup_printf(
+            "<message to='stabber@localhost/profanity' from='stabber@localhost'>"
+                "<result xmlns='urn:xmpp:mam:2' id='load_mam_%" G_GUINT64_FORMAT "_%d'>"
+                    "<forwarded xmlns='urn:xmpp:forward:0'>"
+                        "<delay xmlns='urn:xmpp:delay' stamp='2020-01-01T00:00:00Z'/>"
+                        "<message xmlns='jabber:client' type='chat' to='stabber@localhost' from='buddy2@localhost/mobile'>"
+                            "<body>archived %" G_GUINT64_FORMAT " %d</body>"
+                        "</message>"
+                    "</forwarded>"
+                "</result>"
+            "</message>",
+            seq, i, seq, i);
+        stbbr_send(stanza);
+        g_free(stanza);
+    }
+}
+
+static pid_t
+_find_profanity_pid(void)
+{
+    // exp_pid is the shell running start_profanity.sh, profanity is its child
+    char *path = g_strdup_printf("/proc/%d/task/%d/children", exp_pid, exp_pid);
+    char *contents = NULL;
+    pid_t pid = exp_pid;
+
+    if (g_file_get_contents(path, &contents, NULL, NULL)) {
+        int child = atoi(contents);
+        if (child > 0) {
+            pid = child;
+        }
+    }
+
+    g_free(contents);
+    g_free(path);
+    return pid;
+}
+
+static gboolean
+_read_cpu_ticks(pid_t pid, guint64 *ticks)
+{
+    char *path = g_strdup_printf("/proc/%d/stat", pid);
+    char *contents = NULL;
+    gboolean result = FALSE;
+
+    if (g_file_get_contents(path, &contents, NULL, NULL)) {
+        // the command name may contain spaces, fields are counted after it
+        char *fields = strrchr(contents, ')');
+        guint64 utime, stime;
+        if (fields && sscanf(fields + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT, &utime, &stime) == 2) {
+            *ticks = utime + stime;
+            result = TRUE;
+        }
+    }
+
+    g_free(contents);
+    g_free(path);
+    return result;
+}
+
+static long
+_read_rss_kb(pid_t pid)
+{
+    char *path = g_strdup_printf("/proc/%d/statm", pid);
+    char *contents = NULL;
+    long rss = 0;
+
+    if (g_file_get_contents(path, &contents, NULL, NULL)) {
+        long pages = 0;
+        if (sscanf(contents, "%*ld %ld", &pages) == 1) {
+            rss = pages * (sysconf(_SC_PAGESIZE) / 1024);
+        }
+    }
+
+    g_free(contents);
+    g_free(path);
+    return rss;
+}
+
+static void
+_record_match(void)
+{
+    gint64 now = g_get_monotonic_time();
+    guint64 seq = g_ascii_strtoull(exp_match + strlen("load-"), NULL, 10);
+
+    // a redraw can print the same body again, only time the first sighting
+    if (seq < chat_sent_at->len && g_array_index(chat_sent_at, gint64, seq) != 0) {
+        gint64 latency = now - g_array_index(chat_sent_at, gint64, seq);
+        g_array_append_val(latencies, latency);
+        g_array_index(chat_sent_at, gint64, seq) = 0;
+    }
+}
+
+static gint
+_cmp_gint64(gconstpointer a, gconstpointer b)
+{
+    gint64 x = *(const gint64 *)a;
+    gint64 y = *(const gint64 *)b;
+    return (x > y) - (x < y);
+}
+
+static double
+_percentile_ms(double pct)
+{
+    if (latencies->len == 0) {
+        return 0.0;
+    }
+    guint index = (guint)((latencies->len - 1) * pct / 100.0);
+    return g_array_index(latencies, gint64, index) / 1000.0;
+}
+
+static void
+_print_report(LoadStream *streams, int nstreams, double elapsed)
+{
+    g_array_sort(latencies, _cmp_gint64);
+
+    printf("{\n  \"duration\": %.2f,\n  \"sent\": {", elapsed);
+    for (int i = 0; i < nstreams; i++) {
+        printf("%s \"%s\": %" G_GUINT64_FORMAT, i == 0 ? "" : ",", streams[i].name, streams[i].sent);
+    }
+    printf(", \"mam_messages\": %" G_GUINT64_FORMAT " },\n", streams[nstreams - 1].sent * mam_page);
+
+    printf("  \"latency_ms\": { \"count\": %u, \"lost\": %" G_GUINT64_FORMAT ", \"p50\": %.2f, \"p90\": %.2f, \"p99\": %.2f, \"max\": %.2f },\n",
+           latencies->len, chat_lost, _percentile_ms(50), _percentile_ms(90), _percentile_ms(99), _percentile_ms(100));
+
+    printf("  \"samples\": [");
+    for (guint i = 0; i < samples->len; i++) {
+        LoadSample *sample = &g_array_index(samples, LoadSample, i);
+        printf("%s\n    { \"t\": %.2f, \"cpu_pct\": %.1f, \"rss_kb\": %ld }",
+               i == 0 ? "" : ",", sample->elapsed, sample->cpu, sample->rss_kb);
+    }
+    printf("\n  ]\n}\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+    GError *error = NULL;
+    GOptionContext *context = g_option_context_new("- flood profanity with synthetic XMPP traffic");
+    g_option_context_add_main_entries(context, entries, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        fprintf(stderr, "%s\n", error->message);
+        g_error_free(error);
+        g_option_context_free(context);
+        return 1;
+    }
+    g_option_context_free(context);
+
+    LoadStream streams[] = {
+        { "chat", chat_rate, 0, _send_chat },
+        { "muc", muc_rate, 0, _send_muc },
+        { "presence", presence_rate, 0, _send_presence },
+        { "carbons", carbons_rate, 0, _send_carbon },
+        { "mam_pages", mam_rate, 0, _send_mam_page },
+    };
+    int nstreams = G_N_ELEMENTS(streams);
+
+    chat_sent_at = g_array_new(FALSE, FALSE, sizeof(gint64));
+    latencies = g_array_new(FALSE, FALSE, sizeof(gint64));
+    samples = g_array_new(FALSE, FALSE, sizeof(LoadSample));
+
+    init_prof_test(NULL);
+    prof_connect();
+
+    stbbr_for_id("prof_join_4",
+        "<presence id='prof_join_4' lang='en' to='stabber@localhost/profanity' from='testroom@conference.localhost/stabber'>"
+            "<c hash='sha-1' xmlns='http://jabber.org/protocol/caps' node='http://profanity-im.github.io' ver='*'/>"
+            "<x xmlns='http://jabber.org/protocol/muc#user'>"
+                "<item role='participant' jid='stabber@localhost/profanity' affiliation='none'/>"
+            "</x>"
+            "<status code='110'/>"
+        "</presence>"
+    );
+    prof_input("/join testroom@conference.localhost");
+    prof_output_exact("-> You have joined the room as stabber, role: participant, affiliation: none");
+
+    prof_input("/carbons on");
+
+    // the timed chat window has to be the one on screen
+    prof_input("/msg Buddy1");
+    prof_output_exact("unencrypted");
+
+    pid_t pid = _find_profanity_pid();
+    long ticks_per_sec = sysconf(_SC_CLK_TCK);
+    guint64 last_ticks = 0;
+    _read_cpu_ticks(pid, &last_ticks);
+
+    int saved_timeout = exp_timeout;
+    exp_timeout = 0;
+
+    gint64 start = g_get_monotonic_time();
+    gint64 end = start + (gint64)duration * G_USEC_PER_SEC;
+    gint64 last_sample = start;
+    gint64 now = start;
+
+    while (now < end + LOAD_DRAIN_USEC) {
+        now = g_get_monotonic_time();
+
+        if (now < end) {
+            double elapsed = (now - start) / (double)G_USEC_PER_SEC;
+            for (int i = 0; i < nstreams; i++) {
+                guint64 due = (guint64)(streams[i].rate * elapsed);
+                while (streams[i].sent < due) {
+                    streams[i].send(streams[i].sent);
+                    streams[i].sent++;
+                }
+            }
+        } else if (latencies->len >= chat_sent_at->len) {
+            break;
+        }
+
+        // take every timed body that reached the terminal since the last tick
+        while (exp_expectl(prof_fd(), exp_regexp, "load-[0-9]+\\.", 1, exp_end) == 1) {
+            _record_match();
+        }
+
+        if (now - last_sample >= LOAD_SAMPLE_USEC) {
+            guint64 ticks = last_ticks;
+            _read_cpu_ticks(pid, &ticks);
+            LoadSample sample = {
+                .elapsed = (now - start) / (double)G_USEC_PER_SEC,
+                .cpu = 100.0 * (ticks - last_ticks) / ticks_per_sec / ((now - last_sample) / (double)G_USEC_PER_SEC),
+                .rss_kb = _read_rss_kb(pid),
+            };
+            g_array_append_val(samples, sample);
+            last_ticks = ticks;
+            last_sample = now;
+        }
+
+        g_usleep(LOAD_TICK_USEC);
+    }
+
+    exp_timeout = saved_timeout;
+    chat_lost = chat_sent_at->len - latencies->len;
+
+    _print_report(streams, nstreams, (now - start) / (double)G_USEC_PER_SEC);
+
+    close_prof_test(NULL);
+
+    g_array_free(chat_sent_at, TRUE);
+    g_array_free(latencies, TRUE);
+    g_array_free(samples, TRUE);
+
+    return 0;
+}
@@ -216,6 +216,12 @@ prof_input(const char *input)
     g_string_free(inp_str, TRUE);
 }
 
+int
+prof_fd(void)
+{
+    return fd;
+}
+
 int
 prof_output_exact(const char *text)
 {
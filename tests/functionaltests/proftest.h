@@ -11,6 +11,7 @@ void prof_start(void);
 void prof_connect(void);
 void prof_connect_with_roster(const char *roster);
 void prof_input(const char *input);
+int prof_fd(void);
 
 int prof_output_exact(const char *text);
 int prof_output_regex(const char *text);
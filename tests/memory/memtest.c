@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <locale.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "config.h"
+
+#ifdef HAVE_MALLINFO2
+#include <malloc.h>
+#endif
+
+#ifdef HAVE_NCURSESW_NCURSES_H
+#include <ncursesw/ncurses.h>
+#elif HAVE_NCURSES_H
+#include <ncurses.h>
+#elif HAVE_CURSES_H
+#include <curses.h>
+#endif
+
+#include "common.h"
+#include "config/preferences.h"
+#include "config/theme.h"
+#include "ui/ui.h"
+#include "ui/buffer.h"
+#include "ui/win_types.h"
+#include "ui/window_list.h"
+#include "xmpp/muc.h"
+#include "xmpp/roster_list.h"
+
+// Heap used per chat window, roster contact, room occupant and buffered line.
+// Each kind is measured as the growth of malloc's in-use bytes from MEM_COUNT
+// to twice as many, which leaves out fixed costs like hash table setup. Exits
+// with an error when one goes over its limit, so `make check` catches changes
+// that make them bigger. Limits are bytes, with headroom over what glibc
+// reports on x86_64.
+#define MEM_COUNT 500
+
+#define MEM_ROOM "room@conference.example.org"
+
+typedef struct mem_entity_t
+{
+    const char* name;
+    gsize limit;
+    void (*add)(int from, int to);
+} MemEntity;
+
+static ProfWin* lines_win = NULL;
+
+static gsize
+_mem_in_use(void)
+{
+#ifdef HAVE_MALLINFO2
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+#else
+    return 0;
+#endif
+}
+
+static void
+_mem_add_chat_windows(int from, int to)
+{
+    for (int i = from; i < to; i++) {
+        auto_gchar gchar* barejid = g_strdup_printf("contact%d@example.org", i);
+        wins_new_chat(barejid);
+    }
+}
+
+static void
+_mem_add_contacts(int from, int to)
+{
+    for (int i = from; i < to; i++) {
+        auto_gchar gchar* barejid = g_strdup_printf("friend%d@example.org", i);
+        auto_gchar gchar* name = g_strdup_printf("Friend %d", i);
+        roster_add(barejid, name, NULL, "both", FALSE);
+    }
+}
+
+static void
+_mem_add_occupants(int from, int to)
+{
+    for (int i = from; i < to; i++) {
+        auto_gchar gchar* nick = g_strdup_printf("occupant%d", i);
+        auto_gchar gchar* jid = g_strdup_printf("occupant%d@example.org/laptop", i);
+        muc_roster_add(MEM_ROOM, nick, jid, "participant", "none", NULL, NULL);
+    }
+}
+
+static void
+_mem_add_lines(int from, int to)
+{
+    for (int i = from; i < to; i++) {
+        win_println(lines_win, THEME_TEXT, "-", "line %d, a line of chat that is about as long as a typical message", i);
+    }
+}
+
+static MemEntity entities[] = {
+    { "chat_window", 16384, _mem_add_chat_windows },
+    { "roster_contact", 2048, _mem_add_contacts },
+    { "room_occupant", 2048, _mem_add_occupants },
+    { "buffered_line", 1024, _mem_add_lines },
+};
+
+static void
+_mem_remove_dir(const char* const path)
+{
+    GDir* dir = g_dir_open(path, 0, NULL);
+    if (dir) {
+        const gchar* name;
+        while ((name = g_dir_read_name(dir))) {
+            auto_gchar gchar* child = g_build_filename(path, name, NULL);
+            if (g_file_test(child, G_FILE_TEST_IS_DIR)) {
+                _mem_remove_dir(child);
+            } else {
+                g_unlink(child);
+            }
+        }
+        g_dir_close(dir);
+    }
+    g_rmdir(path);
+}
+
+int
+main(int argc, char* argv[])
+{
+#ifndef HAVE_MALLINFO2
+    fprintf(stderr, "No mallinfo2(), skipping memory tests.\n");
+    return 77;
+#endif
+    setlocale(LC_ALL, "");
+
+    // never touch the user's configuration or data
+    auto_gchar gchar* home = g_dir_make_tmp("profanity-memtest-XXXXXX", NULL);
+    if (!home) {
+        fprintf(stderr, "Could not create a temporary directory.\n");
+        return EXIT_FAILURE;
+    }
+    auto_gchar gchar* config_home = g_build_filename(home, "config", NULL);
+    auto_gchar gchar* data_home = g_build_filename(home, "data", NULL);
+    g_setenv("XDG_CONFIG_HOME", config_home, TRUE);
+    g_setenv("XDG_DATA_HOME", data_home, TRUE);
+
+    // windows need a terminal, give them one that goes nowhere
+    FILE* term_out = fopen("/dev/null", "w");
+    FILE* term_in = fopen("/dev/null", "r");
+    SCREEN* screen = term_out && term_in ? newterm("xterm-256color", term_out, term_in) : NULL;
+    if (!screen) {
+        fprintf(stderr, "Could not create a terminal, skipping memory tests.\n");
+        _mem_remove_dir(home);
+        return 77;
+    }
+
+    prefs_load(NULL);
+    theme_init("default");
+    ui_load_colours();
+    wins_init();
+    roster_create();
+    muc_init();
+    muc_join(MEM_ROOM, "me", NULL, FALSE);
+    lines_win = win_create_xmlconsole();
+    buffer_set_max_size(lines_win->layout->buffer, MEM_COUNT * 2);
+
+    int failed = 0;
+    for (int e = 0; e < ARRAY_SIZE(entities); e++) {
+        MemEntity* entity = &entities[e];
+        entity->add(0, MEM_COUNT);
+        gsize before = _mem_in_use();
+        entity->add(MEM_COUNT, MEM_COUNT * 2);
+        gsize after = _mem_in_use();
+
+        gsize per_entity = after > before ? (after - before) / MEM_COUNT : 0;
+        gboolean over = per_entity > entity->limit;
+        printf("%-16s %8" G_GSIZE_FORMAT " bytes each, limit %8" G_GSIZE_FORMAT "%s\n",
+               entity->name, per_entity, entity->limit, over ? "  FAILED" : "");
+        if (over) {
+            failed++;
+        }
+    }
+
+    win_free(lines_win);
+    muc_close();
+    roster_destroy();
+    wins_destroy();
+    theme_close();
+    endwin();
+    delscreen(screen);
+    fclose(term_out);
+    fclose(term_in);
+    prefs_close();
+
+    _mem_remove_dir(home);
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
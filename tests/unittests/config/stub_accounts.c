@@ -63,6 +63,12 @@ accounts_get_account(const char* const name)
     return mock_ptr_type(ProfAccount*);
 }
 
+const ProfAccount*
+accounts_peek_account(const char* const name)
+{
+    return NULL;
+}
+
 gboolean
 accounts_enable(const char* const name)
 {
@@ -51,3 +51,45 @@ void
 log_database_close(void)
 {
 }
+int
+log_database_queue_depth(void)
+{
+    return 0;
+}
+ProfMessage*
+log_database_get_limits_info(const gchar* const contact_barejid, gboolean is_last)
+{
+    return NULL;
+}
+ProfHistoryCursor*
+log_database_history_cursor_new(const gchar* const contact_barejid, int max_page)
+{
+    return NULL;
+}
+GSList*
+log_database_history_cursor_prev(ProfHistoryCursor* cursor, GDateTime* oldest_shown)
+{
+    return NULL;
+}
+void
+log_database_history_cursor_free(ProfHistoryCursor* cursor)
+{
+}
+GSList*
+log_database_search(const char* const text, int limit)
+{
+    return NULL;
+}
+void
+log_database_maintenance(gboolean vacuum)
+{
+}
+gboolean
+log_database_archive_attached(void)
+{
+    return FALSE;
+}
+void
+log_database_import_chatlogs(void)
+{
+}
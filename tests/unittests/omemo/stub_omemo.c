@@ -113,6 +113,11 @@ omemo_encrypt_file(FILE* in, FILE* out, off_t file_size, int* gcry_res)
 {
     return NULL;
 };
+struct aes256gcm_stream_t*
+omemo_encrypt_file_stream(off_t file_size, char** fragment, gcry_error_t* gcry_res)
+{
+    return NULL;
+}
 void omemo_free(void* a){};
 
 uint32_t
@@ -19,3 +19,8 @@ ox_gpg_public_keys(void)
 {
     return NULL;
 }
+
+void
+ox_key_cache_clear(void)
+{
+}
@@ -232,3 +232,159 @@ complete_previous(void** state)
     free(result3);
     free(result4);
 }
+
+void
+add_all_sorts_items(void** state)
+{
+    Autocomplete ac = autocomplete_new();
+    char* items[] = { "Charlie", "alice", "Bob", "alice", NULL };
+    autocomplete_add(ac, "Dave");
+    autocomplete_add_all(ac, items);
+    GList* result = autocomplete_create_list(ac);
+
+    assert_int_equal(4, g_list_length(result));
+    assert_string_equal("Bob", g_list_nth_data(result, 0));
+    assert_string_equal("Charlie", g_list_nth_data(result, 1));
+    assert_string_equal("Dave", g_list_nth_data(result, 2));
+    assert_string_equal("alice", g_list_nth_data(result, 3));
+
+    autocomplete_free(ac);
+    g_list_free_full(result, free);
+}
+
+void
+complete_after_remove_continues(void** state)
+{
+    Autocomplete ac = autocomplete_new();
+    autocomplete_add(ac, "MyBuddy1");
+    autocomplete_add(ac, "MyBuddy2");
+    autocomplete_add(ac, "MyBuddy3");
+
+    char* result1 = autocomplete_complete(ac, "myb", TRUE, FALSE);
+    char* result2 = autocomplete_complete(ac, result1, TRUE, FALSE);
+    autocomplete_remove(ac, "MyBuddy1");
+    char* result3 = autocomplete_complete(ac, result2, TRUE, FALSE);
+
+    assert_string_equal("MyBuddy3", result3);
+
+    autocomplete_free(ac);
+
+    free(result1);
+    free(result2);
+    free(result3);
+}
+
+void
+bulk_add_sorts_on_end(void** state)
+{
+    Autocomplete ac = autocomplete_new();
+    autocomplete_bulk_begin(ac);
+    autocomplete_add(ac, "Charlie");
+    autocomplete_add(ac, "Alice");
+    autocomplete_add(ac, "Charlie");
+    autocomplete_add(ac, "Bob");
+    autocomplete_bulk_end(ac);
+    GList* result = autocomplete_create_list(ac);
+
+    assert_int_equal(3, g_list_length(result));
+    assert_string_equal("Alice", g_list_nth_data(result, 0));
+    assert_string_equal("Bob", g_list_nth_data(result, 1));
+    assert_string_equal("Charlie", g_list_nth_data(result, 2));
+
+    autocomplete_free(ac);
+    g_list_free_full(result, free);
+}
+
+void
+complete_during_bulk_add(void** state)
+{
+    Autocomplete ac = autocomplete_new();
+    autocomplete_bulk_begin(ac);
+    autocomplete_add(ac, "MyBuddy2");
+    autocomplete_add(ac, "MyBuddy1");
+
+    char* result = autocomplete_complete(ac, "myb", TRUE, FALSE);
+
+    assert_string_equal("MyBuddy1", result);
+
+    autocomplete_bulk_end(ac);
+    autocomplete_free(ac);
+    free(result);
+}
+
+void
+fuzzy_complete_ranks_matches(void** state)
+{
+    Autocomplete ac = autocomplete_new();
+    autocomplete_add(ac, "Bob Smith");
+    autocomplete_add(ac, "bsmith@example.org");
+    autocomplete_add(ac, "Alice");
+
+    autocomplete_set_fuzzy(TRUE);
+    char* result1 = autocomplete_complete(ac, "bsm", FALSE, FALSE);
+    char* result2 = autocomplete_complete(ac, result1, FALSE, FALSE);
+    char* result3 = autocomplete_complete(ac, result2, FALSE, FALSE);
+    autocomplete_set_fuzzy(FALSE);
+
+    assert_string_equal("bsmith@example.org", result1);
+    assert_string_equal("Bob Smith", result2);
+    assert_string_equal("bsmith@example.org", result3);
+
+    autocomplete_free(ac);
+    free(result1);
+    free(result2);
+    free(result3);
+}
+
+void
+fuzzy_complete_narrows_previous_matches(void** state)
+{
+    Autocomplete ac = autocomplete_new();
+    autocomplete_add(ac, "Bob Smith");
+    autocomplete_add(ac, "bsmith@example.org");
+
+    autocomplete_set_fuzzy(TRUE);
+    char* result1 = autocomplete_complete(ac, "bs", FALSE, FALSE);
+    autocomplete_reset(ac);
+    char* result2 = autocomplete_complete(ac, "bsx", FALSE, FALSE);
+    autocomplete_reset(ac);
+    char* result3 = autocomplete_complete(ac, "bot", FALSE, FALSE);
+    autocomplete_set_fuzzy(FALSE);
+
+    assert_string_equal("bsmith@example.org", result1);
+    assert_null(result2);
+    assert_string_equal("Bob Smith", result3);
+
+    autocomplete_free(ac);
+    free(result1);
+    free(result3);
+}
+
+void
+complete_cycles_matches_in_order(void** state)
+{
+    Autocomplete ac = autocomplete_new();
+    autocomplete_add(ac, "room@conference.example.org");
+    autocomplete_add(ac, "Robert");
+    autocomplete_add(ac, "alice@example.org");
+    autocomplete_add(ac, "rob@example.org");
+
+    char* result1 = autocomplete_complete(ac, "ro", FALSE, FALSE);
+    char* result2 = autocomplete_complete(ac, result1, FALSE, FALSE);
+    char* result3 = autocomplete_complete(ac, result2, FALSE, FALSE);
+    char* result4 = autocomplete_complete(ac, result3, FALSE, FALSE);
+    char* result5 = autocomplete_complete(ac, result4, FALSE, TRUE);
+
+    assert_string_equal("Robert", result1);
+    assert_string_equal("rob@example.org", result2);
+    assert_string_equal("room@conference.example.org", result3);
+    assert_string_equal("Robert", result4);
+    assert_string_equal("room@conference.example.org", result5);
+
+    autocomplete_free(ac);
+    free(result1);
+    free(result2);
+    free(result3);
+    free(result4);
+    free(result5);
+}
@@ -14,3 +14,10 @@ void complete_both_with_accented(void** state);
 void complete_both_with_base(void** state);
 void complete_ignores_case(void** state);
 void complete_previous(void** state);
+void add_all_sorts_items(void** state);
+void complete_after_remove_continues(void** state);
+void bulk_add_sorts_on_end(void** state);
+void complete_during_bulk_add(void** state);
+void fuzzy_complete_ranks_matches(void** state);
+void fuzzy_complete_narrows_previous_matches(void** state);
+void complete_cycles_matches_in_order(void** state);
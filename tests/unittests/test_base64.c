@@ -0,0 +1,62 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+
+#include "tools/base64.h"
+
+void
+base64_matches_glib_for_every_length(void** state)
+{
+    guchar data[64];
+    for (int i = 0; i < sizeof(data); i++) {
+        data[i] = i * 37 + 11;
+    }
+
+    for (gsize len = 0; len <= sizeof(data); len++) {
+        gchar* ours = base64_encode(data, len);
+        gchar* theirs = g_base64_encode(data, len);
+        assert_string_equal(theirs, ours);
+
+        gsize decoded_len;
+        guchar* decoded = base64_decode(ours, &decoded_len);
+        assert_int_equal(len, decoded_len);
+        assert_memory_equal(data, decoded, len);
+
+        g_free(decoded);
+        g_free(theirs);
+        g_free(ours);
+    }
+}
+
+void
+base64_decode_skips_line_breaks(void** state)
+{
+    gsize len;
+    guchar* decoded = base64_decode("SGVs\nbG8s\r\nIHdv cmxk\nIQ==\n", &len);
+
+    assert_int_equal(13, len);
+    assert_memory_equal("Hello, world!", decoded, len);
+
+    g_free(decoded);
+}
+
+void
+base64_decode_into_reuses_buffer(void** state)
+{
+    GByteArray* buffer = g_byte_array_new();
+    gsize len;
+
+    guchar* decoded = base64_decode_into(buffer, "bG9uZ2VyIHRleHQ=", &len);
+    assert_int_equal(11, len);
+    assert_memory_equal("longer text", decoded, len);
+
+    decoded = base64_decode_into(buffer, "aGk=", &len);
+    assert_int_equal(2, len);
+    assert_memory_equal("hi", decoded, len);
+    assert_int_equal(2, buffer->len);
+
+    g_byte_array_free(buffer, TRUE);
+}
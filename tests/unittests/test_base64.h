@@ -0,0 +1,3 @@
+void base64_matches_glib_for_every_length(void** state);
+void base64_decode_skips_line_breaks(void** state);
+void base64_decode_into_reuses_buffer(void** state);
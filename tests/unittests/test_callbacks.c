@@ -64,3 +64,23 @@ returns_commands(void** state)
     // TODO: why does this make the test fail?
     // callbacks_close();
 }
+
+void
+returns_deferred_commands_until_removed(void** state)
+{
+    callbacks_init();
+
+    callbacks_add_deferred_command("plugin1", "/command1");
+
+    GList* names = plugins_get_command_names();
+    assert_int_equal(1, g_list_length(names));
+    assert_string_equal("/command1", names->data);
+    g_list_free(names);
+
+    callbacks_remove_deferred("plugin1");
+
+    names = plugins_get_command_names();
+    assert_null(names);
+
+    callbacks_close();
+}
@@ -1,2 +1,3 @@
 void returns_no_commands(void** state);
 void returns_commands(void** state);
+void returns_deferred_commands_until_removed(void** state);
@@ -177,3 +177,35 @@ cmd_join_uses_password_when_supplied(void** state)
 
     muc_close();
 }
+
+void
+cmd_join_joins_each_of_several_rooms(void** state)
+{
+    gchar* account_name = g_strdup("an_account");
+    char* room1 = "room1@conf.server.org";
+    char* room2 = "room2@conf.server.org";
+    gchar* account_nick = g_strdup("a_nick");
+    gchar* args[] = { "room1@conf.server.org,room2@conf.server.org", NULL };
+    ProfAccount* account = account_new(account_name, g_strdup("user@server.org"), NULL, NULL,
+                                       TRUE, NULL, 0, g_strdup("laptop"), NULL, NULL, 0, 0, 0, 0, 0, NULL, account_nick, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, 0);
+
+    muc_init();
+
+    will_return(connection_get_status, JABBER_CONNECTED);
+    will_return(session_get_account_name, account_name);
+
+    expect_string(accounts_get_account, name, account_name);
+    will_return(accounts_get_account, account);
+
+    expect_string(presence_join_room, room, room1);
+    expect_string(presence_join_room, nick, account_nick);
+    expect_value(presence_join_room, passwd, NULL);
+    expect_string(presence_join_room, room, room2);
+    expect_string(presence_join_room, nick, account_nick);
+    expect_value(presence_join_room, passwd, NULL);
+
+    gboolean result = cmd_join(NULL, CMD_JOIN, args);
+    assert_true(result);
+
+    muc_close();
+}
@@ -7,3 +7,4 @@ void cmd_join_uses_account_mucservice_when_no_service_specified(void** state);
 void cmd_join_uses_supplied_nick(void** state);
 void cmd_join_uses_account_nick_when_not_supplied(void** state);
 void cmd_join_uses_password_when_supplied(void** state);
+void cmd_join_joins_each_of_several_rooms(void** state);
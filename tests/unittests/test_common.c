@@ -282,6 +282,14 @@ utf8_display_len_all_wide(void** state)
     assert_int_equal(8, result);
 }
 
+void
+utf8_display_len_mixed_runs(void** state)
+{
+    int result = utf8_display_len("hello 世界, héllo wörld 四");
+
+    assert_int_equal(26, result);
+}
+
 void
 strip_quotes_does_nothing_when_no_quoted(void** state)
 {
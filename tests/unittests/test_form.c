@@ -23,6 +23,7 @@ _new_form(void)
     form->fields = NULL;
     form->var_to_tag = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
     form->tag_to_var = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
+    form->var_to_field = NULL;
     form->tag_ac = NULL;
 
     return form;
@@ -37,6 +38,7 @@ _new_field(void)
     field->description = NULL;
     field->required = FALSE;
     field->options = NULL;
+    field->option_values = NULL;
     field->var = NULL;
     field->values = NULL;
     field->value_ac = NULL;
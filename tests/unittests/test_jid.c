@@ -237,3 +237,18 @@ returns_barejid_when_fulljid_not_exists(void** state)
 
     jid_destroy(jid);
 }
+
+void
+create_same_jid_twice_shares_jid(void** state)
+{
+    Jid* first = jid_create("Someone@Server/Laptop");
+    Jid* second = jid_create("Someone@Server/Laptop");
+
+    assert_ptr_equal(first, second);
+    assert_string_equal("someone@server", second->barejid);
+    assert_string_equal("Someone@Server/Laptop", second->fulljid);
+
+    jid_destroy(first);
+    assert_string_equal("Laptop", second->resourcepart);
+    jid_destroy(second);
+}
@@ -0,0 +1,63 @@
+#include <glib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+
+#include "tools/matcher.h"
+
+static void
+_record_hit(int id, gsize start, gsize end, void* userdata)
+{
+    GString* hits = userdata;
+    g_string_append_printf(hits, "%d:%zu-%zu ", id, start, end);
+}
+
+void
+matcher_finds_overlapping_patterns(void** state)
+{
+    Matcher matcher = matcher_new();
+    matcher_add(matcher, "he", 1);
+    matcher_add(matcher, "she", 2);
+    matcher_add(matcher, "hers", 3);
+
+    GString* hits = g_string_new("");
+    matcher_scan(matcher, "ushers", _record_hit, hits);
+
+    assert_string_equal("2:1-4 1:2-4 3:2-6 ", hits->str);
+
+    g_string_free(hits, TRUE);
+    matcher_free(matcher);
+}
+
+void
+matcher_reports_each_id_of_repeated_pattern(void** state)
+{
+    Matcher matcher = matcher_new();
+    matcher_add(matcher, "bob", 0);
+    matcher_add(matcher, "", 1);
+    matcher_add(matcher, "bob", 2);
+
+    GString* hits = g_string_new("");
+    matcher_scan(matcher, "hi bob", _record_hit, hits);
+
+    assert_string_equal("2:3-6 0:3-6 ", hits->str);
+
+    g_string_free(hits, TRUE);
+    matcher_free(matcher);
+}
+
+void
+matcher_scan_without_patterns_finds_nothing(void** state)
+{
+    Matcher matcher = matcher_new();
+
+    GString* hits = g_string_new("");
+    matcher_scan(matcher, "anything", _record_hit, hits);
+
+    assert_string_equal("", hits->str);
+
+    g_string_free(hits, TRUE);
+    matcher_free(matcher);
+}
@@ -0,0 +1,3 @@
+void matcher_finds_overlapping_patterns(void** state);
+void matcher_reports_each_id_of_repeated_pattern(void** state);
+void matcher_scan_without_patterns_finds_nothing(void** state);
@@ -86,3 +86,119 @@ test_muc_active(void** state)
 
     assert_true(room_is_active);
 }
+
+void
+test_muc_roster_iter_orders_by_role_and_nick(void** state)
+{
+    char* room = "room@server.org";
+    muc_join(room, "bob", NULL, FALSE);
+    muc_roster_add(room, "zed", NULL, "participant", "member", NULL, NULL);
+    muc_roster_add(room, "amy", NULL, "moderator", "owner", NULL, NULL);
+    muc_roster_add(room, "kim", NULL, "participant", "none", NULL, NULL);
+    muc_roster_add(room, "amy", NULL, "participant", "owner", NULL, NULL);
+    muc_roster_remove(room, "kim");
+
+    GSequenceIter* iter = muc_roster_iter(room);
+    assert_string_equal("amy", muc_roster_iter_next(&iter)->nick);
+    assert_string_equal("zed", muc_roster_iter_next(&iter)->nick);
+    assert_null(muc_roster_iter_next(&iter));
+
+    iter = muc_roster_iter_role(room, MUC_ROLE_MODERATOR);
+    assert_null(muc_roster_iter_next(&iter));
+
+    GSList* participants = muc_occupants_by_role(room, MUC_ROLE_PARTICIPANT);
+    assert_int_equal(2, g_slist_length(participants));
+    assert_string_equal("amy", ((Occupant*)participants->data)->nick);
+    assert_string_equal("zed", ((Occupant*)participants->next->data)->nick);
+    g_slist_free(participants);
+}
+
+void
+test_muc_roster_iter_after_resumes_past_removed_occupant(void** state)
+{
+    char* room = "room@server.org";
+    muc_join(room, "bob", NULL, FALSE);
+    muc_roster_set_complete(room);
+    muc_roster_add(room, "amy", NULL, "participant", "none", NULL, NULL);
+    muc_roster_add(room, "kim", NULL, "moderator", "none", NULL, NULL);
+    muc_roster_add(room, "zed", NULL, "participant", "none", NULL, NULL);
+
+    GSequenceIter* iter = muc_roster_iter_after(room, NULL);
+    assert_string_equal("amy", muc_roster_iter_next(&iter)->nick);
+    Occupant* kim = muc_roster_iter_next(&iter);
+    assert_string_equal("kim", kim->nick);
+    gchar* after_key = g_strdup(kim->nick_collate_key);
+    muc_roster_remove(room, "kim");
+
+    iter = muc_roster_iter_after(room, after_key);
+    assert_string_equal("zed", muc_roster_iter_next(&iter)->nick);
+    assert_null(muc_roster_iter_next(&iter));
+
+    iter = muc_roster_iter_role_after(room, MUC_ROLE_PARTICIPANT, after_key);
+    assert_string_equal("zed", muc_roster_iter_next(&iter)->nick);
+    assert_null(muc_roster_iter_next(&iter));
+    g_free(after_key);
+}
+
+void
+test_muc_roster_join_burst_sorted_when_complete(void** state)
+{
+    char* room = "room@server.org";
+    muc_join(room, "bob", NULL, FALSE);
+    muc_roster_add(room, "zed", NULL, "participant", "none", NULL, NULL);
+    muc_roster_add(room, "kim", NULL, "participant", "none", NULL, NULL);
+    muc_roster_set_complete(room);
+    muc_roster_add(room, "amy", NULL, "participant", "none", NULL, NULL);
+
+    GSequenceIter* iter = muc_roster_iter_role(room, MUC_ROLE_PARTICIPANT);
+    assert_string_equal("amy", muc_roster_iter_next(&iter)->nick);
+    assert_string_equal("kim", muc_roster_iter_next(&iter)->nick);
+    assert_string_equal("zed", muc_roster_iter_next(&iter)->nick);
+    assert_null(muc_roster_iter_next(&iter));
+}
+
+void
+test_muc_roster_remove_keeps_order(void** state)
+{
+    char* room = "room@server.org";
+    muc_join(room, "bob", NULL, FALSE);
+    muc_roster_set_complete(room);
+    muc_roster_add(room, "zed", NULL, "participant", "none", NULL, NULL);
+    muc_roster_add(room, "amy", NULL, "participant", "none", NULL, NULL);
+    muc_roster_add(room, "kim", NULL, "participant", "none", NULL, NULL);
+    muc_roster_remove(room, "kim");
+
+    assert_int_equal(2, muc_roster_size(room));
+    GSequenceIter* iter = muc_roster_iter(room);
+    assert_string_equal("amy", muc_roster_iter_next(&iter)->nick);
+    assert_string_equal("zed", muc_roster_iter_next(&iter)->nick);
+    assert_null(muc_roster_iter_next(&iter));
+}
+
+void
+test_muc_autocomplete_offers_recent_speakers_first(void** state)
+{
+    char* room = "room@server.org";
+    muc_join(room, "bob", NULL, FALSE);
+    muc_roster_add(room, "amy", NULL, "participant", "none", NULL, NULL);
+    muc_roster_add(room, "andy", NULL, "participant", "none", NULL, NULL);
+    muc_roster_add(room, "anna", NULL, "participant", "none", NULL, NULL);
+    muc_roster_add(room, "zed", NULL, "participant", "none", NULL, NULL);
+    muc_roster_set_complete(room);
+    muc_speaker_add(room, "zed");
+    muc_speaker_add(room, "andy");
+
+    ProfMucWin mucwin;
+    mucwin.window.type = WIN_MUC;
+    mucwin.memcheck = PROFMUCWIN_MEMCHECK;
+    mucwin.roomjid = room;
+    ProfWin* window = &mucwin.window;
+
+    char* expected[] = { "andy: ", "amy: ", "anna: ", "andy: " };
+    for (int i = 0; i < 4; i++) {
+        char* result = muc_autocomplete(window, "a", FALSE);
+        assert_string_equal(expected[i], result);
+        free(result);
+    }
+    muc_autocomplete_reset(room);
+}
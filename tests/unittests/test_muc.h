@@ -7,3 +7,8 @@ void test_muc_invites_count_0(void** state);
 void test_muc_invites_count_5(void** state);
 void test_muc_room_is_not_active(void** state);
 void test_muc_active(void** state);
+void test_muc_roster_iter_orders_by_role_and_nick(void** state);
+void test_muc_roster_iter_after_resumes_past_removed_occupant(void** state);
+void test_muc_roster_join_burst_sorted_when_complete(void** state);
+void test_muc_roster_remove_keeps_order(void** state);
+void test_muc_autocomplete_offers_recent_speakers_first(void** state);
@@ -672,3 +672,35 @@ parse_options_with_duplicated_option_sets_error(void** state)
 
     options_destroy(options);
 }
+
+void
+parse_spans_point_into_input(void** state)
+{
+    char* inp = "  /cmd \"a b\" c  ";
+    GArray* spans = parse_spans(inp, -1);
+
+    assert_int_equal(3, spans->len);
+    ProfSpan* quoted = &g_array_index(spans, ProfSpan, 1);
+    assert_int_equal(8, quoted->start);
+    assert_int_equal(3, quoted->len);
+    assert_true(quoted->quoted);
+    gchar* last = parse_span_dup(inp, &g_array_index(spans, ProfSpan, 2));
+    assert_string_equal("c", last);
+
+    g_free(last);
+    g_array_free(spans, TRUE);
+}
+
+void
+parse_spans_with_freetext(void** state)
+{
+    char* inp = "/msg user@host here is a \"message\"";
+    GArray* spans = parse_spans(inp, 2);
+
+    assert_int_equal(3, spans->len);
+    gchar* text = parse_span_dup(inp, &g_array_index(spans, ProfSpan, 2));
+    assert_string_equal("here is a \"message\"", text);
+
+    g_free(text);
+    g_array_free(spans, TRUE);
+}
@@ -48,3 +48,5 @@ void parse_options_when_opt3_no_val_sets_error(void** state);
 void parse_options_when_three_returns_map(void** state);
 void parse_options_when_unknown_opt_sets_error(void** state);
 void parse_options_with_duplicated_option_sets_error(void** state);
+void parse_spans_point_into_input(void** state);
+void parse_spans_with_freetext(void** state);
@@ -37,3 +37,60 @@ statuses_muc_defaults_to_all(void** state)
     assert_string_equal("none", setting);
     g_free(setting);
 }
+
+void
+scrollback_defaults_to_200(void** state)
+{
+    assert_int_equal(200, prefs_get_scrollback("chat"));
+    assert_int_equal(200, prefs_get_scrollback("muc"));
+}
+
+void
+scrollback_is_per_window_type(void** state)
+{
+    prefs_set_scrollback("muc", 5000);
+
+    assert_int_equal(5000, prefs_get_scrollback("muc"));
+    assert_int_equal(200, prefs_get_scrollback("chat"));
+}
+
+void
+scrollback_out_of_range_uses_default(void** state)
+{
+    prefs_set_scrollback("chat", 1);
+
+    assert_int_equal(200, prefs_get_scrollback("chat"));
+}
+
+void
+db_retention_is_per_contact(void** state)
+{
+    prefs_set_db_retention(NULL, "365d");
+    prefs_set_db_retention("room@conference.example.org", "5000");
+
+    gchar* all = prefs_get_db_retention(NULL);
+    gchar* room = prefs_get_db_retention("room@conference.example.org");
+    GList* jids = prefs_get_db_retention_jids();
+
+    assert_string_equal("365d", all);
+    assert_string_equal("5000", room);
+    assert_null(prefs_get_db_retention("buddy@example.org"));
+    assert_int_equal(1, g_list_length(jids));
+    assert_string_equal("room@conference.example.org", jids->data);
+
+    g_free(all);
+    g_free(room);
+    g_list_free_full(jids, g_free);
+}
+
+void
+db_retention_off_removes_policy(void** state)
+{
+    prefs_set_db_retention("buddy@example.org", "30d");
+    prefs_set_db_retention("buddy@example.org", NULL);
+
+    GList* jids = prefs_get_db_retention_jids();
+
+    assert_null(prefs_get_db_retention("buddy@example.org"));
+    assert_null(jids);
+}
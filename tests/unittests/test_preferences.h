@@ -1,3 +1,8 @@
 void statuses_console_defaults_to_all(void** state);
 void statuses_chat_defaults_to_all(void** state);
 void statuses_muc_defaults_to_all(void** state);
+void scrollback_defaults_to_200(void** state);
+void scrollback_is_per_window_type(void** state);
+void scrollback_out_of_range_uses_default(void** state);
+void db_retention_is_per_contact(void** state);
+void db_retention_off_removes_policy(void** state);
@@ -721,3 +721,77 @@ get_contact_display_name_is_passed_barejid_if_contact_does_not_exist(void** stat
 
     roster_destroy();
 }
+
+void
+change_name_reorders_contacts(void** state)
+{
+    roster_create();
+    roster_add("a@server.org", "Zed", NULL, NULL, FALSE);
+    roster_add("b@server.org", "Amy", NULL, NULL, FALSE);
+
+    roster_change_name(roster_get_contact("b@server.org"), "Zoe");
+
+    GSList* list = roster_get_contacts(ROSTER_ORD_NAME);
+    assert_int_equal(2, g_slist_length(list));
+    assert_string_equal("a@server.org", p_contact_barejid(list->data));
+    assert_string_equal("b@server.org", p_contact_barejid(list->next->data));
+
+    g_slist_free(list);
+    roster_destroy();
+}
+
+void
+presence_update_reorders_contacts(void** state)
+{
+    roster_create();
+    roster_add("a@server.org", "Amy", NULL, NULL, FALSE);
+    roster_add("b@server.org", "Bob", NULL, NULL, FALSE);
+    roster_process_pending_presence();
+
+    Resource* resource = resource_new("laptop", RESOURCE_ONLINE, NULL, 0);
+    roster_update_presence("b@server.org", resource, NULL);
+
+    GSList* list = roster_get_contacts(ROSTER_ORD_PRESENCE);
+    assert_int_equal(2, g_slist_length(list));
+    assert_string_equal("b@server.org", p_contact_barejid(list->data));
+    assert_string_equal("a@server.org", p_contact_barejid(list->next->data));
+    g_slist_free(list);
+
+    roster_contact_offline("b@server.org", "laptop", NULL);
+
+    list = roster_get_contacts(ROSTER_ORD_PRESENCE);
+    assert_string_equal("a@server.org", p_contact_barejid(list->data));
+    g_slist_free(list);
+
+    roster_destroy();
+}
+
+void
+iter_group_walks_group_in_order(void** state)
+{
+    roster_create();
+
+    GSList* groups1 = NULL;
+    groups1 = g_slist_append(groups1, strdup("friends"));
+    roster_add("c@server.org", NULL, groups1, NULL, FALSE);
+
+    GSList* groups2 = NULL;
+    groups2 = g_slist_append(groups2, strdup("friends"));
+    roster_add("a@server.org", NULL, groups2, NULL, FALSE);
+
+    roster_add("b@server.org", NULL, NULL, NULL, FALSE);
+
+    GSequenceIter* iter = roster_iter_group("friends", ROSTER_ORD_NAME);
+    assert_string_equal("a@server.org", p_contact_barejid(roster_iter_next(&iter)));
+    assert_string_equal("c@server.org", p_contact_barejid(roster_iter_next(&iter)));
+    assert_null(roster_iter_next(&iter));
+
+    iter = roster_iter_group(NULL, ROSTER_ORD_NAME);
+    assert_string_equal("b@server.org", p_contact_barejid(roster_iter_next(&iter)));
+    assert_null(roster_iter_next(&iter));
+
+    iter = roster_iter_group("nonexistent", ROSTER_ORD_NAME);
+    assert_null(roster_iter_next(&iter));
+
+    roster_destroy();
+}
@@ -33,3 +33,6 @@ void remove_contact_with_remaining_in_group(void** state);
 void get_contact_display_name(void** state);
 void get_contact_display_name_is_barejid_if_name_is_empty(void** state);
 void get_contact_display_name_is_passed_barejid_if_contact_does_not_exist(void** state);
+void change_name_reorders_contacts(void** state);
+void presence_update_reorders_contacts(void** state);
+void iter_group_walks_group_in_order(void** state);
@@ -0,0 +1,170 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "common.h"
+#include "stats.h"
+
+void
+stats_rate_counts_last_tick(void** state)
+{
+    stats_reset();
+
+    stats_stanza_received(STATS_STANZA_MESSAGE);
+    stats_stanza_received(STATS_STANZA_MESSAGE);
+    stats_stanza_sent(STATS_STANZA_IQ);
+    stats_tick();
+    stats_stanza_received(STATS_STANZA_MESSAGE);
+
+    assert_int_equal(stats_stanza_rate(FALSE, STATS_STANZA_MESSAGE), 2);
+    assert_int_equal(stats_stanza_total(FALSE, STATS_STANZA_MESSAGE), 3);
+    assert_int_equal(stats_stanza_rate(TRUE, STATS_STANZA_IQ), 1);
+    assert_int_equal(stats_stanza_rate(TRUE, STATS_STANZA_MESSAGE), 0);
+
+    stats_tick();
+
+    assert_int_equal(stats_stanza_rate(FALSE, STATS_STANZA_MESSAGE), 1);
+    assert_int_equal(stats_stanza_rate(TRUE, STATS_STANZA_IQ), 0);
+}
+
+void
+stats_timer_tracks_calls_and_max(void** state)
+{
+    stats_reset();
+
+    gint64 now = g_get_monotonic_time();
+    stats_time(STATS_TIMER_UI_UPDATE, now - 100);
+    stats_time(STATS_TIMER_UI_UPDATE, now - 3000);
+
+    ProfStatsTimer timer;
+    stats_timer_get(STATS_TIMER_UI_UPDATE, &timer);
+
+    assert_int_equal(timer.calls, 2);
+    assert_true(timer.max_us >= 3000);
+    assert_true(timer.total_us >= 3100);
+    assert_true(timer.avg_us >= 1550);
+}
+
+void
+stats_timer_p99_ignores_outlier(void** state)
+{
+    stats_reset();
+
+    gint64 now = g_get_monotonic_time();
+    for (int i = 0; i < 199; i++) {
+        stats_time(STATS_TIMER_TICK, now);
+    }
+    stats_time(STATS_TIMER_TICK, now - G_USEC_PER_SEC);
+
+    ProfStatsTimer timer;
+    stats_timer_get(STATS_TIMER_TICK, &timer);
+
+    assert_int_equal(timer.calls, 200);
+    assert_true(timer.max_us >= G_USEC_PER_SEC);
+    assert_true(timer.p99_us < G_USEC_PER_SEC);
+}
+
+void
+stats_reset_clears_counters(void** state)
+{
+    stats_stanza_received(STATS_STANZA_PRESENCE);
+    stats_time(STATS_TIMER_DB_QUEUE, g_get_monotonic_time());
+    stats_tick();
+
+    stats_reset();
+
+    ProfStatsTimer timer;
+    stats_timer_get(STATS_TIMER_DB_QUEUE, &timer);
+    assert_int_equal(timer.calls, 0);
+    assert_int_equal(timer.p99_us, 0);
+    assert_int_equal(stats_stanza_total(FALSE, STATS_STANZA_PRESENCE), 0);
+    assert_int_equal(stats_stanza_rate(FALSE, STATS_STANZA_PRESENCE), 0);
+}
+
+void
+stats_counter_counts_until_reset(void** state)
+{
+    stats_reset();
+
+    stats_count(STATS_COUNTER_PRESENCE_UNCHANGED);
+    stats_count(STATS_COUNTER_PRESENCE_UNCHANGED);
+    stats_tick();
+
+    assert_int_equal(stats_counter_total(STATS_COUNTER_PRESENCE_UNCHANGED), 2);
+
+    stats_reset();
+
+    assert_int_equal(stats_counter_total(STATS_COUNTER_PRESENCE_UNCHANGED), 0);
+}
+
+void
+stats_span_ignored_without_trace(void** state)
+{
+    assert_false(stats_tracing());
+    assert_int_equal(stats_trace_begin(), 0);
+
+    stats_span("nothing", g_get_monotonic_time());
+
+    assert_int_equal(stats_trace_stop(NULL), 0);
+}
+
+void
+stats_trace_writes_spans(void** state)
+{
+    auto_gchar gchar* path = g_build_filename(g_get_tmp_dir(), "prof_test_trace.json", NULL);
+
+    assert_true(stats_trace_start(path));
+    assert_false(stats_trace_start(path));
+
+    gint64 start = stats_trace_begin();
+    assert_true(start > 0);
+    stats_span("handler \"quoted\"", start);
+    stats_time(STATS_TIMER_UI_UPDATE, start);
+
+    assert_int_equal(stats_trace_stop(NULL), 2);
+    assert_false(stats_tracing());
+
+    auto_gchar gchar* contents = NULL;
+    assert_true(g_file_get_contents(path, &contents, NULL, NULL));
+    assert_non_null(strstr(contents, "{\"traceEvents\":["));
+    assert_non_null(strstr(contents, "\"name\":\"handler \\\"quoted\\\"\",\"ph\":\"X\""));
+    assert_non_null(strstr(contents, "\"name\":\"ui_update\""));
+
+    g_remove(path);
+}
+
+void
+stats_latency_records_once_per_update(void** state)
+{
+    stats_reset();
+
+    stats_latency_begin(STATS_TIMER_KEY_TO_SCREEN);
+    g_usleep(2000);
+    stats_latency_begin(STATS_TIMER_KEY_TO_SCREEN);
+    stats_latency_end();
+    stats_latency_end();
+
+    ProfStatsTimer timer;
+    stats_timer_get(STATS_TIMER_KEY_TO_SCREEN, &timer);
+    assert_int_equal(timer.calls, 1);
+    assert_true(timer.max_us >= 2000);
+
+    stats_timer_get(STATS_TIMER_STANZA_TO_SCREEN, &timer);
+    assert_int_equal(timer.calls, 0);
+}
+
+void
+stats_budget_times_spans(void** state)
+{
+    stats_set_budget(50);
+    assert_int_equal(stats_get_budget(), 50);
+    assert_true(stats_trace_begin() > 0);
+
+    stats_set_budget(0);
+    assert_int_equal(stats_get_budget(), 0);
+    assert_int_equal(stats_trace_begin(), 0);
+}
@@ -0,0 +1,9 @@
+void stats_rate_counts_last_tick(void** state);
+void stats_timer_tracks_calls_and_max(void** state);
+void stats_timer_p99_ignores_outlier(void** state);
+void stats_reset_clears_counters(void** state);
+void stats_counter_counts_until_reset(void** state);
+void stats_span_ignored_without_trace(void** state);
+void stats_trace_writes_spans(void** state);
+void stats_latency_records_once_per_update(void** state);
+void stats_budget_times_spans(void** state);
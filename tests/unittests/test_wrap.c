@@ -0,0 +1,107 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <stdlib.h>
+
+#include "ui/wrap.h"
+
+static void
+_assert_seg(ProfWrap* wrap, int i, int line, int col, int start, int len)
+{
+    assert_true(i < wrap->count);
+    assert_int_equal(wrap->segs[i].line, line);
+    assert_int_equal(wrap->segs[i].col, col);
+    assert_int_equal(wrap->segs[i].start, start);
+    assert_int_equal(wrap->segs[i].len, len);
+}
+
+void
+wrap_keeps_short_message_on_one_line(void** state)
+{
+    ProfWrap* wrap = wrap_layout("hello world", 10, 80, 8, 0);
+
+    assert_int_equal(wrap->lines, 1);
+    assert_int_equal(wrap->count, 1);
+    _assert_seg(wrap, 0, 0, 10, 0, 11);
+
+    wrap_free(wrap);
+}
+
+void
+wrap_breaks_between_words(void** state)
+{
+    ProfWrap* wrap = wrap_layout("aaaa bbbb", 0, 6, 0, 0);
+
+    assert_int_equal(wrap->lines, 2);
+    assert_int_equal(wrap->count, 2);
+    _assert_seg(wrap, 0, 0, 0, 0, 5);
+    _assert_seg(wrap, 1, 1, 0, 5, 4);
+
+    wrap_free(wrap);
+}
+
+void
+wrap_indents_lines_after_newline(void** state)
+{
+    ProfWrap* wrap = wrap_layout("a\nb", 3, 20, 3, 2);
+
+    assert_int_equal(wrap->lines, 2);
+    assert_int_equal(wrap->count, 2);
+    _assert_seg(wrap, 0, 0, 3, 0, 1);
+    _assert_seg(wrap, 1, 1, 5, 2, 1);
+
+    wrap_free(wrap);
+}
+
+void
+wrap_splits_word_longer_than_line(void** state)
+{
+    ProfWrap* wrap = wrap_layout("abcdefgh", 0, 4, 0, 0);
+
+    assert_int_equal(wrap->lines, 2);
+    assert_int_equal(wrap->count, 2);
+    _assert_seg(wrap, 0, 0, 0, 0, 4);
+    _assert_seg(wrap, 1, 1, 0, 4, 4);
+
+    wrap_free(wrap);
+}
+
+void
+wrap_skips_invalid_utf8(void** state)
+{
+    ProfWrap* wrap = wrap_layout("ab\xff" "cd", 0, 80, 0, 0);
+
+    assert_int_equal(wrap->lines, 1);
+    assert_int_equal(wrap->count, 2);
+    _assert_seg(wrap, 0, 0, 0, 0, 2);
+    _assert_seg(wrap, 1, 0, 2, 3, 2);
+
+    wrap_free(wrap);
+}
+
+void
+wrap_moves_wide_char_that_does_not_fit(void** state)
+{
+    ProfWrap* wrap = wrap_layout("日本", 0, 3, 0, 0);
+
+    assert_int_equal(wrap->lines, 2);
+    assert_int_equal(wrap->count, 2);
+    _assert_seg(wrap, 0, 0, 0, 0, 3);
+    _assert_seg(wrap, 1, 1, 0, 3, 3);
+
+    wrap_free(wrap);
+}
+
+void
+wrap_matches_only_same_geometry(void** state)
+{
+    ProfWrap* wrap = wrap_layout("hello", 4, 80, 4, 0);
+
+    assert_true(wrap_matches(wrap, 4, 80, 4, 0));
+    assert_false(wrap_matches(wrap, 4, 100, 4, 0));
+    assert_false(wrap_matches(wrap, 6, 80, 4, 0));
+    assert_false(wrap_matches(NULL, 4, 80, 4, 0));
+
+    wrap_free(wrap);
+}
@@ -0,0 +1,7 @@
+void wrap_keeps_short_message_on_one_line(void** state);
+void wrap_breaks_between_words(void** state);
+void wrap_indents_lines_after_newline(void** state);
+void wrap_splits_word_longer_than_line(void** state);
+void wrap_skips_invalid_utf8(void** state);
+void wrap_moves_wide_char_that_does_not_fit(void** state);
+void wrap_matches_only_same_geometry(void** state);
@@ -0,0 +1,17 @@
+#include <glib.h>
+
+gboolean
+control_init(const char* const path)
+{
+    return TRUE;
+}
+
+void
+control_close(void)
+{
+}
+
+void
+control_event(const char* const event, ...)
+{
+}
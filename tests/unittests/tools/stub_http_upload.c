@@ -32,6 +32,12 @@ file_mime_type(const char* const file_name)
     return NULL;
 }
 
+FILE*
+http_upload_downscale_image(const char* const filename, const char* const mime_type, int max_pixels)
+{
+    return NULL;
+}
+
 off_t
 file_size(const char* const file_name)
 {
@@ -41,4 +47,12 @@ file_size(const char* const file_name)
 void http_upload_cancel_processes(){};
 void http_upload_add_upload(){};
 
+void*
+http_upload_batch_new(ProfWin* window)
+{
+    return NULL;
+}
+void http_upload_batch_add(){};
+void http_upload_batch_start(){};
+
 #endif
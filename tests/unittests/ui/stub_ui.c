@@ -63,6 +63,18 @@ ui_update(void)
 {
 }
 void
+ui_mark_dirty(void)
+{
+}
+void
+ui_mark_dirty_part(ui_dirty_t parts)
+{
+}
+void
+ui_tick(void)
+{
+}
+void
 ui_close(void)
 {
 }
@@ -150,6 +162,17 @@ chatwin_new(const char* const barejid)
     return NULL;
 }
 
+void
+chatwin_history_load(ProfChatWin* chatwin)
+{
+}
+
+ProfMucWin*
+mucwin_new(const char* const barejid)
+{
+    return NULL;
+}
+
 void
 ui_print_system_msg_from_recipient(const char* const barejid, const char* message)
 {
@@ -240,7 +263,23 @@ ui_get_line(void)
 }
 
 void
-xmlwin_show(ProfXMLWin* xmlwin, const char* const msg)
+xmlwin_capture(ProfXMLWin* xmlwin, const char* const msg)
+{
+}
+
+void
+xmlwin_render(ProfXMLWin* xmlwin)
+{
+}
+
+gboolean
+xmlwin_set_filter(ProfXMLWin* xmlwin, const char* const type, const char* const value)
+{
+    return TRUE;
+}
+
+void
+xmlwin_show_filters(ProfXMLWin* xmlwin)
 {
 }
 
@@ -359,7 +398,7 @@ mucwin_occupant_role_and_affiliation_change(ProfMucWin* mucwin, const char* cons
 {
 }
 void
-mucwin_roster(ProfMucWin* mucwin, GList* occupants, const char* const presence)
+mucwin_roster(ProfMucWin* mucwin, const char* const presence)
 {
 }
 void
@@ -370,6 +409,19 @@ void
 mucwin_incoming_msg(ProfMucWin* mucwin, const ProfMessage* const message, GSList* mentions, GList* triggers, gboolean filter_reflection)
 {
 }
+gboolean
+mucwin_flood_count(ProfMucWin* mucwin)
+{
+    return FALSE;
+}
+void
+mucwin_flood_hold(ProfMucWin* mucwin, gboolean mention, gboolean notify_wanted)
+{
+}
+void
+mucwin_flood_check(void)
+{
+}
 void
 mucwin_outgoing_msg(ProfMucWin* mucwin, const char* const message, const char* const id, prof_enc_t enc_mode, const char* const replace_id)
 {
@@ -684,6 +736,17 @@ inp_nonblocking(gboolean reset)
 {
 }
 
+void
+inp_set_focus_reporting(gboolean enabled)
+{
+}
+
+gboolean
+inp_terminal_focused(void)
+{
+    return TRUE;
+}
+
 void
 ui_inp_history_append(char* inp)
 {
@@ -1029,6 +1092,10 @@ cons_wrap_setting(void)
 {
 }
 void
+cons_redraw_setting(void)
+{
+}
+void
 cons_winstidy_setting(void)
 {
 }
@@ -1077,6 +1144,10 @@ cons_carbons_setting(void)
 {
 }
 void
+cons_csi_setting(void)
+{
+}
+void
 cons_receipts_setting(void)
 {
 }
@@ -1109,10 +1180,18 @@ cons_rooms_cache_setting(void)
 {
 }
 void
+cons_url_setting(void)
+{
+}
+void
 cons_inpblock_setting(void)
 {
 }
 void
+cons_scrollback_setting(void)
+{
+}
+void
 cons_winpos_setting(void)
 {
 }
@@ -1137,6 +1216,10 @@ cons_slashguard_setting(void)
 {
 }
 void
+cons_fuzzy_setting(void)
+{
+}
+void
 cons_mam_setting(void)
 {
 }
@@ -1210,6 +1293,10 @@ void
 status_bar_set_all_inactive(void)
 {
 }
+void
+status_bar_names_changed(void)
+{
+}
 
 // roster window
 void
@@ -1280,9 +1367,22 @@ win_update_virtual(ProfWin* window)
 {
 }
 void
+win_invalidate_virtual(void)
+{
+}
+void
 win_free(ProfWin* window)
 {
 }
+void
+win_layout_free(ProfLayout* layout)
+{
+}
+ProfLayout*
+win_layout_detach(ProfWin* window)
+{
+    return NULL;
+}
 gboolean
 win_notify_remind(ProfWin* window)
 {
@@ -1299,6 +1399,18 @@ win_resize(ProfWin* window)
 {
 }
 void
+win_resize_lazy(ProfWin* window)
+{
+}
+void
+win_resize_if_stale(ProfWin* window)
+{
+}
+void
+win_apply_scrollback(ProfWin* window)
+{
+}
+void
 win_hide_subwin(ProfWin* window)
 {
 }
@@ -1377,6 +1489,12 @@ win_to_string(ProfWin* window)
 {
     return NULL;
 }
+void
+win_buffer_stats(ProfWin* window, int* entries, gsize* bytes)
+{
+    *entries = 0;
+    *bytes = 0;
+}
 
 // desktop notifier actions
 void
@@ -1398,6 +1516,10 @@ notify_room_message(const char* const handle, const char* const room,
 {
 }
 void
+notify_room_flood(const char* const room, int win, int count)
+{
+}
+void
 notify_remind(void)
 {
 }
@@ -1423,6 +1545,10 @@ void
 cons_clear_alerts(void)
 {
 }
+void
+cons_clear_views(void)
+{
+}
 gboolean
 cons_has_alerts(void)
 {
@@ -14,6 +14,8 @@
 #include "xmpp/chat_session.h"
 #include "helpers.h"
 #include "test_autocomplete.h"
+#include "test_matcher.h"
+#include "test_base64.h"
 #include "test_chat_session.h"
 #include "test_common.h"
 #include "test_contact.h"
@@ -38,6 +40,8 @@
 #include "test_form.h"
 #include "test_callbacks.h"
 #include "test_plugins_disco.h"
+#include "test_stats.h"
+#include "test_wrap.h"
 
 int
 main(int argc, char* argv[])
@@ -86,6 +90,7 @@ main(int argc, char* argv[])
         cmocka_unit_test(utf8_display_len_non_wide),
         cmocka_unit_test(utf8_display_len_wide),
         cmocka_unit_test(utf8_display_len_all_wide),
+        cmocka_unit_test(utf8_display_len_mixed_runs),
         cmocka_unit_test(strip_quotes_does_nothing_when_no_quoted),
         cmocka_unit_test(strip_quotes_strips_first),
         cmocka_unit_test(strip_quotes_strips_last),
@@ -109,6 +114,21 @@ main(int argc, char* argv[])
         cmocka_unit_test(complete_both_with_base),
         cmocka_unit_test(complete_ignores_case),
         cmocka_unit_test(complete_previous),
+        cmocka_unit_test(add_all_sorts_items),
+        cmocka_unit_test(complete_after_remove_continues),
+        cmocka_unit_test(bulk_add_sorts_on_end),
+        cmocka_unit_test(complete_during_bulk_add),
+        cmocka_unit_test(fuzzy_complete_ranks_matches),
+        cmocka_unit_test(fuzzy_complete_narrows_previous_matches),
+        cmocka_unit_test(complete_cycles_matches_in_order),
+
+        cmocka_unit_test(matcher_finds_overlapping_patterns),
+        cmocka_unit_test(matcher_reports_each_id_of_repeated_pattern),
+        cmocka_unit_test(matcher_scan_without_patterns_finds_nothing),
+
+        cmocka_unit_test(base64_matches_glib_for_every_length),
+        cmocka_unit_test(base64_decode_skips_line_breaks),
+        cmocka_unit_test(base64_decode_into_reuses_buffer),
 
         cmocka_unit_test(create_jid_from_null_returns_null),
         cmocka_unit_test(create_jid_from_empty_string_returns_null),
@@ -135,6 +155,7 @@ main(int argc, char* argv[])
         cmocka_unit_test(create_full_with_trailing_slash),
         cmocka_unit_test(returns_fulljid_when_exists),
         cmocka_unit_test(returns_barejid_when_fulljid_not_exists),
+        cmocka_unit_test(create_same_jid_twice_shares_jid),
 
         cmocka_unit_test(parse_null_returns_null),
         cmocka_unit_test(parse_empty_returns_null),
@@ -186,6 +207,8 @@ main(int argc, char* argv[])
         cmocka_unit_test(parse_options_when_three_returns_map),
         cmocka_unit_test(parse_options_when_unknown_opt_sets_error),
         cmocka_unit_test(parse_options_with_duplicated_option_sets_error),
+        cmocka_unit_test(parse_spans_point_into_input),
+        cmocka_unit_test(parse_spans_with_freetext),
 
         cmocka_unit_test(empty_list_when_none_added),
         cmocka_unit_test(contains_one_element),
@@ -222,6 +245,9 @@ main(int argc, char* argv[])
         cmocka_unit_test(get_contact_display_name),
         cmocka_unit_test(get_contact_display_name_is_barejid_if_name_is_empty),
         cmocka_unit_test(get_contact_display_name_is_passed_barejid_if_contact_does_not_exist),
+        cmocka_unit_test(change_name_reorders_contacts),
+        cmocka_unit_test(presence_update_reorders_contacts),
+        cmocka_unit_test(iter_group_walks_group_in_order),
 
         cmocka_unit_test_setup_teardown(returns_false_when_chat_session_does_not_exist,
                                         init_chat_sessions,
@@ -447,6 +473,21 @@ main(int argc, char* argv[])
         cmocka_unit_test_setup_teardown(statuses_muc_defaults_to_all,
                                         load_preferences,
                                         close_preferences),
+        cmocka_unit_test_setup_teardown(scrollback_defaults_to_200,
+                                        load_preferences,
+                                        close_preferences),
+        cmocka_unit_test_setup_teardown(scrollback_is_per_window_type,
+                                        load_preferences,
+                                        close_preferences),
+        cmocka_unit_test_setup_teardown(scrollback_out_of_range_uses_default,
+                                        load_preferences,
+                                        close_preferences),
+        cmocka_unit_test_setup_teardown(db_retention_is_per_contact,
+                                        load_preferences,
+                                        close_preferences),
+        cmocka_unit_test_setup_teardown(db_retention_off_removes_policy,
+                                        load_preferences,
+                                        close_preferences),
 
         cmocka_unit_test_setup_teardown(console_shows_online_presence_when_set_online,
                                         load_preferences,
@@ -488,6 +529,11 @@ main(int argc, char* argv[])
         cmocka_unit_test_setup_teardown(test_muc_invites_count_5, muc_before_test, muc_after_test),
         cmocka_unit_test_setup_teardown(test_muc_room_is_not_active, muc_before_test, muc_after_test),
         cmocka_unit_test_setup_teardown(test_muc_active, muc_before_test, muc_after_test),
+        cmocka_unit_test_setup_teardown(test_muc_roster_iter_orders_by_role_and_nick, muc_before_test, muc_after_test),
+        cmocka_unit_test_setup_teardown(test_muc_roster_iter_after_resumes_past_removed_occupant, muc_before_test, muc_after_test),
+        cmocka_unit_test_setup_teardown(test_muc_roster_join_burst_sorted_when_complete, muc_before_test, muc_after_test),
+        cmocka_unit_test_setup_teardown(test_muc_roster_remove_keeps_order, muc_before_test, muc_after_test),
+        cmocka_unit_test_setup_teardown(test_muc_autocomplete_offers_recent_speakers_first, muc_before_test, muc_after_test),
 
         cmocka_unit_test(cmd_bookmark_shows_message_when_disconnected),
         cmocka_unit_test(cmd_bookmark_shows_message_when_disconnecting),
@@ -575,6 +621,7 @@ main(int argc, char* argv[])
         cmocka_unit_test(cmd_join_uses_supplied_nick),
         cmocka_unit_test(cmd_join_uses_account_nick_when_not_supplied),
         cmocka_unit_test(cmd_join_uses_password_when_supplied),
+        cmocka_unit_test(cmd_join_joins_each_of_several_rooms),
 
         cmocka_unit_test(cmd_roster_shows_message_when_disconnecting),
         cmocka_unit_test(cmd_roster_shows_message_when_connecting),
@@ -625,6 +672,7 @@ main(int argc, char* argv[])
 
         cmocka_unit_test(returns_no_commands),
         cmocka_unit_test(returns_commands),
+        cmocka_unit_test(returns_deferred_commands_until_removed),
 
         cmocka_unit_test(returns_empty_list_when_none),
         cmocka_unit_test(returns_added_feature),
@@ -633,6 +681,24 @@ main(int argc, char* argv[])
         cmocka_unit_test(does_not_add_duplicate_feature),
         cmocka_unit_test(removes_plugin_features),
         cmocka_unit_test(does_not_remove_feature_when_more_than_one_reference),
+
+        cmocka_unit_test(stats_rate_counts_last_tick),
+        cmocka_unit_test(stats_timer_tracks_calls_and_max),
+        cmocka_unit_test(stats_timer_p99_ignores_outlier),
+        cmocka_unit_test(stats_reset_clears_counters),
+        cmocka_unit_test(stats_counter_counts_until_reset),
+        cmocka_unit_test(stats_span_ignored_without_trace),
+        cmocka_unit_test(stats_trace_writes_spans),
+        cmocka_unit_test(stats_latency_records_once_per_update),
+        cmocka_unit_test(stats_budget_times_spans),
+
+        cmocka_unit_test(wrap_keeps_short_message_on_one_line),
+        cmocka_unit_test(wrap_breaks_between_words),
+        cmocka_unit_test(wrap_indents_lines_after_newline),
+        cmocka_unit_test(wrap_splits_word_longer_than_line),
+        cmocka_unit_test(wrap_skips_invalid_utf8),
+        cmocka_unit_test(wrap_moves_wide_char_that_does_not_fit),
+        cmocka_unit_test(wrap_matches_only_same_geometry),
     };
 
     return cmocka_run_group_tests(all_tests, NULL, NULL);
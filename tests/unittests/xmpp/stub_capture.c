@@ -0,0 +1,29 @@
+#include <glib.h>
+
+gboolean
+capture_start(void)
+{
+    return FALSE;
+}
+
+void
+capture_stop(void)
+{
+}
+
+gboolean
+capture_active(void)
+{
+    return FALSE;
+}
+
+const char*
+capture_get_path(void)
+{
+    return NULL;
+}
+
+void
+capture_log(const char* const msg)
+{
+}
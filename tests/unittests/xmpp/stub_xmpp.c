@@ -18,6 +18,10 @@ void
 session_check_autoaway(void)
 {
 }
+void
+session_check_csi(void)
+{
+}
 
 jabber_conn_status_t
 session_connect_with_details(const char* const jid,
@@ -157,6 +161,17 @@ connection_supports(const char* const feature)
     return FALSE;
 }
 
+gboolean
+connection_sm_resumable(void)
+{
+    return FALSE;
+}
+
+void
+connection_set_csi(gboolean active)
+{
+}
+
 const char*
 connection_get_profanity_identifier(void)
 {
@@ -255,6 +270,29 @@ message_is_sent_by_us(const ProfMessage* const message, bool checkOID)
     return TRUE;
 }
 
+GList*
+message_requests_list(void)
+{
+    return NULL;
+}
+
+guint
+message_requests_overflow_count(void)
+{
+    return 0;
+}
+
+gboolean
+message_request_accept(const char* const barejid)
+{
+    return FALSE;
+}
+
+void
+message_requests_clear(void)
+{
+}
+
 // presence functions
 void
 presence_subscription(const char* const jid, const jabber_subscr_t action)
@@ -342,9 +380,10 @@ void
 iq_set_autoping(int seconds)
 {
 }
-void
+gboolean
 iq_http_upload_request(HTTPUpload* upload)
 {
+    return FALSE;
 }
 void
 iq_confirm_instant_room(const char* const room_jid)
@@ -420,8 +459,13 @@ iq_autoping_timer_cancel(void)
 {
 }
 void
-iq_autoping_check(void)
+iq_timeouts_check(void)
+{
+}
+guint
+iq_id_handlers_count(void)
 {
+    return 0;
 }
 void
 iq_rooms_cache_clear(void)
@@ -450,6 +494,11 @@ iq_mam_request(ProfChatWin* win, GDateTime* enddate)
 {
 }
 
+void
+iq_mam_room_request(ProfMucWin* mucwin)
+{
+}
+
 void
 iq_feature_retrieval_complete_handler(void)
 {
@@ -592,6 +641,12 @@ blocked_list(void)
     return NULL;
 }
 
+gboolean
+blocked_contains(const char* const from)
+{
+    return FALSE;
+}
+
 gboolean
 blocked_add(char* jid, blocked_report reportkind, const char* const message)
 {